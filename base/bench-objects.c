@@ -0,0 +1,183 @@
+/*
+ * Benchmark of the sweeps over all services, which are bound by how
+ * the services are laid out in memory.
+ *
+ * It generates a config with the given number of hosts and services
+ * per host, loads it the way nagios does and times sweeps over
+ * service_list with a cold cache:
+ *   freshness - check_service_result_freshness()
+ *   orphan    - check_for_orphaned_services()
+ *   state     - counting hard problems, as the status updates look at
+ *               the state of every service
+ *
+ * usage: bench-objects [hosts [services-per-host [runs]]]
+ */
+#include "../include/config.h"
+#include "../include/common.h"
+#include "../include/objects.h"
+#include "../include/nagios.h"
+#include "../lib/histogram.h"
+#include <sys/time.h>
+
+#define EVICT_SIZE (256 * 1024 * 1024)
+
+static char dir[] = "/tmp/bench-objects.XXXXXX";
+static char *evict_buf;
+
+
+static uint64_t tv_usec(struct timeval *start, struct timeval *stop) {
+	return (stop->tv_sec - start->tv_sec) * 1000000 + stop->tv_usec - start->tv_usec;
+	}
+
+
+static FILE *open_file(const char *name) {
+	char path[PATH_MAX];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	if((fp = fopen(path, "w")) == NULL) {
+		perror(path);
+		exit(1);
+		}
+	return fp;
+	}
+
+
+static void write_config(unsigned int hosts, unsigned int services) {
+	unsigned int h, s;
+	FILE *fp;
+
+	fp = open_file("objects.cfg");
+	fprintf(fp, "define timeperiod {\n\ttimeperiod_name\t24x7\n\talias\t24x7\n");
+	fprintf(fp, "\tsunday\t00:00-24:00\n\tmonday\t00:00-24:00\n\ttuesday\t00:00-24:00\n\twednesday\t00:00-24:00\n");
+	fprintf(fp, "\tthursday\t00:00-24:00\n\tfriday\t00:00-24:00\n\tsaturday\t00:00-24:00\n\t}\n\n");
+	fprintf(fp, "define command {\n\tcommand_name\tok\n\tcommand_line\t/bin/true\n\t}\n\n");
+	fprintf(fp, "define contact {\n\tcontact_name\tbench\n\tservice_notification_period\t24x7\n\thost_notification_period\t24x7\n");
+	fprintf(fp, "\tservice_notification_commands\tok\n\thost_notification_commands\tok\n\t}\n\n");
+	for(h = 0; h < hosts; h++) {
+		fprintf(fp, "define host {\n\thost_name\thost-%u.example.com\n\taddress\t127.0.0.1\n\tcheck_period\t24x7\n", h);
+		fprintf(fp, "\tcheck_command\tok\n\tcontacts\tbench\n\tmax_check_attempts\t3\n\tnotification_period\t24x7\n");
+		fprintf(fp, "\tnotes_url\thttp://wiki.example.com/hosts/host-%u\n\t}\n\n", h);
+		}
+	for(h = 0; h < hosts; h++) {
+		for(s = 0; s < services; s++) {
+			fprintf(fp, "define service {\n\thost_name\thost-%u.example.com\n\tservice_description\tService number %u\n", h, s);
+			fprintf(fp, "\tcheck_period\t24x7\n\tcheck_command\tok\n\tcontacts\tbench\n\tmax_check_attempts\t3\n");
+			fprintf(fp, "\tnotification_period\t24x7\n\tnotes\tWhat service %u on host %u is for\n\t}\n\n", s, h);
+			}
+		}
+	fclose(fp);
+
+	fp = open_file("nagios.cfg");
+	fprintf(fp, "cfg_file=%s/objects.cfg\nlog_file=%s/nagios.log\ncheck_result_path=%s\ntemp_path=%s\n", dir, dir, dir, dir);
+	fprintf(fp, "check_service_freshness=1\n");
+	fclose(fp);
+	}
+
+
+static void evict_cache(void) {
+	unsigned int i;
+
+	for(i = 0; i < EVICT_SIZE; i += 64)
+		evict_buf[i]++;
+	}
+
+
+static volatile unsigned int problems;
+
+static void state_sweep(void) {
+	service *svc;
+
+	problems = 0;
+	for(svc = service_list; svc; svc = svc->next) {
+		if(svc->has_been_checked == TRUE && svc->current_state != STATE_OK && svc->state_type == HARD_STATE)
+			problems++;
+		}
+	}
+
+
+static void bench(const char *name, void (*sweep)(void), unsigned int runs) {
+	struct timeval start, stop;
+	unsigned long long total = 0;
+	unsigned int i;
+	histogram h;
+
+	histogram_reset(&h);
+	for(i = 0; i < runs; i++) {
+		evict_cache();
+		gettimeofday(&start, NULL);
+		sweep();
+		gettimeofday(&stop, NULL);
+		histogram_add(&h, tv_usec(&start, &stop));
+		total += tv_usec(&start, &stop);
+		}
+
+	printf("%-10s %6u %10.2f %10.2f %10.2f\n", name, runs,
+	       total / runs / 1000.0, histogram_percentile(&h, 50) / 1000.0, h.max / 1000.0);
+	}
+
+
+int main(int argc, char **argv) {
+	unsigned int hosts = 10000, services = 10, runs = 20, i;
+	struct timeval start, stop;
+	char path[PATH_MAX];
+	struct {
+		const char *name;
+		void (*sweep)(void);
+		} sweeps[] = {
+			{ "freshness", check_service_result_freshness },
+			{ "orphan", check_for_orphaned_services },
+			{ "state", state_sweep },
+			{ NULL, NULL }
+		};
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	if(argc > 1)
+		hosts = atoi(argv[1]);
+	if(argc > 2)
+		services = atoi(argv[2]);
+	if(argc > 3)
+		runs = atoi(argv[3]);
+	if(!runs)
+		runs = 1;
+
+	if(!mkdtemp(dir)) {
+		perror("mkdtemp");
+		return 1;
+		}
+	if((evict_buf = calloc(1, EVICT_SIZE)) == NULL) {
+		printf("Out of memory\n");
+		return 1;
+		}
+
+	printf("Generating %u hosts with %u services each in %s\n", hosts, services, dir);
+	write_config(hosts, services);
+
+	gettimeofday(&start, NULL);
+	snprintf(path, sizeof(path), "%s/nagios.cfg", dir);
+	config_file = strdup(path);
+	reset_variables();
+	if(read_main_config_file(config_file) != OK || read_all_object_data(config_file) != OK) {
+		printf("Failed to read the generated config\n");
+		return 1;
+		}
+	gettimeofday(&stop, NULL);
+	printf("Loaded %u services in %.3f s, %lu bytes each\n\n", num_objects.services,
+	       tv_usec(&start, &stop) / 1000000.0, (unsigned long)sizeof(service));
+
+	printf("%-10s %6s %10s %10s %10s\n", "sweep", "runs", "avg ms", "p50 ms", "max ms");
+	for(i = 0; sweeps[i].name; i++)
+		bench(sweeps[i].name, sweeps[i].sweep, runs);
+
+	snprintf(path, sizeof(path), "%s/objects.cfg", dir);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/nagios.cfg", dir);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/nagios.log", dir);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/nagios.log.idx", dir);
+	unlink(path);
+	rmdir(dir);
+
+	return 0;
+	}
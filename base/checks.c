@@ -794,8 +794,18 @@ static inline void service_initial_handling(service *svc, check_result *cr, char
 	my_free(svc->long_plugin_output);
 	my_free(svc->perf_data);
 
+	/* workers may already have split the output for us, so just take it over */
+	if (cr->output_split == TRUE) {
+		svc->plugin_output = cr->plugin_output;
+		svc->long_plugin_output = cr->long_plugin_output;
+		svc->perf_data = cr->perf_data;
+		cr->plugin_output = cr->long_plugin_output = cr->perf_data = NULL;
+	}
+
 	/* parse check output to get: (1) short output, (2) long output, (3) perf data */
-	parse_check_output(cr->output, &svc->plugin_output, &svc->long_plugin_output, &svc->perf_data, TRUE, FALSE);
+	else {
+		parse_check_output(cr->output, &svc->plugin_output, &svc->long_plugin_output, &svc->perf_data, TRUE, FALSE);
+	}
 
 	/* make sure the plugin output isn't null */
 	if (svc->plugin_output == NULL) {
@@ -837,8 +847,18 @@ static inline void host_initial_handling(host *hst, check_result *cr, char **old
 	my_free(hst->long_plugin_output);
 	my_free(hst->perf_data);
 
+	/* workers may already have split the output for us, so just take it over */
+	if (cr->output_split == TRUE) {
+		hst->plugin_output = cr->plugin_output;
+		hst->long_plugin_output = cr->long_plugin_output;
+		hst->perf_data = cr->perf_data;
+		cr->plugin_output = cr->long_plugin_output = cr->perf_data = NULL;
+	}
+
 	/* parse check output to get: (1) short output, (2) long output, (3) perf data */
-	parse_check_output(cr->output, &hst->plugin_output, &hst->long_plugin_output, &hst->perf_data, TRUE, FALSE);
+	else {
+		parse_check_output(cr->output, &hst->plugin_output, &hst->long_plugin_output, &hst->perf_data, TRUE, FALSE);
+	}
 
 	/* make sure the plugin output isn't null */
 	if (hst->plugin_output == NULL) {
@@ -1053,6 +1073,423 @@ static inline void initialize_last_host_state_change_times(host * hst)
 }
 
 
+/******************************************************************************
+ ******* Outage storm mode
+ *****************************************************************************/
+/*
+ * When a network segment fails, dependency and reachability checks can
+ * be asked for faster than the workers can run them, and the checks
+ * that tell us what actually broke queue up behind the rest. Once more
+ * than check_storm_threshold on-demand checks are asked for in one
+ * second, we go into storm mode: on-demand checks of services and of
+ * hosts without children are held back, once per object, and run at
+ * check_storm_drain_rate per second, hosts first. Checks of hosts with
+ * children, which decide what the rest of the outage looks like, go
+ * through as usual. Storm mode ends once the rate has stayed below the
+ * threshold for CHECK_STORM_LINGER seconds and the backlog is gone.
+ */
+#define CHECK_STORM_LINGER 30
+
+struct check_storm_stats check_storm_stats;
+
+struct held_checks {
+	void **objects;         /* a ring of held back objects, oldest first */
+	unsigned int size, head, len;
+	bitmap *held;           /* by object id */
+};
+static struct held_checks held_hosts, held_services;
+static time_t storm_second, storm_until;
+static unsigned int storm_second_checks;
+static struct timeval storm_last_drain;
+static double storm_tokens;
+static int running_held_checks;
+
+static void storm_gettimeofday(struct timeval *tv)
+{
+	gettimeofday(tv, NULL);
+}
+void (*check_storm_clock)(struct timeval *) = storm_gettimeofday;
+
+
+static void free_held(struct held_checks *h)
+{
+	my_free(h->objects);
+	bitmap_destroy(h->held);
+	memset(h, 0, sizeof(*h));
+}
+
+void free_held_checks(void)
+{
+	free_held(&held_hosts);
+	free_held(&held_services);
+	check_storm_stats.backlog = 0;
+	check_storm_stats.active = FALSE;
+	storm_second_checks = 0;
+	storm_second = storm_until = 0;
+}
+
+
+/* holds back a check of an object, unless it's held back already. FALSE if we can't */
+static int hold_check(struct held_checks *h, void *obj, unsigned int id, unsigned int num)
+{
+	if (h->objects == NULL) {
+		h->objects = calloc(num, sizeof(void *));
+		h->held = bitmap_create(num);
+		if (h->objects == NULL || h->held == NULL) {
+			free_held(h);
+			return FALSE;
+		}
+		h->size = num;
+	}
+	if (id >= h->size) {
+		return FALSE;
+	}
+
+	if (bitmap_isset(h->held, id)) {
+		check_storm_stats.coalesced++;
+		return TRUE;
+	}
+
+	bitmap_set(h->held, id);
+	h->objects[(h->head + h->len++) % h->size] = obj;
+	check_storm_stats.deferred++;
+	check_storm_stats.backlog++;
+	return TRUE;
+}
+
+
+static void *next_held_check(struct held_checks *h, unsigned int (*get_id)(void *))
+{
+	void *obj;
+
+	if (h->len == 0) {
+		return NULL;
+	}
+
+	obj = h->objects[h->head];
+	h->head = (h->head + 1) % h->size;
+	h->len--;
+	bitmap_unset(h->held, get_id(obj));
+	check_storm_stats.backlog--;
+	return obj;
+}
+
+static unsigned int held_host_id(void *obj)
+{
+	return ((host *)obj)->id;
+}
+
+static unsigned int held_service_id(void *obj)
+{
+	return ((service *)obj)->id;
+}
+
+
+/*
+ * Counts an on-demand check and decides whether to hold it back.
+ * Returns TRUE if the caller should leave it to us.
+ */
+static int storm_holds_check(host *hst, service *svc, time_t check_time, timed_event *pending)
+{
+	struct timeval now;
+	time_t current_time;
+
+	if (check_storm_threshold <= 0 || running_held_checks == TRUE) {
+		return FALSE;
+	}
+
+	check_storm_clock(&now);
+	current_time = now.tv_sec;
+	if (current_time != storm_second) {
+		storm_second = current_time;
+		storm_second_checks = 0;
+	}
+	if (++storm_second_checks > (unsigned int)check_storm_threshold) {
+		if (check_storm_stats.active == FALSE) {
+			check_storm_stats.active = TRUE;
+			check_storm_stats.storms++;
+			storm_last_drain = now;
+			storm_tokens = 0.0;
+			logit(NSLOG_RUNTIME_WARNING, TRUE, "Warning: More than %d on-demand checks per second were asked for. Checks of services and hosts without children will be run at %d per second until this is over.\n", check_storm_threshold, check_storm_drain_rate);
+		}
+		storm_until = current_time + CHECK_STORM_LINGER;
+	}
+
+	/* a check that's already pending at least as soon will do */
+	if (pending != NULL && pending->run_time <= check_time) {
+		check_storm_stats.coalesced++;
+		return FALSE;
+	}
+
+	if (check_storm_stats.active == FALSE) {
+		return FALSE;
+	}
+
+	if (svc != NULL) {
+		return hold_check(&held_services, svc, svc->id, num_objects.services);
+	}
+	if (hst->child_hosts == NULL) {
+		return hold_check(&held_hosts, hst, hst->id, num_objects.hosts);
+	}
+	return FALSE;
+}
+
+
+/* schedules checks held back by storm mode, at no more than the drain rate */
+void run_held_checks(void)
+{
+	struct timeval now;
+	time_t current_time;
+	void *obj;
+
+	if (check_storm_stats.active == FALSE && check_storm_stats.backlog == 0) {
+		return;
+	}
+
+	check_storm_clock(&now);
+	current_time = now.tv_sec;
+
+	if (check_storm_stats.backlog > 0) {
+		storm_tokens += tv_delta_f(&storm_last_drain, &now) * check_storm_drain_rate;
+		/* don't save up for more than a second's worth */
+		if (storm_tokens > check_storm_drain_rate) {
+			storm_tokens = check_storm_drain_rate;
+		}
+	}
+	storm_last_drain = now;
+
+	running_held_checks = TRUE;
+	while (storm_tokens >= 1.0) {
+		if ((obj = next_held_check(&held_hosts, held_host_id)) != NULL) {
+			schedule_host_check((host *)obj, current_time, CHECK_OPTION_DEPENDENCY_CHECK);
+		}
+		else if ((obj = next_held_check(&held_services, held_service_id)) != NULL) {
+			schedule_service_check((service *)obj, current_time, CHECK_OPTION_DEPENDENCY_CHECK);
+		}
+		else {
+			break;
+		}
+		storm_tokens -= 1.0;
+	}
+	running_held_checks = FALSE;
+
+	if (check_storm_stats.active == TRUE && current_time >= storm_until && check_storm_stats.backlog == 0) {
+		check_storm_stats.active = FALSE;
+		logit(NSLOG_INFO_MESSAGE, TRUE, "The on-demand check storm is over. %lu checks were held back in all, %lu were already pending.\n", check_storm_stats.deferred, check_storm_stats.coalesced);
+	}
+}
+
+
+/******************************************************************************
+ ******* Host reachability index
+ *****************************************************************************/
+/*
+ * For each host we keep count of how many of its parents are live: UP
+ * and reachable themselves. A host is reachable if it has no parents
+ * or a live one. When a host goes UP or stops being UP, the counts of
+ * its children change, and every host that is cut off or reconnected
+ * by that passes the change on to its own children. A whole subtree is
+ * classified in one pass that only touches the hosts it affects, and
+ * the hosts whose reachability changed get their dependency checks
+ * scheduled together the next time around the event loop, rather than
+ * one level of the tree at a time. Since a host that is UP but cut off
+ * doesn't make its children reachable, they are UNREACHABLE when their
+ * checks fail even if its own check hasn't come back yet.
+ */
+struct host_reach {
+	unsigned int live_parents;
+	unsigned char up;
+	unsigned char reachable;
+	unsigned char pending;
+};
+static struct host_reach *host_reach;
+static host **reach_queue, **reach_pending;
+static unsigned int reach_hosts, reach_pending_len;
+
+#define reach_of(hst) (&host_reach[(hst)->id])
+
+
+void free_host_reachability(void)
+{
+	my_free(host_reach);
+	my_free(reach_queue);
+	my_free(reach_pending);
+	reach_hosts = reach_pending_len = 0;
+}
+
+
+void init_host_reachability(void)
+{
+	unsigned int i, head = 0, tail = 0;
+	hostsmember *temp_hostsmember;
+
+	free_host_reachability();
+
+	if (num_objects.hosts == 0) {
+		return;
+	}
+
+	host_reach = calloc(num_objects.hosts, sizeof(*host_reach));
+	/* one more, in case a parent loop brings the first host around again */
+	reach_queue = calloc(num_objects.hosts + 1, sizeof(*reach_queue));
+	reach_pending = calloc(num_objects.hosts, sizeof(*reach_pending));
+	if (host_reach == NULL || reach_queue == NULL || reach_pending == NULL) {
+		/* we'll just have to look at the parents every time */
+		free_host_reachability();
+		return;
+	}
+	reach_hosts = num_objects.hosts;
+
+	for (i = 0; i < reach_hosts; i++) {
+		host *hst = host_ary[i];
+
+		host_reach[i].up = (hst->current_state == HOST_UP);
+		if (hst->parent_hosts == NULL) {
+			host_reach[i].reachable = TRUE;
+			if (host_reach[i].up) {
+				reach_queue[tail++] = hst;
+			}
+		}
+	}
+
+	/* live hosts are queued once, when they're found to be reachable */
+	while (head < tail) {
+		host *hst = reach_queue[head++];
+
+		for (temp_hostsmember = hst->child_hosts; temp_hostsmember; temp_hostsmember = temp_hostsmember->next) {
+			struct host_reach *r = reach_of(temp_hostsmember->host_ptr);
+
+			r->live_parents++;
+			if (r->reachable == FALSE) {
+				r->reachable = TRUE;
+				if (r->up) {
+					reach_queue[tail++] = temp_hostsmember->host_ptr;
+				}
+			}
+		}
+	}
+}
+
+
+/* called whenever a host's state may have changed */
+void update_host_reachability(host *hst)
+{
+	hostsmember *temp_hostsmember;
+	struct host_reach *r;
+	unsigned int head = 0, tail = 0, changed = 0;
+	int up;
+
+	if (host_reach == NULL || hst->id >= reach_hosts) {
+		return;
+	}
+
+	r = reach_of(hst);
+	up = (hst->current_state == HOST_UP);
+	if (up == r->up) {
+		return;
+	}
+
+	r->up = up;
+
+	/* an unreachable host can't make anything else reachable either way */
+	if (r->reachable == FALSE) {
+		return;
+	}
+
+	reach_queue[tail++] = hst;
+	while (head < tail) {
+		host *parent = reach_queue[head++];
+
+		for (temp_hostsmember = parent->child_hosts; temp_hostsmember; temp_hostsmember = temp_hostsmember->next) {
+			host *child = temp_hostsmember->host_ptr;
+			struct host_reach *cr = reach_of(child);
+
+			if (up) {
+				cr->live_parents++;
+			}
+			else {
+				cr->live_parents--;
+			}
+			if (cr->reachable == (cr->live_parents > 0)) {
+				continue;
+			}
+
+			/* cut off or reconnected, so its state needs checking */
+			cr->reachable = !cr->reachable;
+			changed++;
+			if (cr->pending == FALSE) {
+				cr->pending = TRUE;
+				reach_pending[reach_pending_len++] = child;
+			}
+
+			/* it's live or no longer live, and its children need to know */
+			if (cr->up) {
+				reach_queue[tail++] = child;
+			}
+		}
+	}
+
+	if (changed > 0) {
+		log_debug_info(DEBUGL_CHECKS, 1, "Reachability of %u host(s) changed with the state of '%s'\n", changed, hst->name);
+	}
+}
+
+
+/* is a host reachable through the parent hosts we know to be UP? */
+int host_is_reachable(host *hst)
+{
+	hostsmember *temp_hostsmember;
+
+	if (host_reach != NULL && hst->id < reach_hosts) {
+		return reach_of(hst)->reachable;
+	}
+
+	/* without the index, the best we can do is look at the parents */
+	if (hst->parent_hosts == NULL) {
+		return TRUE;
+	}
+	for (temp_hostsmember = hst->parent_hosts; temp_hostsmember; temp_hostsmember = temp_hostsmember->next) {
+		if (temp_hostsmember->host_ptr->current_state == HOST_UP) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+
+/* schedules checks of the hosts whose reachability changed, all in one go */
+void schedule_reachability_checks(void)
+{
+	unsigned int i, scheduled = 0;
+	time_t current_time;
+
+	if (reach_pending_len == 0) {
+		return;
+	}
+
+	time(&current_time);
+	for (i = 0; i < reach_pending_len; i++) {
+		host *hst = reach_pending[i];
+		struct host_reach *r = reach_of(hst);
+
+		r->pending = FALSE;
+
+		/* cut off hosts are checked unless they're UNREACHABLE, reconnected ones unless they're UP */
+		if ((r->reachable == FALSE && hst->current_state == HOST_UNREACHABLE)
+			|| (r->reachable == TRUE && hst->current_state == HOST_UP)) {
+			continue;
+		}
+
+		log_debug_info(DEBUGL_CHECKS, 1, "Check of %s host '%s' queued.\n", r->reachable ? "reconnected" : "cut off", hst->name);
+		schedule_host_check(hst, current_time, CHECK_OPTION_DEPENDENCY_CHECK);
+		scheduled++;
+	}
+
+	log_debug_info(DEBUGL_CHECKS, 0, "Scheduled checks of %u of %u host(s) whose reachability changed\n", scheduled, reach_pending_len);
+	reach_pending_len = 0;
+}
+
+
 /******************************************************************************
  ******* Logic chunks propagating checks to host parents/children
  *****************************************************************************/
@@ -1077,6 +1514,12 @@ static inline void host_propagate_checks_to_immediate_children(host * hst, int c
 	hostsmember *temp_hostsmember = NULL;
 	host *child_host = NULL;
 
+	/* with the reachability index, it's every host whose reachability this changes that gets checked */
+	if (host_reach != NULL) {
+		update_host_reachability(hst);
+		return;
+	}
+
 	log_debug_info(DEBUGL_CHECKS, 1, "Propagating checks to child host(s)...\n");
 	for(temp_hostsmember = hst->child_hosts; temp_hostsmember != NULL; temp_hostsmember = temp_hostsmember->next) {
 		child_host = temp_hostsmember->host_ptr;
@@ -1703,6 +2146,10 @@ inline void schedule_service_check(service *svc, time_t check_time, int options)
 			log_debug_info(DEBUGL_CHECKS, 0, "Last check result is recent enough (%s)", ctime(&svc->last_check));
 			return;
 		}
+		if (storm_holds_check(NULL, svc, check_time, svc->next_check_event) == TRUE) {
+			log_debug_info(DEBUGL_CHECKS, 0, "Holding the check back until the check storm lets up.\n");
+			return;
+		}
 	}
 
 	/* default is to use the new event */
@@ -1864,6 +2311,7 @@ inline int check_service_check_viability(service *svc, int check_options, int *t
 			perform_check = FALSE;
 			if (service_skip_check_dependency_status >= 0) {
 				svc->current_state = service_skip_check_dependency_status;
+				update_service_dependents(svc);
 			}
 			log_debug_info(DEBUGL_CHECKS, 2, "Execution dependencies for this service failed, so it will not be actively checked.\n");
 		}
@@ -1875,6 +2323,7 @@ inline int check_service_check_viability(service *svc, int check_options, int *t
 		perform_check = FALSE;
 		if (service_skip_check_parent_status >= 0) {
 			svc->current_state = service_skip_check_parent_status;
+			update_service_dependents(svc);
 		}
 		log_debug_info(DEBUGL_CHECKS, 2, "Execution parents for this service failed, so it will not be actively checked.\n");
 	}
@@ -1891,6 +2340,7 @@ inline int check_service_check_viability(service *svc, int check_options, int *t
 				perform_check = FALSE;
 				if (service_skip_check_host_down_status >= 0) {
 					svc->current_state = service_skip_check_host_down_status;
+					update_service_dependents(svc);
 				}
 			}
 		}
@@ -1943,15 +2393,246 @@ int check_service_parents(service *svc)
 
 
 
-/* checks service dependencies */
-int check_service_dependencies(service *svc, int dependency_type)
+/*
+ * Dependency results are remembered per object and dependency type,
+ * since the same chains get walked for every check and notification
+ * of every object that depends on them. A remembered result is
+ * forgotten when the state of a master object it was worked out from
+ * changes, which is found through the dependents index: for each
+ * object, the dependencies it is the master of. Results that depended
+ * on a dependency_period are only good for the second they were
+ * worked out in.
+ */
+#define DEPCACHE_VALID   (1 << 0)
+#define DEPCACHE_FAILED  (1 << 1)
+#define DEPCACHE_TIMED   (1 << 2)
+#define DEPCACHE_INDEX(type) ((type) == NOTIFICATION_DEPENDENCY ? 0 : 1)
+
+struct dependency_cache {
+	objectlist *dependents;
+	int state;              /* the state dependents last saw */
+	unsigned char result[2];
+	time_t checked[2];      /* when timed results were worked out */
+};
+static struct dependency_cache *host_depcache, *service_depcache;
+static unsigned int depcache_hosts, depcache_services;
+
+
+/* the state dependencies look at (the last hard state if it's currently in a soft state) */
+static inline int host_dependency_state(host *hst)
+{
+	if (hst->state_type == SOFT_STATE && soft_state_dependencies == FALSE) {
+		return hst->last_hard_state;
+	}
+	return hst->current_state;
+}
+
+static inline int service_dependency_state(service *svc)
+{
+	if (svc->state_type == SOFT_STATE && soft_state_dependencies == FALSE) {
+		return svc->last_hard_state;
+	}
+	return svc->current_state;
+}
+
+
+static inline int depcache_lookup(struct dependency_cache *dc, int idx, time_t now)
 {
+	int flags = dc->result[idx];
+
+	if (!(flags & DEPCACHE_VALID)) {
+		return 0;
+	}
+	if ((flags & DEPCACHE_TIMED) && dc->checked[idx] != now) {
+		return 0;
+	}
+	return flags;
+}
+
+
+static inline int depcache_store(struct dependency_cache *dc, int idx, time_t now, int flags)
+{
+	dc->result[idx] = flags | DEPCACHE_VALID;
+	dc->checked[idx] = now;
+	return flags;
+}
+
+
+void free_dependency_cache(void)
+{
+	unsigned int i;
+
+	for (i = 0; host_depcache && i < depcache_hosts; i++) {
+		free_objectlist(&host_depcache[i].dependents);
+	}
+	for (i = 0; service_depcache && i < depcache_services; i++) {
+		free_objectlist(&service_depcache[i].dependents);
+	}
+	my_free(host_depcache);
+	my_free(service_depcache);
+	depcache_hosts = depcache_services = 0;
+}
+
+
+void init_dependency_cache(void)
+{
+	unsigned int i, indexed = 0;
 	objectlist *list;
-	int state = STATE_OK;
-	time_t current_time = 0L;
 
+	free_dependency_cache();
 
-	log_debug_info(DEBUGL_FUNCTIONS, 0, "check_service_dependencies()\n");
+	if (num_objects.hosts) {
+		host_depcache = calloc(num_objects.hosts, sizeof(*host_depcache));
+	}
+	if (num_objects.services) {
+		service_depcache = calloc(num_objects.services, sizeof(*service_depcache));
+	}
+	if ((num_objects.hosts && !host_depcache) || (num_objects.services && !service_depcache)) {
+		/* we'll just have to work everything out every time */
+		my_free(host_depcache);
+		my_free(service_depcache);
+		return;
+	}
+	depcache_hosts = num_objects.hosts;
+	depcache_services = num_objects.services;
+
+	for (i = 0; i < num_objects.hosts; i++) {
+		host *hst = host_ary[i];
+
+		host_depcache[i].state = host_dependency_state(hst);
+		for (list = hst->exec_deps; list; list = list->next, indexed++) {
+			hostdependency *dep = (hostdependency *)list->object_ptr;
+			if (dep->master_host_ptr != NULL) {
+				prepend_object_to_objectlist(&host_depcache[dep->master_host_ptr->id].dependents, dep);
+			}
+		}
+		for (list = hst->notify_deps; list; list = list->next, indexed++) {
+			hostdependency *dep = (hostdependency *)list->object_ptr;
+			if (dep->master_host_ptr != NULL) {
+				prepend_object_to_objectlist(&host_depcache[dep->master_host_ptr->id].dependents, dep);
+			}
+		}
+	}
+
+	for (i = 0; i < num_objects.services; i++) {
+		service *svc = service_ary[i];
+
+		service_depcache[i].state = service_dependency_state(svc);
+		for (list = svc->exec_deps; list; list = list->next, indexed++) {
+			servicedependency *dep = (servicedependency *)list->object_ptr;
+			if (dep->master_service_ptr != NULL) {
+				prepend_object_to_objectlist(&service_depcache[dep->master_service_ptr->id].dependents, dep);
+			}
+		}
+		for (list = svc->notify_deps; list; list = list->next, indexed++) {
+			servicedependency *dep = (servicedependency *)list->object_ptr;
+			if (dep->master_service_ptr != NULL) {
+				prepend_object_to_objectlist(&service_depcache[dep->master_service_ptr->id].dependents, dep);
+			}
+		}
+	}
+
+	log_debug_info(DEBUGL_CHECKS, 1, "Indexed %u dependencies for the dependency cache\n", indexed);
+}
+
+
+/*
+ * Forget the results of the given dependency types (a bitmask of
+ * cache indexes) for everything that depends on a host, and for
+ * whatever inherits those dependencies in turn. A dependent whose
+ * result is already forgotten can't have passed its result on to
+ * anything, so we needn't look further than that.
+ */
+static void forget_host_dependents(host *hst, int types)
+{
+	objectlist *list;
+
+	for (list = host_depcache[hst->id].dependents; list; list = list->next) {
+		hostdependency *dep = (hostdependency *)list->object_ptr;
+		host *child = dep->dependent_host_ptr;
+		int idx = DEPCACHE_INDEX(dep->dependency_type);
+
+		if (!(types & (1 << idx)) || !(host_depcache[child->id].result[idx] & DEPCACHE_VALID)) {
+			continue;
+		}
+		host_depcache[child->id].result[idx] = 0;
+		if (dep->inherits_parent == TRUE) {
+			forget_host_dependents(child, 1 << idx);
+		}
+	}
+}
+
+static void forget_service_dependents(service *svc, int types)
+{
+	objectlist *list;
+
+	for (list = service_depcache[svc->id].dependents; list; list = list->next) {
+		servicedependency *dep = (servicedependency *)list->object_ptr;
+		service *child = dep->dependent_service_ptr;
+		int idx = DEPCACHE_INDEX(dep->dependency_type);
+
+		if (!(types & (1 << idx)) || !(service_depcache[child->id].result[idx] & DEPCACHE_VALID)) {
+			continue;
+		}
+		service_depcache[child->id].result[idx] = 0;
+		if (dep->inherits_parent == TRUE) {
+			forget_service_dependents(child, 1 << idx);
+		}
+	}
+}
+
+
+/* called whenever a host's state may have changed */
+void update_host_dependents(host *hst)
+{
+	int state;
+
+	if (host_depcache == NULL || hst->id >= depcache_hosts) {
+		return;
+	}
+
+	state = host_dependency_state(hst);
+	if (state == host_depcache[hst->id].state) {
+		return;
+	}
+
+	host_depcache[hst->id].state = state;
+	forget_host_dependents(hst, 3);
+}
+
+/* called whenever a service's state may have changed */
+void update_service_dependents(service *svc)
+{
+	int state;
+
+	if (service_depcache == NULL || svc->id >= depcache_services) {
+		return;
+	}
+
+	state = service_dependency_state(svc);
+	if (state == service_depcache[svc->id].state) {
+		return;
+	}
+
+	service_depcache[svc->id].state = state;
+	forget_service_dependents(svc, 3);
+}
+
+
+/* works out service dependencies, returning DEPCACHE_* flags */
+static int service_dependency_result(service *svc, int dependency_type, time_t now)
+{
+	struct dependency_cache *dc = NULL;
+	objectlist *list;
+	int idx = DEPCACHE_INDEX(dependency_type);
+	int flags = 0;
+
+	if (service_depcache != NULL && svc->id < depcache_services) {
+		dc = &service_depcache[svc->id];
+		if ((flags = depcache_lookup(dc, idx, now))) {
+			return flags;
+		}
+	}
 
 	/* only check dependencies of the desired type */
 	if (dependency_type == NOTIFICATION_DEPENDENCY)
@@ -1970,34 +2651,45 @@ int check_service_dependencies(service *svc, int dependency_type)
 		}
 
 		/* skip this dependency if it has a timeperiod and the current time isn't valid */
-		time(&current_time);
-		if (temp_dependency->dependency_period != NULL 
-			&& (check_time_against_period(current_time, temp_dependency->dependency_period_ptr) == ERROR)) {
-
-			return FALSE;
-		}
-
-		/* get the status to use (use last hard state if its currently in a soft state) */
-		if (temp_service->state_type == SOFT_STATE && soft_state_dependencies == FALSE) {
-			state = temp_service->last_hard_state;
-		}
-		else {
-			state = temp_service->current_state;
+		if (temp_dependency->dependency_period != NULL) {
+			flags |= DEPCACHE_TIMED;
+			if (check_time_against_period(now, temp_dependency->dependency_period_ptr) == ERROR) {
+				break;
+			}
 		}
 
 		/* is the service we depend on in state that fails the dependency tests? */
-		if (flag_isset(temp_dependency->failure_options, 1 << state)) {
-			return DEPENDENCIES_FAILED;
+		if (flag_isset(temp_dependency->failure_options, 1 << service_dependency_state(temp_service))) {
+			flags |= DEPCACHE_FAILED;
+			break;
 		}
 
 		/* immediate dependencies ok at this point - check parent dependencies if necessary */
 		if (temp_dependency->inherits_parent == TRUE) {
-			if (check_service_dependencies(temp_service, dependency_type) != DEPENDENCIES_OK) {
-				return DEPENDENCIES_FAILED;
+			int inherited = service_dependency_result(temp_service, dependency_type, now);
+
+			flags |= inherited & (DEPCACHE_TIMED | DEPCACHE_FAILED);
+			if (inherited & DEPCACHE_FAILED) {
+				break;
 			}
 		}
 	}
 
+	if (dc != NULL) {
+		return depcache_store(dc, idx, now, flags);
+	}
+	return flags;
+}
+
+
+/* checks service dependencies */
+int check_service_dependencies(service *svc, int dependency_type)
+{
+	log_debug_info(DEBUGL_FUNCTIONS, 0, "check_service_dependencies()\n");
+
+	if (service_dependency_result(svc, dependency_type, time(NULL)) & DEPCACHE_FAILED) {
+		return DEPENDENCIES_FAILED;
+	}
 	return DEPENDENCIES_OK;
 }
 
@@ -2594,6 +3286,13 @@ inline void schedule_host_check(host *hst, time_t check_time, int options)
 		return;
 	}
 
+	if (options == CHECK_OPTION_DEPENDENCY_CHECK
+		&& storm_holds_check(hst, NULL, check_time, hst->next_check_event) == TRUE) {
+
+		log_debug_info(DEBUGL_CHECKS, 0, "Holding the check back until the check storm lets up.\n");
+		return;
+	}
+
 	temp_event = (timed_event *)hst->next_check_event;
 
 	if (temp_event == NULL) {
@@ -2689,17 +3388,22 @@ inline void schedule_host_check(host *hst, time_t check_time, int options)
 
 
 
-/* checks host dependencies */
-int check_host_dependencies(host *hst, int dependency_type)
+/* works out host dependencies, returning DEPCACHE_* flags */
+static int host_dependency_result(host *hst, int dependency_type, time_t now)
 {
+	struct dependency_cache *dc = NULL;
 	hostdependency *temp_dependency = NULL;
 	objectlist *list;
 	host *temp_host = NULL;
-	int state = HOST_UP;
-	time_t current_time = 0L;
-
+	int idx = DEPCACHE_INDEX(dependency_type);
+	int flags = 0;
 
-	log_debug_info(DEBUGL_FUNCTIONS, 0, "check_host_dependencies()\n");
+	if (host_depcache != NULL && hst->id < depcache_hosts) {
+		dc = &host_depcache[hst->id];
+		if ((flags = depcache_lookup(dc, idx, now))) {
+			return flags;
+		}
+	}
 
 	if (dependency_type == NOTIFICATION_DEPENDENCY) {
 		list = hst->notify_deps;
@@ -2718,34 +3422,45 @@ int check_host_dependencies(host *hst, int dependency_type)
 		}
 
 		/* skip this dependency if it has a timeperiod and the current time isn't valid */
-		time(&current_time);
-		if ((temp_dependency->dependency_period != NULL) 
-			&& (check_time_against_period(current_time, temp_dependency->dependency_period_ptr) == ERROR)) {
-
-			return FALSE;
-		}
-
-		/* get the status to use (use last hard state if its currently in a soft state) */
-		if (temp_host->state_type == SOFT_STATE && soft_state_dependencies == FALSE) {
-			state = temp_host->last_hard_state;
-		}
-		else {
-			state = temp_host->current_state;
+		if (temp_dependency->dependency_period != NULL) {
+			flags |= DEPCACHE_TIMED;
+			if (check_time_against_period(now, temp_dependency->dependency_period_ptr) == ERROR) {
+				break;
+			}
 		}
 
 		/* is the host we depend on in state that fails the dependency tests? */
-		if (flag_isset(temp_dependency->failure_options, 1 << state)) {
-			return DEPENDENCIES_FAILED;
+		if (flag_isset(temp_dependency->failure_options, 1 << host_dependency_state(temp_host))) {
+			flags |= DEPCACHE_FAILED;
+			break;
 		}
 
 		/* immediate dependencies ok at this point - check parent dependencies if necessary */
-		if ((temp_dependency->inherits_parent == TRUE)
-			&& (check_host_dependencies(temp_host, dependency_type) != DEPENDENCIES_OK)) {
+		if (temp_dependency->inherits_parent == TRUE) {
+			int inherited = host_dependency_result(temp_host, dependency_type, now);
 
-			return DEPENDENCIES_FAILED;
+			flags |= inherited & (DEPCACHE_TIMED | DEPCACHE_FAILED);
+			if (inherited & DEPCACHE_FAILED) {
+				break;
+			}
 		}
 	}
 
+	if (dc != NULL) {
+		return depcache_store(dc, idx, now, flags);
+	}
+	return flags;
+}
+
+
+/* checks host dependencies */
+int check_host_dependencies(host *hst, int dependency_type)
+{
+	log_debug_info(DEBUGL_FUNCTIONS, 0, "check_host_dependencies()\n");
+
+	if (host_dependency_result(hst, dependency_type, time(NULL)) & DEPCACHE_FAILED) {
+		return DEPENDENCIES_FAILED;
+	}
 	return DEPENDENCIES_OK;
 }
 
@@ -3335,6 +4050,8 @@ int check_host_check_viability(host *hst, int check_options, int *time_is_valid,
 			perform_check = FALSE;
 			if (host_skip_check_dependency_status >= 0) {
 				hst->current_state = host_skip_check_dependency_status;
+				update_host_dependents(hst);
+				update_host_reachability(hst);
 			}
 		}
 	}
@@ -3383,6 +4100,14 @@ inline int determine_host_reachability(host *hst)
 		return HOST_DOWN;
 	}
 
+	/* the reachability index knows whether there's a way in through parents that are UP */
+	else if (host_reach != NULL && hst->id < reach_hosts) {
+		if (reach_of(hst)->reachable == TRUE) {
+			log_debug_info(DEBUGL_CHECKS, 2, "%u parent(s) up and reachable, so host is DOWN.\n", reach_of(hst)->live_parents);
+			return HOST_DOWN;
+		}
+	}
+
 	/* check all parent hosts to see if we're DOWN or UNREACHABLE */
 	else {
 		for(temp_hostsmember = hst->parent_hosts; temp_hostsmember != NULL; temp_hostsmember = temp_hostsmember->next) {
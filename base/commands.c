@@ -37,6 +37,21 @@ extern int sigrestart;
 static int command_file_fd;
 static int command_file_created = FALSE;
 
+/*
+ * Linux lets us grow the command file pipe. The default 64KiB fills
+ * up in a few milliseconds when many passive check results arrive at
+ * once, after which everyone writing to it has to wait.
+ */
+#define COMMAND_FILE_PIPE_SIZE (1024 * 1024)
+
+/* bytes of unprocessed commands we read before letting the worker wait */
+#define COMMAND_BACKLOG_MAX (2 * 1024 * 1024)
+
+/* commands read from the worker that we haven't got round to yet */
+static int command_backlog = FALSE;
+
+struct external_command_stats external_command_stats;
+
 /* The command file worker process */
 static struct {
 	/* these must come first for check source detection */
@@ -96,6 +111,11 @@ int open_command_file(void)
 		return ERROR;
 	}
 
+#ifdef F_SETPIPE_SZ
+	/* this may fail if the limit is lower; the default will do then */
+	(void)fcntl(command_file_fd, F_SETPIPE_SZ, COMMAND_FILE_PIPE_SIZE);
+#endif
+
 	/* set a flag to remember we already created the file */
 	command_file_created = TRUE;
 
@@ -132,6 +152,7 @@ int shutdown_command_file_worker(void) {
 
 	iocache_destroy(command_worker.ioc);
 	command_worker.ioc = NULL;
+	command_backlog = FALSE;
 	iobroker_close(nagios_iobs, command_worker.sd);
 	command_worker.sd = -1;
 	kill(command_worker.pid, SIGKILL);
@@ -140,14 +161,25 @@ int shutdown_command_file_worker(void) {
 	}
 
 
+/*
+ * Commands are only read here. They're run from the event loop by
+ * process_external_command_backlog(), a limited number of milliseconds
+ * at a time, so a flood of them can't hold up everything else.
+ */
 static int command_input_handler(int sd, int events, void *discard) {
-	int ret, cmd_ret;
-	char *buf;
-	unsigned long size;
+	int ret;
 
 	if (sigrestart)
 		return 0;
 
+	/*
+	 * if we're this far behind, leave the rest in the socket. The
+	 * worker will wait for us to catch up, rather than have us eat
+	 * all the memory there is.
+	 */
+	if (iocache_available(command_worker.ioc) >= COMMAND_BACKLOG_MAX)
+		return 0;
+
 	ret = iocache_read(command_worker.ioc, sd);
 	log_debug_info(DEBUGL_COMMANDS, 2, "Read %d bytes from command worker\n", ret);
 	if (ret == 0) {
@@ -156,30 +188,188 @@ static int command_input_handler(int sd, int events, void *discard) {
 		launch_command_file_worker();
 		return 0;
 		}
-	while ((buf = iocache_use_delim(command_worker.ioc, "\n", 1, &size))) {
+	if (ret > 0) {
+		command_backlog = TRUE;
+		external_command_stats.backlog = iocache_available(command_worker.ioc);
+		if (external_command_stats.backlog > external_command_stats.max_backlog)
+			external_command_stats.max_backlog = external_command_stats.backlog;
+		}
+	return 0;
+	}
+
+
+/* unescapes newlines and backslashes in plugin output, the way unescape_check_result_output() does */
+static void unescape_output_in_place(char *buf) {
+	char *in, *out;
+
+	for (in = out = buf; *in; in++, out++) {
+		if (*in == '\\' && in[1] == '\\')
+			*out = *++in;
+		else if (*in == '\\' && in[1] == 'n') {
+			in++;
+			*out = '\n';
+			}
+		else
+			*out = *in;
+		}
+	*out = 0;
+	}
+
+
+/*
+ * PROCESS_SERVICE_CHECK_RESULT and PROCESS_HOST_CHECK_RESULT are what
+ * most of the commands are on busy systems. Unless a broker module
+ * wants to see external commands, we split them up in place and hand
+ * them straight to the passive check handlers instead of going through
+ * the copying and command name lookups process_external_command1() does.
+ * Returns FALSE for anything else, including malformed check results,
+ * which the caller then hands to process_external_command1().
+ */
+int process_check_result_command(char *cmd) {
+	char *p, *args, *host_end, *svc_end = NULL, *rc_end, *output;
+	const char *command_name;
+	time_t entry_time;
+	int command_type, return_code, result;
+
+#ifdef USE_EVENT_BROKER
+	if (event_broker_options & BROKER_EXTERNALCOMMAND_DATA)
+		return FALSE;
+#endif
+
+	strip(cmd);
+	if (cmd[0] != '[')
+		return FALSE;
+	entry_time = (time_t)strtoul(cmd + 1, &p, 10);
+	if (*p != ']' || !p[1])
+		return FALSE;
+	p += 2;
+
+	if (!strncasecmp(p, "PROCESS_SERVICE_CHECK_RESULT;", 29)) {
+		command_type = CMD_PROCESS_SERVICE_CHECK_RESULT;
+		command_name = "PROCESS_SERVICE_CHECK_RESULT";
+		args = p + 29;
+		}
+	else if (!strncasecmp(p, "PROCESS_HOST_CHECK_RESULT;", 26)) {
+		command_type = CMD_PROCESS_HOST_CHECK_RESULT;
+		command_name = "PROCESS_HOST_CHECK_RESULT";
+		args = p + 26;
+		}
+	else
+		return FALSE;
+
+	/* find all the fields before we change anything */
+	if (!(host_end = strchr(args, ';')))
+		return FALSE;
+	if (command_type == CMD_PROCESS_SERVICE_CHECK_RESULT && !(svc_end = strchr(host_end + 1, ';')))
+		return FALSE;
+	p = svc_end ? svc_end + 1 : host_end + 1;
+	if (!*p)
+		return FALSE;
+	rc_end = strchr(p, ';');
+	return_code = atoi(p);
+
+	update_check_stats(EXTERNAL_COMMAND_STATS, time(NULL));
+	if (log_passive_checks == TRUE)
+		logit(NSLOG_PASSIVE_CHECK, FALSE, "EXTERNAL COMMAND: %s;%s\n", command_name, args);
+
+	*host_end = 0;
+	if (svc_end)
+		*svc_end = 0;
+	if (rc_end) {
+		*rc_end = 0;
+		output = rc_end + 1;
+		unescape_output_in_place(output);
+		}
+	else
+		output = "";
+
+	log_debug_info(DEBUGL_EXTERNALCOMMANDS, 1, "External Command Type: %d\n", command_type);
+	log_debug_info(DEBUGL_EXTERNALCOMMANDS, 1, "Command Entry Time: %lu\n", (unsigned long)entry_time);
+
+	if (command_type == CMD_PROCESS_SERVICE_CHECK_RESULT)
+		result = process_passive_service_check(entry_time, args, host_end + 1, return_code, output);
+	else
+		result = process_passive_host_check(entry_time, args, return_code, output);
+
+	if (result != OK) {
+		logit(NSLOG_EXTERNAL_COMMAND | NSLOG_RUNTIME_WARNING, TRUE, "Error: External command failed -> %s;%s%s%s;%d;%s\n",
+			command_name, args, svc_end ? ";" : "", svc_end ? host_end + 1 : "", return_code, output);
+		}
+
+	external_command_stats.fast_path++;
+	return TRUE;
+	}
+
+
+/*
+ * Runs the commands read from the command file worker until there are
+ * no complete ones left, or we've spent max_external_command_time
+ * milliseconds on them. What's left is run on the next pass through
+ * the event loop, which doesn't wait for input while there is any.
+ */
+int process_external_command_backlog(void) {
+	struct timeval start, now;
+	unsigned long size;
+	char *buf;
+	int cmd_ret, processed = 0;
+
+	if (!command_backlog || !command_worker.ioc)
+		return 0;
+
+	gettimeofday(&start, NULL);
+	while (1) {
+		if (sigshutdown == TRUE || sigrestart == TRUE)
+			break;
+
+		if (!(buf = iocache_use_delim(command_worker.ioc, "\n", 1, &size))) {
+			command_backlog = FALSE;
+			break;
+			}
+		buf[size] = 0;
 		if (buf[0] == '[') {
 			/* raw external command */
-			buf[size] = 0;
 			log_debug_info(DEBUGL_COMMANDS, 1, "Read raw external command '%s'\n", buf);
 			}
 
-		if ((cmd_ret = process_external_command1(buf)) != CMD_ERROR_OK) {
-			logit(NSLOG_EXTERNAL_COMMAND | NSLOG_RUNTIME_WARNING, TRUE, "External command %s returned error %s\n", buf, cmd_error_strerror(cmd_ret));
+		processed++;
+		if (process_check_result_command(buf) == FALSE) {
+			if ((cmd_ret = process_external_command1(buf)) != CMD_ERROR_OK) {
+				logit(NSLOG_EXTERNAL_COMMAND | NSLOG_RUNTIME_WARNING, TRUE, "External command %s returned error %s\n", buf, cmd_error_strerror(cmd_ret));
+				}
 			}
 
+		gettimeofday(&now, NULL);
+		if (tv_delta_msec(&start, &now) >= max_external_command_time) {
+			external_command_stats.deferred++;
+			break;
+			}
 		}
-	return 0;
+
+	external_command_stats.commands += processed;
+	external_command_stats.backlog = iocache_available(command_worker.ioc);
+	log_debug_info(DEBUGL_COMMANDS, 1, "Processed %d external commands; %lu bytes left\n",
+		processed, external_command_stats.backlog);
+	return processed;
+	}
+
+
+/* tells the event loop not to wait for input while we have commands to run */
+int have_external_command_backlog(void) {
+	return command_backlog;
 	}
 
 
 /* main controller of command file helper process */
 static int command_file_worker(int sd) {
 	iocache *ioc;
+#ifdef SPLICE_F_MOVE
+	int use_splice = TRUE;
+#endif
 
 	if (open_command_file() == ERROR)
 		return (EXIT_FAILURE);
 
-	ioc = iocache_create(65536);
+	ioc = iocache_create(COMMAND_FILE_PIPE_SIZE);
 	if (!ioc)
 		exit(EXIT_FAILURE);
 
@@ -188,6 +378,7 @@ static int command_file_worker(int sd) {
 		int pollval, ret;
 		char *buf;
 		unsigned long size;
+		ssize_t written;
 
 		/* if our master has gone away, we need to die */
 		if (kill(nagios_pid, 0) < 0 && errno == ESRCH) {
@@ -215,22 +406,35 @@ static int command_file_worker(int sd) {
 			return EXIT_FAILURE;
 			}
 
+#ifdef SPLICE_F_MOVE
+		/*
+		 * Move the data straight from the pipe to the socket
+		 * without copying it through our memory. We go back to
+		 * copying if the kernel can't do that for us.
+		 */
+		if (use_splice) {
+			ret = splice(command_file_fd, NULL, sd, NULL, COMMAND_FILE_PIPE_SIZE, SPLICE_F_MOVE);
+			if (ret > 0)
+				continue;
+			if (ret < 0 && (errno == EAGAIN || errno == EINTR))
+				continue;
+			if (ret < 0 && errno != EINVAL)
+				return EXIT_FAILURE;
+			use_splice = FALSE;
+		}
+#endif
+
 		errno = 0;
 		ret = iocache_read(ioc, command_file_fd);
 		if (ret < 1) {
-			if (errno == EINTR)
+			if (errno == EINTR || errno == EAGAIN)
 				continue;
 			return EXIT_FAILURE;
 		}
 
 		size = iocache_available(ioc);
 		buf = iocache_use_size(ioc, size);
-		ret = write(sd, buf, size);
-		/*
-		 * @todo Add libio to get io_write_all(), which handles
-		 * EINTR and EAGAIN properly instead of just exiting.
-		 */
-		if (ret < 0 && errno != EINTR)
+		if (nwrite(sd, buf, size, &written) < 0)
 			return EXIT_FAILURE;
 		} /* while(1) */
 	}
@@ -3496,7 +3700,7 @@ int cmd_change_object_char_var(int cmd, char *args) {
 
 		case CMD_CHANGE_HOST_EVENT_HANDLER:
 
-			my_free(temp_host->event_handler);
+			free_object_string(temp_host->event_handler);
 			temp_host->event_handler = temp_ptr;
 			temp_host->event_handler_ptr = temp_command;
 			attr = MODATTR_EVENT_HANDLER_COMMAND;
@@ -3504,7 +3708,7 @@ int cmd_change_object_char_var(int cmd, char *args) {
 		
 		case CMD_CHANGE_HOST_EVENT_HANDLER_TIMEPERIOD:
 
-			my_free(temp_host->event_handler_period);
+			free_object_string(temp_host->event_handler_period);
 			temp_host->event_handler_period = temp_ptr;
 			temp_host->event_handler_period_ptr = temp_timeperiod;
 			attr = MODATTR_EVENT_HANDLER_TIMEPERIOD;
@@ -3512,7 +3716,7 @@ int cmd_change_object_char_var(int cmd, char *args) {
 
 		case CMD_CHANGE_HOST_CHECK_COMMAND:
 
-			my_free(temp_host->check_command);
+			free_object_string(temp_host->check_command);
 			temp_host->check_command = temp_ptr;
 			temp_host->check_command_ptr = temp_command;
 			attr = MODATTR_CHECK_COMMAND;
@@ -3520,7 +3724,7 @@ int cmd_change_object_char_var(int cmd, char *args) {
 
 		case CMD_CHANGE_HOST_CHECK_TIMEPERIOD:
 
-			my_free(temp_host->check_period);
+			free_object_string(temp_host->check_period);
 			temp_host->check_period = temp_ptr;
 			temp_host->check_period_ptr = temp_timeperiod;
 			attr = MODATTR_CHECK_TIMEPERIOD;
@@ -3528,7 +3732,7 @@ int cmd_change_object_char_var(int cmd, char *args) {
 
 		case CMD_CHANGE_HOST_NOTIFICATION_TIMEPERIOD:
 
-			my_free(temp_host->notification_period);
+			free_object_string(temp_host->notification_period);
 			temp_host->notification_period = temp_ptr;
 			temp_host->notification_period_ptr = temp_timeperiod;
 			attr = MODATTR_NOTIFICATION_TIMEPERIOD;
@@ -3536,7 +3740,7 @@ int cmd_change_object_char_var(int cmd, char *args) {
 
 		case CMD_CHANGE_SVC_EVENT_HANDLER:
 
-			my_free(temp_service->event_handler);
+			free_object_string(temp_service->event_handler);
 			temp_service->event_handler = temp_ptr;
 			temp_service->event_handler_ptr = temp_command;
 			attr = MODATTR_EVENT_HANDLER_COMMAND;
@@ -3544,7 +3748,7 @@ int cmd_change_object_char_var(int cmd, char *args) {
 
 		case CMD_CHANGE_SVC_EVENT_HANDLER_TIMEPERIOD:
 
-			my_free(temp_service->event_handler_period);
+			free_object_string(temp_service->event_handler_period);
 			temp_service->event_handler_period = temp_ptr;
 			temp_service->event_handler_period_ptr = temp_timeperiod;
 			attr = MODATTR_EVENT_HANDLER_TIMEPERIOD;
@@ -3552,7 +3756,7 @@ int cmd_change_object_char_var(int cmd, char *args) {
 
 		case CMD_CHANGE_SVC_CHECK_COMMAND:
 
-			my_free(temp_service->check_command);
+			free_object_string(temp_service->check_command);
 			temp_service->check_command = temp_ptr;
 			temp_service->check_command_ptr = temp_command;
 			attr = MODATTR_CHECK_COMMAND;
@@ -3560,7 +3764,7 @@ int cmd_change_object_char_var(int cmd, char *args) {
 
 		case CMD_CHANGE_SVC_CHECK_TIMEPERIOD:
 
-			my_free(temp_service->check_period);
+			free_object_string(temp_service->check_period);
 			temp_service->check_period = temp_ptr;
 			temp_service->check_period_ptr = temp_timeperiod;
 			attr = MODATTR_CHECK_TIMEPERIOD;
@@ -3568,7 +3772,7 @@ int cmd_change_object_char_var(int cmd, char *args) {
 
 		case CMD_CHANGE_SVC_NOTIFICATION_TIMEPERIOD:
 
-			my_free(temp_service->notification_period);
+			free_object_string(temp_service->notification_period);
 			temp_service->notification_period = temp_ptr;
 			temp_service->notification_period_ptr = temp_timeperiod;
 			attr = MODATTR_NOTIFICATION_TIMEPERIOD;
@@ -3576,7 +3780,7 @@ int cmd_change_object_char_var(int cmd, char *args) {
 
 		case CMD_CHANGE_CONTACT_HOST_NOTIFICATION_TIMEPERIOD:
 
-			my_free(temp_contact->host_notification_period);
+			free_object_string(temp_contact->host_notification_period);
 			temp_contact->host_notification_period = temp_ptr;
 			temp_contact->host_notification_period_ptr = temp_timeperiod;
 			hattr = MODATTR_NOTIFICATION_TIMEPERIOD;
@@ -3584,7 +3788,7 @@ int cmd_change_object_char_var(int cmd, char *args) {
 
 		case CMD_CHANGE_CONTACT_SVC_NOTIFICATION_TIMEPERIOD:
 
-			my_free(temp_contact->service_notification_period);
+			free_object_string(temp_contact->service_notification_period);
 			temp_contact->service_notification_period = temp_ptr;
 			temp_contact->service_notification_period_ptr = temp_timeperiod;
 			sattr = MODATTR_NOTIFICATION_TIMEPERIOD;
@@ -3696,6 +3900,7 @@ int cmd_change_object_custom_var(int cmd, char *args) {
 	service *temp_service = NULL;
 	contact *temp_contact = NULL;
 	customvariablesmember *temp_customvariablesmember = NULL;
+	customvariablesindex *temp_customvariablesindex = NULL;
 	char *temp_ptr = NULL;
 	char *name1 = NULL;
 	char *name2 = NULL;
@@ -3730,6 +3935,7 @@ int cmd_change_object_custom_var(int cmd, char *args) {
 				return ERROR;
 				}
 			temp_customvariablesmember = temp_host->custom_variables;
+			temp_customvariablesindex = &temp_host->custom_variable_index;
 			break;
 		case CMD_CHANGE_CUSTOM_SVC_VAR:
 			if((temp_service = find_service(name1, name2)) == NULL) {
@@ -3738,6 +3944,7 @@ int cmd_change_object_custom_var(int cmd, char *args) {
 				return ERROR;
 				}
 			temp_customvariablesmember = temp_service->custom_variables;
+			temp_customvariablesindex = &temp_service->custom_variable_index;
 			break;
 		case CMD_CHANGE_CUSTOM_CONTACT_VAR:
 			if((temp_contact = find_contact(name1)) == NULL) {
@@ -3746,6 +3953,7 @@ int cmd_change_object_custom_var(int cmd, char *args) {
 				return ERROR;
 				}
 			temp_customvariablesmember = temp_contact->custom_variables;
+			temp_customvariablesindex = &temp_contact->custom_variable_index;
 			break;
 		default:
 			break;
@@ -3781,22 +3989,16 @@ int cmd_change_object_custom_var(int cmd, char *args) {
 	for(x = 0; varname[x] != '\x0'; x++)
 		varname[x] = toupper(varname[x]);
 
-	/* find the proper variable */
-	for(; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
+	/* find the proper variable and update its value */
+	if((temp_customvariablesmember = find_indexed_custom_variable(temp_customvariablesmember, temp_customvariablesindex, varname))) {
 
-		/* we found the variable, so update the value */
-		if(!strcmp(varname, temp_customvariablesmember->variable_name)) {
+		/* update the value */
+		if(temp_customvariablesmember->variable_value)
+			free_object_string(temp_customvariablesmember->variable_value);
+		temp_customvariablesmember->variable_value = (char *)strdup(varvalue);
 
-			/* update the value */
-			if(temp_customvariablesmember->variable_value)
-				my_free(temp_customvariablesmember->variable_value);
-			temp_customvariablesmember->variable_value = (char *)strdup(varvalue);
-
-			/* mark the variable value as having been changed */
-			temp_customvariablesmember->has_been_modified = TRUE;
-
-			break;
-			}
+		/* mark the variable value as having been changed */
+		temp_customvariablesmember->has_been_modified = TRUE;
 		}
 
 	/* free memory */
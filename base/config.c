@@ -28,6 +28,7 @@
 #include "../include/broker.h"
 #include "../include/nebmods.h"
 #include "../include/nebmodules.h"
+#include "../include/workers.h"
 
 
 /*** helpers ****/
@@ -61,6 +62,7 @@ static command *find_bang_command(char *name)
 
 /* read all configuration data */
 int read_all_object_data(char *main_config_file) {
+	struct object_string_stats oss;
 	int result = OK;
 	int options = 0;
 
@@ -71,6 +73,13 @@ int read_all_object_data(char *main_config_file) {
 	if(result != OK)
 		return ERROR;
 
+	/* let the admin know how much sharing object strings saved */
+	get_object_string_stats(&oss);
+	if(oss.strings)
+		logit(NSLOG_INFO_MESSAGE, verify_config ? TRUE : FALSE, "Object strings: %lu of %lu unique, %llu KiB stored for %llu KiB of data (%.1f%% saved)\n",
+			  oss.unique, oss.strings, oss.size / 1024, oss.bytes / 1024,
+			  oss.bytes > oss.size ? 100.0 * (oss.bytes - oss.size) / oss.bytes : 0.0);
+
 	return OK;
 	}
 
@@ -189,6 +198,14 @@ int read_main_config_file(char *main_config_file) {
 			error = set_loadctl_options(value, strlen(value)) != OK;
 		else if(!strcmp(variable, "check_workers"))
 			num_check_workers = atoi(value);
+		else if(!strcmp(variable, "coprocess_plugin")) {
+			char *path = nspath_absolute(value, config_file_dir);
+			if(!path || wproc_add_coprocess_plugin(path) != OK) {
+				asprintf(&error_message, "malloc() error");
+				error = TRUE;
+				}
+			my_free(path);
+			}
 		else if(!strcmp(variable, "query_socket")) {
 			my_free(qh_socket_path);
 			qh_socket_path = nspath_absolute(value, config_file_dir);
@@ -433,6 +450,17 @@ int read_main_config_file(char *main_config_file) {
 			log_current_states = (atoi(value) > 0) ? TRUE : FALSE;
 			}
 
+		else if(!strcmp(variable, "index_log_file")) {
+
+			if(strlen(value) != 1 || value[0] < '0' || value[0] > '1') {
+				asprintf(&error_message, "Illegal value for index_log_file");
+				error = TRUE;
+				break;
+				}
+
+			index_log_file = (atoi(value) > 0) ? TRUE : FALSE;
+			}
+
 		else if(!strcmp(variable, "retain_state_information")) {
 
 			if(strlen(value) != 1 || value[0] < '0' || value[0] > '1') {
@@ -807,6 +835,36 @@ int read_main_config_file(char *main_config_file) {
 				}
 			}
 
+		else if(!strcmp(variable, "max_external_command_time")) {
+
+			max_external_command_time = atoi(value);
+			if(max_external_command_time < 1) {
+				asprintf(&error_message, "Illegal value for max_external_command_time");
+				error = TRUE;
+				break;
+				}
+			}
+
+		else if(!strcmp(variable, "check_storm_threshold")) {
+
+			check_storm_threshold = atoi(value);
+			if(check_storm_threshold < 0) {
+				asprintf(&error_message, "Illegal value for check_storm_threshold");
+				error = TRUE;
+				break;
+				}
+			}
+
+		else if(!strcmp(variable, "check_storm_drain_rate")) {
+
+			check_storm_drain_rate = atoi(value);
+			if(check_storm_drain_rate < 1) {
+				asprintf(&error_message, "Illegal value for check_storm_drain_rate");
+				error = TRUE;
+				break;
+				}
+			}
+
 		else if(!strcmp(variable, "sleep_time")) {
 			obsoleted_warning(variable, NULL);
 			}
@@ -1108,8 +1166,32 @@ int read_main_config_file(char *main_config_file) {
 		/* BEGIN status data variables */
 		else if(!strcmp(variable, "status_file"))
 			status_file = nspath_absolute(value, config_file_dir);
+		else if(!strcmp(variable, "binary_status_file"))
+			binary_status_file = nspath_absolute(value, config_file_dir);
+		else if(!strcmp(variable, "export_status_file")) {
+
+			if(strlen(value) != 1 || value[0] < '0' || value[0] > '1') {
+				asprintf(&error_message, "Illegal value for export_status_file");
+				error = TRUE;
+				break;
+				}
+
+			export_status_file = (atoi(value) > 0) ? TRUE : FALSE;
+			}
 		else if(strstr(input, "state_retention_file=") == input)
 			retention_file = nspath_absolute(value, config_file_dir);
+		else if(!strcmp(variable, "binary_retention_file"))
+			binary_retention_file = nspath_absolute(value, config_file_dir);
+		else if(!strcmp(variable, "export_retention_file")) {
+
+			if(strlen(value) != 1 || value[0] < '0' || value[0] > '1') {
+				asprintf(&error_message, "Illegal value for export_retention_file");
+				error = TRUE;
+				break;
+				}
+
+			export_retention_file = (atoi(value) > 0) ? TRUE : FALSE;
+			}
 		/* END status data variables */
 
 		/*** BEGIN perfdata variables ***/
@@ -1284,6 +1366,7 @@ int read_main_config_file(char *main_config_file) {
 	if(use_timezone != NULL)
 		set_environment_var("TZ", use_timezone, 1);
 	tzset();
+	clear_timeperiod_cache();
 
 	/* adjust tweaks */
 	if(free_child_process_memory == -1)
@@ -69,6 +69,168 @@ static void track_events(unsigned int type, int add)
 		event_count[type] += add;
 	}
 
+
+struct loop_stats loop_stats;
+
+/* which histograms an event type uses, or -1 if it has none */
+static int loop_stats_slot(int type)
+{
+	if (type >= 0 && type <= EVENT_SCHEDULED_DOWNTIME_END)
+		return type;
+	if (type == EVENT_SLEEP)
+		return LOOP_STATS_EVENT_TYPES - 2;
+	if (type == EVENT_USER_FUNCTION)
+		return LOOP_STATS_EVENT_TYPES - 1;
+	return -1;
+	}
+
+static uint64_t tv_delta_usec(const struct timeval *start, const struct timeval *stop)
+{
+	long long usec;
+
+	usec = (long long)(stop->tv_sec - start->tv_sec) * 1000000 + (stop->tv_usec - start->tv_usec);
+	return usec > 0 ? (uint64_t)usec : 0;
+	}
+
+void reset_loop_stats(void)
+{
+	memset(&loop_stats, 0, sizeof(loop_stats));
+	loop_stats.since = time(NULL);
+	}
+
+/*
+ * Gets the i'th histogram and its name: first the lateness and then
+ * the duration of each event type, then the rest of them.
+ */
+static histogram *get_loop_stats_histogram(unsigned int i, char *name, size_t len)
+{
+	const char *what;
+	histogram *h;
+	int type;
+	char *p;
+
+	if (i < LOOP_STATS_EVENT_TYPES * 2) {
+		unsigned int slot = i % LOOP_STATS_EVENT_TYPES;
+
+		type = slot == LOOP_STATS_EVENT_TYPES - 2 ? EVENT_SLEEP : slot == LOOP_STATS_EVENT_TYPES - 1 ? EVENT_USER_FUNCTION : (int)slot;
+		if (i < LOOP_STATS_EVENT_TYPES) {
+			what = "lateness";
+			h = &loop_stats.lateness[slot];
+			}
+		else {
+			what = "duration";
+			h = &loop_stats.duration[slot];
+			}
+		snprintf(name, len, "%s_%s", what, EVENT_TYPE_STR(type));
+		for (p = name; *p; p++)
+			*p = tolower(*p);
+		return h;
+		}
+
+	switch(i - LOOP_STATS_EVENT_TYPES * 2) {
+		case 0:
+			snprintf(name, len, "poll_wait");
+			return &loop_stats.poll_wait;
+		case 1:
+			snprintf(name, len, "poll_handling");
+			return &loop_stats.poll_handling;
+		case 2:
+			snprintf(name, len, "result_queue");
+			return &loop_stats.result_queue;
+		case 3:
+			snprintf(name, len, "result_handling");
+			return &loop_stats.result_handling;
+		case 4:
+			snprintf(name, len, "result_overhead");
+			return &loop_stats.result_overhead;
+		}
+
+	return NULL;
+	}
+
+/* fills in a summary of each histogram with anything in it, for status.dat */
+unsigned int summarize_loop_stats(struct loop_stats_summary *summary)
+{
+	unsigned int i, n = 0;
+	histogram *h;
+
+	for (i = 0; i < LOOP_STATS_HISTOGRAMS; i++) {
+		struct loop_stats_summary *s = &summary[n];
+
+		h = get_loop_stats_histogram(i, s->name, sizeof(s->name));
+		if (!h || !h->count)
+			continue;
+		s->count = (unsigned long)h->count;
+		s->p50 = histogram_percentile(h, 50) / 1000000.0;
+		s->p90 = histogram_percentile(h, 90) / 1000000.0;
+		s->p99 = histogram_percentile(h, 99) / 1000000.0;
+		s->max = h->max / 1000000.0;
+		n++;
+		}
+
+	return n;
+	}
+
+/*
+ * For the query handler. Without a name, prints a line with the
+ * percentiles of each histogram with anything in it, in milliseconds.
+ * With one, prints the buckets of that histogram: the highest value
+ * in each, in microseconds, and how many values it holds.
+ */
+int dump_loop_stats(int sd, const char *name)
+{
+	char hname[40];
+	unsigned int i, b;
+	histogram *h;
+
+	if (name == NULL) {
+		nsock_printf(sd, "since=%lu\n", (unsigned long)loop_stats.since);
+		for (i = 0; i < LOOP_STATS_HISTOGRAMS; i++) {
+			h = get_loop_stats_histogram(i, hname, sizeof(hname));
+			if (!h || !h->count)
+				continue;
+			nsock_printf(sd, "%s: count=%llu;min=%.3f;mean=%.3f;p50=%.3f;p90=%.3f;p99=%.3f;p999=%.3f;max=%.3f\n",
+			             hname, (unsigned long long)h->count, h->min / 1000.0, histogram_mean(h) / 1000.0,
+			             histogram_percentile(h, 50) / 1000.0, histogram_percentile(h, 90) / 1000.0,
+			             histogram_percentile(h, 99) / 1000.0, histogram_percentile(h, 99.9) / 1000.0,
+			             h->max / 1000.0);
+			}
+		nsock_printf(sd, "%c", 0);
+		return 0;
+		}
+
+	for (i = 0; i < LOOP_STATS_HISTOGRAMS; i++) {
+		h = get_loop_stats_histogram(i, hname, sizeof(hname));
+		if (h && !strcmp(hname, name))
+			break;
+		}
+	if (i == LOOP_STATS_HISTOGRAMS) {
+		nsock_printf_nul(sd, "No histogram named '%s'\n", name);
+		return 0;
+		}
+
+	for (b = 0; b < HISTOGRAM_BUCKETS; b++) {
+		if (h->buckets[b])
+			nsock_printf(sd, "%llu %u\n", (unsigned long long)histogram_bucket_top(b), h->buckets[b]);
+		}
+	nsock_printf(sd, "%c", 0);
+
+	return 0;
+	}
+
+/* counts how late an event ran and how long it took */
+static inline void track_event_timing(int type, uint64_t lateness, const struct timeval *start)
+{
+	struct timeval stop;
+	int slot;
+
+	if ((slot = loop_stats_slot(type)) < 0)
+		return;
+	gettimeofday(&stop, NULL);
+	histogram_add(&loop_stats.lateness[slot], lateness);
+	histogram_add(&loop_stats.duration[slot], tv_delta_usec(start, &stop));
+	}
+
 /* initialize the event timing loop before we start monitoring */
 void init_timing_loop(void) {
 	host *temp_host = NULL;
@@ -749,7 +911,9 @@ void display_scheduling_info(void) {
 
 /*
  * Create the event queue
- * We oversize it somewhat to avoid unnecessary growing
+ * We oversize it somewhat to avoid unnecessary growing. Nearly all
+ * events get rescheduled within the next hour, so a timing wheel
+ * is a lot cheaper than a heap for this queue.
  */
 int init_event_queue(void)
 {
@@ -760,7 +924,7 @@ int init_event_queue(void)
 		size = 4096;
 	}
 
-	nagios_squeue = squeue_create(size);
+	nagios_squeue = squeue_create_wheel(size);
 	return 0;
 }
 
@@ -1070,11 +1234,13 @@ int event_execution_loop(void) {
 	log_debug_info(DEBUGL_FUNCTIONS, 0, "event_execution_loop() start\n");
 
 	time(&last_time);
+	reset_loop_stats();
 
 	while(1) {
-		struct timeval now;
+		struct timeval now, poll_start, woke;
 		const struct timeval *event_runtime;
-		int inputs;
+		uint64_t lateness;
+		int inputs, event_type;
 
 		/* super-priority (hardcoded) events come first */
 
@@ -1093,6 +1259,12 @@ int event_execution_loop(void) {
 		else if((current_time - last_time) >= time_change_threshold)
 			compensate_for_system_time_change((unsigned long)last_time, (unsigned long)current_time);
 
+		/* hosts cut off or reconnected since we last got here get checked */
+		schedule_reachability_checks();
+
+		/* and checks held back during a check storm trickle out */
+		run_held_checks();
+
 		/* get next scheduled event */
 		current_event = temp_event = (timed_event *)squeue_peek(nagios_squeue);
 
@@ -1129,17 +1301,37 @@ int event_execution_loop(void) {
 		else if(poll_time_ms >= 1500)
 			poll_time_ms = 1500;
 
+		/* don't sit around waiting while there are commands to run */
+		if (have_external_command_backlog())
+			poll_time_ms = 0;
+
+		/* nor while there are held back checks to let out */
+		if (check_storm_stats.backlog > 0 && poll_time_ms > 100)
+			poll_time_ms = 100;
+
 		log_debug_info(DEBUGL_SCHEDULING | DEBUGL_IPC, 1, "## Polling %dms; sockets=%d; events=%u; iobs=%p\n",
 		               poll_time_ms, iobroker_get_num_fds(nagios_iobs),
 		               squeue_size(nagios_squeue), nagios_iobs);
+		gettimeofday(&poll_start, NULL);
 		inputs = iobroker_poll(nagios_iobs, poll_time_ms);
 		if (inputs < 0 && errno != EINTR) {
 			logit(NSLOG_RUNTIME_ERROR, TRUE, "Error: Polling for input on %p failed: %s", nagios_iobs, iobroker_strerror(inputs));
 			break;
 		}
+		if (inputs >= 0) {
+			gettimeofday(&now, NULL);
+			iobroker_last_wakeup(nagios_iobs, &woke);
+			histogram_add(&loop_stats.poll_wait, tv_delta_usec(&poll_start, &woke));
+			histogram_add(&loop_stats.poll_handling, tv_delta_usec(&woke, &now));
+		}
+
+		/* handle what the workers sent us, all in one go */
+		wproc_handle_results();
 
 		log_debug_info(DEBUGL_IPC, 2, "## %d descriptors had input\n", inputs);
 
+		process_external_command_backlog();
+
 		/*
 		 * if the event we peaked was removed from the queue from
 		 * one of the I/O operations, we must take care not to
@@ -1161,7 +1353,10 @@ int event_execution_loop(void) {
 			continue;
 
 		/* handle the event */
+		event_type = temp_event->event_type;
+		lateness = tv_delta_usec(event_runtime, &now);
 		handle_timed_event(temp_event);
+		track_event_timing(event_type, lateness, &now);
 
 		/*
 		 * we must remove the entry we've peeked, or
@@ -1400,25 +1595,14 @@ int handle_timed_event(timed_event *event) {
 
 
 
-/* The squeue internal event type, declared again here so we can manipulate the
- * scheduling queue without a malloc/free for each add/remove.
- * @todo: Refactor this to not depend so heavily on the event queue
- * implementation, doing so efficiently may require a different scheduling queue
- * data structure. */
-struct squeue_event {
-	unsigned int pos;
-	prqueue_pri_t pri;
-	struct timeval when;
-	void *data;
-	};
-
 /*
  * Adjusts scheduling of active, non-forced host and service checks.
  */
 void adjust_check_scheduling(void) {
-	prqueue_t *temp_prqueue; /* squeue_t is a typedef of prqueue_t. */
 	struct squeue_event *sq_event;
 	struct squeue_event **events_to_reschedule;
+	struct timeval window_end;
+	unsigned int num_events, x;
 
 	timed_event *temp_event;
 	service *temp_service = NULL;
@@ -1446,52 +1630,30 @@ void adjust_check_scheduling(void) {
 	last_window_time = first_window_time + auto_rescheduling_window;
 
 	/* Nothing to do if the first event is after the reschedule window. */
-	sq_event = prqueue_peek(nagios_squeue);
-	temp_event = sq_event ? sq_event->data : NULL;
+	temp_event = squeue_peek(nagios_squeue);
 	if (!temp_event || temp_event->run_time > last_window_time)
 		return;
 
 
-	/* Get a sorted array of all check events to reschedule. First we need a
-	 * duplicate of nagios_squeue so we can get the events in-order without
-	 * having to remove them from the original queue. We will use
-	 * prqueue_change_priority() to move the check events in the original queue.
-	 * @note: This is horribly dependent on implementation details of squeue
-	 * and prqueue, but we don't have much choice to avoid a free/malloc of each
-	 * squeue_event from the head to last_window_time, or avoid paying the full
-	 * O(n lg n) penalty twice to drain and rebuild the queue. */
-	temp_prqueue = malloc(sizeof(*temp_prqueue));
-	if (!temp_prqueue) {
-		logit(NSLOG_RUNTIME_ERROR, TRUE, "Failed to allocate queue needed to adjust check scheduling.\n");
-		return;
-		}
-	*temp_prqueue = *nagios_squeue;
-
-	/* We need a separate copy of the underlying queue array. */
-	temp_prqueue->d = malloc(temp_prqueue->size * sizeof(void*));
-	if (!temp_prqueue->d) {
-		logit(NSLOG_RUNTIME_ERROR, TRUE, "Failed to allocate queue data needed to adjust check scheduling.\n");
-		free(temp_prqueue);
-		return;
-		}
-	memcpy(temp_prqueue->d, nagios_squeue->d, temp_prqueue->size * sizeof(void*));
-	temp_prqueue->avail = temp_prqueue->size;
-
-	/* Now allocate space for a sorted array of check events. We shouldn't need
-	 * space for all events, but we can't really calculate how many we'll need
-	 * without looking at all events. */
-	events_to_reschedule = malloc((temp_prqueue->size - 1) * sizeof(void*));
+	/* Get a sorted array of all events up to the end of the window. They
+	 * stay in nagios_squeue, and we'll move the check events around in
+	 * there with squeue_change_priority_tv(), which avoids a free/malloc
+	 * of each squeue_event from the head to last_window_time. */
+	window_end.tv_sec = last_window_time;
+	window_end.tv_usec = 999999;
+	events_to_reschedule = squeue_get_range(nagios_squeue, &window_end, &num_events);
 	if (!events_to_reschedule) {
 		logit(NSLOG_RUNTIME_ERROR, TRUE, "Failed to allocate memory needed to adjust check scheduling.\n");
-		prqueue_free(temp_prqueue); /* prqueue_free() to keep the events. */
 		return;
 		}
 
-	/* Now we get the events to reschedule and collect some scheduling info. */
-	while ((sq_event = prqueue_pop(temp_prqueue))) {
+	/* Now we pick out the events to reschedule and collect some scheduling
+	 * info. Those are compacted at the start of the array as we go. */
+	for (x = 0; x < num_events; x++) {
+		sq_event = events_to_reschedule[x];
 
 		/* We need a timed_event and event data. */
-		temp_event = sq_event->data;
+		temp_event = squeue_event_data(sq_event);
 		if (!temp_event || !temp_event->event_data)
 			continue;
 
@@ -1522,28 +1684,19 @@ void adjust_check_scheduling(void) {
 			}
 
 		/* Reschedule if the last check overlap into this one. */
-		if (last_check_tv.tv_sec > 0 && tv_delta_msec(&last_check_tv, &sq_event->when) < INTER_CHECK_RESCHEDULE_THRESHOLD * 1000) {
-/*			log_debug_info(DEBUGL_SCHEDULING, 2, "Rescheduling event %d: %.3fs delay.\n", total_checks, tv_delta_f(&last_check_tv, &sq_event->when));
+		if (last_check_tv.tv_sec > 0 && tv_delta_msec(&last_check_tv, squeue_event_runtime(sq_event)) < INTER_CHECK_RESCHEDULE_THRESHOLD * 1000) {
+/*			log_debug_info(DEBUGL_SCHEDULING, 2, "Rescheduling event %d: %.3fs delay.\n", total_checks, tv_delta_f(&last_check_tv, squeue_event_runtime(sq_event)));
 */			adjust_scheduling = TRUE;
 			}
 
-		last_check_tv = sq_event->when;
+		last_check_tv = *squeue_event_runtime(sq_event);
 		events_to_reschedule[total_checks++] = sq_event;
 		}
 
-	/* Removing squeue_events from temp_prqueue invalidates the positions of
-	 * those events in nagios_squeue, so we need to fix that up before we
-	 * return or change their priorities. Start at i=1 since i=0 is unused. */
-	for (i = 1; i < (int)nagios_squeue->size; ++i) {
-		if ((sq_event = nagios_squeue->d[i]))
-			sq_event->pos = i;
-		}
-
 	/* No checks to reschedule, nothing to do... */
 	if (total_checks < 2 || !adjust_scheduling) {
 		log_debug_info(DEBUGL_SCHEDULING, 0, "No events need to be rescheduled (%d checks in %ds window).\n", total_checks, auto_rescheduling_window);
 
-		prqueue_free(temp_prqueue);
 		free(events_to_reschedule);
 		return;
 		}
@@ -1562,7 +1715,7 @@ void adjust_check_scheduling(void) {
 		/* All events_to_reschedule are valid squeue_events with data pointers
 		 * to timed_events for non-forced host or service checks. */
 		sq_event = events_to_reschedule[i];
-		temp_event = sq_event->data;
+		temp_event = squeue_event_data(sq_event);
 
 		/* Calculate and apply a new queue 'when' time. */
 		new_run_time.tv_sec = first_window_time + (time_t)floor(new_run_time_offset);
@@ -1611,7 +1764,6 @@ void adjust_check_scheduling(void) {
 
 	log_debug_info(DEBUGL_FUNCTIONS, 0, "adjust_check_scheduling() end\n");
 
-	prqueue_free(temp_prqueue);
 	free(events_to_reschedule);
 	return;
 	}
@@ -1625,7 +1777,7 @@ static void adjust_squeue_for_time_change(squeue_t **q, int delta) {
 	 * but it should be pretty rare that we have to adjust times
 	 * so we go with the well-tested codepath.
 	 */
-	sq_new = squeue_create(squeue_size(*q));
+	sq_new = squeue_create_wheel(squeue_size(*q));
 	while ((event = squeue_pop(*q))) {
 		if (event->compensate_for_time_change == TRUE) {
 			if (event->timing_func) {
@@ -1689,6 +1841,9 @@ void compensate_for_system_time_change(unsigned long last_time, unsigned long cu
 
 	adjust_squeue_for_time_change(&nagios_squeue, delta);
 
+	/* a clock that jumps may well have been set to another timezone too */
+	clear_timeperiod_cache();
+
 	/* adjust service timestamps */
 	for(temp_service = service_list; temp_service != NULL; temp_service = temp_service->next) {
 
@@ -27,10 +27,33 @@
 #include "../include/nagios.h"
 #include "../include/broker.h"
 #include <fcntl.h>
+#include <pthread.h>
 
 
 static FILE *debug_file_fp;
 static FILE *log_fp;
+static logindex *log_index;
+static unsigned long long log_offset; /* where the next log line goes */
+
+/*
+ * Only the main thread writes to the main log, since that's also where
+ * log rotation and the event broker live. Threads that call
+ * queue_log_messages() have their messages queued until the main thread
+ * gets around to them. The debug log is simply locked.
+ */
+struct queued_log_message {
+	char *buffer;
+	unsigned long data_type;
+	int display;
+	time_t timestamp;
+	struct queued_log_message *next;
+	};
+static struct queued_log_message *log_queue, **log_queue_tail = &log_queue;
+static pthread_mutex_t log_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t debug_log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t log_queue_once = PTHREAD_ONCE_INIT;
+static pthread_key_t log_queue_key;
+static int have_log_queue_key;
 
 /******************************************************************/
 /************************ LOGGING FUNCTIONS ***********************/
@@ -44,8 +67,10 @@ static void write_to_console(char *buffer) {
 	}
 
 
+static void write_to_all_logs_with_timestamp(char *buffer, unsigned long data_type, time_t *timestamp);
+
 /* write something to the log file, syslog, and possibly the console */
-static void write_to_logs_and_console(char *buffer, unsigned long data_type, int display) {
+static void write_to_logs_and_console(char *buffer, unsigned long data_type, int display, time_t *timestamp) {
 	register int len = 0;
 	register int x = 0;
 
@@ -59,7 +84,7 @@ static void write_to_logs_and_console(char *buffer, unsigned long data_type, int
 		}
 
 	/* write messages to the logs */
-	write_to_all_logs(buffer, data_type);
+	write_to_all_logs_with_timestamp(buffer, data_type, timestamp);
 
 	/* write message to the console */
 	if(display == TRUE) {
@@ -73,6 +98,59 @@ static void write_to_logs_and_console(char *buffer, unsigned long data_type, int
 	}
 
 
+static void create_log_queue_key(void) {
+	if(pthread_key_create(&log_queue_key, NULL) == 0)
+		have_log_queue_key = TRUE;
+	}
+
+
+void queue_log_messages(void) {
+	pthread_once(&log_queue_once, create_log_queue_key);
+	if(have_log_queue_key == TRUE)
+		pthread_setspecific(log_queue_key, &log_queue);
+	}
+
+
+static int queue_log_message(char *buffer, unsigned long data_type, int display) {
+	struct queued_log_message *msg;
+
+	if(have_log_queue_key == FALSE || pthread_getspecific(log_queue_key) == NULL)
+		return FALSE;
+	if(!(msg = malloc(sizeof(*msg))))
+		return TRUE;
+
+	msg->buffer = buffer;
+	msg->data_type = data_type;
+	msg->display = display;
+	msg->timestamp = time(NULL);
+	msg->next = NULL;
+	pthread_mutex_lock(&log_queue_lock);
+	*log_queue_tail = msg;
+	log_queue_tail = &msg->next;
+	pthread_mutex_unlock(&log_queue_lock);
+
+	return TRUE;
+	}
+
+
+void write_queued_log_messages(void) {
+	struct queued_log_message *msg, *next;
+
+	pthread_mutex_lock(&log_queue_lock);
+	msg = log_queue;
+	log_queue = NULL;
+	log_queue_tail = &log_queue;
+	pthread_mutex_unlock(&log_queue_lock);
+
+	for(; msg != NULL; msg = next) {
+		next = msg->next;
+		write_to_logs_and_console(msg->buffer, msg->data_type, msg->display, &msg->timestamp);
+		free(msg->buffer);
+		free(msg);
+		}
+	}
+
+
 /* The main logging function */
 void logit(int data_type, int display, const char *fmt, ...) {
 	va_list ap;
@@ -80,7 +158,11 @@ void logit(int data_type, int display, const char *fmt, ...) {
 
 	va_start(ap, fmt);
 	if(vasprintf(&buffer, fmt, ap) > 0) {
-		write_to_logs_and_console(buffer, data_type, display);
+		if(queue_log_message(buffer, data_type, display) == TRUE) {
+			va_end(ap);
+			return;
+			}
+		write_to_logs_and_console(buffer, data_type, display, NULL);
 		free(buffer);
 		}
 	va_end(ap);
@@ -146,6 +228,13 @@ static FILE *open_log_file(void)
 	}
 
 	(void)fcntl(fileno(log_fp), F_SETFD, FD_CLOEXEC);
+
+	log_offset = st.st_size;
+	if (index_log_file == TRUE && !(log_index = logindex_open(log_file))) {
+		if (daemon_mode == FALSE)
+			printf("Warning: Cannot open the index of log file '%s'\n", log_file);
+	}
+
 	return log_fp;
 }
 
@@ -156,11 +245,19 @@ int fix_log_file_owner(uid_t uid, gid_t gid)
 	if (!(log_fp = open_log_file()))
 		return -1;
 	r1 = fchown(fileno(log_fp), uid, gid);
+	if (log_index) {
+		char *idx_path = logindex_path(log_file);
+		if (idx_path && chown(idx_path, uid, gid) < 0)
+			r1 = -1;
+		free(idx_path);
+	}
 
 	if (open_debug_log() != OK)
 		return -1;
+	pthread_mutex_lock(&debug_log_lock);
 	if (debug_file_fp)
 		r2 = fchown(fileno(debug_file_fp), uid, gid);
+	pthread_mutex_unlock(&debug_log_lock);
 
 	/* return 0 if both are 0 and otherwise < 0 */
 	return r1 < r2 ? r1 : r2;
@@ -174,6 +271,8 @@ int close_log_file(void)
 	fflush(log_fp);
 	fclose(log_fp);
 	log_fp = NULL;
+	logindex_close(log_index, log_offset);
+	log_index = NULL;
 	return 0;
 }
 
@@ -181,6 +280,7 @@ int close_log_file(void)
 int write_to_log(char *buffer, unsigned long data_type, time_t *timestamp) {
 	FILE *fp;
 	time_t log_time = 0L;
+	int len;
 
 	if(buffer == NULL)
 		return ERROR;
@@ -206,8 +306,13 @@ int write_to_log(char *buffer, unsigned long data_type, time_t *timestamp) {
 	strip(buffer);
 
 	/* write the buffer to the log file */
-	fprintf(fp, "[%llu] %s\n", (unsigned long long)log_time, buffer);
+	len = fprintf(fp, "[%llu] %s\n", (unsigned long long)log_time, buffer);
 	fflush(fp);
+	if (len > 0) {
+		if (log_index)
+			logindex_add(log_index, log_offset, log_time, buffer);
+		log_offset += len;
+		}
 
 #ifdef USE_EVENT_BROKER
 	/* send data to the event broker */
@@ -418,8 +523,16 @@ int rotate_log_file(time_t rotation_time) {
 		return OK;
 	}
 
-	/* rotate the log file */
+	/* rotate the log file, and its index along with it */
 	rename_result = my_rename(log_file, log_archive);
+	if (!rename_result && index_log_file == TRUE) {
+		char *idx_path = logindex_path(log_file);
+		char *archive_idx_path = logindex_path(log_archive);
+		if (idx_path && archive_idx_path)
+			my_rename(idx_path, archive_idx_path);
+		my_free(idx_path);
+		my_free(archive_idx_path);
+		}
 	log_fp = open_log_file();
 	if (log_fp == NULL)
 		return ERROR;
@@ -468,8 +581,8 @@ int write_log_file_info(time_t *timestamp) {
 	}
 
 
-/* opens the debug log for writing */
-int open_debug_log(void)
+/* opens the debug log for writing. The caller holds debug_log_lock */
+static int open_debug_log_locked(void)
 {
 	int fh;
 	struct stat st;
@@ -504,13 +617,33 @@ int open_debug_log(void)
 	}
 
 
-/* closes the debug log */
-int close_debug_log(void) {
+static void close_debug_log_locked(void) {
 
 	if(debug_file_fp != NULL)
 		fclose(debug_file_fp);
 
 	debug_file_fp = NULL;
+	}
+
+
+/* opens the debug log for writing */
+int open_debug_log(void) {
+	int result;
+
+	pthread_mutex_lock(&debug_log_lock);
+	result = open_debug_log_locked();
+	pthread_mutex_unlock(&debug_log_lock);
+
+	return result;
+	}
+
+
+/* closes the debug log */
+int close_debug_log(void) {
+
+	pthread_mutex_lock(&debug_log_lock);
+	close_debug_log_locked();
+	pthread_mutex_unlock(&debug_log_lock);
 
 	return OK;
 	}
@@ -528,8 +661,11 @@ int log_debug_info(int level, int verbosity, const char *fmt, ...) {
 	if(verbosity > debug_verbosity)
 		return OK;
 
-	if(debug_file_fp == NULL)
+	pthread_mutex_lock(&debug_log_lock);
+	if(debug_file_fp == NULL) {
+		pthread_mutex_unlock(&debug_log_lock);
 		return ERROR;
+		}
 
 	/* write the timestamp */
 	gettimeofday(&current_time, NULL);
@@ -547,7 +683,7 @@ int log_debug_info(int level, int verbosity, const char *fmt, ...) {
 	if((unsigned long)ftell(debug_file_fp) > max_debug_file_size && max_debug_file_size > 0L) {
 
 		/* close the file */
-		close_debug_log();
+		close_debug_log_locked();
 
 		/* rotate the log file */
 		asprintf(&tmppath, "%s.old", debug_file);
@@ -564,8 +700,9 @@ int log_debug_info(int level, int verbosity, const char *fmt, ...) {
 			}
 
 		/* open a new file */
-		open_debug_log();
+		open_debug_log_locked();
 		}
+	pthread_mutex_unlock(&debug_log_lock);
 
 	return OK;
 	}
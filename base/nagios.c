@@ -46,6 +46,7 @@
 #include "../include/nebmods.h"
 #include "../include/nebmodules.h"
 #include "../include/workers.h"
+#include "../xdata/xodbinary.h"
 
 /*#define DEBUG_MEMORY 1*/
 #ifdef DEBUG_MEMORY
@@ -179,6 +180,8 @@ static int nagios_core_worker(const char *path)
 		return 1;
 	}
 
+	/* split check output here rather than in the main process */
+	worker_set_response_filter(wproc_split_check_output);
 	enter_worker(sd, start_cmd);
 	free_worker_memory(WPROC_FORCE);
 	free_memory(get_global_macros());
@@ -483,7 +486,10 @@ int main(int argc, char **argv) {
 			}
 
 		if(verify_config) {
-			printf("   Read object config files okay...\n\n");
+			printf("   Read object config files okay...\n");
+			if(use_precached_objects == FALSE)
+				xodbinary_check_snapshot(object_precache_file);
+			printf("\n");
 			printf("Running pre-flight check on configuration data...\n\n");
 			}
 
@@ -528,7 +534,7 @@ int main(int argc, char **argv) {
 			}
 
 		if(precache_objects) {
-			result = fcache_objects(object_precache_file);
+			result = xodbinary_write_object_config(object_precache_file);
 			timing_point("Done precaching objects\n");
 			if(result == OK) {
 				printf("Object precache file created:\n%s\n", object_precache_file);
@@ -810,6 +816,11 @@ int main(int argc, char **argv) {
 			init_check_stats();
 			timing_point("check stats initialized\n");
 
+			/* index dependencies, now that we know the initial states */
+			init_dependency_cache();
+			init_host_reachability();
+			timing_point("Dependency cache and reachability index initialized\n");
+
 			/* check for updates */
 			check_for_nagios_updates(FALSE, TRUE);
 			timing_point("Update check concluded\n");
@@ -883,10 +894,13 @@ int main(int argc, char **argv) {
 			/* clean up comment data */
 			free_comment_data();
 
-			/* clean up the status data if we are not restarting */
-			if(sigrestart == FALSE) {
-				cleanup_status_data(TRUE);
-				}
+			/* forget dependency results, reachability and held back checks before the objects go away */
+			free_dependency_cache();
+			free_host_reachability();
+			free_held_checks();
+
+			/* clean up the status data, but leave the files for the CGIs if we are restarting */
+			cleanup_status_data(sigrestart == TRUE ? FALSE : TRUE);
 
 			free_worker_memory(WPROC_FORCE);
 			/* shutdown stuff... */
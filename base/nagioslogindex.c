@@ -0,0 +1,178 @@
+/*****************************************************************************
+ *
+ * NAGIOSLOGINDEX.C - Builds and benchmarks indexes of Nagios log files
+ *
+ * Program: Nagioslogindex
+ * License: GPL
+ *
+ * License:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *****************************************************************************/
+
+/*
+ * Nagios indexes its current log file as it writes it and moves the
+ * index along with it when it rotates the log, but archives written
+ * by older versions of Nagios (or copied in from elsewhere) have no
+ * index. This builds one for each log file named on the command line.
+ *
+ * With -b, it instead compares how long it takes to find the state
+ * changes of a host or service in each file by reading all of it,
+ * the way the CGIs do without an index, and by going through its index.
+ */
+
+#include "../lib/libnagios.h"
+#include "../include/config.h"
+#include "../include/common.h"
+
+#define BENCH_TYPES (LOGIDX_PROGRAM | LOGIDX_ALERT | LOGIDX_STATE | LOGIDX_DOWNTIME)
+
+static double tv_elapsed(struct timeval *start)
+{
+	struct timeval stop;
+
+	gettimeofday(&stop, NULL);
+	return tv_delta_f(start, &stop);
+}
+
+/* read every line and pick out the ones about our host or service */
+static int bench_linear(const char *path, const char *host, const char *svc, double *elapsed)
+{
+	struct timeval start;
+	FILE *fp;
+	char *line = NULL;
+	size_t size = 0;
+	uint32_t want, key;
+	int found = 0;
+
+	gettimeofday(&start, NULL);
+	if (!(fp = fopen(path, "r")))
+		return -1;
+	want = logindex_key(host, svc);
+	while (getline(&line, &size, fp) > 0) {
+		char *msg = strchr(line, ']');
+		unsigned int type;
+
+		if (!msg || msg[1] != ' ')
+			continue;
+		type = logindex_classify(msg + 2, &key);
+		if ((type & LOGIDX_PROGRAM) || ((type & BENCH_TYPES) && key == want))
+			found++;
+	}
+	free(line);
+	fclose(fp);
+	*elapsed = tv_elapsed(&start);
+	return found;
+}
+
+static int bench_indexed(const char *path, const char *host, const char *svc, double *elapsed, int *indexed)
+{
+	struct timeval start;
+	logindex_reader *r;
+	char *line;
+	int found = 0;
+
+	gettimeofday(&start, NULL);
+	if (!(r = logindex_reader_open(path, BENCH_TYPES | (svc ? LOGIDX_SERVICE : LOGIDX_HOST))))
+		return -1;
+	logindex_reader_want(r, host, svc);
+	*indexed = logindex_reader_indexed(r);
+	while ((line = logindex_reader_gets(r))) {
+		found++;
+		free(line);
+	}
+	logindex_reader_close(r);
+	*elapsed = tv_elapsed(&start);
+	return found;
+}
+
+static int bench(const char *path, const char *host, const char *svc)
+{
+	double linear_time, indexed_time;
+	int linear_found, indexed_found, indexed;
+
+	if ((linear_found = bench_linear(path, host, svc, &linear_time)) < 0 ||
+	    (indexed_found = bench_indexed(path, host, svc, &indexed_time, &indexed)) < 0)
+	{
+		printf("%s: %s\n", path, strerror(errno));
+		return ERROR;
+	}
+
+	printf("%s: linear %.6fs (%d lines), %s %.6fs (%d lines)", path,
+	       linear_time, linear_found, indexed ? "indexed" : "unindexed",
+	       indexed_time, indexed_found);
+	if (indexed_time > 0)
+		printf(", %.1fx", linear_time / indexed_time);
+	putchar('\n');
+	return OK;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-b <host>[;<service>]] <log file>...\n", name);
+	printf("\n");
+	printf("Builds the indexes the availability, trends and archive CGIs use to\n");
+	printf("find state changes in Nagios log files, for log files written by a\n");
+	printf("Nagios that didn't index them.\n");
+	printf("\n");
+	printf("Options:\n");
+	printf(" -b <host>[;<service>]  compare reading the state changes of a host or\n");
+	printf("                        service from each log file with and without its\n");
+	printf("                        index instead of building the indexes\n");
+	printf(" -h                     display usage information and exit\n");
+}
+
+int main(int argc, char **argv)
+{
+	char *host = NULL, *svc = NULL;
+	int c, i, result = OK;
+
+	while ((c = getopt(argc, argv, "hb:")) != -1) {
+		switch (c) {
+		case 'b':
+			host = optarg;
+			if ((svc = strchr(host, ';')))
+				*svc++ = 0;
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (optind >= argc) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	for (i = optind; i < argc; i++) {
+		int entries;
+
+		if (host) {
+			if (bench(argv[i], host, svc) != OK)
+				result = ERROR;
+			continue;
+		}
+
+		if ((entries = logindex_build(argv[i])) < 0) {
+			printf("%s: Failed to build index: %s\n", argv[i], strerror(errno));
+			result = ERROR;
+			continue;
+		}
+		printf("%s: %d lines indexed\n", argv[i], entries);
+	}
+
+	return result == OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
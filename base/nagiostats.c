@@ -189,11 +189,72 @@ static int active_cached_service_checks_last_15min = 0;
 static int external_commands_last_1min = 0;
 static int external_commands_last_5min = 0;
 static int external_commands_last_15min = 0;
+static unsigned long external_commands_run = 0L;
+static unsigned long external_commands_fast = 0L;
+static unsigned long external_command_deferrals = 0L;
+static unsigned long external_command_backlog = 0L;
+static unsigned long max_external_command_backlog = 0L;
+
+static unsigned long check_results_from_workers = 0L;
+static unsigned long check_results_presplit = 0L;
+static double min_check_result_parse_time = 0.0;
+static double max_check_result_parse_time = 0.0;
+static double average_check_result_parse_time = 0.0;
+static int check_result_queue_depth = 0;
+static int max_check_result_queue_depth = 0;
+static unsigned long check_result_batches = 0L;
+static unsigned long check_result_batch_size[4] = { 0L, 0L, 0L, 0L };
+static double min_check_result_latency = 0.0;
+static double max_check_result_latency = 0.0;
+static double average_check_result_latency = 0.0;
+static double min_check_result_handling_time = 0.0;
+static double max_check_result_handling_time = 0.0;
+static double average_check_result_handling_time = 0.0;
+
+static unsigned long status_file_bytes = 0L;
+static int status_file_objects_written = 0;
+static int status_file_objects_skipped = 0;
+static unsigned long binary_status_file_bytes = 0L;
+static int binary_status_file_slots_written = 0;
+static double state_snapshot_time = 0.0;
+static double max_state_snapshot_time = 0.0;
+static double state_write_time = 0.0;
+static double max_state_write_time = 0.0;
+static double max_state_write_stall = 0.0;
+static unsigned long state_writes_coalesced = 0L;
+static unsigned long check_storms = 0L;
+static unsigned long on_demand_checks_coalesced = 0L;
+static unsigned long on_demand_checks_deferred = 0L;
+static unsigned long on_demand_check_backlog = 0L;
+static int check_storm_active = 0;
+static time_t event_loop_stats_since = 0L;
+static struct loop_stat {
+	char name[40];
+	unsigned long count;
+	double p50, p90, p99, max;
+	} event_loop_stats[64];
+static int num_event_loop_stats = 0;
+
+/* the loop statistics MRTG variables can ask for */
+static struct {
+	const char *var;
+	const char *name;
+	double scale;   /* from seconds to what MRTG gets */
+	} loop_stat_vars[] = {
+	{ "SVCEVTLATE", "lateness_service_check", 1000 },
+	{ "HSTEVTLATE", "lateness_host_check", 1000 },
+	{ "POLLWAIT", "poll_wait", 1000 },
+	{ "POLLHANDLE", "poll_handling", 1000 },
+	{ "RESQUEUE", "result_queue", 1000 },
+	{ "RESHANDLE", "result_handling", 1000 },
+	{ "RESOVERHEAD", "result_overhead", 1000000 },
+	};
 
 static int display_mrtg_values(void);
 static int display_stats(void);
 static int read_config_file(void);
 static int read_status_file(void);
+static int display_loop_stat_mrtg_value(const char *var);
 
 
 int main(int argc, char **argv) {
@@ -374,9 +435,45 @@ int main(int argc, char **argv) {
 		printf(" NUMSACTSVCCHECKSxM   number of scheduled active service checks occurring in last 1/5/15 minutes.\n");
 		printf(" NUMPSVSVCCHECKSxM    number of passive service checks occurring in last 1/5/15 minutes.\n");
 		printf(" NUMEXTCMDSxM         number of external commands processed in last 1/5/15 minutes.\n");
+		printf(" NUMEXTCMDSRUN        number of external commands read from the command file and run.\n");
+		printf(" NUMEXTCMDSFAST       number of check result commands that took the fast path.\n");
+		printf(" NUMEXTCMDDEFERRALS   number of times external commands were left for the next loop.\n");
+		printf(" EXTCMDBACKLOG        bytes of external commands read but not yet run.\n");
+		printf(" MAXEXTCMDBACKLOG     largest external command backlog seen, in bytes.\n");
+		printf(" NUMWPRESULTS         number of check results received from workers.\n");
+		printf(" NUMWPRESPLIT         number of check results with output already split by workers.\n");
+		printf(" xxxCHKRESPARSE       MIN/MAX/AVG time workers spent splitting check output (us).\n");
+		printf(" CHKRESQDEPTH         number of check results read from workers in the last batch.\n");
+		printf(" MAXCHKRESQDEPTH      highest number of check results read from workers in one batch.\n");
+		printf(" xxxCHKRESLAT         MIN/MAX/AVG time check results waited before being picked up (ms).\n");
+		printf(" xxxCHKRESHDL         MIN/MAX/AVG time spent handling check results (ms).\n");
+		printf(" STATUSBYTES          bytes written in the last status file update.\n");
+		printf(" STATUSWRITTEN        hosts and services formatted in the last status file update.\n");
+		printf(" STATUSSKIPPED        unchanged hosts and services copied in the last status file update.\n");
+		printf(" BINSTATUSBYTES       bytes written in the last binary status file update.\n");
+		printf(" BINSTATUSWRITTEN     host and service slots written in the last binary status file update.\n");
+		printf(" STATESNAPTIME        time the last snapshot of status and retention data took (ms).\n");
+		printf(" MAXSTATESNAPTIME     longest time a snapshot of status and retention data took (ms).\n");
+		printf(" STATEWRITETIME       time writing the last snapshot out in the background took (ms).\n");
+		printf(" MAXSTATEWRITETIME    longest time writing a snapshot out in the background took (ms).\n");
+		printf(" MAXSTATESTALL        longest time the event loop waited on status and retention data (ms).\n");
+		printf(" NUMSTATECOALESCED    number of state writes folded into one already in progress.\n");
+		printf(" NUMCHKSTORMS         number of times on-demand checks came in fast enough to start storm mode.\n");
+		printf(" NUMODCHKCOALESCED    number of on-demand checks folded into one already pending.\n");
+		printf(" NUMODCHKDEFERRED     number of on-demand checks held back during check storms.\n");
+		printf(" ODCHKBACKLOG         number of on-demand checks currently held back.\n");
+		printf(" xxxSVCEVTLATE        P50/P90/P99/MAX time service check events ran late (ms).\n");
+		printf(" xxxHSTEVTLATE        P50/P90/P99/MAX time host check events ran late (ms).\n");
+		printf(" xxxPOLLWAIT          P50/P90/P99/MAX time the event loop waited for input (ms).\n");
+		printf(" xxxPOLLHANDLE        P50/P90/P99/MAX time the event loop spent handling input (ms).\n");
+		printf(" xxxRESQUEUE          P50/P90/P99/MAX time check results waited before being picked up (ms).\n");
+		printf(" xxxRESHANDLE         P50/P90/P99/MAX time spent handling check results (ms).\n");
+		printf(" xxxRESOVERHEAD       P50/P90/P99/MAX time per worker message spent outside result handling (us).\n");
+		printf(" NUMRESBATCHES        number of batches of worker messages handled.\n");
+		printf(" xxxRESBATCH          P50/P90/P99/MAX number of worker messages handled in one batch.\n");
 
 		printf("\n");
-		printf(" Note: Replace x's in MRTG variable names with 'MIN', 'MAX', 'AVG', or the\n");
+		printf(" Note: Replace x's in MRTG variable names with 'MIN', 'MAX', 'AVG', 'P50', 'P90', 'P99' or the\n");
 		printf("       the appropriate number (i.e. '1', '5', '15', or '60').\n");
 		printf("\n");
 
@@ -682,6 +779,80 @@ static int display_mrtg_values(void) {
 			printf("%d%s", external_commands_last_5min, mrtg_delimiter);
 		else if(!strcmp(temp_ptr, "NUMEXTCMDS15M"))
 			printf("%d%s", external_commands_last_15min, mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "NUMEXTCMDSRUN"))
+			printf("%lu%s", external_commands_run, mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "NUMEXTCMDSFAST"))
+			printf("%lu%s", external_commands_fast, mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "NUMEXTCMDDEFERRALS"))
+			printf("%lu%s", external_command_deferrals, mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "EXTCMDBACKLOG"))
+			printf("%lu%s", external_command_backlog, mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "MAXEXTCMDBACKLOG"))
+			printf("%lu%s", max_external_command_backlog, mrtg_delimiter);
+
+		/* check result pipeline stats */
+		else if(!strcmp(temp_ptr, "NUMWPRESULTS"))
+			printf("%lu%s", check_results_from_workers, mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "NUMWPRESPLIT"))
+			printf("%lu%s", check_results_presplit, mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "MINCHKRESPARSE"))
+			printf("%d%s", (int)(min_check_result_parse_time * 1000000), mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "MAXCHKRESPARSE"))
+			printf("%d%s", (int)(max_check_result_parse_time * 1000000), mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "AVGCHKRESPARSE"))
+			printf("%d%s", (int)(average_check_result_parse_time * 1000000), mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "CHKRESQDEPTH"))
+			printf("%d%s", check_result_queue_depth, mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "NUMRESBATCHES"))
+			printf("%lu%s", check_result_batches, mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "MAXCHKRESQDEPTH"))
+			printf("%d%s", max_check_result_queue_depth, mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "MINCHKRESLAT"))
+			printf("%d%s", (int)(min_check_result_latency * 1000), mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "MAXCHKRESLAT"))
+			printf("%d%s", (int)(max_check_result_latency * 1000), mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "AVGCHKRESLAT"))
+			printf("%d%s", (int)(average_check_result_latency * 1000), mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "MINCHKRESHDL"))
+			printf("%d%s", (int)(min_check_result_handling_time * 1000), mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "MAXCHKRESHDL"))
+			printf("%d%s", (int)(max_check_result_handling_time * 1000), mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "AVGCHKRESHDL"))
+			printf("%d%s", (int)(average_check_result_handling_time * 1000), mrtg_delimiter);
+
+		/* status file update stats */
+		else if(!strcmp(temp_ptr, "STATUSBYTES"))
+			printf("%lu%s", status_file_bytes, mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "STATUSWRITTEN"))
+			printf("%d%s", status_file_objects_written, mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "STATUSSKIPPED"))
+			printf("%d%s", status_file_objects_skipped, mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "BINSTATUSBYTES"))
+			printf("%lu%s", binary_status_file_bytes, mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "BINSTATUSWRITTEN"))
+			printf("%d%s", binary_status_file_slots_written, mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "STATESNAPTIME"))
+			printf("%d%s", (int)(state_snapshot_time * 1000), mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "MAXSTATESNAPTIME"))
+			printf("%d%s", (int)(max_state_snapshot_time * 1000), mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "STATEWRITETIME"))
+			printf("%d%s", (int)(state_write_time * 1000), mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "MAXSTATEWRITETIME"))
+			printf("%d%s", (int)(max_state_write_time * 1000), mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "MAXSTATESTALL"))
+			printf("%d%s", (int)(max_state_write_stall * 1000), mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "NUMSTATECOALESCED"))
+			printf("%lu%s", state_writes_coalesced, mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "NUMCHKSTORMS"))
+			printf("%lu%s", check_storms, mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "NUMODCHKCOALESCED"))
+			printf("%lu%s", on_demand_checks_coalesced, mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "NUMODCHKDEFERRED"))
+			printf("%lu%s", on_demand_checks_deferred, mrtg_delimiter);
+		else if(!strcmp(temp_ptr, "ODCHKBACKLOG"))
+			printf("%lu%s", on_demand_check_backlog, mrtg_delimiter);
+		else if(display_loop_stat_mrtg_value(temp_ptr) == OK)
+			;
 
 		/* service states */
 		else if(!strcmp(temp_ptr, "NUMSVCOK"))
@@ -737,6 +908,39 @@ static int display_mrtg_values(void) {
 	}
 
 
+/* prints P50/P90/P99/MAX<name> MRTG variables */
+static int display_loop_stat_mrtg_value(const char *var) {
+	const char *which[] = { "P50", "P90", "P99", "MAX" };
+	unsigned int w, v;
+	int x;
+
+	for(w = 0; w < sizeof(which) / sizeof(which[0]); w++) {
+		if(strncmp(var, which[w], 3))
+			continue;
+		if(!strcmp(var + 3, "RESBATCH")) {
+			printf("%lu%s", check_result_batch_size[w], mrtg_delimiter);
+			return OK;
+			}
+		for(v = 0; v < sizeof(loop_stat_vars) / sizeof(loop_stat_vars[0]); v++) {
+			double value = 0.0;
+
+			if(strcmp(var + 3, loop_stat_vars[v].var))
+				continue;
+			for(x = 0; x < num_event_loop_stats; x++) {
+				if(strcmp(event_loop_stats[x].name, loop_stat_vars[v].name))
+					continue;
+				value = w == 0 ? event_loop_stats[x].p50 : w == 1 ? event_loop_stats[x].p90 : w == 2 ? event_loop_stats[x].p99 : event_loop_stats[x].max;
+				break;
+				}
+			printf("%d%s", (int)(value * loop_stat_vars[v].scale), mrtg_delimiter);
+			return OK;
+			}
+		}
+
+	return ERROR;
+	}
+
+
 static int display_stats(void) {
 	time_t current_time;
 	unsigned long time_difference;
@@ -744,6 +948,7 @@ static int display_stats(void) {
 	int hours;
 	int minutes;
 	int seconds;
+	int x;
 
 	time(&current_time);
 
@@ -809,7 +1014,38 @@ static int display_stats(void) {
 	printf("Passive Service Checks Last 1/5/15 min: %d / %d / %d\n", passive_service_checks_last_1min, passive_service_checks_last_5min, passive_service_checks_last_15min);
 	printf("\n");
 	printf("External Commands Last 1/5/15 min:      %d / %d / %d\n", external_commands_last_1min, external_commands_last_5min, external_commands_last_15min);
+	printf("External Commands Run (Fast Path):      %lu (%lu)\n", external_commands_run, external_commands_fast);
+	printf("External Command Backlog (Last/Max):    %lu / %lu bytes\n", external_command_backlog, max_external_command_backlog);
+	printf("External Command Deferrals:             %lu\n", external_command_deferrals);
 	printf("\n");
+	printf("Check Results From Workers:             %lu\n", check_results_from_workers);
+	printf("   Split By Workers:                    %lu\n", check_results_presplit);
+	printf("Check Result Split Time:                %.6f / %.6f / %.6f sec\n", min_check_result_parse_time, max_check_result_parse_time, average_check_result_parse_time);
+	printf("Check Result Queue Depth (Last/Max):    %d / %d\n", check_result_queue_depth, max_check_result_queue_depth);
+	printf("Worker Message Batches:                 %lu\n", check_result_batches);
+	printf("   Size (P50/P90/P99/Max):              %lu / %lu / %lu / %lu\n", check_result_batch_size[0], check_result_batch_size[1], check_result_batch_size[2], check_result_batch_size[3]);
+	printf("Check Result Queue Latency:             %.3f / %.3f / %.3f sec\n", min_check_result_latency, max_check_result_latency, average_check_result_latency);
+	printf("Check Result Handling Time:             %.3f / %.3f / %.3f sec\n", min_check_result_handling_time, max_check_result_handling_time, average_check_result_handling_time);
+	printf("\n");
+	printf("Status File Last Update:                %lu bytes, %d written / %d skipped\n", status_file_bytes, status_file_objects_written, status_file_objects_skipped);
+	printf("Binary Status File Last Update:         %lu bytes, %d slots written\n", binary_status_file_bytes, binary_status_file_slots_written);
+	printf("State Snapshot Time (Last/Max):         %.3f / %.3f sec\n", state_snapshot_time, max_state_snapshot_time);
+	printf("State Write Time (Last/Max):            %.3f / %.3f sec\n", state_write_time, max_state_write_time);
+	printf("Max State Write Stall:                  %.3f sec\n", max_state_write_stall);
+	printf("State Writes Coalesced:                 %lu\n", state_writes_coalesced);
+	printf("\n");
+	printf("On-Demand Check Storms:                 %lu%s\n", check_storms, (check_storm_active) ? " (one in progress)" : "");
+	printf("On-Demand Checks Coalesced:             %lu\n", on_demand_checks_coalesced);
+	printf("On-Demand Checks Deferred:              %lu (%lu held back now)\n", on_demand_checks_deferred, on_demand_check_backlog);
+	printf("\n");
+	if(num_event_loop_stats > 0) {
+		printf("Event Loop Statistics Since:            %s", ctime(&event_loop_stats_since));
+		printf("%-39s %10s %10s %10s %10s %10s\n", "Event Loop Timing (ms):", "Count", "P50", "P90", "P99", "Max");
+		for(x = 0; x < num_event_loop_stats; x++)
+			printf("   %-36s %10lu %10.3f %10.3f %10.3f %10.3f\n", event_loop_stats[x].name, event_loop_stats[x].count,
+			       event_loop_stats[x].p50 * 1000, event_loop_stats[x].p90 * 1000, event_loop_stats[x].p99 * 1000, event_loop_stats[x].max * 1000);
+		printf("\n");
+		}
 	printf("\n");
 
 
@@ -882,6 +1118,7 @@ static int read_status_file(void) {
 	char *temp_ptr = NULL;
 	time_t current_time;
 	unsigned long time_difference = 0L;
+	int x;
 
 	double execution_time = 0.0;
 	double latency = 0.0;
@@ -1265,6 +1502,20 @@ static int read_status_file(void) {
 						if((temp_ptr = strtok(NULL, ",")))
 							external_commands_last_15min = atoi(temp_ptr);
 						}
+					else if(!strcmp(var, "external_commands_run")) {
+						if((temp_ptr = strtok(val, ",")))
+							external_commands_run = strtoul(temp_ptr, NULL, 10);
+						if((temp_ptr = strtok(NULL, ",")))
+							external_commands_fast = strtoul(temp_ptr, NULL, 10);
+						if((temp_ptr = strtok(NULL, ",")))
+							external_command_deferrals = strtoul(temp_ptr, NULL, 10);
+						}
+					else if(!strcmp(var, "external_command_backlog")) {
+						if((temp_ptr = strtok(val, ",")))
+							external_command_backlog = strtoul(temp_ptr, NULL, 10);
+						if((temp_ptr = strtok(NULL, ",")))
+							max_external_command_backlog = strtoul(temp_ptr, NULL, 10);
+						}
 					else if(!strcmp(var, "parallel_host_check_stats")) {
 						if((temp_ptr = strtok(val, ",")))
 							parallel_host_checks_last_1min = atoi(temp_ptr);
@@ -1281,6 +1532,104 @@ static int read_status_file(void) {
 						if((temp_ptr = strtok(NULL, ",")))
 							serial_host_checks_last_15min = atoi(temp_ptr);
 						}
+					else if(!strcmp(var, "check_results_from_workers"))
+						check_results_from_workers = strtoul(val, NULL, 10);
+					else if(!strcmp(var, "check_results_presplit"))
+						check_results_presplit = strtoul(val, NULL, 10);
+					else if(!strcmp(var, "check_result_parse_time")) {
+						if((temp_ptr = strtok(val, ",")))
+							min_check_result_parse_time = strtod(temp_ptr, NULL);
+						if((temp_ptr = strtok(NULL, ",")))
+							max_check_result_parse_time = strtod(temp_ptr, NULL);
+						if((temp_ptr = strtok(NULL, ",")))
+							average_check_result_parse_time = strtod(temp_ptr, NULL);
+						}
+					else if(!strcmp(var, "check_result_queue_depth")) {
+						if((temp_ptr = strtok(val, ",")))
+							check_result_queue_depth = atoi(temp_ptr);
+						if((temp_ptr = strtok(NULL, ",")))
+							max_check_result_queue_depth = atoi(temp_ptr);
+						}
+					else if(!strcmp(var, "check_result_batch_size")) {
+						if((temp_ptr = strtok(val, ",")))
+							check_result_batches = strtoul(temp_ptr, NULL, 10);
+						for(x = 0; x < 4 && (temp_ptr = strtok(NULL, ",")); x++)
+							check_result_batch_size[x] = strtoul(temp_ptr, NULL, 10);
+						}
+					else if(!strcmp(var, "check_result_queue_latency")) {
+						if((temp_ptr = strtok(val, ",")))
+							min_check_result_latency = strtod(temp_ptr, NULL);
+						if((temp_ptr = strtok(NULL, ",")))
+							max_check_result_latency = strtod(temp_ptr, NULL);
+						if((temp_ptr = strtok(NULL, ",")))
+							average_check_result_latency = strtod(temp_ptr, NULL);
+						}
+					else if(!strcmp(var, "check_result_handling_time")) {
+						if((temp_ptr = strtok(val, ",")))
+							min_check_result_handling_time = strtod(temp_ptr, NULL);
+						if((temp_ptr = strtok(NULL, ",")))
+							max_check_result_handling_time = strtod(temp_ptr, NULL);
+						if((temp_ptr = strtok(NULL, ",")))
+							average_check_result_handling_time = strtod(temp_ptr, NULL);
+						}
+					else if(!strcmp(var, "status_file_update")) {
+						if((temp_ptr = strtok(val, ",")))
+							status_file_bytes = strtoul(temp_ptr, NULL, 10);
+						if((temp_ptr = strtok(NULL, ",")))
+							status_file_objects_written = atoi(temp_ptr);
+						if((temp_ptr = strtok(NULL, ",")))
+							status_file_objects_skipped = atoi(temp_ptr);
+						}
+					else if(!strcmp(var, "binary_status_file_update")) {
+						if((temp_ptr = strtok(val, ",")))
+							binary_status_file_bytes = strtoul(temp_ptr, NULL, 10);
+						if((temp_ptr = strtok(NULL, ",")))
+							binary_status_file_slots_written = atoi(temp_ptr);
+						}
+					else if(!strcmp(var, "state_snapshot_time")) {
+						if((temp_ptr = strtok(val, ",")))
+							state_snapshot_time = strtod(temp_ptr, NULL);
+						if((temp_ptr = strtok(NULL, ",")))
+							max_state_snapshot_time = strtod(temp_ptr, NULL);
+						}
+					else if(!strcmp(var, "state_write_time")) {
+						if((temp_ptr = strtok(val, ",")))
+							state_write_time = strtod(temp_ptr, NULL);
+						if((temp_ptr = strtok(NULL, ",")))
+							max_state_write_time = strtod(temp_ptr, NULL);
+						}
+					else if(!strcmp(var, "state_write_stall"))
+						max_state_write_stall = strtod(val, NULL);
+					else if(!strcmp(var, "state_writes_coalesced"))
+						state_writes_coalesced = strtoul(val, NULL, 10);
+					else if(!strcmp(var, "on_demand_check_storms")) {
+						if((temp_ptr = strtok(val, ",")))
+							check_storms = strtoul(temp_ptr, NULL, 10);
+						if((temp_ptr = strtok(NULL, ",")))
+							on_demand_checks_coalesced = strtoul(temp_ptr, NULL, 10);
+						if((temp_ptr = strtok(NULL, ",")))
+							on_demand_checks_deferred = strtoul(temp_ptr, NULL, 10);
+						if((temp_ptr = strtok(NULL, ",")))
+							on_demand_check_backlog = strtoul(temp_ptr, NULL, 10);
+						if((temp_ptr = strtok(NULL, ",")))
+							check_storm_active = atoi(temp_ptr);
+						}
+					else if(!strcmp(var, "loop_stats_since"))
+						event_loop_stats_since = (time_t)strtoul(val, NULL, 10);
+					else if(!strncmp(var, "loop_stats_", 11) && num_event_loop_stats < (int)(sizeof(event_loop_stats) / sizeof(event_loop_stats[0]))) {
+						struct loop_stat *ls = &event_loop_stats[num_event_loop_stats++];
+						snprintf(ls->name, sizeof(ls->name), "%s", var + 11);
+						if((temp_ptr = strtok(val, ",")))
+							ls->count = strtoul(temp_ptr, NULL, 10);
+						if((temp_ptr = strtok(NULL, ",")))
+							ls->p50 = strtod(temp_ptr, NULL);
+						if((temp_ptr = strtok(NULL, ",")))
+							ls->p90 = strtod(temp_ptr, NULL);
+						if((temp_ptr = strtok(NULL, ",")))
+							ls->p99 = strtod(temp_ptr, NULL);
+						if((temp_ptr = strtok(NULL, ",")))
+							ls->max = strtod(temp_ptr, NULL);
+						}
 					break;
 
 				case STATUS_HOST_DATA:
@@ -413,6 +413,10 @@ static int qh_core(int sd, char *buf, unsigned int len)
 			"                    The options are the same parameters and format as\n"
 			"                    returned above.\n"
 			"  squeuestats       scheduling queue statistics\n"
+			"  loopstats         how late events run and how long events, polling\n"
+			"                    and check results take, in milliseconds\n"
+			"  loopstats <name>  the buckets of one of the loopstats histograms\n"
+			"  loopstats reset   start counting over\n"
 		);
 
 		return 0;
@@ -451,6 +455,11 @@ static int qh_core(int sd, char *buf, unsigned int len)
 
 			return dump_event_stats(sd);
 		}
+
+		else if (!strcmp(buf, "loopstats")) {
+
+			return dump_loop_stats(sd, NULL);
+		}
 	}
 
 	/* space != NULL: */
@@ -461,12 +470,240 @@ static int qh_core(int sd, char *buf, unsigned int len)
 		if (!strcmp(buf, "loadctl")) {
 			return set_loadctl_options(space, len) == OK ? 200 : 400;
 		}
+
+		if (!strcmp(buf, "loopstats")) {
+			if (!strcmp(space, "reset")) {
+				reset_loop_stats();
+				return 200;
+			}
+			return dump_loop_stats(sd, space);
+		}
 	}
 
 	/* No matching command found */
 	return 404;
 }
 
+/*
+ * The passive result channel. Clients send "@passive submit", wait
+ * for the "OK" reply and then stream check results in the format
+ * workers use for job results (see worker_send_kvvec()): key=value
+ * pairs separated by nul bytes, with each message ending in MSG_DELIM.
+ * The keys are the ones used in check result spool files. A message
+ * may hold any number of results; each "host_name" starts a new one.
+ *
+ * We read at most one buffer's worth from each client every time
+ * through the event loop, so a client sending faster than we can
+ * keep up with gets held up by its socket buffers filling up rather
+ * than holding up everything else.
+ */
+#define QH_PASSIVE_BUFSIZE (64 * 1024)
+#define QH_PASSIVE_MAX_MSG (4 * 1024 * 1024)
+
+struct qh_passive_client {
+	int sd;
+	iocache *ioc;
+};
+
+static struct {
+	unsigned int clients;
+	unsigned long results;
+	unsigned long rejected;
+	unsigned long bytes;
+} qh_passive_stats;
+
+static const char *qh_passive_source_name(const void *source)
+{
+	return "query handler passive result channel";
+}
+
+static struct check_engine qh_passive_check_engine = {
+	"Query handler passive results",
+	qh_passive_source_name,
+	NULL,
+};
+
+static void qh_passive_str2timeval(const char *str, struct timeval *tv)
+{
+	char *ptr;
+
+	tv->tv_sec = strtoul(str, &ptr, 10);
+	tv->tv_usec = (*ptr == '.') ? strtoul(ptr + 1, NULL, 10) : 0;
+}
+
+static void qh_passive_result(check_result *cr)
+{
+	struct timeval now;
+
+	if (!cr->host_name || !cr->output) {
+		qh_passive_stats.rejected++;
+		return;
+	}
+
+	gettimeofday(&now, NULL);
+	if (!cr->start_time.tv_sec)
+		cr->start_time = now;
+	if (!cr->finish_time.tv_sec)
+		cr->finish_time = cr->start_time;
+	cr->latency = tv_delta_f(&cr->start_time, &now);
+	if (cr->latency < 0.0)
+		cr->latency = 0.0;
+
+	if (cr->object_check_type == SERVICE_CHECK) {
+		if (cr->return_code < 0 || cr->return_code > 3)
+			cr->return_code = STATE_UNKNOWN;
+	}
+	else if (cr->return_code < 0 || cr->return_code > 2) {
+		qh_passive_stats.rejected++;
+		return;
+	}
+
+	if (process_check_result(cr) == OK)
+		qh_passive_stats.results++;
+	else
+		qh_passive_stats.rejected++;
+}
+
+/*
+ * Runs the results in one message. We point the check results at
+ * the strings in the message, so nothing is copied, and the message
+ * goes away once we're done with it.
+ */
+static void qh_passive_message(char *buf, unsigned long size)
+{
+	static struct kvvec kvv = KVVEC_INITIALIZER;
+	check_result cr;
+	int i;
+
+	if (buf2kvvec_prealloc(&kvv, buf, size, '=', '\0', KVVEC_ASSIGN) <= 0) {
+		qh_passive_stats.rejected++;
+		return;
+	}
+
+	init_check_result(&cr);
+	for (i = 0; i < kvv.kv_pairs; i++) {
+		char *key = kvv.kv[i].key, *value = kvv.kv[i].value;
+
+		if (!strcmp(key, "host_name")) {
+			if (cr.host_name)
+				qh_passive_result(&cr);
+			init_check_result(&cr);
+			cr.check_type = CHECK_TYPE_PASSIVE;
+			cr.engine = &qh_passive_check_engine;
+			cr.host_name = value;
+		}
+		else if (!cr.host_name) {
+			log_debug_info(DEBUGL_CHECKS, 1, "qh: passive: '%s' before any host_name\n", key);
+		}
+		else if (!strcmp(key, "service_description")) {
+			cr.service_description = value;
+			cr.object_check_type = SERVICE_CHECK;
+		}
+		else if (!strcmp(key, "return_code")) {
+			cr.return_code = atoi(value);
+		}
+		else if (!strcmp(key, "output")) {
+			cr.output = value;
+		}
+		else if (!strcmp(key, "start_time")) {
+			qh_passive_str2timeval(value, &cr.start_time);
+		}
+		else if (!strcmp(key, "finish_time")) {
+			qh_passive_str2timeval(value, &cr.finish_time);
+		}
+		else {
+			log_debug_info(DEBUGL_CHECKS, 1, "qh: passive: Ignoring unknown key '%s'\n", key);
+		}
+	}
+	if (cr.host_name)
+		qh_passive_result(&cr);
+}
+
+static void qh_passive_disconnect(struct qh_passive_client *client)
+{
+	iobroker_close(nagios_iobs, client->sd);
+	iocache_destroy(client->ioc);
+	free(client);
+	qh_passive_stats.clients--;
+}
+
+static int qh_passive_input(int sd, int events, void *arg)
+{
+	struct qh_passive_client *client = (struct qh_passive_client *)arg;
+	unsigned long size;
+	char *buf;
+	int ret;
+
+	ret = iocache_read(client->ioc, sd);
+	if (ret < 0 && (errno == EAGAIN || errno == EINTR))
+		return 0;
+	if (ret <= 0) {
+		qh_passive_disconnect(client);
+		return 0;
+	}
+	qh_passive_stats.bytes += ret;
+
+	while ((buf = worker_ioc2msg(client->ioc, &size, 0)))
+		qh_passive_message(buf, size);
+
+	/* a message this large is a client gone wrong */
+	if (iocache_available(client->ioc) > QH_PASSIVE_MAX_MSG) {
+		logit(NSLOG_RUNTIME_WARNING, TRUE, "qh: passive: Dropping client that sent more than %d bytes without a message delimiter\n", QH_PASSIVE_MAX_MSG);
+		qh_passive_disconnect(client);
+	}
+
+	return 0;
+}
+
+static int qh_passive(int sd, char *buf, unsigned int len)
+{
+	struct qh_passive_client *client;
+
+	if (buf == NULL || !strcmp(buf, "help")) {
+		nsock_printf_nul(sd,
+			"Query handler for submitting passive check results.\n"
+			"Available commands:\n"
+			"  submit   Switch this connection to streaming check results.\n"
+			"           Wait for the \"OK\" reply before sending any. Each\n"
+			"           result is a key=value vector, as in check result\n"
+			"           spool files, sent the way workers send job results.\n"
+			"  stats    Print statistics for the passive result channel\n"
+		);
+		return 0;
+	}
+
+	if (!strcmp(buf, "stats")) {
+		nsock_printf_nul(sd, "clients=%u;results=%lu;rejected=%lu;bytes=%lu\n",
+			qh_passive_stats.clients, qh_passive_stats.results,
+			qh_passive_stats.rejected, qh_passive_stats.bytes);
+		return 0;
+	}
+
+	if (strcmp(buf, "submit"))
+		return 404;
+
+	client = calloc(1, sizeof(*client));
+	if (client == NULL || (client->ioc = iocache_create(QH_PASSIVE_BUFSIZE)) == NULL) {
+		logit(NSLOG_RUNTIME_ERROR, TRUE, "qh: passive: Failed to allocate memory for client\n");
+		free(client);
+		return 500;
+	}
+	client->sd = sd;
+
+	iobroker_unregister(nagios_iobs, sd);
+	if (iobroker_register(nagios_iobs, sd, client, qh_passive_input) < 0) {
+		logit(NSLOG_RUNTIME_ERROR, TRUE, "qh: passive: Failed to register client socket %d with I/O broker: %s\n", sd, strerror(errno));
+		iocache_destroy(client->ioc);
+		free(client);
+		return 500;
+	}
+	qh_passive_stats.clients++;
+	nsock_printf_nul(sd, "OK");
+
+	/* signal query handler to release its iocache for this one */
+	return QH_TAKEOVER;
+}
+
 int qh_init(const char *path)
 {
 	int result    = 0;
@@ -533,6 +770,11 @@ int qh_init(const char *path)
 		logit(NSLOG_INFO_MESSAGE, FALSE, "qh: echo service query handler registered\n");
 	}
 
+	result = qh_register_handler("passive", "Passive check result submission", 0, qh_passive);
+	if (result == OK) {
+		logit(NSLOG_INFO_MESSAGE, FALSE, "qh: passive check result query handler registered\n");
+	}
+
 	result = qh_register_handler("help", "Help for the query handler", 0, qh_help);
 	if (result == OK) {
 		logit(NSLOG_INFO_MESSAGE, FALSE, "qh: help for the query handler registered\n");
@@ -0,0 +1,433 @@
+/*****************************************************************************
+ *
+ * SNAPSHOT.C - Copies of the state the status and retention writers use
+ *
+ *
+ * License:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *****************************************************************************/
+
+#include "../include/config.h"
+#include "../include/common.h"
+#include "../include/objects.h"
+#include "../include/comments.h"
+#include "../include/downtime.h"
+#include "../include/statusdata.h"
+#include "../include/nagios.h"
+#include "../include/snapshot.h"
+
+struct state_write_stats state_write_stats;
+
+/*
+ * Strings and lists are copied into chunks that are freed along with
+ * the snapshot, so a full snapshot doesn't take a million mallocs.
+ */
+#define SNAPSHOT_CHUNK_SIZE (256 * 1024)
+#define SNAPSHOT_ALIGN(x) (((x) + 7) & ~((size_t)7))
+
+struct snapshot_chunk {
+	struct snapshot_chunk *next;
+	size_t size, used;
+	char data[1];
+	};
+
+static int snapshot_failed;
+
+
+static void *snapshot_alloc(struct state_snapshot *s, size_t len) {
+	struct snapshot_chunk *chunk = s->chunks;
+	void *ret;
+
+	len = SNAPSHOT_ALIGN(len);
+	if(!chunk || chunk->size - chunk->used < len) {
+		size_t size = len > SNAPSHOT_CHUNK_SIZE / 4 ? len : SNAPSHOT_CHUNK_SIZE;
+
+		if(!(chunk = malloc(sizeof(*chunk) + size))) {
+			snapshot_failed = TRUE;
+			return NULL;
+			}
+		chunk->size = size;
+		chunk->used = 0;
+		chunk->next = s->chunks;
+		s->chunks = chunk;
+		}
+
+	ret = chunk->data + chunk->used;
+	chunk->used += len;
+	return ret;
+	}
+
+
+static char *snapshot_strdup(struct state_snapshot *s, const char *str) {
+	size_t len;
+	char *ret;
+
+	if(str == NULL)
+		return NULL;
+	len = strlen(str) + 1;
+	if((ret = snapshot_alloc(s, len)))
+		memcpy(ret, str, len);
+	return ret;
+	}
+
+
+/* the variables are copied, their names and values aren't */
+static customvariablesmember *snapshot_custom_variables(struct state_snapshot *s, customvariablesmember *list) {
+	customvariablesmember *head = NULL, **tail = &head, *var;
+
+	for(; list != NULL; list = list->next) {
+		if(!(var = snapshot_alloc(s, sizeof(*var))))
+			break;
+		var->variable_name = list->variable_name;
+		var->variable_value = list->variable_value;
+		var->has_been_modified = list->has_been_modified;
+		var->next = NULL;
+		*tail = var;
+		tail = &var->next;
+		}
+
+	return head;
+	}
+
+
+static void snapshot_host(struct state_snapshot *s, struct snapshot_host *h, host *hst) {
+	int x;
+
+	h->id = hst->id;
+	h->name = hst->name;
+	h->check_command = hst->check_command;
+	h->check_period = hst->check_period;
+	h->notification_period = hst->notification_period;
+	h->event_handler = hst->event_handler;
+	h->event_handler_period = hst->event_handler_period;
+	h->plugin_output = snapshot_strdup(s, hst->plugin_output);
+	h->long_plugin_output = snapshot_strdup(s, hst->long_plugin_output);
+	h->perf_data = snapshot_strdup(s, hst->perf_data);
+	h->custom_variables = snapshot_custom_variables(s, hst->custom_variables);
+	h->modified_attributes = hst->modified_attributes;
+	h->last_event_id = hst->last_event_id;
+	h->current_event_id = hst->current_event_id;
+	h->current_problem_id = hst->current_problem_id;
+	h->last_problem_id = hst->last_problem_id;
+	h->current_notification_id = hst->current_notification_id;
+	h->flapping_comment_id = hst->flapping_comment_id;
+	h->last_check = hst->last_check;
+	h->next_check = hst->next_check;
+	h->last_state_change = hst->last_state_change;
+	h->last_hard_state_change = hst->last_hard_state_change;
+	h->last_time_up = hst->last_time_up;
+	h->last_time_down = hst->last_time_down;
+	h->last_time_unreachable = hst->last_time_unreachable;
+	h->last_notification = hst->last_notification;
+	h->next_notification = hst->next_notification;
+	h->execution_time = hst->execution_time;
+	h->latency = hst->latency;
+	h->percent_state_change = hst->percent_state_change;
+	h->check_interval = hst->check_interval;
+	h->retry_interval = hst->retry_interval;
+	h->check_options = hst->check_options;
+	h->current_attempt = hst->current_attempt;
+	h->max_attempts = hst->max_attempts;
+	h->notified_on = hst->notified_on;
+	h->current_notification_number = hst->current_notification_number;
+	h->scheduled_downtime_depth = hst->scheduled_downtime_depth;
+	h->hourly_value = hst->hourly_value;
+	h->current_state = hst->current_state;
+	h->last_state = hst->last_state;
+	h->last_hard_state = hst->last_hard_state;
+	h->state_type = hst->state_type;
+	h->check_type = hst->check_type;
+	h->acknowledgement_type = hst->acknowledgement_type;
+	h->has_been_checked = hst->has_been_checked;
+	h->should_be_scheduled = hst->should_be_scheduled;
+	h->checks_enabled = hst->checks_enabled;
+	h->accept_passive_checks = hst->accept_passive_checks;
+	h->notifications_enabled = hst->notifications_enabled;
+	h->no_more_notifications = hst->no_more_notifications;
+	h->problem_has_been_acknowledged = hst->problem_has_been_acknowledged;
+	h->event_handler_enabled = hst->event_handler_enabled;
+	h->flap_detection_enabled = hst->flap_detection_enabled;
+	h->process_performance_data = hst->process_performance_data;
+	h->obsess = hst->obsess;
+	h->is_flapping = hst->is_flapping;
+	h->check_flapping_recovery_notification = hst->check_flapping_recovery_notification;
+	for(x = 0; x < MAX_STATE_HISTORY_ENTRIES; x++)
+		h->state_history[x] = hst->state_history[(x + hst->state_history_index) % MAX_STATE_HISTORY_ENTRIES];
+	}
+
+
+static void snapshot_service(struct state_snapshot *s, struct snapshot_service *sv, service *svc) {
+	int x;
+
+	sv->id = svc->id;
+	sv->host_id = svc->host_ptr->id;
+	sv->host_name = svc->host_name;
+	sv->description = svc->description;
+	sv->check_command = svc->check_command;
+	sv->check_period = svc->check_period;
+	sv->notification_period = svc->notification_period;
+	sv->event_handler = svc->event_handler;
+	sv->event_handler_period = svc->event_handler_period;
+	sv->plugin_output = snapshot_strdup(s, svc->plugin_output);
+	sv->long_plugin_output = snapshot_strdup(s, svc->long_plugin_output);
+	sv->perf_data = snapshot_strdup(s, svc->perf_data);
+	sv->custom_variables = snapshot_custom_variables(s, svc->custom_variables);
+	sv->modified_attributes = svc->modified_attributes;
+	sv->last_event_id = svc->last_event_id;
+	sv->current_event_id = svc->current_event_id;
+	sv->current_problem_id = svc->current_problem_id;
+	sv->last_problem_id = svc->last_problem_id;
+	sv->current_notification_id = svc->current_notification_id;
+	sv->flapping_comment_id = svc->flapping_comment_id;
+	sv->last_check = svc->last_check;
+	sv->next_check = svc->next_check;
+	sv->last_state_change = svc->last_state_change;
+	sv->last_hard_state_change = svc->last_hard_state_change;
+	sv->last_time_ok = svc->last_time_ok;
+	sv->last_time_warning = svc->last_time_warning;
+	sv->last_time_unknown = svc->last_time_unknown;
+	sv->last_time_critical = svc->last_time_critical;
+	sv->last_notification = svc->last_notification;
+	sv->next_notification = svc->next_notification;
+	sv->execution_time = svc->execution_time;
+	sv->latency = svc->latency;
+	sv->percent_state_change = svc->percent_state_change;
+	sv->check_interval = svc->check_interval;
+	sv->retry_interval = svc->retry_interval;
+	sv->check_options = svc->check_options;
+	sv->current_attempt = svc->current_attempt;
+	sv->max_attempts = svc->max_attempts;
+	sv->notified_on = svc->notified_on;
+	sv->current_notification_number = svc->current_notification_number;
+	sv->scheduled_downtime_depth = svc->scheduled_downtime_depth;
+	sv->hourly_value = svc->hourly_value;
+	sv->current_state = svc->current_state;
+	sv->last_state = svc->last_state;
+	sv->last_hard_state = svc->last_hard_state;
+	sv->state_type = svc->state_type;
+	sv->check_type = svc->check_type;
+	sv->acknowledgement_type = svc->acknowledgement_type;
+	sv->has_been_checked = svc->has_been_checked;
+	sv->should_be_scheduled = svc->should_be_scheduled;
+	sv->checks_enabled = svc->checks_enabled;
+	sv->accept_passive_checks = svc->accept_passive_checks;
+	sv->notifications_enabled = svc->notifications_enabled;
+	sv->no_more_notifications = svc->no_more_notifications;
+	sv->problem_has_been_acknowledged = svc->problem_has_been_acknowledged;
+	sv->event_handler_enabled = svc->event_handler_enabled;
+	sv->flap_detection_enabled = svc->flap_detection_enabled;
+	sv->process_performance_data = svc->process_performance_data;
+	sv->obsess = svc->obsess;
+	sv->is_flapping = svc->is_flapping;
+	sv->check_flapping_recovery_notification = svc->check_flapping_recovery_notification;
+	for(x = 0; x < MAX_STATE_HISTORY_ENTRIES; x++)
+		sv->state_history[x] = svc->state_history[(x + svc->state_history_index) % MAX_STATE_HISTORY_ENTRIES];
+	}
+
+
+static void snapshot_contact(struct state_snapshot *s, struct snapshot_contact *c, contact *cntct) {
+	c->id = cntct->id;
+	c->name = cntct->name;
+	c->host_notification_period = cntct->host_notification_period;
+	c->service_notification_period = cntct->service_notification_period;
+	c->custom_variables = snapshot_custom_variables(s, cntct->custom_variables);
+	c->modified_attributes = cntct->modified_attributes;
+	c->modified_host_attributes = cntct->modified_host_attributes;
+	c->modified_service_attributes = cntct->modified_service_attributes;
+	c->last_host_notification = cntct->last_host_notification;
+	c->last_service_notification = cntct->last_service_notification;
+	c->host_notifications_enabled = cntct->host_notifications_enabled;
+	c->service_notifications_enabled = cntct->service_notifications_enabled;
+	}
+
+
+/* comments and downtimes come and go, so they're copied whole */
+static void snapshot_comments(struct state_snapshot *s) {
+	nagios_comment *temp_comment, *copy, **tail = &s->comment_list;
+
+	for(temp_comment = comment_list; temp_comment != NULL; temp_comment = temp_comment->next) {
+		if(!(copy = snapshot_alloc(s, sizeof(*copy))))
+			break;
+		*copy = *temp_comment;
+		copy->host_name = snapshot_strdup(s, temp_comment->host_name);
+		copy->service_description = snapshot_strdup(s, temp_comment->service_description);
+		copy->author = snapshot_strdup(s, temp_comment->author);
+		copy->comment_data = snapshot_strdup(s, temp_comment->comment_data);
+		copy->next = copy->nexthash = NULL;
+		*tail = copy;
+		tail = &copy->next;
+		}
+	}
+
+
+static void snapshot_downtimes(struct state_snapshot *s) {
+	scheduled_downtime *temp_downtime, *copy, *prev = NULL;
+
+	for(temp_downtime = scheduled_downtime_list; temp_downtime != NULL; temp_downtime = temp_downtime->next) {
+		if(!(copy = snapshot_alloc(s, sizeof(*copy))))
+			break;
+		*copy = *temp_downtime;
+		copy->host_name = snapshot_strdup(s, temp_downtime->host_name);
+		copy->service_description = snapshot_strdup(s, temp_downtime->service_description);
+		copy->author = snapshot_strdup(s, temp_downtime->author);
+		copy->comment = snapshot_strdup(s, temp_downtime->comment);
+		copy->start_event = copy->stop_event = NULL;
+		copy->next = NULL;
+		copy->prev = prev;
+		if(prev)
+			prev->next = copy;
+		else
+			s->scheduled_downtime_list = copy;
+		prev = copy;
+		}
+	}
+
+
+static void snapshot_program(struct state_snapshot *s, struct snapshot_program *p) {
+	int x;
+
+	p->last_update_check = last_update_check;
+	p->update_available = update_available;
+	p->update_uid = update_uid;
+	p->last_program_version = snapshot_strdup(s, last_program_version);
+	p->new_program_version = snapshot_strdup(s, new_program_version);
+	p->modified_host_process_attributes = modified_host_process_attributes;
+	p->modified_service_process_attributes = modified_service_process_attributes;
+	p->nagios_pid = nagios_pid;
+	p->daemon_mode = daemon_mode;
+	p->program_start = program_start;
+	p->last_log_rotation = last_log_rotation;
+	p->enable_notifications = enable_notifications;
+	p->execute_service_checks = execute_service_checks;
+	p->accept_passive_service_checks = accept_passive_service_checks;
+	p->execute_host_checks = execute_host_checks;
+	p->accept_passive_host_checks = accept_passive_host_checks;
+	p->enable_event_handlers = enable_event_handlers;
+	p->obsess_over_services = obsess_over_services;
+	p->obsess_over_hosts = obsess_over_hosts;
+	p->check_service_freshness = check_service_freshness;
+	p->check_host_freshness = check_host_freshness;
+	p->enable_flap_detection = enable_flap_detection;
+	p->process_performance_data = process_performance_data;
+	p->global_host_event_handler = snapshot_strdup(s, global_host_event_handler);
+	p->global_service_event_handler = snapshot_strdup(s, global_service_event_handler);
+	p->next_comment_id = next_comment_id;
+	p->next_downtime_id = next_downtime_id;
+	p->next_event_id = next_event_id;
+	p->next_problem_id = next_problem_id;
+	p->next_notification_id = next_notification_id;
+
+	if(s->what & STATE_WRITE_STATUS) {
+		generate_check_stats();
+		for(x = 0; x < MAX_CHECK_STATS_TYPES; x++) {
+			p->check_stats[x][0] = check_statistics[x].minute_stats[0];
+			p->check_stats[x][1] = check_statistics[x].minute_stats[1];
+			p->check_stats[x][2] = check_statistics[x].minute_stats[2];
+			}
+		p->external_command_stats = external_command_stats;
+		p->wproc_result_stats = wproc_result_stats;
+		p->state_write_stats = state_write_stats;
+		p->check_storm_stats = check_storm_stats;
+		p->loop_stats_since = loop_stats.since;
+		p->num_loop_stats = summarize_loop_stats(p->loop_stats);
+		}
+	}
+
+
+struct state_snapshot *take_state_snapshot(int what, int full) {
+	struct state_snapshot *s;
+	unsigned int i, n;
+
+	if(!(s = calloc(1, sizeof(*s))))
+		return NULL;
+
+	/* retention data is all or nothing */
+	if(what & STATE_WRITE_RETENTION)
+		full = TRUE;
+
+	snapshot_failed = FALSE;
+	s->what = what;
+	s->full = full;
+	s->taken = time(NULL);
+	s->total_hosts = num_objects.hosts;
+	s->total_services = num_objects.services;
+
+	/* unchanged hosts and services are left out of status snapshots */
+	if(full == TRUE) {
+		s->num_hosts = num_objects.hosts;
+		s->num_services = num_objects.services;
+		}
+	else {
+		for(i = 0; i < num_objects.hosts; i++)
+			s->num_hosts += host_status_is_dirty(host_ary[i]);
+		for(i = 0; i < num_objects.services; i++)
+			s->num_services += service_status_is_dirty(service_ary[i]);
+		}
+	s->num_contacts = num_objects.contacts;
+
+	s->hosts = malloc((s->num_hosts ? s->num_hosts : 1) * sizeof(*s->hosts));
+	s->services = malloc((s->num_services ? s->num_services : 1) * sizeof(*s->services));
+	s->contacts = malloc((s->num_contacts ? s->num_contacts : 1) * sizeof(*s->contacts));
+	if(!s->hosts || !s->services || !s->contacts) {
+		free_state_snapshot(s);
+		return NULL;
+		}
+
+	for(i = 0, n = 0; i < num_objects.hosts && n < s->num_hosts; i++) {
+		int changed = host_status_is_dirty(host_ary[i]);
+		if(full == TRUE || changed) {
+			snapshot_host(s, &s->hosts[n], host_ary[i]);
+			s->hosts[n++].status_changed = changed;
+			}
+		}
+	for(i = 0, n = 0; i < num_objects.services && n < s->num_services; i++) {
+		int changed = service_status_is_dirty(service_ary[i]);
+		if(full == TRUE || changed) {
+			snapshot_service(s, &s->services[n], service_ary[i]);
+			s->services[n++].status_changed = changed;
+			}
+		}
+	for(i = 0; i < num_objects.contacts; i++)
+		snapshot_contact(s, &s->contacts[i], contact_ary[i]);
+
+	snapshot_comments(s);
+	snapshot_downtimes(s);
+	snapshot_program(s, &s->program);
+
+	if(snapshot_failed == TRUE) {
+		free_state_snapshot(s);
+		return NULL;
+		}
+
+	return s;
+	}
+
+
+void free_state_snapshot(struct state_snapshot *s) {
+	struct snapshot_chunk *chunk, *next;
+
+	if(s == NULL)
+		return;
+
+	for(chunk = s->chunks; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+		}
+	my_free(s->hosts);
+	my_free(s->services);
+	my_free(s->contacts);
+	free(s);
+	}
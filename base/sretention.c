@@ -29,7 +29,9 @@
 #include "../include/nagios.h"
 #include "../include/sretention.h"
 #include "../include/broker.h"
+#include "../include/snapshot.h"
 #include "../xdata/xrddefault.h"		/* default routines */
+#include "../xdata/xrdbinary.h"		/* binary routines */
 
 
 /******************************************************************/
@@ -46,6 +48,8 @@ int initialize_retention_data(const char *cfgfile) {
 
 /* cleans up retention data before program termination */
 int cleanup_retention_data(void) {
+	wait_for_state_writer();
+	xrdbinary_cleanup_retention_data();
 	return xrddefault_cleanup_retention_data();
 	}
 
@@ -63,7 +67,8 @@ int save_state_information(int autosave) {
 	broker_retention_data(NEBTYPE_RETENTIONDATA_STARTSAVE, NEBFLAG_NONE, NEBATTR_NONE, NULL);
 #endif
 
-	result = xrddefault_save_state_information();
+	/* explicit saves wait for the writer thread, so callers know how it went */
+	result = write_state_in_background(STATE_WRITE_RETENTION | (autosave == TRUE ? STATE_WRITE_AUTOSAVE : 0), autosave == TRUE ? FALSE : TRUE);
 
 #ifdef USE_EVENT_BROKER
 	/* send data to event broker */
@@ -73,14 +78,25 @@ int save_state_information(int autosave) {
 	if(result == ERROR)
 		return ERROR;
 
-	if(autosave == TRUE)
-		logit(NSLOG_PROCESS_INFO, FALSE, "Auto-save of retention data completed successfully.\n");
-
 	return OK;
 	}
 
 
 
+/* writes a snapshot to the retention files. Runs in the state writer thread */
+int write_state_information(const struct state_snapshot *snap) {
+	int result = OK;
+
+	if(export_retention_file == TRUE || !binary_retention_file)
+		result = xrddefault_save_state_information(snap);
+	if(binary_retention_file && xrdbinary_save_state_information(snap) != OK)
+		result = ERROR;
+
+	return result;
+	}
+
+
+
 /* reads in initial host and state information */
 int read_initial_state_information(void) {
 	int result = OK;
@@ -88,12 +104,17 @@ int read_initial_state_information(void) {
 	if(retain_state_information == FALSE)
 		return OK;
 
+	/* don't read the files while they're being written */
+	wait_for_state_writer();
+
 #ifdef USE_EVENT_BROKER
 	/* send data to event broker */
 	broker_retention_data(NEBTYPE_RETENTIONDATA_STARTLOAD, NEBFLAG_NONE, NEBATTR_NONE, NULL);
 #endif
 
-	result = xrddefault_read_state_information();
+	/* the text file is there to fall back on if the binary one can't be used */
+	if(!binary_retention_file || xrdbinary_read_state_information() != OK)
+		result = xrddefault_read_state_information();
 
 #ifdef USE_EVENT_BROKER
 	/* send data to event broker */
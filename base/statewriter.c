@@ -0,0 +1,368 @@
+/*****************************************************************************
+ *
+ * STATEWRITER.C - Writes status and retention data in the background
+ *
+ *
+ * License:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *****************************************************************************/
+
+#include "../include/config.h"
+#include "../include/common.h"
+#include "../include/objects.h"
+#include "../include/statusdata.h"
+#include "../include/sretention.h"
+#include "../include/nagios.h"
+#include "../include/snapshot.h"
+#include <pthread.h>
+#include <signal.h>
+
+/*
+ * The main thread hands the writer thread one snapshot at a time. If
+ * more writes are asked for while one is in progress, they're folded
+ * into a single one that starts as soon as it's done. The writer tells
+ * the main thread it's finished through a pipe in the io broker, and
+ * the main thread cleans up after it.
+ */
+static struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int running;                    /* is there a thread? */
+	int stop;                       /* should it exit? */
+	int pipefd[2];
+	struct state_snapshot *job;     /* waiting for the thread to pick up */
+	struct state_snapshot *current; /* being written */
+	int done;                       /* has the thread finished with current? */
+	int result;
+	double write_time;
+	struct status_update_stats update_stats; /* as the write left them */
+	int pending;                    /* STATE_WRITE_* flags for the next write */
+	int last_result;                /* of the last write to finish */
+	} writer = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.pipefd = { -1, -1 },
+	};
+
+
+static double elapsed_since(struct timeval *start) {
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_usec - start->tv_usec) / 1000000.0;
+	}
+
+
+/* does the actual writing. This runs on any thread, so it mustn't touch live objects */
+static int write_state(struct state_snapshot *snap) {
+	int result = OK;
+
+	if((snap->what & STATE_WRITE_STATUS) && write_status_data(snap) != OK)
+		result = ERROR;
+	if((snap->what & STATE_WRITE_RETENTION) && write_state_information(snap) != OK)
+		result = ERROR;
+
+	return result;
+	}
+
+
+static void *state_writer_thread(void *discard) {
+	struct state_snapshot *snap;
+	struct timeval start;
+	int result;
+
+	/* our log messages go through the main thread */
+	queue_log_messages();
+
+	pthread_mutex_lock(&writer.lock);
+	for(;;) {
+		while(writer.job == NULL && writer.stop == FALSE)
+			pthread_cond_wait(&writer.cond, &writer.lock);
+		if(writer.job == NULL)
+			break;
+		snap = writer.job;
+		writer.job = NULL;
+		pthread_mutex_unlock(&writer.lock);
+
+		gettimeofday(&start, NULL);
+		result = write_state(snap);
+
+		pthread_mutex_lock(&writer.lock);
+		writer.result = result;
+		writer.write_time = elapsed_since(&start);
+		writer.update_stats = status_update_stats;
+		writer.done = TRUE;
+		pthread_cond_broadcast(&writer.cond);
+		(void)write(writer.pipefd[1], "", 1);
+		}
+	pthread_mutex_unlock(&writer.lock);
+
+	return NULL;
+	}
+
+
+/* the main thread's half of finishing a write */
+static int start_state_write(int what);
+static void finish_state_write(void) {
+	struct state_snapshot *snap;
+	int result;
+
+	pthread_mutex_lock(&writer.lock);
+	if(writer.done == FALSE) {
+		pthread_mutex_unlock(&writer.lock);
+		return;
+		}
+	snap = writer.current;
+	result = writer.result;
+	writer.current = NULL;
+	writer.done = FALSE;
+	state_write_stats.last_write_time = writer.write_time;
+	if(snap->what & STATE_WRITE_STATUS)
+		state_write_stats.last_update = writer.update_stats;
+	pthread_mutex_unlock(&writer.lock);
+
+	if(state_write_stats.last_write_time > state_write_stats.max_write_time)
+		state_write_stats.max_write_time = state_write_stats.last_write_time;
+
+	/* the strings the writer may have been looking at can go now */
+	defer_object_string_frees(FALSE);
+	write_queued_log_messages();
+
+	log_debug_info(DEBUGL_STATUSDATA | DEBUGL_RETENTIONDATA, 1, "Wrote %s%s%s in %.3fs in the background\n",
+	               (snap->what & STATE_WRITE_STATUS) ? "status data" : "",
+	               (snap->what & STATE_WRITE_STATUS) && (snap->what & STATE_WRITE_RETENTION) ? " and " : "",
+	               (snap->what & STATE_WRITE_RETENTION) ? "retention data" : "",
+	               state_write_stats.last_write_time);
+
+	if(result == OK && (snap->what & STATE_WRITE_AUTOSAVE))
+		logit(NSLOG_PROCESS_INFO, FALSE, "Auto-save of retention data completed successfully.\n");
+
+	free_state_snapshot(snap);
+	writer.last_result = result;
+
+	/* start whatever was asked for in the meantime */
+	if(writer.pending) {
+		int what = writer.pending;
+		writer.pending = 0;
+		start_state_write(what);
+		}
+	}
+
+
+static int state_writer_handler(int sd, int events, void *discard) {
+	char buf[64];
+
+	while(read(sd, buf, sizeof(buf)) > 0)
+		;
+	finish_state_write();
+
+	return 0;
+	}
+
+
+static int start_state_writer(void) {
+	sigset_t all, old;
+	int result;
+
+	if(pipe(writer.pipefd) < 0) {
+		writer.pipefd[0] = writer.pipefd[1] = -1;
+		return ERROR;
+		}
+	fcntl(writer.pipefd[0], F_SETFL, O_NONBLOCK);
+	fcntl(writer.pipefd[1], F_SETFL, O_NONBLOCK);
+	fcntl(writer.pipefd[0], F_SETFD, FD_CLOEXEC);
+	fcntl(writer.pipefd[1], F_SETFD, FD_CLOEXEC);
+	if(nagios_iobs)
+		iobroker_register(nagios_iobs, writer.pipefd[0], NULL, state_writer_handler);
+
+	/* signals are for the main thread to handle */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	writer.stop = FALSE;
+	result = pthread_create(&writer.thread, NULL, state_writer_thread, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if(result != 0) {
+		logit(NSLOG_RUNTIME_WARNING, TRUE, "Warning: Unable to start the state writer thread: %s. Status and retention data will be written by the main thread.\n", strerror(result));
+		if(nagios_iobs)
+			iobroker_close(nagios_iobs, writer.pipefd[0]);
+		else
+			close(writer.pipefd[0]);
+		close(writer.pipefd[1]);
+		writer.pipefd[0] = writer.pipefd[1] = -1;
+		return ERROR;
+		}
+
+	writer.running = TRUE;
+	return OK;
+	}
+
+
+static struct state_snapshot *snapshot_state(int what) {
+	struct state_snapshot *snap;
+	struct timeval start;
+	int full = FALSE;
+
+	gettimeofday(&start, NULL);
+
+	if((what & STATE_WRITE_STATUS) && status_data_needs_full_update() == TRUE)
+		full = TRUE;
+	if((snap = take_state_snapshot(what, full)) == NULL) {
+		logit(NSLOG_RUNTIME_ERROR, TRUE, "Error: Unable to allocate memory for a snapshot of the status and retention data\n");
+		return NULL;
+		}
+	if(what & STATE_WRITE_STATUS)
+		reset_status_changes();
+
+	state_write_stats.last_snapshot_time = elapsed_since(&start);
+	if(state_write_stats.last_snapshot_time > state_write_stats.max_snapshot_time)
+		state_write_stats.max_snapshot_time = state_write_stats.last_snapshot_time;
+
+	log_debug_info(DEBUGL_STATUSDATA | DEBUGL_RETENTIONDATA, 2, "Took a %s snapshot of %u hosts and %u services in %.3fs\n",
+	               snap->full ? "full" : "partial", snap->num_hosts, snap->num_services, state_write_stats.last_snapshot_time);
+
+	return snap;
+	}
+
+
+static int start_state_write(int what) {
+	struct state_snapshot *snap;
+	struct timeval start;
+	int result;
+
+	if(writer.running == FALSE && start_state_writer() != OK) {
+
+		/* do it the old-fashioned way */
+		if((snap = snapshot_state(what)) == NULL)
+			return ERROR;
+		gettimeofday(&start, NULL);
+		result = write_state(snap);
+		state_write_stats.last_write_time = elapsed_since(&start);
+		if(state_write_stats.last_write_time > state_write_stats.max_write_time)
+			state_write_stats.max_write_time = state_write_stats.last_write_time;
+		if(what & STATE_WRITE_STATUS)
+			state_write_stats.last_update = status_update_stats;
+		if(result == OK && (what & STATE_WRITE_AUTOSAVE))
+			logit(NSLOG_PROCESS_INFO, FALSE, "Auto-save of retention data completed successfully.\n");
+		free_state_snapshot(snap);
+		writer.last_result = result;
+		return result;
+		}
+
+	if((snap = snapshot_state(what)) == NULL)
+		return ERROR;
+
+	defer_object_string_frees(TRUE);
+	pthread_mutex_lock(&writer.lock);
+	writer.current = writer.job = snap;
+	pthread_cond_signal(&writer.cond);
+	pthread_mutex_unlock(&writer.lock);
+
+	return OK;
+	}
+
+
+static void wait_for_current_write(void) {
+
+	while(writer.current != NULL) {
+		pthread_mutex_lock(&writer.lock);
+		while(writer.done == FALSE)
+			pthread_cond_wait(&writer.cond, &writer.lock);
+		pthread_mutex_unlock(&writer.lock);
+		finish_state_write();
+		}
+	}
+
+
+static void note_stall(struct timeval *start) {
+	double stall = elapsed_since(start);
+
+	if(stall > state_write_stats.max_stall)
+		state_write_stats.max_stall = stall;
+	}
+
+
+int write_state_in_background(int what, int wait) {
+	struct timeval start;
+	int result;
+
+	gettimeofday(&start, NULL);
+
+	/* a write may have finished without the io broker telling us yet */
+	finish_state_write();
+
+	if(writer.current != NULL) {
+		if(wait == FALSE) {
+			writer.pending |= what;
+			state_write_stats.coalesced++;
+			log_debug_info(DEBUGL_STATUSDATA | DEBUGL_RETENTIONDATA, 1, "The last state write is still in progress. Deferring this one until it's done.\n");
+			return OK;
+			}
+		wait_for_current_write();
+		}
+
+	what |= writer.pending;
+	writer.pending = 0;
+	result = start_state_write(what);
+
+	if(wait == TRUE) {
+		wait_for_current_write();
+		if(result == OK)
+			result = writer.last_result;
+		}
+
+	note_stall(&start);
+
+	return result;
+	}
+
+
+void wait_for_state_writer(void) {
+	struct timeval start;
+
+	if(writer.current == NULL && writer.pending == 0)
+		return;
+
+	gettimeofday(&start, NULL);
+	wait_for_current_write();
+	note_stall(&start);
+	}
+
+
+void stop_state_writer(void) {
+
+	/* finish what we've started, including anything still pending */
+	wait_for_state_writer();
+
+	if(writer.running == FALSE)
+		return;
+
+	pthread_mutex_lock(&writer.lock);
+	writer.stop = TRUE;
+	pthread_cond_signal(&writer.cond);
+	pthread_mutex_unlock(&writer.lock);
+	pthread_join(writer.thread, NULL);
+	writer.running = FALSE;
+
+	if(nagios_iobs)
+		iobroker_close(nagios_iobs, writer.pipefd[0]);
+	else
+		close(writer.pipefd[0]);
+	close(writer.pipefd[1]);
+	writer.pipefd[0] = writer.pipefd[1] = -1;
+	write_queued_log_messages();
+	}
@@ -77,6 +77,7 @@ int log_host_retries;
 int log_event_handlers;
 int log_initial_states;
 int log_current_states;
+int index_log_file;
 int log_external_commands;
 int log_passive_checks;
 unsigned long logging_options = 0;
@@ -104,6 +105,9 @@ int max_service_check_spread;
 
 int check_reaper_interval;
 int max_check_reaper_time;
+int max_external_command_time;
+int check_storm_threshold;
+int check_storm_drain_rate;
 int service_freshness_check_interval;
 int host_freshness_check_interval;
 int auto_rescheduling_interval;
@@ -143,6 +147,8 @@ int use_retained_program_state;
 int use_retained_scheduling_info;
 int retention_scheduling_horizon;
 char *retention_file;
+char *binary_retention_file;
+int export_retention_file;
 
 unsigned long modified_process_attributes = MODATTR_NONE;
 unsigned long modified_host_process_attributes = MODATTR_NONE;
@@ -181,6 +187,7 @@ int translate_passive_host_checks;
 int passive_host_checks_are_soft;
 
 int status_update_interval;
+int export_status_file;
 
 int time_change_threshold;
 
@@ -285,6 +292,7 @@ void init_main_cfg_vars(int first_time) {
 	log_service_retries = DEFAULT_LOG_SERVICE_RETRIES;
 	log_host_retries = DEFAULT_LOG_HOST_RETRIES;
 	log_initial_states = DEFAULT_LOG_INITIAL_STATES;
+	index_log_file = DEFAULT_INDEX_LOG_FILE;
 	if(first_time) {
 		/* Not sure why this is not reset in reset_variables() */
 		log_current_states = DEFAULT_LOG_CURRENT_STATES;
@@ -334,7 +342,9 @@ void init_main_cfg_vars(int first_time) {
 	if(first_time) {
 		/* Not sure why this is not reset in reset_variables() */
 		retention_file = NULL;
+		binary_retention_file = NULL;
 	}
+	export_retention_file = DEFAULT_EXPORT_RETENTION_FILE;
 	retained_host_attribute_mask = 0L;
 	retained_service_attribute_mask = 0L;
 	retained_process_host_attribute_mask = 0L;
@@ -344,6 +354,9 @@ void init_main_cfg_vars(int first_time) {
 
 	check_reaper_interval = DEFAULT_CHECK_REAPER_INTERVAL;
 	max_check_reaper_time = DEFAULT_MAX_REAPER_TIME;
+	max_external_command_time = DEFAULT_MAX_EXTERNAL_COMMAND_TIME;
+	check_storm_threshold = DEFAULT_CHECK_STORM_THRESHOLD;
+	check_storm_drain_rate = DEFAULT_CHECK_STORM_DRAIN_RATE;
 	max_check_result_file_age = DEFAULT_MAX_CHECK_RESULT_AGE;
 	service_freshness_check_interval = DEFAULT_FRESHNESS_CHECK_INTERVAL;
 	host_freshness_check_interval = DEFAULT_FRESHNESS_CHECK_INTERVAL;
@@ -364,6 +377,7 @@ void init_main_cfg_vars(int first_time) {
 	max_parallel_service_checks = DEFAULT_MAX_PARALLEL_SERVICE_CHECKS;
 
 	status_update_interval = DEFAULT_STATUS_UPDATE_INTERVAL;
+	export_status_file = DEFAULT_EXPORT_STATUS_FILE;
 
 	event_broker_options = BROKER_NOTHING;
 
@@ -1156,24 +1170,114 @@ static timerange* _get_matching_timerange(time_t test_time, timeperiod *tperiod)
 	return tperiod->days[test_time_wday];
 }
 
+/*
+ * Finding the time ranges that apply on a day means going through all
+ * the exceptions of a timeperiod, with a few mktime() calls for each,
+ * but the answer only changes at midnight. Every timeperiod remembers
+ * the last few days it was asked about, so the checks and notifications
+ * that test a timeperiod over and over again mostly just have to
+ * compare a couple of numbers.
+ * Days on which the clocks change aren't remembered, as the midnight
+ * the time ranges are relative to depends on the time of day then.
+ */
+#define TIMEPERIOD_CACHE_DAYS 8
+
+struct timeperiod_day {
+	time_t start, end;	/* times in [start, end) are on this day */
+	time_t midnight;	/* what the time ranges are relative to */
+	timerange *ranges;
+};
+
+/*
+ * The scheduler keeps asking when a timeperiod next becomes valid or
+ * invalid, with the current time creeping forward, and finding out
+ * can mean walking day by day through the exclusions. So every
+ * timeperiod also remembers its last answer to each question, along
+ * with the query times it's known to hold for.
+ */
+struct timeperiod_boundary {
+	int known;
+	time_t from, until;	/* queries in [from, until] get the same answer */
+	time_t answer;
+};
+
+struct timeperiod_cache {
+	unsigned int next;
+	struct timeperiod_day day[TIMEPERIOD_CACHE_DAYS];
+	struct timeperiod_boundary next_valid, next_invalid;
+};
+
+static struct timeperiod_cache *get_timeperiod_cache(timeperiod *tperiod) {
+	if(tperiod->cache == NULL)
+		tperiod->cache = calloc(1, sizeof(struct timeperiod_cache));
+	return tperiod->cache;
+	}
+
+/* time ranges that apply at test_time, and the midnight they start from */
+static timerange *get_day_timeranges(time_t test_time, timeperiod *tperiod, time_t *midnight) {
+	struct timeperiod_cache *cache = tperiod->cache;
+	struct timeperiod_day *day;
+	struct tm *t, tm_s;
+	time_t start, end;
+	timerange *ranges;
+	unsigned int i;
+
+	if(cache != NULL) {
+		for(i = 0; i < TIMEPERIOD_CACHE_DAYS; i++) {
+			day = &cache->day[i];
+			if(test_time >= day->start && test_time < day->end) {
+				*midnight = day->midnight;
+				return day->ranges;
+				}
+			}
+		}
+
+	t = localtime_r(&test_time, &tm_s);
+	start = test_time - (t->tm_hour * 3600 + t->tm_min * 60 + t->tm_sec);
+	t->tm_sec = 0;
+	t->tm_min = 0;
+	t->tm_hour = 0;
+	*midnight = mktime(t);
+	ranges = _get_matching_timerange(test_time, tperiod);
+
+	/* only remember days that really are 24 hours, midnight to midnight */
+	end = start + 86400;
+	t = localtime_r(&start, &tm_s);
+	if(t->tm_hour || t->tm_min || t->tm_sec || *midnight != start)
+		return ranges;
+	t = localtime_r(&end, &tm_s);
+	if(t->tm_hour || t->tm_min || t->tm_sec)
+		return ranges;
+
+	if((cache = get_timeperiod_cache(tperiod)) == NULL)
+		return ranges;
+	day = &cache->day[cache->next++ % TIMEPERIOD_CACHE_DAYS];
+	day->start = start;
+	day->end = end;
+	day->midnight = *midnight;
+	day->ranges = ranges;
+
+	return ranges;
+	}
+
+void clear_timeperiod_cache(void) {
+	unsigned int i;
+
+	/* timeperiod_list isn't reset when objects are freed on restarts */
+	for(i = 0; timeperiod_ary && i < num_objects.timeperiods; i++)
+		my_free(timeperiod_ary[i]->cache);
+	}
+
 /* see if the specified time falls into a valid time range in the given time period */
 int check_time_against_period(time_t test_time, timeperiod *tperiod) {
 	timerange *temp_timerange = NULL;
 	timeperiodexclusion *temp_timeperiodexclusion = NULL;
-	struct tm *t, tm_s;
 	time_t midnight = (time_t)0L;
 	time_t day_range_start = (time_t)0L;
 	time_t day_range_end = (time_t)0L;
 
 	log_debug_info(DEBUGL_FUNCTIONS, 0, "check_time_against_period()\n");
 
-	t = localtime_r((time_t *)&test_time, &tm_s);
-
-	t->tm_sec = 0;
-	t->tm_min = 0;
-	t->tm_hour = 0;
-	midnight = mktime(t);
-
 	/* if no period was specified, assume the time is good */
 	if(tperiod == NULL)
 		return OK;
@@ -1184,7 +1288,7 @@ int check_time_against_period(time_t test_time, timeperiod *tperiod) {
 			}
 		}
 
-	for(temp_timerange = _get_matching_timerange(test_time, tperiod); temp_timerange != NULL; temp_timerange = temp_timerange->next) {
+	for(temp_timerange = get_day_timeranges(test_time, tperiod, &midnight); temp_timerange != NULL; temp_timerange = temp_timerange->next) {
 
 		day_range_start = (time_t)(midnight + temp_timerange->range_start);
 		day_range_end = (time_t)(midnight + temp_timerange->range_end);
@@ -1199,37 +1303,33 @@ int check_time_against_period(time_t test_time, timeperiod *tperiod) {
 
 /*#define TEST_TIMEPERIODS_B 1*/
 
-void _get_next_valid_time(time_t pref_time, time_t *valid_time, timeperiod *tperiod);
+static time_t get_timeperiod_boundary(time_t pref_time, timeperiod *tperiod, int valid, time_t *stable_until);
 
-static void _get_next_invalid_time(time_t pref_time, time_t *invalid_time, timeperiod *tperiod) {
+/*
+ * The first invalid time at or after pref_time. stable_until is set to
+ * the last query time known to get the same answer: as long as the
+ * time ranges and exclusions that pref_time falls in go on, nothing
+ * changes.
+ */
+static time_t find_next_invalid_time(time_t pref_time, timeperiod *tperiod, time_t *stable_until) {
 	timeperiodexclusion *temp_timeperiodexclusion = NULL;
 	int depth = 0;
 	int max_depth = 300; // commonly roughly equal to "days in the future"
-	struct tm *t, tm_s;
 	time_t earliest_time = pref_time;
 	time_t last_earliest_time = 0;
 	time_t midnight = (time_t)0L;
 	time_t day_range_start = (time_t)0L;
 	time_t day_range_end = (time_t)0L;
-
-	/* if no period was specified, assume the time is good */
-	if(tperiod == NULL) {
-		*invalid_time = pref_time;
-		return;
-	}
+	time_t stable = pref_time;
+	int in_range = FALSE;
+	int have_stable = FALSE;
 
 	while (earliest_time != last_earliest_time && depth < max_depth) {
 		time_t potential_time = 0;
 		depth++;
 		last_earliest_time = earliest_time;
 
-		t = localtime_r((time_t *)&earliest_time, &tm_s);
-		t->tm_sec = 0;
-		t->tm_min = 0;
-		t->tm_hour = 0;
-		midnight = mktime(t);
-
-		timerange *temp_timerange = _get_matching_timerange(earliest_time, tperiod);
+		timerange *temp_timerange = get_day_timeranges(earliest_time, tperiod, &midnight);
 
 		for(; temp_timerange != NULL; temp_timerange = temp_timerange->next) {
 			/* ranges with start/end of zero mean exclude this day */
@@ -1244,6 +1344,17 @@ static void _get_next_invalid_time(time_t pref_time, time_t *invalid_time, timep
 			printf("  INVALID RANGE END:   %lu (%lu) = %s", temp_timerange->range_end, (unsigned long)day_range_end, ctime(&day_range_end));
 #endif
 
+			/* later query times must fall in the same ranges as pref_time */
+			if(depth == 1 && day_range_end > pref_time) {
+				time_t limit = (day_range_start > pref_time) ? day_range_start - 1 : day_range_end - 1;
+
+				if(day_range_start <= pref_time)
+					in_range = TRUE;
+				if(have_stable == FALSE || limit < stable)
+					stable = limit;
+				have_stable = TRUE;
+				}
+
 			if(day_range_start <= earliest_time && day_range_end > earliest_time)
 				potential_time = day_range_end + 60;
 			else
@@ -1257,8 +1368,16 @@ static void _get_next_invalid_time(time_t pref_time, time_t *invalid_time, timep
 				}
 			}
 
+		/* outside of any range, pref_time is the answer to itself only */
+		if(depth == 1 && in_range == FALSE)
+			stable = pref_time;
+
 		for(temp_timeperiodexclusion = tperiod->exclusions; temp_timeperiodexclusion != NULL; temp_timeperiodexclusion = temp_timeperiodexclusion->next) {
-			_get_next_valid_time(last_earliest_time, &potential_time, temp_timeperiodexclusion->timeperiod_ptr);
+			time_t exclusion_stable;
+
+			potential_time = get_timeperiod_boundary(last_earliest_time, temp_timeperiodexclusion->timeperiod_ptr, TRUE, &exclusion_stable);
+			if (depth == 1 && exclusion_stable < stable)
+				stable = exclusion_stable;
 			if (potential_time + 60 < earliest_time)
 				earliest_time = potential_time + 60;
 			}
@@ -1267,30 +1386,31 @@ static void _get_next_invalid_time(time_t pref_time, time_t *invalid_time, timep
 		printf("    FINAL EARLIEST INVALID TIME: %llu = %s", (unsigned long long)earliest_time, ctime(&earliest_time));
 #endif
 
-	if (depth == max_depth)
-		*invalid_time = pref_time;
-	else
-		*invalid_time = earliest_time;
+	if (depth == max_depth) {
+		*stable_until = pref_time;
+		return pref_time;
+		}
+	*stable_until = stable;
+	return earliest_time;
 	}
 
-/* Separate this out from public get_next_valid_time for testing */
-void _get_next_valid_time(time_t pref_time, time_t *valid_time, timeperiod *tperiod) {
+/*
+ * The first valid time at or after pref_time. Any query time up to the
+ * first time that's in one of the time ranges goes the same way from
+ * there, whatever the exclusions do to it afterwards.
+ */
+static time_t find_next_valid_time(time_t pref_time, timeperiod *tperiod, time_t *stable_until) {
 	timeperiodexclusion *temp_timeperiodexclusion = NULL;
 	int depth = 0;
 	int max_depth = 300; // commonly roughly equal to "days in the future"
 	time_t earliest_time = pref_time;
 	time_t last_earliest_time = 0;
-	struct tm *t, tm_s;
 	time_t midnight = (time_t)0L;
 	time_t day_range_start = (time_t)0L;
 	time_t day_range_end = (time_t)0L;
+	time_t first_in_range = (time_t)0L;
 	int have_earliest_time = FALSE;
-
-	/* if no period was specified, assume the time is good */
-	if(tperiod == NULL) {
-		*valid_time = pref_time;
-		return;
-	}
+	int have_first_in_range = FALSE;
 
 	while (earliest_time != last_earliest_time && depth < max_depth) {
 		time_t potential_time = 0;
@@ -1298,13 +1418,7 @@ void _get_next_valid_time(time_t pref_time, time_t *valid_time, timeperiod *tper
 		depth++;
 		last_earliest_time = earliest_time;
 
-		t = localtime_r((time_t *)&earliest_time, &tm_s);
-		t->tm_sec = 0;
-		t->tm_min = 0;
-		t->tm_hour = 0;
-		midnight = mktime(t);
-
-		timerange *temp_timerange = _get_matching_timerange(earliest_time, tperiod);
+		timerange *temp_timerange = get_day_timeranges(earliest_time, tperiod, &midnight);
 #ifdef TEST_TIMEPERIODS_B
 			printf("  RANGE START: %lu\n", temp_timerange ? temp_timerange->range_start : 0);
 			printf("  RANGE END:   %lu\n", temp_timerange ? temp_timerange->range_end : 0);
@@ -1347,8 +1461,12 @@ void _get_next_valid_time(time_t pref_time, time_t *valid_time, timeperiod *tper
 		if (have_earliest_time == FALSE) {
 			earliest_time = midnight + 86400;
 		} else {
+			if (have_first_in_range == FALSE) {
+				first_in_range = earliest_time;
+				have_first_in_range = TRUE;
+			}
 			for(temp_timeperiodexclusion = tperiod->exclusions; temp_timeperiodexclusion != NULL; temp_timeperiodexclusion = temp_timeperiodexclusion->next) {
-				_get_next_invalid_time(earliest_time, &earliest_time, temp_timeperiodexclusion->timeperiod_ptr);
+				earliest_time = get_timeperiod_boundary(earliest_time, temp_timeperiodexclusion->timeperiod_ptr, FALSE, NULL);
 #ifdef TEST_TIMEPERIODS_B
 				printf("    FINAL EARLIEST TIME: %llu = %s", (unsigned long long)earliest_time, ctime(&earliest_time));
 #endif
@@ -1356,10 +1474,62 @@ void _get_next_valid_time(time_t pref_time, time_t *valid_time, timeperiod *tper
 			}
 		}
 
-	if (depth == max_depth)
-		*valid_time = pref_time;
+	if (depth == max_depth) {
+		*stable_until = pref_time;
+		return pref_time;
+		}
+	*stable_until = first_in_range;
+	return earliest_time;
+	}
+
+/* the next valid or invalid time, from the last answer if that covers pref_time */
+static time_t get_timeperiod_boundary(time_t pref_time, timeperiod *tperiod, int valid, time_t *stable_until) {
+	struct timeperiod_cache *cache;
+	struct timeperiod_boundary *boundary;
+	time_t answer, until;
+
+	/* if no period was specified, assume the time is good */
+	if(tperiod == NULL) {
+		if(stable_until != NULL)
+			*stable_until = pref_time;
+		return pref_time;
+		}
+
+	if((cache = tperiod->cache) != NULL) {
+		boundary = (valid == TRUE) ? &cache->next_valid : &cache->next_invalid;
+		if(boundary->known == TRUE && pref_time >= boundary->from && pref_time <= boundary->until) {
+			if(stable_until != NULL)
+				*stable_until = boundary->until;
+			return boundary->answer;
+			}
+		}
+
+	if(valid == TRUE)
+		answer = find_next_valid_time(pref_time, tperiod, &until);
 	else
-		*valid_time = earliest_time;
+		answer = find_next_invalid_time(pref_time, tperiod, &until);
+	if(stable_until != NULL)
+		*stable_until = until;
+
+	/* the query time has moved past what we knew, so start over from here */
+	if(until > pref_time && (cache = get_timeperiod_cache(tperiod)) != NULL) {
+		boundary = (valid == TRUE) ? &cache->next_valid : &cache->next_invalid;
+		boundary->known = TRUE;
+		boundary->from = pref_time;
+		boundary->until = until;
+		boundary->answer = answer;
+		}
+
+	return answer;
+	}
+
+/* Separate these out from public get_next_valid_time for testing */
+void _get_next_invalid_time(time_t pref_time, time_t *invalid_time, timeperiod *tperiod) {
+	*invalid_time = get_timeperiod_boundary(pref_time, tperiod, FALSE, NULL);
+	}
+
+void _get_next_valid_time(time_t pref_time, time_t *valid_time, timeperiod *tperiod) {
+	*valid_time = get_timeperiod_boundary(pref_time, tperiod, TRUE, NULL);
 	}
 
 
@@ -1766,7 +1936,9 @@ void handle_sigxfsz(int sig) {
 		object_cache_file,
 		object_precache_file,
 		status_file,
+		binary_status_file,
 		retention_file,
+		binary_retention_file,
 		};
 	int x;
 	char **filep;
@@ -2579,6 +2751,10 @@ int init_check_result(check_result *info)
 	info->output              = NULL;
 	info->source              = NULL;
 	info->engine              = NULL;
+	info->output_split        = FALSE;
+	info->plugin_output       = NULL;
+	info->long_plugin_output  = NULL;
+	info->perf_data           = NULL;
 
 	return OK;
 }
@@ -2595,6 +2771,9 @@ int free_check_result(check_result *info)
 	my_free(info->host_name);
 	my_free(info->service_description);
 	my_free(info->output);
+	my_free(info->plugin_output);
+	my_free(info->long_plugin_output);
+	my_free(info->perf_data);
 
 	return OK;
 }
@@ -3583,10 +3762,13 @@ void free_memory(nagios_macros *mac) {
 	mac->x[MACRO_COMMANDFILE] = NULL; /* assigned from command_file */
 
 	my_free(check_result_path);
+	wproc_free_coprocess_plugins();
 	my_free(log_archive_path);
 	my_free(website_url);
 	my_free(status_file);
+	my_free(binary_status_file);
 	my_free(retention_file);
+	my_free(binary_retention_file);
 
 	for (i = 0; i < MAX_USER_MACROS; i++) {
 		my_free(macro_user[i]);
@@ -3632,6 +3814,7 @@ void free_notification_list(void) {
 int reset_variables(void) {
 
 	/* First free any variables previously set */
+	wproc_free_coprocess_plugins();
 	my_free(log_file);
 	my_free(temp_file);
 	my_free(temp_path);
@@ -9,6 +9,7 @@
  */
 #include "../include/config.h"
 #include <string.h>
+#include <sys/ioctl.h>
 #include "../include/nagios.h"
 #include "../include/workers.h"
 
@@ -39,8 +40,96 @@ struct wproc_worker {
 	iocache *ioc;  /**< iocache for reading from worker */
 	fanout_table *jobs; /**< array of jobs */
 	struct wproc_list *wp_list;
+	double avg_runtime; /**< moving average of job runtimes, in seconds */
+	unsigned int backlog; /**< bytes sent to the worker it hadn't read yet, last we looked */
+	unsigned int jobs_rerouted; /**< jobs sent elsewhere because this one was overloaded */
+	unsigned int pick_gen; /**< used by wproc_pick_worker() to skip overloaded workers */
+	int pending; /**< has input we haven't handled yet */
+	struct wproc_worker *next_pending;
 };
 
+/*
+ * If a worker hasn't read this much of what we've sent it, it's
+ * falling behind and new jobs are better off elsewhere.
+ */
+#define WPROC_BACKLOG_MAX (64 * 1024)
+
+/*
+ * Worker results are handled in batches. When a worker's socket has
+ * input, we only read it and put the worker on the pending list.
+ * Once the poll is done, wproc_handle_results() takes the messages
+ * from all pending workers, parses them into the batch and handles
+ * them one after another. The parsed messages point into the workers'
+ * iocaches, which nothing reads into until the batch is done.
+ */
+struct wproc_batch_entry {
+	struct wproc_worker *wp;
+	struct kvvec kvv;
+};
+
+static struct {
+	struct wproc_worker *pending, *pending_tail;
+	struct wproc_batch_entry *entries; /* kept, with their kv arrays, between batches */
+	unsigned int len, size;
+	int busy;
+	double check_time;  /* spent in process_check_result() in this batch */
+} wproc_batch;
+
+static struct kvvec *wproc_batch_add(struct wproc_worker *wp)
+{
+	struct wproc_batch_entry *e;
+
+	if (wproc_batch.len == wproc_batch.size) {
+		unsigned int size = wproc_batch.size ? wproc_batch.size * 2 : 64;
+
+		e = realloc(wproc_batch.entries, size * sizeof(*e));
+		if (!e)
+			return NULL;
+		memset(e + wproc_batch.size, 0, (size - wproc_batch.size) * sizeof(*e));
+		wproc_batch.entries = e;
+		wproc_batch.size = size;
+	}
+	e = &wproc_batch.entries[wproc_batch.len];
+	e->wp = wp;
+	return &e->kvv;
+}
+
+static void wproc_batch_free(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < wproc_batch.size; i++)
+		free(wproc_batch.entries[i].kvv.kv);
+	my_free(wproc_batch.entries);
+	wproc_batch.len = wproc_batch.size = 0;
+}
+
+/* takes a worker that's going away off the pending list */
+static void wproc_batch_forget(struct wproc_worker *wp)
+{
+	struct wproc_worker **pp, *prev = NULL;
+
+	if (!wp->pending)
+		return;
+	for (pp = &wproc_batch.pending; *pp; prev = *pp, pp = &(*pp)->next_pending) {
+		if (*pp != wp)
+			continue;
+		*pp = wp->next_pending;
+		if (wproc_batch.pending_tail == wp)
+			wproc_batch.pending_tail = prev;
+		break;
+	}
+	wp->pending = FALSE;
+}
+
+/* how get_worker() has been deciding where jobs go */
+static struct {
+	unsigned long dispatched; /* jobs handed to a worker */
+	unsigned long rerouted;   /* ... that skipped an overloaded worker */
+	unsigned long saturated;  /* ... while all workers were overloaded */
+	unsigned long retried;    /* jobs moved after failing to reach their worker */
+} dispatch_stats;
+
 struct wproc_list {
 	unsigned int len;
 	unsigned int idx;
@@ -52,6 +141,10 @@ static struct wproc_list workers = {0, 0, NULL};
 static dkhash_table *specialized_workers;
 static struct wproc_list *to_remove = NULL;
 
+/* plugins the workers keep running between checks */
+static char **coprocess_plugins;
+static unsigned int num_coprocess_plugins;
+
 typedef struct wproc_callback_job {
 	void *data;
 	void (*callback)(struct wproc_result *, void *, int);
@@ -65,6 +158,7 @@ typedef struct wproc_object_job {
 
 unsigned int wproc_num_workers_online = 0, wproc_num_workers_desired = 0;
 unsigned int wproc_num_workers_spawned = 0;
+struct wproc_result_stats wproc_result_stats;
 
 extern struct kvvec * macros_to_kvv(nagios_macros *);
 
@@ -144,6 +238,7 @@ void wproc_reap(int jobs, int msecs)
 		if (inputs < 0) {
 			return;
 		}
+		wproc_handle_results();
 
 		jobs -= inputs; /* One input is roughly equivalent to one job. */
 
@@ -263,6 +358,116 @@ static struct wproc_list *get_wproc_list(const char *cmd)
 	return &workers;
 }
 
+int wproc_add_coprocess_plugin(const char *path)
+{
+	char **list, *dup;
+
+	list = realloc(coprocess_plugins, (num_coprocess_plugins + 1) * sizeof(char *));
+	if (!list || !(dup = strdup(path))) {
+		if (list)
+			coprocess_plugins = list;
+		return ERROR;
+	}
+
+	coprocess_plugins = list;
+	coprocess_plugins[num_coprocess_plugins++] = dup;
+	return OK;
+}
+
+void wproc_free_coprocess_plugins(void)
+{
+	while (num_coprocess_plugins)
+		free(coprocess_plugins[--num_coprocess_plugins]);
+	my_free(coprocess_plugins);
+}
+
+/* is this the command line of a plugin we've been told to keep running? */
+static int is_coprocess_command(const char *cmd)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_coprocess_plugins; i++) {
+		size_t len = strlen(coprocess_plugins[i]);
+
+		if (!strncmp(cmd, coprocess_plugins[i], len) &&
+		    (!cmd[len] || cmd[len] == ' ' || cmd[len] == '\t'))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* bytes we've sent to the worker that it hasn't read yet */
+static unsigned int wproc_backlog(struct wproc_worker *wp)
+{
+#ifdef TIOCOUTQ
+	int outq = 0;
+
+	if (!ioctl(wp->sd, TIOCOUTQ, &outq) && outq > 0) {
+		return wp->backlog = outq;
+	}
+#endif
+	return wp->backlog = 0;
+}
+
+/*
+ * Picks the least loaded worker in the list, which is the one with
+ * the fewest jobs running, or the one whose jobs usually finish
+ * the quickest if there's a tie. Workers that are at their job
+ * limit or haven't read the jobs we've already sent them are
+ * passed over, unless they're all like that.
+ */
+static struct wproc_worker *wproc_pick_worker(struct wproc_list *wp_list, struct wproc_worker *skip)
+{
+	static unsigned int gen = 0;
+	struct wproc_worker *wp, *best, *passed = NULL;
+	unsigned int i;
+
+	gen++;
+	for (;;) {
+		best = NULL;
+		for (i = 0; i < wp_list->len; i++) {
+			/* start at a different worker each time, so ties are spread out */
+			wp = wp_list->wps[(wp_list->idx + i) % wp_list->len];
+			if (wp == skip || wp->pick_gen == gen) {
+				continue;
+			}
+			if (!best || wp->jobs_running < best->jobs_running ||
+			    (wp->jobs_running == best->jobs_running && wp->avg_runtime < best->avg_runtime)) {
+				best = wp;
+			}
+		}
+		if (!best) {
+			break;
+		}
+
+		if (best->jobs_running < best->max_jobs && wproc_backlog(best) < WPROC_BACKLOG_MAX) {
+			if (passed) {
+				log_debug_info(DEBUGL_WORKERS, 1, " * %s is overloaded, using %s instead\n", passed->name, best->name);
+				passed->jobs_rerouted++;
+				dispatch_stats.rerouted++;
+			}
+			wp_list->idx++;
+			dispatch_stats.dispatched++;
+			return best;
+		}
+
+		best->pick_gen = gen;
+		if (!passed) {
+			passed = best;
+		}
+	}
+
+	/* everyone's swamped, so go with the least loaded one anyway */
+	if (passed) {
+		log_debug_info(DEBUGL_WORKERS, 1, " * all workers are overloaded, using %s\n", passed->name);
+		wp_list->idx++;
+		dispatch_stats.saturated++;
+		dispatch_stats.dispatched++;
+	}
+	return passed;
+}
+
 static struct wproc_worker *get_worker(const char *cmd)
 {
 	struct wproc_list *wp_list = NULL;
@@ -290,7 +495,37 @@ static struct wproc_worker *get_worker(const char *cmd)
 		return NULL;
 	}
 
-	return wp_list->wps[wp_list->idx++ % wp_list->len];
+	return wproc_pick_worker(wp_list, NULL);
+}
+
+/*
+ * Moves a job that never reached its worker over to another one.
+ * Returns the new worker, or NULL if there's nowhere else to go.
+ */
+static struct wproc_worker *wproc_reroute_job(struct wproc_job *job)
+{
+	struct wproc_list *wp_list;
+	struct wproc_worker *wp;
+	int job_id;
+
+	wp_list = get_wproc_list(job->command);
+	if (!wp_list || !wp_list->len || !(wp = wproc_pick_worker(wp_list, job->wp))) {
+		return NULL;
+	}
+
+	/* the job stays with its old worker unless the new one takes it */
+	job_id = get_job_id(wp);
+	if (fanout_add(wp->jobs, job_id, job) < 0) {
+		return NULL;
+	}
+
+	fanout_remove(job->wp->jobs, job->id);
+	job->wp->jobs_rerouted++;
+	job->wp = wp;
+	job->id = job_id;
+
+	dispatch_stats.retried++;
+	return wp;
 }
 
 static struct wproc_job *create_job(int type, void *arg, time_t timeout, const char *cmd)
@@ -458,6 +693,7 @@ static int wproc_destroy(struct wproc_worker *wp, int flags)
 	}
 
 	/* free all memory when either forcing or a worker called us */
+	wproc_batch_forget(wp);
 	iocache_destroy(wp->ioc);
 	wp->ioc = NULL;
 	my_free(wp->name);
@@ -565,6 +801,7 @@ void free_worker_memory(int flags)
 	}
 	workers.len = 0;
 	workers.idx = 0;
+	wproc_batch_free();
 
 	to_remove = NULL;
 	dkhash_walk_data(specialized_workers, remove_specialized);
@@ -598,6 +835,8 @@ static int handle_worker_check(wproc_result *wpres, struct wproc_worker *wp, str
 {
 	int result = ERROR;
 	check_result *cr = (check_result *)job->arg;
+	struct timeval start, stop;
+	double delta;
 
 	cr->start_time.tv_sec   = wpres->start.tv_sec;
 	cr->start_time.tv_usec  = wpres->start.tv_usec;
@@ -611,7 +850,29 @@ static int handle_worker_check(wproc_result *wpres, struct wproc_worker *wp, str
 		cr->return_code = STATE_UNKNOWN;
 	}
 
-	if (wpres->outstd && *wpres->outstd) {
+	if (wpres->outstd && wpres->output_short) {
+		/*
+		 * the worker has already split the output for us, and only
+		 * sent the first line of the raw output along with it. That's
+		 * all modules get to see, just as if parse_check_output()
+		 * had been run on it
+		 */
+		cr->output = strndup(wpres->outstd, strcspn(wpres->outstd, "\n"));
+		cr->output_split = TRUE;
+		if (*wpres->output_short)
+			cr->plugin_output = strdup(wpres->output_short);
+		if (wpres->output_long)
+			cr->long_plugin_output = strdup(wpres->output_long);
+		if (wpres->output_perfdata)
+			cr->perf_data = strdup(wpres->output_perfdata);
+		if (!wproc_result_stats.presplit || wpres->parse_time < wproc_result_stats.min_parse_time)
+			wproc_result_stats.min_parse_time = wpres->parse_time;
+		if (wpres->parse_time > wproc_result_stats.max_parse_time)
+			wproc_result_stats.max_parse_time = wpres->parse_time;
+		wproc_result_stats.total_parse_time += wpres->parse_time;
+		wproc_result_stats.presplit++;
+	}
+	else if (wpres->outstd && *wpres->outstd) {
 		cr->output = strdup(wpres->outstd);
 	}
 	else if (wpres->outerr) {
@@ -626,9 +887,31 @@ static int handle_worker_check(wproc_result *wpres, struct wproc_worker *wp, str
 	cr->engine        = NULL;
 	cr->source        = wp->name;
 
+	gettimeofday(&start, NULL);
+	delta = tv_delta_f(&wpres->stop, &start);
+	if (delta < 0.0)
+		delta = 0.0;
+	if (!wproc_result_stats.results || delta < wproc_result_stats.min_queue_latency)
+		wproc_result_stats.min_queue_latency = delta;
+	if (delta > wproc_result_stats.max_queue_latency)
+		wproc_result_stats.max_queue_latency = delta;
+	wproc_result_stats.total_queue_latency += delta;
+	histogram_add(&loop_stats.result_queue, (uint64_t)(delta * 1000000));
+
 	process_check_result(cr);
 	free_check_result(cr);
 
+	gettimeofday(&stop, NULL);
+	delta = tv_delta_f(&start, &stop);
+	if (!wproc_result_stats.results || delta < wproc_result_stats.min_handling_time)
+		wproc_result_stats.min_handling_time = delta;
+	if (delta > wproc_result_stats.max_handling_time)
+		wproc_result_stats.max_handling_time = delta;
+	wproc_result_stats.total_handling_time += delta;
+	wproc_batch.check_time += delta;
+	histogram_add(&loop_stats.result_handling, (uint64_t)(delta * 1000000));
+	wproc_result_stats.results++;
+
 	return result;
 }
 
@@ -694,6 +977,18 @@ static int parse_worker_result(wproc_result *wpres, struct kvvec *kvv)
 		case WPRES_runtime:
 			/* ignored */
 			break;
+		case WPRES_output_short:
+			wpres->output_short = value;
+			break;
+		case WPRES_output_long:
+			wpres->output_long = value;
+			break;
+		case WPRES_output_perfdata:
+			wpres->output_perfdata = value;
+			break;
+		case WPRES_parse_time:
+			wpres->parse_time = strtod(value, NULL);
+			break;
 
 		default:
 			logit(NSLOG_RUNTIME_WARNING, TRUE, "wproc: Recognized but unhandled result variable: %s=%s\n", key, value);
@@ -703,6 +998,65 @@ static int parse_worker_result(wproc_result *wpres, struct kvvec *kvv)
 	return 0;
 }
 
+/*
+ * Runs inside core workers for every finished job. For checks we
+ * split the plugin output into its short, long and perfdata parts
+ * here, so the main process doesn't have to spend time on it when
+ * the result comes in. The main process only needs the first line
+ * of the raw output next to those, so that's all we send of it.
+ * The strings must stay valid until the response has been sent,
+ * so we hang on to them until next time.
+ */
+int wproc_split_check_output(child_process *cp, struct kvvec *resp)
+{
+	static char *short_output, *long_output, *perf_data;
+	static char parse_time[32];
+	struct timeval start, stop;
+	char *buf, *nl;
+	int i;
+
+	my_free(short_output);
+	my_free(long_output);
+	my_free(perf_data);
+
+	if (!cp->outstd.buf || !cp->outstd.len)
+		return 0;
+
+	for (i = 0; i < cp->request->kv_pairs; i++) {
+		struct key_value *kv = &cp->request->kv[i];
+		if (kv->key_len == 4 && !strcmp(kv->key, "type"))
+			break;
+	}
+	if (i == cp->request->kv_pairs || atoi(cp->request->kv[i].value) != WPJOB_CHECK)
+		return 0;
+
+	gettimeofday(&start, NULL);
+	if (!(buf = strndup(cp->outstd.buf, cp->outstd.len)))
+		return -1;
+	parse_check_output(buf, &short_output, &long_output, &perf_data, TRUE, FALSE);
+	free(buf);
+	gettimeofday(&stop, NULL);
+	snprintf(parse_time, sizeof(parse_time), "%f", tv_delta_f(&start, &stop));
+
+	for (i = resp->kv_pairs - 1; i >= 0; i--) {
+		struct key_value *kv = &resp->kv[i];
+		if (kv->key_len == 6 && !strcmp(kv->key, "outstd")) {
+			if ((nl = memchr(kv->value, '\n', kv->value_len)))
+				kv->value_len = nl - kv->value;
+			break;
+		}
+	}
+
+	kvvec_addkv(resp, "output_short", short_output ? short_output : "");
+	if (long_output)
+		kvvec_addkv(resp, "output_long", long_output);
+	if (perf_data)
+		kvvec_addkv(resp, "output_perfdata", perf_data);
+	kvvec_addkv(resp, "parse_time", parse_time);
+
+	return 0;
+}
+
 static int wproc_run_job(struct wproc_job *job, nagios_macros *mac);
 static void fo_reassign_wproc_job(void *job_)
 {
@@ -717,13 +1071,235 @@ static void fo_reassign_wproc_job(void *job_)
 	}
 }
 
-static int handle_worker_result(int sd, int events, void *arg)
+/* handles one parsed message from a worker. Returns TRUE if it was a check result */
+static int handle_worker_message(struct wproc_worker *wp, struct kvvec *kvv)
 {
 	wproc_object_job *oj = NULL;
-	char *buf, *error_reason = NULL;
+	struct wproc_job *job;
+	wproc_result wpres;
+	char *error_reason = NULL;
+	double runtime;
+	int is_check = FALSE;
+
+	memset(&wpres, 0, sizeof(wpres));
+	wpres.job_id = -1;
+	wpres.type = -1;
+	wpres.response = kvv;
+	parse_worker_result(&wpres, kvv);
+
+	job = get_job(wp, wpres.job_id);
+	if (!job) {
+		logit(NSLOG_RUNTIME_WARNING, TRUE, "wproc: Job with id '%d' doesn't exist on %s.\n",
+			  wpres.job_id, wp->name);
+		return FALSE;
+	}
+	if (wpres.type != job->type) {
+		logit(NSLOG_RUNTIME_WARNING, TRUE, "wproc: %s claims job %d is type %d, but we think it's type %d\n",
+			  wp->name, job->id, wpres.type, job->type);
+		return FALSE;
+	}
+	oj = (wproc_object_job *)job->arg;
+
+	/* keep track of how long this worker's jobs usually take */
+	runtime = tv_delta_f(&wpres.start, &wpres.stop);
+	if (runtime >= 0.0) {
+		wp->avg_runtime = wp->avg_runtime > 0.0 ? (wp->avg_runtime * 7 + runtime) / 8 : runtime;
+	}
+
+	/*
+	 * ETIME ("Timer expired") doesn't really happen
+	 * on any modern systems, so we reuse it to mean
+	 * "program timed out"
+	 */
+	if (wpres.error_code == ETIME) {
+		wpres.early_timeout = TRUE;
+	}
+	if (wpres.early_timeout) {
+		asprintf(&error_reason, "timed out after %.2fs", tv_delta_f(&wpres.start, &wpres.stop));
+	}
+	else if (WIFSIGNALED(wpres.wait_status)) {
+		asprintf(&error_reason, "died by signal %d%s after %.2f seconds",
+		         WTERMSIG(wpres.wait_status),
+		         WCOREDUMP(wpres.wait_status) ? " (core dumped)" : "",
+		         tv_delta_f(&wpres.start, &wpres.stop));
+	}
+	else if (job->type != WPJOB_CHECK && WEXITSTATUS(wpres.wait_status) != 0) {
+		asprintf(&error_reason, "is a non-check helper but exited with return code %d",
+		         WEXITSTATUS(wpres.wait_status));
+	}
+	if (error_reason) {
+		logit(NSLOG_RUNTIME_ERROR, TRUE, "wproc: %s job %d from worker %s %s",
+		      wpjob_type_name(job->type), job->id, wp->name, error_reason);
+#ifdef DEBUG
+		/* The log below could leak sensitive information, such as 
+			passwords, so only enable it if you really need it */
+		logit(NSLOG_RUNTIME_ERROR, TRUE, "wproc:   command: %s\n", job->command);
+#endif
+		if (job->type != WPJOB_CHECK && oj) {
+			logit(NSLOG_RUNTIME_ERROR, TRUE, "wproc:   host=%s; service=%s; contact=%s\n",
+			      oj->host_name ? oj->host_name : "(none)",
+			      oj->service_description ? oj->service_description : "(none)",
+			      oj->contact_name ? oj->contact_name : "(none)");
+		} else if (oj) {
+			struct check_result *cr = (struct check_result *)job->arg;
+			logit(NSLOG_RUNTIME_ERROR, TRUE, "wproc:   host=%s; service=%s;\n",
+			      cr->host_name, cr->service_description);
+		}
+		logit(NSLOG_RUNTIME_ERROR, TRUE, "wproc:   early_timeout=%d; exited_ok=%d; wait_status=%d; error_code=%d;\n",
+		      wpres.early_timeout, wpres.exited_ok, wpres.wait_status, wpres.error_code);
+		wproc_logdump_buffer(NSLOG_RUNTIME_ERROR, TRUE, "wproc:   stderr", wpres.outerr);
+		wproc_logdump_buffer(NSLOG_RUNTIME_ERROR, TRUE, "wproc:   stdout", wpres.outstd);
+	}
+	my_free(error_reason);
+
+	switch (job->type) {
+	case WPJOB_CHECK:
+		handle_worker_check(&wpres, wp, job);
+		is_check = TRUE;
+		break;
+	case WPJOB_NOTIFY:
+		if (wpres.early_timeout) {
+			if (oj->service_description) {
+				logit(NSLOG_RUNTIME_WARNING, TRUE, "Warning: Notifying contact '%s' of service '%s' on host '%s' by command '%s' timed out after %.2f seconds\n",
+					  oj->contact_name, oj->service_description,
+					  oj->host_name, job->command,
+					  tv2float(&wpres.runtime));
+			} else {
+				logit(NSLOG_RUNTIME_WARNING, TRUE, "Warning: Notifying contact '%s' of host '%s' by command '%s' timed out after %.2f seconds\n",
+					  oj->contact_name, oj->host_name,
+					  job->command, tv2float(&wpres.runtime));
+			}
+		}
+		break;
+	case WPJOB_OCSP:
+		if (wpres.early_timeout) {
+			logit(NSLOG_RUNTIME_WARNING, TRUE, "Warning: OCSP command '%s' for service '%s' on host '%s' timed out after %.2f seconds\n",
+				  job->command, oj->service_description, oj->host_name,
+				  tv2float(&wpres.runtime));
+		}
+		break;
+	case WPJOB_OCHP:
+		if (wpres.early_timeout) {
+			logit(NSLOG_RUNTIME_WARNING, TRUE, "Warning: OCHP command '%s' for host '%s' timed out after %.2f seconds\n",
+				  job->command, oj->host_name, tv2float(&wpres.runtime));
+		}
+		break;
+	case WPJOB_GLOBAL_SVC_EVTHANDLER:
+		if (wpres.early_timeout) {
+			logit(NSLOG_EVENT_HANDLER | NSLOG_RUNTIME_WARNING, TRUE,
+				  "Warning: Global service event handler command '%s' timed out after %.2f seconds\n",
+				  job->command, tv2float(&wpres.runtime));
+		}
+		break;
+	case WPJOB_SVC_EVTHANDLER:
+		if (wpres.early_timeout) {
+			logit(NSLOG_EVENT_HANDLER | NSLOG_RUNTIME_WARNING, TRUE,
+				  "Warning: Service event handler command '%s' timed out after %.2f seconds\n",
+				  job->command, tv2float(&wpres.runtime));
+		}
+		break;
+	case WPJOB_GLOBAL_HOST_EVTHANDLER:
+		if (wpres.early_timeout) {
+			logit(NSLOG_EVENT_HANDLER | NSLOG_RUNTIME_WARNING, TRUE,
+				  "Warning: Global host event handler command '%s' timed out after %.2f seconds\n",
+				  job->command, tv2float(&wpres.runtime));
+		}
+		break;
+	case WPJOB_HOST_EVTHANDLER:
+		if (wpres.early_timeout) {
+			logit(NSLOG_EVENT_HANDLER | NSLOG_RUNTIME_WARNING, TRUE,
+				  "Warning: Host event handler command '%s' timed out after %.2f seconds\n",
+				  job->command, tv2float(&wpres.runtime));
+		}
+		break;
+
+	case WPJOB_CALLBACK:
+		run_job_callback(job, &wpres, 0);
+		break;
+
+	case WPJOB_HOST_PERFDATA:
+	case WPJOB_SVC_PERFDATA:
+		/* these require nothing special */
+		break;
+
+	default:
+		logit(NSLOG_RUNTIME_WARNING, TRUE, "Worker %ld: Unknown jobtype: %d\n", (long)wp->pid, job->type);
+		break;
+	}
+	destroy_job(job);
+
+	return is_check;
+}
+
+void wproc_handle_results(void)
+{
+	struct wproc_worker *wp;
+	struct timeval start, stop;
+	unsigned int i, checks = 0;
 	unsigned long size;
+	char *buf;
+	double elapsed;
+
+	if (wproc_batch.busy || !wproc_batch.pending)
+		return;
+	wproc_batch.busy = TRUE;
+	gettimeofday(&start, NULL);
+
+	wproc_batch.len = 0;
+	for (wp = wproc_batch.pending; wp; wp = wp->next_pending) {
+		wp->pending = FALSE;
+		while ((buf = worker_ioc2msg(wp->ioc, &size, 0))) {
+			struct kvvec *kvv;
+
+			/* log messages are handled first */
+			if (size > 5 && !memcmp(buf, "log=", 4)) {
+				logit(NSLOG_INFO_MESSAGE, TRUE, "wproc: %s: %s\n", wp->name, buf + 4);
+				continue;
+			}
+
+			/* for everything else we need to actually parse */
+			if (!(kvv = wproc_batch_add(wp))) {
+				logit(NSLOG_RUNTIME_ERROR, TRUE, "wproc: Failed to allocate memory for worker results\n");
+				break;
+			}
+			if (buf2kvvec_prealloc(kvv, buf, size, '=', '\0', KVVEC_ASSIGN) <= 0) {
+				logit(NSLOG_RUNTIME_ERROR, TRUE,
+					  "wproc: Failed to parse key/value vector from worker response with len %lu. First kv=%s",
+					  size, buf ? buf : "(NULL)");
+				continue;
+			}
+			wproc_batch.len++;
+		}
+	}
+	wproc_batch.pending = wproc_batch.pending_tail = NULL;
+
+	wproc_batch.check_time = 0.0;
+	for (i = 0; i < wproc_batch.len; i++) {
+		if (handle_worker_message(wproc_batch.entries[i].wp, &wproc_batch.entries[i].kvv))
+			checks++;
+	}
+
+	gettimeofday(&stop, NULL);
+	if (wproc_batch.len) {
+		wproc_result_stats.batches++;
+		histogram_add(&wproc_result_stats.batch_size, wproc_batch.len);
+		elapsed = tv_delta_f(&start, &stop) - wproc_batch.check_time;
+		if (elapsed < 0.0)
+			elapsed = 0.0;
+		histogram_add(&loop_stats.result_overhead, (uint64_t)(elapsed * 1000000 / wproc_batch.len));
+	}
+	if (checks) {
+		wproc_result_stats.queue_depth = checks;
+		if (checks > wproc_result_stats.max_queue_depth)
+			wproc_result_stats.max_queue_depth = checks;
+	}
+
+	wproc_batch.busy = FALSE;
+}
+
+static int handle_worker_result(int sd, int events, void *arg)
+{
 	int ret;
-	static struct kvvec kvv = KVVEC_INITIALIZER;
 	struct wproc_worker *wp = (struct wproc_worker *)arg;
 
 	if((ret = iocache_capacity(wp->ioc)) < 0) {
@@ -737,6 +1313,9 @@ static int handle_worker_result(int sd, int events, void *arg)
 			  wp->name, ret, strerror(errno));
 		return 0;
 	} else if (ret == 0) {
+		/* whatever it sent before it went away is still good */
+		wproc_handle_results();
+
 		logit(NSLOG_INFO_MESSAGE, TRUE, "wproc: Socket to worker %s broken, removing", wp->name);
 		wproc_num_workers_online--;
 		iobroker_unregister(nagios_iobs, sd);
@@ -752,163 +1331,15 @@ static int handle_worker_result(int sd, int events, void *arg)
 		wproc_destroy(wp, WPROC_FORCE);
 		return 0;
 	}
-	while ((buf = worker_ioc2msg(wp->ioc, &size, 0))) {
-		struct wproc_job *job;
-		wproc_result wpres;
-
-		/* log messages are handled first */
-		if (size > 5 && !memcmp(buf, "log=", 4)) {
-			logit(NSLOG_INFO_MESSAGE, TRUE, "wproc: %s: %s\n", wp->name, buf + 4);
-			continue;
-		}
-
-		/* for everything else we need to actually parse */
-		if (buf2kvvec_prealloc(&kvv, buf, size, '=', '\0', KVVEC_ASSIGN) <= 0) {
-			logit(NSLOG_RUNTIME_ERROR, TRUE,
-				  "wproc: Failed to parse key/value vector from worker response with len %lu. First kv=%s",
-				  size, buf ? buf : "(NULL)");
-			continue;
-		}
 
-		memset(&wpres, 0, sizeof(wpres));
-		wpres.job_id = -1;
-		wpres.type = -1;
-		wpres.response = &kvv;
-		parse_worker_result(&wpres, &kvv);
-
-		job = get_job(wp, wpres.job_id);
-		if (!job) {
-			logit(NSLOG_RUNTIME_WARNING, TRUE, "wproc: Job with id '%d' doesn't exist on %s.\n",
-				  wpres.job_id, wp->name);
-			continue;
-		}
-		if (wpres.type != job->type) {
-			logit(NSLOG_RUNTIME_WARNING, TRUE, "wproc: %s claims job %d is type %d, but we think it's type %d\n",
-				  wp->name, job->id, wpres.type, job->type);
-			break;
-		}
-		oj = (wproc_object_job *)job->arg;
-
-		/*
-		 * ETIME ("Timer expired") doesn't really happen
-		 * on any modern systems, so we reuse it to mean
-		 * "program timed out"
-		 */
-		if (wpres.error_code == ETIME) {
-			wpres.early_timeout = TRUE;
-		}
-		if (wpres.early_timeout) {
-			asprintf(&error_reason, "timed out after %.2fs", tv_delta_f(&wpres.start, &wpres.stop));
-		}
-		else if (WIFSIGNALED(wpres.wait_status)) {
-			asprintf(&error_reason, "died by signal %d%s after %.2f seconds",
-			         WTERMSIG(wpres.wait_status),
-			         WCOREDUMP(wpres.wait_status) ? " (core dumped)" : "",
-			         tv_delta_f(&wpres.start, &wpres.stop));
-		}
-		else if (job->type != WPJOB_CHECK && WEXITSTATUS(wpres.wait_status) != 0) {
-			asprintf(&error_reason, "is a non-check helper but exited with return code %d",
-			         WEXITSTATUS(wpres.wait_status));
-		}
-		if (error_reason) {
-			logit(NSLOG_RUNTIME_ERROR, TRUE, "wproc: %s job %d from worker %s %s",
-			      wpjob_type_name(job->type), job->id, wp->name, error_reason);
-#ifdef DEBUG
-			/* The log below could leak sensitive information, such as 
-				passwords, so only enable it if you really need it */
-			logit(NSLOG_RUNTIME_ERROR, TRUE, "wproc:   command: %s\n", job->command);
-#endif
-			if (job->type != WPJOB_CHECK && oj) {
-				logit(NSLOG_RUNTIME_ERROR, TRUE, "wproc:   host=%s; service=%s; contact=%s\n",
-				      oj->host_name ? oj->host_name : "(none)",
-				      oj->service_description ? oj->service_description : "(none)",
-				      oj->contact_name ? oj->contact_name : "(none)");
-			} else if (oj) {
-				struct check_result *cr = (struct check_result *)job->arg;
-				logit(NSLOG_RUNTIME_ERROR, TRUE, "wproc:   host=%s; service=%s;\n",
-				      cr->host_name, cr->service_description);
-			}
-			logit(NSLOG_RUNTIME_ERROR, TRUE, "wproc:   early_timeout=%d; exited_ok=%d; wait_status=%d; error_code=%d;\n",
-			      wpres.early_timeout, wpres.exited_ok, wpres.wait_status, wpres.error_code);
-			wproc_logdump_buffer(NSLOG_RUNTIME_ERROR, TRUE, "wproc:   stderr", wpres.outerr);
-			wproc_logdump_buffer(NSLOG_RUNTIME_ERROR, TRUE, "wproc:   stdout", wpres.outstd);
-		}
-		my_free(error_reason);
-
-		switch (job->type) {
-		case WPJOB_CHECK:
-			ret = handle_worker_check(&wpres, wp, job);
-			break;
-		case WPJOB_NOTIFY:
-			if (wpres.early_timeout) {
-				if (oj->service_description) {
-					logit(NSLOG_RUNTIME_WARNING, TRUE, "Warning: Notifying contact '%s' of service '%s' on host '%s' by command '%s' timed out after %.2f seconds\n",
-						  oj->contact_name, oj->service_description,
-						  oj->host_name, job->command,
-						  tv2float(&wpres.runtime));
-				} else {
-					logit(NSLOG_RUNTIME_WARNING, TRUE, "Warning: Notifying contact '%s' of host '%s' by command '%s' timed out after %.2f seconds\n",
-						  oj->contact_name, oj->host_name,
-						  job->command, tv2float(&wpres.runtime));
-				}
-			}
-			break;
-		case WPJOB_OCSP:
-			if (wpres.early_timeout) {
-				logit(NSLOG_RUNTIME_WARNING, TRUE, "Warning: OCSP command '%s' for service '%s' on host '%s' timed out after %.2f seconds\n",
-					  job->command, oj->service_description, oj->host_name,
-					  tv2float(&wpres.runtime));
-			}
-			break;
-		case WPJOB_OCHP:
-			if (wpres.early_timeout) {
-				logit(NSLOG_RUNTIME_WARNING, TRUE, "Warning: OCHP command '%s' for host '%s' timed out after %.2f seconds\n",
-					  job->command, oj->host_name, tv2float(&wpres.runtime));
-			}
-			break;
-		case WPJOB_GLOBAL_SVC_EVTHANDLER:
-			if (wpres.early_timeout) {
-				logit(NSLOG_EVENT_HANDLER | NSLOG_RUNTIME_WARNING, TRUE,
-					  "Warning: Global service event handler command '%s' timed out after %.2f seconds\n",
-					  job->command, tv2float(&wpres.runtime));
-			}
-			break;
-		case WPJOB_SVC_EVTHANDLER:
-			if (wpres.early_timeout) {
-				logit(NSLOG_EVENT_HANDLER | NSLOG_RUNTIME_WARNING, TRUE,
-					  "Warning: Service event handler command '%s' timed out after %.2f seconds\n",
-					  job->command, tv2float(&wpres.runtime));
-			}
-			break;
-		case WPJOB_GLOBAL_HOST_EVTHANDLER:
-			if (wpres.early_timeout) {
-				logit(NSLOG_EVENT_HANDLER | NSLOG_RUNTIME_WARNING, TRUE,
-					  "Warning: Global host event handler command '%s' timed out after %.2f seconds\n",
-					  job->command, tv2float(&wpres.runtime));
-			}
-			break;
-		case WPJOB_HOST_EVTHANDLER:
-			if (wpres.early_timeout) {
-				logit(NSLOG_EVENT_HANDLER | NSLOG_RUNTIME_WARNING, TRUE,
-					  "Warning: Host event handler command '%s' timed out after %.2f seconds\n",
-					  job->command, tv2float(&wpres.runtime));
-			}
-			break;
-
-		case WPJOB_CALLBACK:
-			run_job_callback(job, &wpres, 0);
-			break;
-
-		case WPJOB_HOST_PERFDATA:
-		case WPJOB_SVC_PERFDATA:
-			/* these require nothing special */
-			break;
-
-		default:
-			logit(NSLOG_RUNTIME_WARNING, TRUE, "Worker %ld: Unknown jobtype: %d\n", (long)wp->pid, job->type);
-			break;
-		}
-		destroy_job(job);
+	if (!wp->pending) {
+		wp->pending = TRUE;
+		wp->next_pending = NULL;
+		if (wproc_batch.pending_tail)
+			wproc_batch.pending_tail->next_pending = wp;
+		else
+			wproc_batch.pending = wp;
+		wproc_batch.pending_tail = wp;
 	}
 
 	return 0;
@@ -1015,7 +1446,8 @@ static int wproc_query_handler(int sd, char *buf, unsigned int len)
 	if (!*buf || !strcmp(buf, "help")) {
 		nsock_printf_nul(sd, "Control worker processes.\n"
 			"Valid commands:\n"
-			"  wpstats              Print general job information\n"
+			"  wpstats              Print general job information and load of each worker\n"
+			"  wpdispatch           Print how jobs have been dispatched to workers\n"
 			"  register <options>   Register a new worker\n"
 			"                       <options> can be name, pid, max_jobs and/or plugin.\n"
 			"                       There can be many plugin args.");
@@ -1035,12 +1467,20 @@ static int wproc_query_handler(int sd, char *buf, unsigned int len)
 
 		for (i = 0; i < workers.len; i++) {
 			struct wproc_worker *wp = workers.wps[i];
-			nsock_printf(sd, "name=%s;pid=%ld;jobs_running=%u;jobs_started=%u\n",
+			nsock_printf(sd, "name=%s;pid=%ld;jobs_running=%u;jobs_started=%u;max_jobs=%d;avg_runtime=%.3f;backlog=%u;jobs_rerouted=%u\n",
 					wp->name, (long)wp->pid,
-					wp->jobs_running, wp->jobs_started);
+					wp->jobs_running, wp->jobs_started,
+					wp->max_jobs, wp->avg_runtime,
+					wproc_backlog(wp), wp->jobs_rerouted);
 		}
 		return 0;
 	}
+	if (!strcmp(buf, "wpdispatch")) {
+		nsock_printf(sd, "dispatched=%lu;rerouted=%lu;saturated=%lu;retried=%lu\n",
+				dispatch_stats.dispatched, dispatch_stats.rerouted,
+				dispatch_stats.saturated, dispatch_stats.retried);
+		return 0;
+	}
 
 	return 400;
 }
@@ -1136,6 +1576,7 @@ static int wproc_run_job(struct wproc_job *job, nagios_macros *mac)
 	int ret                    = OK;
 	int result                 = OK;
 	ssize_t written            = 0;
+	unsigned int attempts      = 0;
 
 	log_debug_info(DEBUGL_WORKERS, 1, "wproc_run_job()\n");
 
@@ -1149,19 +1590,7 @@ static int wproc_run_job(struct wproc_job *job, nagios_macros *mac)
 		return ERROR;
 	}
 
-	wp = job->wp;
-
-	/* job_id, type, command and timeout */
-	if (!kvvec_init(&kvv, 4)) {
-		return ERROR;
-	}
-
-	kvvec_addkv(&kvv, "job_id", (char *)mkstr("%d", job->id));
-	kvvec_addkv(&kvv, "type", (char *)mkstr("%d", job->type));
-	kvvec_addkv(&kvv, "command", job->command);
-	kvvec_addkv(&kvv, "timeout", (char *)mkstr("%u", job->timeout));
-
-	/* Add the macro environment variables */
+	/* Build the macro environment variables once for every worker we try */
 	if (mac != NULL) {
 
 		env_kvvp = macros_to_kvv(mac);
@@ -1172,32 +1601,63 @@ static int wproc_run_job(struct wproc_job *job, nagios_macros *mac)
 
 			if (env_kvvb == NULL) {
 				kvvec_destroy(env_kvvp, KVVEC_FREE_KEYS);
-			}
-			else {
-				/* no reason to call strlen("env") 
-				  when we know it's 3 characters */
-				kvvec_addkv_wlen(&kvv, "env", 3, env_kvvb->buf, env_kvvb->buflen);
+				env_kvvp = NULL;
 			}
 		}
 	}
 
-	kvvb = build_kvvec_buf(&kvv);
+	for (;;) {
 
-	/* ret = write(wp->sd, kvvb->buf, kvvb->bufsize); */
-	ret = nwrite(wp->sd, kvvb->buf, kvvb->bufsize, &written);
+		wp = job->wp;
 
-	if (ret != (int) kvvb->bufsize) {
+		/* job_id, type, command and timeout */
+		if (!kvvec_init(&kvv, 4)) {
+			result = ERROR;
+			break;
+		}
+
+		kvvec_addkv(&kvv, "job_id", (char *)mkstr("%d", job->id));
+		kvvec_addkv(&kvv, "type", (char *)mkstr("%d", job->type));
+		kvvec_addkv(&kvv, "command", job->command);
+		kvvec_addkv(&kvv, "timeout", (char *)mkstr("%u", job->timeout));
+		if (job->type == WPJOB_CHECK && num_coprocess_plugins && is_coprocess_command(job->command))
+			kvvec_addkv(&kvv, "coproc", "1");
+
+		if (env_kvvb != NULL) {
+			/* no reason to call strlen("env") 
+			  when we know it's 3 characters */
+			kvvec_addkv_wlen(&kvv, "env", 3, env_kvvb->buf, env_kvvb->buflen);
+		}
+
+		kvvb = build_kvvec_buf(&kvv);
+
+		/* ret = write(wp->sd, kvvb->buf, kvvb->bufsize); */
+		written = 0;
+		ret = nwrite(wp->sd, kvvb->buf, kvvb->bufsize, &written);
+
+		if (ret == (int) kvvb->bufsize) {
+			wp->jobs_running++;
+			wp->jobs_started++;
+			loadctl.jobs_running++;
+			break;
+		}
 
 		logit(NSLOG_RUNTIME_ERROR, TRUE, 
 			"wproc: '%s' seems to be choked. ret = %d; bufsize = %lu: written = %lu; errno = %d (%s)\n",
 			wp->name, ret, kvvb->bufsize, (long unsigned int) written, errno, strerror(errno));
-		destroy_job(job);
-		result = ERROR;
 
-	} else {
-		wp->jobs_running++;
-		wp->jobs_started++;
-		loadctl.jobs_running++;
+		free(kvvb->buf);
+		my_free(kvvb);
+
+		/* nothing reached the worker, so another one can have a go */
+		if (written || ++attempts > wproc_num_workers_online || !wproc_reroute_job(job)) {
+			destroy_job(job);
+			result = ERROR;
+			break;
+		}
+
+		logit(NSLOG_RUNTIME_WARNING, TRUE, "wproc: Moving job %d from '%s' to '%s'\n",
+			job->id, wp->name, job->wp->name);
 	}
 
 	if (env_kvvp != NULL) {
@@ -1209,8 +1669,10 @@ static int wproc_run_job(struct wproc_job *job, nagios_macros *mac)
 		free(env_kvvb);
 	}
 
-	free(kvvb->buf);
-	free(kvvb);
+	if (kvvb != NULL) {
+		free(kvvb->buf);
+		free(kvvb);
+	}
 
 	return result;
 }
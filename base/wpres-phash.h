@@ -45,6 +45,10 @@ enum {
 	WPRES_error_msg,
 	WPRES_error_code,
 	WPRES_runtime,
+	WPRES_output_short,
+	WPRES_output_long,
+	WPRES_output_perfdata,
+	WPRES_parse_time,
 	WPRES_ru_utime,
 	WPRES_ru_stime,
 	WPRES_ru_maxrss,
@@ -63,15 +67,15 @@ enum {
 	WPRES_ru_nivcsw,
 };
 #include <string.h> /* for strcmp() */
-#line 35 "wpres.gperf"
+#line 39 "wpres.gperf"
 struct wpres_key {
 	const char *name;
 	int code;
 };
 
-#define TOTAL_KEYWORDS 29
+#define TOTAL_KEYWORDS 33
 #define MIN_WORD_LENGTH 4
-#define MAX_WORD_LENGTH 11
+#define MAX_WORD_LENGTH 15
 #define MIN_HASH_VALUE 4
 #define MAX_HASH_VALUE 64
 /* maximum key range = 61, duplicates = 0 */
@@ -138,63 +142,71 @@ wpres_get_key (register const char *str, register size_t len)
 {
   static struct wpres_key wordlist[] =
     {
-#line 41 "wpres.gperf"
-      {"type", WPRES_type},
 #line 45 "wpres.gperf"
+      {"type", WPRES_type},
+#line 49 "wpres.gperf"
       {"start", WPRES_start},
-#line 48 "wpres.gperf"
-      {"outerr", WPRES_outerr},
 #line 52 "wpres.gperf"
+      {"outerr", WPRES_outerr},
+#line 56 "wpres.gperf"
       {"runtime", WPRES_runtime},
-#line 53 "wpres.gperf"
+#line 61 "wpres.gperf"
       {"ru_utime", WPRES_ru_utime},
-#line 46 "wpres.gperf"
+#line 50 "wpres.gperf"
       {"stop", WPRES_stop},
-#line 62 "wpres.gperf"
+#line 70 "wpres.gperf"
       {"ru_inblock", WPRES_ru_inblock},
-#line 47 "wpres.gperf"
+#line 51 "wpres.gperf"
       {"outstd", WPRES_outstd},
-#line 68 "wpres.gperf"
+#line 76 "wpres.gperf"
       {"ru_nivcsw", WPRES_ru_nivcsw},
-#line 54 "wpres.gperf"
+#line 62 "wpres.gperf"
       {"ru_stime", WPRES_ru_stime},
-#line 65 "wpres.gperf"
+#line 73 "wpres.gperf"
       {"ru_msgrcv", WPRES_ru_msgrcv},
-#line 66 "wpres.gperf"
+#line 60 "wpres.gperf"
+      {"parse_time", WPRES_parse_time},
+#line 74 "wpres.gperf"
       {"ru_nsignals", WPRES_ru_nsignals},
-#line 58 "wpres.gperf"
+#line 66 "wpres.gperf"
       {"ru_isrss", WPRES_ru_isrss},
-#line 64 "wpres.gperf"
+#line 72 "wpres.gperf"
       {"ru_msgsnd", WPRES_ru_msgsnd},
-#line 40 "wpres.gperf"
+#line 44 "wpres.gperf"
       {"job_id", WPRES_job_id},
-#line 57 "wpres.gperf"
+#line 65 "wpres.gperf"
       {"ru_idrss", WPRES_ru_idrss},
-#line 49 "wpres.gperf"
+#line 53 "wpres.gperf"
       {"exited_ok", WPRES_exited_ok},
-#line 44 "wpres.gperf"
+#line 48 "wpres.gperf"
       {"wait_status", WPRES_wait_status},
-#line 43 "wpres.gperf"
+#line 47 "wpres.gperf"
       {"timeout", WPRES_timeout},
-#line 56 "wpres.gperf"
+#line 64 "wpres.gperf"
       {"ru_ixrss", WPRES_ru_ixrss},
-#line 50 "wpres.gperf"
+#line 54 "wpres.gperf"
       {"error_msg", WPRES_error_msg},
-#line 63 "wpres.gperf"
+#line 71 "wpres.gperf"
       {"ru_oublock", WPRES_ru_oublock},
-#line 51 "wpres.gperf"
-      {"error_code", WPRES_error_code},
+#line 58 "wpres.gperf"
+      {"output_long", WPRES_output_long},
+#line 57 "wpres.gperf"
+      {"output_short", WPRES_output_short},
 #line 55 "wpres.gperf"
+      {"error_code", WPRES_error_code},
+#line 63 "wpres.gperf"
       {"ru_maxrss", WPRES_ru_maxrss},
-#line 61 "wpres.gperf"
-      {"ru_nswap", WPRES_ru_nswap},
 #line 59 "wpres.gperf"
+      {"output_perfdata", WPRES_output_perfdata},
+#line 69 "wpres.gperf"
+      {"ru_nswap", WPRES_ru_nswap},
+#line 67 "wpres.gperf"
       {"ru_minflt", WPRES_ru_minflt},
-#line 42 "wpres.gperf"
+#line 46 "wpres.gperf"
       {"command", WPRES_command},
-#line 67 "wpres.gperf"
+#line 75 "wpres.gperf"
       {"ru_nvcsw", WPRES_ru_nvcsw},
-#line 60 "wpres.gperf"
+#line 68 "wpres.gperf"
       {"ru_majflt", WPRES_ru_majflt}
     };
 
@@ -241,60 +253,72 @@ wpres_get_key (register const char *str, register size_t len)
               case 10:
                 resword = &wordlist[10];
                 goto compare;
-              case 12:
+              case 11:
                 resword = &wordlist[11];
                 goto compare;
-              case 14:
+              case 12:
                 resword = &wordlist[12];
                 goto compare;
-              case 15:
+              case 14:
                 resword = &wordlist[13];
                 goto compare;
-              case 17:
+              case 15:
                 resword = &wordlist[14];
                 goto compare;
-              case 19:
+              case 17:
                 resword = &wordlist[15];
                 goto compare;
-              case 20:
+              case 19:
                 resword = &wordlist[16];
                 goto compare;
-              case 22:
+              case 20:
                 resword = &wordlist[17];
                 goto compare;
-              case 23:
+              case 22:
                 resword = &wordlist[18];
                 goto compare;
-              case 24:
+              case 23:
                 resword = &wordlist[19];
                 goto compare;
-              case 25:
+              case 24:
                 resword = &wordlist[20];
                 goto compare;
-              case 26:
+              case 25:
                 resword = &wordlist[21];
                 goto compare;
-              case 29:
+              case 26:
                 resword = &wordlist[22];
                 goto compare;
-              case 30:
+              case 27:
                 resword = &wordlist[23];
                 goto compare;
-              case 34:
+              case 28:
                 resword = &wordlist[24];
                 goto compare;
-              case 35:
+              case 29:
                 resword = &wordlist[25];
                 goto compare;
-              case 38:
+              case 30:
                 resword = &wordlist[26];
                 goto compare;
-              case 39:
+              case 31:
                 resword = &wordlist[27];
                 goto compare;
-              case 60:
+              case 34:
                 resword = &wordlist[28];
                 goto compare;
+              case 35:
+                resword = &wordlist[29];
+                goto compare;
+              case 38:
+                resword = &wordlist[30];
+                goto compare;
+              case 39:
+                resword = &wordlist[31];
+                goto compare;
+              case 60:
+                resword = &wordlist[32];
+                goto compare;
             }
           return 0;
         compare:
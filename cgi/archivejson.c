@@ -596,7 +596,7 @@ json_object *json_archive_host_availability(unsigned, char *,
 json_object *json_archive_service_availability(unsigned, char *, char *,
 		au_availability *);
 
-int main(void) {
+int main(int argc, char **argv) {
 	int result = OK;
 	time_t query_time;
 	archive_json_cgi_data	cgi_data;
@@ -605,6 +605,14 @@ int main(void) {
 	time_t last_archive_data_update = (time_t)0;
 	json_object_member *romp = NULL;
 
+	/* serve requests from a long-lived process, or hand them to one */
+	if(argc > 1 && !strcmp(argv[1], "--daemon")) {
+		if(json_cgi_serve(THISCGI, argv) == ERROR)
+			return ERROR;
+		}
+	else if(json_cgi_forward_request(THISCGI) == OK)
+		return OK;
+
 	/* The official time of the query */
 	time(&query_time);
 
@@ -617,7 +625,8 @@ int main(void) {
 			OUTPUT_FORMAT_VERSION);
 
 	/* Initialize shared configuration variables */                             
-	init_shared_cfg_vars(1);
+	if(json_cgi_preloaded() == FALSE)
+		init_shared_cfg_vars(1);
 
 	init_cgi_data(&cgi_data);
 
@@ -634,41 +643,44 @@ int main(void) {
 		return result;
 		}
 
-	/* reset internal variables */
-	reset_cgi_vars();
+	/* a daemon we were forked from has read everything already */
+	if(json_cgi_preloaded() == FALSE) {
+		/* reset internal variables */
+		reset_cgi_vars();
 
-	/* read the CGI configuration file */
-	result = read_cgi_config_file(get_cgi_config_location(), NULL);
-	if(result == ERROR) {
-		json_object_append_object(json_root, "result", 
-				json_result(query_time, THISCGI, 
-				svm_get_string_from_value(cgi_data.query, valid_queries), 
-				get_query_status(query_status, cgi_data.query),
-				(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
-				"Error: Could not open CGI configuration file '%s' for reading!", 
-				get_cgi_config_location()));
-		json_object_append_object(json_root, "data", 
-				json_help(archive_json_help));
-		json_object_print(json_root, 0, 1, cgi_data.strftime_format, 
-				cgi_data.format_options);
-		document_footer();
-		return ERROR;
-		}
-
-	/* read the main configuration file */
-	result = read_main_config_file(main_config_file);
-	if(result == ERROR) {
-		json_object_append_object(json_root, "result", 
-				json_result(query_time, THISCGI, 
-				svm_get_string_from_value(cgi_data.query, valid_queries), 
-				get_query_status(query_status, cgi_data.query),
-				(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
-				"Error: Could not open main configuration file '%s' for reading!",
-				main_config_file));
-		json_object_append_object(json_root, "data", 
-				json_help(archive_json_help));
-		document_footer();
-		return ERROR;
+		/* read the CGI configuration file */
+		result = read_cgi_config_file(get_cgi_config_location(), NULL);
+		if(result == ERROR) {
+			json_object_append_object(json_root, "result", 
+					json_result(query_time, THISCGI, 
+					svm_get_string_from_value(cgi_data.query, valid_queries), 
+					get_query_status(query_status, cgi_data.query),
+					(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
+					"Error: Could not open CGI configuration file '%s' for reading!", 
+					get_cgi_config_location()));
+			json_object_append_object(json_root, "data", 
+					json_help(archive_json_help));
+			json_object_print(json_root, 0, 1, cgi_data.strftime_format, 
+					cgi_data.format_options);
+			document_footer();
+			return ERROR;
+			}
+
+		/* read the main configuration file */
+		result = read_main_config_file(main_config_file);
+		if(result == ERROR) {
+			json_object_append_object(json_root, "result", 
+					json_result(query_time, THISCGI, 
+					svm_get_string_from_value(cgi_data.query, valid_queries), 
+					get_query_status(query_status, cgi_data.query),
+					(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
+					"Error: Could not open main configuration file '%s' for reading!",
+					main_config_file));
+			json_object_append_object(json_root, "data", 
+					json_help(archive_json_help));
+			document_footer();
+			return ERROR;
+			}
 		}
 
 	/* Set the number of backtracked archives if it wasn't specified by the 
@@ -693,36 +705,38 @@ int main(void) {
 			}
 		}
 
-	/* read all object configuration data */
-	result = read_all_object_configuration_data(main_config_file, 
-			READ_ALL_OBJECT_DATA);
-	if(result == ERROR) {
-		json_object_append_object(json_root, "result", 
-				json_result(query_time, THISCGI, 
-				svm_get_string_from_value(cgi_data.query, valid_queries), 
-				get_query_status(query_status, cgi_data.query),
-				(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
-				"Error: Could not read some or all object configuration data!"));
-		json_object_append_object(json_root, "data", 
-				json_help(archive_json_help));
-		document_footer();
-		return ERROR;
-		}
+	if(json_cgi_preloaded() == FALSE) {
+		/* read all object configuration data */
+		result = read_all_object_configuration_data(main_config_file, 
+				READ_ALL_OBJECT_DATA);
+		if(result == ERROR) {
+			json_object_append_object(json_root, "result", 
+					json_result(query_time, THISCGI, 
+					svm_get_string_from_value(cgi_data.query, valid_queries), 
+					get_query_status(query_status, cgi_data.query),
+					(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
+					"Error: Could not read some or all object configuration data!"));
+			json_object_append_object(json_root, "data", 
+					json_help(archive_json_help));
+			document_footer();
+			return ERROR;
+			}
 
-	/* read all status data */
-	result = read_all_status_data(status_file, READ_ALL_STATUS_DATA);
-	if(result == ERROR) {
-		json_object_append_object(json_root, "result", 
-				json_result(query_time, THISCGI, 
-				svm_get_string_from_value(cgi_data.query, valid_queries), 
-				get_query_status(query_status, cgi_data.query),
-				(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
-				"Error: Could not read host and service status information!"));
-		json_object_append_object(json_root, "data", 
-				json_help(archive_json_help));
+		/* read all status data */
+		result = read_all_status_data(status_file, READ_ALL_STATUS_DATA);
+		if(result == ERROR) {
+			json_object_append_object(json_root, "result", 
+					json_result(query_time, THISCGI, 
+					svm_get_string_from_value(cgi_data.query, valid_queries), 
+					get_query_status(query_status, cgi_data.query),
+					(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
+					"Error: Could not read host and service status information!"));
+			json_object_append_object(json_root, "data", 
+					json_help(archive_json_help));
 
-		document_footer();
-		return ERROR;
+			document_footer();
+			return ERROR;
+			}
 		}
 
 	/* validate arguments in URL */
@@ -769,7 +783,7 @@ int main(void) {
 	case ARCHIVE_QUERY_ALERTCOUNT:
 		read_archived_data(cgi_data.start_time, cgi_data.end_time, 
 				cgi_data.backtracked_archives, AU_OBJTYPE_ALL, 
-				AU_STATETYPE_ALL, AU_LOGTYPE_ALERT | AU_LOGTYPE_STATE, log,
+				AU_STATETYPE_ALL, AU_LOGTYPE_ALERT | AU_LOGTYPE_STATE, NULL, NULL, log,
 				&last_archive_data_update);
 		if(result != RESULT_OPTION_IGNORED) {
 			json_object_append_object(json_root, "result", 
@@ -797,7 +811,7 @@ int main(void) {
 	case ARCHIVE_QUERY_ALERTLIST:
 		read_archived_data(cgi_data.start_time, cgi_data.end_time, 
 				cgi_data.backtracked_archives, AU_OBJTYPE_ALL, 
-				AU_STATETYPE_ALL, AU_LOGTYPE_ALERT | AU_LOGTYPE_STATE, log,
+				AU_STATETYPE_ALL, AU_LOGTYPE_ALERT | AU_LOGTYPE_STATE, NULL, NULL, log,
 				&last_archive_data_update);
 		if(result != RESULT_OPTION_IGNORED) {
 			json_object_append_object(json_root, "result", 
@@ -825,7 +839,7 @@ int main(void) {
 	case ARCHIVE_QUERY_NOTIFICATIONCOUNT:
 		read_archived_data(cgi_data.start_time, cgi_data.end_time, 
 				cgi_data.backtracked_archives, AU_OBJTYPE_ALL, 
-				AU_STATETYPE_ALL, AU_LOGTYPE_NOTIFICATION, log,
+				AU_STATETYPE_ALL, AU_LOGTYPE_NOTIFICATION, NULL, NULL, log,
 				&last_archive_data_update);
 		if(result != RESULT_OPTION_IGNORED) {
 			json_object_append_object(json_root, "result", 
@@ -855,7 +869,7 @@ int main(void) {
 	case ARCHIVE_QUERY_NOTIFICATIONLIST:
 		read_archived_data(cgi_data.start_time, cgi_data.end_time, 
 				cgi_data.backtracked_archives, AU_OBJTYPE_ALL, 
-				AU_STATETYPE_ALL, AU_LOGTYPE_NOTIFICATION, log,
+				AU_STATETYPE_ALL, AU_LOGTYPE_NOTIFICATION, NULL, NULL, log,
 				&last_archive_data_update);
 		if(result != RESULT_OPTION_IGNORED) {
 			json_object_append_object(json_root, "result", 
@@ -885,7 +899,10 @@ int main(void) {
 	case ARCHIVE_QUERY_STATECHANGELIST:
 		read_archived_data(cgi_data.start_time, cgi_data.end_time, 
 				cgi_data.backtracked_archives, cgi_data.object_type, 
-				AU_STATETYPE_ALL, (AU_LOGTYPE_ALERT | AU_LOGTYPE_STATE), log,
+				AU_STATETYPE_ALL, (AU_LOGTYPE_ALERT | AU_LOGTYPE_STATE), 
+				cgi_data.host_name, 
+				(cgi_data.object_type == AU_OBJTYPE_SERVICE ? 
+				cgi_data.service_description : NULL), log,
 				&last_archive_data_update);
 		if(result != RESULT_OPTION_IGNORED) {
 			json_object_append_object(json_root, "result", 
@@ -916,7 +933,7 @@ int main(void) {
 			read_archived_data(cgi_data.start_time, cgi_data.end_time, 
 					cgi_data.backtracked_archives, AU_OBJTYPE_HOST, 
 					cgi_data.state_types, (AU_LOGTYPE_NAGIOS | AU_LOGTYPE_ALERT 
-					| AU_LOGTYPE_STATE | AU_LOGTYPE_DOWNTIME), log,
+					| AU_LOGTYPE_STATE | AU_LOGTYPE_DOWNTIME), NULL, NULL, log,
 					&last_archive_data_update);
 			break;
 		case AU_OBJTYPE_SERVICE:
@@ -924,7 +941,7 @@ int main(void) {
 			read_archived_data(cgi_data.start_time, cgi_data.end_time, 
 					cgi_data.backtracked_archives, AU_OBJTYPE_SERVICE, 
 					cgi_data.state_types, (AU_LOGTYPE_NAGIOS | AU_LOGTYPE_ALERT 
-					| AU_LOGTYPE_STATE | AU_LOGTYPE_DOWNTIME), log,
+					| AU_LOGTYPE_STATE | AU_LOGTYPE_DOWNTIME), NULL, NULL, log,
 					&last_archive_data_update);
 			break;
 		}
@@ -973,7 +990,8 @@ int main(void) {
 	free_cgi_data( &cgi_data);
 	json_free_object(json_root, 1);
 	au_free_log(log);
-	free_memory();
+	if(json_cgi_preloaded() == FALSE)
+		free_memory();
 
 	return OK;
 	}
@@ -111,7 +111,8 @@ const string_value_mapping svm_au_notification_types[] = {
 	};
 
 /* Function prototypes */
-int read_log_file(char *, unsigned, unsigned, unsigned, au_log *);
+int read_log_file(char *, unsigned, unsigned, unsigned, const char *, 
+		const char *, au_log *);
 int au_add_nagios_log(au_log *, time_t, int, char *);
 void au_free_nagios_log(au_log_nagios *);
 int parse_states_and_alerts(char *, time_t, int, unsigned, unsigned, au_log *);
@@ -223,7 +224,9 @@ void au_free_log(au_log *log) {
 /* reads log files for archived data */
 int read_archived_data(time_t start_time, time_t end_time, 
 		int backtrack_archives, unsigned obj_types, unsigned state_types, 
-		unsigned log_types, au_log *log, time_t *last_archive_data_update) {
+		unsigned log_types, const char *host_name, 
+		const char *service_description, au_log *log, 
+		time_t *last_archive_data_update) {
 
 	char filename[MAX_FILENAME_LENGTH];
 	int oldest_archive = 0;
@@ -279,7 +282,7 @@ int read_archived_data(time_t start_time, time_t end_time,
 
 			/* scan the log file for archived state data */
 			if(read_log_file(filename, obj_types, state_types, log_types, 
-					log) == 0) {
+					host_name, service_description, log) == 0) {
 				return 0;	/* Memory allocation error */
 				}
 			}
@@ -315,19 +318,33 @@ int read_archived_data(time_t start_time, time_t end_time,
 	return 1;
 	}
 
-/* grabs archives state data from a log file */
+/* grabs archives state data from a log file, optionally only for one host 
+	or service */
 int read_log_file(char *filename, unsigned obj_types, unsigned state_types, 
-		unsigned log_types, au_log *log) {
+		unsigned log_types, const char *host_name, 
+		const char *service_description, au_log *log) {
 	char *input = NULL;
 	char *input2 = NULL;
 	char *temp_buffer = NULL;
 	time_t time_stamp;
-	mmapfile *thefile = NULL;
+	logindex_reader *thefile = NULL;
+	unsigned index_types = LOGIDX_PROGRAM;
 	int	retval = 1;
 
-	if((thefile = mmap_fopen(filename)) == NULL) {
+	/* program starts and stops are always needed */
+	if(log_types & AU_LOGTYPE_ALERT) index_types |= LOGIDX_ALERT;
+	if(log_types & AU_LOGTYPE_STATE) index_types |= LOGIDX_STATE;
+	if(log_types & AU_LOGTYPE_DOWNTIME) index_types |= LOGIDX_DOWNTIME;
+	if(log_types & AU_LOGTYPE_NOTIFICATION) index_types |= LOGIDX_NOTIFICATION;
+	if(obj_types & AU_OBJTYPE_HOST) index_types |= LOGIDX_HOST;
+	if(obj_types & AU_OBJTYPE_SERVICE) index_types |= LOGIDX_SERVICE;
+
+	if((thefile = logindex_reader_open(filename, index_types)) == NULL) {
 		return 1;
 		}
+	if(NULL != host_name) {
+		logindex_reader_want(thefile, host_name, service_description);
+		}
 
 	while(1) {
 
@@ -338,7 +355,7 @@ int read_log_file(char *filename, unsigned obj_types, unsigned state_types,
 		input2 = NULL;
 
 		/* read the next line */
-		if((input = mmap_fgets(thefile)) == NULL) break;
+		if((input = logindex_reader_gets(thefile)) == NULL) break;
 
 		strip(input);
 
@@ -494,7 +511,7 @@ int read_log_file(char *filename, unsigned obj_types, unsigned state_types,
 	/* free memory and close the file */
 	free(input);
 	free(input2);
-	mmap_fclose(thefile);
+	logindex_reader_close(thefile);
 	return retval;
 	}
 
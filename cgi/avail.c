@@ -2986,13 +2986,20 @@ void scan_log_file_for_archived_state_data(char *filename) {
 	char *plugin_output = NULL;
 	char *temp_buffer = NULL;
 	time_t time_stamp;
-	mmapfile *thefile = NULL;
+	logindex_reader *thefile = NULL;
 	avail_subject *temp_subject = NULL;
 	int state_type = 0;
 
-	if ((thefile = mmap_fopen(filename)) == NULL)
+	if ((thefile = logindex_reader_open(filename, LOGIDX_PROGRAM | LOGIDX_ALERT | LOGIDX_STATE | LOGIDX_DOWNTIME)) == NULL)
 		return;
 
+	/* only the lines about our subjects (and host downtime of their hosts) are of interest */
+	for (temp_subject = subject_list; temp_subject != NULL; temp_subject = temp_subject->next) {
+		logindex_reader_want(thefile, temp_subject->host_name, temp_subject->service_description);
+		if (temp_subject->type == SERVICE_SUBJECT)
+			logindex_reader_want(thefile, temp_subject->host_name, NULL);
+		}
+
 	while(1) {
 
 		/* free memory */
@@ -3002,7 +3009,7 @@ void scan_log_file_for_archived_state_data(char *filename) {
 		input2 = NULL;
 
 		/* read the next line */
-		if ((input = mmap_fgets(thefile)) == NULL)
+		if ((input = logindex_reader_gets(thefile)) == NULL)
 			break;
 
 		strip(input);
@@ -3202,7 +3209,7 @@ void scan_log_file_for_archived_state_data(char *filename) {
 	/* free memory and close the file */
 	free(input);
 	free(input2);
-	mmap_fclose(thefile);
+	logindex_reader_close(thefile);
 
 	return;
 	}
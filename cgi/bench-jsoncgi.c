@@ -0,0 +1,298 @@
+/*
+ * Benchmark of statusjson.cgi with and without a --daemon to talk to.
+ *
+ * It generates an object cache and a status file with the given number
+ * of hosts and services per host, starts statusjson.cgi --daemon on
+ * them and then times requests three ways:
+ *   daemon  - the request sent straight to the daemon's socket
+ *   cgi     - statusjson.cgi run like a web server runs it, passing the
+ *             request on to the daemon
+ *   noproxy - statusjson.cgi handling the request itself, reading all
+ *             object and status data first, as it does without a daemon
+ * Every response is checked for its length header and a JSON body.
+ * Requests are 10ms apart, as from dashboards polling now and then,
+ * so one request doesn't pay for cleaning up after the one before.
+ *
+ * usage: bench-jsoncgi [hosts [services-per-host [requests]]]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../lib/histogram.h"
+
+static const char *queries[] = {
+	"query=hostcount",
+	"query=servicecount",
+	"query=hostlist",
+	"query=servicelist&hostname=h1",
+	"query=servicelist",
+	NULL
+	};
+
+static char dir[] = "/tmp/bench-jsoncgi.XXXXXX";
+
+
+static uint64_t tv_usec(struct timeval *start, struct timeval *stop) {
+	return (stop->tv_sec - start->tv_sec) * 1000000 + stop->tv_usec - start->tv_usec;
+	}
+
+
+static FILE *open_file(const char *name) {
+	char path[PATH_MAX];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	if((fp = fopen(path, "w")) == NULL) {
+		perror(path);
+		exit(1);
+		}
+	return fp;
+	}
+
+
+static void write_files(unsigned int hosts, unsigned int services) {
+	unsigned int h, s;
+	time_t now = time(NULL);
+	FILE *fp;
+
+	fp = open_file("objects.cache");
+	fprintf(fp, "define timeperiod {\n\ttimeperiod_name\t24x7\n\talias\t24x7\n");
+	fprintf(fp, "\tsunday\t00:00-24:00\n\tmonday\t00:00-24:00\n\ttuesday\t00:00-24:00\n\twednesday\t00:00-24:00\n");
+	fprintf(fp, "\tthursday\t00:00-24:00\n\tfriday\t00:00-24:00\n\tsaturday\t00:00-24:00\n\t}\n\n");
+	fprintf(fp, "define command {\n\tcommand_name\tok\n\tcommand_line\t/bin/true\n\t}\n\n");
+	fprintf(fp, "define contact {\n\tcontact_name\tbench\n\tservice_notification_period\t24x7\n\thost_notification_period\t24x7\n");
+	fprintf(fp, "\tservice_notification_commands\tok\n\thost_notification_commands\tok\n\t}\n\n");
+	for(h = 0; h < hosts; h++) {
+		fprintf(fp, "define host {\n\thost_name\th%u\n\taddress\t127.0.0.1\n\tcheck_period\t24x7\n\tcheck_command\tok\n", h);
+		fprintf(fp, "\tcontacts\tbench\n\tmax_check_attempts\t3\n\tnotification_period\t24x7\n\t}\n\n");
+		}
+	for(h = 0; h < hosts; h++) {
+		for(s = 0; s < services; s++) {
+			fprintf(fp, "define service {\n\thost_name\th%u\n\tservice_description\ts%u\n\tcheck_period\t24x7\n", h, s);
+			fprintf(fp, "\tcheck_command\tok\n\tcontacts\tbench\n\tmax_check_attempts\t3\n\tnotification_period\t24x7\n\t}\n\n");
+			}
+		}
+	fclose(fp);
+
+	fp = open_file("status.dat");
+	fprintf(fp, "info {\n\tcreated=%lu\n\tversion=bench\n\t}\n\n", (unsigned long)now);
+	fprintf(fp, "programstatus {\n\tnagios_pid=1\n\tprogram_start=%lu\n\t}\n\n", (unsigned long)now);
+	for(h = 0; h < hosts; h++) {
+		fprintf(fp, "hoststatus {\n\thost_name=h%u\n\thas_been_checked=1\n\tcurrent_state=0\n\tstate_type=1\n", h);
+		fprintf(fp, "\tlast_check=%lu\n\tplugin_output=OK - host h%u is up\n\t}\n\n", (unsigned long)now, h);
+		for(s = 0; s < services; s++) {
+			fprintf(fp, "servicestatus {\n\thost_name=h%u\n\tservice_description=s%u\n\thas_been_checked=1\n", h, s);
+			fprintf(fp, "\tcurrent_state=%u\n\tstate_type=1\n\tlast_check=%lu\n", (h + s) % 4 ? 0 : 2, (unsigned long)now);
+			fprintf(fp, "\tplugin_output=Service s%u on h%u is fine\n\tperformance_data=t=%u\n\t}\n\n", s, h, s);
+			}
+		}
+	fclose(fp);
+
+	fp = open_file("nagios.cfg");
+	fprintf(fp, "object_cache_file=%s/objects.cache\nstatus_file=%s/status.dat\n", dir, dir);
+	fclose(fp);
+
+	/* one configuration with the daemon and one without */
+	for(h = 0; h < 2; h++) {
+		fp = open_file(h ? "cgi.cfg" : "cgi-nodaemon.cfg");
+		fprintf(fp, "main_config_file=%s/nagios.cfg\nuse_authentication=1\n", dir);
+		fprintf(fp, "authorized_for_all_hosts=bench\nauthorized_for_all_services=bench\n");
+		if(h)
+			fprintf(fp, "json_cgi_socket_dir=%s\n", dir);
+		fclose(fp);
+		}
+	}
+
+
+static void set_request_env(const char *config, const char *query) {
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%s", dir, config);
+	setenv("NAGIOS_CGI_CONFIG", path, 1);
+	setenv("REQUEST_METHOD", "GET", 1);
+	setenv("QUERY_STRING", query, 1);
+	setenv("REMOTE_USER", "bench", 1);
+	}
+
+
+/* reads everything from fd, returning the number of bytes or -1 if it isn't a JSON response */
+static long read_response(int fd, int framed) {
+	char buf[65536], *p;
+	long total = 0, expected = -1;
+	ssize_t ret;
+	int found = 0, first = 1;
+
+	while((ret = read(fd, buf, sizeof(buf))) > 0) {
+		if(first && framed) {
+			expected = strtol(buf, &p, 10);
+			if(p == buf || p >= buf + ret || *p != '\n')
+				return -1;
+			total -= p + 1 - buf;
+			}
+		first = 0;
+		if(!found && memmem(buf, ret, "\"format_version\"", 16))
+			found = 1;
+		total += ret;
+		}
+	if(!found || (framed && total != expected))
+		return -1;
+	return total;
+	}
+
+
+/* sends one request straight to the daemon */
+static long request_daemon(const char *query) {
+	struct sockaddr_un addr;
+	char req[1024];
+	long ret;
+	int sd, len;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/statusjson.sock", dir);
+	if((sd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		return -1;
+	if(connect(sd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(sd);
+		return -1;
+		}
+
+	len = snprintf(req, sizeof(req), "REQUEST_METHOD=GET%cQUERY_STRING=%s%cREMOTE_USER=bench%c", 0, query, 0, 0);
+	if(write(sd, req, len) != len) {
+		close(sd);
+		return -1;
+		}
+	shutdown(sd, SHUT_WR);
+	ret = read_response(sd, 1);
+	close(sd);
+	return ret;
+	}
+
+
+/* runs the CGI the way a web server would */
+static long request_cgi(const char *cgi, const char *config, const char *query) {
+	int fds[2], status;
+	long ret;
+	pid_t pid;
+
+	if(pipe(fds) < 0)
+		return -1;
+	if((pid = fork()) == 0) {
+		close(fds[0]);
+		dup2(fds[1], STDOUT_FILENO);
+		set_request_env(config, query);
+		execl(cgi, cgi, (char *)NULL);
+		_exit(127);
+		}
+	close(fds[1]);
+	ret = read_response(fds[0], 0);
+	close(fds[0]);
+	waitpid(pid, &status, 0);
+	return pid > 0 && WIFEXITED(status) ? ret : -1;
+	}
+
+
+static void bench(const char *name, const char *cgi, const char *query, unsigned int num) {
+	struct timeval start, stop;
+	unsigned int i, failed = 0;
+	long bytes = 0, ret;
+	histogram h;
+
+	histogram_reset(&h);
+	for(i = 0; i < num; i++) {
+		usleep(10000);
+		gettimeofday(&start, NULL);
+		if(!strcmp(name, "daemon"))
+			ret = request_daemon(query);
+		else
+			ret = request_cgi(cgi, strcmp(name, "cgi") ? "cgi-nodaemon.cfg" : "cgi.cfg", query);
+		gettimeofday(&stop, NULL);
+		if(ret < 0) {
+			failed++;
+			continue;
+			}
+		bytes = ret;
+		histogram_add(&h, tv_usec(&start, &stop));
+		}
+
+	printf("%-30s %-8s %6u %10.2f %10.2f %10.2f %10ld %6u\n", query, name, num,
+	       histogram_percentile(&h, 50) / 1000.0, histogram_percentile(&h, 99) / 1000.0,
+	       h.max / 1000.0, bytes, failed);
+	}
+
+
+int main(int argc, char **argv) {
+	unsigned int hosts = 1000, services = 100, num = 100, i;
+	char cgi[PATH_MAX], path[PATH_MAX], sock[PATH_MAX];
+	struct timeval start, stop;
+	pid_t daemon;
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	if(argc > 1)
+		hosts = atoi(argv[1]);
+	if(argc > 2)
+		services = atoi(argv[2]);
+	if(argc > 3)
+		num = atoi(argv[3]);
+
+	snprintf(path, sizeof(path), "%s/statusjson.cgi", dirname(strdup(argv[0])));
+	if(!realpath(path, cgi)) {
+		printf("Can't find statusjson.cgi at %s\n", path);
+		return 1;
+		}
+	if(!mkdtemp(dir)) {
+		perror("mkdtemp");
+		return 1;
+		}
+
+	printf("Generating %u hosts with %u services each in %s\n", hosts, services, dir);
+	write_files(hosts, services);
+
+	gettimeofday(&start, NULL);
+	if((daemon = fork()) == 0) {
+		set_request_env("cgi.cfg", "");
+		unsetenv("REQUEST_METHOD");
+		execl(cgi, cgi, "--daemon", (char *)NULL);
+		_exit(127);
+		}
+	snprintf(sock, sizeof(sock), "%s/statusjson.sock", dir);
+	while(request_daemon(queries[0]) < 0) {
+		if(waitpid(daemon, NULL, WNOHANG) != 0) {
+			printf("The daemon failed to start\n");
+			return 1;
+			}
+		usleep(10000);
+		}
+	gettimeofday(&stop, NULL);
+	printf("The daemon was ready after %.3f s\n\n", tv_usec(&start, &stop) / 1000000.0);
+
+	printf("%-30s %-8s %6s %10s %10s %10s %10s %6s\n", "query", "path", "reqs",
+	       "p50 ms", "p99 ms", "max ms", "bytes", "failed");
+	for(i = 0; queries[i]; i++) {
+		bench("daemon", cgi, queries[i], num);
+		bench("cgi", cgi, queries[i], num);
+		bench("noproxy", cgi, queries[i], num < 5 ? num : 5);
+		}
+
+	kill(daemon, SIGTERM);
+	waitpid(daemon, NULL, 0);
+	for(i = 0; i < 5; i++) {
+		const char *files[] = { "objects.cache", "status.dat", "nagios.cfg", "cgi.cfg", "cgi-nodaemon.cfg" };
+		snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+		unlink(path);
+		}
+	unlink(sock);
+	rmdir(dir);
+
+	return 0;
+	}
@@ -58,6 +58,8 @@ char            *notes_url_target = NULL;
 char            *action_url_target = NULL;
 
 char            *ping_syntax = NULL;
+char            *json_cgi_socket_dir = NULL;
+char            *json_cgi_client_user = NULL;
 
 char            nagios_process_info[MAX_INPUT_BUFFER] = "";
 int             nagios_process_state = STATE_OK;
@@ -223,6 +225,8 @@ void reset_cgi_vars(void) {
 	statuswrl_include = NULL;
 
 	ping_syntax = NULL;
+	json_cgi_socket_dir = NULL;
+	json_cgi_client_user = NULL;
 
 	return;
 	}
@@ -248,6 +252,8 @@ void free_memory(void) {
 	free(statusmap_background_image);
 	free(statuswrl_include);
 	free(ping_syntax);
+	free(json_cgi_socket_dir);
+	free(json_cgi_client_user);
 
 	return;
 	}
@@ -409,6 +415,12 @@ int read_cgi_config_file(const char *filename, read_config_callback callback) {
 		else if(!strcmp(var, "ping_syntax"))
 			ping_syntax = strdup(val);
 
+		else if(!strcmp(var, "json_cgi_socket_dir"))
+			json_cgi_socket_dir = strdup(val);
+
+		else if(!strcmp(var, "json_cgi_client_user"))
+			json_cgi_client_user = strdup(val);
+
 		else if(!strcmp(var, "action_url_target"))
 			action_url_target = strdup(val);
 
@@ -511,6 +523,11 @@ int read_main_config_file(const char *filename) {
 			temp_buffer = strtok(NULL, "\x0");
 			status_file = nspath_absolute(temp_buffer, config_file_dir);
 			}
+		else if(strstr(input, "binary_status_file=") == input) {
+			temp_buffer = strtok(input, "=");
+			temp_buffer = strtok(NULL, "\x0");
+			binary_status_file = nspath_absolute(temp_buffer, config_file_dir);
+			}
 
 		else if(strstr(input, "log_archive_path=") == input) {
 			temp_buffer = strtok(input, "=");
@@ -27,16 +27,58 @@
 #include "../include/objects.h"
 #include "../include/statusdata.h"
 #include "../include/comments.h"
+#include "../include/downtime.h"
 
 #include "../include/cgiutils.h"
 #include "../include/getcgi.h"
 #include "../include/cgiauth.h"
 #include "../include/jsonutils.h"
+#include "../xdata/xsdbinary.h"
 
 /* Multiplier to increment the buffer in json_escape_string() to avoid frequent
 	repeated reallocations */
 #define BUF_REALLOC_MULTIPLIER 16
 
+/* Limits for persistent mode */
+#define JSON_CGI_MAX_REQUEST		65536
+#define JSON_CGI_MAX_CHILDREN		32
+#define JSON_CGI_REQUEST_TIMEOUT	60
+
+extern char main_config_file[MAX_FILENAME_LENGTH];
+extern char *status_file;
+extern char *binary_status_file;
+extern char *object_cache_file;
+extern char *json_cgi_socket_dir;
+extern char *json_cgi_client_user;
+extern int program_status_has_been_read;
+extern int host_status_has_been_read;
+extern int service_status_has_been_read;
+
+/* The environment variables a request is made of */
+static const char *json_cgi_env[] = {
+	"REQUEST_METHOD",
+	"QUERY_STRING",
+	"REMOTE_USER",
+	"SSL_CLIENT_S_DN_CN",
+	"HTTP_ACCEPT_LANGUAGE",
+	"HTTP_COOKIE",
+	NULL
+	};
+
+/* What a file looked like when we last read it */
+struct json_cgi_stamp {
+	time_t mtime;
+	ino_t ino;
+	off_t size;
+	unsigned long long generation;
+	};
+
+static int json_cgi_preloaded_data = FALSE;
+static int json_cgi_client = -1;
+static time_t json_cgi_status_time = (time_t)0;
+static struct json_cgi_stamp json_cgi_config_stamps[3];
+static struct json_cgi_stamp json_cgi_status_stamp;
+
 const char *result_types[] = {
 	"Success",
 	"Unable to Allocate Memory",
@@ -1481,3 +1523,521 @@ char *json_escape_string(const char *src, const json_escape *escapes) {
 
 	return dest;
 	}
+
+
+
+/* Get the services on a host, in the order they appear in service_list.
+	The host's own list has them the other way round. The caller frees
+	the array. */
+service **json_host_services(host *temp_host, int *count) {
+
+	servicesmember *temp_servicesmember;
+	service **services;
+	int x = 0;
+
+	*count = 0;
+	for(temp_servicesmember = temp_host->services; temp_servicesmember != NULL;
+			temp_servicesmember = temp_servicesmember->next) {
+		x++;
+		}
+	if(x == 0) {
+		return NULL;
+		}
+	if((services = malloc(x * sizeof(service *))) == NULL) {
+		return NULL;
+		}
+
+	*count = x;
+	for(temp_servicesmember = temp_host->services; temp_servicesmember != NULL;
+			temp_servicesmember = temp_servicesmember->next) {
+		services[--x] = temp_servicesmember->service_ptr;
+		}
+
+	return services;
+	}
+
+
+
+/******************************************************************/
+/************************ PERSISTENT MODE *************************/
+/******************************************************************/
+
+/*
+ * A JSON CGI started with --daemon reads the object configuration and
+ * status data once and then serves requests passed to it over a unix
+ * socket in json_cgi_socket_dir. Every request is handled by a forked
+ * child, which works on its own copy of the data and just exits when it
+ * is done. The status data is read again when Nagios has updated it,
+ * and the daemon starts itself afresh when the configuration or the
+ * object cache changes.
+ *
+ * A CGI run by the web server passes GET requests on to the daemon if
+ * one is listening and copies the response back. Otherwise it handles
+ * the request itself, just like it always did.
+ *
+ * The daemon trusts the REMOTE_USER it is sent, so it only takes
+ * requests from json_cgi_client_user (the user it runs as, unless set),
+ * as reported by the kernel for the connecting process. A response is
+ * its length in decimal and a newline, followed by that many bytes.
+ * Anything shorter means the daemon failed, and the CGI then handles
+ * the request itself.
+ */
+
+static char *json_cgi_socket_path(const char *cgi_name) {
+	char *path = NULL;
+	const char *ext;
+	int len;
+
+	if(json_cgi_socket_dir == NULL)
+		return NULL;
+
+	ext = strrchr(cgi_name, '.');
+	len = ext ? (int)(ext - cgi_name) : (int)strlen(cgi_name);
+	if(asprintf(&path, "%s/%.*s.sock", json_cgi_socket_dir, len, cgi_name) < 0)
+		return NULL;
+
+	return path;
+	}
+
+
+static int json_cgi_connect(const char *path, struct sockaddr_un *addr) {
+
+	if(path == NULL || strlen(path) >= sizeof(addr->sun_path))
+		return -1;
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	strcpy(addr->sun_path, path);
+
+	return socket(AF_UNIX, SOCK_STREAM, 0);
+	}
+
+
+static int json_cgi_write_all(int fd, const char *buf, size_t len) {
+	ssize_t ret;
+
+	while(len > 0) {
+		ret = write(fd, buf, len);
+		if(ret < 0) {
+			if(errno == EINTR)
+				continue;
+			return ERROR;
+			}
+		buf += ret;
+		len -= ret;
+		}
+
+	return OK;
+	}
+
+
+static void json_cgi_get_stamp(const char *path, struct json_cgi_stamp *stamp, int binary) {
+	struct xsdb_header hdr;
+	struct stat st;
+	int fd;
+
+	memset(stamp, 0, sizeof(*stamp));
+	if(path == NULL || stat(path, &st) < 0)
+		return;
+	stamp->mtime = st.st_mtime;
+	stamp->ino = st.st_ino;
+	stamp->size = st.st_size;
+
+	/* the binary status file is updated in place, so its mtime isn't
+		enough to tell whether it changed */
+	if(binary == TRUE && (fd = open(path, O_RDONLY)) >= 0) {
+		if(read(fd, &hdr, sizeof(hdr)) == (ssize_t)sizeof(hdr))
+			stamp->generation = hdr.generation;
+		close(fd);
+		}
+	}
+
+
+static void json_cgi_get_status_stamp(struct json_cgi_stamp *stamp) {
+
+	json_cgi_get_stamp(binary_status_file, stamp, TRUE);
+	if(stamp->mtime == (time_t)0)
+		json_cgi_get_stamp(status_file, stamp, FALSE);
+	}
+
+
+static void json_cgi_get_config_stamps(struct json_cgi_stamp *stamps) {
+
+	json_cgi_get_stamp(get_cgi_config_location(), &stamps[0], FALSE);
+	json_cgi_get_stamp(main_config_file, &stamps[1], FALSE);
+	json_cgi_get_stamp(object_cache_file, &stamps[2], FALSE);
+	}
+
+
+/* (re)read the status data */
+static int json_cgi_read_status(void) {
+
+	json_cgi_get_status_stamp(&json_cgi_status_stamp);
+
+	free_comment_data();
+	free_downtime_data();
+	free_status_data();
+	program_status_has_been_read = FALSE;
+	host_status_has_been_read = FALSE;
+	service_status_has_been_read = FALSE;
+
+	if(read_all_status_data(status_file, READ_ALL_STATUS_DATA) == ERROR) {
+		fprintf(stderr, "Warning: Could not read host and service status information!\n");
+		return ERROR;
+		}
+	json_cgi_status_time = json_cgi_status_stamp.mtime;
+
+	return OK;
+	}
+
+
+static int json_cgi_load_data(void) {
+
+	init_shared_cfg_vars(1);
+	reset_cgi_vars();
+
+	if(read_cgi_config_file(get_cgi_config_location(), NULL) == ERROR) {
+		fprintf(stderr, "Error: Could not open CGI configuration file '%s' for reading!\n", get_cgi_config_location());
+		return ERROR;
+		}
+	if(read_main_config_file(main_config_file) == ERROR) {
+		fprintf(stderr, "Error: Could not open main configuration file '%s' for reading!\n", main_config_file);
+		return ERROR;
+		}
+	if(read_all_object_configuration_data(main_config_file, READ_ALL_OBJECT_DATA) == ERROR) {
+		fprintf(stderr, "Error: Could not read some or all object configuration data!\n");
+		return ERROR;
+		}
+	json_cgi_get_config_stamps(json_cgi_config_stamps);
+
+	/* we'll try again when the status data is updated */
+	json_cgi_read_status();
+
+	return OK;
+	}
+
+
+/* start afresh if the configuration changed, re-read the status data if it did */
+static void json_cgi_refresh(char **argv) {
+	struct json_cgi_stamp stamps[3], status_stamp;
+
+	json_cgi_get_config_stamps(stamps);
+	if(memcmp(stamps, json_cgi_config_stamps, sizeof(stamps))) {
+		execv(argv[0], argv);
+		fprintf(stderr, "Warning: Unable to restart '%s' after a configuration change: %s\n", argv[0], strerror(errno));
+		memcpy(json_cgi_config_stamps, stamps, sizeof(stamps));
+		}
+
+	json_cgi_get_status_stamp(&status_stamp);
+	if(memcmp(&status_stamp, &json_cgi_status_stamp, sizeof(status_stamp)))
+		json_cgi_read_status();
+	}
+
+
+/* set up the environment of the request sent to us on fd */
+static int json_cgi_read_request(int fd) {
+	char *buf, *p, *eq, *end;
+	size_t len = 0;
+	ssize_t ret;
+	int i;
+
+	if((buf = malloc(JSON_CGI_MAX_REQUEST + 1)) == NULL)
+		return ERROR;
+	while(len < JSON_CGI_MAX_REQUEST) {
+		ret = read(fd, buf + len, JSON_CGI_MAX_REQUEST - len);
+		if(ret == 0)
+			break;
+		if(ret < 0) {
+			if(errno == EINTR)
+				continue;
+			free(buf);
+			return ERROR;
+			}
+		len += ret;
+		}
+	buf[len] = '\0';
+	end = buf + len;
+
+	for(i = 0; json_cgi_env[i]; i++)
+		unsetenv(json_cgi_env[i]);
+
+	/* NAME=value pairs, each terminated by a nul byte */
+	for(p = buf; p < end && *p; p += strlen(p) + 1) {
+		if((eq = strchr(p, '=')) == NULL)
+			continue;
+		*eq = '\0';
+		for(i = 0; json_cgi_env[i]; i++) {
+			if(!strcmp(p, json_cgi_env[i])) {
+				setenv(p, eq + 1, 1);
+				break;
+				}
+			}
+		*eq = '=';
+		}
+
+	free(buf);
+	return OK;
+	}
+
+
+/* find the uid we take requests from */
+static int json_cgi_get_client_uid(uid_t *uid) {
+	struct passwd *pw;
+
+	if(json_cgi_client_user == NULL) {
+		*uid = geteuid();
+		return OK;
+		}
+	if((pw = getpwnam(json_cgi_client_user)) == NULL)
+		return ERROR;
+	*uid = pw->pw_uid;
+	return OK;
+	}
+
+
+/* who is at the other end of a connection, according to the kernel */
+static int json_cgi_get_peer_uid(int fd, uid_t *uid) {
+#ifdef SO_PEERCRED
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if(getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+		return ERROR;
+	*uid = cred.uid;
+#else
+	gid_t gid;
+
+	if(getpeereid(fd, uid, &gid) < 0)
+		return ERROR;
+#endif
+	return OK;
+	}
+
+
+/* sends what the request's output buffer holds to the client, length first */
+static void json_cgi_send_response(void) {
+	char buf[8192];
+	off_t size;
+	ssize_t ret;
+	int len;
+
+	if(json_cgi_client < 0)
+		return;
+	fflush(stdout);
+
+	if((size = lseek(STDOUT_FILENO, 0, SEEK_END)) < 0 || lseek(STDOUT_FILENO, 0, SEEK_SET) < 0)
+		return;
+	len = snprintf(buf, sizeof(buf), "%llu\n", (unsigned long long)size);
+	if(json_cgi_write_all(json_cgi_client, buf, len) == ERROR)
+		return;
+	while((ret = read(STDOUT_FILENO, buf, sizeof(buf))) != 0) {
+		if(ret < 0) {
+			if(errno == EINTR)
+				continue;
+			break;
+			}
+		if(json_cgi_write_all(json_cgi_client, buf, ret) == ERROR)
+			break;
+		}
+	close(json_cgi_client);
+	json_cgi_client = -1;
+	}
+
+
+/* collects the request's output, to be sent to the client on fd when we exit */
+static int json_cgi_buffer_response(int fd) {
+	FILE *fp;
+	int ret;
+
+	if((fp = tmpfile()) == NULL)
+		return ERROR;
+	ret = dup2(fileno(fp), STDOUT_FILENO);
+	fclose(fp);
+	if(ret < 0)
+		return ERROR;
+
+	json_cgi_client = fd;
+	atexit(json_cgi_send_response);
+	return OK;
+	}
+
+
+/* did the daemon load our data before we were forked off to handle a request? */
+int json_cgi_preloaded(void) {
+	return json_cgi_preloaded_data;
+	}
+
+
+/* when the status data we're working with was written */
+time_t json_cgi_status_update_time(void) {
+	return json_cgi_status_time;
+	}
+
+
+/*
+ * Runs the daemon. Only returns in a child that is to handle a request,
+ * with the request's environment set up and stdout connected to the
+ * client, or if the daemon couldn't be started.
+ */
+int json_cgi_serve(const char *cgi_name, char **argv) {
+	struct sockaddr_un addr;
+	struct pollfd pfd;
+	unsigned int children = 0;
+	char *path;
+	pid_t pid;
+	uid_t client_uid, peer_uid;
+	int sock, conn, ret;
+	time_t last_refresh = (time_t)0, now;
+
+	if(json_cgi_load_data() == ERROR)
+		return ERROR;
+
+	if(json_cgi_get_client_uid(&client_uid) == ERROR) {
+		fprintf(stderr, "Error: Unknown json_cgi_client_user '%s'\n", json_cgi_client_user);
+		return ERROR;
+		}
+
+	path = json_cgi_socket_path(cgi_name);
+	if((sock = json_cgi_connect(path, &addr)) < 0) {
+		fprintf(stderr, "Error: Unable to create the socket for '%s': %s\n", path ? path : "(json_cgi_socket_dir is not set)", strerror(errno));
+		my_free(path);
+		return ERROR;
+		}
+	unlink(path);
+	if(bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || chmod(path, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP) < 0 || listen(sock, 64) < 0) {
+		fprintf(stderr, "Error: Unable to listen on '%s': %s\n", path, strerror(errno));
+		close(sock);
+		my_free(path);
+		return ERROR;
+		}
+	fcntl(sock, F_SETFD, FD_CLOEXEC);
+	signal(SIGPIPE, SIG_IGN);
+
+	for(;;) {
+		while(children > 0 && waitpid(-1, NULL, WNOHANG) > 0)
+			children--;
+		if(children >= JSON_CGI_MAX_CHILDREN) {
+			if(waitpid(-1, NULL, 0) > 0)
+				children--;
+			continue;
+			}
+
+		pfd.fd = sock;
+		pfd.events = POLLIN;
+		ret = poll(&pfd, 1, 1000);
+
+		/* don't look at the files more than once a second */
+		now = time(NULL);
+		if(now != last_refresh) {
+			last_refresh = now;
+			json_cgi_refresh(argv);
+			}
+
+		if(ret <= 0 || (conn = accept(sock, NULL, NULL)) < 0)
+			continue;
+
+		/* the request names its user, so we must know who sent it */
+		if(json_cgi_get_peer_uid(conn, &peer_uid) == ERROR || peer_uid != client_uid) {
+			close(conn);
+			continue;
+			}
+
+		if((pid = fork()) == 0) {
+			close(sock);
+			my_free(path);
+			signal(SIGPIPE, SIG_DFL);
+			alarm(JSON_CGI_REQUEST_TIMEOUT);
+			if(json_cgi_read_request(conn) == ERROR || json_cgi_buffer_response(conn) == ERROR)
+				_exit(1);
+			json_cgi_preloaded_data = TRUE;
+			return OK;
+			}
+		if(pid > 0)
+			children++;
+		close(conn);
+		}
+
+	return ERROR;
+	}
+
+
+/*
+ * Hands the request to a daemon serving this CGI, if there is one.
+ * Returns OK if the daemon answered it.
+ */
+int json_cgi_forward_request(const char *cgi_name) {
+	struct sockaddr_un addr;
+	char *buf = NULL, *body, *path, *val, *end;
+	size_t len = 0, size = 0;
+	unsigned long long expected;
+	void (*old_sigpipe)(int);
+	ssize_t ret = -1;
+	int sock, i;
+
+	/* anything but a simple GET request is handled here */
+	if((val = getenv("REQUEST_METHOD")) == NULL || strcmp(val, "GET"))
+		return ERROR;
+
+	reset_cgi_vars();
+	if(read_cgi_config_file(get_cgi_config_location(), NULL) == ERROR || json_cgi_socket_dir == NULL)
+		return ERROR;
+
+	path = json_cgi_socket_path(cgi_name);
+	sock = json_cgi_connect(path, &addr);
+	my_free(path);
+	if(sock < 0)
+		return ERROR;
+	if(connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(sock);
+		return ERROR;
+		}
+
+	/* a daemon that hangs up on us mustn't take us down with it */
+	old_sigpipe = signal(SIGPIPE, SIG_IGN);
+	for(i = 0; json_cgi_env[i]; i++) {
+		if((val = getenv(json_cgi_env[i])) == NULL)
+			continue;
+		if(json_cgi_write_all(sock, json_cgi_env[i], strlen(json_cgi_env[i])) == ERROR ||
+				json_cgi_write_all(sock, "=", 1) == ERROR ||
+				json_cgi_write_all(sock, val, strlen(val) + 1) == ERROR) {
+			close(sock);
+			signal(SIGPIPE, old_sigpipe);
+			return ERROR;
+			}
+		}
+	shutdown(sock, SHUT_WR);
+
+	/* nothing is passed on until we know we have all of it */
+	for(;;) {
+		if(len == size) {
+			size = size ? size * 2 : 65536;
+			if((body = realloc(buf, size)) == NULL)
+				break;
+			buf = body;
+			}
+		ret = read(sock, buf + len, size - len);
+		if(ret < 0 && errno == EINTR)
+			continue;
+		if(ret <= 0)
+			break;
+		len += ret;
+		}
+	close(sock);
+	signal(SIGPIPE, old_sigpipe);
+
+	/* if the daemon didn't give us a whole answer, we'll have to answer ourselves */
+	if(ret != 0 || len == 0 || (body = memchr(buf, '\n', len)) == NULL) {
+		free(buf);
+		return ERROR;
+		}
+	*body++ = '\0';
+	expected = strtoull(buf, &end, 10);
+	if(end == buf || *end != '\0' || expected != (unsigned long long)(len - (body - buf))) {
+		free(buf);
+		return ERROR;
+		}
+
+	json_cgi_write_all(STDOUT_FILENO, body, expected);
+	free(buf);
+	return OK;
+	}
@@ -598,7 +598,7 @@ int json_object_hostescalation_passes_selection(hostescalation *, host *,
 json_object *json_object_hostescalation_selectors(int, int, host *,
 		hostgroup *, contact *, contactgroup *);
 
-int main(void) {
+int main(int argc, char **argv) {
 	int result = OK;
 	time_t query_time;
 	object_json_cgi_data	cgi_data;
@@ -606,6 +606,14 @@ int main(void) {
 	struct stat ocstat;
 	time_t	last_object_cache_update = (time_t)0;
 
+	/* serve requests from a long-lived process, or hand them to one */
+	if(argc > 1 && !strcmp(argv[1], "--daemon")) {
+		if(json_cgi_serve(THISCGI, argv) == ERROR)
+			return ERROR;
+		}
+	else if(json_cgi_forward_request(THISCGI) == OK)
+		return OK;
+
 	/* The official time of the query */
 	time(&query_time);
 
@@ -618,7 +626,8 @@ int main(void) {
 			OUTPUT_FORMAT_VERSION);
 
 	/* Initialize shared configuration variables */                             
-	init_shared_cfg_vars(1);
+	if(json_cgi_preloaded() == FALSE)
+		init_shared_cfg_vars(1);
 
 	init_cgi_data(&cgi_data);
 
@@ -635,54 +644,57 @@ int main(void) {
 		return result;
 		}
 
-	/* reset internal variables */
-	reset_cgi_vars();
-
-	/* read the CGI configuration file */
-	result = read_cgi_config_file(get_cgi_config_location(), NULL);
-	if(result == ERROR) {
-		json_object_append_object(json_root, "result", 
-				json_result(query_time, THISCGI, 
-				svm_get_string_from_value(cgi_data.query, valid_queries), 
-				get_query_status(query_status, cgi_data.query),
-				(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
-				"Error: Could not open CGI configuration file '%s' for reading!", 
-				get_cgi_config_location()));
-		json_object_append_object(json_root, "data", json_help(object_json_help));
-		json_object_print(json_root, 0, 1, cgi_data.strftime_format,
-				cgi_data.format_options);
-		document_footer();
-		return ERROR;
-		}
+	/* a daemon we were forked from has read everything already */
+	if(json_cgi_preloaded() == FALSE) {
+		/* reset internal variables */
+		reset_cgi_vars();
 
-	/* read the main configuration file */
-	result = read_main_config_file(main_config_file);
-	if(result == ERROR) {
-		json_object_append_object(json_root, "result", 
-				json_result(query_time, THISCGI, 
-				svm_get_string_from_value(cgi_data.query, valid_queries), 
-				get_query_status(query_status, cgi_data.query),
-				(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
-				"Error: Could not open main configuration file '%s' for reading!",
-				main_config_file));
-		json_object_append_object(json_root, "data", json_help(object_json_help));
-		document_footer();
-		return ERROR;
-		}
-
-	/* read all object configuration data */
-	result = read_all_object_configuration_data(main_config_file, 
-			READ_ALL_OBJECT_DATA);
-	if(result == ERROR) {
-		json_object_append_object(json_root, "result", 
-				json_result(query_time, THISCGI, 
-				svm_get_string_from_value(cgi_data.query, valid_queries), 
-				get_query_status(query_status, cgi_data.query),
-				(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
-				"Error: Could not read some or all object configuration data!"));
-		json_object_append_object(json_root, "data", json_help(object_json_help));
-		document_footer();
-		return ERROR;
+		/* read the CGI configuration file */
+		result = read_cgi_config_file(get_cgi_config_location(), NULL);
+		if(result == ERROR) {
+			json_object_append_object(json_root, "result", 
+					json_result(query_time, THISCGI, 
+					svm_get_string_from_value(cgi_data.query, valid_queries), 
+					get_query_status(query_status, cgi_data.query),
+					(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
+					"Error: Could not open CGI configuration file '%s' for reading!", 
+					get_cgi_config_location()));
+			json_object_append_object(json_root, "data", json_help(object_json_help));
+			json_object_print(json_root, 0, 1, cgi_data.strftime_format,
+					cgi_data.format_options);
+			document_footer();
+			return ERROR;
+			}
+
+		/* read the main configuration file */
+		result = read_main_config_file(main_config_file);
+		if(result == ERROR) {
+			json_object_append_object(json_root, "result", 
+					json_result(query_time, THISCGI, 
+					svm_get_string_from_value(cgi_data.query, valid_queries), 
+					get_query_status(query_status, cgi_data.query),
+					(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
+					"Error: Could not open main configuration file '%s' for reading!",
+					main_config_file));
+			json_object_append_object(json_root, "data", json_help(object_json_help));
+			document_footer();
+			return ERROR;
+			}
+
+		/* read all object configuration data */
+		result = read_all_object_configuration_data(main_config_file, 
+				READ_ALL_OBJECT_DATA);
+		if(result == ERROR) {
+			json_object_append_object(json_root, "result", 
+					json_result(query_time, THISCGI, 
+					svm_get_string_from_value(cgi_data.query, valid_queries), 
+					get_query_status(query_status, cgi_data.query),
+					(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
+					"Error: Could not read some or all object configuration data!"));
+			json_object_append_object(json_root, "data", json_help(object_json_help));
+			document_footer();
+			return ERROR;
+			}
 		}
 
 	/* Get the update time on the object cache file */
@@ -700,19 +712,21 @@ int main(void) {
 		}
 	last_object_cache_update = ocstat.st_mtime;
 
-	/* read all status data */
-	result = read_all_status_data(status_file, READ_ALL_STATUS_DATA);
-	if(result == ERROR) {
-		json_object_append_object(json_root, "result", 
-				json_result(query_time, THISCGI, 
-				svm_get_string_from_value(cgi_data.query, valid_queries), 
-				get_query_status(query_status, cgi_data.query),
-				(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
-				"Error: Could not read host and service status information!"));
-		json_object_append_object(json_root, "data", json_help(object_json_help));
+	if(json_cgi_preloaded() == FALSE) {
+		/* read all status data */
+		result = read_all_status_data(status_file, READ_ALL_STATUS_DATA);
+		if(result == ERROR) {
+			json_object_append_object(json_root, "result", 
+					json_result(query_time, THISCGI, 
+					svm_get_string_from_value(cgi_data.query, valid_queries), 
+					get_query_status(query_status, cgi_data.query),
+					(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
+					"Error: Could not read host and service status information!"));
+			json_object_append_object(json_root, "data", json_help(object_json_help));
 
-		document_footer();
-		return ERROR;
+			document_footer();
+			return ERROR;
+			}
 		}
 
 	/* validate arguments in URL */
@@ -1152,7 +1166,8 @@ int main(void) {
 	/* free all allocated memory */
 	free_cgi_data( &cgi_data);
 	json_free_object(json_root, 1);
-	free_memory();
+	if(json_cgi_preloaded() == FALSE)
+		free_memory();
 
 	return OK;
 	}
@@ -3473,9 +3488,12 @@ json_object *json_object_servicelist(unsigned format_options, int start,
 	json_object *json_service_details;
 	host *temp_host;
 	service *temp_service;
+	service **host_services;
 	int current = 0;
 	int counted = 0;
 	int service_count;
+	int num_host_services;
+	int x;
 	char *buf;
 
 	json_data = json_new_object();
@@ -3504,9 +3522,11 @@ json_object *json_object_servicelist(unsigned format_options, int start,
 			json_servicelist_array = json_new_array();
 			}
 
-		for(temp_service = service_list; temp_service != NULL; 
-				temp_service = temp_service->next) {
-	
+		host_services = json_host_services(temp_host, &num_host_services);
+		for(x = 0; x < num_host_services; x++) {
+
+			temp_service = host_services[x];
+
 			if(json_object_service_passes_service_selection(temp_service,
 					temp_servicegroup, temp_contact, 
 					service_description, parent_service_name,
@@ -3516,10 +3536,6 @@ json_object *json_object_servicelist(unsigned format_options, int start,
 				continue;
 				}
 
-			/* If this service isn't on the host we're currently working with, 
-					skip it */
-			if( strcmp( temp_host->name, temp_service->host_name)) continue;
-
 			/* If the current item passes the start and limit tests, display it */
 			if( passes_start_and_count_limits(start, count, current, counted)) {
 				if( details > 0) {
@@ -3540,6 +3556,7 @@ json_object *json_object_servicelist(unsigned format_options, int start,
 				}
 			current++; 
 			}
+		free(host_services);
 
 		if(service_count > 0) {
 			if(details > 0) {
@@ -727,7 +727,7 @@ int json_status_downtime_passes_selection(scheduled_downtime *, int, time_t,
 json_object *json_status_downtime_selectors(unsigned, int, int, int, time_t, 
 		time_t, unsigned, unsigned, unsigned, int, unsigned, char *, char *);
 
-int main(void) {
+int main(int argc, char **argv) {
 	int result = OK;
 	time_t query_time;
 	status_json_cgi_data	cgi_data;
@@ -737,6 +737,14 @@ int main(void) {
 	hoststatus *temp_hoststatus = NULL;
 	servicestatus *temp_servicestatus = NULL;
 
+	/* serve requests from a long-lived process, or hand them to one */
+	if(argc > 1 && !strcmp(argv[1], "--daemon")) {
+		if(json_cgi_serve(THISCGI, argv) == ERROR)
+			return ERROR;
+		}
+	else if(json_cgi_forward_request(THISCGI) == OK)
+		return OK;
+
 	/* The official time of the query */
 	time(&query_time);
 
@@ -749,7 +757,8 @@ int main(void) {
 			OUTPUT_FORMAT_VERSION);
 
 	/* Initialize shared configuration variables */                             
-	init_shared_cfg_vars(1);
+	if(json_cgi_preloaded() == FALSE)
+		init_shared_cfg_vars(1);
 
 	init_cgi_data(&cgi_data);
 
@@ -765,91 +774,98 @@ int main(void) {
 		return ERROR;
 		}
 
-	/* reset internal variables */
-	reset_cgi_vars();
-
-	/* read the CGI configuration file */
-	result = read_cgi_config_file(get_cgi_config_location(), NULL);
-	if(result == ERROR) {
-		json_object_append_object(json_root, "result", 
-				json_result(query_time, THISCGI, 
-				svm_get_string_from_value(cgi_data.query, valid_queries), 
-				get_query_status(query_status, cgi_data.query),
-				(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
-				"Error: Could not open CGI configuration file '%s' for reading!", 
-				get_cgi_config_location()));
-		json_object_append_object(json_root, "data", json_help(status_json_help));
-		json_object_print(json_root, 0, 1, cgi_data.strftime_format, 
-				cgi_data.format_options);
-		document_footer();
-		return ERROR;
-		}
-
-	/* read the main configuration file */
-	result = read_main_config_file(main_config_file);
-	if(result == ERROR) {
-		json_object_append_object(json_root, "result", 
-				json_result(query_time, THISCGI, 
-				svm_get_string_from_value(cgi_data.query, valid_queries), 
-				get_query_status(query_status, cgi_data.query),
-				(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
-				"Error: Could not open main configuration file '%s' for reading!", 
-				main_config_file));
-		json_object_append_object(json_root, "data", json_help(status_json_help));
-		json_object_print(json_root, 0, 1, cgi_data.strftime_format, 
-				cgi_data.format_options);
-		document_footer();
-		return ERROR;
-		}
-
-	/* read all object configuration data */
-	result = read_all_object_configuration_data(main_config_file, 
-			READ_ALL_OBJECT_DATA);
-	if(result == ERROR) {
-		json_object_append_object(json_root, "result", 
-				json_result(query_time, THISCGI, 
-				svm_get_string_from_value(cgi_data.query, valid_queries), 
-				get_query_status(query_status, cgi_data.query),
-				(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
-				"Error: Could not read some or all object configuration data!"));
-		json_object_append_object(json_root, "data", json_help(status_json_help));
-		json_object_print(json_root, 0, 1, cgi_data.strftime_format, 
-				cgi_data.format_options);
-		document_footer();
-		return ERROR;
-		}
-
-	/* Get the update time on the status data file. This needs to occur before
-		the status data is read because the read_all_status_data() function
-		clears the name of the status file */
-	if(stat(status_file, &sdstat) < 0) {
-		json_object_append_object(json_root, "result",
-				json_result(query_time, THISCGI,
-				svm_get_string_from_value(cgi_data.query, valid_queries),
-				get_query_status(query_status, cgi_data.query),
-				(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
-				"Error: Could not obtain status data file status: %s!",
-				strerror(errno)));
-		json_object_append_object(json_root, "data", json_help(status_json_help));
-		document_footer();
-		return ERROR;
-		}
-	last_status_data_update = sdstat.st_mtime;
+	/* a daemon we were forked from has read everything already */
+	if(json_cgi_preloaded() == TRUE)
+		last_status_data_update = json_cgi_status_update_time();
+	else {
+		/* reset internal variables */
+		reset_cgi_vars();
 
-	/* read all status data */
-	result = read_all_status_data(status_file, READ_ALL_STATUS_DATA);
-	if(result == ERROR) {
-		json_object_append_object(json_root, "result", 
-				json_result(query_time, THISCGI, 
-				svm_get_string_from_value(cgi_data.query, valid_queries), 
-				get_query_status(query_status, cgi_data.query),
-				(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
-				"Error: Could not read host and service status information!"));
-		json_object_append_object(json_root, "data", json_help(status_json_help));
-		json_object_print(json_root, 0, 1, cgi_data.strftime_format, 
-				cgi_data.format_options);
-		document_footer();
-		return ERROR;
+		/* read the CGI configuration file */
+		result = read_cgi_config_file(get_cgi_config_location(), NULL);
+		if(result == ERROR) {
+			json_object_append_object(json_root, "result", 
+					json_result(query_time, THISCGI, 
+					svm_get_string_from_value(cgi_data.query, valid_queries), 
+					get_query_status(query_status, cgi_data.query),
+					(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
+					"Error: Could not open CGI configuration file '%s' for reading!", 
+					get_cgi_config_location()));
+			json_object_append_object(json_root, "data", json_help(status_json_help));
+			json_object_print(json_root, 0, 1, cgi_data.strftime_format, 
+					cgi_data.format_options);
+			document_footer();
+			return ERROR;
+			}
+
+		/* read the main configuration file */
+		result = read_main_config_file(main_config_file);
+		if(result == ERROR) {
+			json_object_append_object(json_root, "result", 
+					json_result(query_time, THISCGI, 
+					svm_get_string_from_value(cgi_data.query, valid_queries), 
+					get_query_status(query_status, cgi_data.query),
+					(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
+					"Error: Could not open main configuration file '%s' for reading!", 
+					main_config_file));
+			json_object_append_object(json_root, "data", json_help(status_json_help));
+			json_object_print(json_root, 0, 1, cgi_data.strftime_format, 
+					cgi_data.format_options);
+			document_footer();
+			return ERROR;
+			}
+
+		/* read all object configuration data */
+		result = read_all_object_configuration_data(main_config_file, 
+				READ_ALL_OBJECT_DATA);
+		if(result == ERROR) {
+			json_object_append_object(json_root, "result", 
+					json_result(query_time, THISCGI, 
+					svm_get_string_from_value(cgi_data.query, valid_queries), 
+					get_query_status(query_status, cgi_data.query),
+					(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
+					"Error: Could not read some or all object configuration data!"));
+			json_object_append_object(json_root, "data", json_help(status_json_help));
+			json_object_print(json_root, 0, 1, cgi_data.strftime_format, 
+					cgi_data.format_options);
+			document_footer();
+			return ERROR;
+			}
+
+		/* Get the update time on the status data file. This needs to occur before
+			the status data is read because the read_all_status_data() function
+			clears the name of the status file. The binary status file is
+			preferred when Nagios writes one */
+		if((binary_status_file == NULL || stat(binary_status_file, &sdstat) < 0) &&
+				stat(status_file, &sdstat) < 0) {
+			json_object_append_object(json_root, "result",
+					json_result(query_time, THISCGI,
+					svm_get_string_from_value(cgi_data.query, valid_queries),
+					get_query_status(query_status, cgi_data.query),
+					(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
+					"Error: Could not obtain status data file status: %s!",
+					strerror(errno)));
+			json_object_append_object(json_root, "data", json_help(status_json_help));
+			document_footer();
+			return ERROR;
+			}
+		last_status_data_update = sdstat.st_mtime;
+
+		/* read all status data */
+		result = read_all_status_data(status_file, READ_ALL_STATUS_DATA);
+		if(result == ERROR) {
+			json_object_append_object(json_root, "result", 
+					json_result(query_time, THISCGI, 
+					svm_get_string_from_value(cgi_data.query, valid_queries), 
+					get_query_status(query_status, cgi_data.query),
+					(time_t)-1, NULL, RESULT_FILE_OPEN_READ_ERROR,
+					"Error: Could not read host and service status information!"));
+			json_object_append_object(json_root, "data", json_help(status_json_help));
+			json_object_print(json_root, 0, 1, cgi_data.strftime_format, 
+					cgi_data.format_options);
+			document_footer();
+			return ERROR;
+			}
 		}
 
 	/* validate arguments in URL */
@@ -1157,7 +1173,8 @@ int main(void) {
 	/* free all allocated memory */
 	free_cgi_data( &cgi_data);
 	json_free_object(json_root, 1);
-	free_memory();
+	if(json_cgi_preloaded() == FALSE)
+		free_memory();
 
 	return OK;
 	}
@@ -3356,10 +3373,13 @@ json_object *json_status_servicelist(unsigned format_options, int start,
 	json_object *json_service_details;
 	host *temp_host;
 	service *temp_service;
+	service **host_services;
 	servicestatus *temp_servicestatus;
 	int current = 0;
 	int counted = 0;
 	int service_count; /* number of services on a host */
+	int num_host_services;
+	int x;
 
 	json_data = json_new_object();
 	json_object_append_object(json_data, "selectors", 
@@ -3385,12 +3405,10 @@ json_object *json_status_servicelist(unsigned format_options, int start,
 
 		service_count = 0;
 
-		for(temp_service = service_list; temp_service != NULL; 
-				temp_service = temp_service->next) {
+		host_services = json_host_services(temp_host, &num_host_services);
+		for(x = 0; x < num_host_services; x++) {
 
-			/* If this service isn't on the host we're currently working with, 
-					skip it */
-			if( strcmp( temp_host->name, temp_service->host_name)) continue;
+			temp_service = host_services[x];
 
 			/* Get the service status. If we cannot get the status of 
 				the service, skip it. This should probably return an 
@@ -3440,6 +3458,7 @@ json_object *json_status_servicelist(unsigned format_options, int start,
 				}
 			current++; 
 			}
+		free(host_services);
 
 		if( service_count > 0) {
 			json_object_append_object(json_hostlist, temp_host->name, 
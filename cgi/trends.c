@@ -2470,7 +2470,7 @@ void scan_log_file_for_archived_state_data(char *filename) {
 	char *plugin_output = NULL;
 	char *temp_buffer = NULL;
 	time_t time_stamp;
-	mmapfile *thefile = NULL;
+	logindex_reader *thefile = NULL;
 	int state_type = 0;
 
 	/* print something so browser doesn't time out */
@@ -2479,13 +2479,19 @@ void scan_log_file_for_archived_state_data(char *filename) {
 		fflush(NULL);
 		}
 
-	if((thefile = mmap_fopen(filename)) == NULL) {
+	if((thefile = logindex_reader_open(filename, LOGIDX_PROGRAM | LOGIDX_ALERT | LOGIDX_STATE)) == NULL) {
 #ifdef DEBUG
 		printf("Could not open file '%s' for reading.\n", filename);
 #endif
 		return;
 		}
 
+	/* we only care about the host or service we're graphing */
+	if(display_type == DISPLAY_HOST_TRENDS)
+		logindex_reader_want(thefile, host_name, NULL);
+	else if(display_type == DISPLAY_SERVICE_TRENDS)
+		logindex_reader_want(thefile, host_name, svc_description);
+
 #ifdef DEBUG
 	printf("Scanning log file '%s' for archived state data...\n", filename);
 #endif
@@ -2499,7 +2505,7 @@ void scan_log_file_for_archived_state_data(char *filename) {
 		input2 = NULL;
 
 		/* read the next line */
-		if((input = mmap_fgets(thefile)) == NULL)
+		if((input = logindex_reader_gets(thefile)) == NULL)
 			break;
 
 		strip(input);
@@ -2623,7 +2629,7 @@ void scan_log_file_for_archived_state_data(char *filename) {
 	/* free memory and close the file */
 	free(input);
 	free(input2);
-	mmap_fclose(thefile);
+	logindex_reader_close(thefile);
 
 	return;
 	}
@@ -97,21 +97,233 @@ static const struct macro_key_code *find_macro_key(const char *name) {
 	}
 
 
+/*
+ * Command lines are expanded over and over again, with different
+ * macro values but the same text. Each distinct input is parsed once
+ * into a template of text and macro references, with the macro names
+ * already looked up, so expanding it is a single pass that appends
+ * text and macro values to the output.
+ */
+#define MACRO_TEMPLATE_CACHE_MAX 4096
+
+enum {
+	MT_TEXT,        /* literal text */
+	MT_BAD,         /* text between $'s that can never be a macro */
+	MT_ARGV,        /* $ARGn$ */
+	MT_USER,        /* $USERn$ */
+	MT_MACROX,      /* regular macro, without arguments */
+	MT_OTHER        /* on-demand, contact address and custom variable macros */
+	};
+
+struct macro_token {
+	int type;
+	int code;       /* argv/user index or MACRO_X code */
+	int options;    /* clean options of MT_MACROX macros */
+	int last;       /* not followed by a closing $ */
+	char *str;      /* the text, or the macro as written */
+	size_t len;
+	};
+
+struct macro_template {
+	char *input;
+	unsigned int tokens;
+	struct macro_token token[1];
+	};
+
+struct macro_output {
+	char *buf;
+	size_t len, size;
+	};
+
+static dkhash_table *macro_templates;
+static unsigned int num_macro_templates;
+
+/*
+ * process_macros_r() can be called from any thread, so the core looks
+ * the cache up under a read lock and only takes the write lock to add
+ * to it. Templates are never changed once they are in the cache. The
+ * CGIs have only the one thread.
+ */
+#ifdef NSCORE
+#include <pthread.h>
+static pthread_rwlock_t macro_templates_lock = PTHREAD_RWLOCK_INITIALIZER;
+#define lock_macro_templates_read() pthread_rwlock_rdlock(&macro_templates_lock)
+#define lock_macro_templates_write() pthread_rwlock_wrlock(&macro_templates_lock)
+#define unlock_macro_templates() pthread_rwlock_unlock(&macro_templates_lock)
+#else
+#define lock_macro_templates_read()
+#define lock_macro_templates_write()
+#define unlock_macro_templates()
+#endif
+
+static struct macro_template *compile_macro_template(const char *input) {
+	struct macro_template *t;
+	struct macro_token *tok;
+	size_t len = strlen(input);
+	unsigned int tokens = 1;
+	char *buf, *part, *delim;
+	int in_macro = FALSE;
+	const struct macro_key_code *mkey;
+	int x;
+
+	for(delim = strchr(input, '$'); delim; delim = strchr(delim + 1, '$'))
+		tokens++;
+
+	/* the input is stored twice: once as is, once split into parts */
+	if(!(t = malloc(sizeof(*t) + tokens * sizeof(*tok) + (len + 1) * 2)))
+		return NULL;
+	t->input = (char *)&t->token[tokens];
+	memcpy(t->input, input, len + 1);
+	buf = t->input + len + 1;
+	memcpy(buf, input, len + 1);
+	t->tokens = 0;
+
+	for(part = buf; part; part = delim, in_macro = !in_macro) {
+		if((delim = strchr(part, '$')))
+			*delim++ = 0;
+
+		tok = &t->token[t->tokens];
+		tok->str = part;
+		tok->len = strlen(part);
+		tok->last = delim == NULL;
+		tok->code = tok->options = 0;
+
+		if(in_macro == FALSE) {
+			if(!tok->len)
+				continue;
+			tok->type = MT_TEXT;
+			}
+
+		/* an escaped $ is done by specifying two $$ next to each other */
+		else if(!tok->len) {
+			tok->str = "$";
+			tok->len = 1;
+			tok->type = MT_TEXT;
+			}
+
+		/* these are checked in the same order grab_macro_value_r() does */
+		else if(strstr(part, "ARG") == part) {
+			x = atoi(part + 3);
+			tok->type = (x <= 0 || x > MAX_COMMAND_ARGUMENTS) ? MT_BAD : MT_ARGV;
+			tok->code = x - 1;
+			}
+		else if(strstr(part, "USER") == part) {
+			x = atoi(part + 4);
+			tok->type = (x <= 0 || x > MAX_USER_MACROS) ? MT_BAD : MT_USER;
+			tok->code = x - 1;
+			}
+		else if(!strchr(part, ':') && (mkey = find_macro_key(part))) {
+			tok->type = MT_MACROX;
+			tok->code = mkey->code;
+			tok->options = mkey->options;
+			}
+		else
+			tok->type = MT_OTHER;
+
+		t->tokens++;
+		}
+
+	return t;
+	}
+
+static int free_macro_template(void *t) {
+	free(t);
+	return DKHASH_WALK_REMOVE;
+	}
+
+/* get the template of an input, from the cache if possible */
+static struct macro_template *get_macro_template(const char *input, int *cached) {
+	struct macro_template *t, *found;
+
+	*cached = FALSE;
+	lock_macro_templates_read();
+	found = macro_templates ? dkhash_get(macro_templates, input, NULL) : NULL;
+	unlock_macro_templates();
+	if(found) {
+		*cached = TRUE;
+		return found;
+		}
+
+	if(!(t = compile_macro_template(input)))
+		return NULL;
+
+	lock_macro_templates_write();
+
+	/* another thread may have added it while we were compiling ours */
+	if(macro_templates && (found = dkhash_get(macro_templates, input, NULL))) {
+		unlock_macro_templates();
+		free(t);
+		*cached = TRUE;
+		return found;
+		}
+
+	if(num_macro_templates < MACRO_TEMPLATE_CACHE_MAX
+			&& (macro_templates || (macro_templates = dkhash_create(MACRO_TEMPLATE_CACHE_MAX)))
+			&& dkhash_insert(macro_templates, t->input, NULL, t) == DKHASH_OK) {
+		num_macro_templates++;
+		*cached = TRUE;
+		}
+
+	unlock_macro_templates();
+	return t;
+	}
+
+/* only called once no other thread can be expanding macros */
+static void free_macro_templates(void) {
+	lock_macro_templates_write();
+	if(macro_templates) {
+		dkhash_walk_data(macro_templates, free_macro_template);
+		dkhash_destroy(macro_templates);
+		macro_templates = NULL;
+		num_macro_templates = 0;
+		}
+	unlock_macro_templates();
+	}
+
+static void add_macro_output(struct macro_output *out, const char *str, size_t len) {
+	if(out->len + len >= out->size) {
+		size_t size = out->size ? out->size : 64;
+		char *buf;
+
+		while(out->len + len >= size)
+			size *= 2;
+		if(!(buf = realloc(out->buf, size)))
+			return;
+		out->buf = buf;
+		out->size = size;
+		}
+	memcpy(out->buf + out->len, str, len);
+	out->len += len;
+	out->buf[out->len] = 0;
+	}
+
+static void add_macro_output_str(struct macro_output *out, const char *str) {
+	add_macro_output(out, str, strlen(str));
+	}
+
+/* a macro that couldn't be expanded is kept as it was written */
+static void add_unexpanded_macro(struct macro_output *out, struct macro_token *tok) {
+	add_macro_output(out, "$", 1);
+	add_macro_output(out, tok->str, tok->len);
+	if(!tok->last)
+		add_macro_output(out, "$", 1);
+	}
+
 /*
  * replace macros in notification commands with their values,
  * the thread-safe version
  */
 int process_macros_r(nagios_macros *mac, char *input_buffer, char **output_buffer, int options) {
-	char *temp_buffer = NULL;
-	char *save_buffer = NULL;
-	char *buf_ptr = NULL;
-	char *delim_ptr = NULL;
-	int in_macro = FALSE;
+	struct macro_template *t;
+	struct macro_token *tok;
+	struct macro_output out = { NULL, 0, 0 };
 	char *selected_macro = NULL;
 	char *original_macro = NULL;
 	int result = OK;
 	int free_macro = FALSE;
 	int macro_options = 0;
+	int cached;
+	unsigned int i;
 
 	log_debug_info(DEBUGL_FUNCTIONS, 0, "process_macros_r()\n");
 
@@ -119,149 +331,130 @@ int process_macros_r(nagios_macros *mac, char *input_buffer, char **output_buffe
 		return ERROR;
 	}
 
-	*output_buffer = (char *)strdup("");
+	*output_buffer = NULL;
 
 	if(input_buffer == NULL) {
+		*output_buffer = (char *)strdup("");
 		return ERROR;
 	}
 
-	in_macro = FALSE;
-
 	log_debug_info(DEBUGL_MACROS, 1, "**** BEGIN MACRO PROCESSING ***********\n");
 	log_debug_info(DEBUGL_MACROS, 1, "Processing: '%s'\n", input_buffer);
 
-	/* use a duplicate of original buffer, so we don't modify the original */
-	save_buffer = buf_ptr = (input_buffer ? strdup(input_buffer) : NULL);
+	/* nothing to expand */
+	if(!strchr(input_buffer, '$')) {
+		*output_buffer = (char *)strdup(input_buffer);
+		log_debug_info(DEBUGL_MACROS, 1, "  Done.  Final output: '%s'\n", *output_buffer);
+		log_debug_info(DEBUGL_MACROS, 1, "**** END MACRO PROCESSING *************\n");
+		return OK;
+	}
 
-	while(buf_ptr) {
+	if((t = get_macro_template(input_buffer, &cached)) == NULL) {
+		*output_buffer = (char *)strdup("");
+		return ERROR;
+	}
 
-		/* save pointer to this working part of buffer */
-		temp_buffer = buf_ptr;
+	/* make sure we return a string even if there's nothing to add */
+	add_macro_output(&out, "", 0);
 
-		/* find the next delimiter - terminate preceding string and advance buffer pointer for next run */
-		delim_ptr = strchr(buf_ptr, '$');
-		if(delim_ptr != NULL) {
-			delim_ptr[0] = '\x0';
-			buf_ptr = (char *)delim_ptr + 1;
-		}
-		/* no delimiter found - we already have the last of the buffer */
-		else {
-			buf_ptr = NULL;
+	for(i = 0; i < t->tokens; i++) {
+		tok = &t->token[i];
+
+		if(tok->type == MT_TEXT) {
+			add_macro_output(&out, tok->str, tok->len);
+			continue;
 		}
 
-		log_debug_info(DEBUGL_MACROS, 2, "  Processing part: '%s'\n", temp_buffer);
+		log_debug_info(DEBUGL_MACROS, 2, "  Processing macro: '%s'\n", tok->str);
 
 		selected_macro = NULL;
+		free_macro = FALSE;
+		macro_options = 0;
+		result = OK;
 
-		/* we're in plain text... */
-		if(in_macro == FALSE) {
-
-			/* add the plain text to the end of the already processed buffer */
-			*output_buffer = (char *)realloc(*output_buffer, strlen(*output_buffer) + strlen(temp_buffer) + 1);
-			strcat(*output_buffer, temp_buffer);
-
-			log_debug_info(DEBUGL_MACROS, 2, "  Not currently in macro.  Running output (%lu): '%s'\n", (unsigned long)strlen(*output_buffer), *output_buffer);
-			in_macro = TRUE;
+		/* grab the macro value */
+		switch(tok->type) {
+		case MT_ARGV:
+			selected_macro = mac->argv[tok->code];
+			break;
+		case MT_USER:
+			selected_macro = macro_user[tok->code];
+			break;
+		case MT_MACROX:
+			/* most frequently used "x" macro gets a shortcut */
+			if(tok->code == MACRO_HOSTADDRESS && mac->host_ptr) {
+				selected_macro = mac->host_ptr->address;
+				break;
+			}
+			result = grab_macrox_value_r(mac, tok->code, NULL, NULL, &selected_macro, &free_macro);
+			macro_options = tok->options;
+			break;
+		case MT_OTHER:
+			result = grab_macro_value_r(mac, tok->str, &selected_macro, &macro_options, &free_macro);
+			break;
+		default:
+			result = ERROR;
+			break;
 		}
+		log_debug_info(DEBUGL_MACROS, 2, "  Processed '%s', Free: %d\n", tok->str, free_macro);
 
-		/* looks like we're in a macro, so process it... */
-		else {
-
-			/* by default, we only free when instructed */
-			free_macro = FALSE;
+		/* an error occurred - we couldn't parse the macro, so continue on */
+		if(result != OK) {
+			log_debug_info(DEBUGL_MACROS, 0, " WARNING: An error occurred processing macro '%s'!\n", tok->str);
+			if(free_macro == TRUE) {
+				my_free(selected_macro);
+			}
+			add_unexpanded_macro(&out, tok);
+		}
 
-			/* grab the macro value */
-			result = grab_macro_value_r(mac, temp_buffer, &selected_macro, &macro_options, &free_macro);
-			log_debug_info(DEBUGL_MACROS, 2, "  Processed '%s', Free: %d\n", temp_buffer, free_macro);
+		/* insert macro */
+		if(selected_macro != NULL) {
 
-			/* an error occurred - we couldn't parse the macro, so continue on */
-			if (result != OK) {
+			log_debug_info(DEBUGL_MACROS, 2, "  Processed '%s', Free: %d,  Cleaning options: %d\n", tok->str, free_macro, options);
 
-				log_debug_info(DEBUGL_MACROS, 0, " WARNING: An error occurred processing macro '%s'!\n", temp_buffer);
+			/* URL encode the macro if requested - this allocates new memory */
+			if(options & URL_ENCODE_MACRO_CHARS) {
+				original_macro = selected_macro;
+				selected_macro = get_url_encoded_string(selected_macro);
 				if(free_macro == TRUE) {
-					my_free(selected_macro);
-				}
-
-				/* an escaped $ is done by specifying two $$ next to each other */
-				if(!strcmp(temp_buffer, "")) {
-					log_debug_info(DEBUGL_MACROS, 2, "  Escaped $.  Running output (%lu): '%s'\n", (unsigned long)strlen(*output_buffer), *output_buffer);
-					*output_buffer = (char *)realloc(*output_buffer, strlen(*output_buffer) + 2);
-					strcat(*output_buffer, "$");
-				}
-
-				/* a non-macro, just some user-defined string between two $s */
-				else {
-					log_debug_info(DEBUGL_MACROS, 2, "  Non-macro.  Running output (%lu): '%s'\n", (unsigned long)strlen(*output_buffer), *output_buffer);
-
-					/* add the plain text to the end of the already processed buffer */
-					*output_buffer = (char *)realloc(*output_buffer, strlen(*output_buffer) + strlen(temp_buffer) + 3);
-					strcat(*output_buffer, "$");
-					strcat(*output_buffer, temp_buffer);
-
-					/* just could have been a stray $ */
-					if (buf_ptr != NULL) {
-						strcat(*output_buffer, "$");
-					}
+					my_free(original_macro);
 				}
+				free_macro = TRUE;
 			}
 
-			/* insert macro */
-			if (selected_macro != NULL) {
+			/* some macros should sometimes be cleaned */
+			if(macro_options & options & (STRIP_ILLEGAL_MACRO_CHARS | ESCAPE_MACRO_CHARS)) {
 
-				log_debug_info(DEBUGL_MACROS, 2, "  Processed '%s', Free: %d,  Cleaning options: %d\n", temp_buffer, free_macro, options);
+				char *cleaned_macro = NULL;
 
-				/* URL encode the macro if requested - this allocates new memory */
-				if(options & URL_ENCODE_MACRO_CHARS) {
-					original_macro = selected_macro;
-					selected_macro = get_url_encoded_string(selected_macro);
-					if(free_macro == TRUE) {
-						my_free(original_macro);
-					}
-					free_macro = TRUE;
-				}
-
-				/* some macros should sometimes be cleaned */
-				if(macro_options & options & (STRIP_ILLEGAL_MACRO_CHARS | ESCAPE_MACRO_CHARS)) {
-
-					char *cleaned_macro = NULL;
-
-					/* add the (cleaned) processed macro to the end of the already processed buffer */
-					if(selected_macro != NULL && (cleaned_macro = clean_macro_chars(selected_macro, options)) != NULL) {
-						*output_buffer = (char *)realloc(*output_buffer, strlen(*output_buffer) + strlen(cleaned_macro) + 1);
-						strcat(*output_buffer, cleaned_macro);
-						if(*cleaned_macro) {
-							my_free(cleaned_macro);
-						}
-
-						log_debug_info(DEBUGL_MACROS, 2, "  Cleaned macro.  Running output (%lu): '%s'\n", (unsigned long)strlen(*output_buffer), *output_buffer);
-					}
-				}
-
-				/* others are not cleaned */
-				else {
-					/* add the processed macro to the end of the already processed buffer */
-					if(selected_macro != NULL) {
-						*output_buffer = (char *)realloc(*output_buffer, strlen(*output_buffer) + strlen(selected_macro) + 1);
-						strcat(*output_buffer, selected_macro);
-
-						log_debug_info(DEBUGL_MACROS, 2, "  Uncleaned macro.  Running output (%lu): '%s'\n", (unsigned long)strlen(*output_buffer), *output_buffer);
+				/* add the (cleaned) processed macro to the end of the already processed buffer */
+				if(selected_macro != NULL && (cleaned_macro = clean_macro_chars(selected_macro, options)) != NULL) {
+					add_macro_output_str(&out, cleaned_macro);
+					/* empty macros are "cleaned" into a static string */
+					if(*selected_macro) {
+						my_free(cleaned_macro);
 					}
 				}
+			}
 
-				/* free memory if necessary (if we URL encoded the macro or we were told to do so by grab_macro_value()) */
-				if(free_macro == TRUE) {
-					my_free(selected_macro);
-				}
+			/* others are not cleaned */
+			else if(selected_macro != NULL) {
+				add_macro_output_str(&out, selected_macro);
+			}
 
-				log_debug_info(DEBUGL_MACROS, 2, "  Just finished macro.  Running output (%lu): '%s'\n", (unsigned long)strlen(*output_buffer), *output_buffer);
+			/* free memory if necessary (if we URL encoded the macro or we were told to do so by grab_macro_value()) */
+			if(free_macro == TRUE) {
+				my_free(selected_macro);
 			}
 
-			in_macro = FALSE;
-		} /* if(in_macro == TRUE) */
-	} /* while(buf_ptr) */
+			log_debug_info(DEBUGL_MACROS, 2, "  Just finished macro.  Running output (%lu): '%s'\n", (unsigned long)out.len, out.buf);
+		}
+	}
+
+	if(!cached)
+		free(t);
 
-	/* free copy of input buffer */
-	my_free(save_buffer);
+	*output_buffer = out.buf ? out.buf : strdup("");
 
 	log_debug_info(DEBUGL_MACROS, 1, "  Done.  Final output: '%s'\n", *output_buffer);
 	log_debug_info(DEBUGL_MACROS, 1, "**** END MACRO PROCESSING *************\n");
@@ -1306,6 +1499,8 @@ int grab_macrox_value(int macro_type, char *arg1, char *arg2, char **output, int
 	}
 
 
+static int grab_custom_variable_macro(customvariablesmember *var, char **output);
+
 /* calculates the value of a custom macro */
 int grab_custom_macro_value_r(nagios_macros *mac, char *macro_name, char *arg1, char *arg2, char **output) {
 	host *temp_host = NULL;
@@ -1341,7 +1536,7 @@ int grab_custom_macro_value_r(nagios_macros *mac, char *macro_name, char *arg1,
 				return ERROR;
 
 			/* get the host macro value */
-			result = grab_custom_object_macro_r(mac, macro_name + 5, temp_host->custom_variables, output);
+			result = grab_custom_variable_macro(find_indexed_custom_variable(temp_host->custom_variables, &temp_host->custom_variable_index, macro_name + 5), output);
 			}
 
 		/* a host macro with a hostgroup name and delimiter */
@@ -1387,7 +1582,7 @@ int grab_custom_macro_value_r(nagios_macros *mac, char *macro_name, char *arg1,
 				return ERROR;
 
 			/* get the service macro value */
-			result = grab_custom_object_macro_r(mac, macro_name + 8, temp_service->custom_variables, output);
+			result = grab_custom_variable_macro(find_indexed_custom_variable(temp_service->custom_variables, &temp_service->custom_variable_index, macro_name + 8), output);
 			}
 
 		/* else and ondemand macro... */
@@ -1399,7 +1594,7 @@ int grab_custom_macro_value_r(nagios_macros *mac, char *macro_name, char *arg1,
 			if((temp_service = find_service((mac->host_ptr) ? mac->host_ptr->name : NULL, arg2))) {
 
 				/* get the service macro value */
-				result = grab_custom_object_macro_r(mac, macro_name + 8, temp_service->custom_variables, output);
+				result = grab_custom_variable_macro(find_indexed_custom_variable(temp_service->custom_variables, &temp_service->custom_variable_index, macro_name + 8), output);
 				}
 
 			/* else we have a service macro with a servicegroup name and a delimiter... */
@@ -1454,7 +1649,7 @@ int grab_custom_macro_value_r(nagios_macros *mac, char *macro_name, char *arg1,
 				return ERROR;
 
 			/* get the contact macro value */
-			result = grab_custom_object_macro_r(mac, macro_name + 8, temp_contact->custom_variables, output);
+			result = grab_custom_variable_macro(find_indexed_custom_variable(temp_contact->custom_variables, &temp_contact->custom_variable_index, macro_name + 8), output);
 			}
 
 		/* a contact macro with a contactgroup name and delimiter */
@@ -2472,35 +2667,28 @@ int grab_standard_contactgroup_macro(int macro_type, contactgroup *temp_contactg
 	}
 
 
-/* computes a custom object macro */
-int grab_custom_object_macro_r(nagios_macros *mac, char *macro_name, customvariablesmember *vars, char **output) {
-	customvariablesmember *temp_customvariablesmember = NULL;
-	int result = ERROR;
+/* computes the macro for a custom variable we've looked up */
+static int grab_custom_variable_macro(customvariablesmember *var, char **output) {
 
-	if(macro_name == NULL || output == NULL)
+	if(output == NULL)
 		return ERROR;
 
-	/* get the custom variable */
-	for(temp_customvariablesmember = vars; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
+	/* expand nonexistant custom variables as an empty string */
+	if(var == NULL)
+		*output = "";
+	else if(var->variable_value)
+		*output = var->variable_value;
 
-		if(temp_customvariablesmember->variable_name == NULL)
-			continue;
+	return OK;
+	}
 
-		if(!strcmp(macro_name, temp_customvariablesmember->variable_name)) {
-			if(temp_customvariablesmember->variable_value)
-				*output = temp_customvariablesmember->variable_value;
-			result = OK;
-			break;
-			}
-		}
+/* computes a custom object macro */
+int grab_custom_object_macro_r(nagios_macros *mac, char *macro_name, customvariablesmember *vars, char **output) {
 
-	/* expand nonexistant custom variables as an empty string */
-	if( result == ERROR ){
-		*output = "";
-		result = OK;
-		}
+	if(macro_name == NULL || output == NULL)
+		return ERROR;
 
-	return result;
+	return grab_custom_variable_macro(find_custom_variable(vars, macro_name), output);
 	}
 
 int grab_custom_object_macro(char *macro_name, customvariablesmember *vars, char **output) {
@@ -2877,6 +3065,9 @@ int free_macrox_names(void) {
 	for(x = 0; x < MACRO_X_COUNT; x++)
 		my_free(macro_x_names[x]);
 
+	/* the templates refer to the macros by their codes */
+	free_macro_templates();
+
 	return OK;
 	}
 
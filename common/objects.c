@@ -353,6 +353,244 @@ static int create_object_table(const char *name, unsigned int elems, unsigned in
 #define mktable(name, id) \
 	create_object_table(#name, ocount[id], sizeof(name *), (void **)&name##_ary)
 
+/*
+ * Hosts and services are allocated from one block per type, in the
+ * order of their ids, so that going through all of them walks memory
+ * in order instead of jumping all over the heap. Objects added after
+ * the blocks are full get allocated on their own.
+ */
+static host *host_block;
+static service *service_block;
+static unsigned int host_block_size, service_block_size;
+
+#define alloc_object(name, id) \
+	((id) < name##_block_size ? &name##_block[id] : calloc(1, sizeof(name)))
+#define in_object_block(name, ptr) \
+	(name##_block && (ptr) >= name##_block && (ptr) < name##_block + name##_block_size)
+
+/*
+ * Strings that many objects have in common (time period names, check
+ * commands, service descriptions, notes, custom variables...) are
+ * stored only once, packed into large slabs that are all released at
+ * once along with the rest of the object data. The table maps each
+ * string to its single copy.
+ *
+ * A shared copy is never changed once it's been added. Whoever wants
+ * to give an object a different value points it at a new string and
+ * hands the old one to free_object_string(). Strings are looked up,
+ * added and replaced from more than one thread, so the table and the
+ * deferred frees are locked.
+ */
+#define OBJECT_STRING_SLAB_MIN (4 * 1024)
+#define OBJECT_STRING_SLAB_MAX (64 * 1024)
+
+struct object_string_slab {
+	struct object_string_slab *next;
+	size_t size, used;
+	char data[1];
+};
+
+static struct {
+	dkhash_table *table;
+	struct object_string_slab *slabs;
+	struct object_string_stats stats;
+	} object_strings;
+
+#ifdef NSCORE
+#include <pthread.h>
+static pthread_mutex_t object_strings_lock = PTHREAD_MUTEX_INITIALIZER;
+#define lock_object_strings() pthread_mutex_lock(&object_strings_lock)
+#define unlock_object_strings() pthread_mutex_unlock(&object_strings_lock)
+#else
+#define lock_object_strings()
+#define unlock_object_strings()
+#endif
+
+static char *intern_object_string_locked(const char *str) {
+	struct object_string_slab *slab;
+	size_t len;
+	char *ret;
+
+	if(!object_strings.table && !(object_strings.table = dkhash_create(1024)))
+		return NULL;
+
+	len = strlen(str) + 1;
+	object_strings.stats.strings++;
+	object_strings.stats.bytes += len;
+	if((ret = dkhash_get(object_strings.table, str, NULL)))
+		return ret;
+
+	slab = object_strings.slabs;
+	if(!slab || slab->size - slab->used < len) {
+		/* slabs grow with the arena. big strings get a slab of their own */
+		size_t size = object_strings.stats.size;
+
+		if(size < OBJECT_STRING_SLAB_MIN)
+			size = OBJECT_STRING_SLAB_MIN;
+		else if(size > OBJECT_STRING_SLAB_MAX)
+			size = OBJECT_STRING_SLAB_MAX;
+		if(len > size / 8)
+			size = len;
+
+		if(!(slab = malloc(sizeof(*slab) + size)))
+			return NULL;
+		slab->size = size;
+		slab->used = 0;
+		if(size == len && object_strings.slabs) {
+			slab->next = object_strings.slabs->next;
+			object_strings.slabs->next = slab;
+			}
+		else {
+			slab->next = object_strings.slabs;
+			object_strings.slabs = slab;
+			}
+		object_strings.stats.size += sizeof(*slab) + size;
+		}
+
+	ret = slab->data + slab->used;
+	memcpy(ret, str, len);
+	if(dkhash_insert(object_strings.table, ret, NULL, ret) != DKHASH_OK)
+		return NULL;
+	slab->used += len;
+	object_strings.stats.unique++;
+
+	return ret;
+	}
+
+char *intern_object_string(const char *str) {
+	char *ret;
+
+	if(str == NULL)
+		return NULL;
+
+	lock_object_strings();
+	ret = intern_object_string_locked(str);
+	unlock_object_strings();
+
+	return ret;
+	}
+
+/* returns the shared copy of str, if there is one */
+static char *find_object_string(const char *str) {
+	char *ret;
+
+	lock_object_strings();
+	ret = object_strings.table ? dkhash_get(object_strings.table, str, NULL) : NULL;
+	unlock_object_strings();
+
+	return ret;
+	}
+
+/*
+ * While state is being written out in the background, the writer may
+ * still be looking at strings the main thread replaces. Those are kept
+ * here until the write is done.
+ */
+static struct {
+	int active;
+	char **strings;
+	size_t count, size;
+	} deferred_frees;
+
+void free_object_string(char *str) {
+	char **strings;
+
+	if(!str || find_object_string(str) == str)
+		return;
+
+	lock_object_strings();
+	if(deferred_frees.active) {
+		if(deferred_frees.count == deferred_frees.size) {
+			size_t size = deferred_frees.size ? deferred_frees.size * 2 : 64;
+			if((strings = realloc(deferred_frees.strings, size * sizeof(char *)))) {
+				deferred_frees.strings = strings;
+				deferred_frees.size = size;
+				}
+			}
+		if(deferred_frees.count < deferred_frees.size)
+			deferred_frees.strings[deferred_frees.count++] = str;
+		/* if not, leaking it is better than pulling it out from under the writer */
+		unlock_object_strings();
+		return;
+		}
+	unlock_object_strings();
+
+	free(str);
+	}
+
+void defer_object_string_frees(int defer) {
+	char **strings;
+	size_t i, count;
+
+	lock_object_strings();
+	deferred_frees.active = defer;
+	if(defer) {
+		unlock_object_strings();
+		return;
+		}
+	strings = deferred_frees.strings;
+	count = deferred_frees.count;
+	deferred_frees.strings = NULL;
+	deferred_frees.count = deferred_frees.size = 0;
+	unlock_object_strings();
+
+	for(i = 0; i < count; i++)
+		free(strings[i]);
+	free(strings);
+	}
+
+void get_object_string_stats(struct object_string_stats *stats) {
+	lock_object_strings();
+	*stats = object_strings.stats;
+	unlock_object_strings();
+	}
+
+/* only called once no other thread can be looking at the objects */
+static void free_object_strings(void) {
+	struct object_string_slab *slab, *next;
+
+	defer_object_string_frees(FALSE);
+
+	lock_object_strings();
+	for(slab = object_strings.slabs; slab; slab = next) {
+		next = slab->next;
+		free(slab);
+		}
+	if(object_strings.table)
+		dkhash_destroy(object_strings.table);
+	memset(&object_strings, 0, sizeof(object_strings));
+	unlock_object_strings();
+	}
+
+/* frees the custom variables of a host, service or contact */
+static void free_custom_variables(customvariablesmember *vars) {
+	customvariablesmember *next;
+
+	for(; vars != NULL; vars = next) {
+		next = vars->next;
+		free_object_string(vars->variable_name);
+		free_object_string(vars->variable_value);
+		my_free(vars);
+		}
+	}
+
+static customvariablesmember *add_custom_variable(customvariablesmember **object_ptr, char *varname, char *varvalue, int shared);
+static customvariablesmember *index_custom_variable(customvariablesindex *idx, customvariablesmember *var);
+
+static void free_host_struct(host *h) {
+	if(in_object_block(host, h))
+		memset(h, 0, sizeof(*h));
+	else
+		free(h);
+	}
+
+static void free_service_struct(service *s) {
+	if(in_object_block(service, s))
+		memset(s, 0, sizeof(*s));
+	else
+		free(s);
+	}
+
 /* ocount is an array with NUM_OBJECT_TYPES members */
 int create_object_tables(unsigned int *ocount)
 {
@@ -380,6 +618,14 @@ int create_object_tables(unsigned int *ocount)
 		return ERROR;
 	if (mktable(service, SERVICE_SKIPLIST) != OK)
 		return ERROR;
+	if (!object_strings.table && !(object_strings.table = dkhash_create(ocount[HOST_SKIPLIST] + ocount[SERVICE_SKIPLIST] + 1024)))
+		return ERROR;
+	if (ocount[HOST_SKIPLIST] && !(host_block = calloc(ocount[HOST_SKIPLIST], sizeof(host))))
+		return ERROR;
+	host_block_size = ocount[HOST_SKIPLIST];
+	if (ocount[SERVICE_SKIPLIST] && !(service_block = calloc(ocount[SERVICE_SKIPLIST], sizeof(service))))
+		return ERROR;
+	service_block_size = ocount[SERVICE_SKIPLIST];
 	if (mktable(contact, CONTACT_SKIPLIST) != OK)
 		return ERROR;
 	if (mktable(hostgroup, HOSTGROUP_SKIPLIST) != OK)
@@ -465,7 +711,7 @@ timeperiodexclusion *add_exclusion_to_timeperiod(timeperiod *period, char *name)
 	if((new_timeperiodexclusion = (timeperiodexclusion *)malloc(sizeof(timeperiodexclusion))) == NULL)
 		return NULL;
 
-	new_timeperiodexclusion->timeperiod_name = (char *)strdup(name);
+	new_timeperiodexclusion->timeperiod_name = intern_object_string(name);
 
 	new_timeperiodexclusion->next = period->exclusions;
 	period->exclusions = new_timeperiodexclusion;
@@ -648,18 +894,20 @@ host *add_host(char *name, char *display_name, char *alias, char *address, char
 		return NULL;
 		}
 
-	new_host = calloc(1, sizeof(*new_host));
+	new_host = alloc_object(host, num_objects.hosts);
+	if(!new_host)
+		return NULL;
 
 	/* assign string vars */
 	new_host->name = name;
 	new_host->display_name = display_name ? display_name : new_host->name;
 	new_host->alias = alias ? alias : new_host->name;
 	new_host->address = address ? address : new_host->name;
-	new_host->check_period = check_tp ? (char *)strdup(check_tp->name) : NULL;
+	new_host->check_period = check_tp ? intern_object_string(check_tp->name) : NULL;
 	new_host->check_period_ptr = check_tp;
-	new_host->notification_period = notify_tp ? (char *)strdup(notify_tp->name) : NULL;
+	new_host->notification_period = notify_tp ? intern_object_string(notify_tp->name) : NULL;
 	new_host->notification_period_ptr = notify_tp;
-	new_host->event_handler_period = event_handler_tp ? (char *)strdup(event_handler_tp->name) : NULL;
+	new_host->event_handler_period = event_handler_tp ? intern_object_string(event_handler_tp->name) : NULL;
 	new_host->event_handler_period_ptr = event_handler_tp;
 	new_host->check_command = check_command;
 	new_host->event_handler = event_handler;
@@ -673,6 +921,7 @@ host *add_host(char *name, char *display_name, char *alias, char *address, char
 
 	/* duplicate non-string vars */
 	new_host->hourly_value = hourly_value;
+	new_host->initial_state = initial_state;
 	new_host->max_attempts = max_attempts;
 	new_host->check_interval = check_interval;
 	new_host->retry_interval = retry_interval;
@@ -734,7 +983,7 @@ host *add_host(char *name, char *display_name, char *alias, char *address, char
 
 	/* handle errors */
 	if(result == ERROR) {
-		my_free(new_host);
+		free_host_struct(new_host);
 		return NULL;
 		}
 
@@ -768,7 +1017,7 @@ hostsmember *add_parent_host_to_host(host *hst, char *host_name) {
 		return NULL;
 
 	/* duplicate string vars */
-	if((new_hostsmember->host_name = (char *)strdup(host_name)) == NULL)
+	if((new_hostsmember->host_name = intern_object_string(host_name)) == NULL)
 		result = ERROR;
 
 	/* handle errors */
@@ -801,9 +1050,8 @@ servicesmember *add_parent_service_to_service(service *svc, char *host_name, cha
 	if((sm = calloc(1, sizeof(*sm))) == NULL)
 		return NULL;
 
-	if ((sm->host_name = strdup(host_name)) == NULL || (sm->service_description = strdup(description)) == NULL) {
+	if ((sm->host_name = intern_object_string(host_name)) == NULL || (sm->service_description = intern_object_string(description)) == NULL) {
 		/* there was an error copying (description is NULL now) */
-		my_free(sm->host_name);
 		free(sm);
 		return NULL;
 		}
@@ -933,7 +1181,7 @@ contactsmember *add_contact_to_host(host *hst, char *contact_name) {
 /* adds a custom variable to a host */
 customvariablesmember *add_custom_variable_to_host(host *hst, char *varname, char *varvalue) {
 
-	return add_custom_variable_to_object(&hst->custom_variables, varname, varvalue);
+	return index_custom_variable(&hst->custom_variable_index, add_custom_variable(&hst->custom_variables, varname, varvalue, TRUE));
 	}
 
 
@@ -1211,8 +1459,8 @@ contact *add_contact(char *name, char *alias, char *email, char *pager, char **a
 		return NULL;
 
 
-	new_contact->host_notification_period = htp ? (char *)strdup(htp->name) : NULL;
-	new_contact->service_notification_period = stp ? (char *)strdup(stp->name) : NULL;
+	new_contact->host_notification_period = htp ? intern_object_string(htp->name) : NULL;
+	new_contact->service_notification_period = stp ? intern_object_string(stp->name) : NULL;
 	new_contact->host_notification_period_ptr = htp;
 	new_contact->service_notification_period_ptr = stp;
 	new_contact->name = name;
@@ -1339,7 +1587,7 @@ commandsmember *add_service_notification_command_to_contact(contact *cntct, char
 /* adds a custom variable to a contact */
 customvariablesmember *add_custom_variable_to_contact(contact *cntct, char *varname, char *varvalue) {
 
-	return add_custom_variable_to_object(&cntct->custom_variables, varname, varvalue);
+	return index_custom_variable(&cntct->custom_variable_index, add_custom_variable(&cntct->custom_variables, varname, varvalue, TRUE));
 	}
 
 
@@ -1476,7 +1724,7 @@ service *add_service(char *host_name, char *description, char *display_name, cha
 		}
 
 	/* allocate memory */
-	new_service = calloc(1, sizeof(*new_service));
+	new_service = alloc_object(service, num_objects.services);
 	if(!new_service)
 		return NULL;
 
@@ -1485,47 +1733,48 @@ service *add_service(char *host_name, char *description, char *display_name, cha
 	new_service->check_period_ptr = cp;
 	new_service->event_handler_period_ptr = ep;
 	new_service->host_ptr = h;
-	new_service->check_period = cp ? (char *)strdup(cp->name) : NULL;
-	new_service->notification_period = np ? (char *)strdup(np->name) : NULL;
-	new_service->event_handler_period = ep ? (char *)strdup(ep->name) : NULL;
+	new_service->check_period = cp ? intern_object_string(cp->name) : NULL;
+	new_service->notification_period = np ? intern_object_string(np->name) : NULL;
+	new_service->event_handler_period = ep ? intern_object_string(ep->name) : NULL;
 	new_service->host_name = h->name;
-	if((new_service->description = (char *)strdup(description)) == NULL)
+	if((new_service->description = intern_object_string(description)) == NULL)
 		result = ERROR;
 	if(display_name) {
-		if((new_service->display_name = (char *)strdup(display_name)) == NULL)
+		if((new_service->display_name = intern_object_string(display_name)) == NULL)
 			result = ERROR;
 		}
 	else {
 		new_service->display_name = new_service->description;
 		}
-	if((new_service->check_command = (char *)strdup(check_command)) == NULL)
+	if((new_service->check_command = intern_object_string(check_command)) == NULL)
 		result = ERROR;
 	if(event_handler) {
-		if((new_service->event_handler = (char *)strdup(event_handler)) == NULL)
+		if((new_service->event_handler = intern_object_string(event_handler)) == NULL)
 			result = ERROR;
 		}
 	if(notes) {
-		if((new_service->notes = (char *)strdup(notes)) == NULL)
+		if((new_service->notes = intern_object_string(notes)) == NULL)
 			result = ERROR;
 		}
 	if(notes_url) {
-		if((new_service->notes_url = (char *)strdup(notes_url)) == NULL)
+		if((new_service->notes_url = intern_object_string(notes_url)) == NULL)
 			result = ERROR;
 		}
 	if(action_url) {
-		if((new_service->action_url = (char *)strdup(action_url)) == NULL)
+		if((new_service->action_url = intern_object_string(action_url)) == NULL)
 			result = ERROR;
 		}
 	if(icon_image) {
-		if((new_service->icon_image = (char *)strdup(icon_image)) == NULL)
+		if((new_service->icon_image = intern_object_string(icon_image)) == NULL)
 			result = ERROR;
 		}
 	if(icon_image_alt) {
-		if((new_service->icon_image_alt = (char *)strdup(icon_image_alt)) == NULL)
+		if((new_service->icon_image_alt = intern_object_string(icon_image_alt)) == NULL)
 			result = ERROR;
 		}
 
 	new_service->hourly_value = hourly_value;
+	new_service->initial_state = initial_state;
 	new_service->check_interval = check_interval;
 	new_service->retry_interval = retry_interval;
 	new_service->max_attempts = max_attempts;
@@ -1586,11 +1835,7 @@ service *add_service(char *host_name, char *description, char *display_name, cha
 		my_free(new_service->plugin_output);
 		my_free(new_service->long_plugin_output);
 #endif
-		my_free(new_service->event_handler);
-		my_free(new_service->check_command);
-		my_free(new_service->description);
-		if(display_name)
-			my_free(new_service->display_name);
+		free_service_struct(new_service);
 		return NULL;
 		}
 
@@ -1623,7 +1868,7 @@ contactsmember *add_contact_to_service(service *svc, char *contact_name) {
 /* adds a custom variable to a service */
 customvariablesmember *add_custom_variable_to_service(service *svc, char *varname, char *varvalue) {
 
-	return add_custom_variable_to_object(&svc->custom_variables, varname, varvalue);
+	return index_custom_variable(&svc->custom_variable_index, add_custom_variable(&svc->custom_variables, varname, varvalue, TRUE));
 	}
 
 
@@ -1719,7 +1964,7 @@ serviceescalation *add_serviceescalation(char *host_name, char *description, int
 	new_serviceescalation->service_ptr = svc;
 	new_serviceescalation->escalation_period_ptr = tp;
 	if(tp)
-		new_serviceescalation->escalation_period = (char *)strdup(tp->name);
+		new_serviceescalation->escalation_period = intern_object_string(tp->name);
 
 	new_serviceescalation->first_notification = first_notification;
 	new_serviceescalation->last_notification = last_notification;
@@ -1788,7 +2033,7 @@ servicedependency *add_service_dependency(char *dependent_host_name, char *depen
 	new_servicedependency->host_name = parent->host_name;
 	new_servicedependency->service_description = parent->description;
 	if (tp)
-		new_servicedependency->dependency_period = (char *)strdup(tp->name);
+		new_servicedependency->dependency_period = intern_object_string(tp->name);
 
 	new_servicedependency->dependency_type = (dependency_type == EXECUTION_DEPENDENCY) ? EXECUTION_DEPENDENCY : NOTIFICATION_DEPENDENCY;
 	new_servicedependency->inherits_parent = (inherits_parent > 0) ? TRUE : FALSE;
@@ -1853,7 +2098,7 @@ hostdependency *add_host_dependency(char *dependent_host_name, char *host_name,
 	new_hostdependency->dependent_host_name = child->name;
 	new_hostdependency->host_name = parent->name;
 	if(tp)
-		new_hostdependency->dependency_period = (char *)strdup(tp->name);
+		new_hostdependency->dependency_period = intern_object_string(tp->name);
 
 	new_hostdependency->dependency_type = (dependency_type == EXECUTION_DEPENDENCY) ? EXECUTION_DEPENDENCY : NOTIFICATION_DEPENDENCY;
 	new_hostdependency->inherits_parent = (inherits_parent > 0) ? TRUE : FALSE;
@@ -1909,7 +2154,7 @@ hostescalation *add_hostescalation(char *host_name, int first_notification, int
 	/* assign vars. Object names are immutable, so no need to copy */
 	new_hostescalation->host_name = h->name;
 	new_hostescalation->host_ptr = h;
-	new_hostescalation->escalation_period = tp ? (char *)strdup(tp->name) : NULL;
+	new_hostescalation->escalation_period = tp ? intern_object_string(tp->name) : NULL;
 	new_hostescalation->escalation_period_ptr = tp;
 	new_hostescalation->first_notification = first_notification;
 	new_hostescalation->last_notification = last_notification;
@@ -1979,6 +2224,84 @@ contactsmember *add_contact_to_object(contactsmember **object_ptr, char *contact
 
 /* adds a custom variable to an object */
 customvariablesmember *add_custom_variable_to_object(customvariablesmember **object_ptr, char *varname, char *varvalue) {
+	return add_custom_variable(object_ptr, varname, varvalue, FALSE);
+	}
+
+/* finds a custom variable in a list of them */
+customvariablesmember *find_custom_variable(customvariablesmember *vars, const char *varname) {
+	customvariablesmember *temp_customvariablesmember = NULL;
+
+	if(varname == NULL)
+		return NULL;
+
+	for(temp_customvariablesmember = vars; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
+		if(temp_customvariablesmember->variable_name == varname || (temp_customvariablesmember->variable_name && !strcmp(varname, temp_customvariablesmember->variable_name)))
+			return temp_customvariablesmember;
+		}
+
+	return NULL;
+	}
+
+/* finds a custom variable of a host, service or contact */
+customvariablesmember *find_indexed_custom_variable(customvariablesmember *vars, const customvariablesindex *idx, const char *varname) {
+	unsigned int low = 0, high, mid;
+
+	if(varname == NULL)
+		return NULL;
+
+	/* something other than add_custom_variable_to_*() has been at the list */
+	if(idx == NULL || idx->head != vars)
+		return find_custom_variable(vars, varname);
+
+	/* the first of any variables with the same name is the newest, as in the list */
+	high = idx->count;
+	while(low < high) {
+		mid = low + (high - low) / 2;
+		if(strcmp(idx->by_name[mid]->variable_name, varname) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+		}
+	if(low < idx->count && (idx->by_name[low]->variable_name == varname || !strcmp(idx->by_name[low]->variable_name, varname)))
+		return idx->by_name[low];
+
+	return NULL;
+	}
+
+/* adds a variable that was just put at the head of its list to the list's index */
+static customvariablesmember *index_custom_variable(customvariablesindex *idx, customvariablesmember *var) {
+	customvariablesmember **by_name;
+	unsigned int low = 0, high, mid;
+
+	if(var == NULL || idx->head != var->next)
+		return var;
+
+	if(idx->count == idx->size) {
+		if(!(by_name = realloc(idx->by_name, (idx->size ? idx->size * 2 : 4) * sizeof(*by_name)))) {
+			/* lookups will walk the list instead */
+			return var;
+			}
+		idx->by_name = by_name;
+		idx->size = idx->size ? idx->size * 2 : 4;
+		}
+
+	high = idx->count;
+	while(low < high) {
+		mid = low + (high - low) / 2;
+		if(strcmp(idx->by_name[mid]->variable_name, var->variable_name) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+		}
+	memmove(&idx->by_name[low + 1], &idx->by_name[low], (idx->count - low) * sizeof(*idx->by_name));
+	idx->by_name[low] = var;
+	idx->count++;
+	idx->head = var;
+
+	return var;
+	}
+
+static customvariablesmember *add_custom_variable(customvariablesmember **object_ptr, char *varname, char *varvalue, int shared) {
 	customvariablesmember *new_customvariablesmember = NULL;
 
 	/* make sure we have the data we need */
@@ -1997,15 +2320,24 @@ customvariablesmember *add_custom_variable_to_object(customvariablesmember **obj
 		logit(NSLOG_CONFIG_ERROR, TRUE, "Error: Could not allocate memory for custom variable\n");
 		return NULL;
 		}
-	if((new_customvariablesmember->variable_name = (char *)strdup(varname)) == NULL) {
+	if(shared)
+		new_customvariablesmember->variable_name = intern_object_string(varname);
+	else
+		new_customvariablesmember->variable_name = (char *)strdup(varname);
+	if(new_customvariablesmember->variable_name == NULL) {
 		logit(NSLOG_CONFIG_ERROR, TRUE, "Error: Could not allocate memory for custom variable name\n");
 		my_free(new_customvariablesmember);
 		return NULL;
 		}
 	if(varvalue) {
-		if((new_customvariablesmember->variable_value = (char *)strdup(varvalue)) == NULL) {
+		if(shared)
+			new_customvariablesmember->variable_value = intern_object_string(varvalue);
+		else
+			new_customvariablesmember->variable_value = (char *)strdup(varvalue);
+		if(new_customvariablesmember->variable_value == NULL) {
 			logit(NSLOG_CONFIG_ERROR, TRUE, "Error: Could not allocate memory for custom variable value\n");
-			my_free(new_customvariablesmember->variable_name);
+			if(!shared)
+				my_free(new_customvariablesmember->variable_name);
 			my_free(new_customvariablesmember);
 			return NULL;
 			}
@@ -2573,8 +2905,6 @@ int free_object_data(void) {
 	contactsmember *next_contactsmember = NULL;
 	contactgroupsmember *this_contactgroupsmember = NULL;
 	contactgroupsmember *next_contactgroupsmember = NULL;
-	customvariablesmember *this_customvariablesmember = NULL;
-	customvariablesmember *next_customvariablesmember = NULL;
 	commandsmember *this_commandsmember = NULL;
 	commandsmember *next_commandsmember = NULL;
 	unsigned int i = 0, x = 0;
@@ -2619,13 +2949,13 @@ int free_object_data(void) {
 		/* free exclusions */
 		for(this_timeperiodexclusion = this_timeperiod->exclusions; this_timeperiodexclusion != NULL; this_timeperiodexclusion = next_timeperiodexclusion) {
 			next_timeperiodexclusion = this_timeperiodexclusion->next;
-			my_free(this_timeperiodexclusion->timeperiod_name);
 			my_free(this_timeperiodexclusion);
 			}
 
 		if (this_timeperiod->alias != this_timeperiod->name)
 			my_free(this_timeperiod->alias);
 		my_free(this_timeperiod->name);
+		my_free(this_timeperiod->cache);
 		my_free(this_timeperiod);
 		}
 
@@ -2641,7 +2971,6 @@ int free_object_data(void) {
 		this_hostsmember = this_host->parent_hosts;
 		while(this_hostsmember != NULL) {
 			next_hostsmember = this_hostsmember->next;
-			my_free(this_hostsmember->host_name);
 			my_free(this_hostsmember);
 			this_hostsmember = next_hostsmember;
 			}
@@ -2679,14 +3008,8 @@ int free_object_data(void) {
 			}
 
 		/* free memory for custom variables */
-		this_customvariablesmember = this_host->custom_variables;
-		while(this_customvariablesmember != NULL) {
-			next_customvariablesmember = this_customvariablesmember->next;
-			my_free(this_customvariablesmember->variable_name);
-			my_free(this_customvariablesmember->variable_value);
-			my_free(this_customvariablesmember);
-			this_customvariablesmember = next_customvariablesmember;
-			}
+		free_custom_variables(this_host->custom_variables);
+		my_free(this_host->custom_variable_index.by_name);
 
 		if(this_host->display_name != this_host->name)
 			my_free(this_host->display_name);
@@ -2695,9 +3018,9 @@ int free_object_data(void) {
 		if(this_host->address != this_host->name)
 			my_free(this_host->address);
 		my_free(this_host->name);
-		my_free(this_host->check_period);
-		my_free(this_host->notification_period);
-		my_free(this_host->event_handler_period);
+		free_object_string(this_host->check_period);
+		free_object_string(this_host->notification_period);
+		free_object_string(this_host->event_handler_period);
 #ifdef NSCORE
 		my_free(this_host->plugin_output);
 		my_free(this_host->long_plugin_output);
@@ -2707,8 +3030,8 @@ int free_object_data(void) {
 		free_objectlist(&this_host->notify_deps);
 		free_objectlist(&this_host->exec_deps);
 		free_objectlist(&this_host->escalation_list);
-		my_free(this_host->check_command);
-		my_free(this_host->event_handler);
+		free_object_string(this_host->check_command);
+		free_object_string(this_host->event_handler);
 		my_free(this_host->notes);
 		my_free(this_host->notes_url);
 		my_free(this_host->action_url);
@@ -2716,8 +3039,10 @@ int free_object_data(void) {
 		my_free(this_host->icon_image_alt);
 		my_free(this_host->vrml_image);
 		my_free(this_host->statusmap_image);
-		my_free(this_host);
+		free_host_struct(this_host);
 		}
+	my_free(host_block);
+	host_block_size = 0;
 
 	/* reset pointers */
 	my_free(host_ary);
@@ -2797,22 +3122,16 @@ int free_object_data(void) {
 			}
 
 		/* free memory for custom variables */
-		this_customvariablesmember = this_contact->custom_variables;
-		while(this_customvariablesmember != NULL) {
-			next_customvariablesmember = this_customvariablesmember->next;
-			my_free(this_customvariablesmember->variable_name);
-			my_free(this_customvariablesmember->variable_value);
-			my_free(this_customvariablesmember);
-			this_customvariablesmember = next_customvariablesmember;
-			}
+		free_custom_variables(this_contact->custom_variables);
+		my_free(this_contact->custom_variable_index.by_name);
 
 		if (this_contact->alias != this_contact->name)
 			my_free(this_contact->alias);
 		my_free(this_contact->name);
 		my_free(this_contact->email);
 		my_free(this_contact->pager);
-		my_free(this_contact->host_notification_period);
-		my_free(this_contact->service_notification_period);
+		free_object_string(this_contact->host_notification_period);
+		free_object_string(this_contact->service_notification_period);
 		for(j = 0; j < MAX_CONTACT_ADDRESSES; j++)
 			my_free(this_contact->address[j]);
 
@@ -2867,22 +3186,14 @@ int free_object_data(void) {
 			}
 
 		/* free memory for custom variables */
-		this_customvariablesmember = this_service->custom_variables;
-		while(this_customvariablesmember != NULL) {
-			next_customvariablesmember = this_customvariablesmember->next;
-			my_free(this_customvariablesmember->variable_name);
-			my_free(this_customvariablesmember->variable_value);
-			my_free(this_customvariablesmember);
-			this_customvariablesmember = next_customvariablesmember;
-			}
-
-		if(this_service->display_name != this_service->description)
-			my_free(this_service->display_name);
-		my_free(this_service->description);
-		my_free(this_service->check_command);		
-		my_free(this_service->check_period);
-		my_free(this_service->notification_period);
-		my_free(this_service->event_handler_period);
+		free_custom_variables(this_service->custom_variables);
+		my_free(this_service->custom_variable_index.by_name);
+
+		free_object_string(this_service->check_command);
+		free_object_string(this_service->check_period);
+		free_object_string(this_service->notification_period);
+		free_object_string(this_service->event_handler_period);
+		free_object_string(this_service->event_handler);
 #ifdef NSCORE
 		my_free(this_service->plugin_output);
 		my_free(this_service->long_plugin_output);
@@ -2896,14 +3207,10 @@ int free_object_data(void) {
 		free_objectlist(&this_service->notify_deps);
 		free_objectlist(&this_service->exec_deps);
 		free_objectlist(&this_service->escalation_list);
-		my_free(this_service->event_handler);
-		my_free(this_service->notes);
-		my_free(this_service->notes_url);
-		my_free(this_service->action_url);
-		my_free(this_service->icon_image);
-		my_free(this_service->icon_image_alt);
-		my_free(this_service);
+		free_service_struct(this_service);
 		}
+	my_free(service_block);
+	service_block_size = 0;
 
 	/* reset pointers */
 	my_free(service_ary);
@@ -2988,6 +3295,9 @@ int free_object_data(void) {
 	/* reset pointers */
 	my_free(hostescalation_ary);
 
+	/* the strings go last, as everything above may have used them */
+	free_object_strings();
+
 	/* we no longer have any objects */
 	memset(&num_objects, 0, sizeof(num_objects));
 
@@ -20,6 +20,7 @@ struct object_count num_objects;
 
 int process_performance_data;
 char *status_file;
+char *binary_status_file;
 
 int nagios_pid = 0;
 int daemon_mode = FALSE;
@@ -56,6 +57,7 @@ void init_shared_cfg_vars(int first_time) {
 
 	process_performance_data = DEFAULT_PROCESS_PERFORMANCE_DATA;
 	status_file = NULL;
+	binary_status_file = NULL;
 
 	check_external_commands = DEFAULT_CHECK_EXTERNAL_COMMANDS;
 
@@ -468,17 +470,20 @@ void strip(char *buffer) {
  **************************************************/
 /* dual hash function */
 int hashfunc(const char *name1, const char *name2, int hashslots) {
-	unsigned int i, result;
+	const unsigned char *p;
+	unsigned int result;
 
+	/* sdbm - just adding up the characters put names like "host12" and
+	   "host21" in the same slot and used only a few hundred slots */
 	result = 0;
 
 	if(name1)
-		for(i = 0; i < strlen(name1); i++)
-			result += name1[i];
+		for(p = (const unsigned char *)name1; *p; p++)
+			result = *p + (result << 6) + (result << 16) - result;
 
 	if(name2)
-		for(i = 0; i < strlen(name2); i++)
-			result += name2[i];
+		for(p = (const unsigned char *)name2; *p; p++)
+			result = *p + (result << 6) + (result << 16) - result;
 
 	result = result % hashslots;
 
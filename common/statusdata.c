@@ -27,12 +27,14 @@
 #include "../include/objects.h"
 #include "../include/statusdata.h"
 #include "../xdata/xsddefault.h"		/* default routines */
+#include "../xdata/xsdbinary.h"
 
 #ifdef NSCGI
 #include "../include/cgiutils.h"
 #else
 #include "../include/nagios.h"
 #include "../include/broker.h"
+#include "../include/snapshot.h"
 #endif
 
 
@@ -45,12 +47,28 @@ servicestatus   *servicestatus_list_tail = NULL;
 hoststatus      **hoststatus_hashlist = NULL;
 servicestatus   **servicestatus_hashlist = NULL;
 
+/* the hash lists get a slot per object, so the chains stay short */
+static unsigned int hoststatus_hashslots = 0;
+static unsigned int servicestatus_hashslots = 0;
+
 extern int      use_pending_states;
 #endif
 
 
 
 #ifdef NSCORE
+struct status_update_stats status_update_stats;
+
+/*
+ * Hosts and services whose status has been updated since the status
+ * files were last written. NULL means everything has to be written.
+ * Every STATUS_FULL_UPDATE_CYCLES updates we write everything anyway,
+ * in case something changed an object without telling anyone.
+ */
+#define STATUS_FULL_UPDATE_CYCLES 60
+static bitmap *dirty_hosts = NULL;
+static bitmap *dirty_services = NULL;
+static unsigned int status_update_cycles = 0;
 
 /******************************************************************/
 /****************** TOP-LEVEL OUTPUT FUNCTIONS ********************/
@@ -58,7 +76,13 @@ extern int      use_pending_states;
 
 /* initializes status data at program start */
 int initialize_status_data(const char *cfgfile) {
-	return xsddefault_initialize_status_data(cfgfile);
+	int result = OK;
+
+	result = xsddefault_initialize_status_data(cfgfile);
+	if(result == OK)
+		result = xsdbinary_initialize_status_data(cfgfile);
+
+	return result;
 	}
 
 
@@ -71,7 +95,8 @@ int update_all_status_data(void) {
 	broker_aggregated_status_data(NEBTYPE_AGGREGATEDSTATUS_STARTDUMP, NEBFLAG_NONE, NEBATTR_NONE, NULL);
 #endif
 
-	result = xsddefault_save_status_data();
+	/* the files themselves are written by the state writer thread */
+	result = write_state_in_background(STATE_WRITE_STATUS, FALSE);
 
 #ifdef USE_EVENT_BROKER
 	/* send data to event broker */
@@ -81,9 +106,98 @@ int update_all_status_data(void) {
 	}
 
 
+/* writes a snapshot to the status files. Runs in the state writer thread */
+int write_status_data(const struct state_snapshot *snap) {
+	int result = OK;
+
+	/* the text status file is optional if we write a binary one */
+	if(export_status_file == TRUE || !binary_status_file)
+		result = xsddefault_save_status_data(snap);
+	if(binary_status_file && xsdbinary_save_status_data(snap) != OK)
+		result = ERROR;
+
+	return result;
+	}
+
+
+/* do the status files need every host and service for their next update? */
+int status_data_needs_full_update(void) {
+
+	if(dirty_hosts == NULL || dirty_services == NULL)
+		return TRUE;
+	if((export_status_file == TRUE || !binary_status_file) && xsddefault_needs_full_update() == TRUE)
+		return TRUE;
+	if(binary_status_file && xsdbinary_needs_full_update() == TRUE)
+		return TRUE;
+
+	return FALSE;
+	}
+
+
+/* start tracking changes afresh for the next update */
+void reset_status_changes(void) {
+
+	if(++status_update_cycles >= STATUS_FULL_UPDATE_CYCLES) {
+		status_update_cycles = 0;
+		bitmap_destroy(dirty_hosts);
+		bitmap_destroy(dirty_services);
+		dirty_hosts = dirty_services = NULL;
+		}
+	else if(dirty_hosts && dirty_services) {
+		bitmap_clear(dirty_hosts);
+		bitmap_clear(dirty_services);
+		}
+	else {
+		dirty_hosts = bitmap_create(num_objects.hosts);
+		dirty_services = bitmap_create(num_objects.services);
+		if(!dirty_hosts || !dirty_services) {
+			bitmap_destroy(dirty_hosts);
+			bitmap_destroy(dirty_services);
+			dirty_hosts = dirty_services = NULL;
+			}
+		}
+	}
+
+
 /* cleans up status data before program termination */
 int cleanup_status_data(int delete_status_data) {
-	return xsddefault_cleanup_status_data(delete_status_data);
+	int result = OK;
+
+	/* the writer thread may still be busy with the files */
+	stop_state_writer();
+
+	if(xsdbinary_cleanup_status_data(delete_status_data) != OK)
+		result = ERROR;
+	if(xsddefault_cleanup_status_data(delete_status_data) != OK)
+		result = ERROR;
+
+	/* object ids may mean something else after a restart */
+	bitmap_destroy(dirty_hosts);
+	bitmap_destroy(dirty_services);
+	dirty_hosts = dirty_services = NULL;
+	status_update_cycles = 0;
+
+	return result;
+	}
+
+
+/* has the status of a host changed since the status files were written? */
+int host_status_is_dirty(host *hst) {
+
+	if(dirty_hosts == NULL || hst->id >= num_objects.hosts)
+		return TRUE;
+
+	return bitmap_isset(dirty_hosts, hst->id) ? TRUE : FALSE;
+	}
+
+
+/* has the status of a service changed since the status files were written? */
+int service_status_is_dirty(service *svc) {
+
+	if(dirty_services == NULL || svc->id >= num_objects.services)
+		return TRUE;
+
+	return bitmap_isset(dirty_services, svc->id) ? TRUE : FALSE;
 	}
 
 
@@ -105,6 +219,13 @@ int update_program_status(int aggregated_dump) {
 /* updates host status info */
 int update_host_status(host *hst, int aggregated_dump) {
 
+	if(dirty_hosts)
+		bitmap_set(dirty_hosts, hst->id);
+
+	/* dependency results worked out from the old state are no good now */
+	update_host_dependents(hst);
+	update_host_reachability(hst);
+
 #ifdef USE_EVENT_BROKER
 	/* send data to event broker (non-aggregated dumps only) */
 	if(aggregated_dump == FALSE)
@@ -119,6 +240,11 @@ int update_host_status(host *hst, int aggregated_dump) {
 /* updates service status info */
 int update_service_status(service *svc, int aggregated_dump) {
 
+	if(dirty_services)
+		bitmap_set(dirty_services, svc->id);
+
+	update_service_dependents(svc);
+
 #ifdef USE_EVENT_BROKER
 	/* send data to event broker (non-aggregated dumps only) */
 	if(aggregated_dump == FALSE)
@@ -156,6 +282,11 @@ int update_contact_status(contact *cntct, int aggregated_dump) {
 
 /* reads in all status data */
 int read_status_data(const char *status_file_name, int options) {
+
+	/* use the binary status file if there is one, it's much cheaper to read */
+	if(binary_status_file && xsdbinary_read_status_data(binary_status_file, options) == OK)
+		return OK;
+
 	return xsddefault_read_status_data(status_file_name, options);
 	}
 
@@ -170,23 +301,24 @@ int add_hoststatus_to_hashlist(hoststatus *new_hoststatus) {
 	hoststatus *temp_hoststatus = NULL;
 	hoststatus *lastpointer = NULL;
 	int hashslot = 0;
-	int i = 0;
+	unsigned int i = 0;
 
 	/* initialize hash list */
 	if(hoststatus_hashlist == NULL) {
 
-		hoststatus_hashlist = (hoststatus **)malloc(sizeof(hoststatus *) * HOSTSTATUS_HASHSLOTS);
+		hoststatus_hashslots = num_objects.hosts > HOSTSTATUS_HASHSLOTS ? num_objects.hosts : HOSTSTATUS_HASHSLOTS;
+		hoststatus_hashlist = (hoststatus **)malloc(sizeof(hoststatus *) * hoststatus_hashslots);
 		if(hoststatus_hashlist == NULL)
 			return 0;
 
-		for(i = 0; i < HOSTSTATUS_HASHSLOTS; i++)
+		for(i = 0; i < hoststatus_hashslots; i++)
 			hoststatus_hashlist[i] = NULL;
 		}
 
 	if(!new_hoststatus)
 		return 0;
 
-	hashslot = hashfunc(new_hoststatus->host_name, NULL, HOSTSTATUS_HASHSLOTS);
+	hashslot = hashfunc(new_hoststatus->host_name, NULL, hoststatus_hashslots);
 	lastpointer = NULL;
 	for(temp_hoststatus = hoststatus_hashlist[hashslot]; temp_hoststatus && compare_hashdata(temp_hoststatus->host_name, NULL, new_hoststatus->host_name, NULL) < 0; temp_hoststatus = temp_hoststatus->nexthash)
 		lastpointer = temp_hoststatus;
@@ -209,23 +341,24 @@ int add_hoststatus_to_hashlist(hoststatus *new_hoststatus) {
 int add_servicestatus_to_hashlist(servicestatus *new_servicestatus) {
 	servicestatus *temp_servicestatus = NULL, *lastpointer = NULL;
 	int hashslot = 0;
-	int i = 0;
+	unsigned int i = 0;
 
 	/* initialize hash list */
 	if(servicestatus_hashlist == NULL) {
 
-		servicestatus_hashlist = (servicestatus **)malloc(sizeof(servicestatus *) * SERVICESTATUS_HASHSLOTS);
+		servicestatus_hashslots = num_objects.services > SERVICESTATUS_HASHSLOTS ? num_objects.services : SERVICESTATUS_HASHSLOTS;
+		servicestatus_hashlist = (servicestatus **)malloc(sizeof(servicestatus *) * servicestatus_hashslots);
 		if(servicestatus_hashlist == NULL)
 			return 0;
 
-		for(i = 0; i < SERVICESTATUS_HASHSLOTS; i++)
+		for(i = 0; i < servicestatus_hashslots; i++)
 			servicestatus_hashlist[i] = NULL;
 		}
 
 	if(!new_servicestatus)
 		return 0;
 
-	hashslot = hashfunc(new_servicestatus->host_name, new_servicestatus->description, SERVICESTATUS_HASHSLOTS);
+	hashslot = hashfunc(new_servicestatus->host_name, new_servicestatus->description, servicestatus_hashslots);
 	lastpointer = NULL;
 	for(temp_servicestatus = servicestatus_hashlist[hashslot]; temp_servicestatus && compare_hashdata(temp_servicestatus->host_name, temp_servicestatus->description, new_servicestatus->host_name, new_servicestatus->description) < 0; temp_servicestatus = temp_servicestatus->nexthash)
 		lastpointer = temp_servicestatus;
@@ -452,7 +585,7 @@ hoststatus *find_hoststatus(char *host_name) {
 	if(host_name == NULL || hoststatus_hashlist == NULL)
 		return NULL;
 
-	for(temp_hoststatus = hoststatus_hashlist[hashfunc(host_name, NULL, HOSTSTATUS_HASHSLOTS)]; temp_hoststatus && compare_hashdata(temp_hoststatus->host_name, NULL, host_name, NULL) < 0; temp_hoststatus = temp_hoststatus->nexthash);
+	for(temp_hoststatus = hoststatus_hashlist[hashfunc(host_name, NULL, hoststatus_hashslots)]; temp_hoststatus && compare_hashdata(temp_hoststatus->host_name, NULL, host_name, NULL) < 0; temp_hoststatus = temp_hoststatus->nexthash);
 
 	if(temp_hoststatus && (compare_hashdata(temp_hoststatus->host_name, NULL, host_name, NULL) == 0))
 		return temp_hoststatus;
@@ -468,7 +601,7 @@ servicestatus *find_servicestatus(char *host_name, char *svc_desc) {
 	if(host_name == NULL || svc_desc == NULL || servicestatus_hashlist == NULL)
 		return NULL;
 
-	for(temp_servicestatus = servicestatus_hashlist[hashfunc(host_name, svc_desc, SERVICESTATUS_HASHSLOTS)]; temp_servicestatus && compare_hashdata(temp_servicestatus->host_name, temp_servicestatus->description, host_name, svc_desc) < 0; temp_servicestatus = temp_servicestatus->nexthash);
+	for(temp_servicestatus = servicestatus_hashlist[hashfunc(host_name, svc_desc, servicestatus_hashslots)]; temp_servicestatus && compare_hashdata(temp_servicestatus->host_name, temp_servicestatus->description, host_name, svc_desc) < 0; temp_servicestatus = temp_servicestatus->nexthash);
 
 	if(temp_servicestatus && (compare_hashdata(temp_servicestatus->host_name, temp_servicestatus->description, host_name, svc_desc) == 0))
 		return temp_servicestatus;
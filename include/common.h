@@ -45,6 +45,7 @@ extern unsigned long next_downtime_id;
 
 extern char *object_cache_file;
 extern char *status_file;
+extern char *binary_status_file;
 
 extern time_t program_start;
 extern int nagios_pid;
@@ -14,11 +14,16 @@
 #define DEFAULT_RETRY_INTERVAL  				30	/* services are retried in 30 seconds if they're not OK */
 #define DEFAULT_CHECK_REAPER_INTERVAL				10	/* interval in seconds to reap host and service check results */
 #define DEFAULT_MAX_REAPER_TIME                 		30      /* maximum number of seconds to spend reaping service checks before we break out for a while */
+#define DEFAULT_MAX_EXTERNAL_COMMAND_TIME			200	/* maximum number of milliseconds to spend running external commands before we break out for a while */
+#define DEFAULT_CHECK_STORM_THRESHOLD				0	/* on-demand checks per second that start storm mode (0=never) */
+#define DEFAULT_CHECK_STORM_DRAIN_RATE				100	/* held back checks run per second during and after a storm */
 #define DEFAULT_MAX_CHECK_RESULT_AGE				3600    /* maximum number of seconds that a check result file is considered to be valid */
 #define DEFAULT_MAX_PARALLEL_SERVICE_CHECKS 			0	/* maximum number of service checks we can have running at any given time (0=unlimited) */
 #define DEFAULT_RETENTION_UPDATE_INTERVAL			60	/* minutes between auto-save of retention data */
 #define DEFAULT_RETENTION_SCHEDULING_HORIZON    		900     /* max seconds between program restarts that we will preserve scheduling information */
+#define DEFAULT_EXPORT_RETENTION_FILE				1	/* write the text retention file */
 #define DEFAULT_STATUS_UPDATE_INTERVAL				60	/* seconds between aggregated status data updates */
+#define DEFAULT_EXPORT_STATUS_FILE				1	/* write the text status file */
 #define DEFAULT_FRESHNESS_CHECK_INTERVAL        		60      /* seconds between service result freshness checks */
 #define DEFAULT_AUTO_RESCHEDULING_INTERVAL      		30      /* seconds between host and service check rescheduling events */
 #define DEFAULT_AUTO_RESCHEDULING_WINDOW        		180     /* window of time (in seconds) for which we should reschedule host and service checks */
@@ -40,6 +45,7 @@
 #define DEFAULT_LOG_EVENT_HANDLERS				1	/* log event handlers */
 #define DEFAULT_LOG_INITIAL_STATES				0	/* don't log initial service and host states */
 #define DEFAULT_LOG_CURRENT_STATES				1	/* log current service and host states after rotating log */
+#define DEFAULT_INDEX_LOG_FILE					1	/* keep an index of state changes next to the log */
 #define DEFAULT_LOG_EXTERNAL_COMMANDS				1	/* log external commands */
 #define DEFAULT_LOG_PASSIVE_CHECKS				1	/* log passive service checks */
 
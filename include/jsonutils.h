@@ -224,4 +224,10 @@ extern char *svm_get_description_from_value(int, const string_value_mapping *);
 
 extern time_t compile_time(const char *, const char *);
 extern char *json_escape_string(const char *, const json_escape *);
+extern service **json_host_services(host *, int *);
+
+extern int json_cgi_serve(const char *, char **);
+extern int json_cgi_forward_request(const char *);
+extern int json_cgi_preloaded(void);
+extern time_t json_cgi_status_update_time(void);
 #endif
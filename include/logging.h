@@ -85,6 +85,8 @@ int open_debug_log(void);
 int close_debug_log(void);
 int close_log_file(void);
 int fix_log_file_owner(uid_t uid, gid_t gid);
+void queue_log_messages(void);                          /* has the calling thread's messages written by the main thread */
+void write_queued_log_messages(void);                   /* writes them, from the main thread */
 #endif /* !NSCGI */
 
 NAGIOS_END_DECL
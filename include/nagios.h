@@ -91,6 +91,7 @@ extern int notification_timeout;
 
 extern int log_initial_states;
 extern int log_current_states;
+extern int index_log_file;
 
 extern int daemon_dumps_core;
 extern int sig_id;
@@ -114,6 +115,9 @@ extern int max_parallel_service_checks;
 
 extern int check_reaper_interval;
 extern int max_check_reaper_time;
+extern int max_external_command_time;
+extern int check_storm_threshold;
+extern int check_storm_drain_rate;
 extern int service_freshness_check_interval;
 extern int host_freshness_check_interval;
 extern int auto_rescheduling_interval;
@@ -152,6 +156,8 @@ extern int use_retained_program_state;
 extern int use_retained_scheduling_info;
 extern int retention_scheduling_horizon;
 extern char *retention_file;
+extern char *binary_retention_file;
+extern int export_retention_file;
 extern unsigned long retained_host_attribute_mask;
 extern unsigned long retained_service_attribute_mask;
 extern unsigned long retained_contact_host_attribute_mask;
@@ -163,6 +169,7 @@ extern int translate_passive_host_checks;
 extern int passive_host_checks_are_soft;
 
 extern int status_update_interval;
+extern int export_status_file;
 extern char *retention_file;
 
 extern int time_change_threshold;
@@ -217,6 +224,54 @@ extern iobroker_set *nagios_iobs;
 
 extern struct check_stats check_statistics[MAX_CHECK_STATS_TYPES];
 
+/* commands read from the command file and how far behind we are on them */
+struct external_command_stats {
+	unsigned long commands;    /* commands run */
+	unsigned long fast_path;   /* check results that skipped the full parser */
+	unsigned long deferred;    /* times we ran out of time with commands left */
+	unsigned long backlog;     /* bytes of commands read but not yet run */
+	unsigned long max_backlog; /* largest backlog seen */
+	};
+extern struct external_command_stats external_command_stats;
+
+/* on-demand checks and what storm mode did with them */
+struct check_storm_stats {
+	unsigned long storms;      /* times storm mode started */
+	unsigned long coalesced;   /* on-demand checks of objects with a check already pending */
+	unsigned long deferred;    /* on-demand checks held back by storm mode */
+	unsigned long backlog;     /* checks held back right now */
+	int active;                /* are we in storm mode? */
+	};
+extern struct check_storm_stats check_storm_stats;
+extern void (*check_storm_clock)(struct timeval *); /* where storm mode gets the time, for tests */
+
+/*
+ * How the event loop is keeping up, in microseconds. Each type of timed
+ * event has a histogram of how late events of that type ran and one of
+ * how long running them took. EVENT_SLEEP and EVENT_USER_FUNCTION use
+ * the two slots after EVENT_SCHEDULED_DOWNTIME_END. See base/events.c.
+ */
+#define LOOP_STATS_EVENT_TYPES  21
+struct loop_stats {
+	time_t since;                                  /* when we started counting */
+	histogram lateness[LOOP_STATS_EVENT_TYPES];
+	histogram duration[LOOP_STATS_EVENT_TYPES];
+	histogram poll_wait;                           /* iobroker_poll() waiting for input */
+	histogram poll_handling;                       /* iobroker_poll() handling input */
+	histogram result_queue;                        /* from a plugin exiting to its result being picked up */
+	histogram result_handling;                     /* handling a check result from a worker */
+	histogram result_overhead;                     /* per worker message, outside of result handling */
+	};
+extern struct loop_stats loop_stats;
+
+/* one histogram boiled down to what status.dat has room for, in seconds */
+struct loop_stats_summary {
+	char name[40];
+	unsigned long count;
+	double p50, p90, p99, max;
+	};
+#define LOOP_STATS_HISTOGRAMS   (LOOP_STATS_EVENT_TYPES * 2 + 5)
+
 /*** perfdata variables ***/
 extern int     perfdata_timeout;
 extern char    *host_perfdata_command;
@@ -472,6 +527,9 @@ extern int nerd_broadcast(unsigned int chan_id, void *buf, unsigned int len);
 /*** Query Handler functions, types and macros*/
 typedef int (*qh_handler)(int, char *, unsigned int);
 extern int dump_event_stats(int sd);
+extern int dump_loop_stats(int sd, const char *name);
+extern void reset_loop_stats(void);
+extern unsigned int summarize_loop_stats(struct loop_stats_summary *summary);
 
 /* return codes for query_handlers() */
 #define QH_OK        0  /* keep listening */
@@ -533,6 +591,17 @@ int close_command_file(void);					/* closes and deletes the external command fil
 int check_service_parents(service *svc);			/* checks service parents */
 int check_service_dependencies(service *, int);          	/* checks service dependencies */
 int check_host_dependencies(host *, int);                	/* checks host dependencies */
+void init_dependency_cache(void);				/* indexes dependencies so their results can be remembered */
+void free_dependency_cache(void);				/* forgets remembered dependency results and the index */
+void update_host_dependents(host *);				/* forgets dependency results a host's state change may affect */
+void update_service_dependents(service *);			/* forgets dependency results a service's state change may affect */
+void init_host_reachability(void);				/* works out which hosts are reachable through their parents */
+void free_host_reachability(void);
+void update_host_reachability(host *);				/* passes a host's state change on to the hosts behind it */
+int host_is_reachable(host *);					/* is a host reachable through parents that are UP? */
+void schedule_reachability_checks(void);			/* checks hosts whose reachability changed */
+void run_held_checks(void);					/* schedules checks held back by storm mode, at the drain rate */
+void free_held_checks(void);
 void check_for_orphaned_services(void);				/* checks for orphaned services */
 void check_for_orphaned_hosts(void);				/* checks for orphaned hosts */
 void check_service_result_freshness(void);              	/* checks the "freshness" of service check results */
@@ -677,6 +746,7 @@ time_t calculate_time_from_weekday_of_month(int, int, int, int);	/* calculates m
 time_t calculate_time_from_day_of_month(int, int, int);	/* calculates midnight time of specific (1st, last, etc.) day of a particular month */
 void get_next_valid_time(time_t, time_t *, timeperiod *);	/* get the next valid time in a time period */
 time_t reschedule_within_timeperiod(time_t, timeperiod*, time_t);
+void clear_timeperiod_cache(void);				/* forget the days looked up in time periods, for time(zone) changes */
 time_t get_next_log_rotation_time(void);	     	/* determine the next time to schedule a log rotation */
 int dbuf_init(dbuf *, int);
 int dbuf_free(dbuf *);
@@ -689,6 +759,7 @@ int query_update_api(void);                             /* checks to see if new
 /**** External Command Functions ****/
 int process_external_command1(char *);                  /* top-level external command processor */
 int process_external_command2(int, time_t, char *);	/* process an external command */
+int process_check_result_command(char *);                /* runs a check result command in place, if it is one */
 int process_external_commands_from_file(char *, int);   /* process external commands in a file */
 int process_host_command(int, time_t, char *);          /* process an external host command */
 int process_hostgroup_command(int, time_t, char *);     /* process an external hostgroup command */
@@ -786,6 +857,8 @@ void clear_host_flapping_state(host *);					/* clears the flapping state for a s
 void clear_service_flapping_state(service *);			/* clears the flapping state for a specific service */
 
 int launch_command_file_worker(void);
+int process_external_command_backlog(void);             /* runs commands read from the command file worker */
+int have_external_command_backlog(void);
 int shutdown_command_file_worker(void);
 
 char *get_program_version(void);
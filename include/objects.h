@@ -176,6 +176,10 @@ typedef struct check_result {
 	struct rusage rusage;   			/* resource usage by this check */
 	struct check_engine *engine;                    /* where did we get this check from? */
 	const void *source;				/* engine handles this */
+	int output_split;				/* has output already been split into the fields below? */
+	char *plugin_output;				/* short plugin output */
+	char *long_plugin_output;			/* long plugin output (newlines escaped) */
+	char *perf_data;				/* performance data */
 	} check_result;
 
 
@@ -279,6 +283,7 @@ typedef struct timeperiod {
 	struct daterange *exceptions[DATERANGE_TYPES];
 	struct timeperiodexclusion *exclusions;
 	struct timeperiod *next;
+	struct timeperiod_cache *cache; /* recently looked up days (core only) */
 	} timeperiod;
 
 
@@ -316,6 +321,17 @@ typedef struct customvariablesmember {
 	struct customvariablesmember *next;
 	} customvariablesmember;
 
+/*
+ * The custom variables of a host, service or contact, sorted by name.
+ * It's only good for the list it was built for, so lookups check that
+ * the list still starts where it did.
+ */
+typedef struct customvariablesindex {
+	struct customvariablesmember *head;
+	struct customvariablesmember **by_name;
+	unsigned int count, size;
+	} customvariablesindex;
+
 
 /* COMMAND structure */
 typedef struct command {
@@ -355,6 +371,7 @@ struct contact {
 	int     retain_status_information;
 	int     retain_nonstatus_information;
 	struct customvariablesmember *custom_variables;
+	struct customvariablesindex custom_variable_index;
 #ifndef NSCGI
 	time_t  last_host_notification;
 	time_t  last_service_notification;
@@ -403,6 +420,30 @@ typedef struct hostgroup {
 /* HOST structure */
 struct host {
 	unsigned int id;
+	/* what's looked at most often comes first, as for services */
+	struct  host *next;
+	int     check_freshness;
+	int     checks_enabled;
+	int     accept_passive_checks;
+#ifndef NSCGI
+	int     is_executing;
+	int     is_being_freshened;
+	int     should_be_scheduled;
+	int     check_options;
+	int     has_been_checked;
+	int     current_state;
+	int     state_type;
+	int     current_attempt;
+	time_t  next_check;
+	time_t  last_check;
+	double  latency;
+#endif
+	struct timeperiod *check_period_ptr;
+	double  check_interval;
+	double  retry_interval;
+	int     freshness_threshold;
+	int     max_attempts;
+	struct timed_event *next_check_event;
 	char    *name;
 	char    *display_name;
 	char	*alias;
@@ -412,9 +453,6 @@ struct host {
 	struct servicesmember *services;
 	char    *check_command;
 	int     initial_state;
-	double  check_interval;
-	double  retry_interval;
-	int     max_attempts;
 	char    *event_handler;
 	char	*event_handler_period;	
 	struct contactgroupsmember *contact_groups;
@@ -430,73 +468,36 @@ struct host {
 	double  high_flap_threshold;
 	int     flap_detection_options;
 	unsigned int stalking_options;
-	int     check_freshness;
-	int     freshness_threshold;
 	int     process_performance_data;
-	int     checks_enabled;
 	const char *check_source;
-	int     accept_passive_checks;
 	int     event_handler_enabled;
 	int     retain_status_information;
 	int     retain_nonstatus_information;
 	int     obsess;
-	char    *notes;
-	char    *notes_url;
-	char    *action_url;
-	char    *icon_image;
-	char    *icon_image_alt;
-	char    *statusmap_image; /* used by lots of graphing tools */
-/* #ifdef NSCGI */
-	/*
-	 * these are kept in ancillary storage for the daemon and
-	 * thrown out as soon as we've created the object cache.
-	 * The CGI's still attach them though, since they are the
-	 * only users of this utter crap.
-	 */
-	char    *vrml_image;
-	int     have_2d_coords;
-	int     x_2d;
-	int     y_2d;
-	int     have_3d_coords;
-	double  x_3d;
-	double  y_3d;
-	double  z_3d;
-	int     should_be_drawn;
-/* #endif */
 	customvariablesmember *custom_variables;
+	customvariablesindex custom_variable_index;
 #ifndef NSCGI
 	int     problem_has_been_acknowledged;
 	int     acknowledgement_type;
 	int     check_type;
-	int     current_state;
 	int     last_state;
 	int     last_hard_state;
 	char	*plugin_output;
 	char    *long_plugin_output;
 	char    *perf_data;
-	int     state_type;
-	int     current_attempt;
 	unsigned long current_event_id;
 	unsigned long last_event_id;
 	unsigned long current_problem_id;
 	unsigned long last_problem_id;
-	double  latency;
 	double  execution_time;
-	int     is_executing;
-	int     check_options;
 	int     notifications_enabled;
 	time_t  last_notification;
 	time_t  next_notification;
-	time_t  next_check;
-	int     should_be_scheduled;
-	time_t  last_check;
 	time_t	last_state_change;
 	time_t	last_hard_state_change;
 	time_t  last_time_up;
 	time_t  last_time_down;
 	time_t  last_time_unreachable;
-	int     has_been_checked;
-	int     is_being_freshened;
 	int     notified_on;
 	int     current_notification_number;
 	int     no_more_notifications;
@@ -504,7 +505,6 @@ struct host {
 	int     check_flapping_recovery_notification;
 	int     scheduled_downtime_depth;
 	int     pending_flex_downtime;
-	int     state_history[MAX_STATE_HISTORY_ENTRIES];    /* flap detection */
 	int     state_history_index;
 	time_t  last_state_history_update;
 	int     is_flapping;
@@ -513,19 +513,42 @@ struct host {
 	int     total_services;
 	unsigned long total_service_check_interval;
 	unsigned long modified_attributes;
+	int     state_history[MAX_STATE_HISTORY_ENTRIES];    /* flap detection */
 #endif
 
 	struct command *event_handler_ptr;
 	struct command *check_command_ptr;
 	struct timeperiod *event_handler_period_ptr;
-	struct timeperiod *check_period_ptr;
 	struct timeperiod *notification_period_ptr;
 	struct objectlist *hostgroups_ptr;
 	/* objects we depend upon */
 	struct objectlist *exec_deps, *notify_deps;
 	struct objectlist *escalation_list;
-	struct  host *next;
-	struct timed_event *next_check_event;
+
+	/* for display, mostly by the CGIs */
+	char    *notes;
+	char    *notes_url;
+	char    *action_url;
+	char    *icon_image;
+	char    *icon_image_alt;
+	char    *statusmap_image; /* used by lots of graphing tools */
+/* #ifdef NSCGI */
+	/*
+	 * these are kept in ancillary storage for the daemon and
+	 * thrown out as soon as we've created the object cache.
+	 * The CGI's still attach them though, since they are the
+	 * only users of this utter crap.
+	 */
+	char    *vrml_image;
+	int     have_2d_coords;
+	int     x_2d;
+	int     y_2d;
+	int     have_3d_coords;
+	double  x_3d;
+	double  y_3d;
+	double  z_3d;
+	int     should_be_drawn;
+/* #endif */
 	};
 
 
@@ -545,6 +568,36 @@ typedef struct servicegroup {
 /* SERVICE structure */
 struct service {
 	unsigned int id;
+	/*
+	 * what the event loop and the sweeps over all services (freshness
+	 * and orphan checks, status updates) look at comes first, so that
+	 * going past a service that needs nothing only touches the first
+	 * cache line or two of it.
+	 */
+	struct service *next;
+	int     check_freshness;
+	int	checks_enabled;
+	int     accept_passive_checks;
+#ifndef NSCGI
+	int     is_executing;
+	int     is_being_freshened;
+	int     should_be_scheduled;
+	int     check_options;
+	int     has_been_checked;
+	int	current_state;
+	int     state_type;
+	int	current_attempt;
+	time_t	next_check;
+	time_t	last_check;
+	double  latency;
+#endif
+	struct timeperiod *check_period_ptr;
+	double	check_interval;
+	double  retry_interval;
+	int     freshness_threshold;
+	int	max_attempts;
+	struct timed_event *next_check_event;
+	struct host *host_ptr;
 	char	*host_name;
 	char	*description;
 	char    *display_name;
@@ -554,9 +607,6 @@ struct service {
 	char    *event_handler;
 	char    *event_handler_period;	
 	int     initial_state;
-	double	check_interval;
-	double  retry_interval;
-	int	max_attempts;
 	int     parallelize;
 	struct contactgroupsmember *contact_groups;
 	struct contactsmember *contacts;
@@ -573,38 +623,24 @@ struct service {
 	double  high_flap_threshold;
 	unsigned int flap_detection_options;
 	int     process_performance_data;
-	int     check_freshness;
-	int     freshness_threshold;
-	int     accept_passive_checks;
 	int     event_handler_enabled;
-	int	checks_enabled;
 	const char *check_source;
 	int     retain_status_information;
 	int     retain_nonstatus_information;
 	int     notifications_enabled;
 	int     obsess;
-	char    *notes;
-	char    *notes_url;
-	char    *action_url;
-	char    *icon_image;
-	char    *icon_image_alt;
 	struct customvariablesmember *custom_variables;
+	struct customvariablesindex custom_variable_index;
 #ifndef NSCGI
 	int     problem_has_been_acknowledged;
 	int     acknowledgement_type;
 	int     host_problem_at_last_check;
 	int     check_type;
-	int	current_state;
 	int	last_state;
 	int	last_hard_state;
 	char	*plugin_output;
 	char    *long_plugin_output;
 	char    *perf_data;
-	int     state_type;
-	time_t	next_check;
-	int     should_be_scheduled;
-	time_t	last_check;
-	int	current_attempt;
 	unsigned long current_event_id;
 	unsigned long last_event_id;
 	unsigned long current_problem_id;
@@ -619,38 +655,36 @@ struct service {
 	time_t  last_time_warning;
 	time_t  last_time_unknown;
 	time_t  last_time_critical;
-	int     has_been_checked;
-	int     is_being_freshened;
 	unsigned int notified_on;
 	int     current_notification_number;
 	unsigned long current_notification_id;
-	double  latency;
 	double  execution_time;
-	int     is_executing;
-	int     check_options;
 	int     scheduled_downtime_depth;
 	int     pending_flex_downtime;
-	int     state_history[MAX_STATE_HISTORY_ENTRIES];    /* flap detection */
-	int     state_history_index;
 	int     is_flapping;
 	unsigned long flapping_comment_id;
 	double  percent_state_change;
 	unsigned long modified_attributes;
+	int     state_history_index;
+	int     state_history[MAX_STATE_HISTORY_ENTRIES];    /* flap detection */
 #endif
 
-	struct host *host_ptr;
 	struct command *event_handler_ptr;
 	char *event_handler_args;
 	struct command *check_command_ptr;
 	char *check_command_args;
-	struct timeperiod *check_period_ptr;
 	struct timeperiod *notification_period_ptr;
 	struct timeperiod *event_handler_period_ptr;
 	struct objectlist *servicegroups_ptr;
 	struct objectlist *exec_deps, *notify_deps;
 	struct objectlist *escalation_list;
-	struct service *next;
-	struct timed_event *next_check_event;
+
+	/* for display, mostly by the CGIs */
+	char    *notes;
+	char    *notes_url;
+	char    *action_url;
+	char    *icon_image;
+	char    *icon_image_alt;
 	};
 
 
@@ -788,6 +822,8 @@ struct contactgroupsmember *add_contactgroup_to_hostescalation(hostescalation *,
 
 struct contactsmember *add_contact_to_object(contactsmember **, char *);                                       /* adds a contact to an object */
 struct customvariablesmember *add_custom_variable_to_object(customvariablesmember **, char *, char *);         /* adds a custom variable to an object */
+struct customvariablesmember *find_custom_variable(customvariablesmember *, const char *);                  /* finds a custom variable by name */
+struct customvariablesmember *find_indexed_custom_variable(customvariablesmember *, const customvariablesindex *, const char *); /* ... using the index if it's up to date */
 
 
 struct servicesmember *add_service_link_to_host(host *, service *);
@@ -800,6 +836,18 @@ int get_service_count(void);
 
 int create_object_tables(unsigned int *);
 
+/**** Shared Object Strings ****/
+struct object_string_stats {
+	unsigned long strings;       /* strings passed to intern_object_string() */
+	unsigned long unique;        /* how many of them had to be stored */
+	unsigned long long bytes;    /* memory they would take unshared */
+	unsigned long long size;     /* memory allocated to store them */
+	};
+char *intern_object_string(const char *);                                                                      /* returns a shared copy of a string that lives as long as the object data */
+void free_object_string(char *);                                                                               /* frees a string unless it's a shared copy */
+void defer_object_string_frees(int);                                                                           /* keeps free_object_string() from freeing anything until called with FALSE */
+void get_object_string_stats(struct object_string_stats *);
+
 /**** Object Search Functions ****/
 struct timeperiod *find_timeperiod(const char *);
 struct host *find_host(const char *);
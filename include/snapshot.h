@@ -0,0 +1,290 @@
+/*****************************************************************************
+ *
+ * SNAPSHOT.H - Header for state snapshots and the state writer thread
+ *
+ *
+ * License:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *****************************************************************************/
+
+#ifndef NAGIOS_SNAPSHOT_H_INCLUDED
+#define NAGIOS_SNAPSHOT_H_INCLUDED
+
+#include "common.h"
+#include "objects.h"
+#include "comments.h"
+#include "downtime.h"
+#include "statusdata.h"
+#include "nagios.h"
+#include "workers.h"
+
+NAGIOS_BEGIN_DECL
+
+/*
+ * Status and retention data are written by a thread of their own, so
+ * slow disks don't hold up the event loop. The main thread copies what
+ * the writers need into a snapshot, which the writer thread formats and
+ * writes out while the main thread gets on with things.
+ *
+ * Output and comment strings are copied into the snapshot. Command,
+ * timeperiod and custom variable strings aren't, since they hardly ever
+ * change. Instead, free_object_string() holds on to them until the
+ * write is done (see defer_object_string_frees()).
+ */
+
+/* what to write */
+#define STATE_WRITE_STATUS      1   /* the status files */
+#define STATE_WRITE_RETENTION   2   /* the retention files */
+#define STATE_WRITE_AUTOSAVE    4   /* log that retention data was saved */
+
+/*
+ * The host, service and contact fields the writers use, named like
+ * their counterparts in the objects. Booleans and states are stored
+ * as chars to keep the snapshot small.
+ */
+struct snapshot_host {
+	unsigned int id;
+	char    *name;
+	char    *check_command;
+	char    *check_period;
+	char    *notification_period;
+	char    *event_handler;
+	char    *event_handler_period;
+	char    *plugin_output;
+	char    *long_plugin_output;
+	char    *perf_data;
+	customvariablesmember *custom_variables;
+	unsigned long modified_attributes;
+	unsigned long last_event_id;
+	unsigned long current_event_id;
+	unsigned long current_problem_id;
+	unsigned long last_problem_id;
+	unsigned long current_notification_id;
+	unsigned long flapping_comment_id;
+	time_t  last_check;
+	time_t  next_check;
+	time_t  last_state_change;
+	time_t  last_hard_state_change;
+	time_t  last_time_up;
+	time_t  last_time_down;
+	time_t  last_time_unreachable;
+	time_t  last_notification;
+	time_t  next_notification;
+	double  execution_time;
+	double  latency;
+	double  percent_state_change;
+	double  check_interval;
+	double  retry_interval;
+	int     check_options;
+	int     current_attempt;
+	int     max_attempts;
+	int     notified_on;
+	int     current_notification_number;
+	int     scheduled_downtime_depth;
+	unsigned int hourly_value;
+	char    current_state;
+	char    last_state;
+	char    last_hard_state;
+	char    state_type;
+	char    check_type;
+	char    acknowledgement_type;
+	char    has_been_checked;
+	char    should_be_scheduled;
+	char    checks_enabled;
+	char    accept_passive_checks;
+	char    notifications_enabled;
+	char    no_more_notifications;
+	char    problem_has_been_acknowledged;
+	char    event_handler_enabled;
+	char    flap_detection_enabled;
+	char    process_performance_data;
+	char    obsess;
+	char    is_flapping;
+	char    check_flapping_recovery_notification;
+	char    status_changed;     /* since the last status snapshot */
+	char    state_history[MAX_STATE_HISTORY_ENTRIES];   /* oldest entry first */
+	};
+
+struct snapshot_service {
+	unsigned int id;
+	unsigned int host_id;
+	char    *host_name;
+	char    *description;
+	char    *check_command;
+	char    *check_period;
+	char    *notification_period;
+	char    *event_handler;
+	char    *event_handler_period;
+	char    *plugin_output;
+	char    *long_plugin_output;
+	char    *perf_data;
+	customvariablesmember *custom_variables;
+	unsigned long modified_attributes;
+	unsigned long last_event_id;
+	unsigned long current_event_id;
+	unsigned long current_problem_id;
+	unsigned long last_problem_id;
+	unsigned long current_notification_id;
+	unsigned long flapping_comment_id;
+	time_t  last_check;
+	time_t  next_check;
+	time_t  last_state_change;
+	time_t  last_hard_state_change;
+	time_t  last_time_ok;
+	time_t  last_time_warning;
+	time_t  last_time_unknown;
+	time_t  last_time_critical;
+	time_t  last_notification;
+	time_t  next_notification;
+	double  execution_time;
+	double  latency;
+	double  percent_state_change;
+	double  check_interval;
+	double  retry_interval;
+	int     check_options;
+	int     current_attempt;
+	int     max_attempts;
+	int     notified_on;
+	int     current_notification_number;
+	int     scheduled_downtime_depth;
+	unsigned int hourly_value;
+	char    current_state;
+	char    last_state;
+	char    last_hard_state;
+	char    state_type;
+	char    check_type;
+	char    acknowledgement_type;
+	char    has_been_checked;
+	char    should_be_scheduled;
+	char    checks_enabled;
+	char    accept_passive_checks;
+	char    notifications_enabled;
+	char    no_more_notifications;
+	char    problem_has_been_acknowledged;
+	char    event_handler_enabled;
+	char    flap_detection_enabled;
+	char    process_performance_data;
+	char    obsess;
+	char    is_flapping;
+	char    check_flapping_recovery_notification;
+	char    status_changed;     /* since the last status snapshot */
+	char    state_history[MAX_STATE_HISTORY_ENTRIES];   /* oldest entry first */
+	};
+
+struct snapshot_contact {
+	unsigned int id;
+	char    *name;
+	char    *host_notification_period;
+	char    *service_notification_period;
+	customvariablesmember *custom_variables;
+	unsigned long modified_attributes;
+	unsigned long modified_host_attributes;
+	unsigned long modified_service_attributes;
+	time_t  last_host_notification;
+	time_t  last_service_notification;
+	int     host_notifications_enabled;
+	int     service_notifications_enabled;
+	};
+
+/* how long saving state takes, in seconds */
+struct state_write_stats {
+	double last_snapshot_time;      /* copying state on the main thread */
+	double max_snapshot_time;
+	double last_write_time;         /* writing it out in the background */
+	double max_write_time;
+	double max_stall;               /* longest the event loop waited on us */
+	unsigned long coalesced;        /* writes folded into one still in progress */
+	struct status_update_stats last_update; /* what the status writers wrote last */
+	};
+extern struct state_write_stats state_write_stats;
+
+/* the program-wide state, named like the globals it's copied from */
+struct snapshot_program {
+	time_t  last_update_check;
+	int     update_available;
+	unsigned long update_uid;
+	char    *last_program_version;
+	char    *new_program_version;
+	unsigned long modified_host_process_attributes;
+	unsigned long modified_service_process_attributes;
+	int     nagios_pid;
+	int     daemon_mode;
+	time_t  program_start;
+	time_t  last_log_rotation;
+	int     enable_notifications;
+	int     execute_service_checks;
+	int     accept_passive_service_checks;
+	int     execute_host_checks;
+	int     accept_passive_host_checks;
+	int     enable_event_handlers;
+	int     obsess_over_services;
+	int     obsess_over_hosts;
+	int     check_service_freshness;
+	int     check_host_freshness;
+	int     enable_flap_detection;
+	int     process_performance_data;
+	char    *global_host_event_handler;
+	char    *global_service_event_handler;
+	unsigned long next_comment_id;
+	unsigned long next_downtime_id;
+	unsigned long next_event_id;
+	unsigned long next_problem_id;
+	unsigned long next_notification_id;
+	int     check_stats[MAX_CHECK_STATS_TYPES][3];
+	struct external_command_stats external_command_stats;
+	struct wproc_result_stats wproc_result_stats;
+	struct state_write_stats state_write_stats;
+	struct check_storm_stats check_storm_stats;
+	time_t  loop_stats_since;
+	unsigned int num_loop_stats;
+	struct loop_stats_summary loop_stats[LOOP_STATS_HISTOGRAMS];
+	};
+
+struct snapshot_chunk;
+
+struct state_snapshot {
+	int     what;                   /* STATE_WRITE_* */
+	int     full;                   /* are all hosts and services in it? */
+	time_t  taken;
+	unsigned int total_hosts;       /* as in num_objects */
+	unsigned int total_services;
+	unsigned int num_hosts;         /* in the snapshot, in id order */
+	unsigned int num_services;
+	unsigned int num_contacts;
+	struct snapshot_host *hosts;
+	struct snapshot_service *services;
+	struct snapshot_contact *contacts;
+	nagios_comment *comment_list;
+	scheduled_downtime *scheduled_downtime_list;
+	struct snapshot_program program;
+	struct snapshot_chunk *chunks;  /* where the copied strings live */
+	};
+
+/*
+ * Takes a snapshot for the given STATE_WRITE_* flags. Unless full is
+ * set, it holds only the hosts and services whose status has changed
+ * since the last status snapshot. Retention data always gets them all.
+ */
+struct state_snapshot *take_state_snapshot(int what, int full);
+void free_state_snapshot(struct state_snapshot *);
+
+/* the writer thread */
+int write_state_in_background(int what, int wait);  /* snapshots state and has it written out */
+void wait_for_state_writer(void);                    /* returns when no write is in progress */
+void stop_state_writer(void);                        /* waits for it and stops the thread */
+
+NAGIOS_END_DECL
+#endif
@@ -26,6 +26,8 @@ NAGIOS_BEGIN_DECL
 int initialize_retention_data(const char *);
 int cleanup_retention_data(void);
 int save_state_information(int);                 /* saves all host and state information */
+struct state_snapshot;
+int write_state_information(const struct state_snapshot *);  /* writes a snapshot to the retention files */
 int read_initial_state_information(void);        /* reads in initial host and state information */
 
 NAGIOS_END_DECL
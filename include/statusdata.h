@@ -186,13 +186,33 @@ void free_status_data(void);                            /* free all memory alloc
 #endif
 
 #ifndef NSCGI
+/*
+ * what the last status file updates wrote. Only the thread writing the
+ * status files touches this. The state writer hands a copy back to the
+ * main thread, which puts it in the next snapshot
+ */
+struct status_update_stats {
+	unsigned long bytes_written;
+	unsigned int objects_written;
+	unsigned int objects_skipped;
+	unsigned long binary_bytes_written;
+	unsigned int binary_slots_written;
+	};
+extern struct status_update_stats status_update_stats;
+
 int initialize_status_data(const char *);               /* initializes status data at program start */
 int update_all_status_data(void);                       /* updates all status data */
 int cleanup_status_data(int);                           /* cleans up status data at program termination */
+struct state_snapshot;
+int write_status_data(const struct state_snapshot *);   /* writes a snapshot to the status files */
+int status_data_needs_full_update(void);                /* must the next snapshot have every host and service? */
+void reset_status_changes(void);                        /* starts tracking changes for the next update */
 int update_program_status(int);                         /* updates program status data */
 int update_host_status(host *, int);                    /* updates host status data */
 int update_service_status(service *, int);              /* updates service status data */
 int update_contact_status(contact *, int);              /* updates contact status data */
+int host_status_is_dirty(host *);                       /* has host status changed since the last update? */
+int service_status_is_dirty(service *);                 /* has service status changed since the last update? */
 #endif
 
 NAGIOS_END_DECL
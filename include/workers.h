@@ -39,13 +39,42 @@ typedef struct wproc_result {
 	struct kvvec *response;
 	/* 5DEPR: rusage is deprecated for Nagios, will be removed in 5.0.0 */
 	struct rusage rusage;
+	char *output_short;     /* output split by the worker, if any */
+	char *output_long;
+	char *output_perfdata;
+	double parse_time;      /* seconds the worker spent splitting it */
 } wproc_result;
 
+/*
+ * check result pipeline statistics, written to status.dat for nagiostats.
+ * Results go through three stages: the worker splits the output, the
+ * result waits to be read and handled by the core, and the core handles it
+ */
+struct wproc_result_stats {
+	unsigned long results;          /* check results received from workers */
+	unsigned long presplit;         /* ... with output already split by the worker */
+	double min_parse_time;          /* seconds spent splitting output in workers */
+	double max_parse_time;
+	double total_parse_time;
+	unsigned int queue_depth;       /* check results read in the last batch */
+	unsigned int max_queue_depth;   /* largest batch read so far */
+	double min_queue_latency;       /* seconds from plugin exit to core pickup */
+	double max_queue_latency;
+	double total_queue_latency;
+	double min_handling_time;       /* seconds spent in process_check_result() */
+	double max_handling_time;
+	double total_handling_time;
+	unsigned long batches;          /* batches of worker messages handled */
+	histogram batch_size;           /* messages per batch */
+};
+
 extern unsigned int wproc_num_workers_spawned;
 extern unsigned int wproc_num_workers_online;
 extern unsigned int wproc_num_workers_desired;
+extern struct wproc_result_stats wproc_result_stats;
 
 extern void wproc_reap(int jobs, int msecs);
+extern void wproc_handle_results(void);
 extern int wproc_can_spawn(struct load_control *lc);
 extern void free_worker_memory(int flags);
 extern int workers_alive(void);
@@ -56,7 +85,10 @@ extern int wproc_notify(char *cname, char *hname, char *sdesc, char *cmd, nagios
 extern int wproc_run(int job_type, char *cmd, int timeout, nagios_macros *mac);
 extern int wproc_run_service_job(int jtype, int timeout, service *svc, char *cmd, nagios_macros *mac);
 extern int wproc_run_host_job(int jtype, int timeout, host *hst, char *cmd, nagios_macros *mac);
+extern int wproc_split_check_output(child_process *cp, struct kvvec *resp);
 extern int wproc_run_callback(char *cmt, int timeout, void (*cb)(struct wproc_result *, void *, int), void *data, nagios_macros *mac);
+extern int wproc_add_coprocess_plugin(const char *path);
+extern void wproc_free_coprocess_plugins(void);
 
 NAGIOS_END_DECL
 #endif
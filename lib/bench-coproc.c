@@ -0,0 +1,177 @@
+/*
+ * Benchmark comparing checks a worker runs the normal way with checks
+ * it hands to a coprocess plugin.
+ *
+ * Each round starts a worker in a child process, the way Nagios does,
+ * and keeps it busy with checks of the coproc-dummy stand-in plugin,
+ * with a fixed number of them in flight at all times. Every result is
+ * verified. Latency is the time from sending a job to the worker until
+ * its result is back.
+ *
+ * usage: bench-coproc [checks [parallel...]]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/time.h>
+#include "worker.h"
+
+#define MSG_DELIM "\1\0\0"
+#define MSG_DELIM_LEN (sizeof(MSG_DELIM))
+
+static uint64_t tv_usec(struct timeval *start, struct timeval *stop)
+{
+	return (stop->tv_sec - start->tv_sec) * 1000000 + stop->tv_usec - start->tv_usec;
+}
+
+static int send_job(int sd, const char *plugin, unsigned int id, int coproc)
+{
+	static struct kvvec kvv = KVVEC_INITIALIZER;
+	char cmd[PATH_MAX + 64];
+
+	snprintf(cmd, sizeof(cmd), "%s %u job %u", plugin, id % 4, id);
+	kvvec_init(&kvv, 6);
+	kvvec_addkv(&kvv, "job_id", mkstr("%u", id));
+	kvvec_addkv(&kvv, "type", "0");
+	kvvec_addkv(&kvv, "command", cmd);
+	kvvec_addkv(&kvv, "timeout", "10");
+	kvvec_addkv(&kvv, "env", "NAGIOS_HOSTNAME=bench\nNAGIOS_SERVICEDESC=dummy");
+	if (coproc)
+		kvvec_addkv(&kvv, "coproc", "1");
+	return worker_send_kvvec(sd, &kvv);
+}
+
+/* returns 1 if the result is what the plugin should have said, -1 if it's no result */
+static int check_result(struct kvvec *kvv, unsigned int *id)
+{
+	int i, status = -1, found = 0;
+	char *out = NULL, expect[64];
+
+	for (i = 0; i < kvv->kv_pairs; i++) {
+		struct key_value *kv = &kvv->kv[i];
+		if (!strcmp(kv->key, "job_id")) {
+			*id = strtoul(kv->value, NULL, 10);
+			found = 1;
+		} else if (!strcmp(kv->key, "wait_status")) {
+			status = atoi(kv->value);
+		} else if (!strcmp(kv->key, "outstd")) {
+			out = kv->value;
+		}
+	}
+	if (!found)
+		return -1;
+	if (!out)
+		return 0;
+
+	snprintf(expect, sizeof(expect), "job %u", *id);
+	return WIFEXITED(status) && WEXITSTATUS(status) == *id % 4 &&
+		!strncmp(out, expect, strlen(expect)) && strspn(out + strlen(expect), "\n") == strlen(out + strlen(expect));
+}
+
+static void bench_coproc(const char *name, const char *plugin, int coproc, unsigned int num, unsigned int parallel)
+{
+	struct kvvec kvv = KVVEC_INITIALIZER;
+	struct timeval start, now, *sent;
+	unsigned int next = 0, done = 0, failed = 0, id;
+	unsigned long size;
+	iocache *ioc;
+	histogram h;
+	int sv[2], status, ret;
+	pid_t pid;
+	char *buf;
+
+	sent = calloc(num, sizeof(*sent));
+	ioc = iocache_create(1024 * 1024);
+	if (!sent || !ioc || socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+		printf("%-7s: failed to set up\n", name);
+		return;
+	}
+
+	fflush(stdout);
+	pid = fork();
+	if (!pid) {
+		close(sv[0]);
+		enter_worker(sv[1], start_cmd);
+		exit(0);
+	}
+	close(sv[1]);
+
+	histogram_reset(&h);
+	gettimeofday(&start, NULL);
+	while (done < num) {
+		while (next < num && next - done < parallel) {
+			gettimeofday(&sent[next], NULL);
+			if (send_job(sv[0], plugin, next, coproc) < 0)
+				break;
+			next++;
+		}
+
+		if (iocache_read(ioc, sv[0]) <= 0)
+			break;
+		while ((buf = iocache_use_delim(ioc, MSG_DELIM, MSG_DELIM_LEN, &size))) {
+			if (buf2kvvec_prealloc(&kvv, buf, (unsigned int)size, '=', 0, KVVEC_ASSIGN) <= 0)
+				continue;
+			/* the worker logs things too */
+			if ((ret = check_result(&kvv, &id)) < 0 || id >= next)
+				continue;
+			gettimeofday(&now, NULL);
+			histogram_add(&h, tv_usec(&sent[id], &now));
+			if (!ret)
+				failed++;
+			done++;
+		}
+	}
+	gettimeofday(&now, NULL);
+
+	printf("%-7s %8u %8u %10.3f %10.0f %8llu %8llu %8llu %6u\n",
+	       name, num, parallel, tv_usec(&start, &now) / 1000000.0,
+	       done * 1000000.0 / tv_usec(&start, &now),
+	       (unsigned long long)histogram_percentile(&h, 50),
+	       (unsigned long long)histogram_percentile(&h, 99),
+	       (unsigned long long)h.max, failed + num - done);
+
+	/* the worker exits when we hang up, and takes its plugins along */
+	close(sv[0]);
+	waitpid(pid, &status, 0);
+	iocache_destroy(ioc);
+	free(kvv.kv);
+	free(sent);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i, num = 5000, parallel[] = { 1, 16 };
+	char path[PATH_MAX], plugin[PATH_MAX];
+
+	/* workers run in /tmp, so the plugin needs an absolute path */
+	snprintf(path, sizeof(path), "%s/coproc-dummy", dirname(strdup(argv[0])));
+	if (!realpath(path, plugin)) {
+		printf("Can't find the coproc-dummy plugin at %s\n", path);
+		return 1;
+	}
+
+	if (argc > 1)
+		num = atoi(argv[1]);
+
+	printf("%-7s %8s %8s %10s %10s %8s %8s %8s %6s\n",
+	       "path", "checks", "parallel", "time (s)", "checks/s",
+	       "p50 us", "p99 us", "max us", "failed");
+
+	if (argc > 2) {
+		for (i = 2; i < (unsigned int)argc; i++) {
+			bench_coproc("exec", plugin, 0, num, atoi(argv[i]));
+			bench_coproc("coproc", plugin, 1, num, atoi(argv[i]));
+		}
+		return 0;
+	}
+
+	for (i = 0; i < sizeof(parallel) / sizeof(parallel[0]); i++) {
+		bench_coproc("exec", plugin, 0, num, parallel[i]);
+		bench_coproc("coproc", plugin, 1, num, parallel[i]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * Benchmark comparing the fork() and posix_spawn() paths of runcmd_open().
+ *
+ * fork() has to copy the page tables of the process calling it, so the
+ * more memory a worker uses, the longer it takes to start a check. Each
+ * round grows the heap to a given size and touches every page of it,
+ * then starts a simple command a number of times with each path, one
+ * after the other, reading its output and reaping it like a worker
+ * would. Launch latency is the time spent in runcmd_open(); the rate
+ * also includes running the command and reaping it.
+ *
+ * usage: bench-runcmd [commands [heap-megabytes...]]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "runcmd.h"
+#include "histogram.h"
+
+#define BENCH_COMMAND "/bin/true"
+
+static void stub_iobreg(int fdout, int fderr, void *arg) { }
+
+static uint64_t tv_usec(struct timeval *start, struct timeval *stop)
+{
+	return (stop->tv_sec - start->tv_sec) * 1000000 + stop->tv_usec - start->tv_usec;
+}
+
+static void bench_runcmd(const char *name, int spawn, unsigned int heap_mb, unsigned int num)
+{
+	struct timeval start, opened, stop;
+	unsigned int i, failed = 0;
+	histogram h;
+	char buf[128];
+	int arg = 0;
+
+	runcmd_use_spawn(spawn);
+	histogram_reset(&h);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < num; i++) {
+		int pfd[2], pfderr[2], fd;
+		struct timeval before;
+
+		gettimeofday(&before, NULL);
+		fd = runcmd_open(BENCH_COMMAND, pfd, pfderr, NULL, stub_iobreg, &arg);
+		gettimeofday(&opened, NULL);
+		if (fd < 0) {
+			failed++;
+			continue;
+		}
+		histogram_add(&h, tv_usec(&before, &opened));
+		while (read(pfd[0], buf, sizeof(buf)) > 0)
+			;
+		close(pfderr[0]);
+		if (runcmd_close(fd))
+			failed++;
+	}
+	gettimeofday(&stop, NULL);
+
+	printf("%-6s %8u %8u %10.3f %10.0f %8llu %8llu %8llu %6u\n",
+	       name, heap_mb, num, tv_usec(&start, &stop) / 1000000.0,
+	       num * 1000000.0 / tv_usec(&start, &stop),
+	       (unsigned long long)histogram_percentile(&h, 50),
+	       (unsigned long long)histogram_percentile(&h, 99),
+	       (unsigned long long)h.max, failed);
+}
+
+static void bench_heap(unsigned int heap_mb, unsigned int num)
+{
+	char *heap = NULL;
+
+	if (heap_mb) {
+		heap = malloc((size_t)heap_mb << 20);
+		if (!heap) {
+			printf("%-6s %8u: out of memory\n", "", heap_mb);
+			return;
+		}
+		memset(heap, 1, (size_t)heap_mb << 20);
+	}
+
+	bench_runcmd("fork", 0, heap_mb, num);
+
+	/* the previous setting always reads back as 0 without posix_spawn() */
+	runcmd_use_spawn(1);
+	if (runcmd_use_spawn(1))
+		bench_runcmd("spawn", 1, heap_mb, num);
+	else
+		printf("%-6s %8u: posix_spawn() is not available\n", "spawn", heap_mb);
+
+	free(heap);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i, num = 500, sizes[] = { 0, 64, 512 };
+
+	runcmd_init();
+	if (argc > 1)
+		num = atoi(argv[1]);
+
+	printf("%-6s %8s %8s %10s %10s %8s %8s %8s %6s\n",
+	       "path", "heap MB", "cmds", "time (s)", "cmds/s",
+	       "p50 us", "p99 us", "max us", "failed");
+
+	if (argc > 2) {
+		for (i = 2; i < (unsigned int)argc; i++)
+			bench_heap(atoi(argv[i]), num);
+		return 0;
+	}
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		bench_heap(sizes[i], num);
+
+	return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * Benchmark comparing the heap and timing wheel squeue backends.
+ *
+ * Each round fills a queue with checks spread over their check
+ * interval, the way Nagios does at startup, and then runs the main
+ * loop against a simulated clock: pop the next event, reschedule it
+ * one interval later and now and then cancel some other event and
+ * add it back in, like a passive check result or an external
+ * command rescheduling a check would do.
+ *
+ * usage: bench-squeue [events...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+#include "squeue.h"
+
+struct bench_event {
+	squeue_event *evt;
+	struct timeval when;
+	unsigned int interval;
+};
+
+static double tv_elapsed(struct timeval *start)
+{
+	struct timeval stop;
+
+	gettimeofday(&stop, NULL);
+	return (stop.tv_sec - start->tv_sec) + ((double)stop.tv_usec - start->tv_usec) / 1000000;
+}
+
+/* most checks run every 5 minutes, the rest are spread out a bit */
+static unsigned int check_interval(void)
+{
+	static const unsigned int intervals[] = { 60, 300, 300, 300, 300, 300, 600, 900, 1800, 3600, 14400 };
+
+	return intervals[rand() % (sizeof(intervals) / sizeof(intervals[0]))];
+}
+
+static void bench_squeue(const char *name, squeue_t *(*create)(unsigned int), unsigned int num)
+{
+	struct bench_event *events, *e;
+	struct timeval start;
+	time_t now = time(NULL);
+	unsigned int i, ops = num * 5;
+	double fill, run, drain;
+	squeue_t *sq;
+
+	events = calloc(num, sizeof(*events));
+	if (!events) {
+		printf("%-6s %8u: out of memory\n", name, num);
+		return;
+	}
+
+	srand(num);
+	gettimeofday(&start, NULL);
+	sq = create(num);
+	for (i = 0; i < num; i++) {
+		e = &events[i];
+		e->interval = check_interval();
+		e->when.tv_sec = now + 1 + (i % e->interval);
+		e->when.tv_usec = rand() % 1000000;
+		e->evt = squeue_add_tv(sq, &e->when, e);
+	}
+	fill = tv_elapsed(&start);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < ops; i++) {
+		e = squeue_pop(sq);
+		e->when.tv_sec += e->interval;
+		e->evt = squeue_add_tv(sq, &e->when, e);
+
+		/* every tenth event, something reschedules a random check */
+		if (!(i % 10)) {
+			e = &events[rand() % num];
+			squeue_remove(sq, e->evt);
+			e->when.tv_sec += rand() % e->interval;
+			e->evt = squeue_add_tv(sq, &e->when, e);
+		}
+	}
+	run = tv_elapsed(&start);
+
+	gettimeofday(&start, NULL);
+	while (squeue_pop(sq))
+		;
+	drain = tv_elapsed(&start);
+	squeue_destroy(sq, 0);
+	free(events);
+
+	printf("%-6s %8u %10.3f %10.3f %10.3f %12.0f\n",
+	       name, num, fill, run, drain, (ops * 1.1) / run);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i, sizes[] = { 10000, 100000, 1000000 };
+
+	printf("%-6s %8s %10s %10s %10s %12s\n",
+	       "queue", "events", "fill (s)", "run (s)", "drain (s)", "resched/s");
+
+	if (argc > 1) {
+		for (i = 1; i < (unsigned int)argc; i++) {
+			bench_squeue("heap", squeue_create, atoi(argv[i]));
+			bench_squeue("wheel", squeue_create_wheel, atoi(argv[i]));
+		}
+		return 0;
+	}
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		bench_squeue("heap", squeue_create, sizes[i]);
+		bench_squeue("wheel", squeue_create_wheel, sizes[i]);
+	}
+
+	return 0;
+}
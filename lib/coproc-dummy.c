@@ -0,0 +1,107 @@
+/*
+ * A stand-in plugin that can run as a coprocess of a worker.
+ *
+ * Run normally, it behaves like check_dummy:
+ *   coproc-dummy <state> [text...]
+ * prints the text, or the name of the state if there is none, and
+ * exits with the given state.
+ *
+ * Started by a worker with NAGIOS_COPROCESS=1 in its environment, it
+ * instead reads requests from stdin and answers each of them on stdout
+ * the same way, until stdin is closed. See worker.h for the protocol.
+ * This is all a real plugin needs to do to support it as well.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "worker.h"
+
+#define MSG_DELIM "\1\0\0"
+#define MSG_DELIM_LEN (sizeof(MSG_DELIM))
+#define MAX_ARGS 64
+
+static const char *state_names[] = { "OK", "WARNING", "CRITICAL", "UNKNOWN" };
+
+/* the check itself, shared by both modes */
+static int check(int argc, char **argv, char *out, size_t len)
+{
+	int state, i;
+	size_t used;
+
+	if (argc < 2) {
+		snprintf(out, len, "Usage: coproc-dummy <state> [text...]");
+		return 3;
+	}
+
+	state = atoi(argv[1]);
+	if (state < 0 || state > 3)
+		state = 3;
+	if (argc < 3) {
+		snprintf(out, len, "%s", state_names[state]);
+		return state;
+	}
+
+	*out = 0;
+	for (i = 2, used = 0; i < argc && used < len - 1; i++) {
+		used += snprintf(out + used, len - used, "%s%s", i > 2 ? " " : "", argv[i]);
+	}
+	return state;
+}
+
+static int serve(void)
+{
+	struct kvvec req = KVVEC_INITIALIZER, resp = KVVEC_INITIALIZER;
+	char *buf, *job_id, *argv[MAX_ARGS + 1], out[4096];
+	unsigned long size;
+	iocache *ioc;
+	int argc, i, state;
+
+	ioc = iocache_create(64 * 1024);
+	if (!ioc)
+		return 1;
+
+	while (iocache_read(ioc, STDIN_FILENO) > 0) {
+		while ((buf = iocache_use_delim(ioc, MSG_DELIM, MSG_DELIM_LEN, &size))) {
+			if (buf2kvvec_prealloc(&req, buf, (unsigned int)size, '=', 0, KVVEC_ASSIGN) <= 0)
+				return 1;
+
+			job_id = NULL;
+			argv[0] = "coproc-dummy";
+			for (argc = 1, i = 0; i < req.kv_pairs; i++) {
+				struct key_value *kv = &req.kv[i];
+				if (!strcmp(kv->key, "job_id"))
+					job_id = kv->value;
+				else if (!strcmp(kv->key, "arg") && argc < MAX_ARGS)
+					argv[argc++] = kv->value;
+			}
+			argv[argc] = NULL;
+			if (!job_id)
+				return 1;
+
+			state = check(argc, argv, out, sizeof(out));
+
+			kvvec_init(&resp, 3);
+			kvvec_addkv(&resp, "job_id", job_id);
+			kvvec_addkv(&resp, "exit_code", mkstr("%d", state));
+			kvvec_addkv(&resp, "outstd", out);
+			if (worker_send_kvvec(STDOUT_FILENO, &resp) < 0)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	char out[4096];
+	int state;
+
+	if (getenv(WORKER_COPROC_ENV))
+		return serve();
+
+	state = check(argc, argv, out, sizeof(out));
+	puts(out);
+	return state;
+}
@@ -0,0 +1,112 @@
+#include <string.h>
+#include "histogram.h"
+
+#define HALF_BUCKETS (HISTOGRAM_SUB_BUCKETS / 2)
+
+static inline unsigned int highest_bit(uint64_t value)
+{
+	unsigned int bit = 0;
+
+#if defined(__GNUC__)
+	bit = 63 - __builtin_clzll(value);
+#else
+	while (value >>= 1)
+		bit++;
+#endif
+	return bit;
+}
+
+static inline unsigned int bucket_of(uint64_t value)
+{
+	unsigned int shift;
+
+	if (value < HISTOGRAM_SUB_BUCKETS)
+		return (unsigned int)value;
+	if (value >= HISTOGRAM_MAX_VALUE)
+		return HISTOGRAM_BUCKETS - 1;
+
+	/* keep the HISTOGRAM_SUB_BITS highest bits of the value */
+	shift = highest_bit(value) - HISTOGRAM_SUB_BITS + 1;
+	return HISTOGRAM_SUB_BUCKETS + (shift - 1) * HALF_BUCKETS + (unsigned int)(value >> shift) - HALF_BUCKETS;
+}
+
+uint64_t histogram_bucket_top(unsigned int bucket)
+{
+	unsigned int shift;
+	uint64_t base;
+
+	if (bucket < HISTOGRAM_SUB_BUCKETS)
+		return bucket;
+
+	shift = (bucket - HISTOGRAM_SUB_BUCKETS) / HALF_BUCKETS + 1;
+	base = (bucket - HISTOGRAM_SUB_BUCKETS) % HALF_BUCKETS + HALF_BUCKETS;
+	return ((base + 1) << shift) - 1;
+}
+
+void histogram_reset(histogram *h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+void histogram_add(histogram *h, uint64_t value)
+{
+	if (!h->count || value < h->min)
+		h->min = value;
+	if (value > h->max)
+		h->max = value;
+	h->count++;
+	h->sum += value;
+	h->buckets[bucket_of(value)]++;
+}
+
+void histogram_merge(histogram *dst, const histogram *src)
+{
+	unsigned int i;
+
+	if (!src->count)
+		return;
+	if (!dst->count || src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	dst->count += src->count;
+	dst->sum += src->sum;
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+}
+
+uint64_t histogram_percentile(const histogram *h, double percentile)
+{
+	uint64_t wanted, seen = 0, value;
+	unsigned int i;
+
+	if (!h->count)
+		return 0;
+	if (percentile <= 0.0)
+		return h->min;
+	if (percentile >= 100.0)
+		return h->max;
+
+	/* the rank of the value we're after, counting from 1 */
+	wanted = (uint64_t)(percentile * h->count / 100.0 + 0.5);
+	if (wanted < 1)
+		wanted = 1;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= wanted)
+			break;
+	}
+
+	value = histogram_bucket_top(i);
+	if (value < h->min)
+		return h->min;
+	if (value > h->max)
+		return h->max;
+	return value;
+}
+
+double histogram_mean(const histogram *h)
+{
+	return h->count ? (double)h->sum / (double)h->count : 0.0;
+}
@@ -0,0 +1,85 @@
+#ifndef LIBNAGIOS_HISTOGRAM_H_INCLUDED
+#define LIBNAGIOS_HISTOGRAM_H_INCLUDED
+#include <stdint.h>
+
+/**
+ * @file histogram.h
+ * @brief Cheap histograms of latencies and durations
+ *
+ * A histogram counts values in buckets whose width grows with the
+ * values they hold, the way HdrHistogram does it. Values below
+ * HISTOGRAM_SUB_BUCKETS get a bucket each, and every power of two
+ * above that is split into HISTOGRAM_SUB_BUCKETS / 2 buckets, so a
+ * percentile read from a histogram is never more than about 6% off.
+ *
+ * Adding a value is a handful of arithmetic and bit operations and
+ * never allocates, so histograms can be fed from the hottest loops.
+ * Values are plain integers; Nagios uses microseconds. Values from
+ * HISTOGRAM_MAX_VALUE up all go in the last bucket.
+ * @{
+ */
+
+#define HISTOGRAM_SUB_BITS     5
+#define HISTOGRAM_SUB_BUCKETS  (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_BITS     36  /**< about 19 hours in microseconds */
+#define HISTOGRAM_MAX_VALUE    ((uint64_t)1 << HISTOGRAM_MAX_BITS)
+#define HISTOGRAM_BUCKETS \
+	(HISTOGRAM_SUB_BUCKETS + (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS) * (HISTOGRAM_SUB_BUCKETS / 2))
+
+struct histogram {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint32_t buckets[HISTOGRAM_BUCKETS];
+};
+typedef struct histogram histogram;
+
+/**
+ * Forget everything a histogram has counted. A zeroed histogram
+ * needs no resetting before use.
+ * @param h The histogram
+ */
+extern void histogram_reset(histogram *h);
+
+/**
+ * Count a value
+ * @param h The histogram
+ * @param value The value
+ */
+extern void histogram_add(histogram *h, uint64_t value);
+
+/**
+ * Add everything one histogram has counted to another
+ * @param dst The histogram to add to
+ * @param src The histogram to add
+ */
+extern void histogram_merge(histogram *dst, const histogram *src);
+
+/**
+ * Get a percentile of the counted values
+ * @param h The histogram
+ * @param percentile The percentile, from 0 to 100
+ * @return The highest value in the bucket the percentile falls in, but
+ *         no less than the smallest and no more than the largest
+ *         value counted. 0 if nothing has been counted.
+ */
+extern uint64_t histogram_percentile(const histogram *h, double percentile);
+
+/**
+ * Get the highest value that goes in a bucket, for exporting the
+ * buckets themselves
+ * @param bucket The bucket, from 0 to HISTOGRAM_BUCKETS - 1
+ * @return The value. The last bucket also holds everything larger.
+ */
+extern uint64_t histogram_bucket_top(unsigned int bucket);
+
+/**
+ * Get the mean of the counted values
+ * @param h The histogram
+ * @return The mean, or 0 if nothing has been counted
+ */
+extern double histogram_mean(const histogram *h);
+
+/** @} */
+#endif
@@ -50,6 +50,7 @@ struct iobroker_set {
 #elif !defined(IOBROKER_USES_SELECT)
 	struct pollfd *pfd;
 #endif
+	struct timeval woke; /* when the last poll stopped waiting */
 };
 
 static struct {
@@ -335,6 +336,7 @@ int iobroker_poll(iobroker_set *iobs, int timeout)
 
 #if defined(IOBROKER_USES_EPOLL)
 	nfds = epoll_wait(iobs->epfd, iobs->ep_events, iobs->num_fds, timeout);
+	gettimeofday(&iobs->woke, NULL);
 	if (nfds < 0) {
 		return IOBROKER_ELIB;
 	}
@@ -382,6 +384,7 @@ int iobroker_poll(iobroker_set *iobs, int timeout)
 		} else { /* timeout of -1 means poll indefinitely */
 			nfds = select(iobs->max_fds, &read_fds, NULL, NULL, NULL);
 		}
+		gettimeofday(&iobs->woke, NULL);
 		if (nfds < 0) {
 			return IOBROKER_ELIB;
 		}
@@ -416,6 +419,7 @@ int iobroker_poll(iobroker_set *iobs, int timeout)
 			p++;
 		}
 		nfds = poll(iobs->pfd, p, timeout);
+		gettimeofday(&iobs->woke, NULL);
 		if (nfds < 0) {
 			return IOBROKER_ELIB;
 		}
@@ -438,3 +442,11 @@ int iobroker_poll(iobroker_set *iobs, int timeout)
 
 	return ret;
 }
+
+void iobroker_last_wakeup(iobroker_set *iobs, struct timeval *tv)
+{
+	if (iobs)
+		*tv = iobs->woke;
+	else
+		tv->tv_sec = tv->tv_usec = 0;
+}
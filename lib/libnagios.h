@@ -21,6 +21,8 @@
 #include "skiplist.h"
 #include "nsock.h"
 #include "nspath.h"
+#include "logindex.h"
+#include "histogram.h"
 #include "snprintf.h"
 #include "nwrite.h"
 #endif /* LIB_libnagios_h__ */
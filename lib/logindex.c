@@ -0,0 +1,567 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "lnag-utils.h"
+#include "logindex.h"
+
+struct logindex {
+	int fd;
+	uint64_t end;         /* where the next entry goes */
+	uint64_t entries;
+	uint64_t covered;     /* log bytes indexed so far */
+};
+
+struct logindex_reader {
+	const char *log;
+	uint64_t log_size;
+	void *map;
+	size_t map_size;
+	const struct logindex_entry *entries;
+	uint64_t num_entries, next_entry;
+	uint64_t pos;         /* where we read the unindexed lines from */
+	unsigned int types;
+	uint32_t *keys;
+	unsigned int num_keys, keys_size;
+	int sorted;
+};
+
+/* the prefixes of the messages we index */
+static const struct logindex_prefix {
+	const char *prefix;
+	size_t len;
+	unsigned int type;
+	int skip;             /* fields before the host name */
+} prefixes[] = {
+#define LOGIDX_PREFIX(str, type, skip) { str, sizeof(str) - 1, type, skip }
+	LOGIDX_PREFIX("HOST ALERT: ", LOGIDX_HOST | LOGIDX_ALERT, 0),
+	LOGIDX_PREFIX("SERVICE ALERT: ", LOGIDX_SERVICE | LOGIDX_ALERT, 0),
+	LOGIDX_PREFIX("INITIAL HOST STATE: ", LOGIDX_HOST | LOGIDX_STATE, 0),
+	LOGIDX_PREFIX("CURRENT HOST STATE: ", LOGIDX_HOST | LOGIDX_STATE, 0),
+	LOGIDX_PREFIX("INITIAL SERVICE STATE: ", LOGIDX_SERVICE | LOGIDX_STATE, 0),
+	LOGIDX_PREFIX("CURRENT SERVICE STATE: ", LOGIDX_SERVICE | LOGIDX_STATE, 0),
+	LOGIDX_PREFIX("HOST DOWNTIME ALERT: ", LOGIDX_HOST | LOGIDX_DOWNTIME, 0),
+	LOGIDX_PREFIX("SERVICE DOWNTIME ALERT: ", LOGIDX_SERVICE | LOGIDX_DOWNTIME, 0),
+	LOGIDX_PREFIX("HOST FLAPPING ALERT: ", LOGIDX_HOST | LOGIDX_FLAPPING, 0),
+	LOGIDX_PREFIX("SERVICE FLAPPING ALERT: ", LOGIDX_SERVICE | LOGIDX_FLAPPING, 0),
+	LOGIDX_PREFIX("HOST NOTIFICATION: ", LOGIDX_HOST | LOGIDX_NOTIFICATION, 1),
+	LOGIDX_PREFIX("SERVICE NOTIFICATION: ", LOGIDX_SERVICE | LOGIDX_NOTIFICATION, 1),
+#undef LOGIDX_PREFIX
+};
+
+/*
+ * The CGIs look for these anywhere in a line, so we do too. That way
+ * a reader gets exactly the program lines it would have found by
+ * reading the whole log.
+ */
+static const char *program_markers[] = {
+	" starting...", " restarting...", " shutting down...", "Bailing out",
+};
+
+/* 32-bit FNV-1a */
+#define FNV_OFFSET 2166136261U
+#define FNV_PRIME  16777619U
+
+static uint32_t fnv_update(uint32_t h, const char *p, size_t len)
+{
+	while (len--) {
+		h ^= (unsigned char)*p++;
+		h *= FNV_PRIME;
+	}
+	return h;
+}
+
+char *logindex_path(const char *log_path)
+{
+	char *path;
+	size_t len;
+
+	if (!log_path)
+		return NULL;
+	len = strlen(log_path);
+	if (!(path = malloc(len + 5)))
+		return NULL;
+	memcpy(path, log_path, len);
+	memcpy(path + len, ".idx", 5);
+	return path;
+}
+
+uint32_t logindex_key(const char *host_name, const char *service_description)
+{
+	uint32_t h;
+
+	h = fnv_update(FNV_OFFSET, host_name, strlen(host_name));
+	if (service_description) {
+		h = fnv_update(h, "", 1);
+		h = fnv_update(h, service_description, strlen(service_description));
+	}
+	return h;
+}
+
+unsigned int logindex_classify(const char *msg, uint32_t *key)
+{
+	unsigned int i, type = 0;
+	const char *host, *svc, *end;
+
+	*key = 0;
+	for (i = 0; i < ARRAY_SIZE(program_markers); i++) {
+		if (strstr(msg, program_markers[i])) {
+			type = LOGIDX_PROGRAM;
+			break;
+		}
+	}
+
+	for (i = 0; i < ARRAY_SIZE(prefixes); i++) {
+		const struct logindex_prefix *p = &prefixes[i];
+		int skip;
+
+		if (strncmp(msg, p->prefix, p->len))
+			continue;
+
+		host = msg + p->len;
+		for (skip = p->skip; skip; skip--) {
+			if (!(host = strchr(host, ';')))
+				return type;
+			host++;
+		}
+		if (!(end = strchr(host, ';')))
+			return type;
+		*key = fnv_update(FNV_OFFSET, host, end - host);
+		if (p->type & LOGIDX_SERVICE) {
+			svc = end + 1;
+			if (!(end = strchr(svc, ';')))
+				return type;
+			*key = fnv_update(fnv_update(*key, "", 1), svc, end - svc);
+		}
+		return type | p->type;
+	}
+
+	return type;
+}
+
+/*
+ * Parse a "[timestamp] message" line. Returns the message, or NULL
+ * for lines that don't look like that.
+ */
+static const char *parse_line(const char *line, time_t *timestamp)
+{
+	char *end;
+
+	if (*line != '[')
+		return NULL;
+	*timestamp = (time_t)strtoull(line + 1, &end, 10);
+	if (end == line + 1 || *end != ']' || end[1] != ' ')
+		return NULL;
+	return end + 2;
+}
+
+int logindex_add(logindex *idx, uint64_t offset, time_t timestamp, const char *msg)
+{
+	struct logindex_entry e;
+	uint32_t key;
+	unsigned int type;
+
+	if (!idx || !msg)
+		return -1;
+
+	if (!(type = logindex_classify(msg, &key)))
+		return 0;
+
+	memset(&e, 0, sizeof(e));
+	e.offset = offset;
+	e.timestamp = (int64_t)timestamp;
+	e.key = key;
+	e.type = type;
+	if (pwrite(idx->fd, &e, sizeof(e), idx->end) != sizeof(e))
+		return -1;
+	idx->end += sizeof(e);
+	idx->entries++;
+	return 0;
+}
+
+static int write_header(logindex *idx)
+{
+	struct logindex_header hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, LOGIDX_MAGIC, sizeof(hdr.magic));
+	hdr.version = LOGIDX_VERSION;
+	hdr.entry_size = sizeof(struct logindex_entry);
+	hdr.log_size = idx->covered;
+	if (pwrite(idx->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+		return -1;
+	return 0;
+}
+
+/* the end of the line starting at offset, or 0 if there's no such line */
+static uint64_t line_end(const char *log, uint64_t log_size, uint64_t offset)
+{
+	const char *nl;
+
+	if (offset >= log_size || log[offset] != '[')
+		return 0;
+	if (offset && log[offset - 1] != '\n')
+		return 0;
+	if (!(nl = memchr(log + offset, '\n', log_size - offset)))
+		return 0;
+	return nl - log + 1;
+}
+
+/*
+ * How much of the log an index covers: everything up to the end of
+ * the last indexed line, or what it said when it was closed if that's
+ * more. Returns 0 if the index can't belong to the log.
+ */
+static int index_coverage(const struct logindex_header *hdr, const struct logindex_entry *last,
+                          const char *log, uint64_t log_size, uint64_t *covered)
+{
+	uint64_t end = 0;
+
+	if (last && !(end = line_end(log, log_size, last->offset)))
+		return 0;
+	if (hdr->log_size > log_size)
+		return 0;
+	*covered = hdr->log_size > end ? hdr->log_size : end;
+	return 1;
+}
+
+static int header_ok(const struct logindex_header *hdr)
+{
+	return !memcmp(hdr->magic, LOGIDX_MAGIC, sizeof(hdr->magic)) &&
+		hdr->version == LOGIDX_VERSION &&
+		hdr->entry_size == sizeof(struct logindex_entry);
+}
+
+/* index the complete lines in log[idx->covered, log_size) */
+static int index_lines(logindex *idx, const char *log, uint64_t log_size)
+{
+	char *buf = NULL;
+	size_t bufsize = 0;
+	uint64_t pos = idx->covered;
+
+	while (pos < log_size) {
+		const char *line = log + pos, *nl, *msg;
+		size_t len;
+		time_t timestamp;
+
+		if (!(nl = memchr(line, '\n', log_size - pos)))
+			break;
+		len = nl - line;
+		if (len + 1 > bufsize) {
+			char *p;
+			bufsize = len + 1 > 256 ? len + 1 : 256;
+			if (!(p = realloc(buf, bufsize))) {
+				free(buf);
+				return -1;
+			}
+			buf = p;
+		}
+		memcpy(buf, line, len);
+		buf[len] = 0;
+		if ((msg = parse_line(buf, &timestamp)) && logindex_add(idx, pos, timestamp, msg) < 0) {
+			free(buf);
+			return -1;
+		}
+		pos += len + 1;
+		idx->covered = pos;
+	}
+
+	free(buf);
+	return 0;
+}
+
+static logindex *index_open(const char *log_path, int rebuild)
+{
+	logindex *idx;
+	struct logindex_header hdr;
+	struct logindex_entry last;
+	struct stat st;
+	char *path, *log = NULL;
+	uint64_t log_size = 0;
+	int log_fd, fd;
+
+	if (!(path = logindex_path(log_path)))
+		return NULL;
+	fd = open(path, O_RDWR | O_CREAT, 0644);
+	free(path);
+	if (fd < 0)
+		return NULL;
+	(void)fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	if ((log_fd = open(log_path, O_RDONLY)) >= 0) {
+		if (!fstat(log_fd, &st) && st.st_size > 0) {
+			log_size = st.st_size;
+			log = mmap(NULL, log_size, PROT_READ, MAP_PRIVATE, log_fd, 0);
+			if (log == MAP_FAILED)
+				log = NULL;
+		}
+		close(log_fd);
+	}
+	if (log_size && !log) {
+		close(fd);
+		return NULL;
+	}
+
+	if (!(idx = calloc(1, sizeof(*idx)))) {
+		if (log)
+			munmap(log, log_size);
+		close(fd);
+		return NULL;
+	}
+	idx->fd = fd;
+
+	/* see if we can carry on where the index left off */
+	if (!rebuild && !fstat(fd, &st) && st.st_size >= (off_t)sizeof(hdr) &&
+	    pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) && header_ok(&hdr))
+	{
+		/* a torn entry at the end is dropped */
+		idx->entries = (st.st_size - sizeof(hdr)) / sizeof(last);
+		idx->end = sizeof(hdr) + idx->entries * sizeof(last);
+		if (!idx->entries)
+			rebuild = !index_coverage(&hdr, NULL, log, log_size, &idx->covered);
+		else if (pread(fd, &last, sizeof(last), idx->end - sizeof(last)) != sizeof(last))
+			rebuild = 1;
+		else
+			rebuild = !index_coverage(&hdr, &last, log, log_size, &idx->covered);
+	} else {
+		rebuild = 1;
+	}
+
+	if (rebuild) {
+		idx->entries = 0;
+		idx->covered = 0;
+		idx->end = sizeof(hdr);
+	}
+	if (ftruncate(fd, idx->end) < 0 || index_lines(idx, log, log_size) < 0 || write_header(idx) < 0) {
+		if (log)
+			munmap(log, log_size);
+		close(fd);
+		free(idx);
+		return NULL;
+	}
+
+	if (log)
+		munmap(log, log_size);
+	return idx;
+}
+
+logindex *logindex_open(const char *log_path)
+{
+	return index_open(log_path, 0);
+}
+
+void logindex_close(logindex *idx, uint64_t log_size)
+{
+	if (!idx)
+		return;
+
+	if (log_size > idx->covered)
+		idx->covered = log_size;
+	write_header(idx);
+	close(idx->fd);
+	free(idx);
+}
+
+int logindex_build(const char *log_path)
+{
+	logindex *idx;
+	int entries;
+
+	if (!(idx = index_open(log_path, 1)))
+		return -1;
+	entries = (int)idx->entries;
+	logindex_close(idx, 0);
+	return entries;
+}
+
+
+/*
+ * Reading
+ */
+
+/* set up r to use the index at path, if it's any good */
+static void reader_use_index(logindex_reader *r, const char *path)
+{
+	const struct logindex_header *hdr;
+	const struct logindex_entry *entries;
+	struct stat st;
+	uint64_t num, covered;
+	void *map;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(*hdr)) {
+		close(fd);
+		return;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return;
+
+	hdr = map;
+	entries = (const struct logindex_entry *)(hdr + 1);
+	num = (st.st_size - sizeof(*hdr)) / sizeof(*entries);
+
+	/* lines logged after we opened the log are read without the index */
+	while (num && entries[num - 1].offset >= r->log_size)
+		num--;
+
+	if (!header_ok(hdr) ||
+	    !index_coverage(hdr, num ? &entries[num - 1] : NULL, r->log, r->log_size, &covered) ||
+	    (num && !line_end(r->log, r->log_size, entries[0].offset)))
+	{
+		munmap(map, st.st_size);
+		return;
+	}
+
+	r->map = map;
+	r->map_size = st.st_size;
+	r->entries = entries;
+	r->num_entries = num;
+	r->pos = covered;
+}
+
+logindex_reader *logindex_reader_open(const char *log_path, unsigned int types)
+{
+	logindex_reader *r;
+	struct stat st;
+	char *path;
+	int fd;
+
+	if ((fd = open(log_path, O_RDONLY)) < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0 || !(r = calloc(1, sizeof(*r)))) {
+		close(fd);
+		return NULL;
+	}
+	r->types = types;
+	if (!(types & (LOGIDX_HOST | LOGIDX_SERVICE)))
+		r->types |= LOGIDX_HOST | LOGIDX_SERVICE;
+
+	if (st.st_size > 0) {
+		r->log_size = st.st_size;
+		r->log = mmap(NULL, r->log_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (r->log == MAP_FAILED) {
+			close(fd);
+			free(r);
+			return NULL;
+		}
+	}
+	close(fd);
+
+	if (r->log && (path = logindex_path(log_path))) {
+		reader_use_index(r, path);
+		free(path);
+	}
+
+	return r;
+}
+
+int logindex_reader_want(logindex_reader *r, const char *host_name, const char *service_description)
+{
+	if (!r || !host_name)
+		return -1;
+
+	if (r->num_keys >= r->keys_size) {
+		unsigned int size = r->keys_size ? r->keys_size * 2 : 16;
+		uint32_t *keys = realloc(r->keys, size * sizeof(*keys));
+		if (!keys)
+			return -1;
+		r->keys = keys;
+		r->keys_size = size;
+	}
+	r->keys[r->num_keys++] = logindex_key(host_name, service_description);
+	r->sorted = 0;
+	return 0;
+}
+
+static int key_cmp(const void *a_, const void *b_)
+{
+	uint32_t a = *(const uint32_t *)a_, b = *(const uint32_t *)b_;
+
+	return a < b ? -1 : a > b;
+}
+
+static int entry_wanted(logindex_reader *r, const struct logindex_entry *e)
+{
+	unsigned int type = e->type & r->types;
+
+	if (type & LOGIDX_PROGRAM)
+		return 1;
+	if (!(type & LOGIDX_CLASSES) || !(type & (LOGIDX_HOST | LOGIDX_SERVICE)))
+		return 0;
+	if (!r->num_keys)
+		return 1;
+	return bsearch(&e->key, r->keys, r->num_keys, sizeof(*r->keys), key_cmp) != NULL;
+}
+
+static char *dup_line(const char *line, size_t len)
+{
+	char *buf;
+
+	if (!(buf = malloc(len + 1)))
+		return NULL;
+	memcpy(buf, line, len);
+	buf[len] = 0;
+	return buf;
+}
+
+char *logindex_reader_gets(logindex_reader *r)
+{
+	const char *line, *nl;
+	size_t len;
+
+	if (!r)
+		return NULL;
+
+	if (!r->sorted) {
+		if (r->num_keys)
+			qsort(r->keys, r->num_keys, sizeof(*r->keys), key_cmp);
+		r->sorted = 1;
+	}
+
+	while (r->next_entry < r->num_entries) {
+		const struct logindex_entry *e = &r->entries[r->next_entry++];
+
+		if (!entry_wanted(r, e))
+			continue;
+		line = r->log + e->offset;
+		nl = memchr(line, '\n', r->log_size - e->offset);
+		return dup_line(line, nl ? (size_t)(nl - line) : r->log_size - e->offset);
+	}
+
+	if (r->pos >= r->log_size)
+		return NULL;
+	line = r->log + r->pos;
+	if ((nl = memchr(line, '\n', r->log_size - r->pos)))
+		len = nl - line;
+	else
+		len = r->log_size - r->pos;
+	r->pos += len + 1;
+	return dup_line(line, len);
+}
+
+int logindex_reader_indexed(logindex_reader *r)
+{
+	return r && r->map != NULL;
+}
+
+void logindex_reader_close(logindex_reader *r)
+{
+	if (!r)
+		return;
+
+	if (r->map)
+		munmap(r->map, r->map_size);
+	if (r->log)
+		munmap((void *)r->log, r->log_size);
+	free(r->keys);
+	free(r);
+}
@@ -0,0 +1,167 @@
+#ifndef LIBNAGIOS_LOGINDEX_H_INCLUDED
+#define LIBNAGIOS_LOGINDEX_H_INCLUDED
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * @file logindex.h
+ * @brief Index of the lines in Nagios log files that reports care about
+ *
+ * Availability and trend reports and the alert history only look at
+ * a small part of what Nagios logs, and usually only at the lines
+ * about a handful of hosts and services. A log index remembers where
+ * the state changes, downtime, flapping and notification lines of a
+ * log file are and which host or service they're about, so readers
+ * can go straight to them instead of reading the whole file.
+ *
+ * The index of "nagios.log" lives in "nagios.log.idx". It is a header
+ * followed by fixed-size entries in the order the lines appear in the
+ * log, so Nagios can append to it as it writes the log. The lines
+ * written after the last indexed one are read the usual way, so an
+ * index that lags behind its log is still good to use.
+ * @{
+ */
+
+/** @name Types of indexed lines
+ * An entry has one or more class bits, plus LOGIDX_HOST or
+ * LOGIDX_SERVICE for lines about an object.
+ * @{
+ */
+#define LOGIDX_PROGRAM       (1 << 0) /**< program starts, restarts and stops */
+#define LOGIDX_ALERT         (1 << 1) /**< host and service alerts */
+#define LOGIDX_STATE         (1 << 2) /**< initial and current states */
+#define LOGIDX_DOWNTIME      (1 << 3) /**< downtime starts and stops */
+#define LOGIDX_FLAPPING      (1 << 4) /**< flapping starts and stops */
+#define LOGIDX_NOTIFICATION  (1 << 5) /**< notifications */
+#define LOGIDX_CLASSES       0x3f
+#define LOGIDX_HOST          (1 << 6)
+#define LOGIDX_SERVICE       (1 << 7)
+#define LOGIDX_ALL           0xff
+/** @} */
+
+#define LOGIDX_MAGIC   "NAGLOGIX"
+#define LOGIDX_VERSION 1
+
+struct logindex_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t entry_size;
+	uint64_t log_size;      /**< log bytes covered when the index was closed */
+};
+
+struct logindex_entry {
+	uint64_t offset;        /**< where the line starts in the log */
+	int64_t timestamp;
+	uint32_t key;           /**< logindex_key() of the host or service */
+	uint16_t type;
+	uint16_t pad;
+};
+
+/** opaque type for an index being written */
+typedef struct logindex logindex;
+
+/** opaque type for reading a log through its index */
+typedef struct logindex_reader logindex_reader;
+
+/**
+ * Get the name of the index of a log file
+ * @param log_path The log file
+ * @return A newly allocated string, or NULL on errors
+ */
+extern char *logindex_path(const char *log_path);
+
+/**
+ * Compute the key a host or service is indexed by
+ * @param host_name Name of the host
+ * @param service_description Description of the service, or NULL for
+ *        the host itself
+ * @return The key
+ */
+extern uint32_t logindex_key(const char *host_name, const char *service_description);
+
+/**
+ * Find out what a log message is about
+ * @param msg The message, without the leading "[timestamp] "
+ * @param[out] key Set to the key of the host or service it's about
+ * @return The LOGIDX_* type of the message, or 0 if it isn't indexed
+ */
+extern unsigned int logindex_classify(const char *msg, uint32_t *key);
+
+/**
+ * Open the index of a log file for appending. Lines already in the
+ * log that aren't in the index yet are indexed right away, and an
+ * index that doesn't belong to the log is built afresh.
+ * @param log_path The log file
+ * @return The index, or NULL on errors
+ */
+extern logindex *logindex_open(const char *log_path);
+
+/**
+ * Add a line to an index
+ * @param idx The index
+ * @param offset Where the line starts in the log
+ * @param timestamp The timestamp of the line
+ * @param msg The message, without the leading "[timestamp] "
+ * @return 0 on success (including for lines that aren't indexed),
+ *         -1 on errors
+ */
+extern int logindex_add(logindex *idx, uint64_t offset, time_t timestamp, const char *msg);
+
+/**
+ * Close an index
+ * @param idx The index
+ * @param log_size How much of the log the index now covers
+ */
+extern void logindex_close(logindex *idx, uint64_t log_size);
+
+/**
+ * Build the index of a log file from scratch
+ * @param log_path The log file
+ * @return The number of indexed lines, or -1 on errors
+ */
+extern int logindex_build(const char *log_path);
+
+/**
+ * Open a log file for reading the lines of some types.
+ * Without a usable index, the reader returns all lines of the log.
+ * @param log_path The log file
+ * @param types The LOGIDX_* types of lines wanted
+ * @return A reader, or NULL if the log can't be read
+ */
+extern logindex_reader *logindex_reader_open(const char *log_path, unsigned int types);
+
+/**
+ * Only read lines about the hosts and services asked for with this
+ * (and program starts and stops, if asked for). May be called any
+ * number of times before the first line is read. If it isn't called
+ * at all, lines about all hosts and services are read.
+ * @param r The reader
+ * @param host_name Name of the host
+ * @param service_description Description of the service, or NULL for
+ *        the host itself
+ * @return 0 on success, -1 on errors
+ */
+extern int logindex_reader_want(logindex_reader *r, const char *host_name, const char *service_description);
+
+/**
+ * Read the next line, in the order they appear in the log
+ * @param r The reader
+ * @return The line without its newline in a newly allocated string,
+ *         or NULL at the end of the log
+ */
+extern char *logindex_reader_gets(logindex_reader *r);
+
+/**
+ * Check if a reader uses an index
+ * @param r The reader
+ * @return 1 if it does, 0 if it reads every line of the log
+ */
+extern int logindex_reader_indexed(logindex_reader *r);
+
+/**
+ * Close a reader and free all memory associated with it
+ * @param r The reader
+ */
+extern void logindex_reader_close(logindex_reader *r);
+/** @} */
+#endif
@@ -180,7 +180,16 @@ prqueue_change_priority(prqueue_t *q, prqueue_pri_t new_pri, void *d)
 int
 prqueue_remove(prqueue_t *q, void *d)
 {
-	unsigned int posn = q->getpos(d);
+	unsigned int posn;
+
+	if (!q || !d)
+		return -1;
+
+	/* refuse to remove what isn't in this queue */
+	posn = q->getpos(d);
+	if (posn < 1 || posn >= q->size || q->d[posn] != d)
+		return -1;
+
 	q->d[posn] = q->d[--q->size];
 	if (q->cmppri(q->getpri(d), q->getpri(q->d[posn]))) {
 		bubble_up(q, posn);
@@ -137,7 +137,7 @@ void *prqueue_pop(prqueue_t *q);
  * remove an item from the queue.
  * @param q the queue
  * @param d the entry
- * @return 0 on success
+ * @return 0 on success, -1 if the entry isn't in the queue
  */
 int prqueue_remove(prqueue_t *q, void *d);
 
@@ -23,6 +23,7 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <errno.h>
+#include <fcntl.h>
 #include "runcmd.h"
 
 
@@ -40,6 +41,14 @@
 # define HAVE_SETENV
 #endif
 
+/* posix_spawn() is an optional part of POSIX */
+#if defined(_POSIX_SPAWN) && _POSIX_SPAWN > 0
+# define HAVE_POSIX_SPAWN
+# include <spawn.h>
+extern char **environ;
+static int use_spawn = 1;
+#endif
+
 /*
  * This variable must be global, since there's no way the caller
  * can forcibly slay a dead or ungainly running program otherwise.
@@ -328,6 +337,121 @@ void runcmd_init(void)
 static int runcmd_setenv(const char *name, const char *value);
 int update_environment(char *name, char *value, int set);
 
+int runcmd_use_spawn(int enable)
+{
+#ifdef HAVE_POSIX_SPAWN
+	int prev = use_spawn;
+
+	use_spawn = !!enable;
+	return prev;
+#else
+	return 0;
+#endif
+}
+
+#ifdef HAVE_POSIX_SPAWN
+/* adds a "name=value" string to envp, replacing any earlier value */
+static void runcmd_spawn_setenv(char **envp, int *envc, char *str)
+{
+	size_t len = strcspn(str, "=");
+	int i;
+
+	for (i = 0; i < *envc; i++) {
+		if (!strncmp(envp[i], str, len) && envp[i][len] == '=') {
+			envp[i] = str;
+			return;
+		}
+	}
+	envp[(*envc)++] = str;
+}
+
+/*
+ * Starts a simple command with posix_spawnp(). The child gets the same
+ * process group, descriptors and environment as the one runcmd_open()
+ * forks off; the read ends of all our pipes are close-on-exec, so we
+ * don't have to close them. Anything out of the ordinary is left to
+ * the fork() path, which knows how to report errors from the child.
+ * Returns the pid of the child, or -1 if it must be forked instead.
+ */
+static pid_t runcmd_spawn(char **argv, int argc, char **env, int *pfd, int *pfderr)
+{
+	posix_spawn_file_actions_t fa;
+	posix_spawnattr_t attr;
+	char **envp = NULL, **alloced = NULL;
+	int i, envc = 0, nvars, npairs = 0, nalloced = 0, sets_path = 0;
+	pid_t pid = -1;
+
+	if (pfd[1] <= STDERR_FILENO || pfderr[1] <= STDERR_FILENO)
+		return -1;
+
+	for (nvars = 0; nvars < argc && strchr(argv[nvars], '='); nvars++) {
+		if (*argv[nvars] == '=')
+			return -1;
+		if (!strncmp(argv[nvars], "PATH=", 5))
+			sets_path = 1;
+	}
+	for (i = 0; env && env[i] && env[i + 1]; i += 2, npairs++) {
+		if (!*env[i] || strchr(env[i], '='))
+			return -1;
+		if (!strcmp(env[i], "PATH"))
+			sets_path = 1;
+	}
+	/* execvp() would search the child's $PATH, posix_spawnp() ours */
+	if (nvars == argc || (sets_path && !strchr(argv[nvars], '/')))
+		return -1;
+
+	for (envc = 0; environ && environ[envc]; envc++)
+		;
+	envp = malloc((envc + npairs + nvars + 1) * sizeof(char *));
+	alloced = malloc((npairs + 1) * sizeof(char *));
+	if (!envp || !alloced)
+		goto out;
+	if (envc)
+		memcpy(envp, environ, envc * sizeof(char *));
+
+	/* same order as the setenv() calls in the forked child */
+	for (i = 0; i < npairs; i++) {
+		char *str = malloc(strlen(env[i * 2]) + strlen(env[i * 2 + 1]) + 2);
+		if (!str)
+			goto out;
+		sprintf(str, "%s=%s", env[i * 2], env[i * 2 + 1]);
+		alloced[nalloced++] = str;
+		runcmd_spawn_setenv(envp, &envc, str);
+	}
+	for (i = 0; i < nvars; i++)
+		runcmd_spawn_setenv(envp, &envc, argv[i]);
+	envp[envc] = NULL;
+
+	if (posix_spawnattr_init(&attr))
+		goto out;
+	if (posix_spawn_file_actions_init(&fa)) {
+		posix_spawnattr_destroy(&attr);
+		goto out;
+	}
+
+	if (!posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP) &&
+	    !posix_spawnattr_setpgroup(&attr, 0) &&
+	    !posix_spawn_file_actions_adddup2(&fa, pfd[1], STDOUT_FILENO) &&
+	    !posix_spawn_file_actions_adddup2(&fa, pfderr[1], STDERR_FILENO) &&
+	    !posix_spawn_file_actions_addclose(&fa, pfd[1]) &&
+	    !posix_spawn_file_actions_addclose(&fa, pfderr[1]))
+	{
+		if (posix_spawnp(&pid, argv[nvars], &fa, &attr, argv + nvars, envp))
+			pid = -1;
+	}
+
+	posix_spawn_file_actions_destroy(&fa);
+	posix_spawnattr_destroy(&attr);
+
+out:
+	for (i = 0; i < nalloced; i++)
+		free(alloced[i]);
+	free(alloced);
+	free(envp);
+	return pid;
+}
+#endif
+
 /* Start running a command */
 /* The definition declares nonnull arguments, so checking for these
    arguments as null results in a compiler warning. */
@@ -393,11 +517,22 @@ int runcmd_open(const char *cmd, int *pfd, int *pfderr, char **env,
 		return RUNCMD_EFD;
 	}
 
+	/* other commands' children shouldn't inherit our end of the pipes */
+	fcntl(pfd[0], F_SETFD, FD_CLOEXEC);
+	fcntl(pfderr[0], F_SETFD, FD_CLOEXEC);
+
 	if (iobreg) {
 		iobreg(pfd[0], pfderr[0], iobregarg);
 	}
 
-	pid = fork();
+	pid = -1;
+#ifdef HAVE_POSIX_SPAWN
+	/* simple commands don't need fork()'s copy of our address space */
+	if (use_spawn && !cmd2strv_errors)
+		pid = runcmd_spawn(argv, argc, env, pfd, pfderr);
+	if (pid < 0)
+#endif
+		pid = fork();
 	if (pid < 0) {
 		free(!cmd2strv_errors ? argv[0] : argv[2]);
 		free(argv);
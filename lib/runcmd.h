@@ -103,6 +103,19 @@ extern int runcmd_close(int fd);
  */
 extern int runcmd_cmd2strv(const char *str, int *out_argc, char **out_argv);
 
+/**
+ * Choose how runcmd_open() starts commands that need no shell
+ * With spawning enabled, which is the default where posix_spawn()
+ * is available, such commands are started with posix_spawnp(). That
+ * doesn't copy the caller's page tables the way fork() does, so
+ * starting a command costs the same no matter how much memory the
+ * caller uses. Commands that need a shell, and anything posix_spawnp()
+ * fails to start, are still forked.
+ * @param[in] enable 1 to spawn simple commands, 0 to always fork
+ * @return The previous setting. Always 0 if posix_spawn() is missing.
+ */
+extern int runcmd_use_spawn(int enable);
+
 /**
  * If you're using libnagios to execute a remote command, the 
  * static pid_t pids is not freed after runcmd_open
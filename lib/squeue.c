@@ -1,16 +1,27 @@
 /**
  * @file squeue.c
- * @brief pqeue wrapper library
+ * @brief Scheduling queue library
  *
- * This library wraps the libprqueue library and handles the boring
- * parts for all manner of events that want to use it, while hiding
- * the implementation details of the prqueue's binary heap from the
- * callers.
+ * This library hides the implementation details of the scheduling
+ * queue from the callers, and handles the boring parts for all
+ * manner of events that want to use it.
  *
+ * Two backends are available:
+ *
+ * The default one wraps the libprqueue binary heap:
  * peek() is O(1)
  * add(), pop() and remove() are O(lg n), although remove() is
  * impossible unless caller maintains the pointer to the scheduled
  * event.
+ *
+ * The timing wheel backend hashes events into one-second slots
+ * covering the next SQ_WHEEL_SLOTS seconds. Events further out
+ * than that live in an overflow heap until the wheel catches up
+ * with them, and events that are due in the current tick are kept
+ * in a small heap so they still come out in exact order.
+ * add(), remove() and rescheduling are O(1) for everything that
+ * lands in the wheel, and all events of a tick are moved to the
+ * ready heap in one go when the wheel advances.
  */
 
 #include <stdlib.h>
@@ -21,11 +32,41 @@
 #include "squeue.h"
 #include "prqueue.h"
 
+/* where an event currently lives */
+#define SQ_EVT_READY    0 /* the heap (which is all there is for prqueue queues) */
+#define SQ_EVT_WHEEL    1 /* one of the wheel slots */
+#define SQ_EVT_OVERFLOW 2 /* the wheel's overflow heap */
+
 struct squeue_event {
 	unsigned int pos;
 	prqueue_pri_t pri;
 	struct timeval when;
 	void *data;
+	unsigned int where;
+	struct squeue_event *prev, *next; /* wheel slot list */
+};
+
+/*
+ * 4096 one-second slots covers a little over an hour, which is
+ * more than the check interval of the vast majority of objects.
+ */
+#define SQ_WHEEL_BITS 12
+#define SQ_WHEEL_SLOTS (1 << SQ_WHEEL_BITS)
+#define SQ_WHEEL_MASK (SQ_WHEEL_SLOTS - 1)
+#define SQ_WORD_BITS (sizeof(unsigned long) * 8)
+
+struct sq_wheel {
+	time_t base; /* events due at or before this second are in the ready heap */
+	unsigned int entries; /* events in the slots */
+	prqueue_t *overflow; /* events beyond base + SQ_WHEEL_SLOTS */
+	unsigned long used[SQ_WHEEL_SLOTS / (sizeof(unsigned long) * 8)];
+	squeue_event *slot[SQ_WHEEL_SLOTS];
+};
+
+struct squeue {
+	unsigned int size;
+	prqueue_t *pq;
+	struct sq_wheel *wheel;
 };
 
 /*
@@ -80,6 +121,153 @@ static void sq_set_pos(void *a, unsigned int pos)
 	((squeue_event *)a)->pos = pos;
 }
 
+static prqueue_t *sq_heap_create(unsigned int size)
+{
+	return prqueue_init(size, sq_cmp_pri, sq_get_pri, sq_set_pri, sq_get_pos, sq_set_pos);
+}
+
+static inline void sq_wheel_mark(struct sq_wheel *w, unsigned int slot)
+{
+	w->used[slot / SQ_WORD_BITS] |= 1UL << (slot % SQ_WORD_BITS);
+}
+
+static inline void sq_wheel_unmark(struct sq_wheel *w, unsigned int slot)
+{
+	w->used[slot / SQ_WORD_BITS] &= ~(1UL << (slot % SQ_WORD_BITS));
+}
+
+/* put an event where it belongs, given its runtime and the wheel's base */
+static int sq_wheel_place(squeue_t *q, squeue_event *evt)
+{
+	struct sq_wheel *w = q->wheel;
+	unsigned int slot;
+
+	if (evt->when.tv_sec <= w->base) {
+		evt->where = SQ_EVT_READY;
+		return prqueue_insert(q->pq, evt);
+	}
+	if (evt->when.tv_sec - w->base >= SQ_WHEEL_SLOTS) {
+		evt->where = SQ_EVT_OVERFLOW;
+		return prqueue_insert(w->overflow, evt);
+	}
+
+	slot = evt->when.tv_sec & SQ_WHEEL_MASK;
+	evt->where = SQ_EVT_WHEEL;
+	evt->prev = NULL;
+	evt->next = w->slot[slot];
+	if (evt->next)
+		evt->next->prev = evt;
+	w->slot[slot] = evt;
+	sq_wheel_mark(w, slot);
+	w->entries++;
+	return 0;
+}
+
+/* take an event out of the queue without freeing it */
+static int sq_unlink(squeue_t *q, squeue_event *evt)
+{
+	struct sq_wheel *w = q->wheel;
+	unsigned int slot;
+
+	if (evt->where == SQ_EVT_READY)
+		return prqueue_remove(q->pq, evt);
+	if (evt->where == SQ_EVT_OVERFLOW)
+		return prqueue_remove(w->overflow, evt);
+
+	slot = evt->when.tv_sec & SQ_WHEEL_MASK;
+	if (evt->prev ? evt->prev->next != evt : w->slot[slot] != evt)
+		return -1;
+	if (evt->next && evt->next->prev != evt)
+		return -1;
+
+	if (evt->prev)
+		evt->prev->next = evt->next;
+	else
+		w->slot[slot] = evt->next;
+	if (evt->next)
+		evt->next->prev = evt->prev;
+	if (!w->slot[slot])
+		sq_wheel_unmark(w, slot);
+	w->entries--;
+	return 0;
+}
+
+/*
+ * Find the first non-empty slot after the base. The slot holding
+ * the base itself is always empty, since everything that's due by
+ * then lives in the ready heap.
+ */
+static int sq_wheel_next(struct sq_wheel *w, time_t *when)
+{
+	unsigned int i, slot, bit;
+	unsigned long word;
+
+	for (i = 1; i < SQ_WHEEL_SLOTS;) {
+		slot = (w->base + i) & SQ_WHEEL_MASK;
+		bit = slot % SQ_WORD_BITS;
+		word = w->used[slot / SQ_WORD_BITS] >> bit;
+		if (!word) {
+			i += SQ_WORD_BITS - bit;
+			continue;
+		}
+		while (!(word & 1)) {
+			word >>= 1;
+			i++;
+		}
+		*when = w->base + i;
+		return (w->base + i) & SQ_WHEEL_MASK;
+	}
+
+	return -1;
+}
+
+/*
+ * Move the wheel forward to the next tick that has something
+ * scheduled and hand all of that tick's events to the ready heap.
+ */
+static void sq_wheel_advance(squeue_t *q)
+{
+	struct sq_wheel *w = q->wheel;
+	squeue_event *evt, *next;
+	time_t when;
+	int slot = -1;
+
+	if (w->entries)
+		slot = sq_wheel_next(w, &when);
+	if (slot < 0) {
+		if (!(evt = prqueue_peek(w->overflow)))
+			return;
+		when = evt->when.tv_sec;
+	}
+	w->base = when;
+
+	/* pull in everything that now fits in the wheel */
+	while ((evt = prqueue_peek(w->overflow)) && evt->when.tv_sec - when < SQ_WHEEL_SLOTS) {
+		prqueue_pop(w->overflow);
+		sq_wheel_place(q, evt);
+	}
+
+	if (slot < 0)
+		return;
+
+	evt = w->slot[slot];
+	w->slot[slot] = NULL;
+	sq_wheel_unmark(w, slot);
+	for (; evt; evt = next) {
+		next = evt->next;
+		w->entries--;
+		evt->where = SQ_EVT_READY;
+		prqueue_insert(q->pq, evt);
+	}
+}
+
+static squeue_event *sq_peek_event(squeue_t *q)
+{
+	if (q->wheel && !prqueue_size(q->pq) && q->size)
+		sq_wheel_advance(q);
+	return prqueue_peek(q->pq);
+}
+
 const struct timeval *squeue_event_runtime(squeue_event *evt)
 {
 	if (evt)
@@ -96,10 +284,45 @@ void *squeue_event_data(squeue_event *evt)
 
 squeue_t *squeue_create(unsigned int horizon)
 {
+	squeue_t *q;
+
 	if (!horizon)
 		horizon = 127; /* makes prqueue allocate 128 elements */
 
-	return prqueue_init(horizon, sq_cmp_pri, sq_get_pri, sq_set_pri, sq_get_pos, sq_set_pos);
+	q = calloc(1, sizeof(*q));
+	if (!q)
+		return NULL;
+
+	q->pq = sq_heap_create(horizon);
+	if (!q->pq) {
+		free(q);
+		return NULL;
+	}
+
+	return q;
+}
+
+squeue_t *squeue_create_wheel(unsigned int size)
+{
+	squeue_t *q;
+
+	/* the ready heap only ever holds a tick's worth of events */
+	q = squeue_create(127);
+	if (!q)
+		return NULL;
+
+	q->wheel = calloc(1, sizeof(*q->wheel));
+	if (q->wheel)
+		q->wheel->overflow = sq_heap_create(size / 4 + 127);
+	if (!q->wheel || !q->wheel->overflow) {
+		free(q->wheel);
+		prqueue_free(q->pq);
+		free(q);
+		return NULL;
+	}
+	q->wheel->base = time(NULL);
+
+	return q;
 }
 
 squeue_event *squeue_add_tv(squeue_t *q, struct timeval *tv, void *data)
@@ -131,8 +354,20 @@ squeue_event *squeue_add_tv(squeue_t *q, struct timeval *tv, void *data)
 
 	evt->pri = evt_compute_pri(&evt->when);
 
-	if (!prqueue_insert(q, evt))
-		return evt;
+	if (!q->wheel) {
+		if (!prqueue_insert(q->pq, evt)) {
+			q->size++;
+			return evt;
+		}
+	} else {
+		/* an empty wheel can start over wherever it likes */
+		if (!q->size)
+			q->wheel->base = evt->when.tv_sec;
+		if (!sq_wheel_place(q, evt)) {
+			q->size++;
+			return evt;
+		}
+	}
 
 	free(evt);
 	return NULL;
@@ -170,6 +405,9 @@ void squeue_change_priority_tv(squeue_t *q, squeue_event *evt, struct timeval *t
 {
 	if (!q || !evt || !tv) return;
 
+	if (q->wheel && sq_unlink(q, evt) < 0)
+		return;
+
 	evt->when.tv_sec = tv->tv_sec;
 	if (sizeof(evt->when.tv_sec) > 4) {
 		/* Only use bottom sizeof(prqueue_pri_t)-SQ_BITS bits on 64-bit systems,
@@ -179,12 +417,23 @@ void squeue_change_priority_tv(squeue_t *q, squeue_event *evt, struct timeval *t
 	}
 	evt->when.tv_usec = tv->tv_usec;
 
-	prqueue_change_priority(q, evt_compute_pri(&evt->when), evt);
+	if (q->wheel) {
+		evt->pri = evt_compute_pri(&evt->when);
+		sq_wheel_place(q, evt);
+		return;
+	}
+
+	prqueue_change_priority(q->pq, evt_compute_pri(&evt->when), evt);
 }
 
 void *squeue_peek(squeue_t *q)
 {
-	squeue_event *evt = prqueue_peek(q);
+	squeue_event *evt;
+
+	if (!q)
+		return NULL;
+
+	evt = sq_peek_event(q);
 	if (evt)
 		return evt->data;
 	return NULL;
@@ -195,8 +444,13 @@ void *squeue_pop(squeue_t *q)
 	squeue_event *evt;
 	void *ptr = NULL;
 
-	evt = prqueue_pop(q);
+	if (!q)
+		return NULL;
+
+	sq_peek_event(q);
+	evt = prqueue_pop(q->pq);
 	if (evt) {
+		q->size--;
 		ptr = evt->data;
 		free(evt);
 	}
@@ -209,42 +463,68 @@ int squeue_remove(squeue_t *q, squeue_event *evt)
 
 	if (!q || !evt)
 		return -1;
-	ret = prqueue_remove(q, evt);
-	if (evt)
+	if (q->wheel)
+		ret = sq_unlink(q, evt);
+	else
+		ret = prqueue_remove(q->pq, evt);
+
+	/* an event that isn't in the queue is none of our business */
+	if (!ret) {
+		q->size--;
 		free(evt);
+	}
 
 	return ret;
 }
 
-void squeue_destroy(squeue_t *q, int flags)
+/* calls 'walker' for all events in the queue, in no particular order */
+static void sq_walk(squeue_t *q, void (*walker)(squeue_event *, void *), void *arg)
 {
 	unsigned int i;
+	squeue_event *evt, *next;
+
+	for (i = 1; i < q->pq->size; i++)
+		walker(q->pq->d[i], arg);
 
-	if (!q || prqueue_size(q) < 1)
+	if (!q->wheel)
 		return;
 
-	/*
-	 * Using two separate loops is a lot faster than
-	 * doing 1 cmp+branch for every queued item
-	 */
-	if (flags & SQUEUE_FREE_DATA) {
-		for (i = 0; i < prqueue_size(q); i++) {
-			free(((squeue_event *)q->d[i + 1])->data);
-			free(q->d[i + 1]);
-		}
-	} else {
-		for (i = 0; i < prqueue_size(q); i++) {
-			free(q->d[i + 1]);
+	for (i = 1; i < q->wheel->overflow->size; i++)
+		walker(q->wheel->overflow->d[i], arg);
+	for (i = 0; q->wheel->entries && i < SQ_WHEEL_SLOTS; i++) {
+		for (evt = q->wheel->slot[i]; evt; evt = next) {
+			next = evt->next;
+			walker(evt, arg);
 		}
 	}
-	prqueue_free(q);
+}
+
+static void sq_free_event(squeue_event *evt, void *free_data)
+{
+	if (free_data)
+		free(evt->data);
+	free(evt);
+}
+
+void squeue_destroy(squeue_t *q, int flags)
+{
+	if (!q)
+		return;
+
+	sq_walk(q, sq_free_event, (flags & SQUEUE_FREE_DATA) ? q : NULL);
+	if (q->wheel) {
+		prqueue_free(q->wheel->overflow);
+		free(q->wheel);
+	}
+	prqueue_free(q->pq);
+	free(q);
 }
 
 unsigned int squeue_size(squeue_t *q)
 {
 	if (!q)
 		return 0;
-	return prqueue_size(q);
+	return q->size;
 }
 
 int squeue_evt_when_is_after(squeue_event *evt, struct timeval *reftime) {
@@ -258,3 +538,50 @@ int squeue_evt_when_is_after(squeue_event *evt, struct timeval *reftime) {
 	return 0;
 
 }
+
+struct sq_range {
+	struct timeval *until;
+	squeue_event **evts;
+	unsigned int count;
+};
+
+static void sq_range_walker(squeue_event *evt, void *arg)
+{
+	struct sq_range *r = (struct sq_range *)arg;
+
+	if (evt->when.tv_sec > r->until->tv_sec ||
+	    (evt->when.tv_sec == r->until->tv_sec && evt->when.tv_usec > r->until->tv_usec))
+		return;
+	r->evts[r->count++] = evt;
+}
+
+static int sq_range_cmp(const void *a_, const void *b_)
+{
+	const squeue_event *a = *(const squeue_event **)a_;
+	const squeue_event *b = *(const squeue_event **)b_;
+
+	if (a->pri == b->pri)
+		return 0;
+	return a->pri > b->pri ? 1 : -1;
+}
+
+squeue_event **squeue_get_range(squeue_t *q, struct timeval *until, unsigned int *count)
+{
+	struct sq_range r;
+
+	*count = 0;
+	if (!q || !until || !q->size)
+		return NULL;
+
+	r.evts = malloc(q->size * sizeof(squeue_event *));
+	if (!r.evts)
+		return NULL;
+	r.until = until;
+	r.count = 0;
+
+	sq_walk(q, sq_range_walker, &r);
+	qsort(r.evts, r.count, sizeof(squeue_event *), sq_range_cmp);
+	*count = r.count;
+
+	return r.evts;
+}
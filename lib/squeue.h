@@ -7,9 +7,13 @@
  * @file squeue.h
  * @brief Scheduling queue function declarations
  *
- * This library is based on the prqueue api, which implements a
- * priority queue based on a binary heap, providing O(lg n) times
- * for insert() and remove(), and O(1) time for peek().
+ * By default this library is based on the prqueue api, which
+ * implements a priority queue based on a binary heap, providing
+ * O(lg n) times for insert() and remove(), and O(1) time for peek().
+ * Queues created with squeue_create_wheel() use a timing wheel
+ * instead, which gives O(1) insert(), remove() and rescheduling for
+ * events within the next hour or so. That's a lot cheaper for large
+ * queues where most events get rescheduled over and over again.
  * @note There is no "find". Callers must maintain pointers to their
  * scheduled events if they wish to be able to remove them.
  *
@@ -21,7 +25,8 @@
  * The prqueue library can be useful on its own though, so we
  * don't block that from user view.
  */
-typedef prqueue_t squeue_t;
+struct squeue;
+typedef struct squeue squeue_t;
 struct squeue_event;
 typedef struct squeue_event squeue_event;
 
@@ -59,6 +64,19 @@ extern void *squeue_event_data(squeue_event *evt);
  */
 extern squeue_t *squeue_create(unsigned int size);
 
+/**
+ * Creates a scheduling queue backed by a timing wheel with one
+ * second resolution. Events within the wheel's horizon of a little
+ * over an hour are added, removed and rescheduled in O(1) time, and
+ * events further out are kept in an overflow heap until the wheel
+ * catches up with them. Events are popped in the exact same order
+ * as from a queue created with squeue_create().
+ *
+ * @param size Hint about how large this queue will get
+ * @return A pointer to a scheduling queue
+ */
+extern squeue_t *squeue_create_wheel(unsigned int size);
+
 /**
  * Destroys a scheduling queue completely
  * @param[in] q The doomed queue
@@ -145,6 +163,8 @@ extern void *squeue_pop(squeue_t *q);
  * @note This causes the associated squeue_event() to be free()'d.
  * @param[in] q The scheduling queue to remove from
  * @param[in] evt The event to remove
+ * @return 0 on success, -1 if the event isn't in the queue, in which
+ *         case it is left alone
  */
 extern int squeue_remove(squeue_t *q, squeue_event *evt);
 
@@ -166,5 +186,18 @@ extern unsigned int squeue_size(squeue_t *q);
  * @return 1 if reftime > event time, 0 otherwise
  */
 extern int squeue_evt_when_is_after(squeue_event *evt, struct timeval *reftime);
+
+/**
+ * Fetches all events scheduled to run no later than 'until' without
+ * removing them from the queue. The events are sorted in the order
+ * they would be popped from the queue, so callers can walk them and
+ * reschedule them with squeue_change_priority_tv().
+ *
+ * @param[in] q The scheduling queue to inspect
+ * @param[in] until The latest runtime to include
+ * @param[out] count Set to the number of events returned
+ * @return A malloc()'ed array of events the caller must free(), or NULL
+ */
+extern squeue_event **squeue_get_range(squeue_t *q, struct timeval *until, unsigned int *count);
 #endif
 /** @} */
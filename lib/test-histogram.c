@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include "t-utils.h"
+#include "histogram.c"
+
+/* percentiles may be off by the width of the bucket they're in */
+static int close_enough(uint64_t got, uint64_t expected)
+{
+	uint64_t slack = expected / (HISTOGRAM_SUB_BUCKETS / 2) + 1;
+
+	return got + slack >= expected && got <= expected + slack;
+}
+
+int main(int argc, char **argv)
+{
+	histogram h, h2;
+	uint64_t v, prev = 0;
+	unsigned int i, b;
+	int covered = 1;
+
+	t_set_colors(0);
+	t_start("histogram tests");
+
+	/* the values at the edges of each bucket land in it, and nothing else does */
+	for (b = 0; b < HISTOGRAM_BUCKETS - 1; b++) {
+		if (bucket_of(histogram_bucket_top(b)) != b || bucket_of(histogram_bucket_top(b) + 1) != b + 1)
+			break;
+	}
+	ok_uint(b, HISTOGRAM_BUCKETS - 1, "buckets are contiguous");
+	for (v = 1; v < HISTOGRAM_MAX_VALUE; v += v / 7 + 1) {
+		b = bucket_of(v);
+		if (histogram_bucket_top(b) < v || (b && histogram_bucket_top(b - 1) >= v))
+			covered = 0;
+	}
+	t_ok(covered, "each value is in the right bucket");
+	ok_uint(bucket_of(HISTOGRAM_MAX_VALUE - 1), HISTOGRAM_BUCKETS - 1, "largest value goes in the last bucket");
+	ok_uint(bucket_of((uint64_t)-1), HISTOGRAM_BUCKETS - 1, "huge values go in the last bucket");
+	for (b = 1; b < HISTOGRAM_BUCKETS; b++) {
+		if (histogram_bucket_top(b) <= prev)
+			break;
+		prev = histogram_bucket_top(b);
+	}
+	ok_uint(b, HISTOGRAM_BUCKETS, "bucket tops keep growing");
+
+	memset(&h, 0, sizeof(h));
+	ok_uint(histogram_percentile(&h, 50) == 0, 1, "empty histogram has no percentiles");
+	t_ok(histogram_mean(&h) == 0.0, "empty histogram has no mean");
+
+	histogram_add(&h, 42);
+	ok_uint(histogram_percentile(&h, 0) == 42, 1, "single value is the minimum");
+	ok_uint(histogram_percentile(&h, 50) == 42, 1, "single value is the median");
+	ok_uint(histogram_percentile(&h, 100) == 42, 1, "single value is the maximum");
+
+	/* 1..10000 */
+	histogram_reset(&h);
+	for (i = 1; i <= 10000; i++)
+		histogram_add(&h, i);
+	ok_uint(h.count == 10000, 1, "count");
+	ok_uint(h.min == 1 && h.max == 10000, 1, "min and max");
+	t_ok(histogram_mean(&h) == 5000.5, "mean is exact");
+	t_ok(close_enough(histogram_percentile(&h, 50), 5000), "median is %llu", (unsigned long long)histogram_percentile(&h, 50));
+	t_ok(close_enough(histogram_percentile(&h, 90), 9000), "p90 is %llu", (unsigned long long)histogram_percentile(&h, 90));
+	t_ok(close_enough(histogram_percentile(&h, 99), 9900), "p99 is %llu", (unsigned long long)histogram_percentile(&h, 99));
+	ok_uint(histogram_percentile(&h, 100) == 10000, 1, "p100 is the maximum");
+
+	/* a long tail shows up in the high percentiles only */
+	histogram_reset(&h);
+	for (i = 0; i < 990; i++)
+		histogram_add(&h, 1000);
+	for (i = 0; i < 10; i++)
+		histogram_add(&h, 5000000);
+	t_ok(close_enough(histogram_percentile(&h, 50), 1000), "median ignores the tail");
+	t_ok(close_enough(histogram_percentile(&h, 99.5), 5000000), "p99.5 is in the tail");
+
+	/* merging is the same as adding everything to one */
+	histogram_reset(&h);
+	histogram_reset(&h2);
+	for (i = 0; i < 500; i++) {
+		histogram_add(&h, i * 3);
+		histogram_add(&h2, i * 7 + 100000);
+	}
+	histogram_merge(&h, &h2);
+	ok_uint(h.count == 1000, 1, "merged count");
+	ok_uint(h.min == 0 && h.max == 499 * 7 + 100000, 1, "merged min and max");
+	t_ok(histogram_percentile(&h, 40) < 1500 && histogram_percentile(&h, 60) >= 100000, "merged percentiles");
+	histogram_reset(&h2);
+	histogram_merge(&h2, &h);
+	ok_uint(memcmp(&h, &h2, sizeof(h)) == 0, 1, "merging into an empty histogram copies it");
+
+	t_end();
+	return 0;
+}
@@ -193,7 +193,14 @@ int main(int argc, char **argv)
 		conn_spam(&sain);
 
 	for (;;) {
+		struct timeval before, woke, after;
+
+		gettimeofday(&before, NULL);
 		iobroker_poll(iobs, -1);
+		gettimeofday(&after, NULL);
+		iobroker_last_wakeup(iobs, &woke);
+		if (timercmp(&woke, &before, <) || timercmp(&woke, &after, >))
+			t_fail("iobroker_last_wakeup() must be between the start and end of the poll");
 		if (iobroker_get_num_fds(iobs) <= 1) {
 			break;
 		}
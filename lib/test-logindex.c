@@ -0,0 +1,207 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include "logindex.c"
+#include "t-utils.h"
+
+static const char *log_lines[] = {
+	"[1000] Nagios 4.1.0 starting... (PID=123)",
+	"[1000] LOG VERSION: 2.0",
+	"[1000] INITIAL HOST STATE: web01;UP;HARD;1;PING OK",
+	"[1000] INITIAL SERVICE STATE: web01;HTTP;OK;HARD;1;HTTP OK",
+	"[1000] INITIAL SERVICE STATE: db01;MySQL;OK;HARD;1;Uptime: 12",
+	"[1010] EXTERNAL COMMAND: SCHEDULE_FORCED_SVC_CHECK;web01;HTTP;1010",
+	"[1020] SERVICE ALERT: web01;HTTP;CRITICAL;SOFT;1;Connection refused",
+	"[1030] SERVICE ALERT: db01;MySQL;WARNING;HARD;3;Slow queries",
+	"[1040] SERVICE NOTIFICATION: admin;db01;MySQL;WARNING;notify-by-email;Slow queries",
+	"[1050] HOST DOWNTIME ALERT: web01;STARTED; Host has entered a period of scheduled downtime",
+	"[1060] Caught SIGTERM, shutting down...",
+	NULL,
+};
+
+static int write_log(const char *path, const char **lines, const char *mode)
+{
+	FILE *fp;
+	int i;
+
+	if (!(fp = fopen(path, mode)))
+		return -1;
+	for (i = 0; lines[i]; i++)
+		fprintf(fp, "%s\n", lines[i]);
+	fclose(fp);
+	return 0;
+}
+
+/* read everything a reader returns, one line after another */
+static char *read_all(logindex_reader *r)
+{
+	char *buf = calloc(1, 1), *line;
+	size_t len = 0;
+
+	while ((line = logindex_reader_gets(r))) {
+		buf = realloc(buf, len + strlen(line) + 2);
+		len += sprintf(buf + len, "%s\n", line);
+		free(line);
+	}
+	return buf;
+}
+
+static char *read_log(const char *path, unsigned int types, const char *host, const char *svc, int *indexed)
+{
+	logindex_reader *r;
+	char *buf;
+
+	if (!(r = logindex_reader_open(path, types)))
+		return NULL;
+	if (host)
+		logindex_reader_want(r, host, svc);
+	*indexed = logindex_reader_indexed(r);
+	buf = read_all(r);
+	logindex_reader_close(r);
+	return buf;
+}
+
+static void test_classify(void)
+{
+	struct {
+		const char *msg;
+		unsigned int type;
+		const char *host, *svc;
+	} tc[] = {
+		{ "HOST ALERT: web01;DOWN;SOFT;1;PING CRITICAL", LOGIDX_HOST | LOGIDX_ALERT, "web01", NULL },
+		{ "SERVICE ALERT: web01;HTTP;OK;HARD;1;fine", LOGIDX_SERVICE | LOGIDX_ALERT, "web01", "HTTP" },
+		{ "CURRENT HOST STATE: db01;UP;HARD;1;ok", LOGIDX_HOST | LOGIDX_STATE, "db01", NULL },
+		{ "INITIAL SERVICE STATE: db01;Disk /;OK;HARD;1;ok", LOGIDX_SERVICE | LOGIDX_STATE, "db01", "Disk /" },
+		{ "SERVICE DOWNTIME ALERT: db01;Disk /;STOPPED; done", LOGIDX_SERVICE | LOGIDX_DOWNTIME, "db01", "Disk /" },
+		{ "HOST FLAPPING ALERT: db01;STARTED; flapping", LOGIDX_HOST | LOGIDX_FLAPPING, "db01", NULL },
+		{ "HOST NOTIFICATION: admin;web01;DOWN;notify;out", LOGIDX_HOST | LOGIDX_NOTIFICATION, "web01", NULL },
+		{ "SERVICE NOTIFICATION: admin;web01;HTTP;OK;notify;out", LOGIDX_SERVICE | LOGIDX_NOTIFICATION, "web01", "HTTP" },
+		{ "Nagios 4.1.0 starting... (PID=1)", LOGIDX_PROGRAM, NULL, NULL },
+		{ "Caught SIGHUP, restarting...", LOGIDX_PROGRAM, NULL, NULL },
+		{ "Bailing out due to errors encountered while trying to daemonize...", LOGIDX_PROGRAM, NULL, NULL },
+		{ "EXTERNAL COMMAND: DISABLE_NOTIFICATIONS", 0, NULL, NULL },
+		{ "SERVICE ALERT: truncated", 0, NULL, NULL },
+		{ "HOST NOTIFICATION: admin", 0, NULL, NULL },
+	};
+	unsigned int i, type;
+	uint32_t key;
+
+	t_start("logindex_classify() tests");
+	for (i = 0; i < ARRAY_SIZE(tc); i++) {
+		type = logindex_classify(tc[i].msg, &key);
+		ok_int(type, tc[i].type, tc[i].msg);
+		if (tc[i].host)
+			t_ok(key == logindex_key(tc[i].host, tc[i].svc), "key of '%s'", tc[i].msg);
+	}
+	t_ok(logindex_key("web01", NULL) != logindex_key("web01", ""), "host and service keys differ");
+	t_ok(logindex_key("a", "bc") != logindex_key("ab", "c"), "host/service split is part of the key");
+	t_end();
+}
+
+int main(int argc, char **argv)
+{
+	char log_path[] = "/tmp/test-logindex.XXXXXX";
+	char *idx_path, *all, *buf;
+	const char *more[] = {
+		"[1100] Nagios 4.1.0 starting... (PID=124)",
+		"[1110] SERVICE ALERT: web01;HTTP;OK;HARD;1;HTTP OK",
+		NULL,
+	};
+	logindex *idx;
+	int fd, indexed;
+
+	t_set_colors(0);
+	t_verbose = 1;
+
+	test_classify();
+
+	t_start("logindex reader tests");
+	if ((fd = mkstemp(log_path)) < 0)
+		crash("can't create a temporary log file");
+	close(fd);
+	idx_path = logindex_path(log_path);
+	ok_str(idx_path + strlen(log_path), ".idx", "index lives next to the log");
+	write_log(log_path, log_lines, "w");
+
+	/* without an index, we get everything */
+	all = read_log(log_path, LOGIDX_ALL, "web01", NULL, &indexed);
+	t_ok(!indexed, "no index before it's built");
+	t_ok(all && !strncmp(all, log_lines[0], strlen(log_lines[0])), "unindexed log is read from the start");
+
+	ok_int(logindex_build(log_path), 9, "indexing the log finds 9 lines");
+
+	buf = read_log(log_path, LOGIDX_ALL, NULL, NULL, &indexed);
+	t_ok(indexed, "built index is used");
+	ok_str(buf,
+	       "[1000] Nagios 4.1.0 starting... (PID=123)\n"
+	       "[1000] INITIAL HOST STATE: web01;UP;HARD;1;PING OK\n"
+	       "[1000] INITIAL SERVICE STATE: web01;HTTP;OK;HARD;1;HTTP OK\n"
+	       "[1000] INITIAL SERVICE STATE: db01;MySQL;OK;HARD;1;Uptime: 12\n"
+	       "[1020] SERVICE ALERT: web01;HTTP;CRITICAL;SOFT;1;Connection refused\n"
+	       "[1030] SERVICE ALERT: db01;MySQL;WARNING;HARD;3;Slow queries\n"
+	       "[1040] SERVICE NOTIFICATION: admin;db01;MySQL;WARNING;notify-by-email;Slow queries\n"
+	       "[1050] HOST DOWNTIME ALERT: web01;STARTED; Host has entered a period of scheduled downtime\n"
+	       "[1060] Caught SIGTERM, shutting down...\n",
+	       "all indexed lines, in order");
+	free(buf);
+
+	buf = read_log(log_path, LOGIDX_PROGRAM | LOGIDX_ALERT | LOGIDX_SERVICE, "db01", "MySQL", &indexed);
+	ok_str(buf,
+	       "[1000] Nagios 4.1.0 starting... (PID=123)\n"
+	       "[1030] SERVICE ALERT: db01;MySQL;WARNING;HARD;3;Slow queries\n"
+	       "[1060] Caught SIGTERM, shutting down...\n",
+	       "service alerts for one service");
+	free(buf);
+
+	buf = read_log(log_path, LOGIDX_DOWNTIME | LOGIDX_STATE | LOGIDX_HOST, "web01", NULL, &indexed);
+	ok_str(buf,
+	       "[1000] INITIAL HOST STATE: web01;UP;HARD;1;PING OK\n"
+	       "[1050] HOST DOWNTIME ALERT: web01;STARTED; Host has entered a period of scheduled downtime\n",
+	       "host states and downtime for one host");
+	free(buf);
+
+	/* lines logged after the index was written are read as they are */
+	write_log(log_path, more, "a");
+	buf = read_log(log_path, LOGIDX_ALERT | LOGIDX_SERVICE, "web01", "HTTP", &indexed);
+	ok_str(buf,
+	       "[1020] SERVICE ALERT: web01;HTTP;CRITICAL;SOFT;1;Connection refused\n"
+	       "[1100] Nagios 4.1.0 starting... (PID=124)\n"
+	       "[1110] SERVICE ALERT: web01;HTTP;OK;HARD;1;HTTP OK\n",
+	       "unindexed tail is read line by line");
+	free(buf);
+
+	/* opening the index for writing catches up with the log */
+	idx = logindex_open(log_path);
+	t_req(idx != NULL);
+	logindex_close(idx, 0);
+	buf = read_log(log_path, LOGIDX_ALERT | LOGIDX_SERVICE, "web01", "HTTP", &indexed);
+	ok_str(buf,
+	       "[1020] SERVICE ALERT: web01;HTTP;CRITICAL;SOFT;1;Connection refused\n"
+	       "[1110] SERVICE ALERT: web01;HTTP;OK;HARD;1;HTTP OK\n",
+	       "reopened index covers the new lines");
+	free(buf);
+
+	/* an index that doesn't match its log is ignored, and rebuilt by writers */
+	write_log(log_path, more, "w");
+	buf = read_log(log_path, LOGIDX_ALERT | LOGIDX_SERVICE, "db01", NULL, &indexed);
+	t_ok(!indexed, "stale index is ignored");
+	ok_str(buf, "[1100] Nagios 4.1.0 starting... (PID=124)\n[1110] SERVICE ALERT: web01;HTTP;OK;HARD;1;HTTP OK\n",
+	       "log without a usable index is read in full");
+	free(buf);
+	idx = logindex_open(log_path);
+	t_req(idx != NULL);
+	logindex_add(idx, strlen(more[0]) + strlen(more[1]) + 2, 1120, "SERVICE ALERT: db01;MySQL;OK;HARD;1;fine");
+	logindex_close(idx, 0);
+	write_log(log_path, (const char *[]){ "[1120] SERVICE ALERT: db01;MySQL;OK;HARD;1;fine", NULL }, "a");
+	buf = read_log(log_path, LOGIDX_ALERT | LOGIDX_SERVICE, "db01", "MySQL", &indexed);
+	t_ok(indexed, "rebuilt index is used");
+	ok_str(buf, "[1120] SERVICE ALERT: db01;MySQL;OK;HARD;1;fine\n", "appended entries are found");
+	free(buf);
+
+	unlink(idx_path);
+	unlink(log_path);
+	free(idx_path);
+	free(all);
+	t_end();
+
+	return t_end();
+}
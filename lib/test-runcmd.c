@@ -109,6 +109,49 @@ struct {
 /* We need an iobreg callback to pass to runcmd_open(). */
 static void stub_iobreg(int fdout, int fderr, void *arg) { }
 
+/* runs cmd to completion and returns its exit status */
+static int run_cmd(const char *cmd, char **env, char *out, char *err, int *leader)
+{
+	int pfd[2] = {-1, -1}, pfderr[2] = {-1, -1};
+	int stub_iobregarg = 0;
+	int fd, len;
+
+	*leader = 0;
+	memset(out, 0, BUF_SIZE);
+	memset(err, 0, BUF_SIZE);
+	fd = runcmd_open(cmd, pfd, pfderr, env, stub_iobreg, &stub_iobregarg);
+	if (fd < 0)
+		return fd;
+	for (len = 0; len < BUF_SIZE - 1; ) {
+		int ret = read(pfd[0], out + len, BUF_SIZE - 1 - len);
+		if (ret <= 0)
+			break;
+		len += ret;
+	}
+	read(pfderr[0], err, BUF_SIZE - 1);
+	close(pfderr[0]);
+	/* the child is done with setpgid() by now, but not reaped */
+	*leader = getpgid(runcmd_pid(fd)) == runcmd_pid(fd);
+	return runcmd_close(fd);
+}
+
+struct {
+	char *cmd;
+	char *env[5];
+	int status;
+	char *output;
+	char *error;
+} spawn_case[] = {
+	{ "/bin/sh -c 'echo -n $RUNCMD_TEST'", { "RUNCMD_TEST", "from env", NULL }, 0, "from env", "" },
+	{ "RUNCMD_TEST=from\\ arg /bin/sh -c 'echo -n $RUNCMD_TEST'", { NULL }, 0, "from arg", "" },
+	{ "RUNCMD_TEST=arg /bin/sh -c 'echo -n $RUNCMD_TEST $RUNCMD_TEST2'",
+	  { "RUNCMD_TEST", "env", "RUNCMD_TEST2", "env2", NULL }, 0, "arg env2", "" },
+	{ "/bin/sh -c 'echo -n out; echo -n err >&2; exit 3'", { NULL }, 3, "out", "err" },
+	{ "/nonexistent/runcmd-test", { NULL }, ENOENT, "", "execvp(/nonexistent/runcmd-test, ...) failed. errno is 2: No such file or directory\n" },
+	{ "RUNCMD_TEST=foo", { NULL }, EXIT_FAILURE, "", "No command after variables.\n" },
+	{ NULL },
+};
+
 int main(int argc, char **argv)
 {
 	int ret, r2;
@@ -117,29 +160,52 @@ int main(int argc, char **argv)
 	t_set_colors(0);
 	t_start("exec output comparison");
 	{
-		int i;
+		int i, spawn;
 		char *out = calloc(1, BUF_SIZE);
-		for (i = 0; cases[i].input != NULL; i++) {
-			memset(out, 0, BUF_SIZE);
-			int pfd[2] = {-1, -1}, pfderr[2] = {-1, -1};
-			/* We need a stub iobregarg since runcmd_open()'s prototype
-			 * declares it attribute non-null. */
-			int stub_iobregarg = 0;
-			int fd;
-			char *cmd;
-			asprintf(&cmd, ECHO_COMMAND " -n %s", cases[i].input);
-			fd = runcmd_open(cmd, pfd, pfderr, NULL, stub_iobreg, &stub_iobregarg);
-			free(cmd);
-			read(pfd[0], out, BUF_SIZE);
-			ok_str(cases[i].output, out, "Echoing a command should give expected output");
-			close(pfd[0]);
-			close(pfderr[0]);
-			close(fd);
+		for (spawn = 0; spawn < 2; spawn++) {
+			runcmd_use_spawn(spawn);
+			for (i = 0; cases[i].input != NULL; i++) {
+				memset(out, 0, BUF_SIZE);
+				int pfd[2] = {-1, -1}, pfderr[2] = {-1, -1};
+				/* We need a stub iobregarg since runcmd_open()'s prototype
+				 * declares it attribute non-null. */
+				int stub_iobregarg = 0;
+				int fd;
+				char *cmd;
+				asprintf(&cmd, ECHO_COMMAND " -n %s", cases[i].input);
+				fd = runcmd_open(cmd, pfd, pfderr, NULL, stub_iobreg, &stub_iobregarg);
+				free(cmd);
+				read(pfd[0], out, BUF_SIZE);
+				ok_str(cases[i].output, out, "Echoing a command should give expected output");
+				close(pfd[0]);
+				close(pfderr[0]);
+				close(fd);
+			}
 		}
 		free(out);
 	}
 	ret = t_end();
 	t_reset();
+	t_start("spawning and forking");
+	{
+		int i, spawn;
+		char out[BUF_SIZE], err[BUF_SIZE];
+		int leader;
+
+		for (spawn = 0; spawn < 2; spawn++) {
+			runcmd_use_spawn(spawn);
+			for (i = 0; spawn_case[i].cmd; i++) {
+				ok_int(run_cmd(spawn_case[i].cmd, spawn_case[i].env, out, err, &leader),
+				       spawn_case[i].status, spawn_case[i].cmd);
+				ok_str(out, spawn_case[i].output, "stdout");
+				ok_str(err, spawn_case[i].error, "stderr");
+				ok_int(leader, 1, "child leads its own process group");
+			}
+		}
+	}
+	r2 = t_end();
+	ret = r2 ? r2 : ret;
+	t_reset();
 	t_start("anomaly detection");
 	{
 		int i;
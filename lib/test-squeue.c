@@ -14,19 +14,55 @@
 
 static void squeue_foreach(squeue_t *q, int (*walker)(squeue_event *, void *), void *arg)
 {
-	squeue_t *dup;
-	void *e, *dup_d;
+	squeue_event **evts;
+	struct timeval until = { 0x7fffffff, 0 };
+	unsigned int i, count;
 
-	dup = squeue_create(q->size);
-	dup_d = dup->d;
-	memcpy(dup, q, sizeof(*q));
-	dup->d = dup_d;
-	memcpy(dup->d, q->d, (q->size * sizeof(void *)));
+	evts = squeue_get_range(q, &until, &count);
+	for (i = 0; i < count; i++) {
+		walker(evts[i], arg);
+	}
+	free(evts);
+}
+
+/* make sure the queue's internal bookkeeping adds up */
+static int sq_is_valid(squeue_t *q)
+{
+	unsigned int i, entries = 0, size;
+	squeue_event *evt;
+
+	if (!prqueue_is_valid(q->pq))
+		return 0;
+	size = prqueue_size(q->pq);
+	if (!q->wheel)
+		return size == q->size;
 
-	while ((e = prqueue_pop(dup))) {
-		walker(e, arg);
+	if (!prqueue_is_valid(q->wheel->overflow))
+		return 0;
+	for (i = 1; i < q->pq->size; i++) {
+		evt = q->pq->d[i];
+		if (evt->where != SQ_EVT_READY || evt->when.tv_sec > q->wheel->base)
+			return 0;
+	}
+	for (i = 1; i < q->wheel->overflow->size; i++) {
+		evt = q->wheel->overflow->d[i];
+		if (evt->where != SQ_EVT_OVERFLOW || evt->when.tv_sec - q->wheel->base < SQ_WHEEL_SLOTS)
+			return 0;
+	}
+	for (i = 0; i < SQ_WHEEL_SLOTS; i++) {
+		if (!q->wheel->slot[i] != !(q->wheel->used[i / SQ_WORD_BITS] & (1UL << (i % SQ_WORD_BITS))))
+			return 0;
+		for (evt = q->wheel->slot[i]; evt; evt = evt->next) {
+			if (evt->where != SQ_EVT_WHEEL || (evt->when.tv_sec & SQ_WHEEL_MASK) != i)
+				return 0;
+			if (evt->when.tv_sec <= q->wheel->base || evt->when.tv_sec - q->wheel->base >= SQ_WHEEL_SLOTS)
+				return 0;
+			entries++;
+		}
 	}
-	squeue_destroy(dup, 0);
+	size += prqueue_size(q->wheel->overflow) + entries;
+
+	return entries == q->wheel->entries && size == q->size;
 }
 
 #define t(expr, args...) \
@@ -70,7 +106,7 @@ static int sq_test_random(squeue_t *sq)
 		t(squeue_size(sq) == i + 1 + size);
 	}
 
-	t(prqueue_is_valid(sq));
+	t(sq_is_valid(sq));
 
 	/*
 	 * make sure we pop events in increasing "priority",
@@ -84,29 +120,72 @@ static int sq_test_random(squeue_t *sq)
 		max = *d;
 		t(squeue_size(sq) == size + (EVT_ARY - i - 1));
 	}
-	t(prqueue_is_valid(sq));
+	t(sq_is_valid(sq));
 
 	return 0;
 }
 
-int main(int argc, char **argv)
+/*
+ * spread events over a couple of hours so they end up in the
+ * ready heap, the wheel and the overflow heap, then move them
+ * around and make sure everything still pops in order.
+ */
+#define SPREAD_ARY 20011
+static int sq_test_spread(squeue_t *sq)
 {
-	squeue_t *sq;
+	unsigned long i;
+	squeue_event *evts[SPREAD_ARY];
+	unsigned long long numbers[SPREAD_ARY], *d, max = 0;
 	struct timeval tv;
-	sq_test_event a, b, c, d, *x;
+	time_t now = time(NULL);
 
-	t_set_colors(0);
-	t_start("squeue tests");
+	for (i = 0; i < SPREAD_ARY; i++) {
+		tv.tv_sec = now + rand() % 7200;
+		tv.tv_usec = rand() % 1000000;
+		evts[i] = squeue_add_tv(sq, &tv, &numbers[i]);
+		numbers[i] = evt_compute_pri(&tv);
+	}
+	t(squeue_size(sq) == SPREAD_ARY);
+	t(sq_is_valid(sq));
+
+	/* reschedule every other event, and remove every seventh */
+	for (i = 0; i < SPREAD_ARY; i += 2) {
+		tv.tv_sec = now + rand() % 7200;
+		tv.tv_usec = rand() % 1000000;
+		squeue_change_priority_tv(sq, evts[i], &tv);
+		numbers[i] = evt_compute_pri(&tv);
+	}
+	t(sq_is_valid(sq));
+	for (i = 0; i < SPREAD_ARY; i += 7) {
+		squeue_remove(sq, evts[i]);
+	}
+	t(squeue_size(sq) == SPREAD_ARY - (SPREAD_ARY + 6) / 7);
+	t(sq_is_valid(sq));
+
+	for (i = 0; (d = squeue_pop(sq)); i++) {
+		t(max <= *d, "popping spread. i: %lu; max: %llu; *d: %llu\n", i, max, *d);
+		max = *d;
+		if (!(i % 1000))
+			t(sq_is_valid(sq));
+	}
+	t(i == SPREAD_ARY - (SPREAD_ARY + 6) / 7);
+	t(squeue_size(sq) == 0);
+	t(sq_is_valid(sq));
+
+	return 0;
+}
+
+static void sq_test(squeue_t *sq)
+{
+	sq_test_event a, b, c, d, *x;
 
 	a.id = 1;
 	b.id = 2;
 	c.id = 3;
 	d.id = 4;
 
-	gettimeofday(&tv, NULL);
 	/* Order in is a, b, c, d, but we should get b, c, d, a out. */
-	srand(tv.tv_usec ^ tv.tv_sec);
-	t((sq = squeue_create(1024)) != NULL);
+	t(sq != NULL);
 	t(squeue_size(sq) == 0);
 
 	/* we fill and empty the squeue completely once before testing */
@@ -167,10 +246,77 @@ int main(int argc, char **argv)
 	t(squeue_remove(NULL, NULL) == -1);
 	t(squeue_remove(NULL, a.evt) == -1);
 
+	sq_high = 0;
 	squeue_foreach(sq, sq_walker, NULL);
 
 	/* clean up to prevent false valgrind positives */
 	squeue_destroy(sq, 0);
+}
+
+/* events can't be removed through a queue they aren't in */
+static void sq_test_foreign(squeue_t *sq, squeue_t *other)
+{
+	sq_test_event ours[3], theirs[3];
+	time_t now = time(NULL);
+	int i;
+
+	/* due now, within the wheel and beyond it */
+	for (i = 0; i < 3; i++) {
+		time_t when = now + (i == 0 ? 0 : i == 1 ? 60 : 3 * 3600);
+		ours[i].evt = squeue_add(sq, when, &ours[i]);
+		theirs[i].evt = squeue_add(other, when, &theirs[i]);
+	}
+	/* get the events that are due into the ready heap */
+	t(squeue_peek(sq) == &ours[0]);
+	t(squeue_peek(other) == &theirs[0]);
+
+	for (i = 0; i < 3; i++) {
+		t(squeue_remove(sq, theirs[i].evt) == -1, "removing event %d of another queue fails", i);
+	}
+	t(squeue_size(sq) == 3);
+	t(squeue_size(other) == 3);
+	t(sq_is_valid(sq));
+	t(sq_is_valid(other));
+
+	for (i = 0; i < 3; i++) {
+		t(squeue_pop(sq) == &ours[i]);
+		t(squeue_pop(other) == &theirs[i]);
+	}
+	t(squeue_size(sq) == 0 && squeue_size(other) == 0);
+}
+
+int main(int argc, char **argv)
+{
+	struct timeval tv;
+	squeue_t *sq, *other;
+
+	t_set_colors(0);
+
+	gettimeofday(&tv, NULL);
+	srand(tv.tv_usec ^ tv.tv_sec);
+
+	t_start("squeue tests");
+	sq_test(squeue_create(1024));
+	sq = squeue_create(1024);
+	sq_test_spread(sq);
+	squeue_destroy(sq, 0);
+	sq = squeue_create(1024);
+	other = squeue_create(1024);
+	sq_test_foreign(sq, other);
+	squeue_destroy(sq, 0);
+	squeue_destroy(other, 0);
+	t_end();
+
+	t_start("squeue timing wheel tests");
+	sq_test(squeue_create_wheel(1024));
+	sq = squeue_create_wheel(1024);
+	sq_test_spread(sq);
+	squeue_destroy(sq, 0);
+	sq = squeue_create_wheel(1024);
+	other = squeue_create_wheel(1024);
+	sq_test_foreign(sq, other);
+	squeue_destroy(sq, 0);
+	squeue_destroy(other, 0);
 
 	return t_end();
 }
@@ -16,10 +16,38 @@
 #define PAIR_SEP 0 /**< pair separator for buf2kvvec() and kvvec2buf() */
 #define KV_SEP '=' /**< key/value separator for buf2kvvec() and kvvec2buf() */
 
+/*
+ * Long-lived instances of coprocess plugins, each running at most
+ * one job at a time. Jobs wait in line for an instance when all of
+ * them are busy. See worker.h for the protocol.
+ */
+typedef struct coproc_instance {
+	pid_t pid;
+	int in, out; /* our ends of the plugin's stdin and stdout */
+	iocache *ioc;
+	child_process *job;
+	struct coproc_plugin *plugin;
+	struct coproc_instance *next;
+} coproc_instance;
+
+typedef struct coproc_plugin {
+	char *path;
+	int disabled;
+	unsigned long answered;
+	unsigned int num_instances;
+	coproc_instance *instances;
+	child_process *waiting, *waiting_tail;
+	struct coproc_plugin *next;
+} coproc_plugin;
+
 struct execution_information {
 	squeue_event *sq_event;
 	pid_t pid;
 	int state;
+	int use_coproc;
+	coproc_instance *coproc;
+	coproc_plugin *coproc_queue; /* set while waiting for an instance */
+	child_process *coproc_next;
 	struct timeval start;
 	struct timeval stop;
 	float runtime;
@@ -31,12 +59,17 @@ static iobroker_set *iobs;
 static squeue_t *sq;
 static unsigned int started, running_jobs, timeouts, reapable;
 static int master_sd;
+static int sigchld_pipe[2] = { -1, -1 }; /* wakes up iobroker_poll() when children exit */
 static int parent_pid;
 static fanout_table *ptab;
+static int (*response_filter)(child_process *, struct kvvec *);
+static coproc_plugin *coproc_plugins;
 
 static void exit_worker(int code, const char *msg)
 {
 	child_process *cp;
+	coproc_plugin *plugin;
+	coproc_instance *inst;
 	int discard;
 #ifdef HAVE_SIGACTION
 	struct sigaction sig_action;
@@ -64,12 +97,17 @@ static void exit_worker(int code, const char *msg)
 	signal(SIGSEGV, SIG_IGN);
 #endif
 	kill(0, SIGTERM);
+	for (plugin = coproc_plugins; plugin; plugin = plugin->next) {
+		for (inst = plugin->instances; inst; inst = inst->next)
+			(void)kill(-inst->pid, SIGKILL);
+	}
 	while (waitpid(-1, &discard, WNOHANG) > 0)
 		; /* do nothing */
 	sleep(1);
 	while ((cp = (child_process *)squeue_pop(sq))) {
 		/* kill all processes in the child's process group */
-		(void)kill(-cp->ei->pid, SIGKILL);
+		if (cp->ei->pid)
+			(void)kill(-cp->ei->pid, SIGKILL);
 	}
 	sleep(1);
 	while (waitpid(-1, &discard, WNOHANG) > 0)
@@ -214,8 +252,11 @@ int worker_buf2kvvec_prealloc(struct kvvec *kvv, char *buf, unsigned long len, i
 		kvvec_addkv_wlen(kvv, key, sizeof(key) - 1, buf, strlen(buf)); \
 	} while (0)
 
-/* forward declaration */
+/* forward declarations */
 static void gather_output(child_process *cp, iobuf *io, int final);
+static void coproc_destroy(coproc_instance *inst, int sig);
+static void coproc_dequeue(child_process *cp);
+static void coproc_run_waiting(coproc_plugin *plugin);
 
 static void destroy_job(child_process *cp)
 {
@@ -226,7 +267,8 @@ static void destroy_job(child_process *cp)
 	 */
 	squeue_remove(sq, cp->ei->sq_event);
 	running_jobs--;
-	fanout_remove(ptab, cp->ei->pid);
+	if (cp->ei->pid)
+		fanout_remove(ptab, cp->ei->pid);
 
 	if (cp->outstd.buf) {
 		free(cp->outstd.buf);
@@ -317,6 +359,8 @@ int finish_job(child_process *cp, int reason)
 	}
 	kvvec_addkv_wlen(&resp, "outerr", 6, cp->outerr.buf, cp->outerr.len);
 	kvvec_addkv_wlen(&resp, "outstd", 6, cp->outstd.buf, cp->outstd.len);
+	if (response_filter)
+		response_filter(cp, &resp);
 	ret = worker_send_kvvec(master_sd, &resp);
 	if (ret < 0 && errno == EPIPE)
 		exit_worker(1, "Failed to send kvvec struct to master");
@@ -374,6 +418,25 @@ static void kill_job(child_process *cp, int reason)
 	int status, reaped = 0;
 	int pid = cp ? cp->ei->pid : 0;
 
+	/* a coprocess stuck on a job can't be trusted with the next one */
+	if (cp->ei->coproc || cp->ei->coproc_queue) {
+		coproc_plugin *plugin;
+
+		if (cp->ei->coproc) {
+			plugin = cp->ei->coproc->plugin;
+			coproc_destroy(cp->ei->coproc, SIGKILL);
+			cp->ei->coproc = NULL;
+			cp->ret = SIGKILL;
+		} else {
+			plugin = cp->ei->coproc_queue;
+			coproc_dequeue(cp);
+		}
+		finish_job(cp, reason);
+		destroy_job(cp);
+		coproc_run_waiting(plugin);
+		return;
+	}
+
 	/*
 	 * first attempt at reaping, so see if we just failed to
 	 * notice that things were going wrong her
@@ -508,9 +571,30 @@ static int stdout_handler(int fd, int events, void *cp_)
 	return 0;
 }
 
+/*
+ * A SIGCHLD that arrives after we've looked at 'reapable' but before
+ * iobroker_poll() goes to sleep wouldn't interrupt the poll, and the
+ * child would sit there until something else woke us up. Writing to
+ * a pipe the poll is watching closes that window.
+ */
 static void sigchld_handler(int sig)
 {
+	int saved_errno = errno;
+
 	reapable++;
+	if (sigchld_pipe[1] >= 0 && write(sigchld_pipe[1], "", 1) < 0) {
+		/* the pipe is full, so the poll will wake up anyway */
+	}
+	errno = saved_errno;
+}
+
+static int sigchld_wakeup(int fd, int events, void *arg)
+{
+	char buf[64];
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+	return 0;
 }
 
 static void reap_jobs(void)
@@ -567,7 +651,7 @@ char **env_from_kvvec(struct kvvec *kvv_env) {
 	return env;
 }
 
-int start_cmd(child_process *cp)
+static int launch_cmd(child_process *cp)
 {
 	int pfd[2] = {-1, -1}, pfderr[2] = {-1, -1};
 
@@ -592,6 +676,365 @@ int start_cmd(child_process *cp)
 	return 0;
 }
 
+static coproc_plugin *coproc_get_plugin(const char *path)
+{
+	coproc_plugin *plugin;
+
+	for (plugin = coproc_plugins; plugin; plugin = plugin->next) {
+		if (!strcmp(plugin->path, path))
+			return plugin;
+	}
+
+	plugin = calloc(1, sizeof(*plugin));
+	if (!plugin || !(plugin->path = strdup(path))) {
+		free(plugin);
+		return NULL;
+	}
+	plugin->next = coproc_plugins;
+	coproc_plugins = plugin;
+	return plugin;
+}
+
+/*
+ * Forgets about a coprocess. It's only killed if asked to, since one
+ * that has exited on its own may already have been reaped, and its
+ * pid may belong to someone else by now.
+ */
+static void coproc_destroy(coproc_instance *inst, int sig)
+{
+	coproc_instance **prev;
+
+	for (prev = &inst->plugin->instances; *prev; prev = &(*prev)->next) {
+		if (*prev == inst) {
+			*prev = inst->next;
+			inst->plugin->num_instances--;
+			break;
+		}
+	}
+	if (sig)
+		(void)kill(-inst->pid, sig);
+	iobroker_close(iobs, inst->out);
+	close(inst->in);
+	iocache_destroy(inst->ioc);
+	free(inst);
+}
+
+/* runs a job the normal way, when no coprocess can have it */
+static void coproc_fallback(child_process *cp)
+{
+	if (launch_cmd(cp) < 0) {
+		wlog("job %d: Failed to start %s without a coprocess", cp->id, cp->cmd);
+		finish_job(cp, ECHILD);
+		destroy_job(cp);
+	}
+}
+
+/*
+ * The coprocess went away or stopped making sense, so its job has to
+ * run the normal way. Plugins that have yet to answer a single request
+ * probably don't know how to, so we stop trying.
+ */
+static void coproc_lost(coproc_instance *inst, int sig)
+{
+	child_process *cp = inst->job;
+	coproc_plugin *plugin = inst->plugin;
+
+	if (!plugin->answered && !plugin->disabled) {
+		plugin->disabled = 1;
+		wlog("Coprocess plugin %s failed before answering a request. Running it as a normal plugin from now on", plugin->path);
+	}
+	coproc_destroy(inst, sig);
+	if (cp) {
+		cp->ei->coproc = NULL;
+		coproc_fallback(cp);
+	}
+}
+
+static int coproc_finish_job(coproc_instance *inst, struct kvvec *kvv)
+{
+	child_process *cp = inst->job;
+	struct key_value *out = NULL, *err = NULL;
+	int i, code = 3;
+	long id = -1;
+
+	for (i = 0; i < kvv->kv_pairs; i++) {
+		struct key_value *kv = &kvv->kv[i];
+
+		if (!strcmp(kv->key, "job_id"))
+			id = strtol(kv->value, NULL, 10);
+		else if (!strcmp(kv->key, "exit_code"))
+			code = atoi(kv->value);
+		else if (!strcmp(kv->key, "outstd"))
+			out = kv;
+		else if (!strcmp(kv->key, "outerr"))
+			err = kv;
+	}
+	if (!cp || id != (long)cp->id)
+		return -1;
+
+	inst->job = NULL;
+	inst->plugin->answered++;
+	cp->ei->coproc = NULL;
+	cp->ret = (code & 0xff) << 8;
+	if (out && (cp->outstd.buf = malloc(out->value_len + 1))) {
+		memcpy(cp->outstd.buf, out->value, out->value_len);
+		cp->outstd.buf[out->value_len] = 0;
+		cp->outstd.len = out->value_len;
+	}
+	if (err && (cp->outerr.buf = malloc(err->value_len + 1))) {
+		memcpy(cp->outerr.buf, err->value, err->value_len);
+		cp->outerr.buf[err->value_len] = 0;
+		cp->outerr.len = err->value_len;
+	}
+	finish_job(cp, 0);
+	destroy_job(cp);
+	return 0;
+}
+
+static int coproc_handler(int fd, int events, void *inst_)
+{
+	static struct kvvec kvv = KVVEC_INITIALIZER;
+	coproc_instance *inst = (coproc_instance *)inst_;
+	coproc_plugin *plugin = inst->plugin;
+	unsigned long size;
+	char *buf;
+	int ret;
+
+	ret = iocache_read(inst->ioc, fd);
+	if (!ret || (ret < 0 && errno != EAGAIN && errno != EINTR)) {
+		coproc_lost(inst, 0);
+		coproc_run_waiting(plugin);
+		return 0;
+	}
+
+	while ((buf = iocache_use_delim(inst->ioc, MSG_DELIM, MSG_DELIM_LEN, &size))) {
+		if (buf2kvvec_prealloc(&kvv, buf, (unsigned int)size, KV_SEP, PAIR_SEP, KVVEC_ASSIGN) <= 0 ||
+		    coproc_finish_job(inst, &kvv) < 0)
+		{
+			wlog("Coprocess plugin %s (pid=%ld) sent a response we didn't ask for", plugin->path, (long)inst->pid);
+			coproc_lost(inst, SIGKILL);
+			break;
+		}
+	}
+	coproc_run_waiting(plugin);
+
+	return 0;
+}
+
+static coproc_instance *coproc_start(coproc_plugin *plugin)
+{
+	coproc_instance *inst;
+	int in[2], out[2], fd;
+	pid_t pid;
+
+	if (pipe(in) < 0)
+		return NULL;
+	if (pipe(out) < 0) {
+		close(in[0]);
+		close(in[1]);
+		return NULL;
+	}
+
+	pid = fork();
+	if (!pid) {
+		/* a process group of its own, like any other plugin */
+		setpgid(0, 0);
+		dup2(in[0], STDIN_FILENO);
+		dup2(out[1], STDOUT_FILENO);
+		if ((fd = open("/dev/null", O_WRONLY)) >= 0) {
+			dup2(fd, STDERR_FILENO);
+			close(fd);
+		}
+		close(in[0]);
+		close(in[1]);
+		close(out[0]);
+		close(out[1]);
+		setenv(WORKER_COPROC_ENV, "1", 1);
+		execlp(plugin->path, plugin->path, (char *)NULL);
+		_exit(127);
+	}
+
+	close(in[0]);
+	close(out[1]);
+	if (pid < 0) {
+		close(in[1]);
+		close(out[0]);
+		return NULL;
+	}
+	setpgid(pid, pid);
+
+	/* we must never block on a coprocess, nor let other plugins inherit it */
+	fcntl(in[1], F_SETFD, FD_CLOEXEC);
+	fcntl(in[1], F_SETFL, O_NONBLOCK);
+	fcntl(out[0], F_SETFD, FD_CLOEXEC);
+	fcntl(out[0], F_SETFL, O_NONBLOCK);
+
+	inst = calloc(1, sizeof(*inst));
+	if (inst)
+		inst->ioc = iocache_create(64 * 1024);
+	if (!inst || !inst->ioc || iobroker_register(iobs, out[0], inst, coproc_handler) < 0) {
+		wlog("Failed to set up coprocess plugin %s", plugin->path);
+		(void)kill(-pid, SIGKILL);
+		if (inst)
+			iocache_destroy(inst->ioc);
+		free(inst);
+		close(in[1]);
+		close(out[0]);
+		return NULL;
+	}
+
+	inst->pid = pid;
+	inst->in = in[1];
+	inst->out = out[0];
+	inst->plugin = plugin;
+	inst->next = plugin->instances;
+	plugin->instances = inst;
+	plugin->num_instances++;
+	return inst;
+}
+
+/* sends a job to an idle coprocess. Returns -1 if the coprocess is broken */
+static int coproc_send(coproc_instance *inst, child_process *cp)
+{
+	static struct kvvec req = KVVEC_INITIALIZER;
+	struct kvvec_buf *kvvb;
+	sigset_t pipe_set, old_set;
+	char **argv;
+	int i, argc = 0, ret = -1;
+	ssize_t wrote;
+
+	argv = calloc((strlen(cp->cmd) / 2) + 5, sizeof(char *));
+	if (!argv)
+		return -1;
+	if (runcmd_cmd2strv(cp->cmd, &argc, argv) || !kvvec_init(&req, argc + 3))
+		goto out;
+
+	kvvec_addkv(&req, "job_id", mkstr("%u", cp->id));
+	kvvec_addkv(&req, "timeout", mkstr("%u", cp->timeout));
+	for (i = 1; i < argc; i++)
+		kvvec_addkv(&req, "arg", argv[i]);
+	for (i = 0; i < cp->request->kv_pairs; i++) {
+		struct key_value *kv = &cp->request->kv[i];
+		if (kv->key_len == 3 && !strcmp(kv->key, "env"))
+			kvvec_addkv_wlen(&req, "env", 3, kv->value, kv->value_len);
+	}
+
+	if (!(kvvb = build_kvvec_buf(&req)))
+		goto out;
+
+	/* plugins that don't know they're coprocesses exit early */
+	sigemptyset(&pipe_set);
+	sigaddset(&pipe_set, SIGPIPE);
+	sigprocmask(SIG_BLOCK, &pipe_set, &old_set);
+	do {
+		wrote = write(inst->in, kvvb->buf, kvvb->bufsize);
+	} while (wrote < 0 && errno == EINTR);
+	if (wrote < 0 && errno == EPIPE && !sigismember(&old_set, SIGPIPE)) {
+		struct timespec now = { 0, 0 };
+		sigtimedwait(&pipe_set, NULL, &now);
+	}
+	sigprocmask(SIG_SETMASK, &old_set, NULL);
+	/* half a request would confuse it, and a full pipe means it's stuck */
+	if (wrote == (ssize_t)kvvb->bufsize) {
+		inst->job = cp;
+		cp->ei->coproc = inst;
+		ret = 0;
+	}
+	free(kvvb->buf);
+	free(kvvb);
+
+out:
+	free(argv[0]);
+	free(argv);
+	return ret;
+}
+
+static void coproc_dequeue(child_process *cp)
+{
+	coproc_plugin *plugin = cp->ei->coproc_queue;
+	child_process **prev, *last = NULL;
+
+	for (prev = &plugin->waiting; *prev; last = *prev, prev = &(*prev)->ei->coproc_next) {
+		if (*prev == cp) {
+			*prev = cp->ei->coproc_next;
+			if (plugin->waiting_tail == cp)
+				plugin->waiting_tail = last;
+			break;
+		}
+	}
+	cp->ei->coproc_queue = NULL;
+	cp->ei->coproc_next = NULL;
+}
+
+/*
+ * Hands waiting jobs to idle instances of their plugin, starting new
+ * ones while there's room. Jobs that no instance will ever take run
+ * the normal way.
+ */
+static void coproc_run_waiting(coproc_plugin *plugin)
+{
+	coproc_instance *inst;
+	child_process *cp;
+
+	while ((cp = plugin->waiting)) {
+		inst = NULL;
+		if (!plugin->disabled) {
+			for (inst = plugin->instances; inst && inst->job; inst = inst->next)
+				;
+			if (!inst && plugin->num_instances < WORKER_COPROC_MAX_INSTANCES)
+				inst = coproc_start(plugin);
+			if (!inst && plugin->num_instances)
+				break;
+		}
+
+		coproc_dequeue(cp);
+		if (inst && !coproc_send(inst, cp))
+			continue;
+		if (inst)
+			coproc_lost(inst, SIGKILL);
+		coproc_fallback(cp);
+	}
+}
+
+/*
+ * Queues a job for an instance of its plugin. Returns -1 if the job
+ * has to be run the normal way.
+ */
+static int coproc_start_job(child_process *cp)
+{
+	coproc_plugin *plugin = NULL;
+	char **argv;
+	int argc = 0;
+
+	argv = calloc((strlen(cp->cmd) / 2) + 5, sizeof(char *));
+	if (!argv)
+		return -1;
+	if (!runcmd_cmd2strv(cp->cmd, &argc, argv) && argc && !strchr(argv[0], '='))
+		plugin = coproc_get_plugin(argv[0]);
+	free(argv[0]);
+	free(argv);
+	if (!plugin || plugin->disabled)
+		return -1;
+
+	cp->outstd.fd = cp->outerr.fd = -1;
+	cp->ei->coproc_queue = plugin;
+	if (plugin->waiting_tail)
+		plugin->waiting_tail->ei->coproc_next = cp;
+	else
+		plugin->waiting = cp;
+	plugin->waiting_tail = cp;
+	coproc_run_waiting(plugin);
+	return 0;
+}
+
+int start_cmd(child_process *cp)
+{
+	if (cp->ei->use_coproc && !coproc_start_job(cp))
+		return 0;
+
+	return launch_cmd(cp);
+}
+
 static iocache *ioc;
 
 static child_process *parse_command_kvvec(struct kvvec *kvv)
@@ -638,6 +1081,10 @@ static child_process *parse_command_kvvec(struct kvvec *kvv)
 			cp->env = buf2kvvec(value, strlen(value), '=', '\n', KVVEC_COPY);
 			continue;
 		}
+		if (!strcmp(key, "coproc")) {
+			cp->ei->use_coproc = atoi(value) > 0;
+			continue;
+		}
 	}
 
 	/* jobs without a timeout get a default of 60 seconds. */
@@ -744,11 +1191,17 @@ int set_socket_options(int sd, int bufsize)
 	return worker_set_sockopts(sd, bufsize);
 }
 
+void worker_set_response_filter(int (*filter)(child_process *cp, struct kvvec *resp))
+{
+	response_filter = filter;
+}
+
 void enter_worker(int sd, int (*cb)(child_process*))
 {
 #ifdef HAVE_SIGACTION
 	struct sigaction sig_action;
 #endif
+	int i;
 
 	/* created with socketpair(), usually */
 	master_sd = sd;
@@ -762,6 +1215,15 @@ void enter_worker(int sd, int (*cb)(child_process*))
 		/* XXX: handle error somehow, or maybe just ignore it */
 	}
 
+	/* set up the wakeup pipe before anything can send us SIGCHLD */
+	if (pipe(sigchld_pipe) < 0) {
+		exit_worker(EXIT_FAILURE, "Worker failed to create its SIGCHLD pipe");
+	}
+	for (i = 0; i < 2; i++) {
+		fcntl(sigchld_pipe[i], F_SETFL, O_NONBLOCK);
+		fcntl(sigchld_pipe[i], F_SETFD, FD_CLOEXEC);
+	}
+
 	/* we need to catch child signals to mark jobs as reapable */
 #ifdef HAVE_SIGACTION
 	sig_action.sa_sigaction = NULL;
@@ -790,6 +1252,7 @@ void enter_worker(int sd, int (*cb)(child_process*))
 	worker_set_sockopts(master_sd, 256 * 1024);
 
 	iobroker_register(iobs, master_sd, cb, receive_command);
+	iobroker_register(iobs, sigchld_pipe[0], NULL, sigchld_wakeup);
 	while (iobroker_get_num_fds(iobs) > 0) {
 		int poll_time = -1;
 
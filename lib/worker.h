@@ -22,6 +22,31 @@
 #define ETIME ETIMEDOUT
 #endif
 
+/**
+ * @name Coprocess plugins
+ * Jobs that carry a "coproc=1" key are run by a long-lived instance
+ * of the plugin instead of a new process, if the command needs no
+ * shell. The worker starts the plugin without arguments, with
+ * WORKER_COPROC_ENV set in its environment, its stdin and stdout
+ * connected to pipes and its stderr pointing at /dev/null. For each
+ * check it then writes a request to the plugin's stdin, framed just
+ * like the messages between master and worker, with these keys:
+ *   job_id   A number to copy into the response
+ *   timeout  Seconds the plugin has to respond
+ *   arg      One per argument, in order
+ *   env      The check's environment as newline separated name=value
+ *            pairs, if the master sent one
+ * The plugin answers on stdout with job_id, exit_code, outstd and,
+ * optionally, outerr, and must answer each request before the worker
+ * sends the next. It should exit when its stdin is closed.
+ * A plugin that times out is killed, and a job that can't be handed
+ * to an instance runs the normal way.
+ * @{
+ */
+#define WORKER_COPROC_ENV "NAGIOS_COPROCESS" /**< set to "1" for coprocesses */
+#define WORKER_COPROC_MAX_INSTANCES 8 /**< per plugin and worker */
+/** @} */
+
 typedef struct iobuf {
 	int fd;
 	unsigned int len;
@@ -70,6 +95,15 @@ extern int spawn_helper(char **argv);
  */
 extern int finish_job(child_process *cp, int reason);
 
+/**
+ * Set a function to be called for each finished job before its
+ * result is shipped to nagios. The filter may add key/value pairs
+ * to the response vector, but must keep any memory it hands over
+ * alive until it is called again.
+ * @param filter The filter function, or NULL to disable filtering
+ */
+extern void worker_set_response_filter(int (*filter)(child_process *cp, struct kvvec *resp));
+
 /**
  * Start to poll the socket and call the callback when there are new tasks
  * @param sd A socket descriptor to poll
@@ -50,4 +50,19 @@ int broker_contact_notification_method_data(int type, int flags, int attr, int n
 { return OK; }
 
 int broker_notification_data(int type, int flags, int attr, int notification_type, int reason_type, struct timeval start_time, struct timeval end_time, void *data, char *ack_author, char *ack_data, int escalated, int contacts_notified, struct timeval *timestamp)
-{ return OK; }
\ No newline at end of file
+{ return OK; }
+
+void broker_program_status(int type, int flags, int attr, struct timeval *timestamp)
+{ }
+
+void broker_host_status(int type, int flags, int attr, host *hst, struct timeval *timestamp)
+{ }
+
+void broker_service_status(int type, int flags, int attr, service *svc, struct timeval *timestamp)
+{ }
+
+void broker_contact_status(int type, int flags, int attr, contact *cntct, struct timeval *timestamp)
+{ }
+
+void broker_aggregated_status_data(int type, int flags, int attr, struct timeval *timestamp)
+{ }
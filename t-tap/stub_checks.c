@@ -4,12 +4,16 @@ void schedule_host_check(host *hst, time_t check_time, int options)
 void schedule_service_check(service *svc, time_t check_time, int options) 
 { }
 
+#ifndef TEST_COMMANDS
+
 int handle_async_host_check_result(host *temp_host, check_result *queued_check_result) 
 { return OK; }
 
 int handle_async_service_check_result(service *temp_service, check_result *queued_check_result) 
 { return OK; }
 
+#endif
+
 int reap_check_results(void) 
 { return OK; }
 
@@ -34,3 +38,12 @@ int run_scheduled_service_check(service *svc, int check_options, double latency)
 { return OK; }
 
 #endif
+
+void update_host_dependents(host *hst)
+{ }
+
+void update_service_dependents(service *svc)
+{ }
+
+void update_host_reachability(host *hst)
+{ }
@@ -2,5 +2,9 @@
 
 int close_command_file(void) 
 { return OK; }
+int process_external_command_backlog(void)
+{ return 0; }
+int have_external_command_backlog(void)
+{ return FALSE; }
 
 #endif
@@ -9,3 +9,6 @@ const char *iobroker_strerror(int error)
 
 void iobroker_destroy(iobroker_set *iobs, int flags) 
 { }
+
+void iobroker_last_wakeup(iobroker_set *iobs, struct timeval *tv)
+{ tv->tv_sec = tv->tv_usec = 0; }
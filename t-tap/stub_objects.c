@@ -1,9 +1,13 @@
+#ifndef TEST_COMMANDS
+
 service *find_service(const char *host_name, const char *svc_desc) 
 { return NULL; }
 
 host *find_host(const char *name) 
 { return NULL; }
 
+#endif
+
 hostgroup *find_hostgroup(const char *name) 
 { return NULL; }
 
@@ -30,3 +34,12 @@ int free_objectlist(objectlist **temp_list)
 
 int free_object_data(void) 
 { return OK; }
+
+customvariablesmember *find_custom_variable(customvariablesmember *vars, const char *varname) 
+{ return NULL; }
+
+customvariablesmember *find_indexed_custom_variable(customvariablesmember *vars, const customvariablesindex *idx, const char *varname) 
+{ return NULL; }
+
+void free_object_string(char *str) 
+{}
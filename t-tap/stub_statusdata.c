@@ -1,3 +1,5 @@
+struct status_update_stats status_update_stats;
+
 int update_service_status(service *svc, int aggregated_dump) 
 { return OK; }
 
@@ -10,6 +12,12 @@ int update_contact_status(contact *cntct, int aggregated_dump)
 int update_all_status_data(void) 
 { return OK; }
 
+int host_status_is_dirty(host *hst)
+{ return TRUE; }
+
+int service_status_is_dirty(service *svc)
+{ return TRUE; }
+
 
 #if !(defined(TEST_CHECKS_C) || defined(TEST_EVENTS_C))
 
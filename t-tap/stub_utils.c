@@ -11,5 +11,19 @@ int check_time_against_period(time_t test_time, timeperiod *tperiod)
 void free_memory(nagios_macros *mac) 
 { }
 
+/* unescapes like the real one, so check results can be compared */
 char * unescape_check_result_output(const char *rawbuf)
-{ return strdup(rawbuf); }
+{
+	char *newbuf, *out;
+
+	if (rawbuf == NULL || (newbuf = out = malloc(strlen(rawbuf) + 1)) == NULL)
+		return NULL;
+	for (; *rawbuf; rawbuf++) {
+		if (rawbuf[0] == '\\' && (rawbuf[1] == '\\' || rawbuf[1] == 'n'))
+			*out++ = *++rawbuf == 'n' ? '\n' : '\\';
+		else
+			*out++ = *rawbuf;
+	}
+	*out = 0;
+	return newbuf;
+}
@@ -7,6 +7,15 @@ int wproc_can_spawn(struct load_control *lc)
 void wproc_reap(int jobs, int msecs) 
 { }
 
+void wproc_handle_results(void)
+{ }
+
+int wproc_add_coprocess_plugin(const char *path)
+{ return OK; }
+
+void wproc_free_coprocess_plugins(void)
+{ }
+
 int get_desired_workers(int desired_workers) 
 { return 4; }
 
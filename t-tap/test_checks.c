@@ -1451,6 +1451,24 @@ void run_misc_host_check_tests()
     ok(hst1->execution_time == 0.0,
         "execution time gets fixed when finish time is before start time");
 
+    /* output already split by a worker is taken over as-is */
+    create_check_result(check_type, HOST_UP, "host up");
+    chk_result->output_split       = TRUE;
+    chk_result->plugin_output      = strdup("split output");
+    chk_result->long_plugin_output = strdup("long\\noutput");
+    chk_result->perf_data          = strdup("time=1s");
+
+    handle_hst1();
+
+    ok(hst1->plugin_output != NULL && !strcmp(hst1->plugin_output, "split output"),
+        "pre-split short output is used [%s]", hst1->plugin_output);
+    ok(hst1->long_plugin_output != NULL && !strcmp(hst1->long_plugin_output, "long\\noutput"),
+        "pre-split long output is used [%s]", hst1->long_plugin_output);
+    ok(hst1->perf_data != NULL && !strcmp(hst1->perf_data, "time=1s"),
+        "pre-split perfdata is used [%s]", hst1->perf_data);
+    ok(chk_result->plugin_output == NULL && chk_result->long_plugin_output == NULL && chk_result->perf_data == NULL,
+        "check result no longer owns the pre-split output");
+
     create_check_result(check_type, HOST_UP, "host up");
 
     free_all();
@@ -1473,6 +1491,312 @@ void run_misc_service_check_tests()
         "run service check is ERROR when object is null");
 }
 
+void run_dependency_cache_tests()
+{
+    host *hosts[3], **orig_host_ary = host_ary;
+    hostdependency deps[2];
+    objectlist lists[2];
+    unsigned int orig_hosts = num_objects.hosts;
+    int i;
+
+    /* hosts[2] depends on hosts[1], which depends on hosts[0] */
+    memset(deps, 0, sizeof(deps));
+    memset(lists, 0, sizeof(lists));
+    for (i = 0; i < 3; i++) {
+        hosts[i] = (host *) calloc(1, sizeof(host));
+        hosts[i]->id = i;
+        hosts[i]->current_state = HOST_UP;
+        hosts[i]->state_type = HARD_STATE;
+        hosts[i]->last_hard_state = HOST_UP;
+    }
+    for (i = 0; i < 2; i++) {
+        deps[i].dependency_type = EXECUTION_DEPENDENCY;
+        deps[i].failure_options = 1 << HOST_DOWN;
+        deps[i].inherits_parent = TRUE;
+        deps[i].master_host_ptr = hosts[i];
+        deps[i].dependent_host_ptr = hosts[i + 1];
+        lists[i].object_ptr = &deps[i];
+        hosts[i + 1]->exec_deps = &lists[i];
+    }
+    host_ary = hosts;
+    num_objects.hosts = 3;
+
+    init_dependency_cache();
+
+    ok(check_host_dependencies(hosts[2], EXECUTION_DEPENDENCY) == DEPENDENCIES_OK,
+        "dependencies are ok when everything is up");
+
+    hosts[0]->current_state = HOST_DOWN;
+    ok(check_host_dependencies(hosts[2], EXECUTION_DEPENDENCY) == DEPENDENCIES_OK,
+        "dependency results are remembered until told of state changes");
+
+    update_host_dependents(hosts[0]);
+    ok(check_host_dependencies(hosts[1], EXECUTION_DEPENDENCY) == DEPENDENCIES_FAILED,
+        "a state change is seen by direct dependents");
+    ok(check_host_dependencies(hosts[2], EXECUTION_DEPENDENCY) == DEPENDENCIES_FAILED,
+        "a state change is seen by dependents that inherit dependencies");
+    ok(check_host_dependencies(hosts[2], NOTIFICATION_DEPENDENCY) == DEPENDENCIES_OK,
+        "dependency types are remembered separately");
+
+    hosts[0]->state_type = SOFT_STATE;
+    update_host_dependents(hosts[0]);
+    ok(check_host_dependencies(hosts[2], EXECUTION_DEPENDENCY) == DEPENDENCIES_OK,
+        "soft states don't count unless soft_state_dependencies is set");
+
+    deps[1].inherits_parent = FALSE;
+    hosts[0]->state_type = HARD_STATE;
+    update_host_dependents(hosts[0]);
+    ok(check_host_dependencies(hosts[2], EXECUTION_DEPENDENCY) == DEPENDENCIES_OK,
+        "dependencies are only inherited when asked to");
+    ok(check_host_dependencies(hosts[1], EXECUTION_DEPENDENCY) == DEPENDENCIES_FAILED,
+        "the direct dependent still sees the state change");
+
+    hosts[1]->current_state = HOST_DOWN;
+    update_host_dependents(hosts[1]);
+    ok(check_host_dependencies(hosts[2], EXECUTION_DEPENDENCY) == DEPENDENCIES_FAILED,
+        "remembered results are forgotten for each master that changes");
+
+    free_dependency_cache();
+    hosts[1]->current_state = HOST_UP;
+    ok(check_host_dependencies(hosts[2], EXECUTION_DEPENDENCY) == DEPENDENCIES_OK,
+        "dependencies are worked out every time without the cache");
+
+    host_ary = orig_host_ary;
+    num_objects.hosts = orig_hosts;
+    for (i = 0; i < 3; i++) {
+        my_free(hosts[i]);
+    }
+}
+
+static void add_test_parent(host *child, host *parent)
+{
+    hostsmember *hm;
+
+    hm = (hostsmember *) calloc(1, sizeof(hostsmember));
+    hm->host_ptr = parent;
+    hm->next = child->parent_hosts;
+    child->parent_hosts = hm;
+
+    hm = (hostsmember *) calloc(1, sizeof(hostsmember));
+    hm->host_ptr = child;
+    hm->next = parent->child_hosts;
+    parent->child_hosts = hm;
+}
+
+void run_reachability_tests()
+{
+    /* core -> sw -> { a, b }, a -> c, and d hangs off both sw and core */
+    enum { CORE, SW, A, B, C, D, NUM_HOSTS };
+    host *hosts[NUM_HOSTS], **orig_host_ary = host_ary;
+    unsigned int orig_hosts = num_objects.hosts;
+    hostsmember *hm, *next;
+    int i;
+
+    for (i = 0; i < NUM_HOSTS; i++) {
+        hosts[i] = (host *) calloc(1, sizeof(host));
+        hosts[i]->id = i;
+        hosts[i]->name = "reachability test host";
+        hosts[i]->current_state = HOST_UP;
+        hosts[i]->checks_enabled = TRUE;
+    }
+    add_test_parent(hosts[SW], hosts[CORE]);
+    add_test_parent(hosts[A], hosts[SW]);
+    add_test_parent(hosts[B], hosts[SW]);
+    add_test_parent(hosts[C], hosts[A]);
+    add_test_parent(hosts[D], hosts[SW]);
+    add_test_parent(hosts[D], hosts[CORE]);
+    host_ary = hosts;
+    num_objects.hosts = NUM_HOSTS;
+
+    init_host_reachability();
+    ok(host_is_reachable(hosts[CORE]) && host_is_reachable(hosts[C]) && host_is_reachable(hosts[D]),
+        "everything is reachable when everything is up");
+
+    hosts[SW]->current_state = HOST_DOWN;
+    update_host_reachability(hosts[SW]);
+    ok(host_is_reachable(hosts[SW]) == TRUE,
+        "a host that goes down is still reachable itself");
+    ok(!host_is_reachable(hosts[A]) && !host_is_reachable(hosts[B]) && !host_is_reachable(hosts[C]),
+        "the whole subtree behind a host that goes down is cut off");
+    ok(host_is_reachable(hosts[D]) == TRUE,
+        "hosts with another way in stay reachable");
+
+    hosts[C]->current_state = HOST_DOWN;
+    ok(determine_host_reachability(hosts[C]) == HOST_UNREACHABLE,
+        "hosts whose parents are up but cut off are unreachable");
+    hosts[C]->current_state = HOST_UP;
+
+    hosts[A]->current_state = HOST_DOWN;
+    hosts[D]->current_state = HOST_DOWN;
+    ok(determine_host_reachability(hosts[A]) == HOST_UNREACHABLE,
+        "hosts with no parent up are unreachable");
+    ok(determine_host_reachability(hosts[D]) == HOST_DOWN,
+        "hosts with a parent up are down");
+
+    schedule_reachability_checks();
+    ok(hosts[A]->next_check_event && hosts[B]->next_check_event && hosts[C]->next_check_event,
+        "the cut off subtree is checked in one batch");
+    ok(hosts[D]->next_check_event == NULL && hosts[CORE]->next_check_event == NULL,
+        "hosts whose reachability didn't change aren't checked");
+
+    update_host_reachability(hosts[A]);
+    hosts[SW]->current_state = HOST_UP;
+    update_host_reachability(hosts[SW]);
+    ok(host_is_reachable(hosts[A]) && host_is_reachable(hosts[B]),
+        "hosts behind a recovered host are reachable again");
+    ok(host_is_reachable(hosts[C]) == FALSE,
+        "but not the ones behind hosts that are still down");
+
+    free_host_reachability();
+    ok(host_is_reachable(hosts[C]) == FALSE && host_is_reachable(hosts[B]) == TRUE,
+        "reachability is worked out from the parents without the index");
+
+    host_ary = orig_host_ary;
+    num_objects.hosts = orig_hosts;
+    for (i = 0; i < NUM_HOSTS; i++) {
+        for (hm = hosts[i]->parent_hosts; hm; hm = next) {
+            next = hm->next;
+            free(hm);
+        }
+        for (hm = hosts[i]->child_hosts; hm; hm = next) {
+            next = hm->next;
+            free(hm);
+        }
+        my_free(hosts[i]->next_check_event);
+        my_free(hosts[i]);
+    }
+}
+
+/* storm mode's clock, moved along by the tests */
+static struct timeval storm_test_now;
+
+static void storm_test_clock(struct timeval *tv)
+{
+    *tv = storm_test_now;
+}
+
+static void storm_test_sleep(long usecs)
+{
+    storm_test_now.tv_usec += usecs;
+    storm_test_now.tv_sec += storm_test_now.tv_usec / 1000000;
+    storm_test_now.tv_usec %= 1000000;
+}
+
+void run_check_storm_tests()
+{
+    enum { ROUTER, LEAF, NUM_HOSTS };
+    host *hosts[NUM_HOSTS], **orig_host_ary = host_ary;
+    service *svcs[2];
+    unsigned int orig_hosts = num_objects.hosts, orig_services = num_objects.services;
+    hostsmember *hm, *next;
+    void (*orig_clock)(struct timeval *) = check_storm_clock;
+    time_t start;
+    int i;
+
+    for (i = 0; i < NUM_HOSTS; i++) {
+        hosts[i] = (host *) calloc(1, sizeof(host));
+        hosts[i]->id = i;
+        hosts[i]->name = "storm test host";
+        hosts[i]->checks_enabled = TRUE;
+    }
+    add_test_parent(hosts[LEAF], hosts[ROUTER]);
+    for (i = 0; i < 2; i++) {
+        svcs[i] = (service *) calloc(1, sizeof(service));
+        svcs[i]->id = i;
+        svcs[i]->host_name = "storm test host";
+        svcs[i]->description = "storm test service";
+        svcs[i]->checks_enabled = TRUE;
+    }
+    host_ary = hosts;
+    num_objects.hosts = NUM_HOSTS;
+    num_objects.services = 2;
+
+    check_storm_threshold = 2;
+    check_storm_drain_rate = 2;
+    memset(&check_storm_stats, 0, sizeof(check_storm_stats));
+
+    /* the threshold is per second, so start at the beginning of one */
+    start = time(NULL);
+    storm_test_now.tv_sec = start;
+    storm_test_now.tv_usec = 0;
+    check_storm_clock = storm_test_clock;
+
+    schedule_service_check(svcs[0], start, CHECK_OPTION_DEPENDENCY_CHECK);
+    schedule_service_check(svcs[0], start, CHECK_OPTION_DEPENDENCY_CHECK);
+    ok(svcs[0]->next_check_event != NULL && check_storm_stats.active == FALSE,
+        "on-demand checks below the threshold are scheduled as usual");
+    ok(check_storm_stats.coalesced == 1,
+        "an on-demand check of a service with a check pending is coalesced");
+
+    schedule_service_check(svcs[1], start, CHECK_OPTION_DEPENDENCY_CHECK);
+    ok(check_storm_stats.active == TRUE && check_storm_stats.storms == 1,
+        "going over the threshold starts storm mode");
+    ok(svcs[1]->next_check_event == NULL && check_storm_stats.deferred == 1,
+        "on-demand service checks are held back during a storm");
+
+    schedule_service_check(svcs[1], start, CHECK_OPTION_DEPENDENCY_CHECK);
+    ok(check_storm_stats.coalesced == 2 && check_storm_stats.backlog == 1,
+        "a service is only held back once");
+
+    schedule_host_check(hosts[LEAF], start, CHECK_OPTION_DEPENDENCY_CHECK);
+    schedule_host_check(hosts[ROUTER], start, CHECK_OPTION_DEPENDENCY_CHECK);
+    ok(hosts[LEAF]->next_check_event == NULL && check_storm_stats.backlog == 2,
+        "on-demand checks of hosts without children are held back");
+    ok(hosts[ROUTER]->next_check_event != NULL,
+        "on-demand checks of hosts with children go through");
+
+    schedule_service_check(svcs[1], start + 60, CHECK_OPTION_NONE);
+    ok(svcs[1]->next_check_event != NULL,
+        "regular checks aren't held back");
+    my_free(svcs[1]->next_check_event);
+
+    run_held_checks();
+    ok(check_storm_stats.backlog == 2,
+        "nothing is let out before the first drain interval");
+    storm_test_sleep(600000);
+    run_held_checks();
+    ok(hosts[LEAF]->next_check_event != NULL && svcs[1]->next_check_event == NULL && check_storm_stats.backlog == 1,
+        "held back checks are let out at the drain rate, hosts first");
+    storm_test_sleep(600000);
+    run_held_checks();
+    ok(svcs[1]->next_check_event != NULL && check_storm_stats.backlog == 0,
+        "the backlog drains");
+    ok(check_storm_stats.active == TRUE,
+        "storm mode lingers after the backlog is gone");
+
+    free_held_checks();
+    ok(check_storm_stats.active == FALSE && check_storm_stats.backlog == 0,
+        "freeing held checks ends storm mode");
+
+    check_storm_threshold = 0;
+    my_free(svcs[0]->next_check_event);
+    for (i = 0; i < 5; i++)
+        schedule_service_check(svcs[0], start, CHECK_OPTION_DEPENDENCY_CHECK);
+    ok(check_storm_stats.active == FALSE && check_storm_stats.storms == 1,
+        "storm mode is off with a threshold of 0");
+
+    check_storm_clock = orig_clock;
+    host_ary = orig_host_ary;
+    num_objects.hosts = orig_hosts;
+    num_objects.services = orig_services;
+    for (i = 0; i < NUM_HOSTS; i++) {
+        for (hm = hosts[i]->parent_hosts; hm; hm = next) {
+            next = hm->next;
+            free(hm);
+        }
+        for (hm = hosts[i]->child_hosts; hm; hm = next) {
+            next = hm->next;
+            free(hm);
+        }
+        my_free(hosts[i]->next_check_event);
+        my_free(hosts[i]);
+    }
+    for (i = 0; i < 2; i++) {
+        my_free(svcs[i]->next_check_event);
+        my_free(svcs[i]);
+    }
+}
+
 void run_reaper_tests()
 {
     int result;
@@ -1551,7 +1875,7 @@ int main(int argc, char **argv)
     accept_passive_service_checks   = TRUE;
 
     /* Increment this when the check_reaper test is fixed */
-    plan_tests(452);
+    plan_tests(492);
 
     time(&now);
 
@@ -1566,6 +1890,9 @@ int main(int argc, char **argv)
     run_passive_host_tests();
 
     run_misc_host_check_tests(now);
+    run_dependency_cache_tests();
+    run_reachability_tests();
+    run_check_storm_tests();
     run_reaper_tests();
 
     return exit_status();
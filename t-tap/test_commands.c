@@ -84,6 +84,9 @@ command *global_host_event_handler_ptr;
 char *command_file = NULL;
 iobroker_set *nagios_iobs = NULL;
 int sigrestart = FALSE;
+int sigshutdown = FALSE;
+int max_external_command_time = 200;
+unsigned long event_broker_options = 0;
 int debug_level = 0;
 int debug_verbosity = 0;
 int log_passive_checks = TRUE;
@@ -125,11 +128,101 @@ void reset_vars() {
 
 hostgroup *temp_hostgroup = NULL;
 
+/* a host and service for the check result commands to find */
+host test_host;
+service test_service;
+
+host *find_host(const char *name) {
+	return name && !strcmp(name, test_host.name) ? &test_host : NULL;
+	}
+
+service *find_service(const char *host_name, const char *svc_desc) {
+	if(host_name && svc_desc && !strcmp(host_name, test_host.name) && !strcmp(svc_desc, test_service.description))
+		return &test_service;
+	return NULL;
+	}
+
+/* what the passive check handlers were given */
+char received[1024];
+
+int handle_async_host_check_result(host *hst, check_result *cr) {
+	snprintf(received, sizeof(received), "host %s %d %lu '%s'", hst->name,
+	         cr->return_code, (unsigned long)cr->start_time.tv_sec, cr->output);
+	return OK;
+	}
+
+int handle_async_service_check_result(service *svc, check_result *cr) {
+	snprintf(received, sizeof(received), "service %s;%s %d %lu '%s'", cr->host_name, cr->service_description,
+	         cr->return_code, (unsigned long)cr->start_time.tv_sec, cr->output);
+	return OK;
+	}
+
+/*
+ * runs a command the way the command file backlog does, through the
+ * check result fast path first, or only through process_external_command1()
+ */
+static char *run_check_result(const char *command, int fast, int *handled) {
+	char buf[1024];
+
+	received[0] = 0;
+	snprintf(buf, sizeof(buf), "%s", command);
+	*handled = FALSE;
+	if(fast == TRUE)
+		*handled = process_check_result_command(buf);
+	if(*handled == FALSE)
+		process_external_command1(buf);
+	return strdup(received);
+	}
+
+struct {
+	const char *command;
+	int fast;
+	const char *expected;
+	} check_results[] = {
+	{ "[1234567890] PROCESS_SERVICE_CHECK_RESULT;host1;Service 1;2;CRITICAL - disk full|used=99%", TRUE,
+	  "service host1;Service 1 2 1234567890 'CRITICAL - disk full|used=99%'" },
+	{ "[1234567890] PROCESS_SERVICE_CHECK_RESULT;host1;Service 1;1;WARNING\\nsecond line\\\\n", TRUE,
+	  "service host1;Service 1 1 1234567890 'WARNING\nsecond line\\n'" },
+	{ "[1234567890] PROCESS_SERVICE_CHECK_RESULT;host1;Service 1;0;OK; all fine;really", TRUE,
+	  "service host1;Service 1 0 1234567890 'OK; all fine;really'" },
+	{ "[1234567890] PROCESS_SERVICE_CHECK_RESULT;host1;Service 1;0;", TRUE,
+	  "service host1;Service 1 0 1234567890 ''" },
+	{ "[1234567890] PROCESS_SERVICE_CHECK_RESULT;host1;Service 1;0", TRUE,
+	  "service host1;Service 1 0 1234567890 ''" },
+	{ "[1234567890] PROCESS_SERVICE_CHECK_RESULT;host1;Service 1;;no return code", TRUE,
+	  "service host1;Service 1 0 1234567890 'no return code'" },
+	{ "[1234567890] PROCESS_SERVICE_CHECK_RESULT;host1;Service 1;7;odd return code", TRUE,
+	  "service host1;Service 1 3 1234567890 'odd return code'" },
+	{ "[1234567890] PROCESS_SERVICE_CHECK_RESULT;10.0.0.1;Service 1;0;by address", TRUE,
+	  "service host1;Service 1 0 1234567890 'by address'" },
+	{ "[1234567890] process_service_check_result;host1;Service 1;0;lower case\r\n", TRUE,
+	  "service host1;Service 1 0 1234567890 'lower case'" },
+	{ "[1234567890] PROCESS_SERVICE_CHECK_RESULT;nohost;Service 1;0;unknown host", TRUE, "" },
+	{ "[1234567890] PROCESS_SERVICE_CHECK_RESULT;host1;No service;0;unknown service", TRUE, "" },
+	{ "[1234567890] PROCESS_HOST_CHECK_RESULT;host1;1;DOWN - no route\\nmore", TRUE,
+	  "host host1 1 1234567890 'DOWN - no route\nmore'" },
+	{ "[1234567890] PROCESS_HOST_CHECK_RESULT;10.0.0.1;0", TRUE,
+	  "host host1 0 1234567890 ''" },
+	{ "[1234567890] PROCESS_HOST_CHECK_RESULT;host1;3;bad return code", TRUE, "" },
+	{ "[1234567890] PROCESS_SERVICE_CHECK_RESULT;host1;Service 1", FALSE, "" },
+	{ "[1234567890] PROCESS_SERVICE_CHECK_RESULT;host1", FALSE, "" },
+	{ "[1234567890] PROCESS_HOST_CHECK_RESULT;host1", FALSE, "" },
+	{ "[1234567890] PROCESS_HOST_CHECK_RESULT;host1;", FALSE, "" },
+	{ "[1234567890] PROCESS_HOST_CHECK_RESULT", FALSE, "" },
+	{ "[1234567890]", FALSE, "" },
+	{ "1234567890 PROCESS_HOST_CHECK_RESULT;host1;0;no brackets", FALSE, "" },
+	{ "[12x] PROCESS_HOST_CHECK_RESULT;host1;0;bad time", FALSE, "host host1 0 12 'bad time'" },
+	{ "[1234567890] ENABLE_NOTIFICATIONS", FALSE, "" },
+	{ NULL, FALSE, NULL }
+	};
+
 int
 main() {
 	time_t now = 0L;
+	char *fast, *slow, buf[1024];
+	int handled, unused, i;
 
-	plan_tests(62);
+	plan_tests(86);
 
 	ok(test_start_time == 0L, "Start time is empty");
 	ok(test_comment == NULL, "And test_comment is blank");
@@ -227,6 +320,34 @@ main() {
 	ok(strcmp(test_comment, "comment") == 0, "comment right") || diag("comment=%s", test_comment);
 
 
+	/* check results must come out the same through the fast path and process_external_command1() */
+	test_host.name = "host1";
+	test_host.address = "10.0.0.1";
+	test_host.accept_passive_checks = TRUE;
+	test_service.host_name = "host1";
+	test_service.description = "Service 1";
+	test_service.accept_passive_checks = TRUE;
+	host_list = &test_host;
+	accept_passive_service_checks = TRUE;
+	accept_passive_host_checks = TRUE;
+
+	for(i = 0; check_results[i].command; i++) {
+		fast = run_check_result(check_results[i].command, TRUE, &handled);
+		slow = run_check_result(check_results[i].command, FALSE, &unused);
+		ok(handled == check_results[i].fast && !strcmp(fast, check_results[i].expected) && !strcmp(slow, check_results[i].expected),
+		   "%s: %s", check_results[i].fast ? "Fast path" : "Not for the fast path", check_results[i].command)
+		|| diag("handled=%d fast=%s slow=%s", handled, fast, slow);
+		free(fast);
+		free(slow);
+		}
+
+	/* broker modules that want external commands get all of them */
+	event_broker_options = BROKER_EXTERNALCOMMAND_DATA;
+	strcpy(buf, check_results[0].command);
+	ok(process_check_result_command(buf) == FALSE && !strcmp(buf, check_results[0].command),
+	   "Fast path skipped when broker modules want external commands");
+	event_broker_options = 0;
+
 	return exit_status();
 	}
 
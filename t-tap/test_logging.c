@@ -39,6 +39,7 @@ unsigned long logging_options       = 0;
 int log_initial_states              = DEFAULT_LOG_INITIAL_STATES;
 char *log_archive_path              = "var";
 int log_current_states              = DEFAULT_LOG_CURRENT_STATES;
+int index_log_file                  = FALSE;
 int log_service_retries             = DEFAULT_LOG_SERVICE_RETRIES;
 int use_large_installation_tweaks   = DEFAULT_USE_LARGE_INSTALLATION_TWEAKS;
 
@@ -351,19 +351,185 @@ void test_escaping(nagios_macros *mac)
     ALLOC_MACROS("$TOTALSERVICESCRITICALUNHANDLED$");
 }
 
+void test_parsing(nagios_macros *mac)
+{
+    char * output = NULL;
+
+    mac->argv[0] = strdup("-w 80%");
+    macro_user[0] = strdup("/usr/lib/nagios/plugins");
+
+    RUN_MACRO_TEST(
+        "$USER1$/check_disk -H $HOSTADDRESS$ $ARG1$ -c $ARG2$",
+        "/usr/lib/nagios/plugins/check_disk -H address'&% -w 80% -c ",
+        NO_OPTIONS);
+
+    /*
+        $$ is a $, and things between $'s that aren't macros are left as
+        they were, even at the end of the string
+    */
+    RUN_MACRO_TEST(
+        "echo $$HOME $NOSUCHMACRO$ $ARG0$ $USER999$ $HOSTNAME",
+        "echo $HOME $NOSUCHMACRO$ $ARG0$ $USER999$ name'&%",
+        NO_OPTIONS);
+
+    RUN_MACRO_TEST("costs $5", "costs $5", NO_OPTIONS);
+    RUN_MACRO_TEST("$", "$", NO_OPTIONS);
+    RUN_MACRO_TEST("", "", NO_OPTIONS);
+
+    /* the same input with other macro values and options */
+    my_free(mac->argv[0]);
+    mac->argv[0] = strdup("-w 90%");
+    RUN_MACRO_TEST(
+        "$USER1$/check_disk -H $HOSTADDRESS$ $ARG1$ -c $ARG2$",
+        "%2Fusr%2Flib%2Fnagios%2Fplugins/check_disk -H address%27%26%25 -w%2090%25 -c ",
+        URL_ENCODE_MACRO_CHARS);
+
+    my_free(mac->argv[0]);
+    my_free(macro_user[0]);
+}
+
+void test_custom_variables(nagios_macros *mac)
+{
+    customvariablesmember *host_var, *svc_var, *own_var, *next;
+    char * output = NULL;
+
+    add_custom_variable_to_host(hst1, "SNMP_COMMUNITY", "public");
+    add_custom_variable_to_host(hst1, "LOCATION", "rack 3");
+    add_custom_variable_to_host(hst1, "LOCATION", "rack 4");
+    add_custom_variable_to_host(hst1, "ADMIN", "bob");
+    add_custom_variable_to_service(svc1, "SNMP_COMMUNITY", "private");
+
+    ok(hst1->custom_variable_index.count == 4 && hst1->custom_variable_index.head == hst1->custom_variables
+       && !strcmp(hst1->custom_variable_index.by_name[0]->variable_name, "ADMIN")
+       && !strcmp(hst1->custom_variable_index.by_name[3]->variable_name, "SNMP_COMMUNITY"),
+       "Host custom variables indexed by name");
+    host_var = find_indexed_custom_variable(hst1->custom_variables, &hst1->custom_variable_index, "LOCATION");
+    ok(host_var && host_var == find_custom_variable(hst1->custom_variables, "LOCATION")
+       && !strcmp(host_var->variable_value, "rack 4"),
+       "Index finds the newest of two variables with the same name, like the list");
+    ok(find_indexed_custom_variable(hst1->custom_variables, &hst1->custom_variable_index, "ADMIN")
+       && find_indexed_custom_variable(hst1->custom_variables, &hst1->custom_variable_index, "AAA") == NULL
+       && find_indexed_custom_variable(hst1->custom_variables, &hst1->custom_variable_index, "ZZZ") == NULL
+       && find_indexed_custom_variable(hst1->custom_variables, &hst1->custom_variable_index, "LOCATIONS") == NULL,
+       "Index lookups of the first variable and of missing ones");
+
+    add_custom_variable_to_object(&hst1->custom_variables, "OWN", "own name");
+    ok(find_indexed_custom_variable(hst1->custom_variables, &hst1->custom_variable_index, "OWN") != NULL,
+       "Variables added behind the index's back are still found");
+
+    host_var = find_custom_variable(hst1->custom_variables, "SNMP_COMMUNITY");
+    svc_var = find_custom_variable(svc1->custom_variables, "SNMP_COMMUNITY");
+    ok(host_var && !strcmp(host_var->variable_value, "public")
+       && svc_var && !strcmp(svc_var->variable_value, "private"),
+       "Custom variables found on the host and on the service");
+    ok(host_var && svc_var && host_var->variable_name == svc_var->variable_name,
+       "Host and service share the name of their custom variable");
+
+    own_var = find_custom_variable(hst1->custom_variables, "OWN");
+    ok(own_var && !strcmp(own_var->variable_value, "own name"),
+       "Custom variable with a name of its own found");
+    ok(find_custom_variable(hst1->custom_variables, "NOPE") == NULL
+       && find_custom_variable(svc1->custom_variables, "LOCATION") == NULL
+       && find_custom_variable(hst1->custom_variables, NULL) == NULL,
+       "Custom variables the object doesn't have aren't found");
+
+    RUN_MACRO_TEST(
+        "$_HOSTSNMP_COMMUNITY$ $_SERVICESNMP_COMMUNITY$ $_HOSTLOCATION$ $_HOSTOWN$ [$_HOSTNOPE$]",
+        "public private rack 4 own name []",
+        NO_OPTIONS);
+
+    /* back to what add_custom_variable_to_host() left, so the index is used */
+    own_var = hst1->custom_variables;
+    hst1->custom_variables = own_var->next;
+    free(own_var->variable_name);
+    free(own_var->variable_value);
+    free(own_var);
+    RUN_MACRO_TEST(
+        "$_HOSTADMIN$ $_HOSTLOCATION$ [$_HOSTOWN$] $_SERVICESNMP_COMMUNITY$",
+        "bob rack 4 [] private",
+        NO_OPTIONS);
+
+    for (host_var = hst1->custom_variables; host_var; host_var = next) {
+        next = host_var->next;
+        free_object_string(host_var->variable_name);
+        free_object_string(host_var->variable_value);
+        free(host_var);
+    }
+    hst1->custom_variables = NULL;
+    my_free(hst1->custom_variable_index.by_name);
+    memset(&hst1->custom_variable_index, 0, sizeof(hst1->custom_variable_index));
+    for (svc_var = svc1->custom_variables; svc_var; svc_var = next) {
+        next = svc_var->next;
+        free_object_string(svc_var->variable_name);
+        free_object_string(svc_var->variable_value);
+        free(svc_var);
+    }
+    svc1->custom_variables = NULL;
+    my_free(svc1->custom_variable_index.by_name);
+    memset(&svc1->custom_variable_index, 0, sizeof(svc1->custom_variable_index));
+}
+
+/*
+    Not a test, but a way to see how fast commands are expanded:
+    ./test_macros bench
+*/
+void bench_macros(nagios_macros *mac)
+{
+    const char *commands[] = {
+        "$USER1$/check_ping -H $HOSTADDRESS$ -w 3000.0,80% -c 5000.0,100% -p 5",
+        "$USER1$/check_http -I $HOSTADDRESS$ $ARG1$",
+        "$USER1$/check_disk -w $ARG1$ -c $ARG2$ -p $ARG3$",
+        "/usr/bin/printf \"%b\" \"***** Nagios *****\\n\\nNotification Type: $NOTIFICATIONTYPE$\\n\\nService: $SERVICEDESC$\\nHost: $HOSTALIAS$\\nAddress: $HOSTADDRESS$\\nState: $SERVICESTATE$\\n\\nDate/Time: $LONGDATETIME$\\n\\nAdditional Info:\\n\\n$SERVICEOUTPUT$\\n\" | /usr/bin/mail -s \"** $NOTIFICATIONTYPE$ Service Alert: $HOSTALIAS$/$SERVICEDESC$ is $SERVICESTATE$ **\" $CONTACTEMAIL$",
+        "/usr/bin/printf \"%b\" \"$LASTSERVICECHECK$\\t$HOSTNAME$\\t$SERVICEDESC$\\t$SERVICESTATE$\\t$SERVICEATTEMPT$\\t$SERVICESTATETYPE$\\t$SERVICEEXECUTIONTIME$\\t$SERVICELATENCY$\\t$SERVICEOUTPUT$\\t$SERVICEPERFDATA$\\n\" >> /var/nagios/service-perfdata.out",
+        NULL,
+    };
+    struct timeval start, stop;
+    char *output = NULL;
+    double elapsed;
+    int i, n = 0;
+
+    mac->argv[0] = strdup("-w 80%");
+    mac->argv[1] = strdup("-c 90%");
+    mac->argv[2] = strdup("/var");
+    macro_user[0] = strdup("/usr/lib/nagios/plugins");
+
+    gettimeofday(&start, NULL);
+    do {
+        for (i = 0; i < 10000; i++, n++) {
+            process_macros_r(mac, (char *)commands[n % 5], &output, STRIP_ILLEGAL_MACRO_CHARS | ESCAPE_MACRO_CHARS);
+            my_free(output);
+        }
+        gettimeofday(&stop, NULL);
+        elapsed = tv_delta_f(&start, &stop);
+    } while (elapsed < 2.0);
+
+    printf("%d expansions in %.3fs, %.0f/s\n", n, elapsed, n / elapsed);
+
+    for (i = 0; i < 3; i++)
+        my_free(mac->argv[i]);
+    my_free(macro_user[0]);
+}
+
 /*****************************************************************************/
 /*                             Main function                                 */
 /*****************************************************************************/
 
-int main(void) {
-
-    plan_tests(23);
+int main(int argc, char **argv) {
 
     reset_variables();
     setup_environment();
     setup_objects();
 
+    if (argc > 1 && !strcmp(argv[1], "bench")) {
+        bench_macros(mac);
+        return 0;
+    }
+
+    plan_tests(39);
+
     test_escaping(mac);
+    test_parsing(mac);
+    test_custom_variables(mac);
 
     free_memory(mac);
     free(mac);
@@ -372,6 +538,7 @@ int main(void) {
     free_svc1();
     free_hst1();
     free(lock_file);
+    free_object_data();
 
     return exit_status();
 }
@@ -41,6 +41,11 @@
 #include "../include/broker.h"
 #include "../include/nebmods.h"
 #include "../include/nebmodules.h"
+#include "../include/snapshot.h"
+#include "../xdata/xodbinary.h"
+#include "../xdata/xsddefault.h"
+#include "../xdata/xsdbinary.h"
+#include <stddef.h>
 
 #include "tap.h"
 #include "stub_perfdata.c"
@@ -52,11 +57,137 @@
 #include "stub_nebmods.c"
 #include "stub_netutils.c"
 #include "stub_broker.c"
-#include "stub_statusdata.c"
 #include "stub_flapping.c"
 #include "stub_notifications.c"
 
+struct external_command_stats external_command_stats;
+struct wproc_result_stats wproc_result_stats;
+struct check_storm_stats check_storm_stats;
+struct loop_stats loop_stats;
+unsigned int summarize_loop_stats(struct loop_stats_summary *summary) {
+	return 0;
+	}
+int write_state_in_background(int what, int wait) {
+	return OK;
+	}
+void stop_state_writer(void) {
+	}
+
 int xrddefault_read_state_information(void);
+int xrddefault_save_state_information(const struct state_snapshot *);
+int xrdbinary_save_state_information(const struct state_snapshot *);
+int xrdbinary_read_state_information(void);
+
+/* compares two files, ignoring the lines starting with 'ignore' */
+static int same_file_data(const char *a, const char *b, const char *ignore) {
+	char abuf[8192], bbuf[8192];
+	FILE *fa, *fb;
+	int result = TRUE;
+
+	if(!(fa = fopen(a, "r")) || !(fb = fopen(b, "r"))) {
+		if(fa)
+			fclose(fa);
+		return FALSE;
+		}
+	for(;;) {
+		char *ra = fgets(abuf, sizeof(abuf), fa), *rb = fgets(bbuf, sizeof(bbuf), fb);
+		if(!ra || !rb) {
+			result = (ra == rb);
+			break;
+			}
+		if(!strncmp(abuf, ignore, strlen(ignore)) && !strncmp(bbuf, ignore, strlen(ignore)))
+			continue;
+		if(strcmp(abuf, bbuf)) {
+			diag("'%s' != '%s'", abuf, bbuf);
+			result = FALSE;
+			break;
+			}
+		}
+	fclose(fa);
+	fclose(fb);
+	return result;
+	}
+
+/* compares the host and service records in two status files, ignoring when they were written */
+static int same_status_objects(const char *a, const char *b) {
+	char abuf[8192], bbuf[8192];
+	FILE *fa, *fb;
+	int result = TRUE;
+
+	if(!(fa = fopen(a, "r")) || !(fb = fopen(b, "r"))) {
+		if(fa)
+			fclose(fa);
+		return FALSE;
+		}
+	while(fgets(abuf, sizeof(abuf), fa) && strcmp(abuf, "hoststatus {\n"))
+		;
+	while(fgets(bbuf, sizeof(bbuf), fb) && strcmp(bbuf, "hoststatus {\n"))
+		;
+	for(;;) {
+		char *ra = fgets(abuf, sizeof(abuf), fa), *rb = fgets(bbuf, sizeof(bbuf), fb);
+		if(!ra || !rb) {
+			result = (ra == rb);
+			break;
+			}
+		if(!strncmp(abuf, "\tlast_update=", 13) && !strncmp(bbuf, "\tlast_update=", 13))
+			continue;
+		if(strcmp(abuf, bbuf)) {
+			diag("'%s' != '%s'", abuf, bbuf);
+			result = FALSE;
+			break;
+			}
+		}
+	fclose(fa);
+	fclose(fb);
+	return result;
+	}
+
+
+/* the retention writers work on a snapshot of the current state */
+static int save_retention_data(int (*writer)(const struct state_snapshot *)) {
+	struct state_snapshot *snap = take_state_snapshot(STATE_WRITE_RETENTION, TRUE);
+	int result = snap ? writer(snap) : ERROR;
+
+	free_state_snapshot(snap);
+	return result;
+	}
+
+/* makes it look like nothing was read from the retention file yet */
+static void forget_state(host *hst, service *svc) {
+	hst->current_state = 0;
+	my_free(hst->plugin_output);
+	hst->modified_attributes = 0;
+	svc->state_type = HARD_STATE;
+	svc->current_attempt = 1;
+	svc->modified_attributes = 0;
+	free_comment_data();
+	free_downtime_data();
+	initialize_downtime_data();
+	}
+
+/* loads the first 'len' bytes of a snapshot, with 'size' bytes of 'val' written over it at 'off' */
+static int read_damaged_snapshot(const char *snapshot, size_t len, size_t off, const void *val, size_t size) {
+	char *buf;
+	size_t written;
+	FILE *fp;
+	int result = ERROR;
+
+	if(!(buf = malloc(len)))
+		return ERROR;
+	memcpy(buf, snapshot, len);
+	if(val)
+		memcpy(buf + off, val, size);
+	if((fp = fopen("var/objects.damaged", "w"))) {
+		written = fwrite(buf, 1, len, fp);
+		if(!fclose(fp) && written == len)
+			result = xodbinary_read_object_config("var/objects.damaged", 0);
+		}
+	free(buf);
+	free_object_data();
+	unlink("var/objects.damaged");
+
+	return result;
+	}
 
 int main(int argc, char **argv) {
 	int result;
@@ -69,14 +200,28 @@ int main(int argc, char **argv) {
 	time_t now;
 	char datestring[256];
 	host *temp_host = NULL;
+	service *temp_service = NULL;
+	service *other_service = NULL;
+	struct object_string_stats oss, before;
+	char *shared, long_string[20000];
 	hostgroup *temp_hostgroup = NULL;
 	hostsmember *temp_member = NULL;
+	struct state_snapshot *snap;
+	struct xodb_header hdr;
+	uint64_t span[2];
+	uint32_t word;
+	char *snapshot = NULL;
+	size_t len = 0;
+	FILE *fp;
 
-	plan_tests(14);
+	plan_tests(61);
 
 	/* reset program variables */
 	reset_variables();
 
+	/* remember the config files, so a binary precache can be written */
+	precache_objects = TRUE;
+
 	printf("Reading configuration data...\n");
 
 	config_file = strdup("smallconfig/nagios.cfg");
@@ -90,6 +235,31 @@ int main(int argc, char **argv) {
 	result = pre_flight_check();
 	ok(result == OK, "Preflight check okay");
 
+	/* strings the objects have in common are stored once */
+	get_object_string_stats(&oss);
+	ok(oss.unique > 0 && oss.unique < oss.strings && oss.bytes > 0 && oss.size > 0, "Object strings are shared");
+	temp_service = find_service("host1", "Dummy service");
+	other_service = find_service("host1", "Dummy service2");
+	ok(temp_service->check_period == other_service->check_period && temp_service->check_command == other_service->check_command,
+	   "Services share their check period and command");
+	buffer = strdup("Dummy service");
+	shared = intern_object_string(buffer);
+	get_object_string_stats(&before);
+	ok(shared == temp_service->description && intern_object_string(buffer) == shared && intern_object_string(NULL) == NULL,
+	   "Interning a string returns its shared copy");
+	get_object_string_stats(&oss);
+	ok(oss.strings == before.strings + 1 && oss.unique == before.unique && oss.size == before.size,
+	   "Interning a string again stores nothing");
+	memset(long_string, 'x', sizeof(long_string) - 1);
+	long_string[sizeof(long_string) - 1] = 0;
+	shared = intern_object_string(long_string);
+	get_object_string_stats(&oss);
+	ok(shared && shared != long_string && !strcmp(shared, long_string) && oss.unique == before.unique + 1
+	   && oss.size >= before.size + sizeof(long_string), "Strings longer than a slab are stored on their own");
+	free_object_string(temp_service->description);
+	free_object_string(buffer);
+	ok(!strcmp(temp_service->description, "Dummy service"), "Shared copies are not freed");
+
 	initialize_downtime_data();
 
 	for(temp_hostgroup = hostgroup_list; temp_hostgroup != NULL; temp_hostgroup = temp_hostgroup->next) {
@@ -108,6 +278,11 @@ int main(int argc, char **argv) {
 		//printf("host pointer=%d\n", temp_member->host_ptr);
 		}
 
+	temp_host = find_host("hostveryrecent");
+	ok(temp_host->initial_state == HOST_DOWN && temp_host->current_state == HOST_DOWN, "Host initial_state is kept");
+	temp_service = find_service("host1", "Dummy service2");
+	ok(temp_service->initial_state == STATE_WARNING && temp_service->current_state == STATE_WARNING, "Service initial_state is kept");
+
 	temp_host = find_host("host1");
 	ok(temp_host->current_state == 0, "State is assumed OK on initial load");
 
@@ -125,6 +300,184 @@ int main(int argc, char **argv) {
 	ok(find_service_downtime(1110) != NULL, "Found service downtime 1110");
 	ok(find_host_downtime(1234567888) == NULL, "No such host downtime");
 
+	/* reading the binary retention file must have the same effect as reading the text one */
+	my_free(retention_file);
+	retention_file = strdup("var/retention.text");
+	binary_retention_file = strdup("var/retention.bin");
+	my_free(temp_file);
+	temp_file = strdup("var/nagios.tmp");
+	unlink(binary_retention_file);
+	/* a soft problem whose max_attempts was changed at runtime */
+	temp_service->has_been_checked = TRUE;
+	temp_service->current_state = STATE_CRITICAL;
+	temp_service->state_type = SOFT_STATE;
+	temp_service->current_attempt = 2;
+	temp_service->max_attempts = 5;
+	temp_service->modified_attributes |= MODATTR_MAX_CHECK_ATTEMPTS;
+	ok(save_retention_data(xrddefault_save_state_information) == OK, "Saving text retention data");
+	ok(save_retention_data(xrdbinary_save_state_information) == OK, "Saving binary retention data");
+	forget_state(temp_host, temp_service);
+	ok(find_host_comment(418) == NULL, "Comments are gone");
+	my_free(retention_file);
+	retention_file = strdup("var/retention.from-bin");
+	unlink(retention_file);
+	ok(xrdbinary_read_state_information() == OK, "Reading binary retention data");
+	ok(temp_host->current_state == 1, "State restored from binary retention data");
+	ok(temp_service->state_type == SOFT_STATE && temp_service->current_attempt == 5,
+	   "Soft state attempts adjusted to a retained max_attempts as by the text reader");
+	ok(find_host_comment(418) != NULL && find_service_downtime(1110) != NULL, "Comments and downtimes restored from binary retention data");
+	ok(save_retention_data(xrddefault_save_state_information) == OK, "Saving state read from binary retention data");
+	forget_state(temp_host, temp_service);
+	my_free(retention_file);
+	retention_file = strdup("var/retention.text");
+	xrddefault_read_state_information();
+	my_free(retention_file);
+	retention_file = strdup("var/retention.from-text");
+	save_retention_data(xrddefault_save_state_information);
+	ok(same_file_data("var/retention.from-bin", "var/retention.from-text", "created=") == TRUE, "Binary retention data round-trips");
+
+	/* a text retention file written after the binary one wins */
+	sleep(1);
+	ok(save_retention_data(xrddefault_save_state_information) == OK && xrdbinary_read_state_information() == ERROR,
+	   "Newer text retention file is preferred");
+
+	/* the attribute masks keep retained attributes out, each for its own objects */
+	retained_host_attribute_mask = MODATTR_MAX_CHECK_ATTEMPTS;
+	forget_state(temp_host, temp_service);
+	xrddefault_read_state_information();
+	ok(temp_service->modified_attributes & MODATTR_MAX_CHECK_ATTEMPTS, "Host attribute mask leaves services alone");
+	retained_host_attribute_mask = 0L;
+	retained_service_attribute_mask = MODATTR_MAX_CHECK_ATTEMPTS;
+	forget_state(temp_host, temp_service);
+	temp_service->max_attempts = 1;
+	xrddefault_read_state_information();
+	ok(!(temp_service->modified_attributes & MODATTR_MAX_CHECK_ATTEMPTS) && temp_service->max_attempts == 1,
+	   "Service attribute mask keeps the retained max_attempts out");
+	retained_service_attribute_mask = 0L;
+	unlink("var/retention.text");
+	unlink("var/retention.from-bin");
+	unlink("var/retention.from-text");
+	unlink(binary_retention_file);
+
+	/* what's in a snapshot stays put while the objects change */
+	my_free(temp_host->plugin_output);
+	temp_host->plugin_output = strdup("Before the snapshot");
+	nagios_pid = (int)getpid();
+	program_start = time(NULL);
+	snap = take_state_snapshot(STATE_WRITE_STATUS | STATE_WRITE_RETENTION, TRUE);
+	my_free(temp_host->plugin_output);
+	temp_host->plugin_output = strdup("After the snapshot");
+	ok(snap && !strcmp(snap->hosts[temp_host->id].plugin_output, "Before the snapshot"), "Snapshots are independent of the objects");
+
+	/* test_xsdbinary reads these back and compares them */
+	my_free(status_file);
+	status_file = strdup("var/status.text");
+	binary_status_file = strdup("var/status.bin");
+	ok(snap && xsddefault_save_status_data(snap) == OK && xsdbinary_save_status_data(snap) == OK,
+	   "Writing text and binary status data");
+	xsdbinary_cleanup_status_data(FALSE);
+	free_state_snapshot(snap);
+
+	/* only the hosts and services that changed are written again */
+	my_free(temp_host->plugin_output);
+	temp_host->plugin_output = strdup("Before the snapshot");
+	reset_status_changes();
+	ok(host_status_is_dirty(temp_host) == FALSE && service_status_is_dirty(temp_service) == FALSE
+	   && status_data_needs_full_update() == FALSE, "Nothing changed since the status file was written");
+	my_free(temp_service->plugin_output);
+	temp_service->plugin_output = strdup("Changed since the last update");
+	update_service_status(temp_service, FALSE);
+	ok(service_status_is_dirty(temp_service) == TRUE && host_status_is_dirty(temp_host) == FALSE,
+	   "Updating a service marks only that service changed");
+	snap = take_state_snapshot(STATE_WRITE_STATUS, FALSE);
+	ok(snap && snap->num_hosts == 0 && snap->num_services == 1, "Status snapshot leaves out what didn't change");
+	my_free(status_file);
+	status_file = strdup("var/status.incremental");
+	ok(snap && xsddefault_save_status_data(snap) == OK && status_update_stats.objects_written == 1
+	   && status_update_stats.objects_skipped == num_objects.hosts + num_objects.services - 1,
+	   "Unchanged hosts and services copied from the previous status file");
+	free_state_snapshot(snap);
+	xsddefault_cleanup_status_data(FALSE);
+	ok(xsddefault_needs_full_update() == TRUE, "Everything written again after the status file was cleaned up");
+	status_file = strdup("var/status.full");
+	snap = take_state_snapshot(STATE_WRITE_STATUS, TRUE);
+	ok(snap && xsddefault_save_status_data(snap) == OK && status_update_stats.objects_skipped == 0
+	   && same_status_objects("var/status.incremental", "var/status.full") == TRUE,
+	   "Copied status records are the same as freshly written ones");
+	free_state_snapshot(snap);
+	xsddefault_cleanup_status_data(FALSE);
+	unlink("var/status.incremental");
+	unlink("var/status.full");
+
+	/* without change tracking, everything counts as changed */
+	cleanup_status_data(FALSE);
+	ok(host_status_is_dirty(temp_host) == TRUE && service_status_is_dirty(temp_service) == TRUE
+	   && status_data_needs_full_update() == TRUE, "Everything changed after the status data was cleaned up");
+
+	/* a binary object precache must load the same objects as the config files */
+	free_comment_data();
+	free_downtime_data();
+	my_free(object_precache_file);
+	object_precache_file = strdup("var/objects.bin");
+	ok(fcache_objects("var/objects.from-config") == OK && xodbinary_write_object_config(object_precache_file) == OK,
+	   "Writing text and binary object precache");
+	ok(xodbinary_is_snapshot(object_precache_file) == TRUE && xodbinary_is_snapshot("var/objects.from-config") == FALSE,
+	   "Binary object precache is told from the text one");
+	free_object_data();
+	get_object_string_stats(&oss);
+	ok(oss.strings == 0 && oss.unique == 0 && oss.size == 0, "Object strings are freed with the objects");
+	use_precached_objects = TRUE;
+	ok(read_all_object_data(config_file) == OK, "Reading binary object precache");
+	ok(fcache_objects("var/objects.from-snapshot") == OK
+	   && same_file_data("var/objects.from-config", "var/objects.from-snapshot", "# Created:") == TRUE,
+	   "Binary object precache round-trips");
+	free_object_data();
+	unlink("var/objects.from-config");
+	unlink("var/objects.from-snapshot");
+
+	/* damaged ones must be turned down without reading past what they say is there */
+	if((fp = fopen(object_precache_file, "r"))) {
+		fseek(fp, 0, SEEK_END);
+		len = ftell(fp);
+		rewind(fp);
+		if((snapshot = malloc(len)) && fread(snapshot, 1, len, fp) != len)
+			len = 0;
+		fclose(fp);
+		}
+	ok(snapshot && len > sizeof(hdr), "Read back binary object precache");
+	if(!snapshot || len <= sizeof(hdr))
+		return exit_status();
+	memcpy(&hdr, snapshot, sizeof(hdr));
+	ok(read_damaged_snapshot(snapshot, len, 0, NULL, 0) == OK, "Undamaged copy of the object precache loads");
+	ok(read_damaged_snapshot(snapshot, sizeof(hdr) / 2, 0, NULL, 0) == ERROR, "Object precache cut off in the header is rejected");
+	ok(read_damaged_snapshot(snapshot, len - 1, 0, NULL, 0) == ERROR, "Truncated object precache is rejected");
+	ok(read_damaged_snapshot(snapshot, len, 0, "NAGOBJPX", 8) == ERROR, "Object precache with bad magic is rejected");
+	word = XODBINARY_VERSION + 1;
+	ok(read_damaged_snapshot(snapshot, len, offsetof(struct xodb_header, version), &word, sizeof(word)) == ERROR,
+	   "Object precache from another version is rejected");
+	word = 0x04030201;
+	ok(read_damaged_snapshot(snapshot, len, offsetof(struct xodb_header, byte_order), &word, sizeof(word)) == ERROR,
+	   "Object precache with another byte order is rejected");
+	span[0] = hdr.records_size - sizeof(uint32_t);
+	ok(read_damaged_snapshot(snapshot, len, offsetof(struct xodb_header, records_size), span, sizeof(span[0])) == ERROR,
+	   "Object precache with records cut short is rejected");
+	/* offsets and sizes that only add up by wrapping around */
+	span[0] = (uint64_t)1 << 63;
+	span[1] = hdr.records_offset + hdr.records_size - span[0];
+	ok(read_damaged_snapshot(snapshot, len, offsetof(struct xodb_header, records_offset), span, sizeof(span)) == ERROR,
+	   "Object precache with records past the end is rejected");
+	span[1] = hdr.file_size - span[0];
+	ok(read_damaged_snapshot(snapshot, len, offsetof(struct xodb_header, strings_offset), span, sizeof(span)) == ERROR,
+	   "Object precache with strings past the end is rejected");
+	ok(read_damaged_snapshot(snapshot, len, len - 1, "x", 1) == ERROR, "Object precache with unterminated strings is rejected");
+	word = ~(uint32_t)0;
+	ok(read_damaged_snapshot(snapshot, len, hdr.records_offset, &word, sizeof(word)) == ERROR,
+	   "Object precache with garbage records is rejected");
+	free(snapshot);
+
+	ok(read_all_object_data(config_file) == OK && find_host("host1") != NULL, "Object precache still loads");
+	unlink(object_precache_file);
+
 	cleanup();
 
 	my_free(config_file);
@@ -0,0 +1,278 @@
+/*****************************************************************************
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+*****************************************************************************/
+
+#define NSCORE 1
+
+#include "config.h"
+#include "common.h"
+#include "nagios.h"
+#include "objects.h"
+#include "../lib/libnagios.h"
+#include <signal.h>
+
+#include "stub_logging.c"
+#include "stub_events.c"
+
+#include "tap.h"
+
+#define QH_SOCKET "var/qh.sock"
+
+iobroker_set *nagios_iobs = NULL;
+int debug_level = 0;
+int debug_verbosity = 0;
+struct load_control loadctl;
+
+int set_loadctl_options(char *opts, unsigned int len)
+{ return OK; }
+int dump_loop_stats(int sd, const char *name)
+{ return 0; }
+void reset_loop_stats(void)
+{ }
+
+int init_check_result(check_result *cr)
+{
+	memset(cr, 0, sizeof(*cr));
+	cr->object_check_type = HOST_CHECK;
+	return OK;
+}
+
+/* the check results that reached the core, one per line */
+char received[4096];
+int received_results;
+
+int process_check_result(check_result *cr)
+{
+	size_t len = strlen(received);
+
+	received_results++;
+	snprintf(received + len, sizeof(received) - len, "%s %s;%s %d %lu.%lu %s\n",
+		cr->object_check_type == SERVICE_CHECK ? "service" : "host",
+		cr->host_name, cr->service_description ? cr->service_description : "",
+		cr->return_code, (unsigned long)cr->start_time.tv_sec,
+		(unsigned long)cr->start_time.tv_usec, cr->output);
+	return strcmp(cr->host_name, "unknown") ? OK : ERROR;
+}
+
+static void reset_received(void)
+{
+	received[0] = 0;
+	received_results = 0;
+}
+
+/* lets the core handle whatever has arrived */
+static void run_core(void)
+{
+	int i;
+
+	for (i = 0; i < 5; i++)
+		iobroker_poll(nagios_iobs, 10);
+}
+
+static int qh_connect(const char *query)
+{
+	int sd;
+
+	if ((sd = nsock_unix(QH_SOCKET, NSOCK_TCP | NSOCK_CONNECT)) < 0)
+		return -1;
+	if (write(sd, query, strlen(query) + 1) < 0) {
+		close(sd);
+		return -1;
+	}
+	run_core();
+	return sd;
+}
+
+static char *qh_reply(int sd)
+{
+	static char buf[1024];
+	ssize_t len;
+
+	len = read(sd, buf, sizeof(buf) - 1);
+	buf[len > 0 ? len : 0] = 0;
+	return buf;
+}
+
+/* what a client sends for the given key/value pairs, as workers send it */
+static char *message(int *len, ...)
+{
+	static char buf[4096];
+	struct kvvec *kvv = kvvec_create(8);
+	const char *key, *value;
+	int sv[2];
+	va_list ap;
+
+	va_start(ap, len);
+	while ((key = va_arg(ap, const char *))) {
+		value = va_arg(ap, const char *);
+		kvvec_addkv(kvv, key, value);
+	}
+	va_end(ap);
+
+	socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+	worker_send_kvvec(sv[0], kvv);
+	*len = read(sv[1], buf, sizeof(buf));
+	close(sv[0]);
+	close(sv[1]);
+	kvvec_destroy(kvv, 0);
+	return buf;
+}
+
+static int send_bytes(int sd, const char *buf, int len)
+{
+	return write(sd, buf, len) == len;
+}
+
+static void passive_stats(unsigned int *clients, unsigned long *results, unsigned long *rejected)
+{
+	int sd = qh_connect("#passive stats");
+	char *reply = qh_reply(sd);
+
+	*clients = *results = *rejected = 0;
+	sscanf(reply, "clients=%u;results=%lu;rejected=%lu", clients, results, rejected);
+	close(sd);
+}
+
+int main(int argc, char **argv)
+{
+	char *msg, two[8192], big[65536];
+	unsigned long results, rejected;
+	unsigned int clients;
+	int sd, sd2, len, len2, i;
+
+	plan_tests(20);
+
+	signal(SIGPIPE, SIG_IGN);
+	nagios_iobs = iobroker_create();
+	ok(qh_init(QH_SOCKET) == OK, "Query handler listening");
+
+	sd = qh_connect("#passive nonsense");
+	ok(!strncmp(qh_reply(sd), "404", 3), "Unknown passive query gets a 404");
+	close(sd);
+
+	sd = qh_connect("@passive submit");
+	ok(!strcmp(qh_reply(sd), "OK"), "Connection switched to streaming check results");
+
+	/* a valid result */
+	reset_received();
+	msg = message(&len, "host_name", "host1", "service_description", "Disk", "return_code", "2",
+		"output", "CRITICAL - disk full", "start_time", "1400000000.25", NULL);
+	send_bytes(sd, msg, len);
+	run_core();
+	ok(!strcmp(received, "service host1;Disk 2 1400000000.25 CRITICAL - disk full\n"), "Service result passed on") || diag("%s", received);
+
+	/* several results in one message, and several messages in one read */
+	reset_received();
+	msg = message(&len, "host_name", "host1", "return_code", "1", "output", "DOWN", "start_time", "1400000001",
+		"host_name", "host2", "service_description", "Load", "return_code", "0", "output", "OK - load fine",
+		"start_time", "1400000002", NULL);
+	memcpy(two, msg, len);
+	msg = message(&len2, "host_name", "host3", "return_code", "0", "output", "UP", "start_time", "1400000003", NULL);
+	memcpy(two + len, msg, len2);
+	send_bytes(sd, two, len + len2);
+	run_core();
+	ok(!strcmp(received, "host host1; 1 1400000001.0 DOWN\nservice host2;Load 0 1400000002.0 OK - load fine\nhost host3; 0 1400000003.0 UP\n"),
+		"Every result in every message passed on in order") || diag("%s", received);
+
+	/* messages split across reads */
+	reset_received();
+	msg = message(&len, "host_name", "host1", "service_description", "Split", "return_code", "0", "output", "OK", "start_time", "1400000004", NULL);
+	send_bytes(sd, msg, len / 2);
+	run_core();
+	ok(received_results == 0, "Nothing passed on from half a message");
+	send_bytes(sd, msg + len / 2, len - len / 2);
+	run_core();
+	ok(!strcmp(received, "service host1;Split 0 1400000004.0 OK\n"), "Result passed on once the rest arrived") || diag("%s", received);
+
+	reset_received();
+	send_bytes(sd, msg, len - 2);
+	run_core();
+	ok(received_results == 0, "Nothing passed on from a message without all of its delimiter");
+	send_bytes(sd, msg + len - 2, 2);
+	run_core();
+	ok(received_results == 1, "Result passed on once the delimiter was complete");
+
+	for (i = 0; i < len; i++) {
+		send_bytes(sd, msg + i, 1);
+		run_core();
+	}
+	ok(received_results == 2, "Result passed on when sent one byte at a time");
+
+	/* malformed results */
+	passive_stats(&clients, &results, &rejected);
+	ok(clients == 1 && results == 7 && rejected == 0, "Stats count the client and the results") || diag("clients=%u results=%lu rejected=%lu", clients, results, rejected);
+
+	reset_received();
+	msg = message(&len, "host_name", "host1", "return_code", "0", NULL);
+	send_bytes(sd, msg, len);
+	run_core();
+	ok(received_results == 0, "Result without output not passed on");
+
+	msg = message(&len, "host_name", "host1", "return_code", "3", "output", "no such host state", NULL);
+	send_bytes(sd, msg, len);
+	run_core();
+	ok(received_results == 0, "Host result with a bad return code not passed on");
+
+	msg = message(&len, "host_name", "unknown", "return_code", "0", "output", "OK", NULL);
+	send_bytes(sd, msg, len);
+	run_core();
+	ok(received_results == 1, "Result for an unknown host passed on, and rejected there");
+
+	reset_received();
+	send_bytes(sd, "garbage\1\0\0\0", 11);
+	run_core();
+	ok(received_results == 0, "Message without any key/value pairs not passed on");
+
+	msg = message(&len, "output", "before any host", "host_name", "host1", "service_description", "Odd", "return_code", "9",
+		"output", "odd return code", "mystery", "value", "start_time", "1400000005", NULL);
+	send_bytes(sd, msg, len);
+	run_core();
+	ok(!strcmp(received, "service host1;Odd 3 1400000005.0 odd return code\n"),
+		"Keys before the host and unknown keys ignored, bad service return code is UNKNOWN") || diag("%s", received);
+
+	passive_stats(&clients, &results, &rejected);
+	ok(results == 8 && rejected == 4, "Stats count the rejected results") || diag("results=%lu rejected=%lu", results, rejected);
+
+	/* clients that go away, and clients that never send a delimiter */
+	close(sd);
+	run_core();
+	passive_stats(&clients, &results, &rejected);
+	ok(clients == 0, "Client gone once it disconnected");
+
+	sd2 = qh_connect("@passive submit");
+	qh_reply(sd2);
+	memset(big, 'x', sizeof(big));
+	for (i = 0; i < 100; i++) {
+		if (!send_bytes(sd2, big, sizeof(big)))
+			break;
+		run_core();
+	}
+	passive_stats(&clients, &results, &rejected);
+	ok(clients == 0 && i < 100, "Client dropped after sending too much without a delimiter") || diag("clients=%u after %d writes", clients, i);
+	close(sd2);
+
+	reset_received();
+	sd = qh_connect("@passive submit");
+	msg = message(&len, "host_name", "host1", "return_code", "0", "output", "UP", NULL);
+	send_bytes(sd, msg, len);
+	run_core();
+	ok(!strcmp(qh_reply(sd), "OK") && received_results == 1, "New clients still welcome");
+	close(sd);
+
+	qh_deinit(QH_SOCKET);
+	return exit_status();
+}
@@ -72,6 +72,68 @@ int handle_async_service_check_result(service *temp_service, check_result *queue
 int handle_async_host_check_result(host *temp_host, check_result *queued_check_result) { return 0; }
 
 void _get_next_valid_time(time_t pref_time, time_t *valid_time, timeperiod *tperiod);
+void _get_next_invalid_time(time_t pref_time, time_t *invalid_time, timeperiod *tperiod);
+
+/*
+ * Timeperiods remember the time ranges of the last few days they were
+ * asked about, and their last next valid and invalid times. Ask every
+ * timeperiod about random times in 2009-2011, first with an empty
+ * cache before each question and then letting the cache fill up, and
+ * count the answers that differ. The times come in clusters of a few
+ * days, so some answers come from the cache and cache slots get
+ * reused. Every other cluster creeps forward a bit at a time, the way
+ * the scheduler asks.
+ */
+#define CACHE_TEST_TIMES 240
+static int compare_cached_timeperiods(void) {
+	time_t times[CACHE_TEST_TIMES], valid[CACHE_TEST_TIMES], invalid[CACHE_TEST_TIMES];
+	time_t base = 0, next_valid, next_invalid;
+	int check[CACHE_TEST_TIMES];
+	timeperiod *temp_timeperiod;
+	int i, differ = 0;
+
+	for(i = 0; i < CACHE_TEST_TIMES; i++) {
+		if(i % 8 == 0)
+			base = 1230768000 + random() % (3 * 365 * 86400);
+		if((i / 8) % 2)
+			times[i] = base += random() % 7200;
+		else
+			times[i] = base + random() % (4 * 86400) - 2 * 86400;
+		}
+
+	for(temp_timeperiod = timeperiod_list; temp_timeperiod != NULL; temp_timeperiod = temp_timeperiod->next) {
+		for(i = 0; i < CACHE_TEST_TIMES; i++) {
+			clear_timeperiod_cache();
+			check[i] = check_time_against_period(times[i], temp_timeperiod);
+			clear_timeperiod_cache();
+			_get_next_valid_time(times[i], &valid[i], temp_timeperiod);
+			clear_timeperiod_cache();
+			_get_next_invalid_time(times[i], &invalid[i], temp_timeperiod);
+			}
+
+		clear_timeperiod_cache();
+		for(i = 0; i < CACHE_TEST_TIMES; i++) {
+			if(check_time_against_period(times[i], temp_timeperiod) != check[i]) {
+				diag("%s: check of %lu differs with the cache", temp_timeperiod->name, (unsigned long)times[i]);
+				differ++;
+				}
+			_get_next_valid_time(times[i], &next_valid, temp_timeperiod);
+			if(next_valid != valid[i]) {
+				diag("%s: next valid time after %lu is %lu with the cache, %lu without", temp_timeperiod->name,
+				     (unsigned long)times[i], (unsigned long)next_valid, (unsigned long)valid[i]);
+				differ++;
+				}
+			_get_next_invalid_time(times[i], &next_invalid, temp_timeperiod);
+			if(next_invalid != invalid[i]) {
+				diag("%s: next invalid time after %lu is %lu with the cache, %lu without", temp_timeperiod->name,
+				     (unsigned long)times[i], (unsigned long)next_invalid, (unsigned long)invalid[i]);
+				differ++;
+				}
+			}
+		}
+
+	return differ;
+	}
 
 int main(int argc, char **argv) {
 	int result;
@@ -84,8 +146,10 @@ int main(int argc, char **argv) {
 	timeperiod *temp_timeperiod = NULL;
 	int is_valid_time = 0;
 	int iterations = 1000;
+	const char *cache_test_zones[] = { "TZ=UTC", "TZ=Europe/London", "TZ=America/New_York",
+	                                   "TZ=Australia/Sydney", "TZ=Asia/Kolkata", NULL };
 
-	plan_tests(6046);
+	plan_tests(6051);
 
 	/* reset program variables */
 	reset_variables();
@@ -131,6 +195,7 @@ int main(int argc, char **argv) {
 
 	putenv("TZ=UTC");
 	tzset();
+	clear_timeperiod_cache();
 	test_time = saved_test_time;
 	c = 0;
 	while(c < iterations) {
@@ -145,6 +210,7 @@ int main(int argc, char **argv) {
 
 	putenv("TZ=Europe/London");
 	tzset();
+	clear_timeperiod_cache();
 	test_time = saved_test_time;
 	c = 0;
 	while(c < iterations) {
@@ -163,6 +229,7 @@ int main(int argc, char **argv) {
 
 	putenv("TZ=America/New_York");
 	tzset();
+	clear_timeperiod_cache();
 	test_time = saved_test_time;
 	c = 0;
 	while(c < iterations) {
@@ -181,6 +248,7 @@ int main(int argc, char **argv) {
 	/* A little trip to Paris*/
 	putenv("TZ=Europe/Paris");
 	tzset();
+	clear_timeperiod_cache();
 
 
 	/* Timeperiod exclude tests, from Jean Gabes */
@@ -232,12 +300,14 @@ int main(int argc, char **argv) {
 	/* Back to New york */
 	putenv("TZ=America/New_York");
 	tzset();
+	clear_timeperiod_cache();
 
 
 	temp_timeperiod = find_timeperiod("sunday_only");
 	ok(temp_timeperiod != NULL, "Testing Sunday 00:00-01:15,03:15-22:00");
 	putenv("TZ=Europe/London");
 	tzset();
+	clear_timeperiod_cache();
 
 
 	test_time = 1256421000;
@@ -308,6 +378,7 @@ int main(int argc, char **argv) {
 	ok(temp_timeperiod != NULL, "Testing complex weekly timeperiod definition");
 	putenv("TZ=America/New_York");
 	tzset();
+	clear_timeperiod_cache();
 
 	test_time = 1268109420;
 	is_valid_time = check_time_against_period(test_time, temp_timeperiod);
@@ -316,6 +387,13 @@ int main(int argc, char **argv) {
 	ok(chosen_valid_time == 1268115300, "Next valid time=Tue Mar  9 01:15:00 2010");
 
 
+	srandom(20091025);
+	for(c = 0; cache_test_zones[c] != NULL; c++) {
+		putenv((char *)cache_test_zones[c]);
+		tzset();
+		clear_timeperiod_cache();
+		ok(compare_cached_timeperiods() == 0, "Cached and uncached timeperiod lookups agree in %s", cache_test_zones[c] + 3);
+		}
 
 
 
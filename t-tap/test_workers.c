@@ -0,0 +1,295 @@
+/*****************************************************************************
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+*****************************************************************************/
+
+#define NSCORE 1
+
+#include "config.h"
+#include "common.h"
+#include "nagios.h"
+#include "objects.h"
+#include "workers.h"
+#include "../lib/libnagios.h"
+#include <sys/wait.h>
+
+#include "stub_logging.c"
+
+#include "tap.h"
+
+iobroker_set *nagios_iobs = NULL;
+struct load_control loadctl;
+struct loop_stats loop_stats;
+char *nagios_binary_path = "/bin/true";
+char *qh_socket_path = NULL;
+int host_check_timeout = 30;
+int service_check_timeout = 60;
+int notification_timeout = 30;
+int debug_level = 0;
+int debug_verbosity = 0;
+
+struct kvvec *macros_to_kvv(nagios_macros *mac)
+{ return NULL; }
+int parse_check_output(char *buf, char **short_output, char **long_output, char **perf_data, int escape_newlines_please, int newlines_are_escaped)
+{ return OK; }
+
+/* what the core made of the last check result */
+static char checked[256];
+
+int process_check_result(check_result *cr)
+{
+	snprintf(checked, sizeof(checked), "%s|%s|%d", cr->output ? cr->output : "(null)",
+	         cr->plugin_output ? cr->plugin_output : "(null)", cr->output_split);
+	return OK;
+}
+int free_check_result(check_result *cr)
+{ return OK; }
+
+/* the wproc query handler, as init_workers() registers it */
+static qh_handler wproc_qh;
+
+int qh_register_handler(const char *name, const char *description, unsigned int options, qh_handler handler)
+{
+	if (!strcmp(name, "wproc"))
+		wproc_qh = handler;
+	return 0;
+}
+
+/* the output of the jobs that finished, one per line */
+static char finished[4096];
+
+static void job_done(struct wproc_result *wpres, void *data, int flags)
+{
+	size_t len = strlen(finished);
+
+	snprintf(finished + len, sizeof(finished) - len, "%s\n", wpres->outstd ? wpres->outstd : "(null)");
+}
+
+/* the worker's end of the socket, and the ids of the jobs it was sent */
+static int worker_sd;
+static int job_ids[16];
+
+static int read_job_ids(int num)
+{
+	char buf[65536], *p;
+	ssize_t len;
+	int found = 0;
+
+	len = read(worker_sd, buf, sizeof(buf) - 1);
+	if (len <= 0)
+		return 0;
+	buf[len] = 0;
+	for (p = buf; p < buf + len && found < num; p += strlen(p) + 1) {
+		if (!strncmp(p, "job_id=", 7))
+			job_ids[found++] = atoi(p + 7);
+	}
+	return found == num;
+}
+
+static int start_jobs(int num)
+{
+	int i;
+
+	for (i = 0; i < num; i++) {
+		if (wproc_run_callback("/bin/true", 10, job_done, NULL, NULL) != OK)
+			return 0;
+	}
+	return read_job_ids(num);
+}
+
+/* the result the worker sends when job number 'job' is done */
+static struct kvvec *result_kvv(int job, int job_type, const char *output)
+{
+	static char id[16], type[16];
+	struct kvvec *kvv = kvvec_create(12);
+
+	snprintf(id, sizeof(id), "%d", job_ids[job]);
+	snprintf(type, sizeof(type), "%d", job_type);
+	kvvec_addkv(kvv, "job_id", id);
+	kvvec_addkv(kvv, "type", type);
+	kvvec_addkv(kvv, "start", "1400000000.0");
+	kvvec_addkv(kvv, "stop", "1400000000.5");
+	kvvec_addkv(kvv, "wait_status", "0");
+	kvvec_addkv(kvv, "exited_ok", "1");
+	kvvec_addkv(kvv, "outstd", output);
+	return kvv;
+}
+
+/* what the worker sends for the given result */
+static char *encode(int *len, struct kvvec *kvv)
+{
+	static char buf[4096];
+	int sv[2];
+
+	socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+	worker_send_kvvec(sv[0], kvv);
+	*len = read(sv[1], buf, sizeof(buf));
+	close(sv[0]);
+	close(sv[1]);
+	kvvec_destroy(kvv, 0);
+	return buf;
+}
+
+static char *result(int *len, int job, const char *output)
+{
+	return encode(len, result_kvv(job, WPJOB_CALLBACK, output));
+}
+
+/* sends the given number of results in one write */
+static void send_results(int num, ...)
+{
+	char buf[16384];
+	int len = 0, msg_len, i;
+	va_list ap;
+
+	va_start(ap, num);
+	for (i = 0; i < num; i++) {
+		int job = va_arg(ap, int);
+		const char *output = va_arg(ap, const char *);
+		char *msg = result(&msg_len, job, output);
+
+		memcpy(buf + len, msg, msg_len);
+		len += msg_len;
+	}
+	va_end(ap);
+	write(worker_sd, buf, len);
+}
+
+/* lets the core read what the worker sent, without handling it */
+static void run_poll(void)
+{
+	iobroker_poll(nagios_iobs, 10);
+}
+
+int main(int argc, char **argv)
+{
+	char query[] = "register name=test worker;pid=1;max_jobs=100";
+	char reply[16], *msg, output[] = "first line|time=1s\nsecond line\nthird line|size=2B";
+	unsigned long batches, batched, presplit;
+	struct kvvec *kvv, *request, *resp;
+	child_process cp;
+	check_result *cr;
+	int sv[2], len;
+
+	plan_tests(21);
+
+	nagios_iobs = iobroker_create();
+	init_workers(1);
+	wait(NULL);
+	ok(wproc_qh != NULL, "Worker manager registered its query handler");
+
+	socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+	worker_sd = sv[1];
+	ok(wproc_qh(sv[0], query, strlen(query)) == QH_TAKEOVER && read(worker_sd, reply, sizeof(reply)) == 3
+	   && !strcmp(reply, "OK") && workers_alive() == 1, "Worker registered");
+
+	/* results are read when the poll says so, and handled afterwards */
+	ok(start_jobs(3), "Three jobs sent to the worker");
+	send_results(3, 0, "first", 1, "second", 2, "third");
+	run_poll();
+	ok(!*finished, "Nothing handled while polling");
+	batches = wproc_result_stats.batches;
+	wproc_handle_results();
+	ok(!strcmp(finished, "first\nsecond\nthird\n"), "All results in the batch handled in order") || diag("%s", finished);
+	ok(wproc_result_stats.batches == batches + 1, "One batch for all three");
+
+	/* a batch split across reads */
+	*finished = 0;
+	ok(start_jobs(2), "Two more jobs sent");
+	msg = result(&len, 0, "split");
+	write(worker_sd, msg, len / 2);
+	run_poll();
+	wproc_handle_results();
+	ok(!*finished, "Nothing handled from half a message");
+	write(worker_sd, msg + len / 2, len - len / 2);
+	msg = result(&len, 1, "split in the delimiter");
+	write(worker_sd, msg, len - 2);
+	run_poll();
+	wproc_handle_results();
+	ok(!strcmp(finished, "split\n"), "Only the finished message handled") || diag("%s", finished);
+	write(worker_sd, msg + len - 2, 2);
+	run_poll();
+	wproc_handle_results();
+	ok(!strcmp(finished, "split\nsplit in the delimiter\n"), "The rest handled once the delimiter was complete") || diag("%s", finished);
+
+	/* a batch ending in a malformed message */
+	*finished = 0;
+	ok(start_jobs(3), "Three more jobs sent");
+	send_results(2, 0, "before garbage", 1, "still before garbage");
+	write(worker_sd, "log=worker says hi\1\0\0\0", 22);
+	write(worker_sd, "garbage\1\0\0\0", 11);
+	run_poll();
+	batches = wproc_result_stats.batches;
+	batched = wproc_result_stats.batch_size.sum;
+	wproc_handle_results();
+	ok(!strcmp(finished, "before garbage\nstill before garbage\n"), "Results before the malformed message handled") || diag("%s", finished);
+	ok(wproc_result_stats.batches == batches + 1 && wproc_result_stats.batch_size.sum == batched + 2,
+	   "Log lines and malformed messages not counted as results");
+	send_results(1, 2, "after garbage");
+	run_poll();
+	wproc_handle_results();
+	ok(!strcmp(finished, "before garbage\nstill before garbage\nafter garbage\n"), "Next batch handled as usual") || diag("%s", finished);
+
+	/* workers split check output, and only send its first line along */
+	request = kvvec_create(4);
+	kvvec_addkv(request, "type", "0");
+	memset(&cp, 0, sizeof(cp));
+	cp.request = request;
+	cp.outstd.buf = output;
+	cp.outstd.len = strlen(output);
+	resp = kvvec_create(8);
+	kvvec_addkv_wlen(resp, "outstd", 6, cp.outstd.buf, cp.outstd.len);
+	wproc_split_check_output(&cp, resp);
+	ok(resp->kv_pairs == 3 && resp->kv[0].value_len == 18 && !strncmp(resp->kv[0].value, "first line|time=1s", 18)
+	   && !strcmp(resp->kv[1].key, "output_short") && !strcmp(resp->kv[2].key, "parse_time"),
+	   "Check output split, and the raw output cut down to its first line");
+	kvvec_destroy(resp, 0);
+	request->kv[0].value = "3";
+	resp = kvvec_create(8);
+	kvvec_addkv_wlen(resp, "outstd", 6, cp.outstd.buf, cp.outstd.len);
+	wproc_split_check_output(&cp, resp);
+	ok(resp->kv_pairs == 1 && resp->kv[0].value_len == strlen(output), "Output of other jobs left alone");
+	kvvec_destroy(resp, 0);
+	kvvec_destroy(request, 0);
+
+	/* the core takes over what the worker split, and times each stage */
+	cr = calloc(1, sizeof(*cr));
+	cr->host_name = strdup("host1");
+	ok(wproc_run_check(cr, "/bin/true", NULL) == OK && read_job_ids(1), "Check sent to the worker");
+	presplit = wproc_result_stats.presplit;
+	kvv = result_kvv(0, WPJOB_CHECK, "first line");
+	kvvec_addkv(kvv, "output_short", "first line");
+	kvvec_addkv(kvv, "parse_time", "0.000250");
+	msg = encode(&len, kvv);
+	write(worker_sd, msg, len);
+	run_poll();
+	wproc_handle_results();
+	ok(!strcmp(checked, "first line|first line|1"), "Check result handled with the output the worker split") || diag("%s", checked);
+	ok(wproc_result_stats.presplit == presplit + 1 && wproc_result_stats.max_parse_time == 0.00025
+	   && wproc_result_stats.total_parse_time == 0.00025, "Time the worker spent splitting the output counted");
+
+	/* results sent before the worker goes away */
+	*finished = 0;
+	ok(start_jobs(1), "One last job sent");
+	send_results(1, 0, "last words");
+	close(worker_sd);
+	run_poll();
+	run_poll();
+	ok(!strcmp(finished, "last words\n") && workers_alive() == 0, "Result handled before the worker was removed") || diag("%s", finished);
+
+	free_worker_memory(0);
+	return exit_status();
+}
@@ -0,0 +1,177 @@
+/*****************************************************************************
+ *
+ * test_xsdbinary.c - Test binary status file reading
+ *
+ * Program: Nagios Core Testing
+ * License: GPL
+ *
+ * Description:
+ *
+ * Reads the text and binary status files test_nagios_config wrote from
+ * the same snapshot and checks that the CGIs get the same status data
+ * out of both, and only the parts they asked for.
+ *
+ * License:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *****************************************************************************/
+
+/* Need these to get CGI mode */
+#undef NSCORE
+#define NSCGI 1
+#include "../include/config.h"
+#include "../include/common.h"
+#include "../include/statusdata.h"
+#include "../include/comments.h"
+#include "../include/downtime.h"
+#include "../xdata/xsddefault.h"
+#include "../xdata/xsdbinary.h"
+#include "tap.h"
+#include <stdarg.h>
+
+#define TEXT_STATUS_FILE	"var/status.text"
+#define BINARY_STATUS_FILE	"var/status.bin"
+
+extern hoststatus *hoststatus_list;
+extern servicestatus *servicestatus_list;
+extern int nagios_pid;
+extern int enable_notifications;
+extern int execute_service_checks;
+extern time_t program_start;
+
+
+static void append(char **buf, const char *fmt, ...) {
+	char *line = NULL, *joined = NULL;
+	va_list ap;
+
+	va_start(ap, fmt);
+	vasprintf(&line, fmt, ap);
+	va_end(ap);
+	asprintf(&joined, "%s%s", *buf ? *buf : "", line);
+	free(*buf);
+	free(line);
+	*buf = joined;
+	}
+
+#define S(str) ((str) ? (str) : "(null)")
+
+/* everything the CGIs show about the status data that was read in */
+static char *describe_status_data(void) {
+	hoststatus *hs;
+	servicestatus *ss;
+	nagios_comment *com;
+	scheduled_downtime *dt;
+	char *buf = NULL;
+
+	append(&buf, "program %d %lu %d %d\n", nagios_pid, (unsigned long)program_start,
+	       enable_notifications, execute_service_checks);
+	for(hs = hoststatus_list; hs; hs = hs->next) {
+		append(&buf, "host %s %d %d %d/%d %d %lu %lu %lu %d %d %d %.2f %d\n\t%s\n\t%s\n\t%s\n",
+		       hs->host_name, hs->status, hs->has_been_checked, hs->current_attempt, hs->max_attempts,
+		       hs->state_type, (unsigned long)hs->last_check, (unsigned long)hs->next_check,
+		       (unsigned long)hs->last_state_change, hs->notifications_enabled,
+		       hs->problem_has_been_acknowledged, hs->checks_enabled, hs->percent_state_change,
+		       hs->scheduled_downtime_depth, S(hs->plugin_output), S(hs->long_plugin_output), S(hs->perf_data));
+		}
+	for(ss = servicestatus_list; ss; ss = ss->next) {
+		append(&buf, "service %s;%s %d %d %d/%d %d %lu %lu %lu %d %d %d %.2f %d\n\t%s\n\t%s\n\t%s\n",
+		       ss->host_name, ss->description, ss->status, ss->has_been_checked, ss->current_attempt,
+		       ss->max_attempts, ss->state_type, (unsigned long)ss->last_check, (unsigned long)ss->next_check,
+		       (unsigned long)ss->last_state_change, ss->notifications_enabled,
+		       ss->problem_has_been_acknowledged, ss->checks_enabled, ss->percent_state_change,
+		       ss->scheduled_downtime_depth, S(ss->plugin_output), S(ss->long_plugin_output), S(ss->perf_data));
+		}
+	for(com = comment_list; com; com = com->next) {
+		append(&buf, "comment %lu %d %s;%s %d %d %lu %d %lu %s: %s\n", com->comment_id, com->entry_type,
+		       S(com->host_name), S(com->service_description), com->source, com->persistent,
+		       (unsigned long)com->entry_time, com->expires, (unsigned long)com->expire_time,
+		       S(com->author), S(com->comment_data));
+		}
+	for(dt = scheduled_downtime_list; dt; dt = dt->next) {
+		append(&buf, "downtime %lu %d %s;%s %lu-%lu %d %lu %lu %s: %s\n", dt->downtime_id, dt->type,
+		       S(dt->host_name), S(dt->service_description), (unsigned long)dt->start_time,
+		       (unsigned long)dt->end_time, dt->fixed, dt->duration, dt->triggered_by,
+		       S(dt->author), S(dt->comment));
+		}
+
+	return buf;
+	}
+
+
+static int count_comments(void) {
+	nagios_comment *com;
+	int count = 0;
+
+	for(com = comment_list; com; com = com->next)
+		count++;
+	return count;
+	}
+
+
+static void forget_status_data(void) {
+	free_status_data();
+	free_comment_data();
+	free_downtime_data();
+	nagios_pid = 0;
+	program_start = 0;
+	}
+
+
+int main(int argc, char **argv) {
+	char *from_text, *from_binary;
+	int comments;
+
+	plan_tests(11);
+
+	ok(xsddefault_read_status_data(TEXT_STATUS_FILE, READ_ALL_STATUS_DATA) == OK, "Read text status data");
+	from_text = describe_status_data();
+	comments = count_comments();
+	ok(hoststatus_list && servicestatus_list && comments > 0 && nagios_pid > 0, "Text status data has hosts, services, comments and program status");
+	forget_status_data();
+
+	ok(xsdbinary_read_status_data(BINARY_STATUS_FILE, READ_ALL_STATUS_DATA) == OK, "Read binary status data");
+	from_binary = describe_status_data();
+	ok(!strcmp(from_text, from_binary), "Binary status data is the same as the text status data");
+	if(strcmp(from_text, from_binary))
+		diag("text:\n%s\nbinary:\n%s", from_text, from_binary);
+	forget_status_data();
+
+	/* the CGIs read program status first, and the rest later */
+	ok(xsdbinary_read_status_data(BINARY_STATUS_FILE, READ_PROGRAM_STATUS) == OK, "Read binary program status");
+	ok(nagios_pid > 0 && !hoststatus_list && !servicestatus_list && !comment_list && !scheduled_downtime_list,
+	   "Only program status read");
+	ok(xsdbinary_read_status_data(BINARY_STATUS_FILE, READ_HOST_STATUS | READ_SERVICE_STATUS) == OK
+	   && count_comments() == comments, "Read binary host and service status without adding comments twice");
+	free(from_binary);
+	from_binary = describe_status_data();
+	ok(!strcmp(from_text, from_binary), "Both reads together are the same as the text status data");
+	forget_status_data();
+
+	/* and reading hosts must leave the program status alone */
+	nagios_pid = 1;
+	ok(xsdbinary_read_status_data(BINARY_STATUS_FILE, READ_HOST_STATUS) == OK && nagios_pid == 1,
+	   "Read binary host status without program status");
+	ok(hoststatus_list && !servicestatus_list, "Only host status read");
+	forget_status_data();
+
+	ok(xsdbinary_read_status_data("var/status.missing", READ_ALL_STATUS_DATA) == ERROR, "Missing binary status file fails");
+
+	free(from_text);
+	free(from_binary);
+	unlink(TEXT_STATUS_FILE);
+	unlink(BINARY_STATUS_FILE);
+
+	return exit_status();
+	}
@@ -0,0 +1,1695 @@
+/*****************************************************************************
+ *
+ * XODBINARY.C - Binary object precache routines for Nagios
+ *
+ *
+ * License:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *****************************************************************************/
+
+
+/*********** COMMON HEADER FILES ***********/
+
+#include "../include/config.h"
+#include "../include/common.h"
+#include "../include/objects.h"
+#include "../include/locations.h"
+#include "xodbinary.h"
+#include <stddef.h>
+#include <sys/mman.h>
+
+#ifdef NSCORE
+#include "../include/nagios.h"
+
+
+#define XODB_ALIGN(x) (((x) + 7) & ~((uint64_t)7))
+#define XODB_HASH_INIT           0xcbf29ce484222325ULL
+#define XODB_READ_BUFSIZE        (64 * 1024)
+
+/* the config files the objects in memory were read from */
+struct xodb_source_file {
+	char *path;
+	uint64_t size;
+	int64_t mtime;
+	uint64_t hash;
+	};
+
+static struct {
+	struct xodb_source_file *files;
+	unsigned int count;
+	uint64_t digest;
+	} sources;
+
+/* snapshot output buffers */
+static struct {
+	uint32_t *rec;
+	size_t rec_len, rec_size;
+	char *heap;
+	size_t heap_len, heap_size;
+	dkhash_table *strings;
+	const void **scratch;
+	unsigned int scratch_size;
+	int error;
+	} wr;
+
+struct xodb_map {
+	const char *base;
+	size_t size;
+	struct xodb_header hdr;
+	};
+
+struct xodb_reader {
+	const uint32_t *pos, *end;
+	const char *heap;
+	uint64_t heap_size;
+	int error;
+	};
+
+
+/******************************************************************/
+/********************* SOURCE FILE FUNCTIONS **********************/
+/******************************************************************/
+
+static uint64_t xodb_hash(uint64_t h, const void *data, size_t len) {
+	const unsigned char *p = data;
+	size_t i;
+
+	for(i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+		}
+
+	return h;
+	}
+
+
+static int xodb_hash_file(const char *path, struct xodb_source_file *f) {
+	static char buf[XODB_READ_BUFSIZE];
+	struct stat st;
+	ssize_t len;
+	int fd;
+
+	if((fd = open(path, O_RDONLY)) < 0)
+		return ERROR;
+	if(fstat(fd, &st) < 0) {
+		close(fd);
+		return ERROR;
+		}
+
+	f->size = st.st_size;
+	f->mtime = st.st_mtime;
+	f->hash = XODB_HASH_INIT;
+	while((len = read(fd, buf, sizeof(buf))) != 0) {
+		if(len < 0) {
+			if(errno == EINTR)
+				continue;
+			close(fd);
+			return ERROR;
+			}
+		f->hash = xodb_hash(f->hash, buf, len);
+		}
+
+	close(fd);
+	return OK;
+	}
+
+
+static uint64_t xodb_digest(const struct xodb_source_file *files, unsigned int count) {
+	uint64_t h = XODB_HASH_INIT;
+	unsigned int i;
+
+	for(i = 0; i < count; i++) {
+		h = xodb_hash(h, files[i].path, strlen(files[i].path) + 1);
+		h = xodb_hash(h, &files[i].hash, sizeof(files[i].hash));
+		}
+
+	return h;
+	}
+
+
+static void xodb_free_sources(void) {
+	unsigned int i;
+
+	for(i = 0; i < sources.count; i++)
+		my_free(sources.files[i].path);
+	my_free(sources.files);
+	sources.count = 0;
+	sources.digest = 0;
+	}
+
+
+/*
+ * remembers the main config file and the object config files that
+ * were just read, so snapshots can be checked against them
+ */
+int xodbinary_set_sources(const char *main_config_file, char **files, int count) {
+	struct xodb_source_file *f;
+	int i;
+
+	xodb_free_sources();
+
+	if((sources.files = calloc(count + 1, sizeof(*sources.files))) == NULL)
+		return ERROR;
+
+	for(i = -1; i < count; i++) {
+		f = &sources.files[sources.count];
+		if((f->path = strdup(i < 0 ? main_config_file : files[i])) == NULL)
+			break;
+		sources.count++;
+		if(xodb_hash_file(f->path, f) != OK) {
+			logit(NSLOG_CONFIG_WARNING, TRUE, "Warning: Unable to read '%s' to checksum it: %s\n", f->path, strerror(errno));
+			f->size = f->mtime = f->hash = 0;
+			}
+		}
+	sources.digest = xodb_digest(sources.files, sources.count);
+
+	return i == count ? OK : ERROR;
+	}
+
+
+/******************************************************************/
+/******************** SNAPSHOT OUTPUT FUNCTIONS *******************/
+/******************************************************************/
+
+static void xodb_put(uint32_t val) {
+	uint32_t *p;
+	size_t size;
+
+	if(wr.rec_len == wr.rec_size) {
+		size = wr.rec_size ? wr.rec_size * 2 : 64 * 1024;
+		if((p = realloc(wr.rec, size * sizeof(*p))) == NULL) {
+			wr.error = TRUE;
+			return;
+			}
+		wr.rec = p;
+		wr.rec_size = size;
+		}
+	wr.rec[wr.rec_len++] = val;
+	}
+
+
+static void xodb_put_double(double val) {
+	uint32_t w[2];
+
+	memcpy(w, &val, sizeof(w));
+	xodb_put(w[0]);
+	xodb_put(w[1]);
+	}
+
+
+/* adds a string to the heap, unless it's there already */
+static uint32_t xodb_string(const char *str) {
+	size_t len, size;
+	void *off;
+	char *p;
+
+	if(str == NULL)
+		return 0;
+	if((off = dkhash_get(wr.strings, str, NULL)) != NULL)
+		return (uint32_t)(uintptr_t)off;
+
+	len = strlen(str) + 1;
+	if(wr.heap_len + len > UINT32_MAX) {
+		wr.error = TRUE;
+		return 0;
+		}
+	if(wr.heap_len + len > wr.heap_size) {
+		size = (wr.heap_len + len) * 2;
+		if((p = realloc(wr.heap, size)) == NULL) {
+			wr.error = TRUE;
+			return 0;
+			}
+		wr.heap = p;
+		wr.heap_size = size;
+		}
+
+	off = (void *)(uintptr_t)wr.heap_len;
+	memcpy(wr.heap + wr.heap_len, str, len);
+	wr.heap_len += len;
+	if(dkhash_insert(wr.strings, str, NULL, off) != DKHASH_OK)
+		wr.error = TRUE;
+
+	return (uint32_t)(uintptr_t)off;
+	}
+
+
+static void xodb_put_string(const char *str) {
+	xodb_put(xodb_string(str));
+	}
+
+
+static void xodb_put_timeperiod(const timeperiod *tp) {
+	xodb_put(tp ? tp->id + 1 : 0);
+	}
+
+
+/*
+ * collects the members of a linked list in the scratch array,
+ * starting at 'start', so they can be written last to first
+ */
+static unsigned int xodb_gather(const void *list, size_t next_offset, unsigned int start) {
+	unsigned int n = start, size;
+	const void **p;
+
+	for(; list != NULL; list = *(const void * const *)((const char *)list + next_offset)) {
+		if(n == wr.scratch_size) {
+			size = wr.scratch_size ? wr.scratch_size * 2 : 256;
+			if((p = realloc(wr.scratch, size * sizeof(*p))) == NULL) {
+				wr.error = TRUE;
+				break;
+				}
+			wr.scratch = p;
+			wr.scratch_size = size;
+			}
+		wr.scratch[n++] = list;
+		}
+
+	return n - start;
+	}
+
+#define xodb_gather_list(list, type, start) xodb_gather(list, offsetof(type, next), start)
+
+
+static void xodb_put_contacts(const contactsmember *list) {
+	unsigned int i, n = xodb_gather_list(list, contactsmember, 0);
+
+	xodb_put(n);
+	for(i = n; i > 0; i--)
+		xodb_put(((const contactsmember *)wr.scratch[i - 1])->contact_ptr->id);
+	}
+
+
+static void xodb_put_contactgroups(const contactgroupsmember *list) {
+	unsigned int i, n = xodb_gather_list(list, contactgroupsmember, 0);
+
+	xodb_put(n);
+	for(i = n; i > 0; i--)
+		xodb_put(((const contactgroupsmember *)wr.scratch[i - 1])->group_ptr->id);
+	}
+
+
+static void xodb_put_custom_variables(const customvariablesmember *list) {
+	const customvariablesmember *cv;
+	unsigned int i, n = xodb_gather_list(list, customvariablesmember, 0);
+
+	xodb_put(n);
+	for(i = n; i > 0; i--) {
+		cv = wr.scratch[i - 1];
+		xodb_put_string(cv->variable_name);
+		xodb_put_string(cv->variable_value);
+		}
+	}
+
+
+static void xodb_put_commands(const commandsmember *list) {
+	unsigned int i, n = xodb_gather_list(list, commandsmember, 0);
+
+	xodb_put(n);
+	for(i = n; i > 0; i--)
+		xodb_put_string(((const commandsmember *)wr.scratch[i - 1])->command);
+	}
+
+
+static void xodb_write_timeperiod(const timeperiod *tp) {
+	const timerange *tr;
+	const daterange *dr;
+	unsigned int i, j, n, m;
+	int x;
+
+	xodb_put_string(tp->name);
+	xodb_put_string(tp->alias);
+
+	/* day ranges are insertion-sorted when added, so they go in as they are */
+	for(x = 0; x < 7; x++) {
+		for(n = 0, tr = tp->days[x]; tr; tr = tr->next)
+			n++;
+		xodb_put(n);
+		for(tr = tp->days[x]; tr; tr = tr->next) {
+			xodb_put(tr->range_start);
+			xodb_put(tr->range_end);
+			}
+		}
+
+	for(x = 0; x < DATERANGE_TYPES; x++) {
+		n = xodb_gather_list(tp->exceptions[x], daterange, 0);
+		xodb_put(n);
+		for(i = n; i > 0; i--) {
+			dr = wr.scratch[i - 1];
+			xodb_put(dr->syear);
+			xodb_put(dr->smon);
+			xodb_put(dr->smday);
+			xodb_put(dr->swday);
+			xodb_put(dr->swday_offset);
+			xodb_put(dr->eyear);
+			xodb_put(dr->emon);
+			xodb_put(dr->emday);
+			xodb_put(dr->ewday);
+			xodb_put(dr->ewday_offset);
+			xodb_put(dr->skip_interval);
+			m = xodb_gather_list(dr->times, timerange, n);
+			xodb_put(m);
+			for(j = m; j > 0; j--) {
+				tr = wr.scratch[n + j - 1];
+				xodb_put(tr->range_start);
+				xodb_put(tr->range_end);
+				}
+			}
+		}
+
+	n = xodb_gather_list(tp->exclusions, timeperiodexclusion, 0);
+	xodb_put(n);
+	for(i = n; i > 0; i--)
+		xodb_put_string(((const timeperiodexclusion *)wr.scratch[i - 1])->timeperiod_name);
+	}
+
+
+static void xodb_write_contact(const contact *cntct) {
+	int x;
+
+	xodb_put_string(cntct->name);
+	xodb_put_string(cntct->alias != cntct->name ? cntct->alias : NULL);
+	xodb_put_string(cntct->email);
+	xodb_put_string(cntct->pager);
+	xodb_put(MAX_CONTACT_ADDRESSES);
+	for(x = 0; x < MAX_CONTACT_ADDRESSES; x++)
+		xodb_put_string(cntct->address[x]);
+	xodb_put_timeperiod(cntct->service_notification_period_ptr);
+	xodb_put_timeperiod(cntct->host_notification_period_ptr);
+	xodb_put(cntct->service_notification_options);
+	xodb_put(cntct->host_notification_options);
+	xodb_put(cntct->host_notifications_enabled);
+	xodb_put(cntct->service_notifications_enabled);
+	xodb_put(cntct->can_submit_commands);
+	xodb_put(cntct->retain_status_information);
+	xodb_put(cntct->retain_nonstatus_information);
+	xodb_put(cntct->minimum_value);
+
+	xodb_put_commands(cntct->host_notification_commands);
+	xodb_put_commands(cntct->service_notification_commands);
+	xodb_put_custom_variables(cntct->custom_variables);
+	}
+
+
+static void xodb_write_host(const host *hst) {
+	unsigned int i, n;
+
+	/* in the order add_host() takes them */
+	xodb_put_string(hst->name);
+	xodb_put_string(hst->display_name != hst->name ? hst->display_name : NULL);
+	xodb_put_string(hst->alias != hst->name ? hst->alias : NULL);
+	xodb_put_string(hst->address != hst->name ? hst->address : NULL);
+	xodb_put_timeperiod(hst->check_period_ptr);
+	xodb_put(hst->initial_state);
+	xodb_put_double(hst->check_interval);
+	xodb_put_double(hst->retry_interval);
+	xodb_put(hst->max_attempts);
+	xodb_put(hst->notification_options);
+	xodb_put_double(hst->notification_interval);
+	xodb_put_double(hst->first_notification_delay);
+	xodb_put_timeperiod(hst->notification_period_ptr);
+	xodb_put(hst->notifications_enabled);
+	xodb_put_string(hst->check_command);
+	xodb_put(hst->checks_enabled);
+	xodb_put(hst->accept_passive_checks);
+	xodb_put_string(hst->event_handler);
+	xodb_put(hst->event_handler_enabled);
+	xodb_put_timeperiod(hst->event_handler_period_ptr);
+	xodb_put(hst->flap_detection_enabled);
+	xodb_put_double(hst->low_flap_threshold);
+	xodb_put_double(hst->high_flap_threshold);
+	xodb_put(hst->flap_detection_options);
+	xodb_put(hst->stalking_options);
+	xodb_put(hst->process_performance_data);
+	xodb_put(hst->check_freshness);
+	xodb_put(hst->freshness_threshold);
+	xodb_put_string(hst->notes);
+	xodb_put_string(hst->notes_url);
+	xodb_put_string(hst->action_url);
+	xodb_put_string(hst->icon_image);
+	xodb_put_string(hst->icon_image_alt);
+	xodb_put_string(hst->vrml_image);
+	xodb_put_string(hst->statusmap_image);
+	xodb_put(hst->x_2d);
+	xodb_put(hst->y_2d);
+	xodb_put(hst->have_2d_coords);
+	xodb_put_double(hst->x_3d);
+	xodb_put_double(hst->y_3d);
+	xodb_put_double(hst->z_3d);
+	xodb_put(hst->have_3d_coords);
+	xodb_put(hst->should_be_drawn);
+	xodb_put(hst->retain_status_information);
+	xodb_put(hst->retain_nonstatus_information);
+	xodb_put(hst->obsess);
+	xodb_put(hst->hourly_value);
+
+	n = xodb_gather_list(hst->parent_hosts, hostsmember, 0);
+	xodb_put(n);
+	for(i = n; i > 0; i--)
+		xodb_put_string(((const hostsmember *)wr.scratch[i - 1])->host_name);
+	xodb_put_contactgroups(hst->contact_groups);
+	xodb_put_contacts(hst->contacts);
+	xodb_put_custom_variables(hst->custom_variables);
+	}
+
+
+static void xodb_write_service(const service *svc) {
+	const servicesmember *sm;
+	unsigned int i, n;
+
+	/* in the order add_service() takes them */
+	xodb_put(svc->host_ptr->id);
+	xodb_put_string(svc->description);
+	xodb_put_string(svc->display_name != svc->description ? svc->display_name : NULL);
+	xodb_put_timeperiod(svc->check_period_ptr);
+	xodb_put(svc->initial_state);
+	xodb_put(svc->max_attempts);
+	xodb_put(svc->parallelize);
+	xodb_put(svc->accept_passive_checks);
+	xodb_put_double(svc->check_interval);
+	xodb_put_double(svc->retry_interval);
+	xodb_put_double(svc->notification_interval);
+	xodb_put_double(svc->first_notification_delay);
+	xodb_put_timeperiod(svc->notification_period_ptr);
+	xodb_put(svc->notification_options);
+	xodb_put(svc->notifications_enabled);
+	xodb_put(svc->is_volatile);
+	xodb_put_string(svc->event_handler);
+	xodb_put(svc->event_handler_enabled);
+	xodb_put_timeperiod(svc->event_handler_period_ptr);
+	xodb_put_string(svc->check_command);
+	xodb_put(svc->checks_enabled);
+	xodb_put(svc->flap_detection_enabled);
+	xodb_put_double(svc->low_flap_threshold);
+	xodb_put_double(svc->high_flap_threshold);
+	xodb_put(svc->flap_detection_options);
+	xodb_put(svc->stalking_options);
+	xodb_put(svc->process_performance_data);
+	xodb_put(svc->check_freshness);
+	xodb_put(svc->freshness_threshold);
+	xodb_put_string(svc->notes);
+	xodb_put_string(svc->notes_url);
+	xodb_put_string(svc->action_url);
+	xodb_put_string(svc->icon_image);
+	xodb_put_string(svc->icon_image_alt);
+	xodb_put(svc->retain_status_information);
+	xodb_put(svc->retain_nonstatus_information);
+	xodb_put(svc->obsess);
+	xodb_put(svc->hourly_value);
+
+	n = xodb_gather_list(svc->parents, servicesmember, 0);
+	xodb_put(n);
+	for(i = n; i > 0; i--) {
+		sm = wr.scratch[i - 1];
+		xodb_put_string(sm->host_name);
+		xodb_put_string(sm->service_description);
+		}
+	xodb_put_contactgroups(svc->contact_groups);
+	xodb_put_contacts(svc->contacts);
+	xodb_put_custom_variables(svc->custom_variables);
+	}
+
+
+static void xodb_write_servicedependencies(void) {
+	const servicedependency *dep;
+	const objectlist *lists[2];
+	unsigned int i, j, n, x;
+	size_t count_at = wr.rec_len;
+
+	/*
+	 * each service's dependency lists only depend on the order
+	 * they were added in, so they are written per dependent service
+	 */
+	xodb_put(0);
+	for(i = 0, n = 0; i < num_objects.services; i++) {
+		lists[0] = service_ary[i]->notify_deps;
+		lists[1] = service_ary[i]->exec_deps;
+		if(!lists[0] && !lists[1])
+			continue;
+		n++;
+		xodb_put(i);
+		for(x = 0; x < 2; x++) {
+			j = xodb_gather_list(lists[x], objectlist, 0);
+			xodb_put(j);
+			for(; j > 0; j--) {
+				dep = ((const objectlist *)wr.scratch[j - 1])->object_ptr;
+				xodb_put(dep->master_service_ptr->id);
+				xodb_put(dep->dependency_type);
+				xodb_put(dep->inherits_parent);
+				xodb_put(dep->failure_options);
+				xodb_put_timeperiod(dep->dependency_period_ptr);
+				}
+			}
+		}
+	if(wr.error == FALSE)
+		wr.rec[count_at] = n;
+	}
+
+
+static void xodb_write_hostdependencies(void) {
+	const hostdependency *dep;
+	const objectlist *lists[2];
+	unsigned int i, j, n, x;
+	size_t count_at = wr.rec_len;
+
+	xodb_put(0);
+	for(i = 0, n = 0; i < num_objects.hosts; i++) {
+		lists[0] = host_ary[i]->notify_deps;
+		lists[1] = host_ary[i]->exec_deps;
+		if(!lists[0] && !lists[1])
+			continue;
+		n++;
+		xodb_put(i);
+		for(x = 0; x < 2; x++) {
+			j = xodb_gather_list(lists[x], objectlist, 0);
+			xodb_put(j);
+			for(; j > 0; j--) {
+				dep = ((const objectlist *)wr.scratch[j - 1])->object_ptr;
+				xodb_put(dep->master_host_ptr->id);
+				xodb_put(dep->dependency_type);
+				xodb_put(dep->inherits_parent);
+				xodb_put(dep->failure_options);
+				xodb_put_timeperiod(dep->dependency_period_ptr);
+				}
+			}
+		}
+	if(wr.error == FALSE)
+		wr.rec[count_at] = n;
+	}
+
+
+/* escalations are sorted after they're registered, so put them back in id order */
+static void xodb_write_escalations(void) {
+	const serviceescalation *se;
+	const hostescalation *he;
+	void **by_id;
+	unsigned int i, n;
+
+	n = num_objects.serviceescalations > num_objects.hostescalations ? num_objects.serviceescalations : num_objects.hostescalations;
+	if((by_id = calloc(n ? n : 1, sizeof(*by_id))) == NULL) {
+		wr.error = TRUE;
+		return;
+		}
+
+	for(i = 0; i < num_objects.serviceescalations; i++)
+		by_id[serviceescalation_ary[i]->id] = serviceescalation_ary[i];
+	for(i = 0; i < num_objects.serviceescalations; i++) {
+		se = by_id[i];
+		xodb_put(se->service_ptr->id);
+		xodb_put(se->first_notification);
+		xodb_put(se->last_notification);
+		xodb_put_double(se->notification_interval);
+		xodb_put_timeperiod(se->escalation_period_ptr);
+		xodb_put(se->escalation_options);
+		xodb_put_contactgroups(se->contact_groups);
+		xodb_put_contacts(se->contacts);
+		}
+
+	/* host dependencies are registered in between */
+	xodb_write_hostdependencies();
+
+	for(i = 0; i < num_objects.hostescalations; i++)
+		by_id[hostescalation_ary[i]->id] = hostescalation_ary[i];
+	for(i = 0; i < num_objects.hostescalations; i++) {
+		he = by_id[i];
+		xodb_put(he->host_ptr->id);
+		xodb_put(he->first_notification);
+		xodb_put(he->last_notification);
+		xodb_put_double(he->notification_interval);
+		xodb_put_timeperiod(he->escalation_period_ptr);
+		xodb_put(he->escalation_options);
+		xodb_put_contactgroups(he->contact_groups);
+		xodb_put_contacts(he->contacts);
+		}
+
+	free(by_id);
+	}
+
+
+static void xodb_write_objects(void) {
+	const contactgroup *cg;
+	const hostgroup *hg;
+	const servicegroup *sg;
+	unsigned int i, j, n;
+
+	for(i = 0; i < num_objects.timeperiods; i++)
+		xodb_write_timeperiod(timeperiod_ary[i]);
+
+	for(i = 0; i < num_objects.commands; i++) {
+		xodb_put_string(command_ary[i]->name);
+		xodb_put_string(command_ary[i]->command_line);
+		}
+
+	for(i = 0; i < num_objects.contactgroups; i++) {
+		cg = contactgroup_ary[i];
+		xodb_put_string(cg->group_name);
+		xodb_put_string(cg->alias != cg->group_name ? cg->alias : NULL);
+		}
+
+	for(i = 0; i < num_objects.hostgroups; i++) {
+		hg = hostgroup_ary[i];
+		xodb_put_string(hg->group_name);
+		xodb_put_string(hg->alias != hg->group_name ? hg->alias : NULL);
+		xodb_put_string(hg->notes);
+		xodb_put_string(hg->notes_url);
+		xodb_put_string(hg->action_url);
+		}
+
+	for(i = 0; i < num_objects.servicegroups; i++) {
+		sg = servicegroup_ary[i];
+		xodb_put_string(sg->group_name);
+		xodb_put_string(sg->alias != sg->group_name ? sg->alias : NULL);
+		xodb_put_string(sg->notes);
+		xodb_put_string(sg->notes_url);
+		xodb_put_string(sg->action_url);
+		}
+
+	for(i = 0; i < num_objects.contacts; i++)
+		xodb_write_contact(contact_ary[i]);
+
+	for(i = 0; i < num_objects.hosts; i++)
+		xodb_write_host(host_ary[i]);
+
+	for(i = 0; i < num_objects.services; i++)
+		xodb_write_service(service_ary[i]);
+
+	/*
+	 * group members go last to first, which also makes each of
+	 * them land at the head of an insertion-sorted member list
+	 */
+	for(i = 0; i < num_objects.contactgroups; i++) {
+		n = xodb_gather_list(contactgroup_ary[i]->members, contactsmember, 0);
+		xodb_put(n);
+		for(j = n; j > 0; j--)
+			xodb_put(((const contactsmember *)wr.scratch[j - 1])->contact_ptr->id);
+		}
+	for(i = 0; i < num_objects.hostgroups; i++) {
+		n = xodb_gather_list(hostgroup_ary[i]->members, hostsmember, 0);
+		xodb_put(n);
+		for(j = n; j > 0; j--)
+			xodb_put(((const hostsmember *)wr.scratch[j - 1])->host_ptr->id);
+		}
+	for(i = 0; i < num_objects.servicegroups; i++) {
+		n = xodb_gather_list(servicegroup_ary[i]->members, servicesmember, 0);
+		xodb_put(n);
+		for(j = n; j > 0; j--)
+			xodb_put(((const servicesmember *)wr.scratch[j - 1])->service_ptr->id);
+		}
+
+	xodb_write_servicedependencies();
+	xodb_write_escalations();
+	}
+
+
+static int xodb_pwrite(int fd, const void *buf, size_t len, uint64_t off) {
+	const char *p = buf;
+	ssize_t ret;
+
+	while(len > 0) {
+		ret = pwrite(fd, p, len, (off_t)off);
+		if(ret < 0) {
+			if(errno == EINTR)
+				continue;
+			return ERROR;
+			}
+		p += ret;
+		len -= ret;
+		off += ret;
+		}
+
+	return OK;
+	}
+
+
+static void xodb_free_writer(void) {
+	my_free(wr.rec);
+	my_free(wr.heap);
+	my_free(wr.scratch);
+	if(wr.strings)
+		dkhash_destroy(wr.strings);
+	memset(&wr, 0, sizeof(wr));
+	}
+
+
+/* writes a snapshot of all registered objects */
+int xodbinary_write_object_config(const char *snapshot_file) {
+	struct xodb_header hdr;
+	struct xodb_source *src = NULL;
+	char *tmp_file = NULL;
+	unsigned int i;
+	int fd = -1, result = ERROR;
+
+	/* some people won't want to cache their objects */
+	if(!snapshot_file || !strcmp(snapshot_file, "/dev/null"))
+		return OK;
+
+	memset(&wr, 0, sizeof(wr));
+	wr.heap_size = 64 * 1024;
+	wr.heap_len = 1;
+	wr.heap = calloc(1, wr.heap_size);
+	wr.strings = dkhash_create(num_objects.hosts + num_objects.services + 1024);
+	src = calloc(sources.count ? sources.count : 1, sizeof(*src));
+	if(!wr.heap || !wr.strings || !src)
+		goto out;
+
+	for(i = 0; i < sources.count; i++) {
+		src[i].path = xodb_string(sources.files[i].path);
+		src[i].size = sources.files[i].size;
+		src[i].mtime = sources.files[i].mtime;
+		src[i].hash = sources.files[i].hash;
+		}
+
+	xodb_write_objects();
+	if(wr.error == TRUE)
+		goto out;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, XODBINARY_MAGIC, sizeof(hdr.magic));
+	hdr.version = XODBINARY_VERSION;
+	hdr.header_size = sizeof(hdr);
+	hdr.byte_order = XODBINARY_BYTE_ORDER;
+	hdr.num_sources = sources.count;
+	hdr.created = time(NULL);
+	hdr.source_digest = sources.digest;
+	hdr.num_timeperiods = num_objects.timeperiods;
+	hdr.num_commands = num_objects.commands;
+	hdr.num_contactgroups = num_objects.contactgroups;
+	hdr.num_hostgroups = num_objects.hostgroups;
+	hdr.num_servicegroups = num_objects.servicegroups;
+	hdr.num_contacts = num_objects.contacts;
+	hdr.num_hosts = num_objects.hosts;
+	hdr.num_services = num_objects.services;
+	hdr.num_servicedependencies = num_objects.servicedependencies;
+	hdr.num_serviceescalations = num_objects.serviceescalations;
+	hdr.num_hostdependencies = num_objects.hostdependencies;
+	hdr.num_hostescalations = num_objects.hostescalations;
+	hdr.sources_offset = XODB_ALIGN(sizeof(hdr));
+	hdr.records_offset = XODB_ALIGN(hdr.sources_offset + (uint64_t)sources.count * sizeof(*src));
+	hdr.records_size = (uint64_t)wr.rec_len * sizeof(*wr.rec);
+	hdr.strings_offset = XODB_ALIGN(hdr.records_offset + hdr.records_size);
+	hdr.strings_size = wr.heap_len;
+	hdr.file_size = hdr.strings_offset + hdr.strings_size;
+
+	asprintf(&tmp_file, "%s.XXXXXX", snapshot_file);
+	if(tmp_file == NULL)
+		goto out;
+	if((fd = mkstemp(tmp_file)) == -1) {
+		logit(NSLOG_CONFIG_WARNING, TRUE, "Warning: Unable to create temp file '%s' for writing the object precache: %s\n", tmp_file, strerror(errno));
+		goto out;
+		}
+	fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+
+	/* the gaps between sections are left as holes */
+	if(xodb_pwrite(fd, &hdr, sizeof(hdr), 0) != OK
+	   || xodb_pwrite(fd, src, sources.count * sizeof(*src), hdr.sources_offset) != OK
+	   || xodb_pwrite(fd, wr.rec, hdr.records_size, hdr.records_offset) != OK
+	   || xodb_pwrite(fd, wr.heap, hdr.strings_size, hdr.strings_offset) != OK
+	   || fsync(fd) != 0) {
+		logit(NSLOG_CONFIG_WARNING, TRUE, "Warning: Unable to write object precache file '%s': %s\n", tmp_file, strerror(errno));
+		goto out;
+		}
+
+	if(rename(tmp_file, snapshot_file)) {
+		logit(NSLOG_CONFIG_WARNING, TRUE, "Warning: Unable to update object precache file '%s': %s\n", snapshot_file, strerror(errno));
+		goto out;
+		}
+	result = OK;
+
+out:
+	if(fd >= 0) {
+		close(fd);
+		if(result != OK)
+			unlink(tmp_file);
+		}
+	my_free(tmp_file);
+	my_free(src);
+	xodb_free_writer();
+
+	return result;
+	}
+
+
+/******************************************************************/
+/******************** SNAPSHOT INPUT FUNCTIONS ********************/
+/******************************************************************/
+
+/* tells a binary snapshot from a text precache file */
+int xodbinary_is_snapshot(const char *snapshot_file) {
+	char magic[sizeof(((struct xodb_header *)0)->magic)];
+	int fd, result = FALSE;
+
+	if(snapshot_file == NULL || (fd = open(snapshot_file, O_RDONLY)) < 0)
+		return FALSE;
+	if(read(fd, magic, sizeof(magic)) == sizeof(magic) && !memcmp(magic, XODBINARY_MAGIC, sizeof(magic)))
+		result = TRUE;
+	close(fd);
+
+	return result;
+	}
+
+
+static void xodb_unmap(struct xodb_map *map) {
+	if(map->base)
+		munmap((void *)map->base, map->size);
+	map->base = NULL;
+	}
+
+
+static int xodb_map(const char *snapshot_file, struct xodb_map *map) {
+	const struct xodb_header *hdr = &map->hdr;
+	struct stat st;
+	void *base;
+	int fd;
+
+	map->base = NULL;
+	if((fd = open(snapshot_file, O_RDONLY)) < 0)
+		return ERROR;
+	if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(map->hdr)) {
+		close(fd);
+		return ERROR;
+		}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED)
+		return ERROR;
+
+	map->base = base;
+	map->size = st.st_size;
+	memcpy(&map->hdr, base, sizeof(map->hdr));
+
+	/*
+	 * the sections must follow each other inside the file, which is
+	 * checked without adding offsets, so huge ones can't wrap around.
+	 * The heap must end with a nul, so every string in it is terminated
+	 */
+	if(memcmp(hdr->magic, XODBINARY_MAGIC, sizeof(hdr->magic)) || hdr->version != XODBINARY_VERSION
+	   || hdr->header_size != sizeof(map->hdr) || hdr->byte_order != XODBINARY_BYTE_ORDER
+	   || hdr->file_size != (uint64_t)st.st_size
+	   || hdr->sources_offset < sizeof(map->hdr) || hdr->sources_offset > hdr->records_offset
+	   || hdr->num_sources > (hdr->records_offset - hdr->sources_offset) / sizeof(struct xodb_source)
+	   || hdr->records_offset > hdr->strings_offset || hdr->records_offset % sizeof(uint32_t)
+	   || hdr->records_size > hdr->strings_offset - hdr->records_offset || hdr->records_size % sizeof(uint32_t)
+	   || hdr->strings_offset >= hdr->file_size || hdr->strings_size != hdr->file_size - hdr->strings_offset
+	   || map->base[hdr->file_size - 1] != 0) {
+		xodb_unmap(map);
+		errno = EINVAL;
+		return ERROR;
+		}
+
+	return OK;
+	}
+
+
+/*
+ * checks the config files a snapshot was made from. Unless 'deep' is
+ * set, files that still have the same size and mtime are assumed not
+ * to have changed. Returns the first changed file, or NULL.
+ */
+static const char *xodb_stale_source(const struct xodb_map *map, int deep) {
+	const struct xodb_header *hdr = &map->hdr;
+	struct xodb_source src;
+	struct xodb_source_file f;
+	struct stat st;
+	const char *path;
+	unsigned int i;
+
+	for(i = 0; i < hdr->num_sources; i++) {
+		memcpy(&src, map->base + hdr->sources_offset + (uint64_t)i * sizeof(src), sizeof(src));
+		if(!src.path || src.path >= hdr->strings_size)
+			return "(unknown)";
+		path = map->base + hdr->strings_offset + src.path;
+		if(deep == FALSE) {
+			if(stat(path, &st) < 0 || (uint64_t)st.st_size != src.size || (int64_t)st.st_mtime != src.mtime)
+				return path;
+			continue;
+			}
+		if(xodb_hash_file(path, &f) != OK || f.size != src.size || f.hash != src.hash)
+			return path;
+		}
+
+	return NULL;
+	}
+
+
+static uint32_t xodb_get(struct xodb_reader *rd) {
+	if(rd->pos >= rd->end) {
+		rd->error = TRUE;
+		return 0;
+		}
+	return *rd->pos++;
+	}
+
+
+static double xodb_get_double(struct xodb_reader *rd) {
+	uint32_t w[2];
+	double val;
+
+	w[0] = xodb_get(rd);
+	w[1] = xodb_get(rd);
+	memcpy(&val, w, sizeof(val));
+	return val;
+	}
+
+
+/* returns a string in the mapped file. It must be copied to be kept */
+static char *xodb_get_string(struct xodb_reader *rd) {
+	uint32_t off = xodb_get(rd);
+
+	if(!off)
+		return NULL;
+	if(off >= rd->heap_size) {
+		rd->error = TRUE;
+		return NULL;
+		}
+	return (char *)rd->heap + off;
+	}
+
+
+static char *xodb_dup_string(struct xodb_reader *rd) {
+	char *str = xodb_get_string(rd);
+
+	if(str && !(str = strdup(str)))
+		rd->error = TRUE;
+	return str;
+	}
+
+
+static char *xodb_get_timeperiod(struct xodb_reader *rd) {
+	uint32_t id = xodb_get(rd);
+
+	if(!id)
+		return NULL;
+	if(id > num_objects.timeperiods) {
+		rd->error = TRUE;
+		return NULL;
+		}
+	return timeperiod_ary[id - 1]->name;
+	}
+
+
+static char *xodb_get_contact(struct xodb_reader *rd) {
+	uint32_t id = xodb_get(rd);
+
+	if(id >= num_objects.contacts) {
+		rd->error = TRUE;
+		return NULL;
+		}
+	return contact_ary[id]->name;
+	}
+
+
+static char *xodb_get_contactgroup(struct xodb_reader *rd) {
+	uint32_t id = xodb_get(rd);
+
+	if(id >= num_objects.contactgroups) {
+		rd->error = TRUE;
+		return NULL;
+		}
+	return contactgroup_ary[id]->group_name;
+	}
+
+
+static host *xodb_get_host(struct xodb_reader *rd) {
+	uint32_t id = xodb_get(rd);
+
+	if(id >= num_objects.hosts) {
+		rd->error = TRUE;
+		return NULL;
+		}
+	return host_ary[id];
+	}
+
+
+static service *xodb_get_service(struct xodb_reader *rd) {
+	uint32_t id = xodb_get(rd);
+
+	if(id >= num_objects.services) {
+		rd->error = TRUE;
+		return NULL;
+		}
+	return service_ary[id];
+	}
+
+
+static int xodb_read_timeperiod(struct xodb_reader *rd) {
+	timeperiod *tp;
+	daterange *dr;
+	char *name, *alias;
+	int x, v[11], i;
+	uint32_t n, m, start;
+
+	name = xodb_dup_string(rd);
+	alias = xodb_dup_string(rd);
+	if(rd->error == TRUE || (tp = add_timeperiod(name, alias)) == NULL) {
+		my_free(name);
+		my_free(alias);
+		return ERROR;
+		}
+
+	for(x = 0; x < 7; x++) {
+		for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+			start = xodb_get(rd);
+			if(!add_timerange_to_timeperiod(tp, x, start, xodb_get(rd)))
+				return ERROR;
+			}
+		}
+
+	for(x = 0; x < DATERANGE_TYPES; x++) {
+		for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+			for(i = 0; i < 11; i++)
+				v[i] = (int)xodb_get(rd);
+			if(!(dr = add_exception_to_timeperiod(tp, x, v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], v[9], v[10])))
+				return ERROR;
+			for(m = xodb_get(rd); m > 0 && rd->error == FALSE; m--) {
+				start = xodb_get(rd);
+				if(!add_timerange_to_daterange(dr, start, xodb_get(rd)))
+					return ERROR;
+				}
+			}
+		}
+
+	for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+		if(!add_exclusion_to_timeperiod(tp, xodb_get_string(rd)))
+			return ERROR;
+		}
+
+	return rd->error == TRUE ? ERROR : OK;
+	}
+
+
+static int xodb_read_command(struct xodb_reader *rd) {
+	char *name, *command_line;
+
+	name = xodb_dup_string(rd);
+	command_line = xodb_dup_string(rd);
+	if(rd->error == TRUE || !add_command(name, command_line)) {
+		my_free(name);
+		my_free(command_line);
+		return ERROR;
+		}
+	return OK;
+	}
+
+
+static int xodb_read_contactgroup(struct xodb_reader *rd) {
+	char *name, *alias;
+
+	name = xodb_dup_string(rd);
+	alias = xodb_dup_string(rd);
+	if(rd->error == TRUE || !add_contactgroup(name, alias)) {
+		my_free(name);
+		my_free(alias);
+		return ERROR;
+		}
+	return OK;
+	}
+
+
+static int xodb_read_group(struct xodb_reader *rd, int is_hostgroup) {
+	char *name, *alias, *notes, *notes_url, *action_url;
+	void *grp;
+
+	name = xodb_dup_string(rd);
+	alias = xodb_dup_string(rd);
+	notes = xodb_dup_string(rd);
+	notes_url = xodb_dup_string(rd);
+	action_url = xodb_dup_string(rd);
+	if(rd->error == FALSE) {
+		if(is_hostgroup == TRUE)
+			grp = add_hostgroup(name, alias, notes, notes_url, action_url);
+		else
+			grp = add_servicegroup(name, alias, notes, notes_url, action_url);
+		if(grp != NULL)
+			return OK;
+		}
+
+	my_free(name);
+	my_free(alias);
+	my_free(notes);
+	my_free(notes_url);
+	my_free(action_url);
+	return ERROR;
+	}
+
+
+static int xodb_read_contact(struct xodb_reader *rd) {
+	contact tmp, *cntct;
+	char *name, *value;
+	uint32_t n;
+	int x;
+
+	memset(&tmp, 0, sizeof(tmp));
+	tmp.name = xodb_dup_string(rd);
+	tmp.alias = xodb_dup_string(rd);
+	tmp.email = xodb_dup_string(rd);
+	tmp.pager = xodb_dup_string(rd);
+	if(xodb_get(rd) != MAX_CONTACT_ADDRESSES)
+		rd->error = TRUE;
+	for(x = 0; x < MAX_CONTACT_ADDRESSES && rd->error == FALSE; x++)
+		tmp.address[x] = xodb_dup_string(rd);
+	tmp.service_notification_period = xodb_get_timeperiod(rd);
+	tmp.host_notification_period = xodb_get_timeperiod(rd);
+	tmp.service_notification_options = xodb_get(rd);
+	tmp.host_notification_options = xodb_get(rd);
+	tmp.host_notifications_enabled = xodb_get(rd);
+	tmp.service_notifications_enabled = xodb_get(rd);
+	tmp.can_submit_commands = xodb_get(rd);
+	tmp.retain_status_information = xodb_get(rd);
+	tmp.retain_nonstatus_information = xodb_get(rd);
+	tmp.minimum_value = xodb_get(rd);
+
+	cntct = NULL;
+	if(rd->error == FALSE)
+		cntct = add_contact(tmp.name, tmp.alias, tmp.email, tmp.pager, tmp.address, tmp.service_notification_period, tmp.host_notification_period, tmp.service_notification_options, tmp.host_notification_options, tmp.host_notifications_enabled, tmp.service_notifications_enabled, tmp.can_submit_commands, tmp.retain_status_information, tmp.retain_nonstatus_information, tmp.minimum_value);
+	if(cntct == NULL) {
+		my_free(tmp.name);
+		my_free(tmp.alias);
+		my_free(tmp.email);
+		my_free(tmp.pager);
+		for(x = 0; x < MAX_CONTACT_ADDRESSES; x++)
+			my_free(tmp.address[x]);
+		return ERROR;
+		}
+
+	for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+		if(!add_host_notification_command_to_contact(cntct, xodb_get_string(rd)))
+			return ERROR;
+		}
+	for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+		if(!add_service_notification_command_to_contact(cntct, xodb_get_string(rd)))
+			return ERROR;
+		}
+
+	for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+		name = xodb_get_string(rd);
+		value = xodb_get_string(rd);
+		if(rd->error == TRUE || !add_custom_variable_to_contact(cntct, name, value))
+			return ERROR;
+		}
+
+	return rd->error == TRUE ? ERROR : OK;
+	}
+
+
+static int xodb_read_host(struct xodb_reader *rd) {
+	host tmp, *hst;
+	char *name, *value;
+	uint32_t n;
+
+	memset(&tmp, 0, sizeof(tmp));
+	tmp.name = xodb_dup_string(rd);
+	tmp.display_name = xodb_dup_string(rd);
+	tmp.alias = xodb_dup_string(rd);
+	tmp.address = xodb_dup_string(rd);
+	tmp.check_period = xodb_get_timeperiod(rd);
+	tmp.initial_state = xodb_get(rd);
+	tmp.check_interval = xodb_get_double(rd);
+	tmp.retry_interval = xodb_get_double(rd);
+	tmp.max_attempts = xodb_get(rd);
+	tmp.notification_options = xodb_get(rd);
+	tmp.notification_interval = xodb_get_double(rd);
+	tmp.first_notification_delay = xodb_get_double(rd);
+	tmp.notification_period = xodb_get_timeperiod(rd);
+	tmp.notifications_enabled = xodb_get(rd);
+	tmp.check_command = intern_object_string(xodb_get_string(rd));
+	tmp.checks_enabled = xodb_get(rd);
+	tmp.accept_passive_checks = xodb_get(rd);
+	tmp.event_handler = intern_object_string(xodb_get_string(rd));
+	tmp.event_handler_enabled = xodb_get(rd);
+	tmp.event_handler_period = xodb_get_timeperiod(rd);
+	tmp.flap_detection_enabled = xodb_get(rd);
+	tmp.low_flap_threshold = xodb_get_double(rd);
+	tmp.high_flap_threshold = xodb_get_double(rd);
+	tmp.flap_detection_options = xodb_get(rd);
+	tmp.stalking_options = xodb_get(rd);
+	tmp.process_performance_data = xodb_get(rd);
+	tmp.check_freshness = xodb_get(rd);
+	tmp.freshness_threshold = xodb_get(rd);
+	tmp.notes = xodb_dup_string(rd);
+	tmp.notes_url = xodb_dup_string(rd);
+	tmp.action_url = xodb_dup_string(rd);
+	tmp.icon_image = xodb_dup_string(rd);
+	tmp.icon_image_alt = xodb_dup_string(rd);
+	tmp.vrml_image = xodb_dup_string(rd);
+	tmp.statusmap_image = xodb_dup_string(rd);
+	tmp.x_2d = xodb_get(rd);
+	tmp.y_2d = xodb_get(rd);
+	tmp.have_2d_coords = xodb_get(rd);
+	tmp.x_3d = xodb_get_double(rd);
+	tmp.y_3d = xodb_get_double(rd);
+	tmp.z_3d = xodb_get_double(rd);
+	tmp.have_3d_coords = xodb_get(rd);
+	tmp.should_be_drawn = xodb_get(rd);
+	tmp.retain_status_information = xodb_get(rd);
+	tmp.retain_nonstatus_information = xodb_get(rd);
+	tmp.obsess = xodb_get(rd);
+	tmp.hourly_value = xodb_get(rd);
+
+	hst = NULL;
+	if(rd->error == FALSE)
+		hst = add_host(tmp.name, tmp.display_name, tmp.alias, tmp.address, tmp.check_period, tmp.initial_state, tmp.check_interval, tmp.retry_interval, tmp.max_attempts, tmp.notification_options, tmp.notification_interval, tmp.first_notification_delay, tmp.notification_period, tmp.notifications_enabled, tmp.check_command, tmp.checks_enabled, tmp.accept_passive_checks, tmp.event_handler, tmp.event_handler_enabled, tmp.event_handler_period, tmp.flap_detection_enabled, tmp.low_flap_threshold, tmp.high_flap_threshold, tmp.flap_detection_options, tmp.stalking_options, tmp.process_performance_data, tmp.check_freshness, tmp.freshness_threshold, tmp.notes, tmp.notes_url, tmp.action_url, tmp.icon_image, tmp.icon_image_alt, tmp.vrml_image, tmp.statusmap_image, tmp.x_2d, tmp.y_2d, tmp.have_2d_coords, tmp.x_3d, tmp.y_3d, tmp.z_3d, tmp.have_3d_coords, tmp.should_be_drawn, tmp.retain_status_information, tmp.retain_nonstatus_information, tmp.obsess, tmp.hourly_value);
+	if(hst == NULL) {
+		my_free(tmp.name);
+		my_free(tmp.display_name);
+		my_free(tmp.alias);
+		my_free(tmp.address);
+		free_object_string(tmp.check_command);
+		free_object_string(tmp.event_handler);
+		my_free(tmp.notes);
+		my_free(tmp.notes_url);
+		my_free(tmp.action_url);
+		my_free(tmp.icon_image);
+		my_free(tmp.icon_image_alt);
+		my_free(tmp.vrml_image);
+		my_free(tmp.statusmap_image);
+		return ERROR;
+		}
+
+	for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+		if(!add_parent_host_to_host(hst, xodb_get_string(rd)))
+			return ERROR;
+		}
+	for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+		if(!add_contactgroup_to_host(hst, xodb_get_contactgroup(rd)))
+			return ERROR;
+		}
+	for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+		if(!add_contact_to_host(hst, xodb_get_contact(rd)))
+			return ERROR;
+		}
+	for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+		name = xodb_get_string(rd);
+		value = xodb_get_string(rd);
+		if(rd->error == TRUE || !add_custom_variable_to_host(hst, name, value))
+			return ERROR;
+		}
+
+	return rd->error == TRUE ? ERROR : OK;
+	}
+
+
+static int xodb_read_service(struct xodb_reader *rd) {
+	service tmp, *svc;
+	host *hst;
+	char *host_name, *description, *name, *value;
+	uint32_t n;
+
+	/* add_service() copies what it keeps, so the strings can stay in the map */
+	memset(&tmp, 0, sizeof(tmp));
+	hst = xodb_get_host(rd);
+	tmp.description = xodb_get_string(rd);
+	tmp.display_name = xodb_get_string(rd);
+	tmp.check_period = xodb_get_timeperiod(rd);
+	tmp.initial_state = xodb_get(rd);
+	tmp.max_attempts = xodb_get(rd);
+	tmp.parallelize = xodb_get(rd);
+	tmp.accept_passive_checks = xodb_get(rd);
+	tmp.check_interval = xodb_get_double(rd);
+	tmp.retry_interval = xodb_get_double(rd);
+	tmp.notification_interval = xodb_get_double(rd);
+	tmp.first_notification_delay = xodb_get_double(rd);
+	tmp.notification_period = xodb_get_timeperiod(rd);
+	tmp.notification_options = xodb_get(rd);
+	tmp.notifications_enabled = xodb_get(rd);
+	tmp.is_volatile = xodb_get(rd);
+	tmp.event_handler = xodb_get_string(rd);
+	tmp.event_handler_enabled = xodb_get(rd);
+	tmp.event_handler_period = xodb_get_timeperiod(rd);
+	tmp.check_command = xodb_get_string(rd);
+	tmp.checks_enabled = xodb_get(rd);
+	tmp.flap_detection_enabled = xodb_get(rd);
+	tmp.low_flap_threshold = xodb_get_double(rd);
+	tmp.high_flap_threshold = xodb_get_double(rd);
+	tmp.flap_detection_options = xodb_get(rd);
+	tmp.stalking_options = xodb_get(rd);
+	tmp.process_performance_data = xodb_get(rd);
+	tmp.check_freshness = xodb_get(rd);
+	tmp.freshness_threshold = xodb_get(rd);
+	tmp.notes = xodb_get_string(rd);
+	tmp.notes_url = xodb_get_string(rd);
+	tmp.action_url = xodb_get_string(rd);
+	tmp.icon_image = xodb_get_string(rd);
+	tmp.icon_image_alt = xodb_get_string(rd);
+	tmp.retain_status_information = xodb_get(rd);
+	tmp.retain_nonstatus_information = xodb_get(rd);
+	tmp.obsess = xodb_get(rd);
+	tmp.hourly_value = xodb_get(rd);
+
+	if(rd->error == TRUE)
+		return ERROR;
+	svc = add_service(hst->name, tmp.description, tmp.display_name, tmp.check_period, tmp.initial_state, tmp.max_attempts, tmp.parallelize, tmp.accept_passive_checks, tmp.check_interval, tmp.retry_interval, tmp.notification_interval, tmp.first_notification_delay, tmp.notification_period, tmp.notification_options, tmp.notifications_enabled, tmp.is_volatile, tmp.event_handler, tmp.event_handler_enabled, tmp.event_handler_period, tmp.check_command, tmp.checks_enabled, tmp.flap_detection_enabled, tmp.low_flap_threshold, tmp.high_flap_threshold, tmp.flap_detection_options, tmp.stalking_options, tmp.process_performance_data, tmp.check_freshness, tmp.freshness_threshold, tmp.notes, tmp.notes_url, tmp.action_url, tmp.icon_image, tmp.icon_image_alt, tmp.retain_status_information, tmp.retain_nonstatus_information, tmp.obsess, tmp.hourly_value);
+	if(svc == NULL)
+		return ERROR;
+
+	for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+		host_name = xodb_get_string(rd);
+		description = xodb_get_string(rd);
+		if(!add_parent_service_to_service(svc, host_name, description))
+			return ERROR;
+		}
+	for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+		if(!add_contactgroup_to_service(svc, xodb_get_contactgroup(rd)))
+			return ERROR;
+		}
+	for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+		if(!add_contact_to_service(svc, xodb_get_contact(rd)))
+			return ERROR;
+		}
+	for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+		name = xodb_get_string(rd);
+		value = xodb_get_string(rd);
+		if(rd->error == TRUE || !add_custom_variable_to_service(svc, name, value))
+			return ERROR;
+		}
+
+	return rd->error == TRUE ? ERROR : OK;
+	}
+
+
+static int xodb_read_members(struct xodb_reader *rd) {
+	unsigned int i;
+	uint32_t n;
+	char *name;
+	service *svc;
+
+	for(i = 0; i < num_objects.contactgroups; i++) {
+		for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+			if((name = xodb_get_contact(rd)) == NULL || !add_contact_to_contactgroup(contactgroup_ary[i], name))
+				return ERROR;
+			}
+		}
+	timing_point("%u contactgroups populated\n", num_objects.contactgroups);
+
+	for(i = 0; i < num_objects.hostgroups; i++) {
+		for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+			host *hst = xodb_get_host(rd);
+			if(hst == NULL || !add_host_to_hostgroup(hostgroup_ary[i], hst->name))
+				return ERROR;
+			}
+		}
+	timing_point("%u hostgroups populated\n", num_objects.hostgroups);
+
+	for(i = 0; i < num_objects.servicegroups; i++) {
+		for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+			if((svc = xodb_get_service(rd)) == NULL || !add_service_to_servicegroup(servicegroup_ary[i], svc->host_name, svc->description))
+				return ERROR;
+			}
+		}
+	timing_point("%u servicegroups populated\n", num_objects.servicegroups);
+
+	return rd->error == TRUE ? ERROR : OK;
+	}
+
+
+static int xodb_read_servicedependencies(struct xodb_reader *rd) {
+	service *child, *parent;
+	uint32_t n, m, x;
+	int type, inherits, options;
+	char *period;
+
+	for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+		if((child = xodb_get_service(rd)) == NULL)
+			return ERROR;
+		for(x = 0; x < 2; x++) {
+			for(m = xodb_get(rd); m > 0 && rd->error == FALSE; m--) {
+				parent = xodb_get_service(rd);
+				type = xodb_get(rd);
+				inherits = xodb_get(rd);
+				options = xodb_get(rd);
+				period = xodb_get_timeperiod(rd);
+				if(rd->error == TRUE || !add_service_dependency(child->host_name, child->description, parent->host_name, parent->description, type, inherits, options, period))
+					return ERROR;
+				}
+			}
+		}
+
+	return rd->error == TRUE ? ERROR : OK;
+	}
+
+
+static int xodb_read_hostdependencies(struct xodb_reader *rd) {
+	host *child, *parent;
+	uint32_t n, m, x;
+	int type, inherits, options;
+	char *period;
+
+	for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+		if((child = xodb_get_host(rd)) == NULL)
+			return ERROR;
+		for(x = 0; x < 2; x++) {
+			for(m = xodb_get(rd); m > 0 && rd->error == FALSE; m--) {
+				parent = xodb_get_host(rd);
+				type = xodb_get(rd);
+				inherits = xodb_get(rd);
+				options = xodb_get(rd);
+				period = xodb_get_timeperiod(rd);
+				if(rd->error == TRUE || !add_host_dependency(child->name, parent->name, type, inherits, options, period))
+					return ERROR;
+				}
+			}
+		}
+
+	return rd->error == TRUE ? ERROR : OK;
+	}
+
+
+static int xodb_read_serviceescalation(struct xodb_reader *rd) {
+	serviceescalation tmp, *se;
+	service *svc;
+	uint32_t n;
+
+	svc = xodb_get_service(rd);
+	tmp.first_notification = xodb_get(rd);
+	tmp.last_notification = xodb_get(rd);
+	tmp.notification_interval = xodb_get_double(rd);
+	tmp.escalation_period = xodb_get_timeperiod(rd);
+	tmp.escalation_options = xodb_get(rd);
+	if(rd->error == TRUE)
+		return ERROR;
+
+	se = add_serviceescalation(svc->host_name, svc->description, tmp.first_notification, tmp.last_notification, tmp.notification_interval, tmp.escalation_period, tmp.escalation_options);
+	if(se == NULL)
+		return ERROR;
+	for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+		if(!add_contactgroup_to_serviceescalation(se, xodb_get_contactgroup(rd)))
+			return ERROR;
+		}
+	for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+		if(!add_contact_to_serviceescalation(se, xodb_get_contact(rd)))
+			return ERROR;
+		}
+
+	return rd->error == TRUE ? ERROR : OK;
+	}
+
+
+static int xodb_read_hostescalation(struct xodb_reader *rd) {
+	hostescalation tmp, *he;
+	host *hst;
+	uint32_t n;
+
+	hst = xodb_get_host(rd);
+	tmp.first_notification = xodb_get(rd);
+	tmp.last_notification = xodb_get(rd);
+	tmp.notification_interval = xodb_get_double(rd);
+	tmp.escalation_period = xodb_get_timeperiod(rd);
+	tmp.escalation_options = xodb_get(rd);
+	if(rd->error == TRUE)
+		return ERROR;
+
+	he = add_hostescalation(hst->name, tmp.first_notification, tmp.last_notification, tmp.notification_interval, tmp.escalation_period, tmp.escalation_options);
+	if(he == NULL)
+		return ERROR;
+	for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+		if(!add_contactgroup_to_hostescalation(he, xodb_get_contactgroup(rd)))
+			return ERROR;
+		}
+	for(n = xodb_get(rd); n > 0 && rd->error == FALSE; n--) {
+		if(!add_contact_to_hostescalation(he, xodb_get_contact(rd)))
+			return ERROR;
+		}
+
+	return rd->error == TRUE ? ERROR : OK;
+	}
+
+
+/* registers the objects in a snapshot, the same way and in the same order the template engine does */
+static int xodb_register_objects(struct xodb_map *map) {
+	const struct xodb_header *hdr = &map->hdr;
+	struct xodb_reader rd;
+	unsigned int ocount[NUM_OBJECT_SKIPLISTS];
+	unsigned int i;
+
+	memset(ocount, 0, sizeof(ocount));
+	ocount[TIMEPERIOD_SKIPLIST] = hdr->num_timeperiods;
+	ocount[COMMAND_SKIPLIST] = hdr->num_commands;
+	ocount[CONTACTGROUP_SKIPLIST] = hdr->num_contactgroups;
+	ocount[HOSTGROUP_SKIPLIST] = hdr->num_hostgroups;
+	ocount[SERVICEGROUP_SKIPLIST] = hdr->num_servicegroups;
+	ocount[CONTACT_SKIPLIST] = hdr->num_contacts;
+	ocount[HOST_SKIPLIST] = hdr->num_hosts;
+	ocount[SERVICE_SKIPLIST] = hdr->num_services;
+	ocount[SERVICEESCALATION_SKIPLIST] = hdr->num_serviceescalations;
+	ocount[HOSTESCALATION_SKIPLIST] = hdr->num_hostescalations;
+
+	if(create_object_tables(ocount) != OK) {
+		logit(NSLOG_CONFIG_ERROR, TRUE, "Failed to create object tables\n");
+		return ERROR;
+		}
+
+	rd.pos = (const uint32_t *)(map->base + hdr->records_offset);
+	rd.end = rd.pos + hdr->records_size / sizeof(uint32_t);
+	rd.heap = map->base + hdr->strings_offset;
+	rd.heap_size = hdr->strings_size;
+	rd.error = FALSE;
+
+	for(i = 0; i < hdr->num_timeperiods; i++) {
+		if(xodb_read_timeperiod(&rd) != OK)
+			return ERROR;
+		}
+	timing_point("%u timeperiods registered\n", num_objects.timeperiods);
+
+	for(i = 0; i < hdr->num_commands; i++) {
+		if(xodb_read_command(&rd) != OK)
+			return ERROR;
+		}
+	timing_point("%u commands registered\n", num_objects.commands);
+
+	for(i = 0; i < hdr->num_contactgroups; i++) {
+		if(xodb_read_contactgroup(&rd) != OK)
+			return ERROR;
+		}
+	timing_point("%u contactgroups registered\n", num_objects.contactgroups);
+
+	for(i = 0; i < hdr->num_hostgroups; i++) {
+		if(xodb_read_group(&rd, TRUE) != OK)
+			return ERROR;
+		}
+	timing_point("%u hostgroups registered\n", num_objects.hostgroups);
+
+	for(i = 0; i < hdr->num_servicegroups; i++) {
+		if(xodb_read_group(&rd, FALSE) != OK)
+			return ERROR;
+		}
+	timing_point("%u servicegroups registered\n", num_objects.servicegroups);
+
+	for(i = 0; i < hdr->num_contacts; i++) {
+		if(xodb_read_contact(&rd) != OK)
+			return ERROR;
+		}
+	timing_point("%u contacts registered\n", num_objects.contacts);
+
+	for(i = 0; i < hdr->num_hosts; i++) {
+		if(xodb_read_host(&rd) != OK)
+			return ERROR;
+		}
+	timing_point("%u hosts registered\n", num_objects.hosts);
+
+	for(i = 0; i < hdr->num_services; i++) {
+		if(xodb_read_service(&rd) != OK)
+			return ERROR;
+		}
+	timing_point("%u services registered\n", num_objects.services);
+
+	if(xodb_read_members(&rd) != OK)
+		return ERROR;
+
+	if(xodb_read_servicedependencies(&rd) != OK)
+		return ERROR;
+	timing_point("%u servicedependencies registered\n", num_objects.servicedependencies);
+
+	for(i = 0; i < hdr->num_serviceescalations; i++) {
+		if(xodb_read_serviceescalation(&rd) != OK)
+			return ERROR;
+		}
+	timing_point("%u serviceescalations registered\n", num_objects.serviceescalations);
+
+	if(xodb_read_hostdependencies(&rd) != OK)
+		return ERROR;
+	timing_point("%u hostdependencies registered\n", num_objects.hostdependencies);
+
+	for(i = 0; i < hdr->num_hostescalations; i++) {
+		if(xodb_read_hostescalation(&rd) != OK)
+			return ERROR;
+		}
+	timing_point("%u hostescalations registered\n", num_objects.hostescalations);
+
+	/* everything must have been used up, and have come out the same */
+	if(rd.error == TRUE || rd.pos != rd.end
+	   || num_objects.servicedependencies != hdr->num_servicedependencies
+	   || num_objects.hostdependencies != hdr->num_hostdependencies)
+		return ERROR;
+
+	return OK;
+	}
+
+
+/* reads all objects from a binary snapshot */
+int xodbinary_read_object_config(const char *snapshot_file, int options) {
+	struct xodb_map map;
+	const char *stale;
+	int result;
+
+	timing_point("Reading object snapshot '%s'\n", snapshot_file);
+
+	if(xodb_map(snapshot_file, &map) != OK) {
+		logit(NSLOG_CONFIG_ERROR, TRUE, "Error: Unable to read object precache file '%s': %s\n", snapshot_file, strerror(errno));
+		return ERROR;
+		}
+
+	/* a stale snapshot is still used, since that's what we were asked to do */
+	if((stale = xodb_stale_source(&map, verify_config ? TRUE : FALSE)) != NULL)
+		logit(NSLOG_CONFIG_WARNING, TRUE, "Warning: Object precache file '%s' is older than '%s'. Run 'nagios -p' to bring it up to date.\n", snapshot_file, stale);
+
+	result = xodb_register_objects(&map);
+	xodb_unmap(&map);
+	if(result != OK) {
+		logit(NSLOG_CONFIG_ERROR, TRUE, "Error: Object precache file '%s' is damaged or was written by a different version of Nagios\n", snapshot_file);
+		return ERROR;
+		}
+	timing_point("Done registering objects from snapshot\n");
+
+	return OK;
+	}
+
+
+/*
+ * tells whether an existing snapshot was made from the config that
+ * was just read. Files that aren't snapshots are quietly ignored.
+ */
+int xodbinary_check_snapshot(const char *snapshot_file) {
+	struct xodb_map map;
+	int result = OK;
+
+	if(!sources.count || xodbinary_is_snapshot(snapshot_file) == FALSE)
+		return OK;
+
+	if(xodb_map(snapshot_file, &map) != OK) {
+		printf("Warning: Object precache file '%s' is damaged or was written by a different version of Nagios\n", snapshot_file);
+		return ERROR;
+		}
+
+	if(map.hdr.source_digest == sources.digest && map.hdr.num_sources == sources.count)
+		printf("   Object precache file '%s' is up to date\n", snapshot_file);
+	else {
+		printf("Warning: Object precache file '%s' was made from a different config. Run 'nagios -p' to bring it up to date.\n", snapshot_file);
+		result = ERROR;
+		}
+	xodb_unmap(&map);
+
+	return result;
+	}
+
+#endif
@@ -0,0 +1,97 @@
+/*****************************************************************************
+ *
+ * XODBINARY.H - Header file for binary object precache routines
+ *
+ *
+ * License:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *****************************************************************************/
+
+#ifndef NAGIOS_XODBINARY_H_INCLUDED
+#define NAGIOS_XODBINARY_H_INCLUDED
+
+#include <stdint.h>
+
+/*
+ * The binary precache file is a snapshot of the registered objects,
+ * written by 'nagios -p' and read back by 'nagios -u' without going
+ * anywhere near the template engine.
+ *
+ * After the header comes a table of the config files the objects were
+ * read from, then the object records and finally a heap of nul-terminated
+ * strings. Strings are referenced by their offset into the heap, with
+ * 0 meaning NULL. Objects are referenced by their id, and timeperiods
+ * by their id plus one, since they're optional.
+ *
+ * The records are a stream of 32-bit words (doubles take two) laid out
+ * the way they are fed to the add_*() functions, one object type at a
+ * time in the order the template engine registers them. Lists that those
+ * functions prepend to are stored last member first, so loading the file
+ * rebuilds the exact same lists, and the object ids, as the config did.
+ *
+ * The file is only meant to be read on the host that wrote it, so
+ * everything is stored in native byte order.
+ */
+#define XODBINARY_MAGIC          "NAGOBJPC"
+#define XODBINARY_VERSION        1
+#define XODBINARY_BYTE_ORDER     0x01020304
+
+/* a config file the snapshot was made from */
+struct xodb_source {
+	uint32_t path;              /* heap offset */
+	uint32_t pad;
+	uint64_t size;
+	int64_t mtime;
+	uint64_t hash;              /* of the contents */
+	};
+
+struct xodb_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t byte_order;
+	uint32_t num_sources;
+	int64_t created;
+	uint64_t source_digest;     /* over the paths and hashes of all sources */
+	uint32_t num_timeperiods;
+	uint32_t num_commands;
+	uint32_t num_contactgroups;
+	uint32_t num_hostgroups;
+	uint32_t num_servicegroups;
+	uint32_t num_contacts;
+	uint32_t num_hosts;
+	uint32_t num_services;
+	uint32_t num_servicedependencies;
+	uint32_t num_serviceescalations;
+	uint32_t num_hostdependencies;
+	uint32_t num_hostescalations;
+	uint64_t sources_offset;
+	uint64_t records_offset;
+	uint64_t records_size;
+	uint64_t strings_offset;
+	uint64_t strings_size;
+	uint64_t file_size;
+	};
+
+#ifdef NSCORE
+int xodbinary_set_sources(const char *, char **, int);
+int xodbinary_is_snapshot(const char *);
+int xodbinary_write_object_config(const char *);
+int xodbinary_read_object_config(const char *, int);
+int xodbinary_check_snapshot(const char *);
+#endif
+
+#endif
@@ -55,6 +55,7 @@
 
 #ifdef NSCORE
 #include "../include/nagios.h"
+#include "xodbinary.h"
 #endif
 
 #ifdef NSCGI
@@ -205,6 +206,12 @@ int xodtemplate_read_config_data(const char *main_config_file, int options) {
 		return ERROR;
 		}
 
+#ifdef NSCORE
+	/* binary snapshots don't need the template engine at all */
+	if(use_precached_objects == TRUE && xodbinary_is_snapshot(object_precache_file) == TRUE)
+		return xodbinary_read_object_config(object_precache_file, options);
+#endif
+
 	timing_point("Reading config data from '%s'\n", main_config_file);
 
 	/* initialize variables */
@@ -449,6 +456,12 @@ int xodtemplate_read_config_data(const char *main_config_file, int options) {
 	if(test_scheduling == TRUE)
 		gettimeofday(&tv[10], NULL);
 
+#ifdef NSCORE
+	/* remember what we read, so a snapshot can be checked against it */
+	if(use_precached_objects == FALSE && (verify_config || precache_objects))
+		xodbinary_set_sources(main_config_file, xodtemplate_config_files, xodtemplate_current_config_file);
+#endif
+
 	/* cleanup */
 	xodtemplate_free_memory();
 #ifdef NSCORE
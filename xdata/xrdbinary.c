@@ -0,0 +1,1730 @@
+/*****************************************************************************
+ *
+ * XRDBINARY.C - Binary state retention routines for Nagios
+ *
+ *
+ * License:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *****************************************************************************/
+
+
+/*********** COMMON HEADER FILES ***********/
+
+#include "../include/config.h"
+#include "../include/common.h"
+#include "../include/objects.h"
+#include "../include/statusdata.h"
+#include "../include/comments.h"
+#include "../include/downtime.h"
+#include "../include/nagios.h"
+#include "../include/sretention.h"
+#include "../include/snapshot.h"
+#include "xrddefault.h"
+#include "xrdbinary.h"
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+
+#define XRDB_ALIGN(x) (((x) + 7) & ~((uint64_t)7))
+#define XRDB_HASH_INIT           0xcbf29ce484222325ULL
+#define XRDB_APPEND_BUFSIZE      (64 * 1024)
+
+/* don't bother compacting the heap until this much of it is wasted */
+#define XRDB_MIN_WASTE           (1024 * 1024)
+
+/* string hashes kept per host and service: the three outputs plus one for the rest */
+#define XRDB_HASHES              4
+
+/* the slots are restored by at most this many threads, with at least this many slots each */
+#define XRDB_MAX_THREADS         8
+#define XRDB_MIN_CHUNK           16384
+
+static struct {
+	int fd;
+	ino_t inode;
+	uint64_t heap_end;
+	uint64_t heap_waste;
+	unsigned long bytes_written;
+	struct xrdb_header hdr;
+	struct xrdb_host *hosts;        /* the slots as they are on disk */
+	struct xrdb_service *services;
+	struct xrdb_contact *contacts;
+	uint64_t *host_hashes;
+	uint64_t *service_hashes;
+	uint64_t *contact_hashes;
+	uint64_t header_hashes[3];      /* comments, downtimes and the program strings */
+	unsigned char *dirty;           /* hosts, then services, then contacts */
+	char *appendbuf;
+	size_t appendlen;
+	uint64_t appendoff;
+	char *blob;
+	size_t blob_len, blob_size;
+	} rdb = { -1 };
+
+struct xrdb_map {
+	const char *base;
+	size_t size;
+	struct xrdb_header hdr;
+	host **hosts;                   /* what each slot is restored to */
+	service **services;
+	contact **contacts;
+	int scheduling_info_is_ok;
+	};
+
+/* a range of host and service slots handled by one thread */
+struct xrdb_job {
+	struct xrdb_map *map;
+	int (*fn)(struct xrdb_map *, unsigned int);
+	unsigned int start, end;
+	int result;
+	};
+
+
+/******************************************************************/
+/********************* INIT/CLEANUP FUNCTIONS *********************/
+/******************************************************************/
+
+static void xrdb_close(void) {
+	if(rdb.fd >= 0)
+		close(rdb.fd);
+	rdb.fd = -1;
+	my_free(rdb.hosts);
+	my_free(rdb.services);
+	my_free(rdb.contacts);
+	my_free(rdb.host_hashes);
+	my_free(rdb.service_hashes);
+	my_free(rdb.contact_hashes);
+	my_free(rdb.dirty);
+	}
+
+
+/* cleanup binary retention data before terminating */
+int xrdbinary_cleanup_retention_data(void) {
+
+	xrdb_close();
+	my_free(rdb.appendbuf);
+	my_free(rdb.blob);
+	rdb.blob_len = rdb.blob_size = 0;
+
+	/* free memory */
+	my_free(binary_retention_file);
+
+	return OK;
+	}
+
+
+/******************************************************************/
+/******************* RETENTION OUTPUT FUNCTIONS *******************/
+/******************************************************************/
+
+static uint64_t xrdb_hash(uint64_t h, const void *data, size_t len) {
+	const unsigned char *p = data;
+	size_t i;
+
+	for(i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+		}
+
+	return h;
+	}
+
+
+/* hashes a string so that NULL and "" come out different */
+static uint64_t xrdb_hash_string(uint64_t h, const char *str) {
+	if(str == NULL)
+		return xrdb_hash(h, "\xff", 1);
+	return xrdb_hash(h, str, strlen(str) + 1);
+	}
+
+
+static int xrdb_pwrite(const void *buf, size_t len, uint64_t off) {
+	const char *p = buf;
+	ssize_t ret;
+
+	rdb.bytes_written += len;
+	while(len > 0) {
+		ret = pwrite(rdb.fd, p, len, (off_t)off);
+		if(ret < 0) {
+			if(errno == EINTR)
+				continue;
+			return ERROR;
+			}
+		p += ret;
+		len -= ret;
+		off += ret;
+		}
+
+	return OK;
+	}
+
+
+static int xrdb_flush_append(void) {
+	if(!rdb.appendlen)
+		return OK;
+	if(xrdb_pwrite(rdb.appendbuf, rdb.appendlen, rdb.appendoff) != OK)
+		return ERROR;
+	rdb.appendoff += rdb.appendlen;
+	rdb.appendlen = 0;
+	return OK;
+	}
+
+
+/*
+ * Points a slot string at a new copy of 'len' bytes of data at the end
+ * of the heap. The copy is nul-terminated and padded to 8 bytes, and
+ * the space taken by the old one is only reclaimed by a new layout.
+ */
+static int xrdb_set_string(struct xrdb_string *s, const char *data, size_t len) {
+	uint64_t size;
+	int result = OK;
+
+	if(s->offset)
+		rdb.heap_waste += XRDB_ALIGN(s->len + 1);
+
+	if(data == NULL || len > UINT32_MAX - 1) {
+		s->offset = 0;
+		s->len = 0;
+		return OK;
+		}
+
+	size = XRDB_ALIGN(len + 1);
+	s->offset = rdb.heap_end;
+	s->len = len;
+	rdb.heap_end += size;
+
+	if(rdb.appendlen + size > XRDB_APPEND_BUFSIZE && xrdb_flush_append() != OK)
+		return ERROR;
+
+	/* too big to buffer. The padding is left as a hole in the file */
+	if(size > XRDB_APPEND_BUFSIZE) {
+		if(xrdb_pwrite(data, len, s->offset) != OK || xrdb_pwrite("", 1, s->offset + len) != OK)
+			result = ERROR;
+		rdb.appendoff = s->offset + size;
+		return result;
+		}
+
+	memcpy(rdb.appendbuf + rdb.appendlen, data, len);
+	memset(rdb.appendbuf + rdb.appendlen + len, 0, size - len);
+	rdb.appendlen += size;
+	return OK;
+	}
+
+
+/* updates a slot string, unless it's the same as the last time it was written */
+static int xrdb_set_hashed_string(struct xrdb_string *s, uint64_t *hash, const char *str, int full) {
+	uint64_t h = xrdb_hash_string(XRDB_HASH_INIT, str);
+
+	if(full == FALSE && *hash == h)
+		return OK;
+	*hash = h;
+	return xrdb_set_string(s, str, str ? strlen(str) : 0);
+	}
+
+
+static void xrdb_blob_add(const void *data, size_t len) {
+	size_t need = XRDB_ALIGN(rdb.blob_len + len);
+	char *p;
+
+	if(need > rdb.blob_size) {
+		p = realloc(rdb.blob, need * 2);
+		if(p == NULL)
+			return;
+		rdb.blob = p;
+		rdb.blob_size = need * 2;
+		}
+	memcpy(rdb.blob + rdb.blob_len, data, len);
+	rdb.blob_len += len;
+	}
+
+
+static void xrdb_blob_add_string(const char *str, uint32_t *lenp) {
+	*lenp = str ? strlen(str) : 0;
+	xrdb_blob_add(str ? str : "", *lenp + 1);
+	}
+
+
+static void xrdb_blob_pad(void) {
+	static const char zero[8];
+	xrdb_blob_add(zero, XRDB_ALIGN(rdb.blob_len) - rdb.blob_len);
+	}
+
+
+/* collects the modified custom variables of an object in the blob */
+static void xrdb_build_custom_variables(customvariablesmember *list, unsigned long modified_attributes) {
+	customvariablesmember *temp_customvariablesmember;
+
+	rdb.blob_len = 0;
+	if(!(modified_attributes & MODATTR_CUSTOM_VARIABLE))
+		return;
+
+	for(temp_customvariablesmember = list; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
+		if(temp_customvariablesmember->has_been_modified == FALSE || temp_customvariablesmember->variable_name == NULL)
+			continue;
+		xrdb_blob_add(temp_customvariablesmember->variable_name, strlen(temp_customvariablesmember->variable_name) + 1);
+		if(temp_customvariablesmember->variable_value)
+			xrdb_blob_add(temp_customvariablesmember->variable_value, strlen(temp_customvariablesmember->variable_value) + 1);
+		else
+			xrdb_blob_add("", 1);
+		}
+	}
+
+
+/* stores the blob built by xrdb_build_custom_variables() */
+static int xrdb_set_custom_variables(struct xrdb_string *s) {
+	if(!rdb.blob_len)
+		return xrdb_set_string(s, NULL, 0);
+	return xrdb_set_string(s, rdb.blob, rdb.blob_len - 1);
+	}
+
+
+static void xrdb_build_comments(const struct state_snapshot *snap) {
+	struct xrdb_comment rec;
+	nagios_comment *temp_comment;
+	size_t start;
+
+	rdb.blob_len = 0;
+	for(temp_comment = snap->comment_list; temp_comment != NULL; temp_comment = temp_comment->next) {
+		memset(&rec, 0, sizeof(rec));
+		rec.comment_id = temp_comment->comment_id;
+		rec.entry_time = temp_comment->entry_time;
+		rec.expire_time = temp_comment->expire_time;
+		rec.comment_type = temp_comment->comment_type;
+		rec.entry_type = temp_comment->entry_type;
+		rec.source = temp_comment->source;
+		rec.persistent = temp_comment->persistent;
+		rec.expires = temp_comment->expires;
+
+		start = rdb.blob_len;
+		xrdb_blob_add(&rec, sizeof(rec));
+		xrdb_blob_add_string(temp_comment->host_name, &rec.lengths[0]);
+		xrdb_blob_add_string(temp_comment->comment_type == SERVICE_COMMENT ? temp_comment->service_description : NULL, &rec.lengths[1]);
+		xrdb_blob_add_string(temp_comment->author, &rec.lengths[2]);
+		xrdb_blob_add_string(temp_comment->comment_data, &rec.lengths[3]);
+		xrdb_blob_pad();
+		if(rdb.blob_len >= start + sizeof(rec))
+			memcpy(rdb.blob + start, &rec, sizeof(rec));
+		}
+	}
+
+
+static void xrdb_build_downtimes(const struct state_snapshot *snap) {
+	struct xrdb_downtime rec;
+	scheduled_downtime *temp_downtime;
+	size_t start;
+
+	rdb.blob_len = 0;
+	for(temp_downtime = snap->scheduled_downtime_list; temp_downtime != NULL; temp_downtime = temp_downtime->next) {
+		memset(&rec, 0, sizeof(rec));
+		rec.downtime_id = temp_downtime->downtime_id;
+		rec.triggered_by = temp_downtime->triggered_by;
+		rec.duration = temp_downtime->duration;
+		rec.entry_time = temp_downtime->entry_time;
+		rec.start_time = temp_downtime->start_time;
+		rec.flex_downtime_start = temp_downtime->flex_downtime_start;
+		rec.end_time = temp_downtime->end_time;
+		rec.type = temp_downtime->type;
+		rec.fixed = temp_downtime->fixed;
+		rec.is_in_effect = temp_downtime->is_in_effect;
+		rec.start_notification_sent = temp_downtime->start_notification_sent;
+
+		start = rdb.blob_len;
+		xrdb_blob_add(&rec, sizeof(rec));
+		xrdb_blob_add_string(temp_downtime->host_name, &rec.lengths[0]);
+		xrdb_blob_add_string(temp_downtime->type == SERVICE_DOWNTIME ? temp_downtime->service_description : NULL, &rec.lengths[1]);
+		xrdb_blob_add_string(temp_downtime->author, &rec.lengths[2]);
+		xrdb_blob_add_string(temp_downtime->comment, &rec.lengths[3]);
+		xrdb_blob_pad();
+		if(rdb.blob_len >= start + sizeof(rec))
+			memcpy(rdb.blob + start, &rec, sizeof(rec));
+		}
+	}
+
+
+/* stores the blob if it has changed since the last time */
+static int xrdb_set_blob(struct xrdb_string *s, uint64_t *hash, int full) {
+	uint64_t h = xrdb_hash(XRDB_HASH_INIT, rdb.blob, rdb.blob_len);
+
+	if(full == FALSE && *hash == h)
+		return OK;
+	*hash = h;
+	return xrdb_set_string(s, rdb.blob_len ? rdb.blob : "", rdb.blob_len);
+	}
+
+
+static void xrdb_fill_host(struct xrdb_host *slot, const struct snapshot_host *hst) {
+	int x;
+
+	slot->modified_attributes = hst->modified_attributes & ~retained_host_attribute_mask;
+	slot->last_event_id = hst->last_event_id;
+	slot->current_event_id = hst->current_event_id;
+	slot->current_problem_id = hst->current_problem_id;
+	slot->last_problem_id = hst->last_problem_id;
+	slot->current_notification_id = hst->current_notification_id;
+	slot->flapping_comment_id = hst->flapping_comment_id;
+	slot->last_check = hst->last_check;
+	slot->next_check = hst->next_check;
+	slot->last_state_change = hst->last_state_change;
+	slot->last_hard_state_change = hst->last_hard_state_change;
+	slot->last_time_up = hst->last_time_up;
+	slot->last_time_down = hst->last_time_down;
+	slot->last_time_unreachable = hst->last_time_unreachable;
+	slot->last_notification = hst->last_notification;
+	slot->execution_time = hst->execution_time;
+	slot->latency = hst->latency;
+	slot->percent_state_change = hst->percent_state_change;
+	slot->check_interval = hst->check_interval;
+	slot->retry_interval = hst->retry_interval;
+	slot->has_been_checked = hst->has_been_checked;
+	slot->check_type = hst->check_type;
+	slot->current_state = hst->current_state;
+	slot->last_state = hst->last_state;
+	slot->last_hard_state = hst->last_hard_state;
+	slot->check_options = hst->check_options;
+	slot->current_attempt = hst->current_attempt;
+	slot->max_attempts = hst->max_attempts;
+	slot->state_type = hst->state_type;
+	slot->notified_on = hst->notified_on & (OPT_DOWN | OPT_UNREACHABLE);
+	slot->current_notification_number = hst->current_notification_number;
+	slot->notifications_enabled = hst->notifications_enabled;
+	slot->problem_has_been_acknowledged = hst->problem_has_been_acknowledged;
+	slot->acknowledgement_type = hst->acknowledgement_type;
+	slot->checks_enabled = hst->checks_enabled;
+	slot->accept_passive_checks = hst->accept_passive_checks;
+	slot->event_handler_enabled = hst->event_handler_enabled;
+	slot->flap_detection_enabled = hst->flap_detection_enabled;
+	slot->process_performance_data = hst->process_performance_data;
+	slot->obsess = hst->obsess;
+	slot->is_flapping = hst->is_flapping;
+	slot->check_flapping_recovery_notification = hst->check_flapping_recovery_notification;
+	for(x = 0; x < MAX_STATE_HISTORY_ENTRIES; x++)
+		slot->state_history[x] = hst->state_history[x];
+	}
+
+
+static void xrdb_fill_service(struct xrdb_service *slot, const struct snapshot_service *svc) {
+	int x;
+
+	slot->modified_attributes = svc->modified_attributes & ~retained_service_attribute_mask;
+	slot->last_event_id = svc->last_event_id;
+	slot->current_event_id = svc->current_event_id;
+	slot->current_problem_id = svc->current_problem_id;
+	slot->last_problem_id = svc->last_problem_id;
+	slot->current_notification_id = svc->current_notification_id;
+	slot->flapping_comment_id = svc->flapping_comment_id;
+	slot->last_check = svc->last_check;
+	slot->next_check = svc->next_check;
+	slot->last_state_change = svc->last_state_change;
+	slot->last_hard_state_change = svc->last_hard_state_change;
+	slot->last_time_ok = svc->last_time_ok;
+	slot->last_time_warning = svc->last_time_warning;
+	slot->last_time_unknown = svc->last_time_unknown;
+	slot->last_time_critical = svc->last_time_critical;
+	slot->last_notification = svc->last_notification;
+	slot->execution_time = svc->execution_time;
+	slot->latency = svc->latency;
+	slot->percent_state_change = svc->percent_state_change;
+	slot->check_interval = svc->check_interval;
+	slot->retry_interval = svc->retry_interval;
+	slot->has_been_checked = svc->has_been_checked;
+	slot->check_type = svc->check_type;
+	slot->current_state = svc->current_state;
+	slot->last_state = svc->last_state;
+	slot->last_hard_state = svc->last_hard_state;
+	slot->check_options = svc->check_options;
+	slot->current_attempt = svc->current_attempt;
+	slot->max_attempts = svc->max_attempts;
+	slot->state_type = svc->state_type;
+	slot->notified_on = svc->notified_on & (OPT_UNKNOWN | OPT_WARNING | OPT_CRITICAL);
+	slot->current_notification_number = svc->current_notification_number;
+	slot->notifications_enabled = svc->notifications_enabled;
+	slot->problem_has_been_acknowledged = svc->problem_has_been_acknowledged;
+	slot->acknowledgement_type = svc->acknowledgement_type;
+	slot->checks_enabled = svc->checks_enabled;
+	slot->accept_passive_checks = svc->accept_passive_checks;
+	slot->event_handler_enabled = svc->event_handler_enabled;
+	slot->flap_detection_enabled = svc->flap_detection_enabled;
+	slot->process_performance_data = svc->process_performance_data;
+	slot->obsess = svc->obsess;
+	slot->is_flapping = svc->is_flapping;
+	slot->check_flapping_recovery_notification = svc->check_flapping_recovery_notification;
+	for(x = 0; x < MAX_STATE_HISTORY_ENTRIES; x++)
+		slot->state_history[x] = svc->state_history[x];
+	}
+
+
+static void xrdb_fill_contact(struct xrdb_contact *slot, const struct snapshot_contact *cntct) {
+	slot->modified_attributes = cntct->modified_attributes;
+	slot->modified_host_attributes = cntct->modified_host_attributes & ~retained_contact_host_attribute_mask;
+	slot->modified_service_attributes = cntct->modified_service_attributes & ~retained_contact_service_attribute_mask;
+	slot->last_host_notification = cntct->last_host_notification;
+	slot->last_service_notification = cntct->last_service_notification;
+	slot->host_notifications_enabled = cntct->host_notifications_enabled;
+	slot->service_notifications_enabled = cntct->service_notifications_enabled;
+	}
+
+
+static void xrdb_fill_program(struct xrdb_header *hdr, const struct snapshot_program *sp) {
+	struct xrdb_program *p = &hdr->program;
+
+	hdr->info.last_update_check = sp->last_update_check;
+	hdr->info.update_uid = sp->update_uid;
+	hdr->info.update_available = sp->update_available;
+
+	p->modified_host_attributes = sp->modified_host_process_attributes & ~retained_process_host_attribute_mask;
+	p->modified_service_attributes = sp->modified_service_process_attributes & ~retained_process_service_attribute_mask;
+	p->next_comment_id = sp->next_comment_id;
+	p->next_downtime_id = sp->next_downtime_id;
+	p->next_event_id = sp->next_event_id;
+	p->next_problem_id = sp->next_problem_id;
+	p->next_notification_id = sp->next_notification_id;
+	p->enable_notifications = sp->enable_notifications;
+	p->execute_service_checks = sp->execute_service_checks;
+	p->accept_passive_service_checks = sp->accept_passive_service_checks;
+	p->execute_host_checks = sp->execute_host_checks;
+	p->accept_passive_host_checks = sp->accept_passive_host_checks;
+	p->enable_event_handlers = sp->enable_event_handlers;
+	p->obsess_over_services = sp->obsess_over_services;
+	p->obsess_over_hosts = sp->obsess_over_hosts;
+	p->check_service_freshness = sp->check_service_freshness;
+	p->check_host_freshness = sp->check_host_freshness;
+	p->enable_flap_detection = sp->enable_flap_detection;
+	p->process_performance_data = sp->process_performance_data;
+	}
+
+
+static int xrdb_set_program_strings(struct xrdb_header *hdr, const struct snapshot_program *sp, int full) {
+	uint64_t h = XRDB_HASH_INIT;
+
+	h = xrdb_hash_string(h, PROGRAM_VERSION);
+	h = xrdb_hash_string(h, sp->last_program_version);
+	h = xrdb_hash_string(h, sp->new_program_version);
+	h = xrdb_hash_string(h, sp->global_host_event_handler);
+	h = xrdb_hash_string(h, sp->global_service_event_handler);
+	if(full == FALSE && rdb.header_hashes[2] == h)
+		return OK;
+	rdb.header_hashes[2] = h;
+
+	if(xrdb_set_string(&hdr->info.version, PROGRAM_VERSION, strlen(PROGRAM_VERSION)) != OK
+	   || xrdb_set_string(&hdr->info.last_version, sp->last_program_version, sp->last_program_version ? strlen(sp->last_program_version) : 0) != OK
+	   || xrdb_set_string(&hdr->info.new_version, sp->new_program_version, sp->new_program_version ? strlen(sp->new_program_version) : 0) != OK
+	   || xrdb_set_string(&hdr->program.global_host_event_handler, sp->global_host_event_handler, sp->global_host_event_handler ? strlen(sp->global_host_event_handler) : 0) != OK
+	   || xrdb_set_string(&hdr->program.global_service_event_handler, sp->global_service_event_handler, sp->global_service_event_handler ? strlen(sp->global_service_event_handler) : 0) != OK)
+		return ERROR;
+
+	return OK;
+	}
+
+
+/* only what can actually be restored is stored, see xrdb_restore_host_config() */
+static int xrdb_set_host_strings(struct xrdb_host *slot, uint64_t *hashes, const struct snapshot_host *hst, int full) {
+	unsigned long mattr = slot->modified_attributes;
+	const char *check_command = (mattr & MODATTR_CHECK_COMMAND) ? hst->check_command : NULL;
+	const char *check_period = (mattr & MODATTR_CHECK_TIMEPERIOD) ? hst->check_period : NULL;
+	const char *notification_period = (mattr & MODATTR_NOTIFICATION_TIMEPERIOD) ? hst->notification_period : NULL;
+	const char *event_handler = (mattr & MODATTR_EVENT_HANDLER_COMMAND) ? hst->event_handler : NULL;
+	const char *event_handler_period = (mattr & MODATTR_EVENT_HANDLER_TIMEPERIOD) ? hst->event_handler_period : NULL;
+	uint64_t h = XRDB_HASH_INIT;
+
+	if(xrdb_set_hashed_string(&slot->plugin_output, &hashes[0], hst->plugin_output, full) != OK
+	   || xrdb_set_hashed_string(&slot->long_plugin_output, &hashes[1], hst->long_plugin_output, full) != OK
+	   || xrdb_set_hashed_string(&slot->perf_data, &hashes[2], hst->perf_data, full) != OK)
+		return ERROR;
+
+	xrdb_build_custom_variables(hst->custom_variables, mattr);
+	h = xrdb_hash_string(h, check_command);
+	h = xrdb_hash_string(h, check_period);
+	h = xrdb_hash_string(h, notification_period);
+	h = xrdb_hash_string(h, event_handler);
+	h = xrdb_hash_string(h, event_handler_period);
+	h = xrdb_hash(h, rdb.blob, rdb.blob_len);
+	if(full == FALSE && hashes[3] == h)
+		return OK;
+	hashes[3] = h;
+
+	if(xrdb_set_string(&slot->check_command, check_command, check_command ? strlen(check_command) : 0) != OK
+	   || xrdb_set_string(&slot->check_period, check_period, check_period ? strlen(check_period) : 0) != OK
+	   || xrdb_set_string(&slot->notification_period, notification_period, notification_period ? strlen(notification_period) : 0) != OK
+	   || xrdb_set_string(&slot->event_handler, event_handler, event_handler ? strlen(event_handler) : 0) != OK
+	   || xrdb_set_string(&slot->event_handler_period, event_handler_period, event_handler_period ? strlen(event_handler_period) : 0) != OK
+	   || xrdb_set_custom_variables(&slot->custom_variables) != OK)
+		return ERROR;
+
+	return OK;
+	}
+
+
+static int xrdb_set_service_strings(struct xrdb_service *slot, uint64_t *hashes, const struct snapshot_service *svc, int full) {
+	unsigned long mattr = slot->modified_attributes;
+	const char *check_command = (mattr & MODATTR_CHECK_COMMAND) ? svc->check_command : NULL;
+	const char *check_period = (mattr & MODATTR_CHECK_TIMEPERIOD) ? svc->check_period : NULL;
+	const char *notification_period = (mattr & MODATTR_NOTIFICATION_TIMEPERIOD) ? svc->notification_period : NULL;
+	const char *event_handler = (mattr & MODATTR_EVENT_HANDLER_COMMAND) ? svc->event_handler : NULL;
+	const char *event_handler_period = (mattr & MODATTR_EVENT_HANDLER_TIMEPERIOD) ? svc->event_handler_period : NULL;
+	uint64_t h = XRDB_HASH_INIT;
+
+	if(xrdb_set_hashed_string(&slot->plugin_output, &hashes[0], svc->plugin_output, full) != OK
+	   || xrdb_set_hashed_string(&slot->long_plugin_output, &hashes[1], svc->long_plugin_output, full) != OK
+	   || xrdb_set_hashed_string(&slot->perf_data, &hashes[2], svc->perf_data, full) != OK)
+		return ERROR;
+
+	xrdb_build_custom_variables(svc->custom_variables, mattr);
+	h = xrdb_hash_string(h, check_command);
+	h = xrdb_hash_string(h, check_period);
+	h = xrdb_hash_string(h, notification_period);
+	h = xrdb_hash_string(h, event_handler);
+	h = xrdb_hash_string(h, event_handler_period);
+	h = xrdb_hash(h, rdb.blob, rdb.blob_len);
+	if(full == FALSE && hashes[3] == h)
+		return OK;
+	hashes[3] = h;
+
+	if(xrdb_set_string(&slot->check_command, check_command, check_command ? strlen(check_command) : 0) != OK
+	   || xrdb_set_string(&slot->check_period, check_period, check_period ? strlen(check_period) : 0) != OK
+	   || xrdb_set_string(&slot->notification_period, notification_period, notification_period ? strlen(notification_period) : 0) != OK
+	   || xrdb_set_string(&slot->event_handler, event_handler, event_handler ? strlen(event_handler) : 0) != OK
+	   || xrdb_set_string(&slot->event_handler_period, event_handler_period, event_handler_period ? strlen(event_handler_period) : 0) != OK
+	   || xrdb_set_custom_variables(&slot->custom_variables) != OK)
+		return ERROR;
+
+	return OK;
+	}
+
+
+static int xrdb_set_contact_strings(struct xrdb_contact *slot, uint64_t *hash, const struct snapshot_contact *cntct, int full) {
+	const char *host_notification_period = (slot->modified_host_attributes & MODATTR_NOTIFICATION_TIMEPERIOD) ? cntct->host_notification_period : NULL;
+	const char *service_notification_period = (slot->modified_service_attributes & MODATTR_NOTIFICATION_TIMEPERIOD) ? cntct->service_notification_period : NULL;
+	uint64_t h = XRDB_HASH_INIT;
+
+	xrdb_build_custom_variables(cntct->custom_variables, slot->modified_attributes);
+	h = xrdb_hash_string(h, host_notification_period);
+	h = xrdb_hash_string(h, service_notification_period);
+	h = xrdb_hash(h, rdb.blob, rdb.blob_len);
+	if(full == FALSE && *hash == h)
+		return OK;
+	*hash = h;
+
+	if(xrdb_set_string(&slot->host_notification_period, host_notification_period, host_notification_period ? strlen(host_notification_period) : 0) != OK
+	   || xrdb_set_string(&slot->service_notification_period, service_notification_period, service_notification_period ? strlen(service_notification_period) : 0) != OK
+	   || xrdb_set_custom_variables(&slot->custom_variables) != OK)
+		return ERROR;
+
+	return OK;
+	}
+
+
+/* writes the slots marked dirty, consecutive ones with a single call */
+static int xrdb_write_slots(const void *slots, size_t slot_size, const unsigned char *dirty, unsigned int count, uint64_t offset) {
+	const char *base = slots;
+	unsigned int i, run;
+
+	for(i = 0; i < count; i++) {
+		if(!dirty[i])
+			continue;
+		for(run = i; i < count && dirty[i]; i++)
+			;
+		if(xrdb_pwrite(base + (size_t)run * slot_size, (size_t)(i - run) * slot_size, offset + (uint64_t)run * slot_size) != OK)
+			return ERROR;
+		}
+
+	return OK;
+	}
+
+
+/* creates a new, empty retention file and resets our view of it */
+static int xrdb_layout(char **tmp_file, const struct state_snapshot *snap) {
+	struct xrdb_header *hdr = &rdb.hdr;
+	unsigned int nhosts = snap->num_hosts, nservices = snap->num_services, ncontacts = snap->num_contacts;
+	uint64_t h;
+	unsigned int i;
+
+	xrdb_close();
+
+	asprintf(tmp_file, "%s.XXXXXX", binary_retention_file);
+	if(*tmp_file == NULL)
+		return ERROR;
+
+	if((rdb.fd = mkstemp(*tmp_file)) == -1) {
+		logit(NSLOG_RUNTIME_ERROR, TRUE, "Error: Unable to create temp file '%s' for writing binary retention data: %s\n", *tmp_file, strerror(errno));
+		return ERROR;
+		}
+
+	rdb.hosts = calloc(nhosts ? nhosts : 1, sizeof(*rdb.hosts));
+	rdb.services = calloc(nservices ? nservices : 1, sizeof(*rdb.services));
+	rdb.contacts = calloc(ncontacts ? ncontacts : 1, sizeof(*rdb.contacts));
+	rdb.host_hashes = calloc(nhosts ? nhosts * XRDB_HASHES : 1, sizeof(uint64_t));
+	rdb.service_hashes = calloc(nservices ? nservices * XRDB_HASHES : 1, sizeof(uint64_t));
+	rdb.contact_hashes = calloc(ncontacts ? ncontacts : 1, sizeof(uint64_t));
+	rdb.dirty = calloc((size_t)nhosts + nservices + ncontacts + 1, 1);
+	if(!rdb.appendbuf)
+		rdb.appendbuf = malloc(XRDB_APPEND_BUFSIZE);
+	if(!rdb.hosts || !rdb.services || !rdb.contacts || !rdb.host_hashes || !rdb.service_hashes || !rdb.contact_hashes || !rdb.dirty || !rdb.appendbuf)
+		return ERROR;
+
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, XRDBINARY_MAGIC, sizeof(hdr->magic));
+	hdr->version = XRDBINARY_VERSION;
+	hdr->header_size = sizeof(*hdr);
+	hdr->byte_order = XRDBINARY_BYTE_ORDER;
+	hdr->created = time(NULL);
+	hdr->num_hosts = nhosts;
+	hdr->num_services = nservices;
+	hdr->num_contacts = ncontacts;
+	hdr->host_slot_size = sizeof(struct xrdb_host);
+	hdr->service_slot_size = sizeof(struct xrdb_service);
+	hdr->contact_slot_size = sizeof(struct xrdb_contact);
+	hdr->host_offset = XRDB_ALIGN(sizeof(*hdr));
+	hdr->service_offset = hdr->host_offset + (uint64_t)nhosts * sizeof(struct xrdb_host);
+	hdr->contact_offset = hdr->service_offset + (uint64_t)nservices * sizeof(struct xrdb_service);
+	hdr->heap_offset = hdr->contact_offset + (uint64_t)ncontacts * sizeof(struct xrdb_contact);
+
+	rdb.heap_end = hdr->heap_offset;
+	rdb.heap_waste = 0;
+	memset(rdb.header_hashes, 0, sizeof(rdb.header_hashes));
+
+	/* tell the reader which objects the slots belong to */
+	for(h = XRDB_HASH_INIT, i = 0; i < nhosts; i++)
+		h = xrdb_hash_string(h, snap->hosts[i].name);
+	hdr->host_digest = h;
+	for(h = XRDB_HASH_INIT, i = 0; i < nservices; i++) {
+		h = xrdb_hash_string(h, snap->services[i].host_name);
+		h = xrdb_hash_string(h, snap->services[i].description);
+		}
+	hdr->service_digest = h;
+	for(h = XRDB_HASH_INIT, i = 0; i < ncontacts; i++)
+		h = xrdb_hash_string(h, snap->contacts[i].name);
+	hdr->contact_digest = h;
+
+	return OK;
+	}
+
+
+/*
+ * Writes all slots that have changed since the last update, or all
+ * of them if the file was just laid out. New strings go to disk before
+ * the slots pointing at them, and the header goes last.
+ */
+static int xrdb_update(const struct state_snapshot *snap, int full, unsigned int *slots_written) {
+	struct xrdb_header *hdr = &rdb.hdr;
+	struct xrdb_host hslot;
+	struct xrdb_service sslot;
+	struct xrdb_contact cslot;
+	unsigned char *host_dirty = rdb.dirty;
+	unsigned char *service_dirty = rdb.dirty + hdr->num_hosts;
+	unsigned char *contact_dirty = service_dirty + hdr->num_services;
+	uint64_t old_heap_end = rdb.heap_end;
+	unsigned int i;
+	const struct snapshot_host *hst;
+	const struct snapshot_service *svc;
+	const struct snapshot_contact *cntct;
+
+	/* tell readers an update is in progress */
+	hdr->generation++;
+	if(!full && xrdb_pwrite(&hdr->generation, sizeof(hdr->generation), offsetof(struct xrdb_header, generation)) != OK)
+		return ERROR;
+
+	rdb.appendoff = rdb.heap_end;
+	rdb.appendlen = 0;
+
+	for(i = 0; i < hdr->num_hosts; i++) {
+		hst = &snap->hosts[i];
+		memcpy(&hslot, &rdb.hosts[i], sizeof(hslot));
+		if(full && xrdb_set_string(&hslot.host_name, hst->name, strlen(hst->name)) != OK)
+			return ERROR;
+		xrdb_fill_host(&hslot, hst);
+		if(xrdb_set_host_strings(&hslot, &rdb.host_hashes[i * XRDB_HASHES], hst, full) != OK)
+			return ERROR;
+		host_dirty[i] = full || memcmp(&hslot, &rdb.hosts[i], sizeof(hslot));
+		if(host_dirty[i]) {
+			memcpy(&rdb.hosts[i], &hslot, sizeof(hslot));
+			(*slots_written)++;
+			}
+		}
+
+	for(i = 0; i < hdr->num_services; i++) {
+		svc = &snap->services[i];
+		memcpy(&sslot, &rdb.services[i], sizeof(sslot));
+		if(full) {
+			/* services share the name string with their host */
+			sslot.host_name = rdb.hosts[svc->host_id].host_name;
+			if(xrdb_set_string(&sslot.description, svc->description, strlen(svc->description)) != OK)
+				return ERROR;
+			}
+		xrdb_fill_service(&sslot, svc);
+		if(xrdb_set_service_strings(&sslot, &rdb.service_hashes[i * XRDB_HASHES], svc, full) != OK)
+			return ERROR;
+		service_dirty[i] = full || memcmp(&sslot, &rdb.services[i], sizeof(sslot));
+		if(service_dirty[i]) {
+			memcpy(&rdb.services[i], &sslot, sizeof(sslot));
+			(*slots_written)++;
+			}
+		}
+
+	for(i = 0; i < hdr->num_contacts; i++) {
+		cntct = &snap->contacts[i];
+		memcpy(&cslot, &rdb.contacts[i], sizeof(cslot));
+		if(full && xrdb_set_string(&cslot.contact_name, cntct->name, strlen(cntct->name)) != OK)
+			return ERROR;
+		xrdb_fill_contact(&cslot, cntct);
+		if(xrdb_set_contact_strings(&cslot, &rdb.contact_hashes[i], cntct, full) != OK)
+			return ERROR;
+		contact_dirty[i] = full || memcmp(&cslot, &rdb.contacts[i], sizeof(cslot));
+		if(contact_dirty[i]) {
+			memcpy(&rdb.contacts[i], &cslot, sizeof(cslot));
+			(*slots_written)++;
+			}
+		}
+
+	xrdb_build_comments(snap);
+	if(xrdb_set_blob(&hdr->comments, &rdb.header_hashes[0], full) != OK)
+		return ERROR;
+	xrdb_build_downtimes(snap);
+	if(xrdb_set_blob(&hdr->downtimes, &rdb.header_hashes[1], full) != OK)
+		return ERROR;
+	if(xrdb_set_program_strings(hdr, &snap->program, full) != OK)
+		return ERROR;
+
+	/* the new strings must be on disk before anything points at them */
+	if(xrdb_flush_append() != OK)
+		return ERROR;
+	if(!full && rdb.heap_end != old_heap_end && fdatasync(rdb.fd) != 0)
+		return ERROR;
+
+	if(xrdb_write_slots(rdb.hosts, sizeof(hslot), host_dirty, hdr->num_hosts, hdr->host_offset) != OK
+	   || xrdb_write_slots(rdb.services, sizeof(sslot), service_dirty, hdr->num_services, hdr->service_offset) != OK
+	   || xrdb_write_slots(rdb.contacts, sizeof(cslot), contact_dirty, hdr->num_contacts, hdr->contact_offset) != OK)
+		return ERROR;
+
+	xrdb_fill_program(hdr, &snap->program);
+	hdr->file_size = rdb.heap_end;
+	hdr->last_update = snap->taken;
+
+	/* the update is complete */
+	hdr->generation++;
+	if(xrdb_pwrite(hdr, sizeof(*hdr), 0) != OK)
+		return ERROR;
+
+	return fdatasync(rdb.fd) ? ERROR : OK;
+	}
+
+
+/* saves all changed state information to the binary retention file */
+int xrdbinary_save_state_information(const struct state_snapshot *snap) {
+	unsigned int slots_written = 0;
+	char *tmp_file = NULL;
+	struct stat st;
+	int full = FALSE;
+	int result;
+
+	log_debug_info(DEBUGL_FUNCTIONS, 0, "xrdbinary_save_state_information()\n");
+
+	if(!binary_retention_file)
+		return OK;
+
+	/* lay the file out afresh if it's new, gone or has too many holes */
+	if(rdb.fd < 0)
+		full = TRUE;
+	else if(stat(binary_retention_file, &st) < 0 || st.st_ino != rdb.inode)
+		full = TRUE;
+	else if(rdb.hdr.num_hosts != snap->num_hosts || rdb.hdr.num_services != snap->num_services || rdb.hdr.num_contacts != snap->num_contacts)
+		full = TRUE;
+	else if(rdb.heap_waste > XRDB_MIN_WASTE && rdb.heap_waste > (rdb.heap_end - rdb.hdr.heap_offset) / 2)
+		full = TRUE;
+
+	if(full == TRUE && xrdb_layout(&tmp_file, snap) != OK) {
+		xrdb_close();
+		if(tmp_file)
+			unlink(tmp_file);
+		my_free(tmp_file);
+		return ERROR;
+		}
+
+	rdb.bytes_written = 0;
+	result = xrdb_update(snap, full, &slots_written);
+
+	if(result == OK && full == TRUE) {
+		fchmod(rdb.fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+		if(fsync(rdb.fd) || my_rename(tmp_file, binary_retention_file) || fstat(rdb.fd, &st) < 0)
+			result = ERROR;
+		else
+			rdb.inode = st.st_ino;
+		}
+
+	if(result != OK) {
+		logit(NSLOG_RUNTIME_ERROR, TRUE, "Error: Unable to update binary retention file '%s': %s\n", binary_retention_file, strerror(errno));
+		xrdb_close();
+		if(tmp_file)
+			unlink(tmp_file);
+		}
+	else {
+		log_debug_info(DEBUGL_RETENTIONDATA, 1, "%s binary retention data: %u of %u slots, %lu bytes\n",
+		               full == TRUE ? "Wrote" : "Updated", slots_written,
+		               rdb.hdr.num_hosts + rdb.hdr.num_services + rdb.hdr.num_contacts, rdb.bytes_written);
+		}
+
+	my_free(tmp_file);
+
+	return result;
+	}
+
+
+
+/******************************************************************/
+/******************** RETENTION INPUT FUNCTIONS *******************/
+/******************************************************************/
+
+static const char *xrdb_str(const struct xrdb_map *map, const struct xrdb_string *s) {
+	return s->offset ? map->base + s->offset : NULL;
+	}
+
+
+/* makes sure a string lies within the heap and is terminated */
+static int xrdb_check_string(const struct xrdb_map *map, const struct xrdb_string *s) {
+	if(!s->offset)
+		return OK;
+	if(s->offset < map->hdr.heap_offset || s->offset + s->len >= map->size || map->base[s->offset + s->len] != 0)
+		return ERROR;
+	return OK;
+	}
+
+
+/* custom variables must also come in name/value pairs */
+static int xrdb_check_custom_variables(const struct xrdb_map *map, const struct xrdb_string *s) {
+	const char *p, *end;
+
+	if(xrdb_check_string(map, s) != OK)
+		return ERROR;
+	if(!s->offset)
+		return OK;
+
+	p = map->base + s->offset;
+	end = p + s->len + 1;
+	while(p < end) {
+		p += strlen(p) + 1;
+		if(p >= end)
+			return ERROR;
+		p += strlen(p) + 1;
+		}
+
+	return OK;
+	}
+
+
+/*
+ * Points 'strs' at the four strings following a comment or downtime
+ * record and returns the offset of the next record, or 0 if the
+ * record doesn't fit in the blob.
+ */
+static size_t xrdb_record_strings(const char *blob, size_t len, size_t off, size_t rec_size, const uint32_t *lengths, char **strs) {
+	int x;
+
+	off += rec_size;
+	for(x = 0; x < 4; x++) {
+		if(off + lengths[x] >= len || blob[off + lengths[x]] != 0)
+			return 0;
+		strs[x] = lengths[x] ? (char *)blob + off : NULL;
+		off += lengths[x] + 1;
+		}
+
+	return XRDB_ALIGN(off);
+	}
+
+
+/* walks a comment or downtime blob without using it */
+static int xrdb_check_records(const struct xrdb_map *map, const struct xrdb_string *s, size_t rec_size) {
+	const char *blob = xrdb_str(map, s);
+	uint32_t lengths[4];
+	char *strs[4];
+	size_t off = 0;
+
+	if(xrdb_check_string(map, s) != OK)
+		return ERROR;
+
+	while(blob && off < s->len) {
+		if(off + rec_size > s->len)
+			return ERROR;
+		memcpy(lengths, blob + off + rec_size - sizeof(lengths), sizeof(lengths));
+		if(!(off = xrdb_record_strings(blob, s->len + 1, off, rec_size, lengths, strs)))
+			return ERROR;
+		}
+
+	return OK;
+	}
+
+
+static const struct xrdb_host *xrdb_host_slot(const struct xrdb_map *map, unsigned int i) {
+	return (const struct xrdb_host *)(map->base + map->hdr.host_offset) + i;
+	}
+
+
+static const struct xrdb_service *xrdb_service_slot(const struct xrdb_map *map, unsigned int i) {
+	return (const struct xrdb_service *)(map->base + map->hdr.service_offset) + i;
+	}
+
+
+static const struct xrdb_contact *xrdb_contact_slot(const struct xrdb_map *map, unsigned int i) {
+	return (const struct xrdb_contact *)(map->base + map->hdr.contact_offset) + i;
+	}
+
+
+/*
+ * Checks the strings of a host or service slot and finds the object
+ * it belongs to. Slots are numbered hosts first, then services.
+ */
+static int xrdb_check_slot(struct xrdb_map *map, unsigned int i) {
+	const struct xrdb_host *hslot;
+	const struct xrdb_service *sslot;
+
+	if(i < map->hdr.num_hosts) {
+		hslot = xrdb_host_slot(map, i);
+		if(xrdb_check_string(map, &hslot->host_name) != OK || !hslot->host_name.offset
+		   || xrdb_check_string(map, &hslot->check_command) != OK || xrdb_check_string(map, &hslot->check_period) != OK
+		   || xrdb_check_string(map, &hslot->notification_period) != OK || xrdb_check_string(map, &hslot->event_handler) != OK
+		   || xrdb_check_string(map, &hslot->event_handler_period) != OK || xrdb_check_string(map, &hslot->plugin_output) != OK
+		   || xrdb_check_string(map, &hslot->long_plugin_output) != OK || xrdb_check_string(map, &hslot->perf_data) != OK
+		   || xrdb_check_custom_variables(map, &hslot->custom_variables) != OK)
+			return ERROR;
+		if(map->hosts[i] == NULL)
+			map->hosts[i] = find_host(xrdb_str(map, &hslot->host_name));
+		return OK;
+		}
+
+	i -= map->hdr.num_hosts;
+	sslot = xrdb_service_slot(map, i);
+	if(xrdb_check_string(map, &sslot->host_name) != OK || !sslot->host_name.offset
+	   || xrdb_check_string(map, &sslot->description) != OK || !sslot->description.offset
+	   || xrdb_check_string(map, &sslot->check_command) != OK || xrdb_check_string(map, &sslot->check_period) != OK
+	   || xrdb_check_string(map, &sslot->notification_period) != OK || xrdb_check_string(map, &sslot->event_handler) != OK
+	   || xrdb_check_string(map, &sslot->event_handler_period) != OK || xrdb_check_string(map, &sslot->plugin_output) != OK
+	   || xrdb_check_string(map, &sslot->long_plugin_output) != OK || xrdb_check_string(map, &sslot->perf_data) != OK
+	   || xrdb_check_custom_variables(map, &sslot->custom_variables) != OK)
+		return ERROR;
+	if(map->services[i] == NULL)
+		map->services[i] = find_service(xrdb_str(map, &sslot->host_name), xrdb_str(map, &sslot->description));
+	return OK;
+	}
+
+
+static void xrdb_restore_output(char **dest, const char *val) {
+	my_free(*dest);
+	*dest = (char *)strdup(val ? val : "");
+	}
+
+
+/*
+ * Restores the modified attributes and status of a host or service.
+ * These only touch the object itself, so they can run in parallel.
+ */
+static int xrdb_restore_status(struct xrdb_map *map, unsigned int i) {
+	const struct xrdb_host *hslot;
+	const struct xrdb_service *sslot;
+	host *hst;
+	service *svc;
+	int x;
+
+	if(i < map->hdr.num_hosts) {
+		hslot = xrdb_host_slot(map, i);
+		if((hst = map->hosts[i]) == NULL)
+			return OK;
+
+		/* mask out attributes we don't want to retain */
+		hst->modified_attributes = hslot->modified_attributes & ~retained_host_attribute_mask;
+
+		if(hst->retain_status_information == FALSE)
+			return OK;
+
+		hst->has_been_checked = (hslot->has_been_checked > 0) ? TRUE : FALSE;
+		hst->execution_time = hslot->execution_time;
+		hst->latency = hslot->latency;
+		hst->check_type = hslot->check_type;
+		hst->current_state = hslot->current_state;
+		hst->last_state = hslot->last_state;
+		hst->last_hard_state = hslot->last_hard_state;
+		xrdb_restore_output(&hst->plugin_output, xrdb_str(map, &hslot->plugin_output));
+		xrdb_restore_output(&hst->long_plugin_output, xrdb_str(map, &hslot->long_plugin_output));
+		xrdb_restore_output(&hst->perf_data, xrdb_str(map, &hslot->perf_data));
+		hst->last_check = hslot->last_check;
+		if(use_retained_scheduling_info == TRUE && map->scheduling_info_is_ok == TRUE) {
+			hst->next_check = hslot->next_check;
+			hst->check_options = hslot->check_options;
+			}
+		hst->current_attempt = hslot->current_attempt;
+		hst->current_event_id = hslot->current_event_id;
+		hst->last_event_id = hslot->last_event_id;
+		hst->current_problem_id = hslot->current_problem_id;
+		hst->last_problem_id = hslot->last_problem_id;
+		hst->state_type = hslot->state_type;
+		hst->last_state_change = hslot->last_state_change;
+		hst->last_hard_state_change = hslot->last_hard_state_change;
+		hst->last_time_up = hslot->last_time_up;
+		hst->last_time_down = hslot->last_time_down;
+		hst->last_time_unreachable = hslot->last_time_unreachable;
+		hst->notified_on |= hslot->notified_on & (OPT_DOWN | OPT_UNREACHABLE);
+		hst->last_notification = hslot->last_notification;
+		hst->current_notification_number = hslot->current_notification_number;
+		hst->current_notification_id = hslot->current_notification_id;
+		hst->percent_state_change = hslot->percent_state_change;
+		hst->check_flapping_recovery_notification = hslot->check_flapping_recovery_notification;
+		for(x = 0; x < MAX_STATE_HISTORY_ENTRIES; x++)
+			hst->state_history[x] = hslot->state_history[x];
+		hst->state_history_index = 0;
+		if(sigrestart == TRUE)
+			hst->flapping_comment_id = hslot->flapping_comment_id;
+		return OK;
+		}
+
+	i -= map->hdr.num_hosts;
+	sslot = xrdb_service_slot(map, i);
+	if((svc = map->services[i]) == NULL)
+		return OK;
+
+	/* mask out attributes we don't want to retain */
+	svc->modified_attributes = sslot->modified_attributes & ~retained_service_attribute_mask;
+
+	if(svc->retain_status_information == FALSE)
+		return OK;
+
+	svc->has_been_checked = (sslot->has_been_checked > 0) ? TRUE : FALSE;
+	svc->execution_time = sslot->execution_time;
+	svc->latency = sslot->latency;
+	svc->check_type = sslot->check_type;
+	svc->current_state = sslot->current_state;
+	svc->last_state = sslot->last_state;
+	svc->last_hard_state = sslot->last_hard_state;
+	svc->current_attempt = sslot->current_attempt;
+	svc->current_event_id = sslot->current_event_id;
+	svc->last_event_id = sslot->last_event_id;
+	svc->current_problem_id = sslot->current_problem_id;
+	svc->last_problem_id = sslot->last_problem_id;
+	svc->state_type = sslot->state_type;
+	svc->last_state_change = sslot->last_state_change;
+	svc->last_hard_state_change = sslot->last_hard_state_change;
+	svc->last_time_ok = sslot->last_time_ok;
+	svc->last_time_warning = sslot->last_time_warning;
+	svc->last_time_unknown = sslot->last_time_unknown;
+	svc->last_time_critical = sslot->last_time_critical;
+	xrdb_restore_output(&svc->plugin_output, xrdb_str(map, &sslot->plugin_output));
+	xrdb_restore_output(&svc->long_plugin_output, xrdb_str(map, &sslot->long_plugin_output));
+	xrdb_restore_output(&svc->perf_data, xrdb_str(map, &sslot->perf_data));
+	svc->last_check = sslot->last_check;
+	if(use_retained_scheduling_info == TRUE && map->scheduling_info_is_ok == TRUE) {
+		svc->next_check = sslot->next_check;
+		svc->check_options = sslot->check_options;
+		}
+	svc->notified_on |= sslot->notified_on & (OPT_UNKNOWN | OPT_WARNING | OPT_CRITICAL);
+	svc->current_notification_number = sslot->current_notification_number;
+	svc->current_notification_id = sslot->current_notification_id;
+	svc->last_notification = sslot->last_notification;
+	svc->percent_state_change = sslot->percent_state_change;
+	svc->check_flapping_recovery_notification = sslot->check_flapping_recovery_notification;
+	for(x = 0; x < MAX_STATE_HISTORY_ENTRIES; x++)
+		svc->state_history[x] = sslot->state_history[x];
+	svc->state_history_index = 0;
+	if(sigrestart == TRUE)
+		svc->flapping_comment_id = sslot->flapping_comment_id;
+
+	return OK;
+	}
+
+
+static void *xrdb_run_job(void *arg) {
+	struct xrdb_job *job = arg;
+	unsigned int i;
+
+	for(i = job->start; i < job->end; i++) {
+		if(job->fn(job->map, i) != OK) {
+			job->result = ERROR;
+			break;
+			}
+		}
+
+	return NULL;
+	}
+
+
+/*
+ * Calls 'fn' for every host and service slot, splitting them up between
+ * a few threads if there are enough of them to make it worthwhile.
+ */
+static int xrdb_run(struct xrdb_map *map, int (*fn)(struct xrdb_map *, unsigned int)) {
+	struct xrdb_job jobs[XRDB_MAX_THREADS];
+	pthread_t threads[XRDB_MAX_THREADS];
+	int started[XRDB_MAX_THREADS];
+	unsigned int total = map->hdr.num_hosts + map->hdr.num_services;
+	unsigned int nthreads, chunk, t;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int result = OK;
+
+	nthreads = total / XRDB_MIN_CHUNK;
+	if(cpus > 0 && nthreads > (unsigned long)cpus)
+		nthreads = cpus;
+	if(nthreads > XRDB_MAX_THREADS)
+		nthreads = XRDB_MAX_THREADS;
+	if(nthreads < 1)
+		nthreads = 1;
+	chunk = (total + nthreads - 1) / nthreads;
+
+	for(t = 0; t < nthreads; t++) {
+		jobs[t].map = map;
+		jobs[t].fn = fn;
+		jobs[t].start = t * chunk;
+		jobs[t].end = (t + 1) * chunk < total ? (t + 1) * chunk : total;
+		jobs[t].result = OK;
+		started[t] = FALSE;
+		}
+
+	/* the first chunk is ours. If a thread can't be started, we do its share too */
+	for(t = 1; t < nthreads; t++) {
+		if(pthread_create(&threads[t], NULL, xrdb_run_job, &jobs[t]) == 0)
+			started[t] = TRUE;
+		}
+	xrdb_run_job(&jobs[0]);
+	for(t = 1; t < nthreads; t++) {
+		if(started[t] == TRUE)
+			pthread_join(threads[t], NULL);
+		else
+			xrdb_run_job(&jobs[t]);
+		}
+
+	for(t = 0; t < nthreads; t++) {
+		if(jobs[t].result != OK)
+			result = ERROR;
+		}
+
+	return result;
+	}
+
+
+/* a retained command is only used if it still exists */
+static int xrdb_command_exists(const char *val) {
+	char *tempval, *temp_ptr;
+	command *temp_command;
+
+	if(val == NULL || (tempval = (char *)strdup(val)) == NULL)
+		return FALSE;
+	temp_ptr = my_strtok(tempval, "!");
+	temp_command = find_command(temp_ptr);
+	my_free(tempval);
+
+	return temp_command != NULL ? TRUE : FALSE;
+	}
+
+
+/* restores a command or timeperiod of an object, clearing the modified attribute if it's gone */
+static void xrdb_restore_object_string(char **dest, const char *val, int is_command, unsigned long *modified_attributes, unsigned long attr) {
+	char *temp_ptr;
+
+	if(!(*modified_attributes & attr))
+		return;
+
+	if(val != NULL && (is_command == TRUE ? xrdb_command_exists(val) : find_timeperiod(val) != NULL) && (temp_ptr = (char *)strdup(val))) {
+		free_object_string(*dest);
+		*dest = temp_ptr;
+		}
+	else
+		*modified_attributes -= attr;
+	}
+
+
+static void xrdb_restore_custom_variables(const struct xrdb_map *map, customvariablesmember *list, const customvariablesindex *idx, const struct xrdb_string *s) {
+	customvariablesmember *temp_customvariablesmember;
+	const char *p, *end, *name;
+
+	if((p = xrdb_str(map, s)) == NULL)
+		return;
+
+	for(end = p + s->len + 1; p < end; p += strlen(p) + 1) {
+		name = p;
+		p += strlen(p) + 1;
+		if((temp_customvariablesmember = find_indexed_custom_variable(list, idx, name))) {
+			free_object_string(temp_customvariablesmember->variable_value);
+			temp_customvariablesmember->variable_value = (char *)strdup(p);
+			temp_customvariablesmember->has_been_modified = TRUE;
+			}
+		}
+	}
+
+
+/* restores what's left of a host once its status is in place */
+static void xrdb_restore_host_config(const struct xrdb_map *map, host *hst, const struct xrdb_host *slot) {
+
+	if(hst->retain_nonstatus_information == FALSE)
+		return;
+
+	hst->problem_has_been_acknowledged = (slot->problem_has_been_acknowledged > 0) ? TRUE : FALSE;
+	hst->acknowledgement_type = slot->acknowledgement_type;
+	if(hst->modified_attributes & MODATTR_NOTIFICATIONS_ENABLED)
+		hst->notifications_enabled = (slot->notifications_enabled > 0) ? TRUE : FALSE;
+	if(hst->modified_attributes & MODATTR_ACTIVE_CHECKS_ENABLED)
+		hst->checks_enabled = (slot->checks_enabled > 0) ? TRUE : FALSE;
+	if(hst->modified_attributes & MODATTR_PASSIVE_CHECKS_ENABLED)
+		hst->accept_passive_checks = (slot->accept_passive_checks > 0) ? TRUE : FALSE;
+	if(hst->modified_attributes & MODATTR_EVENT_HANDLER_ENABLED)
+		hst->event_handler_enabled = (slot->event_handler_enabled > 0) ? TRUE : FALSE;
+	if(hst->modified_attributes & MODATTR_FLAP_DETECTION_ENABLED)
+		hst->flap_detection_enabled = (slot->flap_detection_enabled > 0) ? TRUE : FALSE;
+	if(hst->modified_attributes & MODATTR_PERFORMANCE_DATA_ENABLED)
+		hst->process_performance_data = (slot->process_performance_data > 0) ? TRUE : FALSE;
+	if(hst->modified_attributes & MODATTR_OBSESSIVE_HANDLER_ENABLED)
+		hst->obsess = (slot->obsess > 0) ? TRUE : FALSE;
+
+	xrdb_restore_object_string(&hst->check_command, xrdb_str(map, &slot->check_command), TRUE, &hst->modified_attributes, MODATTR_CHECK_COMMAND);
+	xrdb_restore_object_string(&hst->check_period, xrdb_str(map, &slot->check_period), FALSE, &hst->modified_attributes, MODATTR_CHECK_TIMEPERIOD);
+	xrdb_restore_object_string(&hst->notification_period, xrdb_str(map, &slot->notification_period), FALSE, &hst->modified_attributes, MODATTR_NOTIFICATION_TIMEPERIOD);
+	xrdb_restore_object_string(&hst->event_handler, xrdb_str(map, &slot->event_handler), TRUE, &hst->modified_attributes, MODATTR_EVENT_HANDLER_COMMAND);
+	xrdb_restore_object_string(&hst->event_handler_period, xrdb_str(map, &slot->event_handler_period), FALSE, &hst->modified_attributes, MODATTR_EVENT_HANDLER_TIMEPERIOD);
+
+	if(hst->modified_attributes & MODATTR_NORMAL_CHECK_INTERVAL && slot->check_interval >= 0)
+		hst->check_interval = slot->check_interval;
+	if(hst->modified_attributes & MODATTR_RETRY_CHECK_INTERVAL && slot->retry_interval >= 0)
+		hst->retry_interval = slot->retry_interval;
+	if(hst->modified_attributes & MODATTR_MAX_CHECK_ATTEMPTS && slot->max_attempts >= 1) {
+
+		hst->max_attempts = slot->max_attempts;
+
+		/*
+		 * adjust current attempt number. The text reader sees max_attempts
+		 * before state_type, so it checks the state type from the config,
+		 * which is always hard, and adjusts soft states too. Do the same
+		 */
+		if(hst->current_state != HOST_UP && hst->current_attempt > 1)
+			hst->current_attempt = hst->max_attempts;
+		}
+
+	if(hst->modified_attributes & MODATTR_CUSTOM_VARIABLE)
+		xrdb_restore_custom_variables(map, hst->custom_variables, &hst->custom_variable_index, &slot->custom_variables);
+	}
+
+
+static void xrdb_restore_service_config(const struct xrdb_map *map, service *svc, const struct xrdb_service *slot) {
+
+	if(svc->retain_nonstatus_information == FALSE)
+		return;
+
+	svc->problem_has_been_acknowledged = (slot->problem_has_been_acknowledged > 0) ? TRUE : FALSE;
+	svc->acknowledgement_type = slot->acknowledgement_type;
+	if(svc->modified_attributes & MODATTR_NOTIFICATIONS_ENABLED)
+		svc->notifications_enabled = (slot->notifications_enabled > 0) ? TRUE : FALSE;
+	if(svc->modified_attributes & MODATTR_ACTIVE_CHECKS_ENABLED)
+		svc->checks_enabled = (slot->checks_enabled > 0) ? TRUE : FALSE;
+	if(svc->modified_attributes & MODATTR_PASSIVE_CHECKS_ENABLED)
+		svc->accept_passive_checks = (slot->accept_passive_checks > 0) ? TRUE : FALSE;
+	if(svc->modified_attributes & MODATTR_EVENT_HANDLER_ENABLED)
+		svc->event_handler_enabled = (slot->event_handler_enabled > 0) ? TRUE : FALSE;
+	if(svc->modified_attributes & MODATTR_FLAP_DETECTION_ENABLED)
+		svc->flap_detection_enabled = (slot->flap_detection_enabled > 0) ? TRUE : FALSE;
+	if(svc->modified_attributes & MODATTR_PERFORMANCE_DATA_ENABLED)
+		svc->process_performance_data = (slot->process_performance_data > 0) ? TRUE : FALSE;
+	if(svc->modified_attributes & MODATTR_OBSESSIVE_HANDLER_ENABLED)
+		svc->obsess = (slot->obsess > 0) ? TRUE : FALSE;
+
+	xrdb_restore_object_string(&svc->check_command, xrdb_str(map, &slot->check_command), TRUE, &svc->modified_attributes, MODATTR_CHECK_COMMAND);
+	xrdb_restore_object_string(&svc->check_period, xrdb_str(map, &slot->check_period), FALSE, &svc->modified_attributes, MODATTR_CHECK_TIMEPERIOD);
+	xrdb_restore_object_string(&svc->notification_period, xrdb_str(map, &slot->notification_period), FALSE, &svc->modified_attributes, MODATTR_NOTIFICATION_TIMEPERIOD);
+	xrdb_restore_object_string(&svc->event_handler, xrdb_str(map, &slot->event_handler), TRUE, &svc->modified_attributes, MODATTR_EVENT_HANDLER_COMMAND);
+	xrdb_restore_object_string(&svc->event_handler_period, xrdb_str(map, &slot->event_handler_period), FALSE, &svc->modified_attributes, MODATTR_EVENT_HANDLER_TIMEPERIOD);
+
+	if(svc->modified_attributes & MODATTR_NORMAL_CHECK_INTERVAL && slot->check_interval >= 0)
+		svc->check_interval = slot->check_interval;
+	if(svc->modified_attributes & MODATTR_RETRY_CHECK_INTERVAL && slot->retry_interval >= 0)
+		svc->retry_interval = slot->retry_interval;
+	if(svc->modified_attributes & MODATTR_MAX_CHECK_ATTEMPTS && slot->max_attempts >= 1) {
+
+		svc->max_attempts = slot->max_attempts;
+
+		/* adjust current attempt number, in soft states too, as for hosts */
+		if(svc->current_state != STATE_OK && svc->current_attempt > 1)
+			svc->current_attempt = svc->max_attempts;
+		}
+
+	if(svc->modified_attributes & MODATTR_CUSTOM_VARIABLE)
+		xrdb_restore_custom_variables(map, svc->custom_variables, &svc->custom_variable_index, &slot->custom_variables);
+	}
+
+
+static void xrdb_restore_contact(const struct xrdb_map *map, contact *cntct, const struct xrdb_contact *slot) {
+
+	/* mask out attributes we don't want to retain */
+	cntct->modified_attributes = slot->modified_attributes;
+	cntct->modified_host_attributes = slot->modified_host_attributes & ~retained_contact_host_attribute_mask;
+	cntct->modified_service_attributes = slot->modified_service_attributes & ~retained_contact_service_attribute_mask;
+
+	if(cntct->retain_status_information == TRUE) {
+		cntct->last_host_notification = slot->last_host_notification;
+		cntct->last_service_notification = slot->last_service_notification;
+		}
+
+	if(cntct->retain_nonstatus_information == TRUE) {
+		xrdb_restore_object_string(&cntct->host_notification_period, xrdb_str(map, &slot->host_notification_period), FALSE, &cntct->modified_host_attributes, MODATTR_NOTIFICATION_TIMEPERIOD);
+		xrdb_restore_object_string(&cntct->service_notification_period, xrdb_str(map, &slot->service_notification_period), FALSE, &cntct->modified_service_attributes, MODATTR_NOTIFICATION_TIMEPERIOD);
+		if(cntct->modified_host_attributes & MODATTR_NOTIFICATIONS_ENABLED)
+			cntct->host_notifications_enabled = (slot->host_notifications_enabled > 0) ? TRUE : FALSE;
+		if(cntct->modified_service_attributes & MODATTR_NOTIFICATIONS_ENABLED)
+			cntct->service_notifications_enabled = (slot->service_notifications_enabled > 0) ? TRUE : FALSE;
+		if(cntct->modified_attributes & MODATTR_CUSTOM_VARIABLE)
+			xrdb_restore_custom_variables(map, cntct->custom_variables, &cntct->custom_variable_index, &slot->custom_variables);
+		}
+
+	xrddefault_finish_contact(cntct);
+	}
+
+
+static void xrdb_restore_program(const struct xrdb_map *map) {
+	const struct xrdb_info *info = &map->hdr.info;
+	const struct xrdb_program *p = &map->hdr.program;
+	const char *val;
+	time_t current_time;
+
+	time(&current_time);
+	last_program_stop = map->hdr.last_update;
+	last_update_check = info->last_update_check;
+	update_available = info->update_available;
+	update_uid = info->update_uid;
+	my_free(last_program_version);
+	last_program_version = (char *)strdup((val = xrdb_str(map, &info->last_version)) ? val : "");
+	my_free(new_program_version);
+	new_program_version = (char *)strdup((val = xrdb_str(map, &info->new_version)) ? val : "");
+
+	/* mask out attributes we don't want to retain */
+	modified_host_process_attributes = p->modified_host_attributes & ~retained_process_host_attribute_mask;
+	modified_service_process_attributes = p->modified_service_attributes & ~retained_process_service_attribute_mask;
+
+	if(use_retained_program_state == FALSE) {
+		modified_host_process_attributes = MODATTR_NONE;
+		modified_service_process_attributes = MODATTR_NONE;
+		return;
+		}
+
+	if(modified_host_process_attributes & MODATTR_NOTIFICATIONS_ENABLED)
+		enable_notifications = (p->enable_notifications > 0) ? TRUE : FALSE;
+	if(modified_service_process_attributes & MODATTR_ACTIVE_CHECKS_ENABLED)
+		execute_service_checks = (p->execute_service_checks > 0) ? TRUE : FALSE;
+	if(modified_service_process_attributes & MODATTR_PASSIVE_CHECKS_ENABLED)
+		accept_passive_service_checks = (p->accept_passive_service_checks > 0) ? TRUE : FALSE;
+	if(modified_host_process_attributes & MODATTR_ACTIVE_CHECKS_ENABLED)
+		execute_host_checks = (p->execute_host_checks > 0) ? TRUE : FALSE;
+	if(modified_host_process_attributes & MODATTR_PASSIVE_CHECKS_ENABLED)
+		accept_passive_host_checks = (p->accept_passive_host_checks > 0) ? TRUE : FALSE;
+	if(modified_host_process_attributes & MODATTR_EVENT_HANDLER_ENABLED)
+		enable_event_handlers = (p->enable_event_handlers > 0) ? TRUE : FALSE;
+	if(modified_service_process_attributes & MODATTR_OBSESSIVE_HANDLER_ENABLED)
+		obsess_over_services = (p->obsess_over_services > 0) ? TRUE : FALSE;
+	if(modified_host_process_attributes & MODATTR_OBSESSIVE_HANDLER_ENABLED)
+		obsess_over_hosts = (p->obsess_over_hosts > 0) ? TRUE : FALSE;
+	if(modified_service_process_attributes & MODATTR_FRESHNESS_CHECKS_ENABLED)
+		check_service_freshness = (p->check_service_freshness > 0) ? TRUE : FALSE;
+	if(modified_host_process_attributes & MODATTR_FRESHNESS_CHECKS_ENABLED)
+		check_host_freshness = (p->check_host_freshness > 0) ? TRUE : FALSE;
+	if(modified_host_process_attributes & MODATTR_FLAP_DETECTION_ENABLED)
+		enable_flap_detection = (p->enable_flap_detection > 0) ? TRUE : FALSE;
+	if(modified_host_process_attributes & MODATTR_PERFORMANCE_DATA_ENABLED)
+		process_performance_data = (p->process_performance_data > 0) ? TRUE : FALSE;
+
+	/* make sure the commands still exist... */
+	val = xrdb_str(map, &p->global_host_event_handler);
+	if(modified_host_process_attributes & MODATTR_EVENT_HANDLER_COMMAND && xrdb_command_exists(val) == TRUE) {
+		my_free(global_host_event_handler);
+		global_host_event_handler = (char *)strdup(val);
+		}
+	val = xrdb_str(map, &p->global_service_event_handler);
+	if(modified_service_process_attributes & MODATTR_EVENT_HANDLER_COMMAND && xrdb_command_exists(val) == TRUE) {
+		my_free(global_service_event_handler);
+		global_service_event_handler = (char *)strdup(val);
+		}
+
+	next_comment_id = p->next_comment_id;
+	next_downtime_id = p->next_downtime_id;
+	next_event_id = p->next_event_id;
+	next_problem_id = p->next_problem_id;
+	next_notification_id = p->next_notification_id;
+	}
+
+
+static void xrdb_restore_comments(const struct xrdb_map *map) {
+	const char *blob = xrdb_str(map, &map->hdr.comments);
+	struct xrdb_comment rec;
+	char *strs[4];
+	size_t off = 0;
+
+	while(blob && off < map->hdr.comments.len) {
+		memcpy(&rec, blob + off, sizeof(rec));
+		off = xrdb_record_strings(blob, map->hdr.comments.len + 1, off, sizeof(rec), rec.lengths, strs);
+		xrddefault_restore_comment(rec.comment_type, rec.entry_type, strs[0], strs[1], rec.entry_time, strs[2] ? strs[2] : "", strs[3] ? strs[3] : "", rec.comment_id, rec.persistent, rec.expires, rec.expire_time, rec.source);
+		}
+	}
+
+
+static void xrdb_restore_downtimes(const struct xrdb_map *map) {
+	const char *blob = xrdb_str(map, &map->hdr.downtimes);
+	struct xrdb_downtime rec;
+	char *strs[4];
+	size_t off = 0;
+
+	while(blob && off < map->hdr.downtimes.len) {
+		memcpy(&rec, blob + off, sizeof(rec));
+		off = xrdb_record_strings(blob, map->hdr.downtimes.len + 1, off, sizeof(rec), rec.lengths, strs);
+
+		/* add the downtime */
+		if(rec.type == HOST_DOWNTIME)
+			add_host_downtime(strs[0], rec.entry_time, strs[2] ? strs[2] : "", strs[3] ? strs[3] : "", rec.start_time, rec.flex_downtime_start, rec.end_time, rec.fixed, rec.triggered_by, rec.duration, rec.downtime_id, rec.is_in_effect, rec.start_notification_sent);
+		else
+			add_service_downtime(strs[0], strs[1], rec.entry_time, strs[2] ? strs[2] : "", strs[3] ? strs[3] : "", rec.start_time, rec.flex_downtime_start, rec.end_time, rec.fixed, rec.triggered_by, rec.duration, rec.downtime_id, rec.is_in_effect, rec.start_notification_sent);
+
+		/* must register the downtime with Nagios so it can schedule it, add comments, etc. */
+		register_downtime((rec.type == HOST_DOWNTIME) ? HOST_DOWNTIME : SERVICE_DOWNTIME, rec.downtime_id);
+		}
+	}
+
+
+static uint64_t xrdb_host_digest(void) {
+	uint64_t h = XRDB_HASH_INIT;
+	unsigned int i;
+
+	for(i = 0; i < num_objects.hosts; i++)
+		h = xrdb_hash_string(h, host_ary[i]->name);
+	return h;
+	}
+
+
+static uint64_t xrdb_service_digest(void) {
+	uint64_t h = XRDB_HASH_INIT;
+	unsigned int i;
+
+	for(i = 0; i < num_objects.services; i++) {
+		h = xrdb_hash_string(h, service_ary[i]->host_name);
+		h = xrdb_hash_string(h, service_ary[i]->description);
+		}
+	return h;
+	}
+
+
+static uint64_t xrdb_contact_digest(void) {
+	uint64_t h = XRDB_HASH_INIT;
+	unsigned int i;
+
+	for(i = 0; i < num_objects.contacts; i++)
+		h = xrdb_hash_string(h, contact_ary[i]->name);
+	return h;
+	}
+
+
+/* objects matched up by name may turn up twice in a damaged file. The first one wins */
+static void xrdb_drop_duplicates(void **objs, unsigned int count, unsigned int num_objs, unsigned int (*get_id)(const void *)) {
+	unsigned char *seen;
+	unsigned int i, id;
+
+	if((seen = calloc(num_objs + 1, 1)) == NULL)
+		return;
+	for(i = 0; i < count; i++) {
+		if(objs[i] == NULL)
+			continue;
+		id = get_id(objs[i]);
+		if(seen[id])
+			objs[i] = NULL;
+		seen[id] = 1;
+		}
+	free(seen);
+	}
+
+
+static unsigned int xrdb_host_id(const void *obj) {
+	return ((const host *)obj)->id;
+	}
+
+
+static unsigned int xrdb_service_id(const void *obj) {
+	return ((const service *)obj)->id;
+	}
+
+
+static unsigned int xrdb_contact_id(const void *obj) {
+	return ((const contact *)obj)->id;
+	}
+
+
+/*
+ * Maps the retention file and checks that all of it can be used. No
+ * object is touched unless that's the case.
+ */
+static int xrdb_map(struct xrdb_map *map, const char *path) {
+	const struct xrdb_header *hdr = &map->hdr;
+	struct stat st;
+	void *base;
+	int fd;
+
+	map->base = NULL;
+	if((fd = open(path, O_RDONLY)) < 0)
+		return ERROR;
+	if(fstat(fd, &st) < 0) {
+		close(fd);
+		return ERROR;
+		}
+	if((size_t)st.st_size < sizeof(map->hdr)) {
+		close(fd);
+		errno = EINVAL;
+		return ERROR;
+		}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED)
+		return ERROR;
+
+	map->base = base;
+	map->size = st.st_size;
+	memcpy(&map->hdr, base, sizeof(map->hdr));
+
+	/* an update that was cut short may have left strings past the recorded end of the file */
+	if(memcmp(hdr->magic, XRDBINARY_MAGIC, sizeof(hdr->magic)) || hdr->version != XRDBINARY_VERSION
+	   || hdr->header_size != sizeof(map->hdr) || hdr->byte_order != XRDBINARY_BYTE_ORDER
+	   || hdr->host_slot_size != sizeof(struct xrdb_host) || hdr->service_slot_size != sizeof(struct xrdb_service)
+	   || hdr->contact_slot_size != sizeof(struct xrdb_contact)
+	   || hdr->host_offset < sizeof(map->hdr) || hdr->host_offset % 8
+	   || hdr->host_offset + (uint64_t)hdr->num_hosts * sizeof(struct xrdb_host) != hdr->service_offset
+	   || hdr->service_offset + (uint64_t)hdr->num_services * sizeof(struct xrdb_service) != hdr->contact_offset
+	   || hdr->contact_offset + (uint64_t)hdr->num_contacts * sizeof(struct xrdb_contact) != hdr->heap_offset
+	   || hdr->heap_offset > hdr->file_size || hdr->file_size > (uint64_t)st.st_size
+	   || xrdb_check_records(map, &hdr->comments, sizeof(struct xrdb_comment)) != OK
+	   || xrdb_check_records(map, &hdr->downtimes, sizeof(struct xrdb_downtime)) != OK
+	   || xrdb_check_string(map, &hdr->info.last_version) != OK || xrdb_check_string(map, &hdr->info.new_version) != OK
+	   || xrdb_check_string(map, &hdr->program.global_host_event_handler) != OK
+	   || xrdb_check_string(map, &hdr->program.global_service_event_handler) != OK) {
+		munmap(base, map->size);
+		map->base = NULL;
+		errno = EINVAL;
+		return ERROR;
+		}
+
+	return OK;
+	}
+
+
+/* reads in initial host and service state information from the binary retention file */
+int xrdbinary_read_state_information(void) {
+	struct xrdb_map map;
+	const struct xrdb_header *hdr = &map.hdr;
+	const struct xrdb_contact *cslot;
+	struct stat st;
+	time_t current_time;
+	unsigned int i;
+	int by_id[3];
+	int result = ERROR;
+
+	log_debug_info(DEBUGL_FUNCTIONS, 0, "xrdbinary_read_state_information() start\n");
+
+	if(!binary_retention_file)
+		return ERROR;
+
+	memset(&map, 0, sizeof(map));
+	if(xrdb_map(&map, binary_retention_file) != OK) {
+		if(errno != ENOENT)
+			logit(NSLOG_RUNTIME_WARNING, TRUE, "Warning: Unable to use binary retention file '%s': %s\n", binary_retention_file, strerror(errno));
+		return ERROR;
+		}
+
+	/* someone wrote the text file after we last wrote this one, so that's what they want us to read */
+	if(retention_file && stat(retention_file, &st) == 0 && (int64_t)st.st_mtime > hdr->last_update) {
+		logit(NSLOG_INFO_MESSAGE, FALSE, "Retention file '%s' is newer than binary retention file '%s'. Reading it instead.\n", retention_file, binary_retention_file);
+		goto out;
+		}
+
+	if(hdr->generation & 1)
+		logit(NSLOG_RUNTIME_WARNING, TRUE, "Warning: The last update of binary retention file '%s' was cut short. Some objects will get their state from the update before that.\n", binary_retention_file);
+
+	map.hosts = calloc(hdr->num_hosts + 1, sizeof(*map.hosts));
+	map.services = calloc(hdr->num_services + 1, sizeof(*map.services));
+	map.contacts = calloc(hdr->num_contacts + 1, sizeof(*map.contacts));
+	if(!map.hosts || !map.services || !map.contacts)
+		goto out;
+
+	/* slots belong to the objects with the same id if the objects are the same as when the file was written */
+	by_id[0] = hdr->num_hosts == num_objects.hosts && hdr->host_digest == xrdb_host_digest();
+	by_id[1] = hdr->num_services == num_objects.services && hdr->service_digest == xrdb_service_digest();
+	by_id[2] = hdr->num_contacts == num_objects.contacts && hdr->contact_digest == xrdb_contact_digest();
+	for(i = 0; by_id[0] && i < hdr->num_hosts; i++)
+		map.hosts[i] = host_ary[i];
+	for(i = 0; by_id[1] && i < hdr->num_services; i++)
+		map.services[i] = service_ary[i];
+	log_debug_info(DEBUGL_RETENTIONDATA, 1, "Binary retention data: hosts matched by %s, services by %s, contacts by %s\n",
+	               by_id[0] ? "id" : "name", by_id[1] ? "id" : "name", by_id[2] ? "id" : "name");
+
+	/* check everything and find the objects before touching any of them */
+	if(xrdb_run(&map, xrdb_check_slot) != OK)
+		goto invalid;
+	for(i = 0; i < hdr->num_contacts; i++) {
+		cslot = xrdb_contact_slot(&map, i);
+		if(xrdb_check_string(&map, &cslot->contact_name) != OK || !cslot->contact_name.offset
+		   || xrdb_check_string(&map, &cslot->host_notification_period) != OK
+		   || xrdb_check_string(&map, &cslot->service_notification_period) != OK
+		   || xrdb_check_custom_variables(&map, &cslot->custom_variables) != OK)
+			goto invalid;
+		map.contacts[i] = by_id[2] ? contact_ary[i] : find_contact(xrdb_str(&map, &cslot->contact_name));
+		}
+	if(!by_id[0])
+		xrdb_drop_duplicates((void **)map.hosts, hdr->num_hosts, num_objects.hosts, xrdb_host_id);
+	if(!by_id[1])
+		xrdb_drop_duplicates((void **)map.services, hdr->num_services, num_objects.services, xrdb_service_id);
+	if(!by_id[2])
+		xrdb_drop_duplicates((void **)map.contacts, hdr->num_contacts, num_objects.contacts, xrdb_contact_id);
+
+	time(&current_time);
+	map.scheduling_info_is_ok = (current_time - hdr->last_update < retention_scheduling_horizon) ? TRUE : FALSE;
+
+	/* Big speedup when reading retention data in bulk */
+	defer_downtime_sorting = 1;
+	defer_comment_sorting = 1;
+
+	xrdb_restore_program(&map);
+
+	/* status first, in parallel, then everything that can't be done that way */
+	xrdb_run(&map, xrdb_restore_status);
+	for(i = 0; i < hdr->num_hosts; i++) {
+		if(map.hosts[i] == NULL)
+			continue;
+		xrdb_restore_host_config(&map, map.hosts[i], xrdb_host_slot(&map, i));
+		xrddefault_finish_host(map.hosts[i], map.hosts[i]->retain_status_information == TRUE ? xrdb_host_slot(&map, i)->is_flapping : FALSE);
+		}
+	for(i = 0; i < hdr->num_services; i++) {
+		if(map.services[i] == NULL)
+			continue;
+		xrdb_restore_service_config(&map, map.services[i], xrdb_service_slot(&map, i));
+		xrddefault_finish_service(map.services[i], map.services[i]->retain_status_information == TRUE ? xrdb_service_slot(&map, i)->is_flapping : FALSE);
+		}
+	for(i = 0; i < hdr->num_contacts; i++) {
+		if(map.contacts[i] != NULL)
+			xrdb_restore_contact(&map, map.contacts[i], xrdb_contact_slot(&map, i));
+		}
+	xrdb_restore_comments(&map);
+	xrdb_restore_downtimes(&map);
+
+	sort_downtime();
+	sort_comments();
+
+	log_debug_info(DEBUGL_RETENTIONDATA, 1, "Read binary retention data: %u hosts, %u services, %u contacts\n", hdr->num_hosts, hdr->num_services, hdr->num_contacts);
+	result = OK;
+	goto out;
+
+invalid:
+	logit(NSLOG_RUNTIME_WARNING, TRUE, "Warning: Binary retention file '%s' is damaged. Reading the text retention file instead.\n", binary_retention_file);
+
+out:
+	my_free(map.hosts);
+	my_free(map.services);
+	my_free(map.contacts);
+	munmap((void *)map.base, map.size);
+
+	return result;
+	}
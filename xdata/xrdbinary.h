@@ -0,0 +1,301 @@
+/*****************************************************************************
+ *
+ * XRDBINARY.H - Header file for binary state retention routines
+ *
+ *
+ * License:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *****************************************************************************/
+
+#ifndef NAGIOS_XRDBINARY_H_INCLUDED
+#define NAGIOS_XRDBINARY_H_INCLUDED
+
+#include <stdint.h>
+
+/*
+ * The binary retention file holds the same data as the text one, but
+ * in one fixed-size slot per host, service and contact, indexed by
+ * object id. A digest of the object names tells the reader whether
+ * the ids still match the objects in memory. If they don't, the slots
+ * are matched up by name instead, just like the text file is.
+ *
+ * The file is laid out afresh each time Nagios starts. After that,
+ * only the slots that have changed since the last save are written.
+ * Strings live in a heap area after the slots and are never updated
+ * in place: a changed string is appended to the heap and the slot is
+ * pointed at it once it's safely on disk. An update that is cut short
+ * thus leaves every slot with either its old or its new contents.
+ * The generation counter in the header is odd while an update is in
+ * progress.
+ *
+ * The file is only meant to be read on the host that wrote it, so
+ * everything is stored in native byte order.
+ */
+#define XRDBINARY_MAGIC          "NAGRETNB"
+#define XRDBINARY_VERSION        1
+#define XRDBINARY_BYTE_ORDER     0x01020304
+
+/*
+ * a nul-terminated string in the heap area. An offset of 0 means NULL.
+ * Custom variables are stored as one string holding the name and value
+ * of every modified variable, each nul-terminated.
+ */
+struct xrdb_string {
+	uint64_t offset;            /* from the start of the file */
+	uint32_t len;               /* not counting the final nul terminator */
+	uint32_t pad;
+	};
+
+struct xrdb_info {
+	int64_t last_update_check;
+	uint64_t update_uid;
+	int32_t update_available;
+	int32_t pad;
+	struct xrdb_string version;
+	struct xrdb_string last_version;
+	struct xrdb_string new_version;
+	};
+
+struct xrdb_program {
+	uint64_t modified_host_attributes;
+	uint64_t modified_service_attributes;
+	uint64_t next_comment_id;
+	uint64_t next_downtime_id;
+	uint64_t next_event_id;
+	uint64_t next_problem_id;
+	uint64_t next_notification_id;
+	struct xrdb_string global_host_event_handler;
+	struct xrdb_string global_service_event_handler;
+	int32_t enable_notifications;
+	int32_t execute_service_checks;
+	int32_t accept_passive_service_checks;
+	int32_t execute_host_checks;
+	int32_t accept_passive_host_checks;
+	int32_t enable_event_handlers;
+	int32_t obsess_over_services;
+	int32_t obsess_over_hosts;
+	int32_t check_service_freshness;
+	int32_t check_host_freshness;
+	int32_t enable_flap_detection;
+	int32_t process_performance_data;
+	};
+
+/*
+ * Commands and timeperiods are only stored if the matching modified
+ * attribute is set, since they aren't restored otherwise. The state
+ * history is stored oldest entry first.
+ */
+struct xrdb_host {
+	struct xrdb_string host_name;
+	struct xrdb_string check_command;
+	struct xrdb_string check_period;
+	struct xrdb_string notification_period;
+	struct xrdb_string event_handler;
+	struct xrdb_string event_handler_period;
+	struct xrdb_string plugin_output;
+	struct xrdb_string long_plugin_output;
+	struct xrdb_string perf_data;
+	struct xrdb_string custom_variables;
+	uint64_t modified_attributes;
+	uint64_t last_event_id;
+	uint64_t current_event_id;
+	uint64_t current_problem_id;
+	uint64_t last_problem_id;
+	uint64_t current_notification_id;
+	uint64_t flapping_comment_id;
+	int64_t last_check;
+	int64_t next_check;
+	int64_t last_state_change;
+	int64_t last_hard_state_change;
+	int64_t last_time_up;
+	int64_t last_time_down;
+	int64_t last_time_unreachable;
+	int64_t last_notification;
+	double execution_time;
+	double latency;
+	double percent_state_change;
+	double check_interval;
+	double retry_interval;
+	int32_t has_been_checked;
+	int32_t check_type;
+	int32_t current_state;
+	int32_t last_state;
+	int32_t last_hard_state;
+	int32_t check_options;
+	int32_t current_attempt;
+	int32_t max_attempts;
+	int32_t state_type;
+	int32_t notified_on;
+	int32_t current_notification_number;
+	int32_t notifications_enabled;
+	int32_t problem_has_been_acknowledged;
+	int32_t acknowledgement_type;
+	int32_t checks_enabled;
+	int32_t accept_passive_checks;
+	int32_t event_handler_enabled;
+	int32_t flap_detection_enabled;
+	int32_t process_performance_data;
+	int32_t obsess;
+	int32_t is_flapping;
+	int32_t check_flapping_recovery_notification;
+	int8_t state_history[MAX_STATE_HISTORY_ENTRIES];
+	int8_t pad[32 - MAX_STATE_HISTORY_ENTRIES];
+	};
+
+struct xrdb_service {
+	struct xrdb_string host_name;
+	struct xrdb_string description;
+	struct xrdb_string check_command;
+	struct xrdb_string check_period;
+	struct xrdb_string notification_period;
+	struct xrdb_string event_handler;
+	struct xrdb_string event_handler_period;
+	struct xrdb_string plugin_output;
+	struct xrdb_string long_plugin_output;
+	struct xrdb_string perf_data;
+	struct xrdb_string custom_variables;
+	uint64_t modified_attributes;
+	uint64_t last_event_id;
+	uint64_t current_event_id;
+	uint64_t current_problem_id;
+	uint64_t last_problem_id;
+	uint64_t current_notification_id;
+	uint64_t flapping_comment_id;
+	int64_t last_check;
+	int64_t next_check;
+	int64_t last_state_change;
+	int64_t last_hard_state_change;
+	int64_t last_time_ok;
+	int64_t last_time_warning;
+	int64_t last_time_unknown;
+	int64_t last_time_critical;
+	int64_t last_notification;
+	double execution_time;
+	double latency;
+	double percent_state_change;
+	double check_interval;
+	double retry_interval;
+	int32_t has_been_checked;
+	int32_t check_type;
+	int32_t current_state;
+	int32_t last_state;
+	int32_t last_hard_state;
+	int32_t check_options;
+	int32_t current_attempt;
+	int32_t max_attempts;
+	int32_t state_type;
+	int32_t notified_on;
+	int32_t current_notification_number;
+	int32_t notifications_enabled;
+	int32_t problem_has_been_acknowledged;
+	int32_t acknowledgement_type;
+	int32_t checks_enabled;
+	int32_t accept_passive_checks;
+	int32_t event_handler_enabled;
+	int32_t flap_detection_enabled;
+	int32_t process_performance_data;
+	int32_t obsess;
+	int32_t is_flapping;
+	int32_t check_flapping_recovery_notification;
+	int8_t state_history[MAX_STATE_HISTORY_ENTRIES];
+	int8_t pad[32 - MAX_STATE_HISTORY_ENTRIES];
+	};
+
+struct xrdb_contact {
+	struct xrdb_string contact_name;
+	struct xrdb_string host_notification_period;
+	struct xrdb_string service_notification_period;
+	struct xrdb_string custom_variables;
+	uint64_t modified_attributes;
+	uint64_t modified_host_attributes;
+	uint64_t modified_service_attributes;
+	int64_t last_host_notification;
+	int64_t last_service_notification;
+	int32_t host_notifications_enabled;
+	int32_t service_notifications_enabled;
+	};
+
+/*
+ * Comments and downtimes are stored as one heap string each, holding
+ * a sequence of these records. Every record is followed by its
+ * nul-terminated strings (host name, service description, author and
+ * comment, in that order) and padded to an 8 byte boundary.
+ */
+struct xrdb_comment {
+	uint64_t comment_id;
+	int64_t entry_time;
+	int64_t expire_time;
+	int32_t comment_type;
+	int32_t entry_type;
+	int32_t source;
+	int32_t persistent;
+	int32_t expires;
+	int32_t pad;
+	uint32_t lengths[4];
+	};
+
+struct xrdb_downtime {
+	uint64_t downtime_id;
+	uint64_t triggered_by;
+	uint64_t duration;
+	int64_t entry_time;
+	int64_t start_time;
+	int64_t flex_downtime_start;
+	int64_t end_time;
+	int32_t type;
+	int32_t fixed;
+	int32_t is_in_effect;
+	int32_t start_notification_sent;
+	uint32_t lengths[4];
+	};
+
+struct xrdb_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t byte_order;
+	uint32_t pad;
+	uint64_t generation;        /* odd while an update is in progress */
+	int64_t created;            /* when the file was laid out */
+	int64_t last_update;        /* when the state was last saved */
+	uint32_t num_hosts;
+	uint32_t num_services;
+	uint32_t num_contacts;
+	uint32_t host_slot_size;
+	uint32_t service_slot_size;
+	uint32_t contact_slot_size;
+	uint64_t host_digest;       /* of the object names, in id order */
+	uint64_t service_digest;
+	uint64_t contact_digest;
+	uint64_t host_offset;
+	uint64_t service_offset;
+	uint64_t contact_offset;
+	uint64_t heap_offset;
+	uint64_t file_size;
+	struct xrdb_string comments;
+	struct xrdb_string downtimes;
+	struct xrdb_info info;
+	struct xrdb_program program;
+	};
+
+#ifdef NSCORE
+int xrdbinary_cleanup_retention_data(void);
+struct state_snapshot;
+int xrdbinary_save_state_information(const struct state_snapshot *);
+int xrdbinary_read_state_information(void);
+#endif
+
+#endif
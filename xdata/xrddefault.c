@@ -32,6 +32,7 @@
 #include "../include/sretention.h"
 #include "../include/comments.h"
 #include "../include/downtime.h"
+#include "../include/snapshot.h"
 #include "xrddefault.h"
 
 
@@ -78,15 +79,16 @@ int xrddefault_cleanup_retention_data(void) {
 /**************** DEFAULT STATE OUTPUT FUNCTION *******************/
 /******************************************************************/
 
-int xrddefault_save_state_information(void) {
+int xrddefault_save_state_information(const struct state_snapshot *snap) {
 	char *tmp_file = NULL;
 	customvariablesmember *temp_customvariablesmember = NULL;
 	time_t current_time = 0L;
 	int result = OK;
 	FILE *fp = NULL;
-	host *temp_host = NULL;
-	service *temp_service = NULL;
-	contact *temp_contact = NULL;
+	const struct snapshot_program *p = &snap->program;
+	const struct snapshot_host *temp_host = NULL;
+	const struct snapshot_service *temp_service = NULL;
+	const struct snapshot_contact *temp_contact = NULL;
 	nagios_comment *temp_comment = NULL;
 	scheduled_downtime *temp_downtime = NULL;
 	int x = 0;
@@ -147,46 +149,46 @@ int xrddefault_save_state_information(void) {
 	fprintf(fp, "# BY NAGIOS.  DO NOT MODIFY THIS FILE!\n");
 	fprintf(fp, "########################################\n");
 
-	time(&current_time);
+	current_time = snap->taken;
 
 	/* write file info */
 	fprintf(fp, "info {\n");
 	fprintf(fp, "created=%llu\n", (unsigned long long)current_time);
 	fprintf(fp, "version=%s\n", PROGRAM_VERSION);
-	fprintf(fp, "last_update_check=%llu\n", (unsigned long long)last_update_check);
-	fprintf(fp, "update_available=%d\n", update_available);
-	fprintf(fp, "update_uid=%lu\n", update_uid);
-	fprintf(fp, "last_version=%s\n", (last_program_version == NULL) ? "" : last_program_version);
-	fprintf(fp, "new_version=%s\n", (new_program_version == NULL) ? "" : new_program_version);
+	fprintf(fp, "last_update_check=%llu\n", (unsigned long long)p->last_update_check);
+	fprintf(fp, "update_available=%d\n", p->update_available);
+	fprintf(fp, "update_uid=%lu\n", p->update_uid);
+	fprintf(fp, "last_version=%s\n", (p->last_program_version == NULL) ? "" : p->last_program_version);
+	fprintf(fp, "new_version=%s\n", (p->new_program_version == NULL) ? "" : p->new_program_version);
 	fprintf(fp, "}\n");
 
 	/* save program state information */
 	fprintf(fp, "program {\n");
-	fprintf(fp, "modified_host_attributes=%lu\n", (modified_host_process_attributes & ~process_host_attribute_mask));
-	fprintf(fp, "modified_service_attributes=%lu\n", (modified_service_process_attributes & ~process_service_attribute_mask));
-	fprintf(fp, "enable_notifications=%d\n", enable_notifications);
-	fprintf(fp, "active_service_checks_enabled=%d\n", execute_service_checks);
-	fprintf(fp, "passive_service_checks_enabled=%d\n", accept_passive_service_checks);
-	fprintf(fp, "active_host_checks_enabled=%d\n", execute_host_checks);
-	fprintf(fp, "passive_host_checks_enabled=%d\n", accept_passive_host_checks);
-	fprintf(fp, "enable_event_handlers=%d\n", enable_event_handlers);
-	fprintf(fp, "obsess_over_services=%d\n", obsess_over_services);
-	fprintf(fp, "obsess_over_hosts=%d\n", obsess_over_hosts);
-	fprintf(fp, "check_service_freshness=%d\n", check_service_freshness);
-	fprintf(fp, "check_host_freshness=%d\n", check_host_freshness);
-	fprintf(fp, "enable_flap_detection=%d\n", enable_flap_detection);
-	fprintf(fp, "process_performance_data=%d\n", process_performance_data);
-	fprintf(fp, "global_host_event_handler=%s\n", (global_host_event_handler == NULL) ? "" : global_host_event_handler);
-	fprintf(fp, "global_service_event_handler=%s\n", (global_service_event_handler == NULL) ? "" : global_service_event_handler);
-	fprintf(fp, "next_comment_id=%lu\n", next_comment_id);
-	fprintf(fp, "next_downtime_id=%lu\n", next_downtime_id);
-	fprintf(fp, "next_event_id=%lu\n", next_event_id);
-	fprintf(fp, "next_problem_id=%lu\n", next_problem_id);
-	fprintf(fp, "next_notification_id=%lu\n", next_notification_id);
+	fprintf(fp, "modified_host_attributes=%lu\n", (p->modified_host_process_attributes & ~process_host_attribute_mask));
+	fprintf(fp, "modified_service_attributes=%lu\n", (p->modified_service_process_attributes & ~process_service_attribute_mask));
+	fprintf(fp, "enable_notifications=%d\n", p->enable_notifications);
+	fprintf(fp, "active_service_checks_enabled=%d\n", p->execute_service_checks);
+	fprintf(fp, "passive_service_checks_enabled=%d\n", p->accept_passive_service_checks);
+	fprintf(fp, "active_host_checks_enabled=%d\n", p->execute_host_checks);
+	fprintf(fp, "passive_host_checks_enabled=%d\n", p->accept_passive_host_checks);
+	fprintf(fp, "enable_event_handlers=%d\n", p->enable_event_handlers);
+	fprintf(fp, "obsess_over_services=%d\n", p->obsess_over_services);
+	fprintf(fp, "obsess_over_hosts=%d\n", p->obsess_over_hosts);
+	fprintf(fp, "check_service_freshness=%d\n", p->check_service_freshness);
+	fprintf(fp, "check_host_freshness=%d\n", p->check_host_freshness);
+	fprintf(fp, "enable_flap_detection=%d\n", p->enable_flap_detection);
+	fprintf(fp, "process_performance_data=%d\n", p->process_performance_data);
+	fprintf(fp, "global_host_event_handler=%s\n", (p->global_host_event_handler == NULL) ? "" : p->global_host_event_handler);
+	fprintf(fp, "global_service_event_handler=%s\n", (p->global_service_event_handler == NULL) ? "" : p->global_service_event_handler);
+	fprintf(fp, "next_comment_id=%lu\n", p->next_comment_id);
+	fprintf(fp, "next_downtime_id=%lu\n", p->next_downtime_id);
+	fprintf(fp, "next_event_id=%lu\n", p->next_event_id);
+	fprintf(fp, "next_problem_id=%lu\n", p->next_problem_id);
+	fprintf(fp, "next_notification_id=%lu\n", p->next_notification_id);
 	fprintf(fp, "}\n");
 
 	/* save host state information */
-	for(temp_host = host_list; temp_host != NULL; temp_host = temp_host->next) {
+	for(temp_host = snap->hosts; temp_host < snap->hosts + snap->num_hosts; temp_host++) {
 
 		fprintf(fp, "host {\n");
 		fprintf(fp, "host_name=%s\n", temp_host->name);
@@ -244,7 +246,7 @@ int xrddefault_save_state_information(void) {
 
 		fprintf(fp, "state_history=");
 		for(x = 0; x < MAX_STATE_HISTORY_ENTRIES; x++)
-			fprintf(fp, "%s%d", (x > 0) ? "," : "", temp_host->state_history[(x + temp_host->state_history_index) % MAX_STATE_HISTORY_ENTRIES]);
+			fprintf(fp, "%s%d", (x > 0) ? "," : "", temp_host->state_history[x]);
 		fprintf(fp, "\n");
 
 		/* custom variables */
@@ -257,7 +259,7 @@ int xrddefault_save_state_information(void) {
 		}
 
 	/* save service state information */
-	for(temp_service = service_list; temp_service != NULL; temp_service = temp_service->next) {
+	for(temp_service = snap->services; temp_service < snap->services + snap->num_services; temp_service++) {
 
 		fprintf(fp, "service {\n");
 		fprintf(fp, "host_name=%s\n", temp_service->host_name);
@@ -318,7 +320,7 @@ int xrddefault_save_state_information(void) {
 
 		fprintf(fp, "state_history=");
 		for(x = 0; x < MAX_STATE_HISTORY_ENTRIES; x++)
-			fprintf(fp, "%s%d", (x > 0) ? "," : "", temp_service->state_history[(x + temp_service->state_history_index) % MAX_STATE_HISTORY_ENTRIES]);
+			fprintf(fp, "%s%d", (x > 0) ? "," : "", temp_service->state_history[x]);
 		fprintf(fp, "\n");
 
 		/* custom variables */
@@ -331,7 +333,7 @@ int xrddefault_save_state_information(void) {
 		}
 
 	/* save contact state information */
-	for(temp_contact = contact_list; temp_contact != NULL; temp_contact = temp_contact->next) {
+	for(temp_contact = snap->contacts; temp_contact < snap->contacts + snap->num_contacts; temp_contact++) {
 
 		fprintf(fp, "contact {\n");
 		fprintf(fp, "contact_name=%s\n", temp_contact->name);
@@ -355,7 +357,7 @@ int xrddefault_save_state_information(void) {
 		}
 
 	/* save all comments */
-	for(temp_comment = comment_list; temp_comment != NULL; temp_comment = temp_comment->next) {
+	for(temp_comment = snap->comment_list; temp_comment != NULL; temp_comment = temp_comment->next) {
 
 		if(temp_comment->comment_type == HOST_COMMENT)
 			fprintf(fp, "hostcomment {\n");
@@ -377,7 +379,7 @@ int xrddefault_save_state_information(void) {
 		}
 
 	/* save all downtime */
-	for(temp_downtime = scheduled_downtime_list; temp_downtime != NULL; temp_downtime = temp_downtime->next) {
+	for(temp_downtime = snap->scheduled_downtime_list; temp_downtime != NULL; temp_downtime = temp_downtime->next) {
 
 		if(temp_downtime->type == HOST_DOWNTIME)
 			fprintf(fp, "hostdowntime {\n");
@@ -438,6 +440,203 @@ int xrddefault_save_state_information(void) {
 
 
 
+/******************************************************************/
+/****************** SHARED STATE INPUT FUNCTIONS ******************/
+/******************************************************************/
+
+/*
+ * these finish off objects whose retained state has been read, and
+ * are shared with the binary retention file reader
+ */
+
+/* finishes restoring the state of a host */
+void xrddefault_finish_host(host *temp_host, int was_flapping) {
+	customvariablesmember *temp_customvariablesmember = NULL;
+	int allow_flapstart_notification = TRUE;
+
+	/* adjust modified attributes if necessary */
+	if(temp_host->retain_nonstatus_information == FALSE)
+		temp_host->modified_attributes = MODATTR_NONE;
+
+	/* adjust modified attributes if no custom variables have been changed */
+	if(temp_host->modified_attributes & MODATTR_CUSTOM_VARIABLE) {
+		for(temp_customvariablesmember = temp_host->custom_variables; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
+			if(temp_customvariablesmember->has_been_modified == TRUE)
+				break;
+
+			}
+		if(temp_customvariablesmember == NULL)
+			temp_host->modified_attributes -= MODATTR_CUSTOM_VARIABLE;
+		}
+
+	/* calculate next possible notification time */
+	if(temp_host->current_state != HOST_UP && temp_host->last_notification != (time_t)0)
+		temp_host->next_notification = get_next_host_notification_time(temp_host, temp_host->last_notification);
+
+	/* ADDED 01/23/2009 adjust current check attempts if host in hard problem state (max attempts may have changed in config since restart) */
+	if(temp_host->current_state != HOST_UP && temp_host->state_type == HARD_STATE)
+		temp_host->current_attempt = temp_host->max_attempts;
+
+
+	/* ADDED 02/20/08 assume same flapping state if large install tweaks enabled */
+	if(use_large_installation_tweaks == TRUE) {
+		temp_host->is_flapping = was_flapping;
+		}
+	/* else use normal startup flap detection logic */
+	else {
+		/* host was flapping before program started */
+		/* 11/10/07 don't allow flapping notifications to go out */
+		if(was_flapping == TRUE)
+			allow_flapstart_notification = FALSE;
+		else
+			/* flapstart notifications are okay */
+			allow_flapstart_notification = TRUE;
+
+		/* check for flapping */
+		check_for_host_flapping(temp_host, FALSE, FALSE, allow_flapstart_notification);
+
+		/* host was flapping before and isn't now, so clear recovery check variable if host isn't flapping now */
+		if(was_flapping == TRUE && temp_host->is_flapping == FALSE)
+			temp_host->check_flapping_recovery_notification = FALSE;
+		}
+
+	/* handle new vars added in 2.x */
+	if(temp_host->last_hard_state_change == (time_t)0)
+		temp_host->last_hard_state_change = temp_host->last_state_change;
+
+	/* update host status */
+	update_host_status(temp_host, FALSE);
+	}
+
+
+/* finishes restoring the state of a service */
+void xrddefault_finish_service(service *temp_service, int was_flapping) {
+	customvariablesmember *temp_customvariablesmember = NULL;
+	int allow_flapstart_notification = TRUE;
+
+	/* adjust modified attributes if necessary */
+	if(temp_service->retain_nonstatus_information == FALSE)
+		temp_service->modified_attributes = MODATTR_NONE;
+
+	/* adjust modified attributes if no custom variables have been changed */
+	if(temp_service->modified_attributes & MODATTR_CUSTOM_VARIABLE) {
+		for(temp_customvariablesmember = temp_service->custom_variables; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
+			if(temp_customvariablesmember->has_been_modified == TRUE)
+				break;
+
+			}
+		if(temp_customvariablesmember == NULL)
+			temp_service->modified_attributes -= MODATTR_CUSTOM_VARIABLE;
+		}
+
+	/* calculate next possible notification time */
+	if(temp_service->current_state != STATE_OK && temp_service->last_notification != (time_t)0)
+		temp_service->next_notification = get_next_service_notification_time(temp_service, temp_service->last_notification);
+
+	/* fix old vars */
+	if(temp_service->has_been_checked == FALSE && temp_service->state_type == SOFT_STATE)
+		temp_service->state_type = HARD_STATE;
+
+	/* ADDED 01/23/2009 adjust current check attempt if service is in hard problem state (max attempts may have changed in config since restart) */
+	if(temp_service->current_state != STATE_OK && temp_service->state_type == HARD_STATE)
+		temp_service->current_attempt = temp_service->max_attempts;
+
+
+	/* ADDED 02/20/08 assume same flapping state if large install tweaks enabled */
+	if(use_large_installation_tweaks == TRUE) {
+		temp_service->is_flapping = was_flapping;
+		}
+	/* else use normal startup flap detection logic */
+	else {
+		/* service was flapping before program started */
+		/* 11/10/07 don't allow flapping notifications to go out */
+		if(was_flapping == TRUE)
+			allow_flapstart_notification = FALSE;
+		else
+			/* flapstart notifications are okay */
+			allow_flapstart_notification = TRUE;
+
+		/* check for flapping */
+		check_for_service_flapping(temp_service, FALSE, allow_flapstart_notification);
+
+		/* service was flapping before and isn't now, so clear recovery check variable if service isn't flapping now */
+		if(was_flapping == TRUE && temp_service->is_flapping == FALSE)
+			temp_service->check_flapping_recovery_notification = FALSE;
+		}
+
+	/* handle new vars added in 2.x */
+	if(temp_service->last_hard_state_change == (time_t)0)
+		temp_service->last_hard_state_change = temp_service->last_state_change;
+
+	/* update service status */
+	update_service_status(temp_service, FALSE);
+	}
+
+
+/* finishes restoring the state of a contact */
+void xrddefault_finish_contact(contact *temp_contact) {
+	customvariablesmember *temp_customvariablesmember = NULL;
+
+	/* adjust modified attributes if necessary */
+	if(temp_contact->retain_nonstatus_information == FALSE)
+		temp_contact->modified_attributes = MODATTR_NONE;
+
+	/* adjust modified attributes if no custom variables have been changed */
+	if(temp_contact->modified_attributes & MODATTR_CUSTOM_VARIABLE) {
+		for(temp_customvariablesmember = temp_contact->custom_variables; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
+			if(temp_customvariablesmember->has_been_modified == TRUE)
+				break;
+
+			}
+		if(temp_customvariablesmember == NULL)
+			temp_contact->modified_attributes -= MODATTR_CUSTOM_VARIABLE;
+		}
+
+	/* update contact status */
+	update_contact_status(temp_contact, FALSE);
+	}
+
+
+/* adds a retained comment, unless it's no longer wanted */
+void xrddefault_restore_comment(int type, int entry_type, char *host_name, char *service_description, time_t entry_time, char *author, char *comment_data, unsigned long comment_id, int persistent, int expires, time_t expire_time, int source) {
+	host *temp_host = NULL;
+	service *temp_service = NULL;
+	int remove_comment = FALSE;
+	int ack = FALSE;
+
+	/* add the comment */
+	add_comment(type, entry_type, host_name, service_description, entry_time, author, comment_data, comment_id, persistent, expires, expire_time, source);
+
+	/* delete the comment if necessary */
+	/* it seems a bit backwards to add and then immediately delete the comment, but its necessary to track comment deletions in the event broker */
+	remove_comment = FALSE;
+	/* host no longer exists */
+	if((temp_host = find_host(host_name)) == NULL)
+		remove_comment = TRUE;
+	/* service no longer exists */
+	else if(type == SERVICE_COMMENT && (temp_service = find_service(host_name, service_description)) == NULL)
+		remove_comment = TRUE;
+	/* acknowledgement comments get deleted if they're not persistent and the original problem is no longer acknowledged */
+	else if(entry_type == ACKNOWLEDGEMENT_COMMENT) {
+		ack = FALSE;
+		if(type == HOST_COMMENT)
+			ack = temp_host->problem_has_been_acknowledged;
+		else
+			ack = temp_service->problem_has_been_acknowledged;
+		if(ack == FALSE && persistent == FALSE)
+			remove_comment = TRUE;
+		}
+	/* non-persistent comments don't last past restarts UNLESS they're acks (see above) */
+	else if(persistent == FALSE && (sigrestart == FALSE || entry_type == DOWNTIME_COMMENT))
+		remove_comment = TRUE;
+
+	if(remove_comment == TRUE)
+		delete_comment(type, comment_id);
+	}
+
+
+
+
 /******************************************************************/
 /***************** DEFAULT STATE INPUT FUNCTION *******************/
 /******************************************************************/
@@ -489,10 +688,7 @@ int xrddefault_read_state_information(void) {
 	unsigned long contact_service_attribute_mask = 0L;
 	unsigned long process_host_attribute_mask = 0L;
 	unsigned long process_service_attribute_mask = 0L;
-	int remove_comment = FALSE;
-	int ack = FALSE;
 	int was_flapping = FALSE;
-	int allow_flapstart_notification = TRUE;
 	struct timeval tv[2];
 	double runtime[2];
 	int found_directive = FALSE;
@@ -520,9 +716,9 @@ int xrddefault_read_state_information(void) {
 	/* what attributes should be masked out? */
 	/* NOTE: host/service/contact-specific values may be added in the future, but for now we only have global masks */
 	process_host_attribute_mask = retained_process_host_attribute_mask;
-	process_service_attribute_mask = retained_process_host_attribute_mask;
+	process_service_attribute_mask = retained_process_service_attribute_mask;
 	host_attribute_mask = retained_host_attribute_mask;
-	service_attribute_mask = retained_host_attribute_mask;
+	service_attribute_mask = retained_service_attribute_mask;
 	contact_host_attribute_mask = retained_contact_host_attribute_mask;
 	contact_service_attribute_mask = retained_contact_service_attribute_mask;
 
@@ -585,65 +781,11 @@ int xrddefault_read_state_information(void) {
 
 				case XRDDEFAULT_HOSTSTATUS_DATA:
 
-					if(temp_host != NULL) {
-
-						/* adjust modified attributes if necessary */
-						if(temp_host->retain_nonstatus_information == FALSE)
-							temp_host->modified_attributes = MODATTR_NONE;
-
-						/* adjust modified attributes if no custom variables have been changed */
-						if(temp_host->modified_attributes & MODATTR_CUSTOM_VARIABLE) {
-							for(temp_customvariablesmember = temp_host->custom_variables; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
-								if(temp_customvariablesmember->has_been_modified == TRUE)
-									break;
-
-								}
-							if(temp_customvariablesmember == NULL)
-								temp_host->modified_attributes -= MODATTR_CUSTOM_VARIABLE;
-							}
-
-						/* calculate next possible notification time */
-						if(temp_host->current_state != HOST_UP && temp_host->last_notification != (time_t)0)
-							temp_host->next_notification = get_next_host_notification_time(temp_host, temp_host->last_notification);
-
-						/* ADDED 01/23/2009 adjust current check attempts if host in hard problem state (max attempts may have changed in config since restart) */
-						if(temp_host->current_state != HOST_UP && temp_host->state_type == HARD_STATE)
-							temp_host->current_attempt = temp_host->max_attempts;
-
-
-						/* ADDED 02/20/08 assume same flapping state if large install tweaks enabled */
-						if(use_large_installation_tweaks == TRUE) {
-							temp_host->is_flapping = was_flapping;
-							}
-						/* else use normal startup flap detection logic */
-						else {
-							/* host was flapping before program started */
-							/* 11/10/07 don't allow flapping notifications to go out */
-							if(was_flapping == TRUE)
-								allow_flapstart_notification = FALSE;
-							else
-								/* flapstart notifications are okay */
-								allow_flapstart_notification = TRUE;
-
-							/* check for flapping */
-							check_for_host_flapping(temp_host, FALSE, FALSE, allow_flapstart_notification);
-
-							/* host was flapping before and isn't now, so clear recovery check variable if host isn't flapping now */
-							if(was_flapping == TRUE && temp_host->is_flapping == FALSE)
-								temp_host->check_flapping_recovery_notification = FALSE;
-							}
-
-						/* handle new vars added in 2.x */
-						if(temp_host->last_hard_state_change == (time_t)0)
-							temp_host->last_hard_state_change = temp_host->last_state_change;
-
-						/* update host status */
-						update_host_status(temp_host, FALSE);
-						}
+					if(temp_host != NULL)
+						xrddefault_finish_host(temp_host, was_flapping);
 
 					/* reset vars */
 					was_flapping = FALSE;
-					allow_flapstart_notification = TRUE;
 
 					my_free(host_name);
 					host_name = NULL;
@@ -652,69 +794,11 @@ int xrddefault_read_state_information(void) {
 
 				case XRDDEFAULT_SERVICESTATUS_DATA:
 
-					if(temp_service != NULL) {
-
-						/* adjust modified attributes if necessary */
-						if(temp_service->retain_nonstatus_information == FALSE)
-							temp_service->modified_attributes = MODATTR_NONE;
-
-						/* adjust modified attributes if no custom variables have been changed */
-						if(temp_service->modified_attributes & MODATTR_CUSTOM_VARIABLE) {
-							for(temp_customvariablesmember = temp_service->custom_variables; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
-								if(temp_customvariablesmember->has_been_modified == TRUE)
-									break;
-
-								}
-							if(temp_customvariablesmember == NULL)
-								temp_service->modified_attributes -= MODATTR_CUSTOM_VARIABLE;
-							}
-
-						/* calculate next possible notification time */
-						if(temp_service->current_state != STATE_OK && temp_service->last_notification != (time_t)0)
-							temp_service->next_notification = get_next_service_notification_time(temp_service, temp_service->last_notification);
-
-						/* fix old vars */
-						if(temp_service->has_been_checked == FALSE && temp_service->state_type == SOFT_STATE)
-							temp_service->state_type = HARD_STATE;
-
-						/* ADDED 01/23/2009 adjust current check attempt if service is in hard problem state (max attempts may have changed in config since restart) */
-						if(temp_service->current_state != STATE_OK && temp_service->state_type == HARD_STATE)
-							temp_service->current_attempt = temp_service->max_attempts;
-
-
-						/* ADDED 02/20/08 assume same flapping state if large install tweaks enabled */
-						if(use_large_installation_tweaks == TRUE) {
-							temp_service->is_flapping = was_flapping;
-							}
-						/* else use normal startup flap detection logic */
-						else {
-							/* service was flapping before program started */
-							/* 11/10/07 don't allow flapping notifications to go out */
-							if(was_flapping == TRUE)
-								allow_flapstart_notification = FALSE;
-							else
-								/* flapstart notifications are okay */
-								allow_flapstart_notification = TRUE;
-
-							/* check for flapping */
-							check_for_service_flapping(temp_service, FALSE, allow_flapstart_notification);
-
-							/* service was flapping before and isn't now, so clear recovery check variable if service isn't flapping now */
-							if(was_flapping == TRUE && temp_service->is_flapping == FALSE)
-								temp_service->check_flapping_recovery_notification = FALSE;
-							}
-
-						/* handle new vars added in 2.x */
-						if(temp_service->last_hard_state_change == (time_t)0)
-							temp_service->last_hard_state_change = temp_service->last_state_change;
-
-						/* update service status */
-						update_service_status(temp_service, FALSE);
-						}
+					if(temp_service != NULL)
+						xrddefault_finish_service(temp_service, was_flapping);
 
 					/* reset vars */
 					was_flapping = FALSE;
-					allow_flapstart_notification = TRUE;
 
 					my_free(host_name);
 					my_free(service_description);
@@ -723,26 +807,8 @@ int xrddefault_read_state_information(void) {
 
 				case XRDDEFAULT_CONTACTSTATUS_DATA:
 
-					if(temp_contact != NULL) {
-
-						/* adjust modified attributes if necessary */
-						if(temp_contact->retain_nonstatus_information == FALSE)
-							temp_contact->modified_attributes = MODATTR_NONE;
-
-						/* adjust modified attributes if no custom variables have been changed */
-						if(temp_contact->modified_attributes & MODATTR_CUSTOM_VARIABLE) {
-							for(temp_customvariablesmember = temp_contact->custom_variables; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
-								if(temp_customvariablesmember->has_been_modified == TRUE)
-									break;
-
-								}
-							if(temp_customvariablesmember == NULL)
-								temp_contact->modified_attributes -= MODATTR_CUSTOM_VARIABLE;
-							}
-
-						/* update contact status */
-						update_contact_status(temp_contact, FALSE);
-						}
+					if(temp_contact != NULL)
+						xrddefault_finish_contact(temp_contact);
 
 					my_free(contact_name);
 					temp_contact = NULL;
@@ -751,34 +817,7 @@ int xrddefault_read_state_information(void) {
 				case XRDDEFAULT_HOSTCOMMENT_DATA:
 				case XRDDEFAULT_SERVICECOMMENT_DATA:
 
-					/* add the comment */
-					add_comment((data_type == XRDDEFAULT_HOSTCOMMENT_DATA) ? HOST_COMMENT : SERVICE_COMMENT, entry_type, host_name, service_description, entry_time, author, comment_data, comment_id, persistent, expires, expire_time, source);
-
-					/* delete the comment if necessary */
-					/* it seems a bit backwards to add and then immediately delete the comment, but its necessary to track comment deletions in the event broker */
-					remove_comment = FALSE;
-					/* host no longer exists */
-					if((temp_host = find_host(host_name)) == NULL)
-						remove_comment = TRUE;
-					/* service no longer exists */
-					else if(data_type == XRDDEFAULT_SERVICECOMMENT_DATA && (temp_service = find_service(host_name, service_description)) == NULL)
-						remove_comment = TRUE;
-					/* acknowledgement comments get deleted if they're not persistent and the original problem is no longer acknowledged */
-					else if(entry_type == ACKNOWLEDGEMENT_COMMENT) {
-						ack = FALSE;
-						if(data_type == XRDDEFAULT_HOSTCOMMENT_DATA)
-							ack = temp_host->problem_has_been_acknowledged;
-						else
-							ack = temp_service->problem_has_been_acknowledged;
-						if(ack == FALSE && persistent == FALSE)
-							remove_comment = TRUE;
-						}
-					/* non-persistent comments don't last past restarts UNLESS they're acks (see above) */
-					else if(persistent == FALSE && (sigrestart == FALSE || entry_type == DOWNTIME_COMMENT))
-						remove_comment = TRUE;
-
-					if(remove_comment == TRUE)
-						delete_comment((data_type == XRDDEFAULT_HOSTCOMMENT_DATA) ? HOST_COMMENT : SERVICE_COMMENT, comment_id);
+					xrddefault_restore_comment((data_type == XRDDEFAULT_HOSTCOMMENT_DATA) ? HOST_COMMENT : SERVICE_COMMENT, entry_type, host_name, service_description, entry_time, author, comment_data, comment_id, persistent, expires, expire_time, source);
 
 					/* free temp memory */
 					my_free(host_name);
@@ -1095,6 +1134,8 @@ int xrddefault_read_state_information(void) {
 							else
 								found_directive = FALSE;
 							}
+						else
+							found_directive = FALSE;
 						if(temp_host->retain_nonstatus_information == TRUE) {
 							/* null-op speeds up logic */
 							if(found_directive == TRUE);
@@ -1142,7 +1183,7 @@ int xrddefault_read_state_information(void) {
 									my_free(tempval);
 
 									if(temp_command != NULL && temp_ptr != NULL) {
-										my_free(temp_host->check_command);
+										free_object_string(temp_host->check_command);
 										temp_host->check_command = temp_ptr;
 										}
 									else
@@ -1157,7 +1198,7 @@ int xrddefault_read_state_information(void) {
 									temp_ptr = (char *)strdup(val);
 
 									if(temp_timeperiod != NULL && temp_ptr != NULL) {
-										my_free(temp_host->check_period);
+										free_object_string(temp_host->check_period);
 										temp_host->check_period = temp_ptr;
 										}
 									else
@@ -1172,7 +1213,7 @@ int xrddefault_read_state_information(void) {
 									temp_ptr = (char *)strdup(val);
 
 									if(temp_timeperiod != NULL && temp_ptr != NULL) {
-										my_free(temp_host->notification_period);
+										free_object_string(temp_host->notification_period);
 										temp_host->notification_period = temp_ptr;
 										}
 									else
@@ -1190,7 +1231,7 @@ int xrddefault_read_state_information(void) {
 									my_free(tempval);
 
 									if(temp_command != NULL && temp_ptr != NULL) {
-										my_free(temp_host->event_handler);
+										free_object_string(temp_host->event_handler);
 										temp_host->event_handler = temp_ptr;
 										}
 									else
@@ -1205,7 +1246,7 @@ int xrddefault_read_state_information(void) {
 									temp_ptr = (char *)strdup(val);
 
 									if(temp_timeperiod != NULL && temp_ptr != NULL) {
-										my_free(temp_host->event_handler_period);
+										free_object_string(temp_host->event_handler_period);
 										temp_host->event_handler_period = temp_ptr;
 										}
 									else
@@ -1239,14 +1280,11 @@ int xrddefault_read_state_information(void) {
 									/* get the variable name */
 									if((customvarname = (char *)strdup(var + 1))) {
 
-										for(temp_customvariablesmember = temp_host->custom_variables; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
-											if(!strcmp(customvarname, temp_customvariablesmember->variable_name)) {
-												if((x = atoi(val)) > 0 && strlen(val) > 3) {
-													my_free(temp_customvariablesmember->variable_value);
-													temp_customvariablesmember->variable_value = (char *)strdup(val + 2);
-													temp_customvariablesmember->has_been_modified = (x > 0) ? TRUE : FALSE;
-													}
-												break;
+										if((temp_customvariablesmember = find_indexed_custom_variable(temp_host->custom_variables, &temp_host->custom_variable_index, customvarname))) {
+											if((x = atoi(val)) > 0 && strlen(val) > 3) {
+												free_object_string(temp_customvariablesmember->variable_value);
+												temp_customvariablesmember->variable_value = (char *)strdup(val + 2);
+												temp_customvariablesmember->has_been_modified = (x > 0) ? TRUE : FALSE;
 												}
 											}
 
@@ -1383,6 +1421,8 @@ int xrddefault_read_state_information(void) {
 							else
 								found_directive = FALSE;
 							}
+						else
+							found_directive = FALSE;
 						if(temp_service->retain_nonstatus_information == TRUE) {
 							/* null-op speeds up logic */
 							if(found_directive == TRUE);
@@ -1430,7 +1470,7 @@ int xrddefault_read_state_information(void) {
 									my_free(tempval);
 
 									if(temp_command != NULL && temp_ptr != NULL) {
-										my_free(temp_service->check_command);
+										free_object_string(temp_service->check_command);
 										temp_service->check_command = temp_ptr;
 										}
 									else
@@ -1445,7 +1485,7 @@ int xrddefault_read_state_information(void) {
 									temp_ptr = (char *)strdup(val);
 
 									if(temp_timeperiod != NULL && temp_ptr != NULL) {
-										my_free(temp_service->check_period);
+										free_object_string(temp_service->check_period);
 										temp_service->check_period = temp_ptr;
 										}
 									else
@@ -1460,7 +1500,7 @@ int xrddefault_read_state_information(void) {
 									temp_ptr = (char *)strdup(val);
 
 									if(temp_timeperiod != NULL && temp_ptr != NULL) {
-										my_free(temp_service->notification_period);
+										free_object_string(temp_service->notification_period);
 										temp_service->notification_period = temp_ptr;
 										}
 									else
@@ -1478,7 +1518,7 @@ int xrddefault_read_state_information(void) {
 									my_free(tempval);
 
 									if(temp_command != NULL && temp_ptr != NULL) {
-										my_free(temp_service->event_handler);
+										free_object_string(temp_service->event_handler);
 										temp_service->event_handler = temp_ptr;
 										}
 									else
@@ -1493,7 +1533,7 @@ int xrddefault_read_state_information(void) {
 									temp_ptr = (char *)strdup(val);
 
 									if(temp_timeperiod != NULL && temp_ptr != NULL) {
-										my_free(temp_service->event_handler_period);
+										free_object_string(temp_service->event_handler_period);
 										temp_service->event_handler_period = temp_ptr;
 										}
 									else
@@ -1527,14 +1567,11 @@ int xrddefault_read_state_information(void) {
 									/* get the variable name */
 									if((customvarname = (char *)strdup(var + 1))) {
 
-										for(temp_customvariablesmember = temp_service->custom_variables; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
-											if(!strcmp(customvarname, temp_customvariablesmember->variable_name)) {
-												if((x = atoi(val)) > 0 && strlen(val) > 3) {
-													my_free(temp_customvariablesmember->variable_value);
-													temp_customvariablesmember->variable_value = (char *)strdup(val + 2);
-													temp_customvariablesmember->has_been_modified = (x > 0) ? TRUE : FALSE;
-													}
-												break;
+										if((temp_customvariablesmember = find_indexed_custom_variable(temp_service->custom_variables, &temp_service->custom_variable_index, customvarname))) {
+											if((x = atoi(val)) > 0 && strlen(val) > 3) {
+												free_object_string(temp_customvariablesmember->variable_value);
+												temp_customvariablesmember->variable_value = (char *)strdup(val + 2);
+												temp_customvariablesmember->has_been_modified = (x > 0) ? TRUE : FALSE;
 												}
 											}
 
@@ -1585,6 +1622,8 @@ int xrddefault_read_state_information(void) {
 							else
 								found_directive = FALSE;
 							}
+						else
+							found_directive = FALSE;
 						if(temp_contact->retain_nonstatus_information == TRUE) {
 							/* null-op speeds up logic */
 							if(found_directive == TRUE);
@@ -1597,7 +1636,7 @@ int xrddefault_read_state_information(void) {
 									temp_ptr = (char *)strdup(val);
 
 									if(temp_timeperiod != NULL && temp_ptr != NULL) {
-										my_free(temp_contact->host_notification_period);
+										free_object_string(temp_contact->host_notification_period);
 										temp_contact->host_notification_period = temp_ptr;
 										}
 									else
@@ -1612,7 +1651,7 @@ int xrddefault_read_state_information(void) {
 									temp_ptr = (char *)strdup(val);
 
 									if(temp_timeperiod != NULL && temp_ptr != NULL) {
-										my_free(temp_contact->service_notification_period);
+										free_object_string(temp_contact->service_notification_period);
 										temp_contact->service_notification_period = temp_ptr;
 										}
 									else
@@ -1635,14 +1674,11 @@ int xrddefault_read_state_information(void) {
 									/* get the variable name */
 									if((customvarname = (char *)strdup(var + 1))) {
 
-										for(temp_customvariablesmember = temp_contact->custom_variables; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
-											if(!strcmp(customvarname, temp_customvariablesmember->variable_name)) {
-												if((x = atoi(val)) > 0 && strlen(val) > 3) {
-													my_free(temp_customvariablesmember->variable_value);
-													temp_customvariablesmember->variable_value = (char *)strdup(val + 2);
-													temp_customvariablesmember->has_been_modified = (x > 0) ? TRUE : FALSE;
-													}
-												break;
+										if((temp_customvariablesmember = find_indexed_custom_variable(temp_contact->custom_variables, &temp_contact->custom_variable_index, customvarname))) {
+											if((x = atoi(val)) > 0 && strlen(val) > 3) {
+												free_object_string(temp_customvariablesmember->variable_value);
+												temp_customvariablesmember->variable_value = (char *)strdup(val + 2);
+												temp_customvariablesmember->has_been_modified = (x > 0) ? TRUE : FALSE;
 												}
 											}
 
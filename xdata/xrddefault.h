@@ -37,7 +37,13 @@
 
 int xrddefault_initialize_retention_data(const char *);
 int xrddefault_cleanup_retention_data(void);
-int xrddefault_save_state_information(void);        /* saves all host and service state information */
+struct state_snapshot;
+int xrddefault_save_state_information(const struct state_snapshot *);  /* saves all host and service state information */
 int xrddefault_read_state_information(void);        /* reads in initial host and service state information */
 
+void xrddefault_finish_host(host *, int);
+void xrddefault_finish_service(service *, int);
+void xrddefault_finish_contact(contact *);
+void xrddefault_restore_comment(int, int, char *, char *, time_t, char *, char *, unsigned long, int, int, time_t, int);
+
 #endif
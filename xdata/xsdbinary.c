@@ -0,0 +1,1110 @@
+/*****************************************************************************
+ *
+ * XSDBINARY.C - Binary status data routines for Nagios
+ *
+ *
+ * License:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *****************************************************************************/
+
+
+/*********** COMMON HEADER FILES ***********/
+
+#include "../include/config.h"
+#include "../include/common.h"
+#include "../include/locations.h"
+#include "../include/statusdata.h"
+#include "../include/comments.h"
+#include "../include/downtime.h"
+#include "../include/macros.h"
+#include "xsdbinary.h"
+#include <stddef.h>
+#include <sys/mman.h>
+
+#ifdef NSCORE
+#include "../include/nagios.h"
+#include "../include/snapshot.h"
+#endif
+
+#ifdef NSCGI
+#include "../include/cgiutils.h"
+extern int accept_passive_service_checks;
+extern int execute_host_checks;
+extern int accept_passive_host_checks;
+extern int enable_event_handlers;
+extern int obsess_over_services;
+extern int check_service_freshness;
+extern int check_host_freshness;
+extern int enable_flap_detection;
+extern int process_performance_data;
+extern int program_stats[MAX_CHECK_STATS_TYPES][3];
+#endif
+
+
+#define XSDB_ALIGN(x) (((x) + 7) & ~((uint64_t)7))
+
+
+#ifdef NSCORE
+
+/* check output changes a lot, so leave it some room to grow in place */
+#define XSDB_OUTPUT_SLACK        64
+#define XSDB_BLOB_SLACK          1024
+#define XSDB_APPEND_BUFSIZE      (64 * 1024)
+
+/* don't bother compacting the heap until this much of it is wasted */
+#define XSDB_MIN_WASTE           (1024 * 1024)
+
+static struct {
+	int fd;
+	ino_t inode;
+	uint64_t heap_end;
+	uint64_t heap_waste;
+	unsigned long bytes_written;
+	struct xsdb_header hdr;
+	struct xsdb_host *hosts;        /* the host slots as they are on disk */
+	struct xsdb_service *services;  /* the service slots as they are on disk */
+	uint64_t *host_hashes;          /* output, long output and perfdata */
+	uint64_t *service_hashes;
+	uint64_t blob_hashes[2];        /* comments and downtimes */
+	char *appendbuf;
+	size_t appendlen;
+	uint64_t appendoff;
+	char *blob;
+	size_t blob_len, blob_size;
+	} sdb = { -1 };
+
+
+/******************************************************************/
+/********************* INIT/CLEANUP FUNCTIONS *********************/
+/******************************************************************/
+
+static void xsdb_close(void) {
+	if(sdb.fd >= 0)
+		close(sdb.fd);
+	sdb.fd = -1;
+	my_free(sdb.hosts);
+	my_free(sdb.services);
+	my_free(sdb.host_hashes);
+	my_free(sdb.service_hashes);
+	}
+
+
+/* initialize binary status data */
+int xsdbinary_initialize_status_data(const char *cfgfile) {
+
+	xsdb_close();
+
+	/* delete the old status file (it might not exist) */
+	if(binary_status_file)
+		unlink(binary_status_file);
+
+	return OK;
+	}
+
+
+/* cleanup binary status data before terminating */
+int xsdbinary_cleanup_status_data(int delete_status_data) {
+	int result = OK;
+
+	xsdb_close();
+	my_free(sdb.appendbuf);
+	my_free(sdb.blob);
+	sdb.blob_len = sdb.blob_size = 0;
+
+	/* delete the status file */
+	if(delete_status_data == TRUE && binary_status_file) {
+		if(unlink(binary_status_file) && errno != ENOENT)
+			result = ERROR;
+		}
+
+	/* free memory */
+	my_free(binary_status_file);
+
+	return result;
+	}
+
+
+/******************************************************************/
+/****************** STATUS DATA OUTPUT FUNCTIONS ******************/
+/******************************************************************/
+
+static uint64_t xsdb_hash(const char *str, size_t len) {
+	uint64_t h = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for(i = 0; i < len; i++) {
+		h ^= (unsigned char)str[i];
+		h *= 0x100000001b3ULL;
+		}
+
+	return h;
+	}
+
+
+static int xsdb_pwrite(const void *buf, size_t len, uint64_t off) {
+	const char *p = buf;
+	ssize_t ret;
+
+	sdb.bytes_written += len;
+	while(len > 0) {
+		ret = pwrite(sdb.fd, p, len, (off_t)off);
+		if(ret < 0) {
+			if(errno == EINTR)
+				continue;
+			return ERROR;
+			}
+		p += ret;
+		len -= ret;
+		off += ret;
+		}
+
+	return OK;
+	}
+
+
+static int xsdb_flush_append(void) {
+	if(!sdb.appendlen)
+		return OK;
+	if(xsdb_pwrite(sdb.appendbuf, sdb.appendlen, sdb.appendoff) != OK)
+		return ERROR;
+	sdb.appendoff += sdb.appendlen;
+	sdb.appendlen = 0;
+	return OK;
+	}
+
+
+/* stores a string at the end of the heap */
+static int xsdb_append(const char *str, size_t len, size_t size) {
+	uint64_t off = sdb.heap_end;
+
+	sdb.heap_end += size;
+
+	if(sdb.appendlen + size > XSDB_APPEND_BUFSIZE && xsdb_flush_append() != OK)
+		return ERROR;
+
+	/* too big to buffer. The padding is left as a hole in the file */
+	if(size > XSDB_APPEND_BUFSIZE) {
+		sdb.appendoff = off + size;
+		return xsdb_pwrite(str, len, off);
+		}
+
+	if(len)
+		memcpy(sdb.appendbuf + sdb.appendlen, str, len);
+	memset(sdb.appendbuf + sdb.appendlen + len, 0, size - len);
+	sdb.appendlen += size;
+	return OK;
+	}
+
+
+/*
+ * Updates a string in the heap, in place if it fits. Strings passed
+ * with a hash are skipped if their contents haven't changed since
+ * the last time they were written.
+ */
+static int xsdb_set_string(struct xsdb_string *s, uint64_t *hash, const char *str, size_t len, size_t slack) {
+	uint64_t h;
+
+	if(str == NULL)
+		len = 0;
+
+	if(hash != NULL) {
+		h = xsdb_hash(str, len);
+		if(s->size && *hash == h && s->len == len)
+			return OK;
+		*hash = h;
+		}
+
+	/* readers go by the length, so the nul terminator can stay where it was */
+	if(len < s->size) {
+		s->len = len;
+		return len ? xsdb_pwrite(str, len, s->offset) : OK;
+		}
+
+	sdb.heap_waste += s->size;
+	s->offset = sdb.heap_end;
+	s->size = XSDB_ALIGN(len + 1 + slack);
+	s->len = len;
+	return xsdb_append(str, len, s->size);
+	}
+
+
+static void xsdb_blob_add(const void *data, size_t len) {
+	size_t need = XSDB_ALIGN(sdb.blob_len + len);
+	char *p;
+
+	if(need > sdb.blob_size) {
+		p = realloc(sdb.blob, need * 2);
+		if(p == NULL)
+			return;
+		sdb.blob = p;
+		sdb.blob_size = need * 2;
+		}
+	memcpy(sdb.blob + sdb.blob_len, data, len);
+	sdb.blob_len += len;
+	}
+
+
+static void xsdb_blob_add_string(const char *str, uint32_t *lenp) {
+	*lenp = str ? strlen(str) : 0;
+	xsdb_blob_add(str ? str : "", *lenp + 1);
+	}
+
+
+static void xsdb_blob_pad(void) {
+	static const char zero[8];
+	xsdb_blob_add(zero, XSDB_ALIGN(sdb.blob_len) - sdb.blob_len);
+	}
+
+
+static void xsdb_build_comments(const struct state_snapshot *snap) {
+	struct xsdb_comment rec;
+	nagios_comment *temp_comment;
+	size_t start;
+
+	sdb.blob_len = 0;
+	for(temp_comment = snap->comment_list; temp_comment != NULL; temp_comment = temp_comment->next) {
+		memset(&rec, 0, sizeof(rec));
+		rec.comment_id = temp_comment->comment_id;
+		rec.entry_time = temp_comment->entry_time;
+		rec.expire_time = temp_comment->expire_time;
+		rec.comment_type = temp_comment->comment_type;
+		rec.entry_type = temp_comment->entry_type;
+		rec.source = temp_comment->source;
+		rec.persistent = temp_comment->persistent;
+		rec.expires = temp_comment->expires;
+
+		start = sdb.blob_len;
+		xsdb_blob_add(&rec, sizeof(rec));
+		xsdb_blob_add_string(temp_comment->host_name, &rec.lengths[0]);
+		xsdb_blob_add_string(temp_comment->comment_type == SERVICE_COMMENT ? temp_comment->service_description : NULL, &rec.lengths[1]);
+		xsdb_blob_add_string(temp_comment->author, &rec.lengths[2]);
+		xsdb_blob_add_string(temp_comment->comment_data, &rec.lengths[3]);
+		xsdb_blob_pad();
+		if(sdb.blob_len >= start + sizeof(rec))
+			memcpy(sdb.blob + start, &rec, sizeof(rec));
+		}
+	}
+
+
+static void xsdb_build_downtimes(const struct state_snapshot *snap) {
+	struct xsdb_downtime rec;
+	scheduled_downtime *temp_downtime;
+	size_t start;
+
+	sdb.blob_len = 0;
+	for(temp_downtime = snap->scheduled_downtime_list; temp_downtime != NULL; temp_downtime = temp_downtime->next) {
+		memset(&rec, 0, sizeof(rec));
+		rec.downtime_id = temp_downtime->downtime_id;
+		rec.comment_id = temp_downtime->comment_id;
+		rec.triggered_by = temp_downtime->triggered_by;
+		rec.duration = temp_downtime->duration;
+		rec.entry_time = temp_downtime->entry_time;
+		rec.start_time = temp_downtime->start_time;
+		rec.flex_downtime_start = temp_downtime->flex_downtime_start;
+		rec.end_time = temp_downtime->end_time;
+		rec.type = temp_downtime->type;
+		rec.fixed = temp_downtime->fixed;
+		rec.is_in_effect = temp_downtime->is_in_effect;
+		rec.start_notification_sent = temp_downtime->start_notification_sent;
+
+		start = sdb.blob_len;
+		xsdb_blob_add(&rec, sizeof(rec));
+		xsdb_blob_add_string(temp_downtime->host_name, &rec.lengths[0]);
+		xsdb_blob_add_string(temp_downtime->type == SERVICE_DOWNTIME ? temp_downtime->service_description : NULL, &rec.lengths[1]);
+		xsdb_blob_add_string(temp_downtime->author, &rec.lengths[2]);
+		xsdb_blob_add_string(temp_downtime->comment, &rec.lengths[3]);
+		xsdb_blob_pad();
+		if(sdb.blob_len >= start + sizeof(rec))
+			memcpy(sdb.blob + start, &rec, sizeof(rec));
+		}
+	}
+
+
+static void xsdb_fill_program(struct xsdb_program *p, const struct snapshot_program *sp) {
+	int x;
+
+	p->program_start = sp->program_start;
+	p->last_log_rotation = sp->last_log_rotation;
+	p->nagios_pid = sp->nagios_pid;
+	p->daemon_mode = sp->daemon_mode;
+	p->enable_notifications = sp->enable_notifications;
+	p->execute_service_checks = sp->execute_service_checks;
+	p->accept_passive_service_checks = sp->accept_passive_service_checks;
+	p->execute_host_checks = sp->execute_host_checks;
+	p->accept_passive_host_checks = sp->accept_passive_host_checks;
+	p->enable_event_handlers = sp->enable_event_handlers;
+	p->obsess_over_services = sp->obsess_over_services;
+	p->obsess_over_hosts = sp->obsess_over_hosts;
+	p->check_service_freshness = sp->check_service_freshness;
+	p->check_host_freshness = sp->check_host_freshness;
+	p->enable_flap_detection = sp->enable_flap_detection;
+	p->process_performance_data = sp->process_performance_data;
+	for(x = 0; x < MAX_CHECK_STATS_TYPES; x++) {
+		p->check_stats[x][0] = sp->check_stats[x][0];
+		p->check_stats[x][1] = sp->check_stats[x][1];
+		p->check_stats[x][2] = sp->check_stats[x][2];
+		}
+	}
+
+
+static void xsdb_fill_host(struct xsdb_host *slot, const struct snapshot_host *hst) {
+	slot->last_check = hst->last_check;
+	slot->next_check = hst->next_check;
+	slot->last_state_change = hst->last_state_change;
+	slot->last_hard_state_change = hst->last_hard_state_change;
+	slot->last_time_up = hst->last_time_up;
+	slot->last_time_down = hst->last_time_down;
+	slot->last_time_unreachable = hst->last_time_unreachable;
+	slot->last_notification = hst->last_notification;
+	slot->next_notification = hst->next_notification;
+	slot->percent_state_change = hst->percent_state_change;
+	slot->latency = hst->latency;
+	slot->execution_time = hst->execution_time;
+	slot->current_state = hst->current_state;
+	slot->last_hard_state = hst->last_hard_state;
+	slot->state_type = hst->state_type;
+	slot->has_been_checked = hst->has_been_checked;
+	slot->should_be_scheduled = hst->should_be_scheduled;
+	slot->current_attempt = hst->current_attempt;
+	slot->max_attempts = hst->max_attempts;
+	slot->check_options = hst->check_options;
+	slot->check_type = hst->check_type;
+	slot->no_more_notifications = hst->no_more_notifications;
+	slot->current_notification_number = hst->current_notification_number;
+	slot->notifications_enabled = hst->notifications_enabled;
+	slot->problem_has_been_acknowledged = hst->problem_has_been_acknowledged;
+	slot->acknowledgement_type = hst->acknowledgement_type;
+	slot->checks_enabled = hst->checks_enabled;
+	slot->accept_passive_checks = hst->accept_passive_checks;
+	slot->event_handler_enabled = hst->event_handler_enabled;
+	slot->flap_detection_enabled = hst->flap_detection_enabled;
+	slot->is_flapping = hst->is_flapping;
+	slot->scheduled_downtime_depth = hst->scheduled_downtime_depth;
+	slot->process_performance_data = hst->process_performance_data;
+	slot->obsess = hst->obsess;
+	}
+
+
+static void xsdb_fill_service(struct xsdb_service *slot, const struct snapshot_service *svc) {
+	slot->last_check = svc->last_check;
+	slot->next_check = svc->next_check;
+	slot->last_state_change = svc->last_state_change;
+	slot->last_hard_state_change = svc->last_hard_state_change;
+	slot->last_time_ok = svc->last_time_ok;
+	slot->last_time_warning = svc->last_time_warning;
+	slot->last_time_unknown = svc->last_time_unknown;
+	slot->last_time_critical = svc->last_time_critical;
+	slot->last_notification = svc->last_notification;
+	slot->next_notification = svc->next_notification;
+	slot->percent_state_change = svc->percent_state_change;
+	slot->latency = svc->latency;
+	slot->execution_time = svc->execution_time;
+	slot->current_state = svc->current_state;
+	slot->last_hard_state = svc->last_hard_state;
+	slot->state_type = svc->state_type;
+	slot->has_been_checked = svc->has_been_checked;
+	slot->should_be_scheduled = svc->should_be_scheduled;
+	slot->current_attempt = svc->current_attempt;
+	slot->max_attempts = svc->max_attempts;
+	slot->check_options = svc->check_options;
+	slot->check_type = svc->check_type;
+	slot->no_more_notifications = svc->no_more_notifications;
+	slot->current_notification_number = svc->current_notification_number;
+	slot->notifications_enabled = svc->notifications_enabled;
+	slot->problem_has_been_acknowledged = svc->problem_has_been_acknowledged;
+	slot->acknowledgement_type = svc->acknowledgement_type;
+	slot->checks_enabled = svc->checks_enabled;
+	slot->accept_passive_checks = svc->accept_passive_checks;
+	slot->event_handler_enabled = svc->event_handler_enabled;
+	slot->flap_detection_enabled = svc->flap_detection_enabled;
+	slot->is_flapping = svc->is_flapping;
+	slot->scheduled_downtime_depth = svc->scheduled_downtime_depth;
+	slot->process_performance_data = svc->process_performance_data;
+	slot->obsess = svc->obsess;
+	}
+
+
+/* creates a new, empty status file and resets our view of it */
+static int xsdb_layout(char **tmp_file, unsigned int nhosts, unsigned int nservices) {
+	struct xsdb_header *hdr = &sdb.hdr;
+
+	xsdb_close();
+
+	asprintf(tmp_file, "%s.XXXXXX", binary_status_file);
+	if(*tmp_file == NULL)
+		return ERROR;
+
+	if((sdb.fd = mkstemp(*tmp_file)) == -1) {
+		logit(NSLOG_RUNTIME_ERROR, TRUE, "Error: Unable to create temp file '%s' for writing binary status data: %s\n", *tmp_file, strerror(errno));
+		return ERROR;
+		}
+
+	sdb.hosts = calloc(nhosts ? nhosts : 1, sizeof(*sdb.hosts));
+	sdb.services = calloc(nservices ? nservices : 1, sizeof(*sdb.services));
+	sdb.host_hashes = calloc(nhosts ? nhosts * 3 : 1, sizeof(uint64_t));
+	sdb.service_hashes = calloc(nservices ? nservices * 3 : 1, sizeof(uint64_t));
+	if(!sdb.appendbuf)
+		sdb.appendbuf = malloc(XSDB_APPEND_BUFSIZE);
+	if(!sdb.hosts || !sdb.services || !sdb.host_hashes || !sdb.service_hashes || !sdb.appendbuf)
+		return ERROR;
+
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, XSDBINARY_MAGIC, sizeof(hdr->magic));
+	hdr->version = XSDBINARY_VERSION;
+	hdr->header_size = sizeof(*hdr);
+	hdr->created = time(NULL);
+	hdr->num_hosts = nhosts;
+	hdr->num_services = nservices;
+	hdr->host_slot_size = sizeof(struct xsdb_host);
+	hdr->service_slot_size = sizeof(struct xsdb_service);
+	hdr->host_offset = XSDB_ALIGN(sizeof(*hdr));
+	hdr->service_offset = hdr->host_offset + (uint64_t)nhosts * sizeof(struct xsdb_host);
+	hdr->heap_offset = hdr->service_offset + (uint64_t)nservices * sizeof(struct xsdb_service);
+
+	sdb.heap_end = hdr->heap_offset;
+	sdb.heap_waste = 0;
+	sdb.blob_hashes[0] = sdb.blob_hashes[1] = 0;
+
+	return OK;
+	}
+
+
+/*
+ * Writes all slots that have changed since the last update, or all
+ * of them if the file was just laid out. Consecutive changed slots
+ * are written with a single call.
+ */
+static int xsdb_update(const struct state_snapshot *snap, int full, unsigned int *hosts_written, unsigned int *services_written) {
+	struct xsdb_header *hdr = &sdb.hdr;
+	struct xsdb_host hslot;
+	struct xsdb_service sslot;
+	uint64_t old_heap_end = sdb.heap_end;
+	unsigned int i, run_end = 0;
+	int run = -1, changed;
+	const struct snapshot_host *hst;
+	const struct snapshot_service *svc;
+
+	/* tell readers an update is in progress */
+	hdr->generation++;
+	if(!full && xsdb_pwrite(&hdr->generation, sizeof(hdr->generation), offsetof(struct xsdb_header, generation)) != OK)
+		return ERROR;
+
+	sdb.appendoff = sdb.heap_end;
+	sdb.appendlen = 0;
+
+	/* hosts left out of the snapshot haven't changed */
+	for(hst = snap->hosts; hst < snap->hosts + snap->num_hosts; hst++) {
+		i = hst->id;
+
+		/* hosts whose status hasn't been updated can't have changed */
+		changed = full || hst->status_changed;
+		if(changed) {
+			hslot = sdb.hosts[i];
+			if(full && xsdb_set_string(&hslot.host_name, NULL, hst->name, strlen(hst->name), 0) != OK)
+				return ERROR;
+			if(xsdb_set_string(&hslot.plugin_output, &sdb.host_hashes[i * 3], hst->plugin_output, hst->plugin_output ? strlen(hst->plugin_output) : 0, XSDB_OUTPUT_SLACK) != OK)
+				return ERROR;
+			if(xsdb_set_string(&hslot.long_plugin_output, &sdb.host_hashes[i * 3 + 1], hst->long_plugin_output, hst->long_plugin_output ? strlen(hst->long_plugin_output) : 0, XSDB_OUTPUT_SLACK) != OK)
+				return ERROR;
+			if(xsdb_set_string(&hslot.perf_data, &sdb.host_hashes[i * 3 + 2], hst->perf_data, hst->perf_data ? strlen(hst->perf_data) : 0, XSDB_OUTPUT_SLACK) != OK)
+				return ERROR;
+			xsdb_fill_host(&hslot, hst);
+			changed = full || memcmp(&hslot, &sdb.hosts[i], sizeof(hslot));
+			}
+		if(!changed)
+			continue;
+
+		sdb.hosts[i] = hslot;
+		(*hosts_written)++;
+		if(run >= 0 && i != run_end) {
+			if(xsdb_pwrite(&sdb.hosts[run], (run_end - run) * sizeof(hslot), hdr->host_offset + (uint64_t)run * sizeof(hslot)) != OK)
+				return ERROR;
+			run = -1;
+			}
+		if(run < 0)
+			run = i;
+		run_end = i + 1;
+		}
+	if(run >= 0 && xsdb_pwrite(&sdb.hosts[run], (run_end - run) * sizeof(hslot), hdr->host_offset + (uint64_t)run * sizeof(hslot)) != OK)
+		return ERROR;
+
+	run = -1;
+	for(svc = snap->services; svc < snap->services + snap->num_services; svc++) {
+		i = svc->id;
+
+		changed = full || svc->status_changed;
+		if(changed) {
+			sslot = sdb.services[i];
+			if(full) {
+				/* services share the name string with their host */
+				sslot.host_name = sdb.hosts[svc->host_id].host_name;
+				if(xsdb_set_string(&sslot.description, NULL, svc->description, strlen(svc->description), 0) != OK)
+					return ERROR;
+				}
+			if(xsdb_set_string(&sslot.plugin_output, &sdb.service_hashes[i * 3], svc->plugin_output, svc->plugin_output ? strlen(svc->plugin_output) : 0, XSDB_OUTPUT_SLACK) != OK)
+				return ERROR;
+			if(xsdb_set_string(&sslot.long_plugin_output, &sdb.service_hashes[i * 3 + 1], svc->long_plugin_output, svc->long_plugin_output ? strlen(svc->long_plugin_output) : 0, XSDB_OUTPUT_SLACK) != OK)
+				return ERROR;
+			if(xsdb_set_string(&sslot.perf_data, &sdb.service_hashes[i * 3 + 2], svc->perf_data, svc->perf_data ? strlen(svc->perf_data) : 0, XSDB_OUTPUT_SLACK) != OK)
+				return ERROR;
+			xsdb_fill_service(&sslot, svc);
+			changed = full || memcmp(&sslot, &sdb.services[i], sizeof(sslot));
+			}
+		if(!changed)
+			continue;
+
+		sdb.services[i] = sslot;
+		(*services_written)++;
+		if(run >= 0 && i != run_end) {
+			if(xsdb_pwrite(&sdb.services[run], (run_end - run) * sizeof(sslot), hdr->service_offset + (uint64_t)run * sizeof(sslot)) != OK)
+				return ERROR;
+			run = -1;
+			}
+		if(run < 0)
+			run = i;
+		run_end = i + 1;
+		}
+	if(run >= 0 && xsdb_pwrite(&sdb.services[run], (run_end - run) * sizeof(sslot), hdr->service_offset + (uint64_t)run * sizeof(sslot)) != OK)
+		return ERROR;
+
+	xsdb_build_comments(snap);
+	if(xsdb_set_string(&hdr->comments, &sdb.blob_hashes[0], sdb.blob, sdb.blob_len, XSDB_BLOB_SLACK) != OK)
+		return ERROR;
+	xsdb_build_downtimes(snap);
+	if(xsdb_set_string(&hdr->downtimes, &sdb.blob_hashes[1], sdb.blob, sdb.blob_len, XSDB_BLOB_SLACK) != OK)
+		return ERROR;
+
+	if(xsdb_flush_append() != OK)
+		return ERROR;
+	if(sdb.heap_end != old_heap_end && ftruncate(sdb.fd, (off_t)sdb.heap_end) < 0)
+		return ERROR;
+
+	xsdb_fill_program(&hdr->program, &snap->program);
+	hdr->file_size = sdb.heap_end;
+	hdr->last_update = snap->taken;
+
+	/* the update is complete */
+	hdr->generation++;
+	return xsdb_pwrite(hdr, sizeof(*hdr), 0);
+	}
+
+
+/* does the file have to be laid out afresh? It does if it's new, gone or has too many holes */
+static int xsdb_needs_layout(unsigned int nhosts, unsigned int nservices) {
+	struct stat st;
+
+	if(sdb.fd < 0)
+		return TRUE;
+	if(stat(binary_status_file, &st) < 0 || st.st_ino != sdb.inode)
+		return TRUE;
+	if(sdb.hdr.num_hosts != nhosts || sdb.hdr.num_services != nservices)
+		return TRUE;
+	if(sdb.heap_waste > XSDB_MIN_WASTE && sdb.heap_waste > (sdb.heap_end - sdb.hdr.heap_offset) / 2)
+		return TRUE;
+
+	return FALSE;
+	}
+
+
+/* will the next update need every host and service? */
+int xsdbinary_needs_full_update(void) {
+	return xsdb_needs_layout(num_objects.hosts, num_objects.services);
+	}
+
+
+/* write all changed status data to the binary status file */
+int xsdbinary_save_status_data(const struct state_snapshot *snap) {
+	unsigned int hosts_written = 0, services_written = 0;
+	char *tmp_file = NULL;
+	struct stat st;
+	int full = FALSE;
+	int result;
+
+	log_debug_info(DEBUGL_FUNCTIONS, 0, "xsdbinary_save_status_data()\n");
+
+	if(!binary_status_file)
+		return OK;
+
+	if(xsdb_needs_layout(snap->total_hosts, snap->total_services) == TRUE) {
+
+		/* we can't lay it out without all the hosts and services. Next time */
+		if(snap->full == FALSE) {
+			xsdb_close();
+			return ERROR;
+			}
+		full = TRUE;
+		}
+
+	if(full == TRUE && xsdb_layout(&tmp_file, snap->total_hosts, snap->total_services) != OK) {
+		xsdb_close();
+		if(tmp_file)
+			unlink(tmp_file);
+		my_free(tmp_file);
+		return ERROR;
+		}
+
+	sdb.bytes_written = 0;
+	result = xsdb_update(snap, full, &hosts_written, &services_written);
+
+	if(result == OK && full == TRUE) {
+		fchmod(sdb.fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+		fsync(sdb.fd);
+		if(rename(tmp_file, binary_status_file) || fstat(sdb.fd, &st) < 0)
+			result = ERROR;
+		else
+			sdb.inode = st.st_ino;
+		}
+
+	if(result != OK) {
+		logit(NSLOG_RUNTIME_ERROR, TRUE, "Error: Unable to update binary status data file '%s': %s\n", binary_status_file, strerror(errno));
+		xsdb_close();
+		if(tmp_file)
+			unlink(tmp_file);
+		}
+	else {
+		status_update_stats.binary_bytes_written = sdb.bytes_written;
+		status_update_stats.binary_slots_written = hosts_written + services_written;
+		log_debug_info(DEBUGL_STATUSDATA, 1, "%s binary status data: %u of %u hosts, %u of %u services, %lu bytes\n",
+		               full == TRUE ? "Wrote" : "Updated", hosts_written, sdb.hdr.num_hosts,
+		               services_written, sdb.hdr.num_services, sdb.bytes_written);
+		}
+
+	my_free(tmp_file);
+
+	return result;
+	}
+
+#endif
+
+
+
+#ifdef NSCGI
+
+/******************************************************************/
+/******************* BINARY DATA INPUT FUNCTIONS ******************/
+/******************************************************************/
+
+/* how many times we try to get a consistent view before giving up */
+#define XSDB_READ_ATTEMPTS       10
+
+struct xsdb_map {
+	const char *base;
+	size_t size;
+	uint64_t heap_offset;
+	int torn;
+	};
+
+
+/* copies a string out of the mapped file */
+static char *xsdb_strdup(struct xsdb_map *map, const struct xsdb_string *s) {
+	char *ret;
+
+	if(!s->len)
+		return NULL;
+
+	/* a half-written slot can point anywhere */
+	if(s->offset < map->heap_offset || s->len >= s->size || s->offset + s->len > map->size) {
+		map->torn = TRUE;
+		return NULL;
+		}
+
+	if((ret = malloc(s->len + 1)) == NULL)
+		return NULL;
+	memcpy(ret, map->base + s->offset, s->len);
+	ret[s->len] = 0;
+	return ret;
+	}
+
+
+static void xsdb_free_hoststatus(hoststatus *hs) {
+	my_free(hs->host_name);
+	my_free(hs->plugin_output);
+	my_free(hs->long_plugin_output);
+	my_free(hs->perf_data);
+	free(hs);
+	}
+
+
+static void xsdb_free_servicestatus(servicestatus *ss) {
+	my_free(ss->host_name);
+	my_free(ss->description);
+	my_free(ss->plugin_output);
+	my_free(ss->long_plugin_output);
+	my_free(ss->perf_data);
+	free(ss);
+	}
+
+
+static hoststatus *xsdb_read_host(struct xsdb_map *map, const struct xsdb_host *slot, time_t last_update) {
+	hoststatus *hs;
+
+	if((hs = calloc(1, sizeof(*hs))) == NULL)
+		return NULL;
+
+	hs->host_name = xsdb_strdup(map, &slot->host_name);
+	hs->plugin_output = xsdb_strdup(map, &slot->plugin_output);
+	hs->long_plugin_output = xsdb_strdup(map, &slot->long_plugin_output);
+	hs->perf_data = xsdb_strdup(map, &slot->perf_data);
+	if(hs->plugin_output)
+		unescape_newlines(hs->plugin_output);
+	if(hs->long_plugin_output)
+		unescape_newlines(hs->long_plugin_output);
+	hs->last_update = last_update;
+	hs->last_check = slot->last_check;
+	hs->next_check = slot->next_check;
+	hs->last_state_change = slot->last_state_change;
+	hs->last_hard_state_change = slot->last_hard_state_change;
+	hs->last_time_up = slot->last_time_up;
+	hs->last_time_down = slot->last_time_down;
+	hs->last_time_unreachable = slot->last_time_unreachable;
+	hs->last_notification = slot->last_notification;
+	hs->next_notification = slot->next_notification;
+	hs->percent_state_change = slot->percent_state_change;
+	hs->latency = slot->latency;
+	hs->execution_time = slot->execution_time;
+	hs->status = slot->current_state;
+	hs->last_hard_state = slot->last_hard_state;
+	hs->state_type = slot->state_type;
+	hs->has_been_checked = slot->has_been_checked > 0 ? TRUE : FALSE;
+	hs->should_be_scheduled = slot->should_be_scheduled > 0 ? TRUE : FALSE;
+	hs->current_attempt = slot->current_attempt;
+	hs->max_attempts = slot->max_attempts;
+	hs->check_options = slot->check_options;
+	hs->check_type = slot->check_type;
+	hs->no_more_notifications = slot->no_more_notifications > 0 ? TRUE : FALSE;
+	hs->current_notification_number = slot->current_notification_number;
+	hs->notifications_enabled = slot->notifications_enabled > 0 ? TRUE : FALSE;
+	hs->problem_has_been_acknowledged = slot->problem_has_been_acknowledged > 0 ? TRUE : FALSE;
+	hs->acknowledgement_type = slot->acknowledgement_type;
+	hs->checks_enabled = slot->checks_enabled > 0 ? TRUE : FALSE;
+	hs->accept_passive_checks = slot->accept_passive_checks > 0 ? TRUE : FALSE;
+	hs->event_handler_enabled = slot->event_handler_enabled > 0 ? TRUE : FALSE;
+	hs->flap_detection_enabled = slot->flap_detection_enabled > 0 ? TRUE : FALSE;
+	hs->is_flapping = slot->is_flapping > 0 ? TRUE : FALSE;
+	hs->scheduled_downtime_depth = slot->scheduled_downtime_depth < 0 ? 0 : slot->scheduled_downtime_depth;
+	hs->process_performance_data = slot->process_performance_data > 0 ? TRUE : FALSE;
+	hs->obsess = slot->obsess > 0 ? TRUE : FALSE;
+
+	if(hs->host_name == NULL)
+		map->torn = TRUE;
+
+	return hs;
+	}
+
+
+static servicestatus *xsdb_read_service(struct xsdb_map *map, const struct xsdb_service *slot, time_t last_update) {
+	servicestatus *ss;
+
+	if((ss = calloc(1, sizeof(*ss))) == NULL)
+		return NULL;
+
+	ss->host_name = xsdb_strdup(map, &slot->host_name);
+	ss->description = xsdb_strdup(map, &slot->description);
+	ss->plugin_output = xsdb_strdup(map, &slot->plugin_output);
+	ss->long_plugin_output = xsdb_strdup(map, &slot->long_plugin_output);
+	ss->perf_data = xsdb_strdup(map, &slot->perf_data);
+	if(ss->plugin_output)
+		unescape_newlines(ss->plugin_output);
+	if(ss->long_plugin_output)
+		unescape_newlines(ss->long_plugin_output);
+	ss->last_update = last_update;
+	ss->last_check = slot->last_check;
+	ss->next_check = slot->next_check;
+	ss->last_state_change = slot->last_state_change;
+	ss->last_hard_state_change = slot->last_hard_state_change;
+	ss->last_time_ok = slot->last_time_ok;
+	ss->last_time_warning = slot->last_time_warning;
+	ss->last_time_unknown = slot->last_time_unknown;
+	ss->last_time_critical = slot->last_time_critical;
+	ss->last_notification = slot->last_notification;
+	ss->next_notification = slot->next_notification;
+	ss->percent_state_change = slot->percent_state_change;
+	ss->latency = slot->latency;
+	ss->execution_time = slot->execution_time;
+	ss->status = slot->current_state;
+	ss->last_hard_state = slot->last_hard_state;
+	ss->state_type = slot->state_type;
+	ss->has_been_checked = slot->has_been_checked > 0 ? TRUE : FALSE;
+	ss->should_be_scheduled = slot->should_be_scheduled > 0 ? TRUE : FALSE;
+	ss->current_attempt = slot->current_attempt;
+	ss->max_attempts = slot->max_attempts;
+	ss->check_options = slot->check_options;
+	ss->check_type = slot->check_type;
+	ss->no_more_notifications = slot->no_more_notifications > 0 ? TRUE : FALSE;
+	ss->current_notification_number = slot->current_notification_number;
+	ss->notifications_enabled = slot->notifications_enabled > 0 ? TRUE : FALSE;
+	ss->problem_has_been_acknowledged = slot->problem_has_been_acknowledged > 0 ? TRUE : FALSE;
+	ss->acknowledgement_type = slot->acknowledgement_type;
+	ss->checks_enabled = slot->checks_enabled > 0 ? TRUE : FALSE;
+	ss->accept_passive_checks = slot->accept_passive_checks > 0 ? TRUE : FALSE;
+	ss->event_handler_enabled = slot->event_handler_enabled > 0 ? TRUE : FALSE;
+	ss->flap_detection_enabled = slot->flap_detection_enabled > 0 ? TRUE : FALSE;
+	ss->is_flapping = slot->is_flapping > 0 ? TRUE : FALSE;
+	ss->scheduled_downtime_depth = slot->scheduled_downtime_depth < 0 ? 0 : slot->scheduled_downtime_depth;
+	ss->process_performance_data = slot->process_performance_data > 0 ? TRUE : FALSE;
+	ss->obsess = slot->obsess > 0 ? TRUE : FALSE;
+
+	if(ss->host_name == NULL || ss->description == NULL)
+		map->torn = TRUE;
+
+	return ss;
+	}
+
+
+/*
+ * Points 'strs' at the four strings following a comment or downtime
+ * record and returns the offset of the next record, or 0 if the
+ * record doesn't fit in the blob.
+ */
+static size_t xsdb_record_strings(const char *blob, size_t len, size_t off, size_t rec_size, const uint32_t *lengths, char **strs) {
+	int x;
+
+	off += rec_size;
+	for(x = 0; x < 4; x++) {
+		if(off + lengths[x] >= len || blob[off + lengths[x]] != 0)
+			return 0;
+		strs[x] = lengths[x] ? (char *)blob + off : NULL;
+		off += lengths[x] + 1;
+		}
+
+	return XSDB_ALIGN(off);
+	}
+
+
+static int xsdb_add_comments(const char *blob, size_t len) {
+	struct xsdb_comment rec;
+	char *strs[4];
+	size_t off = 0, next;
+
+	while(off + sizeof(rec) <= len) {
+		memcpy(&rec, blob + off, sizeof(rec));
+		if(!(next = xsdb_record_strings(blob, len, off, sizeof(rec), rec.lengths, strs)))
+			return ERROR;
+		add_comment(rec.comment_type, rec.entry_type, strs[0], strs[1], rec.entry_time, strs[2], strs[3], rec.comment_id, rec.persistent, rec.expires, rec.expire_time, rec.source);
+		off = next;
+		}
+
+	return OK;
+	}
+
+
+static int xsdb_add_downtimes(const char *blob, size_t len) {
+	struct xsdb_downtime rec;
+	scheduled_downtime *temp_downtime;
+	char *strs[4];
+	size_t off = 0, next;
+
+	while(off + sizeof(rec) <= len) {
+		memcpy(&rec, blob + off, sizeof(rec));
+		if(!(next = xsdb_record_strings(blob, len, off, sizeof(rec), rec.lengths, strs)))
+			return ERROR;
+		if(rec.type == HOST_DOWNTIME)
+			add_host_downtime(strs[0], rec.entry_time, strs[2], strs[3], rec.start_time, rec.flex_downtime_start, rec.end_time, rec.fixed, rec.triggered_by, rec.duration, rec.downtime_id, rec.is_in_effect, rec.start_notification_sent);
+		else
+			add_service_downtime(strs[0], strs[1], rec.entry_time, strs[2], strs[3], rec.start_time, rec.flex_downtime_start, rec.end_time, rec.fixed, rec.triggered_by, rec.duration, rec.downtime_id, rec.is_in_effect, rec.start_notification_sent);
+		if((temp_downtime = find_downtime(rec.type, rec.downtime_id)))
+			temp_downtime->comment_id = rec.comment_id;
+		off = next;
+		}
+
+	return OK;
+	}
+
+
+static void xsdb_apply_program(const struct xsdb_program *p) {
+	int x;
+
+	program_start = p->program_start;
+	last_log_rotation = p->last_log_rotation;
+	nagios_pid = p->nagios_pid;
+	daemon_mode = p->daemon_mode > 0 ? TRUE : FALSE;
+	enable_notifications = p->enable_notifications > 0 ? TRUE : FALSE;
+	execute_service_checks = p->execute_service_checks > 0 ? TRUE : FALSE;
+	accept_passive_service_checks = p->accept_passive_service_checks > 0 ? TRUE : FALSE;
+	execute_host_checks = p->execute_host_checks > 0 ? TRUE : FALSE;
+	accept_passive_host_checks = p->accept_passive_host_checks > 0 ? TRUE : FALSE;
+	enable_event_handlers = p->enable_event_handlers > 0 ? TRUE : FALSE;
+	obsess_over_services = p->obsess_over_services > 0 ? TRUE : FALSE;
+	obsess_over_hosts = p->obsess_over_hosts > 0 ? TRUE : FALSE;
+	check_service_freshness = p->check_service_freshness > 0 ? TRUE : FALSE;
+	check_host_freshness = p->check_host_freshness > 0 ? TRUE : FALSE;
+	enable_flap_detection = p->enable_flap_detection > 0 ? TRUE : FALSE;
+	process_performance_data = p->process_performance_data > 0 ? TRUE : FALSE;
+	for(x = 0; x < MAX_CHECK_STATS_TYPES; x++) {
+		program_stats[x][0] = p->check_stats[x][0];
+		program_stats[x][1] = p->check_stats[x][1];
+		program_stats[x][2] = p->check_stats[x][2];
+		}
+	}
+
+
+/*
+ * Makes one attempt at reading the status file. Everything is copied
+ * out of the mapping first and only handed to the rest of the CGI
+ * once we know the writer didn't touch the file while we were at it.
+ * Comments and downtimes go with the host and service status, so a
+ * program status read before them doesn't add them twice.
+ */
+static int xsdb_read(const char *status_file_name, int options, int *retry) {
+	const volatile struct xsdb_header *vhdr;
+	struct xsdb_header hdr;
+	struct xsdb_map map;
+	struct xsdb_host hslot;
+	struct xsdb_service sslot;
+	hoststatus **hosts = NULL;
+	servicestatus **services = NULL;
+	char *comments = NULL, *downtimes = NULL;
+	struct stat st;
+	void *base;
+	unsigned int i, nhosts = 0, nservices = 0, want_hosts, want_services;
+	int fd, result = ERROR;
+
+	*retry = FALSE;
+
+	if((fd = open(status_file_name, O_RDONLY)) < 0)
+		return ERROR;
+	if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(hdr)) {
+		close(fd);
+		return ERROR;
+		}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED)
+		return ERROR;
+
+	vhdr = base;
+	memcpy(&hdr, base, sizeof(hdr));
+	if(memcmp(hdr.magic, XSDBINARY_MAGIC, sizeof(hdr.magic)) || hdr.version != XSDBINARY_VERSION || hdr.header_size != sizeof(hdr)
+	   || hdr.host_slot_size != sizeof(hslot) || hdr.service_slot_size != sizeof(sslot)
+	   || hdr.host_offset + (uint64_t)hdr.num_hosts * sizeof(hslot) > hdr.service_offset
+	   || hdr.service_offset + (uint64_t)hdr.num_services * sizeof(sslot) > hdr.heap_offset
+	   || hdr.heap_offset > (uint64_t)st.st_size) {
+		munmap(base, st.st_size);
+		return ERROR;
+		}
+
+	/* an update is in progress, or grew the file after we mapped it */
+	if((hdr.generation & 1) || hdr.file_size > (uint64_t)st.st_size) {
+		munmap(base, st.st_size);
+		*retry = TRUE;
+		return ERROR;
+		}
+	__sync_synchronize();
+
+	map.base = base;
+	map.size = st.st_size;
+	map.heap_offset = hdr.heap_offset;
+	map.torn = FALSE;
+
+	want_hosts = (options & READ_HOST_STATUS) ? hdr.num_hosts : 0;
+	want_services = (options & READ_SERVICE_STATUS) ? hdr.num_services : 0;
+	hosts = calloc(want_hosts ? want_hosts : 1, sizeof(*hosts));
+	services = calloc(want_services ? want_services : 1, sizeof(*services));
+	if(hosts == NULL || services == NULL)
+		goto out;
+
+	for(nhosts = 0; nhosts < want_hosts && map.torn == FALSE; nhosts++) {
+		memcpy(&hslot, map.base + hdr.host_offset + (uint64_t)nhosts * sizeof(hslot), sizeof(hslot));
+		if((hosts[nhosts] = xsdb_read_host(&map, &hslot, hdr.last_update)) == NULL)
+			goto out;
+		}
+	for(nservices = 0; nservices < want_services && map.torn == FALSE; nservices++) {
+		memcpy(&sslot, map.base + hdr.service_offset + (uint64_t)nservices * sizeof(sslot), sizeof(sslot));
+		if((services[nservices] = xsdb_read_service(&map, &sslot, hdr.last_update)) == NULL)
+			goto out;
+		}
+	if(options & (READ_HOST_STATUS | READ_SERVICE_STATUS)) {
+		comments = xsdb_strdup(&map, &hdr.comments);
+		downtimes = xsdb_strdup(&map, &hdr.downtimes);
+		}
+
+	__sync_synchronize();
+	if(map.torn == TRUE || vhdr->generation != hdr.generation) {
+		*retry = TRUE;
+		goto out;
+		}
+
+	/* we have a consistent copy, so hand it over */
+	for(i = 0; i < nhosts; i++) {
+		add_host_status(hosts[i]);
+		hosts[i] = NULL;
+		}
+	for(i = 0; i < nservices; i++) {
+		add_service_status(services[i]);
+		services[i] = NULL;
+		}
+	if(comments)
+		xsdb_add_comments(comments, hdr.comments.len);
+	if(downtimes)
+		xsdb_add_downtimes(downtimes, hdr.downtimes.len);
+	if(options & READ_PROGRAM_STATUS)
+		xsdb_apply_program(&hdr.program);
+	result = OK;
+
+out:
+	for(i = 0; hosts && i < nhosts; i++) {
+		if(hosts[i])
+			xsdb_free_hoststatus(hosts[i]);
+		}
+	for(i = 0; services && i < nservices; i++) {
+		if(services[i])
+			xsdb_free_servicestatus(services[i]);
+		}
+	my_free(hosts);
+	my_free(services);
+	my_free(comments);
+	my_free(downtimes);
+	munmap(base, st.st_size);
+
+	return result;
+	}
+
+
+/* read the program, host, and service status information asked for in options */
+int xsdbinary_read_status_data(const char *status_file_name, int options) {
+	int attempt, retry = FALSE;
+	int x;
+
+	if(options & READ_PROGRAM_STATUS) {
+		for(x = 0; x < MAX_CHECK_STATS_TYPES; x++) {
+			program_stats[x][0] = 0;
+			program_stats[x][1] = 0;
+			program_stats[x][2] = 0;
+			}
+		}
+
+	defer_downtime_sorting = 1;
+	defer_comment_sorting = 1;
+
+	for(attempt = 0; attempt < XSDB_READ_ATTEMPTS; attempt++) {
+		if(xsdb_read(status_file_name, options, &retry) == OK)
+			break;
+		if(retry == FALSE)
+			return ERROR;
+		usleep(1000 * (attempt + 1));
+		}
+	if(attempt == XSDB_READ_ATTEMPTS)
+		return ERROR;
+
+	if(sort_downtime() != OK)
+		return ERROR;
+	if(sort_comments() != OK)
+		return ERROR;
+
+	return OK;
+	}
+
+#endif
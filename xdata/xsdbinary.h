@@ -0,0 +1,224 @@
+/*****************************************************************************
+ *
+ * XSDBINARY.H - Header file for binary status data routines
+ *
+ *
+ * License:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *****************************************************************************/
+
+#ifndef NAGIOS_XSDBINARY_H_INCLUDED
+#define NAGIOS_XSDBINARY_H_INCLUDED
+
+#include <stdint.h>
+
+/*
+ * The binary status file is laid out once when Nagios starts and
+ * then updated in place. It starts with a header holding the program
+ * status, followed by one fixed-size slot per host and one per
+ * service, indexed by object id. All strings live in a heap area
+ * after the slots. A string that outgrows the space reserved for it
+ * is moved to the end of the heap, and the file is laid out afresh
+ * once too much of the heap is taken up by such leftovers.
+ *
+ * The generation counter in the header is odd while Nagios is
+ * updating the file. Readers must check that it is even and that it
+ * is the same before and after they have copied out what they need.
+ *
+ * The file is only meant to be read on the host that wrote it, so
+ * everything is stored in native byte order.
+ */
+#define XSDBINARY_MAGIC          "NAGSTATB"
+#define XSDBINARY_VERSION        1
+
+/* a string in the heap area. 'len' is 0 for empty and NULL strings */
+struct xsdb_string {
+	uint64_t offset;            /* from the start of the file */
+	uint32_t len;               /* not counting the nul terminator */
+	uint32_t size;              /* bytes reserved at offset */
+	};
+
+struct xsdb_program {
+	int64_t program_start;
+	int64_t last_log_rotation;
+	int32_t nagios_pid;
+	int32_t daemon_mode;
+	int32_t enable_notifications;
+	int32_t execute_service_checks;
+	int32_t accept_passive_service_checks;
+	int32_t execute_host_checks;
+	int32_t accept_passive_host_checks;
+	int32_t enable_event_handlers;
+	int32_t obsess_over_services;
+	int32_t obsess_over_hosts;
+	int32_t check_service_freshness;
+	int32_t check_host_freshness;
+	int32_t enable_flap_detection;
+	int32_t process_performance_data;
+	int32_t check_stats[MAX_CHECK_STATS_TYPES][3];
+	};
+
+struct xsdb_host {
+	struct xsdb_string host_name;
+	struct xsdb_string plugin_output;
+	struct xsdb_string long_plugin_output;
+	struct xsdb_string perf_data;
+	int64_t last_check;
+	int64_t next_check;
+	int64_t last_state_change;
+	int64_t last_hard_state_change;
+	int64_t last_time_up;
+	int64_t last_time_down;
+	int64_t last_time_unreachable;
+	int64_t last_notification;
+	int64_t next_notification;
+	double percent_state_change;
+	double latency;
+	double execution_time;
+	int32_t current_state;
+	int32_t last_hard_state;
+	int32_t state_type;
+	int32_t has_been_checked;
+	int32_t should_be_scheduled;
+	int32_t current_attempt;
+	int32_t max_attempts;
+	int32_t check_options;
+	int32_t check_type;
+	int32_t no_more_notifications;
+	int32_t current_notification_number;
+	int32_t notifications_enabled;
+	int32_t problem_has_been_acknowledged;
+	int32_t acknowledgement_type;
+	int32_t checks_enabled;
+	int32_t accept_passive_checks;
+	int32_t event_handler_enabled;
+	int32_t flap_detection_enabled;
+	int32_t is_flapping;
+	int32_t scheduled_downtime_depth;
+	int32_t process_performance_data;
+	int32_t obsess;
+	};
+
+struct xsdb_service {
+	struct xsdb_string host_name;
+	struct xsdb_string description;
+	struct xsdb_string plugin_output;
+	struct xsdb_string long_plugin_output;
+	struct xsdb_string perf_data;
+	int64_t last_check;
+	int64_t next_check;
+	int64_t last_state_change;
+	int64_t last_hard_state_change;
+	int64_t last_time_ok;
+	int64_t last_time_warning;
+	int64_t last_time_unknown;
+	int64_t last_time_critical;
+	int64_t last_notification;
+	int64_t next_notification;
+	double percent_state_change;
+	double latency;
+	double execution_time;
+	int32_t current_state;
+	int32_t last_hard_state;
+	int32_t state_type;
+	int32_t has_been_checked;
+	int32_t should_be_scheduled;
+	int32_t current_attempt;
+	int32_t max_attempts;
+	int32_t check_options;
+	int32_t check_type;
+	int32_t no_more_notifications;
+	int32_t current_notification_number;
+	int32_t notifications_enabled;
+	int32_t problem_has_been_acknowledged;
+	int32_t acknowledgement_type;
+	int32_t checks_enabled;
+	int32_t accept_passive_checks;
+	int32_t event_handler_enabled;
+	int32_t flap_detection_enabled;
+	int32_t is_flapping;
+	int32_t scheduled_downtime_depth;
+	int32_t process_performance_data;
+	int32_t obsess;
+	};
+
+/*
+ * Comments and downtimes are stored as one heap string each, holding
+ * a sequence of these records. Every record is followed by its
+ * nul-terminated strings (host name, service description, author and
+ * comment, in that order) and padded to an 8 byte boundary.
+ */
+struct xsdb_comment {
+	uint64_t comment_id;
+	int64_t entry_time;
+	int64_t expire_time;
+	int32_t comment_type;
+	int32_t entry_type;
+	int32_t source;
+	int32_t persistent;
+	int32_t expires;
+	uint32_t lengths[4];
+	};
+
+struct xsdb_downtime {
+	uint64_t downtime_id;
+	uint64_t comment_id;
+	uint64_t triggered_by;
+	uint64_t duration;
+	int64_t entry_time;
+	int64_t start_time;
+	int64_t flex_downtime_start;
+	int64_t end_time;
+	int32_t type;
+	int32_t fixed;
+	int32_t is_in_effect;
+	int32_t start_notification_sent;
+	uint32_t lengths[4];
+	};
+
+struct xsdb_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t generation;        /* odd while an update is in progress */
+	int64_t created;            /* when the file was laid out */
+	int64_t last_update;
+	uint32_t num_hosts;
+	uint32_t num_services;
+	uint32_t host_slot_size;
+	uint32_t service_slot_size;
+	uint64_t host_offset;
+	uint64_t service_offset;
+	uint64_t heap_offset;
+	uint64_t file_size;
+	struct xsdb_string comments;
+	struct xsdb_string downtimes;
+	struct xsdb_program program;
+	};
+
+#ifdef NSCORE
+int xsdbinary_initialize_status_data(const char *);
+int xsdbinary_cleanup_status_data(int);
+struct state_snapshot;
+int xsdbinary_save_status_data(const struct state_snapshot *);
+int xsdbinary_needs_full_update(void);
+#endif
+
+#ifdef NSCGI
+int xsdbinary_read_status_data(const char *, int);
+#endif
+
+#endif
@@ -34,6 +34,8 @@
 
 #ifdef NSCORE
 #include "../include/nagios.h"
+#include "../include/workers.h"
+#include "../include/snapshot.h"
 #endif
 
 #ifdef NSCGI
@@ -60,6 +62,36 @@ int program_stats[MAX_CHECK_STATS_TYPES][3];
 
 #ifdef NSCORE
 
+#define SD_WRITER_BUFSIZE (256 * 1024)
+
+struct sd_writer {
+	int fd;
+	char *buf;
+	size_t len;                  /* bytes in buf */
+	unsigned long long flushed;  /* bytes written to fd */
+	int error;
+	};
+
+/* where a host or service record ended up in a status file we wrote */
+struct sd_record {
+	unsigned long long start;
+	unsigned int last_update;     /* offsets from start */
+	unsigned int last_update_end;
+	unsigned int end;
+	};
+
+/* the status file we wrote last, mapped read-only */
+static struct {
+	char *map;
+	size_t size;
+	unsigned int num_hosts;
+	unsigned int num_services;
+	struct sd_record *hosts;
+	struct sd_record *services;
+	} prev_status;
+
+static void xsddefault_drop_previous_status(void);
+
 /******************************************************************/
 /********************* INIT/CLEANUP FUNCTIONS *********************/
 /******************************************************************/
@@ -94,6 +126,8 @@ int xsddefault_initialize_status_data(const char *cfgfile) {
 /* cleanup status data before terminating */
 int xsddefault_cleanup_status_data(int delete_status_data) {
 
+	xsddefault_drop_previous_status();
+
 	/* delete the status log */
 	if(delete_status_data == TRUE && status_file) {
 		if(unlink(status_file))
@@ -111,18 +145,139 @@ int xsddefault_cleanup_status_data(int delete_status_data) {
 /****************** STATUS DATA OUTPUT FUNCTIONS ******************/
 /******************************************************************/
 
+/* a buffered writer that knows where in the file it is */
+static void sd_flush(struct sd_writer *w) {
+	size_t done = 0;
+	ssize_t ret;
+
+	while(done < w->len && w->error == FALSE) {
+		ret = write(w->fd, w->buf + done, w->len - done);
+		if(ret < 0) {
+			if(errno == EINTR)
+				continue;
+			w->error = TRUE;
+			break;
+			}
+		done += ret;
+		}
+	w->flushed += w->len;
+	w->len = 0;
+	}
+
+
+static void sd_write(struct sd_writer *w, const char *data, size_t len) {
+	size_t n;
+
+	while(len > 0) {
+		n = SD_WRITER_BUFSIZE - w->len;
+		if(n > len)
+			n = len;
+		memcpy(w->buf + w->len, data, n);
+		w->len += n;
+		data += n;
+		len -= n;
+		if(w->len == SD_WRITER_BUFSIZE)
+			sd_flush(w);
+		}
+	}
+
+
+static void sd_printf(struct sd_writer *w, const char *fmt, ...) {
+	va_list ap;
+	char *big = NULL;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(w->buf + w->len, SD_WRITER_BUFSIZE - w->len, fmt, ap);
+	va_end(ap);
+	if(n < 0) {
+		w->error = TRUE;
+		return;
+		}
+	if((size_t)n < SD_WRITER_BUFSIZE - w->len) {
+		w->len += n;
+		return;
+		}
+
+	/* it didn't fit, so make room or format it on the side */
+	sd_flush(w);
+	va_start(ap, fmt);
+	if((size_t)n < SD_WRITER_BUFSIZE) {
+		vsnprintf(w->buf, SD_WRITER_BUFSIZE, fmt, ap);
+		w->len = n;
+		}
+	else if(vasprintf(&big, fmt, ap) >= 0) {
+		sd_write(w, big, n);
+		free(big);
+		}
+	else
+		w->error = TRUE;
+	va_end(ap);
+	}
+
+
+static unsigned long long sd_tell(struct sd_writer *w) {
+	return w->flushed + w->len;
+	}
+
+
+/* forget about the last status file we wrote */
+static void xsddefault_drop_previous_status(void) {
+	if(prev_status.map)
+		munmap(prev_status.map, prev_status.size);
+	prev_status.map = NULL;
+	prev_status.size = 0;
+	my_free(prev_status.hosts);
+	my_free(prev_status.services);
+	}
+
+
+/* can the next update copy unchanged objects from the last file we wrote? */
+int xsddefault_needs_full_update(void) {
+	return prev_status.map == NULL ? TRUE : FALSE;
+	}
+
+
+/*
+ * Copies the record of an object whose status hasn't changed from the
+ * previous status file, updating only its last_update line.
+ */
+static int sd_splice(struct sd_writer *w, const struct sd_record *old, struct sd_record *new, time_t current_time) {
+	const char *rec;
+
+	if(!old->end || old->start + old->end > prev_status.size || old->last_update > old->last_update_end || old->last_update_end > old->end)
+		return ERROR;
+
+	rec = prev_status.map + old->start;
+	new->start = sd_tell(w);
+	new->last_update = old->last_update;
+	sd_write(w, rec, old->last_update);
+	sd_printf(w, "\tlast_update=%llu\n", (unsigned long long)current_time);
+	new->last_update_end = sd_tell(w) - new->start;
+	sd_write(w, rec + old->last_update_end, old->end - old->last_update_end);
+	new->end = sd_tell(w) - new->start;
+
+	return OK;
+	}
+
+
 /* write all status data to file */
-int xsddefault_save_status_data(void) {
+int xsddefault_save_status_data(const struct state_snapshot *snap) {
 	char *tmp_log = NULL;
 	customvariablesmember *temp_customvariablesmember = NULL;
-	host *temp_host = NULL;
-	service *temp_service = NULL;
-	contact *temp_contact = NULL;
+	const struct snapshot_program *p = &snap->program;
+	const struct snapshot_host *temp_host = snap->hosts, *hosts_end = snap->hosts + snap->num_hosts;
+	const struct snapshot_service *temp_service = snap->services, *services_end = snap->services + snap->num_services;
+	const struct snapshot_contact *temp_contact = NULL;
 	nagios_comment *temp_comment = NULL;
 	scheduled_downtime *temp_downtime = NULL;
 	time_t current_time;
 	int fd = 0;
-	FILE *fp = NULL;
+	struct sd_writer out;
+	struct sd_record *host_records = NULL, *service_records = NULL, *rec;
+	unsigned int i;
+	unsigned int objects_written = 0, objects_skipped = 0;
+	int splice = FALSE;
 	int result = OK;
 
 	log_debug_info(DEBUGL_FUNCTIONS, 0, "save_status_data()\n");
@@ -147,309 +302,389 @@ int xsddefault_save_status_data(void) {
 
 		return ERROR;
 		}
-	fp = (FILE *)fdopen(fd, "w");
-	if(fp == NULL) {
+	out.fd = fd;
+	out.len = 0;
+	out.flushed = 0;
+	out.error = FALSE;
+	out.buf = malloc(SD_WRITER_BUFSIZE);
+	host_records = calloc(snap->total_hosts ? snap->total_hosts : 1, sizeof(*host_records));
+	service_records = calloc(snap->total_services ? snap->total_services : 1, sizeof(*service_records));
+	if(out.buf == NULL || host_records == NULL || service_records == NULL) {
 
 		close(fd);
 		unlink(tmp_log);
 
 		/* log an error */
-		logit(NSLOG_RUNTIME_ERROR, TRUE, "Error: Unable to open temp file '%s' for writing status data: %s\n", tmp_log, strerror(errno));
+		logit(NSLOG_RUNTIME_ERROR, TRUE, "Error: Unable to allocate memory for writing status data\n");
 
 		/* free memory */
+		my_free(out.buf);
+		my_free(host_records);
+		my_free(service_records);
 		my_free(tmp_log);
 
 		return ERROR;
 		}
 
-	/* generate check statistics */
-	generate_check_stats();
+	/* unchanged hosts and services can be copied from the last file we wrote */
+	if(prev_status.map && prev_status.num_hosts == snap->total_hosts && prev_status.num_services == snap->total_services)
+		splice = TRUE;
 
 	/* write version info to status file */
-	fprintf(fp, "########################################\n");
-	fprintf(fp, "#          NAGIOS STATUS FILE\n");
-	fprintf(fp, "#\n");
-	fprintf(fp, "# THIS FILE IS AUTOMATICALLY GENERATED\n");
-	fprintf(fp, "# BY NAGIOS.  DO NOT MODIFY THIS FILE!\n");
-	fprintf(fp, "########################################\n\n");
+	sd_printf(&out, "########################################\n");
+	sd_printf(&out, "#          NAGIOS STATUS FILE\n");
+	sd_printf(&out, "#\n");
+	sd_printf(&out, "# THIS FILE IS AUTOMATICALLY GENERATED\n");
+	sd_printf(&out, "# BY NAGIOS.  DO NOT MODIFY THIS FILE!\n");
+	sd_printf(&out, "########################################\n\n");
 
-	time(&current_time);
+	current_time = snap->taken;
 
 	/* write file info */
-	fprintf(fp, "info {\n");
-	fprintf(fp, "\tcreated=%llu\n", (unsigned long long)current_time);
-	fprintf(fp, "\tversion=%s\n", PROGRAM_VERSION);
-	fprintf(fp, "\tlast_update_check=%llu\n", (unsigned long long)last_update_check);
-	fprintf(fp, "\tupdate_available=%d\n", update_available);
-	fprintf(fp, "\tlast_version=%s\n", (last_program_version == NULL) ? "" : last_program_version);
-	fprintf(fp, "\tnew_version=%s\n", (new_program_version == NULL) ? "" : new_program_version);
-	fprintf(fp, "\t}\n\n");
+	sd_printf(&out, "info {\n");
+	sd_printf(&out, "\tcreated=%llu\n", (unsigned long long)current_time);
+	sd_printf(&out, "\tversion=%s\n", PROGRAM_VERSION);
+	sd_printf(&out, "\tlast_update_check=%llu\n", (unsigned long long)p->last_update_check);
+	sd_printf(&out, "\tupdate_available=%d\n", p->update_available);
+	sd_printf(&out, "\tlast_version=%s\n", (p->last_program_version == NULL) ? "" : p->last_program_version);
+	sd_printf(&out, "\tnew_version=%s\n", (p->new_program_version == NULL) ? "" : p->new_program_version);
+	sd_printf(&out, "\t}\n\n");
 
 	/* save program status data */
-	fprintf(fp, "programstatus {\n");
-	fprintf(fp, "\tmodified_host_attributes=%lu\n", modified_host_process_attributes);
-	fprintf(fp, "\tmodified_service_attributes=%lu\n", modified_service_process_attributes);
-	fprintf(fp, "\tnagios_pid=%d\n", nagios_pid);
-	fprintf(fp, "\tdaemon_mode=%d\n", daemon_mode);
-	fprintf(fp, "\tprogram_start=%llu\n", (unsigned long long)program_start);
-	fprintf(fp, "\tlast_log_rotation=%llu\n", (unsigned long long)last_log_rotation);
-	fprintf(fp, "\tenable_notifications=%d\n", enable_notifications);
-	fprintf(fp, "\tactive_service_checks_enabled=%d\n", execute_service_checks);
-	fprintf(fp, "\tpassive_service_checks_enabled=%d\n", accept_passive_service_checks);
-	fprintf(fp, "\tactive_host_checks_enabled=%d\n", execute_host_checks);
-	fprintf(fp, "\tpassive_host_checks_enabled=%d\n", accept_passive_host_checks);
-	fprintf(fp, "\tenable_event_handlers=%d\n", enable_event_handlers);
-	fprintf(fp, "\tobsess_over_services=%d\n", obsess_over_services);
-	fprintf(fp, "\tobsess_over_hosts=%d\n", obsess_over_hosts);
-	fprintf(fp, "\tcheck_service_freshness=%d\n", check_service_freshness);
-	fprintf(fp, "\tcheck_host_freshness=%d\n", check_host_freshness);
-	fprintf(fp, "\tenable_flap_detection=%d\n", enable_flap_detection);
-	fprintf(fp, "\tprocess_performance_data=%d\n", process_performance_data);
-	fprintf(fp, "\tglobal_host_event_handler=%s\n", (global_host_event_handler == NULL) ? "" : global_host_event_handler);
-	fprintf(fp, "\tglobal_service_event_handler=%s\n", (global_service_event_handler == NULL) ? "" : global_service_event_handler);
-	fprintf(fp, "\tnext_comment_id=%lu\n", next_comment_id);
-	fprintf(fp, "\tnext_downtime_id=%lu\n", next_downtime_id);
-	fprintf(fp, "\tnext_event_id=%lu\n", next_event_id);
-	fprintf(fp, "\tnext_problem_id=%lu\n", next_problem_id);
-	fprintf(fp, "\tnext_notification_id=%lu\n", next_notification_id);
-	fprintf(fp, "\tactive_scheduled_host_check_stats=%d,%d,%d\n", check_statistics[ACTIVE_SCHEDULED_HOST_CHECK_STATS].minute_stats[0], check_statistics[ACTIVE_SCHEDULED_HOST_CHECK_STATS].minute_stats[1], check_statistics[ACTIVE_SCHEDULED_HOST_CHECK_STATS].minute_stats[2]);
-	fprintf(fp, "\tactive_ondemand_host_check_stats=%d,%d,%d\n", check_statistics[ACTIVE_ONDEMAND_HOST_CHECK_STATS].minute_stats[0], check_statistics[ACTIVE_ONDEMAND_HOST_CHECK_STATS].minute_stats[1], check_statistics[ACTIVE_ONDEMAND_HOST_CHECK_STATS].minute_stats[2]);
-	fprintf(fp, "\tpassive_host_check_stats=%d,%d,%d\n", check_statistics[PASSIVE_HOST_CHECK_STATS].minute_stats[0], check_statistics[PASSIVE_HOST_CHECK_STATS].minute_stats[1], check_statistics[PASSIVE_HOST_CHECK_STATS].minute_stats[2]);
-	fprintf(fp, "\tactive_scheduled_service_check_stats=%d,%d,%d\n", check_statistics[ACTIVE_SCHEDULED_SERVICE_CHECK_STATS].minute_stats[0], check_statistics[ACTIVE_SCHEDULED_SERVICE_CHECK_STATS].minute_stats[1], check_statistics[ACTIVE_SCHEDULED_SERVICE_CHECK_STATS].minute_stats[2]);
-	fprintf(fp, "\tactive_ondemand_service_check_stats=%d,%d,%d\n", check_statistics[ACTIVE_ONDEMAND_SERVICE_CHECK_STATS].minute_stats[0], check_statistics[ACTIVE_ONDEMAND_SERVICE_CHECK_STATS].minute_stats[1], check_statistics[ACTIVE_ONDEMAND_SERVICE_CHECK_STATS].minute_stats[2]);
-	fprintf(fp, "\tpassive_service_check_stats=%d,%d,%d\n", check_statistics[PASSIVE_SERVICE_CHECK_STATS].minute_stats[0], check_statistics[PASSIVE_SERVICE_CHECK_STATS].minute_stats[1], check_statistics[PASSIVE_SERVICE_CHECK_STATS].minute_stats[2]);
-	fprintf(fp, "\tcached_host_check_stats=%d,%d,%d\n", check_statistics[ACTIVE_CACHED_HOST_CHECK_STATS].minute_stats[0], check_statistics[ACTIVE_CACHED_HOST_CHECK_STATS].minute_stats[1], check_statistics[ACTIVE_CACHED_HOST_CHECK_STATS].minute_stats[2]);
-	fprintf(fp, "\tcached_service_check_stats=%d,%d,%d\n", check_statistics[ACTIVE_CACHED_SERVICE_CHECK_STATS].minute_stats[0], check_statistics[ACTIVE_CACHED_SERVICE_CHECK_STATS].minute_stats[1], check_statistics[ACTIVE_CACHED_SERVICE_CHECK_STATS].minute_stats[2]);
-	fprintf(fp, "\texternal_command_stats=%d,%d,%d\n", check_statistics[EXTERNAL_COMMAND_STATS].minute_stats[0], check_statistics[EXTERNAL_COMMAND_STATS].minute_stats[1], check_statistics[EXTERNAL_COMMAND_STATS].minute_stats[2]);
-
-	fprintf(fp, "\tparallel_host_check_stats=%d,%d,%d\n", check_statistics[PARALLEL_HOST_CHECK_STATS].minute_stats[0], check_statistics[PARALLEL_HOST_CHECK_STATS].minute_stats[1], check_statistics[PARALLEL_HOST_CHECK_STATS].minute_stats[2]);
-	fprintf(fp, "\tserial_host_check_stats=%d,%d,%d\n", check_statistics[SERIAL_HOST_CHECK_STATS].minute_stats[0], check_statistics[SERIAL_HOST_CHECK_STATS].minute_stats[1], check_statistics[SERIAL_HOST_CHECK_STATS].minute_stats[2]);
-	fprintf(fp, "\t}\n\n");
+	sd_printf(&out, "programstatus {\n");
+	sd_printf(&out, "\tmodified_host_attributes=%lu\n", p->modified_host_process_attributes);
+	sd_printf(&out, "\tmodified_service_attributes=%lu\n", p->modified_service_process_attributes);
+	sd_printf(&out, "\tnagios_pid=%d\n", p->nagios_pid);
+	sd_printf(&out, "\tdaemon_mode=%d\n", p->daemon_mode);
+	sd_printf(&out, "\tprogram_start=%llu\n", (unsigned long long)p->program_start);
+	sd_printf(&out, "\tlast_log_rotation=%llu\n", (unsigned long long)p->last_log_rotation);
+	sd_printf(&out, "\tenable_notifications=%d\n", p->enable_notifications);
+	sd_printf(&out, "\tactive_service_checks_enabled=%d\n", p->execute_service_checks);
+	sd_printf(&out, "\tpassive_service_checks_enabled=%d\n", p->accept_passive_service_checks);
+	sd_printf(&out, "\tactive_host_checks_enabled=%d\n", p->execute_host_checks);
+	sd_printf(&out, "\tpassive_host_checks_enabled=%d\n", p->accept_passive_host_checks);
+	sd_printf(&out, "\tenable_event_handlers=%d\n", p->enable_event_handlers);
+	sd_printf(&out, "\tobsess_over_services=%d\n", p->obsess_over_services);
+	sd_printf(&out, "\tobsess_over_hosts=%d\n", p->obsess_over_hosts);
+	sd_printf(&out, "\tcheck_service_freshness=%d\n", p->check_service_freshness);
+	sd_printf(&out, "\tcheck_host_freshness=%d\n", p->check_host_freshness);
+	sd_printf(&out, "\tenable_flap_detection=%d\n", p->enable_flap_detection);
+	sd_printf(&out, "\tprocess_performance_data=%d\n", p->process_performance_data);
+	sd_printf(&out, "\tglobal_host_event_handler=%s\n", (p->global_host_event_handler == NULL) ? "" : p->global_host_event_handler);
+	sd_printf(&out, "\tglobal_service_event_handler=%s\n", (p->global_service_event_handler == NULL) ? "" : p->global_service_event_handler);
+	sd_printf(&out, "\tnext_comment_id=%lu\n", p->next_comment_id);
+	sd_printf(&out, "\tnext_downtime_id=%lu\n", p->next_downtime_id);
+	sd_printf(&out, "\tnext_event_id=%lu\n", p->next_event_id);
+	sd_printf(&out, "\tnext_problem_id=%lu\n", p->next_problem_id);
+	sd_printf(&out, "\tnext_notification_id=%lu\n", p->next_notification_id);
+	sd_printf(&out, "\tactive_scheduled_host_check_stats=%d,%d,%d\n", p->check_stats[ACTIVE_SCHEDULED_HOST_CHECK_STATS][0], p->check_stats[ACTIVE_SCHEDULED_HOST_CHECK_STATS][1], p->check_stats[ACTIVE_SCHEDULED_HOST_CHECK_STATS][2]);
+	sd_printf(&out, "\tactive_ondemand_host_check_stats=%d,%d,%d\n", p->check_stats[ACTIVE_ONDEMAND_HOST_CHECK_STATS][0], p->check_stats[ACTIVE_ONDEMAND_HOST_CHECK_STATS][1], p->check_stats[ACTIVE_ONDEMAND_HOST_CHECK_STATS][2]);
+	sd_printf(&out, "\tpassive_host_check_stats=%d,%d,%d\n", p->check_stats[PASSIVE_HOST_CHECK_STATS][0], p->check_stats[PASSIVE_HOST_CHECK_STATS][1], p->check_stats[PASSIVE_HOST_CHECK_STATS][2]);
+	sd_printf(&out, "\tactive_scheduled_service_check_stats=%d,%d,%d\n", p->check_stats[ACTIVE_SCHEDULED_SERVICE_CHECK_STATS][0], p->check_stats[ACTIVE_SCHEDULED_SERVICE_CHECK_STATS][1], p->check_stats[ACTIVE_SCHEDULED_SERVICE_CHECK_STATS][2]);
+	sd_printf(&out, "\tactive_ondemand_service_check_stats=%d,%d,%d\n", p->check_stats[ACTIVE_ONDEMAND_SERVICE_CHECK_STATS][0], p->check_stats[ACTIVE_ONDEMAND_SERVICE_CHECK_STATS][1], p->check_stats[ACTIVE_ONDEMAND_SERVICE_CHECK_STATS][2]);
+	sd_printf(&out, "\tpassive_service_check_stats=%d,%d,%d\n", p->check_stats[PASSIVE_SERVICE_CHECK_STATS][0], p->check_stats[PASSIVE_SERVICE_CHECK_STATS][1], p->check_stats[PASSIVE_SERVICE_CHECK_STATS][2]);
+	sd_printf(&out, "\tcached_host_check_stats=%d,%d,%d\n", p->check_stats[ACTIVE_CACHED_HOST_CHECK_STATS][0], p->check_stats[ACTIVE_CACHED_HOST_CHECK_STATS][1], p->check_stats[ACTIVE_CACHED_HOST_CHECK_STATS][2]);
+	sd_printf(&out, "\tcached_service_check_stats=%d,%d,%d\n", p->check_stats[ACTIVE_CACHED_SERVICE_CHECK_STATS][0], p->check_stats[ACTIVE_CACHED_SERVICE_CHECK_STATS][1], p->check_stats[ACTIVE_CACHED_SERVICE_CHECK_STATS][2]);
+	sd_printf(&out, "\texternal_command_stats=%d,%d,%d\n", p->check_stats[EXTERNAL_COMMAND_STATS][0], p->check_stats[EXTERNAL_COMMAND_STATS][1], p->check_stats[EXTERNAL_COMMAND_STATS][2]);
+	sd_printf(&out, "\texternal_commands_run=%lu,%lu,%lu\n", p->external_command_stats.commands, p->external_command_stats.fast_path, p->external_command_stats.deferred);
+	sd_printf(&out, "\texternal_command_backlog=%lu,%lu\n", p->external_command_stats.backlog, p->external_command_stats.max_backlog);
+
+	sd_printf(&out, "\tparallel_host_check_stats=%d,%d,%d\n", p->check_stats[PARALLEL_HOST_CHECK_STATS][0], p->check_stats[PARALLEL_HOST_CHECK_STATS][1], p->check_stats[PARALLEL_HOST_CHECK_STATS][2]);
+	sd_printf(&out, "\tserial_host_check_stats=%d,%d,%d\n", p->check_stats[SERIAL_HOST_CHECK_STATS][0], p->check_stats[SERIAL_HOST_CHECK_STATS][1], p->check_stats[SERIAL_HOST_CHECK_STATS][2]);
+
+	sd_printf(&out, "\tcheck_results_from_workers=%lu\n", p->wproc_result_stats.results);
+	sd_printf(&out, "\tcheck_results_presplit=%lu\n", p->wproc_result_stats.presplit);
+	sd_printf(&out, "\tcheck_result_parse_time=%.6f,%.6f,%.6f\n", p->wproc_result_stats.min_parse_time, p->wproc_result_stats.max_parse_time, p->wproc_result_stats.presplit ? p->wproc_result_stats.total_parse_time / p->wproc_result_stats.presplit : 0.0);
+	sd_printf(&out, "\tcheck_result_queue_depth=%u,%u\n", p->wproc_result_stats.queue_depth, p->wproc_result_stats.max_queue_depth);
+	sd_printf(&out, "\tcheck_result_batch_size=%lu,%lu,%lu,%lu,%lu\n", p->wproc_result_stats.batches,
+	          (unsigned long)histogram_percentile(&p->wproc_result_stats.batch_size, 50),
+	          (unsigned long)histogram_percentile(&p->wproc_result_stats.batch_size, 90),
+	          (unsigned long)histogram_percentile(&p->wproc_result_stats.batch_size, 99),
+	          (unsigned long)p->wproc_result_stats.batch_size.max);
+	sd_printf(&out, "\tcheck_result_queue_latency=%.3f,%.3f,%.3f\n", p->wproc_result_stats.min_queue_latency, p->wproc_result_stats.max_queue_latency, p->wproc_result_stats.results ? p->wproc_result_stats.total_queue_latency / p->wproc_result_stats.results : 0.0);
+	sd_printf(&out, "\tcheck_result_handling_time=%.3f,%.3f,%.3f\n", p->wproc_result_stats.min_handling_time, p->wproc_result_stats.max_handling_time, p->wproc_result_stats.results ? p->wproc_result_stats.total_handling_time / p->wproc_result_stats.results : 0.0);
+	sd_printf(&out, "\tstatus_file_update=%lu,%u,%u\n", p->state_write_stats.last_update.bytes_written, p->state_write_stats.last_update.objects_written, p->state_write_stats.last_update.objects_skipped);
+	sd_printf(&out, "\tbinary_status_file_update=%lu,%u\n", p->state_write_stats.last_update.binary_bytes_written, p->state_write_stats.last_update.binary_slots_written);
+	sd_printf(&out, "\tstate_snapshot_time=%.3f,%.3f\n", p->state_write_stats.last_snapshot_time, p->state_write_stats.max_snapshot_time);
+	sd_printf(&out, "\tstate_write_time=%.3f,%.3f\n", p->state_write_stats.last_write_time, p->state_write_stats.max_write_time);
+	sd_printf(&out, "\tstate_write_stall=%.3f\n", p->state_write_stats.max_stall);
+	sd_printf(&out, "\tstate_writes_coalesced=%lu\n", p->state_write_stats.coalesced);
+	sd_printf(&out, "\ton_demand_check_storms=%lu,%lu,%lu,%lu,%d\n", p->check_storm_stats.storms,
+	          p->check_storm_stats.coalesced, p->check_storm_stats.deferred,
+	          p->check_storm_stats.backlog, p->check_storm_stats.active);
+	sd_printf(&out, "\tloop_stats_since=%lu\n", (unsigned long)p->loop_stats_since);
+	for(i = 0; i < p->num_loop_stats; i++) {
+		const struct loop_stats_summary *ls = &p->loop_stats[i];
+		sd_printf(&out, "\tloop_stats_%s=%lu,%.6f,%.6f,%.6f,%.6f\n", ls->name, ls->count, ls->p50, ls->p90, ls->p99, ls->max);
+		}
+	sd_printf(&out, "\t}\n\n");
 
 
 	/* save host status data */
-	for(temp_host = host_list; temp_host != NULL; temp_host = temp_host->next) {
-
-		fprintf(fp, "hoststatus {\n");
-		fprintf(fp, "\thost_name=%s\n", temp_host->name);
-
-		fprintf(fp, "\tmodified_attributes=%lu\n", temp_host->modified_attributes);
-		fprintf(fp, "\tcheck_command=%s\n", (temp_host->check_command == NULL) ? "" : temp_host->check_command);
-		fprintf(fp, "\tcheck_period=%s\n", (temp_host->check_period == NULL) ? "" : temp_host->check_period);
-		fprintf(fp, "\tnotification_period=%s\n", (temp_host->notification_period == NULL) ? "" : temp_host->notification_period);
-		fprintf(fp, "\timportance=%u\n", temp_host->hourly_value);
-		fprintf(fp, "\tcheck_interval=%f\n", temp_host->check_interval);
-		fprintf(fp, "\tretry_interval=%f\n", temp_host->retry_interval);
-		fprintf(fp, "\tevent_handler=%s\n", (temp_host->event_handler == NULL) ? "" : temp_host->event_handler);
-		fprintf(fp, "\tevent_handler_period=%s\n", (temp_host->event_handler_period == NULL) ? "" : temp_host->event_handler_period);
-
-		fprintf(fp, "\thas_been_checked=%d\n", temp_host->has_been_checked);
-		fprintf(fp, "\tshould_be_scheduled=%d\n", temp_host->should_be_scheduled);
-		fprintf(fp, "\tcheck_execution_time=%.3f\n", temp_host->execution_time);
-		fprintf(fp, "\tcheck_latency=%.3f\n", temp_host->latency);
-		fprintf(fp, "\tcheck_type=%d\n", temp_host->check_type);
-		fprintf(fp, "\tcurrent_state=%d\n", temp_host->current_state);
-		fprintf(fp, "\tlast_hard_state=%d\n", temp_host->last_hard_state);
-		fprintf(fp, "\tlast_event_id=%lu\n", temp_host->last_event_id);
-		fprintf(fp, "\tcurrent_event_id=%lu\n", temp_host->current_event_id);
-		fprintf(fp, "\tcurrent_problem_id=%lu\n", temp_host->current_problem_id);
-		fprintf(fp, "\tlast_problem_id=%lu\n", temp_host->last_problem_id);
-		fprintf(fp, "\tplugin_output=%s\n", (temp_host->plugin_output == NULL) ? "" : temp_host->plugin_output);
-		fprintf(fp, "\tlong_plugin_output=%s\n", (temp_host->long_plugin_output == NULL) ? "" : temp_host->long_plugin_output);
-		fprintf(fp, "\tperformance_data=%s\n", (temp_host->perf_data == NULL) ? "" : temp_host->perf_data);
-		fprintf(fp, "\tlast_check=%llu\n", (unsigned long long)temp_host->last_check);
-		fprintf(fp, "\tnext_check=%llu\n", (unsigned long long)temp_host->next_check);
-		fprintf(fp, "\tcheck_options=%d\n", temp_host->check_options);
-		fprintf(fp, "\tcurrent_attempt=%d\n", temp_host->current_attempt);
-		fprintf(fp, "\tmax_attempts=%d\n", temp_host->max_attempts);
-		fprintf(fp, "\tstate_type=%d\n", temp_host->state_type);
-		fprintf(fp, "\tlast_state_change=%llu\n", (unsigned long long)temp_host->last_state_change);
-		fprintf(fp, "\tlast_hard_state_change=%llu\n", (unsigned long long)temp_host->last_hard_state_change);
-		fprintf(fp, "\tlast_time_up=%llu\n", (unsigned long long)temp_host->last_time_up);
-		fprintf(fp, "\tlast_time_down=%llu\n", (unsigned long long)temp_host->last_time_down);
-		fprintf(fp, "\tlast_time_unreachable=%llu\n", (unsigned long long)temp_host->last_time_unreachable);
-		fprintf(fp, "\tlast_notification=%llu\n", (unsigned long long)temp_host->last_notification);
-		fprintf(fp, "\tnext_notification=%llu\n", (unsigned long long)temp_host->next_notification);
-		fprintf(fp, "\tno_more_notifications=%d\n", temp_host->no_more_notifications);
-		fprintf(fp, "\tcurrent_notification_number=%d\n", temp_host->current_notification_number);
-		fprintf(fp, "\tcurrent_notification_id=%lu\n", temp_host->current_notification_id);
-		fprintf(fp, "\tnotifications_enabled=%d\n", temp_host->notifications_enabled);
-		fprintf(fp, "\tproblem_has_been_acknowledged=%d\n", temp_host->problem_has_been_acknowledged);
-		fprintf(fp, "\tacknowledgement_type=%d\n", temp_host->acknowledgement_type);
-		fprintf(fp, "\tactive_checks_enabled=%d\n", temp_host->checks_enabled);
-		fprintf(fp, "\tpassive_checks_enabled=%d\n", temp_host->accept_passive_checks);
-		fprintf(fp, "\tevent_handler_enabled=%d\n", temp_host->event_handler_enabled);
-		fprintf(fp, "\tflap_detection_enabled=%d\n", temp_host->flap_detection_enabled);
-		fprintf(fp, "\tprocess_performance_data=%d\n", temp_host->process_performance_data);
-		fprintf(fp, "\tobsess=%d\n", temp_host->obsess);
-		fprintf(fp, "\tlast_update=%llu\n", (unsigned long long)current_time);
-		fprintf(fp, "\tis_flapping=%d\n", temp_host->is_flapping);
-		fprintf(fp, "\tpercent_state_change=%.2f\n", temp_host->percent_state_change);
-		fprintf(fp, "\tscheduled_downtime_depth=%d\n", temp_host->scheduled_downtime_depth);
+	for(i = 0; i < snap->total_hosts; i++) {
+
+		/* hosts left out of the snapshot haven't changed */
+		rec = &host_records[i];
+		if(temp_host == hosts_end || temp_host->id != i) {
+			if(splice == FALSE || sd_splice(&out, &prev_status.hosts[i], rec, current_time) != OK)
+				break;
+			objects_skipped++;
+			continue;
+			}
+		if(splice == TRUE && !temp_host->status_changed && sd_splice(&out, &prev_status.hosts[i], rec, current_time) == OK) {
+			objects_skipped++;
+			temp_host++;
+			continue;
+			}
+		objects_written++;
+
+		rec->start = sd_tell(&out);
+		sd_printf(&out, "hoststatus {\n");
+		sd_printf(&out, "\thost_name=%s\n", temp_host->name);
+
+		sd_printf(&out, "\tmodified_attributes=%lu\n", temp_host->modified_attributes);
+		sd_printf(&out, "\tcheck_command=%s\n", (temp_host->check_command == NULL) ? "" : temp_host->check_command);
+		sd_printf(&out, "\tcheck_period=%s\n", (temp_host->check_period == NULL) ? "" : temp_host->check_period);
+		sd_printf(&out, "\tnotification_period=%s\n", (temp_host->notification_period == NULL) ? "" : temp_host->notification_period);
+		sd_printf(&out, "\timportance=%u\n", temp_host->hourly_value);
+		sd_printf(&out, "\tcheck_interval=%f\n", temp_host->check_interval);
+		sd_printf(&out, "\tretry_interval=%f\n", temp_host->retry_interval);
+		sd_printf(&out, "\tevent_handler=%s\n", (temp_host->event_handler == NULL) ? "" : temp_host->event_handler);
+		sd_printf(&out, "\tevent_handler_period=%s\n", (temp_host->event_handler_period == NULL) ? "" : temp_host->event_handler_period);
+
+		sd_printf(&out, "\thas_been_checked=%d\n", temp_host->has_been_checked);
+		sd_printf(&out, "\tshould_be_scheduled=%d\n", temp_host->should_be_scheduled);
+		sd_printf(&out, "\tcheck_execution_time=%.3f\n", temp_host->execution_time);
+		sd_printf(&out, "\tcheck_latency=%.3f\n", temp_host->latency);
+		sd_printf(&out, "\tcheck_type=%d\n", temp_host->check_type);
+		sd_printf(&out, "\tcurrent_state=%d\n", temp_host->current_state);
+		sd_printf(&out, "\tlast_hard_state=%d\n", temp_host->last_hard_state);
+		sd_printf(&out, "\tlast_event_id=%lu\n", temp_host->last_event_id);
+		sd_printf(&out, "\tcurrent_event_id=%lu\n", temp_host->current_event_id);
+		sd_printf(&out, "\tcurrent_problem_id=%lu\n", temp_host->current_problem_id);
+		sd_printf(&out, "\tlast_problem_id=%lu\n", temp_host->last_problem_id);
+		sd_printf(&out, "\tplugin_output=%s\n", (temp_host->plugin_output == NULL) ? "" : temp_host->plugin_output);
+		sd_printf(&out, "\tlong_plugin_output=%s\n", (temp_host->long_plugin_output == NULL) ? "" : temp_host->long_plugin_output);
+		sd_printf(&out, "\tperformance_data=%s\n", (temp_host->perf_data == NULL) ? "" : temp_host->perf_data);
+		sd_printf(&out, "\tlast_check=%llu\n", (unsigned long long)temp_host->last_check);
+		sd_printf(&out, "\tnext_check=%llu\n", (unsigned long long)temp_host->next_check);
+		sd_printf(&out, "\tcheck_options=%d\n", temp_host->check_options);
+		sd_printf(&out, "\tcurrent_attempt=%d\n", temp_host->current_attempt);
+		sd_printf(&out, "\tmax_attempts=%d\n", temp_host->max_attempts);
+		sd_printf(&out, "\tstate_type=%d\n", temp_host->state_type);
+		sd_printf(&out, "\tlast_state_change=%llu\n", (unsigned long long)temp_host->last_state_change);
+		sd_printf(&out, "\tlast_hard_state_change=%llu\n", (unsigned long long)temp_host->last_hard_state_change);
+		sd_printf(&out, "\tlast_time_up=%llu\n", (unsigned long long)temp_host->last_time_up);
+		sd_printf(&out, "\tlast_time_down=%llu\n", (unsigned long long)temp_host->last_time_down);
+		sd_printf(&out, "\tlast_time_unreachable=%llu\n", (unsigned long long)temp_host->last_time_unreachable);
+		sd_printf(&out, "\tlast_notification=%llu\n", (unsigned long long)temp_host->last_notification);
+		sd_printf(&out, "\tnext_notification=%llu\n", (unsigned long long)temp_host->next_notification);
+		sd_printf(&out, "\tno_more_notifications=%d\n", temp_host->no_more_notifications);
+		sd_printf(&out, "\tcurrent_notification_number=%d\n", temp_host->current_notification_number);
+		sd_printf(&out, "\tcurrent_notification_id=%lu\n", temp_host->current_notification_id);
+		sd_printf(&out, "\tnotifications_enabled=%d\n", temp_host->notifications_enabled);
+		sd_printf(&out, "\tproblem_has_been_acknowledged=%d\n", temp_host->problem_has_been_acknowledged);
+		sd_printf(&out, "\tacknowledgement_type=%d\n", temp_host->acknowledgement_type);
+		sd_printf(&out, "\tactive_checks_enabled=%d\n", temp_host->checks_enabled);
+		sd_printf(&out, "\tpassive_checks_enabled=%d\n", temp_host->accept_passive_checks);
+		sd_printf(&out, "\tevent_handler_enabled=%d\n", temp_host->event_handler_enabled);
+		sd_printf(&out, "\tflap_detection_enabled=%d\n", temp_host->flap_detection_enabled);
+		sd_printf(&out, "\tprocess_performance_data=%d\n", temp_host->process_performance_data);
+		sd_printf(&out, "\tobsess=%d\n", temp_host->obsess);
+		rec->last_update = sd_tell(&out) - rec->start;
+		sd_printf(&out, "\tlast_update=%llu\n", (unsigned long long)current_time);
+		rec->last_update_end = sd_tell(&out) - rec->start;
+		sd_printf(&out, "\tis_flapping=%d\n", temp_host->is_flapping);
+		sd_printf(&out, "\tpercent_state_change=%.2f\n", temp_host->percent_state_change);
+		sd_printf(&out, "\tscheduled_downtime_depth=%d\n", temp_host->scheduled_downtime_depth);
 		/* custom variables */
 		for(temp_customvariablesmember = temp_host->custom_variables; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
 			if(temp_customvariablesmember->variable_name)
-				fprintf(fp, "\t_%s=%d;%s\n", temp_customvariablesmember->variable_name, temp_customvariablesmember->has_been_modified, (temp_customvariablesmember->variable_value == NULL) ? "" : temp_customvariablesmember->variable_value);
+				sd_printf(&out, "\t_%s=%d;%s\n", temp_customvariablesmember->variable_name, temp_customvariablesmember->has_been_modified, (temp_customvariablesmember->variable_value == NULL) ? "" : temp_customvariablesmember->variable_value);
 			}
-		fprintf(fp, "\t}\n\n");
+		sd_printf(&out, "\t}\n\n");
+		rec->end = sd_tell(&out) - rec->start;
+		temp_host++;
 		}
+	if(i < snap->total_hosts)
+		out.error = TRUE;
 
 	/* save service status data */
-	for(temp_service = service_list; temp_service != NULL; temp_service = temp_service->next) {
-
-		fprintf(fp, "servicestatus {\n");
-		fprintf(fp, "\thost_name=%s\n", temp_service->host_name);
-
-		fprintf(fp, "\tservice_description=%s\n", temp_service->description);
-		fprintf(fp, "\tmodified_attributes=%lu\n", temp_service->modified_attributes);
-		fprintf(fp, "\tcheck_command=%s\n", (temp_service->check_command == NULL) ? "" : temp_service->check_command);
-		fprintf(fp, "\tcheck_period=%s\n", (temp_service->check_period == NULL) ? "" : temp_service->check_period);
-		fprintf(fp, "\tnotification_period=%s\n", (temp_service->notification_period == NULL) ? "" : temp_service->notification_period);
-		fprintf(fp, "\timportance=%u\n", temp_service->hourly_value);
-		fprintf(fp, "\tcheck_interval=%f\n", temp_service->check_interval);
-		fprintf(fp, "\tretry_interval=%f\n", temp_service->retry_interval);
-		fprintf(fp, "\tevent_handler=%s\n", (temp_service->event_handler == NULL) ? "" : temp_service->event_handler);
-		fprintf(fp, "\tevent_handler_period=%s\n", (temp_service->event_handler_period == NULL) ? "" : temp_service->event_handler_period);
-
-		fprintf(fp, "\thas_been_checked=%d\n", temp_service->has_been_checked);
-		fprintf(fp, "\tshould_be_scheduled=%d\n", temp_service->should_be_scheduled);
-		fprintf(fp, "\tcheck_execution_time=%.3f\n", temp_service->execution_time);
-		fprintf(fp, "\tcheck_latency=%.3f\n", temp_service->latency);
-		fprintf(fp, "\tcheck_type=%d\n", temp_service->check_type);
-		fprintf(fp, "\tcurrent_state=%d\n", temp_service->current_state);
-		fprintf(fp, "\tlast_hard_state=%d\n", temp_service->last_hard_state);
-		fprintf(fp, "\tlast_event_id=%lu\n", temp_service->last_event_id);
-		fprintf(fp, "\tcurrent_event_id=%lu\n", temp_service->current_event_id);
-		fprintf(fp, "\tcurrent_problem_id=%lu\n", temp_service->current_problem_id);
-		fprintf(fp, "\tlast_problem_id=%lu\n", temp_service->last_problem_id);
-		fprintf(fp, "\tcurrent_attempt=%d\n", temp_service->current_attempt);
-		fprintf(fp, "\tmax_attempts=%d\n", temp_service->max_attempts);
-		fprintf(fp, "\tstate_type=%d\n", temp_service->state_type);
-		fprintf(fp, "\tlast_state_change=%llu\n", (unsigned long long)temp_service->last_state_change);
-		fprintf(fp, "\tlast_hard_state_change=%llu\n", (unsigned long long)temp_service->last_hard_state_change);
-		fprintf(fp, "\tlast_time_ok=%llu\n", (unsigned long long)temp_service->last_time_ok);
-		fprintf(fp, "\tlast_time_warning=%llu\n", (unsigned long long)temp_service->last_time_warning);
-		fprintf(fp, "\tlast_time_unknown=%llu\n", (unsigned long long)temp_service->last_time_unknown);
-		fprintf(fp, "\tlast_time_critical=%llu\n", (unsigned long long)temp_service->last_time_critical);
-		fprintf(fp, "\tplugin_output=%s\n", (temp_service->plugin_output == NULL) ? "" : temp_service->plugin_output);
-		fprintf(fp, "\tlong_plugin_output=%s\n", (temp_service->long_plugin_output == NULL) ? "" : temp_service->long_plugin_output);
-		fprintf(fp, "\tperformance_data=%s\n", (temp_service->perf_data == NULL) ? "" : temp_service->perf_data);
-		fprintf(fp, "\tlast_check=%llu\n", (unsigned long long)temp_service->last_check);
-		fprintf(fp, "\tnext_check=%llu\n", (unsigned long long)temp_service->next_check);
-		fprintf(fp, "\tcheck_options=%d\n", temp_service->check_options);
-		fprintf(fp, "\tcurrent_notification_number=%d\n", temp_service->current_notification_number);
-		fprintf(fp, "\tcurrent_notification_id=%lu\n", temp_service->current_notification_id);
-		fprintf(fp, "\tlast_notification=%llu\n", (unsigned long long)temp_service->last_notification);
-		fprintf(fp, "\tnext_notification=%llu\n", (unsigned long long)temp_service->next_notification);
-		fprintf(fp, "\tno_more_notifications=%d\n", temp_service->no_more_notifications);
-		fprintf(fp, "\tnotifications_enabled=%d\n", temp_service->notifications_enabled);
-		fprintf(fp, "\tactive_checks_enabled=%d\n", temp_service->checks_enabled);
-		fprintf(fp, "\tpassive_checks_enabled=%d\n", temp_service->accept_passive_checks);
-		fprintf(fp, "\tevent_handler_enabled=%d\n", temp_service->event_handler_enabled);
-		fprintf(fp, "\tproblem_has_been_acknowledged=%d\n", temp_service->problem_has_been_acknowledged);
-		fprintf(fp, "\tacknowledgement_type=%d\n", temp_service->acknowledgement_type);
-		fprintf(fp, "\tflap_detection_enabled=%d\n", temp_service->flap_detection_enabled);
-		fprintf(fp, "\tprocess_performance_data=%d\n", temp_service->process_performance_data);
-		fprintf(fp, "\tobsess=%d\n", temp_service->obsess);
-		fprintf(fp, "\tlast_update=%llu\n", (unsigned long long)current_time);
-		fprintf(fp, "\tis_flapping=%d\n", temp_service->is_flapping);
-		fprintf(fp, "\tpercent_state_change=%.2f\n", temp_service->percent_state_change);
-		fprintf(fp, "\tscheduled_downtime_depth=%d\n", temp_service->scheduled_downtime_depth);
+	for(i = 0; i < snap->total_services; i++) {
+
+		/* services left out of the snapshot haven't changed */
+		rec = &service_records[i];
+		if(temp_service == services_end || temp_service->id != i) {
+			if(splice == FALSE || sd_splice(&out, &prev_status.services[i], rec, current_time) != OK)
+				break;
+			objects_skipped++;
+			continue;
+			}
+		if(splice == TRUE && !temp_service->status_changed && sd_splice(&out, &prev_status.services[i], rec, current_time) == OK) {
+			objects_skipped++;
+			temp_service++;
+			continue;
+			}
+		objects_written++;
+
+		rec->start = sd_tell(&out);
+		sd_printf(&out, "servicestatus {\n");
+		sd_printf(&out, "\thost_name=%s\n", temp_service->host_name);
+
+		sd_printf(&out, "\tservice_description=%s\n", temp_service->description);
+		sd_printf(&out, "\tmodified_attributes=%lu\n", temp_service->modified_attributes);
+		sd_printf(&out, "\tcheck_command=%s\n", (temp_service->check_command == NULL) ? "" : temp_service->check_command);
+		sd_printf(&out, "\tcheck_period=%s\n", (temp_service->check_period == NULL) ? "" : temp_service->check_period);
+		sd_printf(&out, "\tnotification_period=%s\n", (temp_service->notification_period == NULL) ? "" : temp_service->notification_period);
+		sd_printf(&out, "\timportance=%u\n", temp_service->hourly_value);
+		sd_printf(&out, "\tcheck_interval=%f\n", temp_service->check_interval);
+		sd_printf(&out, "\tretry_interval=%f\n", temp_service->retry_interval);
+		sd_printf(&out, "\tevent_handler=%s\n", (temp_service->event_handler == NULL) ? "" : temp_service->event_handler);
+		sd_printf(&out, "\tevent_handler_period=%s\n", (temp_service->event_handler_period == NULL) ? "" : temp_service->event_handler_period);
+
+		sd_printf(&out, "\thas_been_checked=%d\n", temp_service->has_been_checked);
+		sd_printf(&out, "\tshould_be_scheduled=%d\n", temp_service->should_be_scheduled);
+		sd_printf(&out, "\tcheck_execution_time=%.3f\n", temp_service->execution_time);
+		sd_printf(&out, "\tcheck_latency=%.3f\n", temp_service->latency);
+		sd_printf(&out, "\tcheck_type=%d\n", temp_service->check_type);
+		sd_printf(&out, "\tcurrent_state=%d\n", temp_service->current_state);
+		sd_printf(&out, "\tlast_hard_state=%d\n", temp_service->last_hard_state);
+		sd_printf(&out, "\tlast_event_id=%lu\n", temp_service->last_event_id);
+		sd_printf(&out, "\tcurrent_event_id=%lu\n", temp_service->current_event_id);
+		sd_printf(&out, "\tcurrent_problem_id=%lu\n", temp_service->current_problem_id);
+		sd_printf(&out, "\tlast_problem_id=%lu\n", temp_service->last_problem_id);
+		sd_printf(&out, "\tcurrent_attempt=%d\n", temp_service->current_attempt);
+		sd_printf(&out, "\tmax_attempts=%d\n", temp_service->max_attempts);
+		sd_printf(&out, "\tstate_type=%d\n", temp_service->state_type);
+		sd_printf(&out, "\tlast_state_change=%llu\n", (unsigned long long)temp_service->last_state_change);
+		sd_printf(&out, "\tlast_hard_state_change=%llu\n", (unsigned long long)temp_service->last_hard_state_change);
+		sd_printf(&out, "\tlast_time_ok=%llu\n", (unsigned long long)temp_service->last_time_ok);
+		sd_printf(&out, "\tlast_time_warning=%llu\n", (unsigned long long)temp_service->last_time_warning);
+		sd_printf(&out, "\tlast_time_unknown=%llu\n", (unsigned long long)temp_service->last_time_unknown);
+		sd_printf(&out, "\tlast_time_critical=%llu\n", (unsigned long long)temp_service->last_time_critical);
+		sd_printf(&out, "\tplugin_output=%s\n", (temp_service->plugin_output == NULL) ? "" : temp_service->plugin_output);
+		sd_printf(&out, "\tlong_plugin_output=%s\n", (temp_service->long_plugin_output == NULL) ? "" : temp_service->long_plugin_output);
+		sd_printf(&out, "\tperformance_data=%s\n", (temp_service->perf_data == NULL) ? "" : temp_service->perf_data);
+		sd_printf(&out, "\tlast_check=%llu\n", (unsigned long long)temp_service->last_check);
+		sd_printf(&out, "\tnext_check=%llu\n", (unsigned long long)temp_service->next_check);
+		sd_printf(&out, "\tcheck_options=%d\n", temp_service->check_options);
+		sd_printf(&out, "\tcurrent_notification_number=%d\n", temp_service->current_notification_number);
+		sd_printf(&out, "\tcurrent_notification_id=%lu\n", temp_service->current_notification_id);
+		sd_printf(&out, "\tlast_notification=%llu\n", (unsigned long long)temp_service->last_notification);
+		sd_printf(&out, "\tnext_notification=%llu\n", (unsigned long long)temp_service->next_notification);
+		sd_printf(&out, "\tno_more_notifications=%d\n", temp_service->no_more_notifications);
+		sd_printf(&out, "\tnotifications_enabled=%d\n", temp_service->notifications_enabled);
+		sd_printf(&out, "\tactive_checks_enabled=%d\n", temp_service->checks_enabled);
+		sd_printf(&out, "\tpassive_checks_enabled=%d\n", temp_service->accept_passive_checks);
+		sd_printf(&out, "\tevent_handler_enabled=%d\n", temp_service->event_handler_enabled);
+		sd_printf(&out, "\tproblem_has_been_acknowledged=%d\n", temp_service->problem_has_been_acknowledged);
+		sd_printf(&out, "\tacknowledgement_type=%d\n", temp_service->acknowledgement_type);
+		sd_printf(&out, "\tflap_detection_enabled=%d\n", temp_service->flap_detection_enabled);
+		sd_printf(&out, "\tprocess_performance_data=%d\n", temp_service->process_performance_data);
+		sd_printf(&out, "\tobsess=%d\n", temp_service->obsess);
+		rec->last_update = sd_tell(&out) - rec->start;
+		sd_printf(&out, "\tlast_update=%llu\n", (unsigned long long)current_time);
+		rec->last_update_end = sd_tell(&out) - rec->start;
+		sd_printf(&out, "\tis_flapping=%d\n", temp_service->is_flapping);
+		sd_printf(&out, "\tpercent_state_change=%.2f\n", temp_service->percent_state_change);
+		sd_printf(&out, "\tscheduled_downtime_depth=%d\n", temp_service->scheduled_downtime_depth);
 		/* custom variables */
 		for(temp_customvariablesmember = temp_service->custom_variables; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
 			if(temp_customvariablesmember->variable_name)
-				fprintf(fp, "\t_%s=%d;%s\n", temp_customvariablesmember->variable_name, temp_customvariablesmember->has_been_modified, (temp_customvariablesmember->variable_value == NULL) ? "" : temp_customvariablesmember->variable_value);
+				sd_printf(&out, "\t_%s=%d;%s\n", temp_customvariablesmember->variable_name, temp_customvariablesmember->has_been_modified, (temp_customvariablesmember->variable_value == NULL) ? "" : temp_customvariablesmember->variable_value);
 			}
-		fprintf(fp, "\t}\n\n");
+		sd_printf(&out, "\t}\n\n");
+		rec->end = sd_tell(&out) - rec->start;
+		temp_service++;
 		}
+	if(i < snap->total_services)
+		out.error = TRUE;
 
 	/* save contact status data */
-	for(temp_contact = contact_list; temp_contact != NULL; temp_contact = temp_contact->next) {
+	for(temp_contact = snap->contacts; temp_contact < snap->contacts + snap->num_contacts; temp_contact++) {
 
-		fprintf(fp, "contactstatus {\n");
-		fprintf(fp, "\tcontact_name=%s\n", temp_contact->name);
+		sd_printf(&out, "contactstatus {\n");
+		sd_printf(&out, "\tcontact_name=%s\n", temp_contact->name);
 
-		fprintf(fp, "\tmodified_attributes=%lu\n", temp_contact->modified_attributes);
-		fprintf(fp, "\tmodified_host_attributes=%lu\n", temp_contact->modified_host_attributes);
-		fprintf(fp, "\tmodified_service_attributes=%lu\n", temp_contact->modified_service_attributes);
-		fprintf(fp, "\thost_notification_period=%s\n", (temp_contact->host_notification_period == NULL) ? "" : temp_contact->host_notification_period);
-		fprintf(fp, "\tservice_notification_period=%s\n", (temp_contact->service_notification_period == NULL) ? "" : temp_contact->service_notification_period);
+		sd_printf(&out, "\tmodified_attributes=%lu\n", temp_contact->modified_attributes);
+		sd_printf(&out, "\tmodified_host_attributes=%lu\n", temp_contact->modified_host_attributes);
+		sd_printf(&out, "\tmodified_service_attributes=%lu\n", temp_contact->modified_service_attributes);
+		sd_printf(&out, "\thost_notification_period=%s\n", (temp_contact->host_notification_period == NULL) ? "" : temp_contact->host_notification_period);
+		sd_printf(&out, "\tservice_notification_period=%s\n", (temp_contact->service_notification_period == NULL) ? "" : temp_contact->service_notification_period);
 
-		fprintf(fp, "\tlast_host_notification=%llu\n", (unsigned long long)temp_contact->last_host_notification);
-		fprintf(fp, "\tlast_service_notification=%llu\n", (unsigned long long)temp_contact->last_service_notification);
-		fprintf(fp, "\thost_notifications_enabled=%d\n", temp_contact->host_notifications_enabled);
-		fprintf(fp, "\tservice_notifications_enabled=%d\n", temp_contact->service_notifications_enabled);
+		sd_printf(&out, "\tlast_host_notification=%llu\n", (unsigned long long)temp_contact->last_host_notification);
+		sd_printf(&out, "\tlast_service_notification=%llu\n", (unsigned long long)temp_contact->last_service_notification);
+		sd_printf(&out, "\thost_notifications_enabled=%d\n", temp_contact->host_notifications_enabled);
+		sd_printf(&out, "\tservice_notifications_enabled=%d\n", temp_contact->service_notifications_enabled);
 		/* custom variables */
 		for(temp_customvariablesmember = temp_contact->custom_variables; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
 			if(temp_customvariablesmember->variable_name)
-				fprintf(fp, "\t_%s=%d;%s\n", temp_customvariablesmember->variable_name, temp_customvariablesmember->has_been_modified, (temp_customvariablesmember->variable_value == NULL) ? "" : temp_customvariablesmember->variable_value);
+				sd_printf(&out, "\t_%s=%d;%s\n", temp_customvariablesmember->variable_name, temp_customvariablesmember->has_been_modified, (temp_customvariablesmember->variable_value == NULL) ? "" : temp_customvariablesmember->variable_value);
 			}
-		fprintf(fp, "\t}\n\n");
+		sd_printf(&out, "\t}\n\n");
 		}
 
 	/* save all comments */
-	for(temp_comment = comment_list; temp_comment != NULL; temp_comment = temp_comment->next) {
+	for(temp_comment = snap->comment_list; temp_comment != NULL; temp_comment = temp_comment->next) {
 
 		if(temp_comment->comment_type == HOST_COMMENT)
-			fprintf(fp, "hostcomment {\n");
+			sd_printf(&out, "hostcomment {\n");
 		else
-			fprintf(fp, "servicecomment {\n");
-		fprintf(fp, "\thost_name=%s\n", temp_comment->host_name);
+			sd_printf(&out, "servicecomment {\n");
+		sd_printf(&out, "\thost_name=%s\n", temp_comment->host_name);
 		if(temp_comment->comment_type == SERVICE_COMMENT)
-			fprintf(fp, "\tservice_description=%s\n", temp_comment->service_description);
-		fprintf(fp, "\tentry_type=%d\n", temp_comment->entry_type);
-		fprintf(fp, "\tcomment_id=%lu\n", temp_comment->comment_id);
-		fprintf(fp, "\tsource=%d\n", temp_comment->source);
-		fprintf(fp, "\tpersistent=%d\n", temp_comment->persistent);
-		fprintf(fp, "\tentry_time=%llu\n", (unsigned long long)temp_comment->entry_time);
-		fprintf(fp, "\texpires=%d\n", temp_comment->expires);
-		fprintf(fp, "\texpire_time=%llu\n", (unsigned long long)temp_comment->expire_time);
-		fprintf(fp, "\tauthor=%s\n", temp_comment->author);
-		fprintf(fp, "\tcomment_data=%s\n", temp_comment->comment_data);
-		fprintf(fp, "\t}\n\n");
+			sd_printf(&out, "\tservice_description=%s\n", temp_comment->service_description);
+		sd_printf(&out, "\tentry_type=%d\n", temp_comment->entry_type);
+		sd_printf(&out, "\tcomment_id=%lu\n", temp_comment->comment_id);
+		sd_printf(&out, "\tsource=%d\n", temp_comment->source);
+		sd_printf(&out, "\tpersistent=%d\n", temp_comment->persistent);
+		sd_printf(&out, "\tentry_time=%llu\n", (unsigned long long)temp_comment->entry_time);
+		sd_printf(&out, "\texpires=%d\n", temp_comment->expires);
+		sd_printf(&out, "\texpire_time=%llu\n", (unsigned long long)temp_comment->expire_time);
+		sd_printf(&out, "\tauthor=%s\n", temp_comment->author);
+		sd_printf(&out, "\tcomment_data=%s\n", temp_comment->comment_data);
+		sd_printf(&out, "\t}\n\n");
 		}
 
 	/* save all downtime */
-	for(temp_downtime = scheduled_downtime_list; temp_downtime != NULL; temp_downtime = temp_downtime->next) {
+	for(temp_downtime = snap->scheduled_downtime_list; temp_downtime != NULL; temp_downtime = temp_downtime->next) {
 
 		if(temp_downtime->type == HOST_DOWNTIME)
-			fprintf(fp, "hostdowntime {\n");
+			sd_printf(&out, "hostdowntime {\n");
 		else
-			fprintf(fp, "servicedowntime {\n");
-		fprintf(fp, "\thost_name=%s\n", temp_downtime->host_name);
+			sd_printf(&out, "servicedowntime {\n");
+		sd_printf(&out, "\thost_name=%s\n", temp_downtime->host_name);
 		if(temp_downtime->type == SERVICE_DOWNTIME)
-			fprintf(fp, "\tservice_description=%s\n", temp_downtime->service_description);
-		fprintf(fp, "\tdowntime_id=%lu\n", temp_downtime->downtime_id);
-		fprintf(fp, "\tcomment_id=%lu\n", temp_downtime->comment_id);
-		fprintf(fp, "\tentry_time=%llu\n", (unsigned long long)temp_downtime->entry_time);
-		fprintf(fp, "\tstart_time=%llu\n", (unsigned long long)temp_downtime->start_time);
-		fprintf(fp, "\tflex_downtime_start=%llu\n", (unsigned long long)temp_downtime->flex_downtime_start);
-		fprintf(fp, "\tend_time=%llu\n", (unsigned long long)temp_downtime->end_time);
-		fprintf(fp, "\ttriggered_by=%lu\n", temp_downtime->triggered_by);
-		fprintf(fp, "\tfixed=%d\n", temp_downtime->fixed);
-		fprintf(fp, "\tduration=%lu\n", temp_downtime->duration);
-		fprintf(fp, "\tis_in_effect=%d\n", temp_downtime->is_in_effect);
-		fprintf(fp, "\tstart_notification_sent=%d\n", temp_downtime->start_notification_sent);
-		fprintf(fp, "\tauthor=%s\n", temp_downtime->author);
-		fprintf(fp, "\tcomment=%s\n", temp_downtime->comment);
-		fprintf(fp, "\t}\n\n");
+			sd_printf(&out, "\tservice_description=%s\n", temp_downtime->service_description);
+		sd_printf(&out, "\tdowntime_id=%lu\n", temp_downtime->downtime_id);
+		sd_printf(&out, "\tcomment_id=%lu\n", temp_downtime->comment_id);
+		sd_printf(&out, "\tentry_time=%llu\n", (unsigned long long)temp_downtime->entry_time);
+		sd_printf(&out, "\tstart_time=%llu\n", (unsigned long long)temp_downtime->start_time);
+		sd_printf(&out, "\tflex_downtime_start=%llu\n", (unsigned long long)temp_downtime->flex_downtime_start);
+		sd_printf(&out, "\tend_time=%llu\n", (unsigned long long)temp_downtime->end_time);
+		sd_printf(&out, "\ttriggered_by=%lu\n", temp_downtime->triggered_by);
+		sd_printf(&out, "\tfixed=%d\n", temp_downtime->fixed);
+		sd_printf(&out, "\tduration=%lu\n", temp_downtime->duration);
+		sd_printf(&out, "\tis_in_effect=%d\n", temp_downtime->is_in_effect);
+		sd_printf(&out, "\tstart_notification_sent=%d\n", temp_downtime->start_notification_sent);
+		sd_printf(&out, "\tauthor=%s\n", temp_downtime->author);
+		sd_printf(&out, "\tcomment=%s\n", temp_downtime->comment);
+		sd_printf(&out, "\t}\n\n");
 		}
 
 
+	/* flush the file to disk */
+	sd_flush(&out);
+	my_free(out.buf);
+
 	/* reset file permissions */
 	fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
 
-	/* flush the file to disk */
-	fflush(fp);
-
 	/* fsync the file so that it is completely written out before moving it */
 	fsync(fd);
 
-	/* close the temp file */
-	result = fclose(fp);
-
-	/* save/close was successful */
-	if(result == 0) {
+	/* save was successful */
+	if(out.error == FALSE) {
 
 		result = OK;
 
@@ -471,6 +706,32 @@ int xsddefault_save_status_data(void) {
 		logit(NSLOG_RUNTIME_ERROR, TRUE, "Error: Unable to save status file: %s", strerror(errno));
 		}
 
+	/* keep the file we just wrote around, so the next update can copy from it */
+	xsddefault_drop_previous_status();
+	if(result == OK && out.flushed > 0) {
+		prev_status.map = mmap(NULL, out.flushed, PROT_READ, MAP_SHARED, fd, 0);
+		if(prev_status.map == MAP_FAILED)
+			prev_status.map = NULL;
+		}
+	if(prev_status.map) {
+		prev_status.size = out.flushed;
+		prev_status.hosts = host_records;
+		prev_status.services = service_records;
+		prev_status.num_hosts = snap->total_hosts;
+		prev_status.num_services = snap->total_services;
+		}
+	else {
+		my_free(host_records);
+		my_free(service_records);
+		}
+	close(fd);
+
+	status_update_stats.bytes_written = out.flushed;
+	status_update_stats.objects_written = objects_written;
+	status_update_stats.objects_skipped = objects_skipped;
+
+	log_debug_info(DEBUGL_STATUSDATA, 1, "Wrote %llu bytes of status data: %u objects formatted, %u copied from the previous file\n", out.flushed, objects_written, objects_skipped);
+
 	/* free memory */
 	my_free(tmp_log);
 
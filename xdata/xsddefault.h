@@ -26,7 +26,9 @@
 #ifdef NSCORE
 int xsddefault_initialize_status_data(const char *);
 int xsddefault_cleanup_status_data(int);
-int xsddefault_save_status_data(void);
+struct state_snapshot;
+int xsddefault_save_status_data(const struct state_snapshot *);
+int xsddefault_needs_full_update(void);
 #endif
 
 #ifdef NSCGI